@@ -3,7 +3,29 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/stats.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
+#ifdef USERPROG
+#include "userprog/process.h"
+#endif
+
+/* Buckets in a latency histogram.  Bucket B counts requests
+   that took at least 2**B nanoseconds (bucket 0 also counts
+   shorter ones) from submission to completion. */
+#define LATENCY_BUCKETS 40
+
+/* Statistics for transfers in one direction. */
+struct block_io_stats
+  {
+    unsigned long long ops;             /* Requests. */
+    unsigned long long sectors;         /* Sectors moved. */
+    unsigned long long latency[LATENCY_BUCKETS];  /* Requests by time. */
+  };
 
 /* A block device. */
 struct block
@@ -16,9 +38,34 @@ struct block
 
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
+    size_t max_transfer;                /* Most sectors per driver request. */
+    struct block *parent;               /* Device this is a part of, or null. */
+    block_sector_t start;               /* First sector within PARENT. */
 
-    unsigned long long read_cnt;        /* Number of sectors read. */
-    unsigned long long write_cnt;       /* Number of sectors written. */
+    /* Request queue.  Used only if QUEUED is true, in which case
+       DISPATCHER_CNT dispatcher threads serve the queue. */
+    bool queued;                        /* Has dispatcher threads? */
+    size_t dispatcher_cnt;              /* Dispatchers to start. */
+    struct lock queue_lock;             /* Protects the members below. */
+    struct condition queue_ready;       /* Signaled when a request arrives
+                                           or a batch finishes. */
+    struct list queue;                  /* Pending requests, by sector. */
+    struct list inflight;               /* Requests being transferred. */
+    block_sector_t head_pos;            /* Sector after the last dispatched. */
+    unsigned long long next_seq;        /* Next request's seq. */
+    unsigned long long batch_cnt;       /* Batches dispatched. */
+    size_t depth;                       /* Requests queued or in flight. */
+
+    /* Queue statistics, updated under QUEUE_LOCK but read
+       without it. */
+    size_t depth_max;                   /* High-water mark of DEPTH. */
+    unsigned long long merged_cnt;      /* Requests merged into another's
+                                           driver call. */
+    unsigned long long jump_cnt;        /* Batches served ahead of C-LOOK
+                                           order for their class. */
+
+    struct block_io_stats stats[2];     /* Reads, then writes. */
+    struct seqlock stats_seq;           /* Protects STATS. */
   };
 
 /* List of all block devices. */
@@ -99,12 +146,23 @@ block_get_by_name (const char *name)
   return NULL;
 }
 
-/* Verifies that SECTOR is a valid offset within BLOCK.
-   Panics if not. */
+/* Number of sector pointers that block_read_multiple() and
+   block_write_multiple() pass to a driver at a time. */
+#define VEC_CNT 32
+
+/* Most sectors that the dispatcher merges from separate requests
+   into one driver call. */
+#define MERGE_MAX 64
+
+/* Number of request priority classes. */
+#define IO_CLASS_CNT 3
+
+/* Verifies that the CNT sectors starting at SECTOR are valid
+   offsets within BLOCK.  Panics if not. */
 static void
-check_sector (struct block *block, block_sector_t sector)
+check_sectors (struct block *block, block_sector_t sector, size_t cnt)
 {
-  if (sector >= block->size)
+  if (sector >= block->size || cnt > block->size - sector)
     {
       /* We do not use ASSERT because we want to panic here
          regardless of whether NDEBUG is defined. */
@@ -113,6 +171,115 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Verifies that SECTOR is a valid offset within BLOCK.
+   Panics if not. */
+static void
+check_sector (struct block *block, block_sector_t sector)
+{
+  check_sectors (block, sector, 1);
+}
+
+/* Records in BLOCK's statistics a request, in the direction
+   given by WRITE, that moved CNT sectors in CYCLES cycles of
+   timer_cycles().
+   Several threads may be transferring sectors on BLOCK at once,
+   so this runs with interrupts off, as seqlock writers must. */
+static void
+account (struct block *block, bool write, size_t cnt, uint64_t cycles) 
+{
+  struct block_io_stats *st = &block->stats[write];
+  uint64_t ns = timer_cycles_to_ns (cycles);
+  enum intr_level old_level;
+  int bucket = 0;
+
+  while (bucket < LATENCY_BUCKETS - 1 && ns >> (bucket + 1) != 0)
+    bucket++;
+  TRACE (TRACE_BLOCK_IO, thread_current (), cnt * 2 + write, ns / 1000);
+
+  old_level = intr_disable ();
+  seqlock_write_begin (&block->stats_seq);
+  st->ops++;
+  st->sectors += cnt;
+  st->latency[bucket]++;
+  seqlock_write_end (&block->stats_seq);
+  intr_set_level (old_level);
+}
+
+/* Records request R, which has finished, in the statistics of
+   the device it was submitted to and of each device that one is
+   part of, and then calls its completion function. */
+static void
+finish_request (struct block_request *r) 
+{
+  uint64_t cycles = timer_cycles () - r->stamp;
+  struct block *block;
+
+  for (block = r->block; block != NULL; block = block->parent)
+    account (block, r->write, r->cnt, cycles);
+  r->complete (r);
+}
+
+/* Returns true if requests for BLOCK go through a queue, its own
+   or that of the device it is part of. */
+static bool
+is_queued (struct block *block)
+{
+  while (block->parent != NULL)
+    block = block->parent;
+  return block->queued;
+}
+
+/* Has BLOCK's driver transfer the CNT sectors starting at SECTOR
+   to or from BUFFERS, without going through the queue or
+   counting them. */
+static void
+transfer (struct block *block, block_sector_t sector,
+          void *const buffers[], size_t cnt, bool write)
+{
+  size_t i;
+
+  if (write)
+    {
+      if (block->ops->writev != NULL)
+        block->ops->writev (block->aux, sector,
+                            (const void *const *) buffers, cnt);
+      else
+        for (i = 0; i < cnt; i++)
+          block->ops->write (block->aux, sector + i, buffers[i]);
+    }
+  else
+    {
+      if (block->ops->readv != NULL)
+        block->ops->readv (block->aux, sector, buffers, cnt);
+      else
+        for (i = 0; i < cnt; i++)
+          block->ops->read (block->aux, sector + i, buffers[i]);
+    }
+}
+
+/* Completion function for submit_and_wait(). */
+static void
+wake_waiter (struct block_request *r) 
+{
+  sema_up (r->aux);
+}
+
+/* Submits a request to transfer the CNT sectors starting at
+   SECTOR of BLOCK to or from BUFFERS, and waits for it to
+   finish. */
+static void
+submit_and_wait (struct block *block, block_sector_t sector,
+                 void *const buffers[], size_t cnt, bool write) 
+{
+  struct block_request r;
+  struct semaphore done;
+
+  sema_init (&done, 0);
+  block_request_init (&r, sector, cnt, buffers, write, wake_waiter, &done);
+  block_submit (block, &r);
+  sema_down (&done);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -120,9 +287,17 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
+  uint64_t start;
+
+  if (is_queued (block))
+    {
+      submit_and_wait (block, sector, &buffer, 1, false);
+      return;
+    }
   check_sector (block, sector);
+  start = timer_cycles ();
   block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  account (block, false, 1, timer_cycles () - start);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +308,373 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
+  uint64_t start;
+
+  if (is_queued (block))
+    {
+      submit_and_wait (block, sector, (void **) &buffer, 1, true);
+      return;
+    }
   check_sector (block, sector);
   ASSERT (block->type != BLOCK_FOREIGN);
+  start = timer_cycles ();
   block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  account (block, true, 1, timer_cycles () - start);
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR from
+   BLOCK into the CNT buffers in BUFFERS, each of which must have
+   room for BLOCK_SECTOR_SIZE bytes, in as few driver requests as
+   the driver allows.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_readv (struct block *block, block_sector_t sector,
+             void *const buffers[], size_t cnt) 
+{
+  uint64_t start;
+
+  if (is_queued (block))
+    {
+      submit_and_wait (block, sector, buffers, cnt, false);
+      return;
+    }
+  check_sectors (block, sector, cnt);
+  start = timer_cycles ();
+  transfer (block, sector, buffers, cnt, false);
+  account (block, false, cnt, timer_cycles () - start);
+}
+
+/* Writes the CNT consecutive sectors starting at SECTOR to BLOCK
+   from the CNT buffers in BUFFERS, each of which must contain
+   BLOCK_SECTOR_SIZE bytes, in as few driver requests as the
+   driver allows.  Returns after the block device has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_writev (struct block *block, block_sector_t sector,
+              const void *const buffers[], size_t cnt) 
+{
+  uint64_t start;
+
+  if (is_queued (block))
+    {
+      submit_and_wait (block, sector, (void *const *) buffers, cnt, true);
+      return;
+    }
+  check_sectors (block, sector, cnt);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  start = timer_cycles ();
+  transfer (block, sector, (void *const *) buffers, cnt, true);
+  account (block, true, cnt, timer_cycles () - start);
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR from
+   BLOCK into BUFFER, which must have room for CNT *
+   BLOCK_SECTOR_SIZE bytes. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffer_) 
+{
+  uint8_t *buffer = buffer_;
+
+  while (cnt > 0) 
+    {
+      void *buffers[VEC_CNT];
+      size_t n = cnt < VEC_CNT ? cnt : VEC_CNT;
+      size_t i;
+
+      for (i = 0; i < n; i++)
+        buffers[i] = buffer + i * BLOCK_SECTOR_SIZE;
+      block_readv (block, sector, buffers, n);
+      sector += n;
+      buffer += n * BLOCK_SECTOR_SIZE;
+      cnt -= n;
+    }
+}
+
+/* Writes the CNT consecutive sectors starting at SECTOR to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving the
+   data. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      size_t cnt, const void *buffer_) 
+{
+  const uint8_t *buffer = buffer_;
+
+  while (cnt > 0) 
+    {
+      const void *buffers[VEC_CNT];
+      size_t n = cnt < VEC_CNT ? cnt : VEC_CNT;
+      size_t i;
+
+      for (i = 0; i < n; i++)
+        buffers[i] = buffer + i * BLOCK_SECTOR_SIZE;
+      block_writev (block, sector, buffers, n);
+      sector += n;
+      buffer += n * BLOCK_SECTOR_SIZE;
+      cnt -= n;
+    }
+}
+
+/* Initializes R as a request to transfer the CNT consecutive
+   sectors starting at SECTOR to or from the CNT sector-sized
+   buffers in BUFFERS: from the device into the buffers if WRITE
+   is false, from the buffers to the device if it is true.
+   COMPLETE will be called with R once it is done. */
+void
+block_request_init (struct block_request *r, block_sector_t sector,
+                    size_t cnt, void *const buffers[], bool write,
+                    block_complete_func *complete, void *aux) 
+{
+  ASSERT (cnt > 0);
+  ASSERT (complete != NULL);
+
+  r->sector = sector;
+  r->cnt = cnt;
+  r->buffers = buffers;
+  r->write = write;
+  r->complete = complete;
+  r->aux = aux;
+}
+
+/* Orders block_request elements by ascending sector.  Requests
+   for the same sector stay in submission order. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED) 
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+
+  return a->sector < b->sector;
+}
+
+/* Submits request R for BLOCK and returns without waiting for it
+   to finish, if BLOCK has a queue.  R's sector is rebased onto
+   the device that owns the queue.  If there is no queue, carries
+   out R at once, and calls its completion function before
+   returning. */
+void
+block_submit (struct block *block, struct block_request *r) 
+{
+  ASSERT (!intr_context ());
+  check_sectors (block, r->sector, r->cnt);
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+
+  r->block = block;
+  r->stamp = timer_cycles ();
+  r->priority = thread_get_priority ();
+#ifdef USERPROG
+  process_count_sectors (r->write, r->cnt);
+#endif
+  for (; block->parent != NULL; block = block->parent)
+    r->sector += block->start;
+
+  if (!block->queued)
+    {
+      transfer (block, r->sector, r->buffers, r->cnt, r->write);
+      finish_request (r);
+      return;
+    }
+
+  lock_acquire (&block->queue_lock);
+  r->seq = block->next_seq++;
+  r->batch = block->batch_cnt;
+  if (++block->depth > block->depth_max)
+    block->depth_max = block->depth;
+  list_insert_ordered (&block->queue, &r->elem, request_less, NULL);
+  cond_signal (&block->queue_ready, &block->queue_lock);
+  lock_release (&block->queue_lock);
+}
+
+/* Returns true if requests Q and R overlap and one of the two
+   writes. */
+static bool
+conflicts (const struct block_request *q, const struct block_request *r)
+{
+  return ((q->write || r->write)
+          && q->sector < r->sector + r->cnt
+          && r->sector < q->sector + q->cnt);
+}
+
+/* Returns true if a request older than R in BLOCK's queue, or a
+   request that another dispatcher has in flight, overlaps R, and
+   one of the two writes, so that R has to wait for it to preserve
+   submission order. */
+static bool
+is_blocked (struct block *block, const struct block_request *r) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      const struct block_request *q
+        = list_entry (e, struct block_request, elem);
+      if (q->seq < r->seq && conflicts (q, r))
+        return true;
+    }
+  for (e = list_begin (&block->inflight); e != list_end (&block->inflight);
+       e = list_next (e))
+    if (conflicts (list_entry (e, struct block_request, elem), r))
+      return true;
+  return false;
+}
+
+/* Returns the priority class of request R in BLOCK's queue,
+   from 0 to IO_CLASS_CNT - 1, counting the classes it has moved
+   up while waiting. */
+static int
+request_class (const struct block *block, const struct block_request *r) 
+{
+  int class = (r->priority > PRI_DEFAULT ? 2
+               : r->priority == PRI_DEFAULT ? 1 : 0);
+  unsigned long long age = ((block->batch_cnt - r->batch)
+                            / BLOCK_AGE_BATCHES);
+
+  return age < (unsigned) (IO_CLASS_CNT - 1 - class)
+         ? class + (int) age : IO_CLASS_CNT - 1;
+}
+
+/* Moves the next requests to serve from BLOCK's queue, which
+   must not be empty, to its in-flight list and stores them in
+   BATCH, whose room must be at least MERGE_MAX.  Returns the
+   number of requests and stores their total sectors in *CNT.
+   Returns 0 if every queued request has to wait for one in
+   flight.
+
+   The first request is the one that C-LOOK would choose among
+   the requests of the highest class that are not blocked: the
+   lowest sector at or past the end of the previous batch, or the
+   lowest sector of all if there's none.  It is followed by any
+   requests in the same direction, of any class, for the sectors
+   that come just after it, up to MERGE_MAX sectors and the
+   driver's limit. */
+static size_t
+next_batch (struct block *block, struct block_request *batch[], size_t *cnt) 
+{
+  struct block_request *r = NULL;
+  struct block_request *first = NULL, *ahead = NULL;
+  int r_key = -1;
+  struct list_elem *e;
+  size_t limit = block->max_transfer < MERGE_MAX ? block->max_transfer
+                                                 : MERGE_MAX;
+  size_t n, i;
+
+  ASSERT (lock_held_by_current_thread (&block->queue_lock));
+  ASSERT (!list_empty (&block->queue));
+
+  /* Rank each request by class, then by whether it lies ahead of
+     the head.  The queue is in sector order, so the first request
+     of the best rank is the one C-LOOK takes within it.  FIRST
+     and AHEAD track what C-LOOK would take regardless of class,
+     for the statistics.  With a single dispatcher nothing else is
+     in flight, so the oldest request is never blocked. */
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *q = list_entry (e, struct block_request, elem);
+      bool is_ahead = q->sector >= block->head_pos;
+      int key = request_class (block, q) * 2 + is_ahead;
+
+      if ((key <= r_key && first != NULL && (ahead != NULL || !is_ahead))
+          || is_blocked (block, q))
+        continue;
+      if (first == NULL)
+        first = q;
+      if (ahead == NULL && is_ahead)
+        ahead = q;
+      if (key > r_key)
+        {
+          r = q;
+          r_key = key;
+        }
+    }
+  if (r == NULL)
+    {
+      ASSERT (block->dispatcher_cnt > 1);
+      return 0;
+    }
+  if (r != (ahead != NULL ? ahead : first))
+    block->jump_cnt++;
+
+  batch[0] = r;
+  n = 1;
+  *cnt = r->cnt;
+  for (e = list_next (&r->elem); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *q = list_entry (e, struct block_request, elem);
+      if (q->sector != r->sector + *cnt || q->write != r->write
+          || *cnt + q->cnt > limit || is_blocked (block, q))
+        break;
+      batch[n++] = q;
+      *cnt += q->cnt;
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      list_remove (&batch[i]->elem);
+      list_push_back (&block->inflight, &batch[i]->elem);
+    }
+  block->head_pos = r->sector + *cnt;
+  block->merged_cnt += n - 1;
+  block->batch_cnt++;
+  return n;
+}
+
+/* Dispatcher thread for BLOCK_, a struct block.  Serves the
+   device's queue one batch at a time.  A device whose driver can
+   carry out several requests at once has several dispatchers,
+   each with a batch in flight. */
+static void
+dispatcher (void *block_) 
+{
+  struct block *block = block_;
+
+  for (;;) 
+    {
+      struct block_request *batch[MERGE_MAX];
+      void *buffers[MERGE_MAX];
+      size_t req_cnt, cnt, i;
+
+      lock_acquire (&block->queue_lock);
+      while (list_empty (&block->queue)
+             || (req_cnt = next_batch (block, batch, &cnt)) == 0)
+        cond_wait (&block->queue_ready, &block->queue_lock);
+      lock_release (&block->queue_lock);
+
+      if (req_cnt == 1)
+        transfer (block, batch[0]->sector, batch[0]->buffers, cnt,
+                  batch[0]->write);
+      else 
+        {
+          /* A merged batch has at most MERGE_MAX sectors. */
+          size_t j, k = 0;
+
+          for (i = 0; i < req_cnt; i++)
+            for (j = 0; j < batch[i]->cnt; j++)
+              buffers[k++] = batch[i]->buffers[j];
+          transfer (block, batch[0]->sector, buffers, cnt, batch[0]->write);
+        }
+
+      /* Take the batch out of flight before completing it, since
+         completion may free the requests.  Other dispatchers may
+         be waiting for it. */
+      lock_acquire (&block->queue_lock);
+      for (i = 0; i < req_cnt; i++)
+        list_remove (&batch[i]->elem);
+      block->depth -= req_cnt;
+      if (block->dispatcher_cnt > 1)
+        cond_broadcast (&block->queue_ready, &block->queue_lock);
+      lock_release (&block->queue_lock);
+
+      for (i = 0; i < req_cnt; i++)
+        finish_request (batch[i]);
+    }
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,10 +698,73 @@ block_type (struct block *block)
   return block->type;
 }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Returns the most consecutive sectors that BLOCK's driver
+   moves in a single request to the hardware.  Callers that batch
+   I/O can size their batches to fit. */
+size_t
+block_max_transfer (struct block *block)
+{
+  return block->max_transfer;
+}
+
+/* Copies BLOCK's statistics for reads and then writes into
+   STATS[0] and STATS[1]. */
+static void
+get_stats (struct block *block, struct block_io_stats stats[2]) 
+{
+  unsigned seq;
+
+  do
+    {
+      seq = seqlock_read_begin (&block->stats_seq);
+      stats[0] = block->stats[0];
+      stats[1] = block->stats[1];
+    }
+  while (seqlock_read_retry (&block->stats_seq, seq));
+}
+
+/* Returns the number of sectors read from or written to BLOCK so
+   far, which tells a background task whether the device has been
+   busy. */
+unsigned long long
+block_io_count (struct block *block) 
+{
+  unsigned long long reads, writes;
+  unsigned seq;
+
+  do
+    {
+      seq = seqlock_read_begin (&block->stats_seq);
+      reads = block->stats[0].sectors;
+      writes = block->stats[1].sectors;
+    }
+  while (seqlock_read_retry (&block->stats_seq, seq));
+  return reads + writes;
+}
+
+/* Prints HIST, BLOCK's latency histogram for requests of the
+   kind named by WHAT, trimmed to the last nonempty bucket. */
+static void
+print_latency (struct block *block, const char *what,
+               const unsigned long long hist[LATENCY_BUCKETS]) 
+{
+  int i, last;
+
+  for (last = LATENCY_BUCKETS - 1; last > 0; last--)
+    if (hist[last] != 0)
+      break;
+  printf ("%s: %s latency (ns):", block->name, what);
+  for (i = 0; i <= last; i++)
+    printf (" <2^%d:%llu", i + 1, hist[i]);
+  printf ("\n");
+}
+
+/* Prints statistics for each block device used for a Pintos
+   role, then queue statistics for each device with a queue. */
 void
 block_print_stats (void)
 {
+  struct list_elem *e;
   int i;
 
   for (i = 0; i < BLOCK_ROLE_CNT; i++)
@@ -171,11 +772,31 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
+          struct block_io_stats st[2];
+
+          get_stats (block, st);
           printf ("%s (%s): %llu reads, %llu writes\n",
                   block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
+                  st[0].sectors, st[1].sectors);
+          printf ("%s: %llu bytes read in %llu requests, "
+                  "%llu bytes written in %llu requests\n",
+                  block->name, st[0].sectors * BLOCK_SECTOR_SIZE, st[0].ops,
+                  st[1].sectors * BLOCK_SECTOR_SIZE, st[1].ops);
+          print_latency (block, "read", st[0].latency);
+          print_latency (block, "write", st[1].latency);
         }
     }
+
+  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+       e = list_next (e))
+    {
+      struct block *block = list_entry (e, struct block, list_elem);
+      if (block->queued)
+        printf ("%s: queue depth %zu max, %llu requests merged, "
+                "%llu batches moved up by priority\n",
+                block->name, block->depth_max, block->merged_cnt,
+                block->jump_cnt);
+    }
 }
 
 /* Registers a new block device with the given NAME.  If
@@ -198,8 +819,35 @@ block_register (const char *name, enum block_type type,
   block->size = size;
   block->ops = ops;
   block->aux = aux;
-  block->read_cnt = 0;
-  block->write_cnt = 0;
+  block->max_transfer = ops->readv != NULL ? SIZE_MAX : 1;
+  block->parent = NULL;
+  block->start = 0;
+  block->queued = false;
+  block->dispatcher_cnt = 1;
+  lock_init (&block->queue_lock);
+  cond_init (&block->queue_ready);
+  list_init (&block->queue);
+  list_init (&block->inflight);
+  block->head_pos = 0;
+  block->next_seq = 0;
+  block->batch_cnt = 0;
+  block->depth = 0;
+  block->depth_max = 0;
+  block->merged_cnt = 0;
+  block->jump_cnt = 0;
+  memset (block->stats, 0, sizeof block->stats);
+  seqlock_init (&block->stats_seq);
+  stats_counter ("block", block->name, "read_ops", &block->stats[0].ops);
+  stats_counter ("block", block->name, "read_sectors",
+                 &block->stats[0].sectors);
+  stats_histogram ("block", block->name, "read_latency_log2_ns",
+                   block->stats[0].latency, LATENCY_BUCKETS);
+  stats_counter ("block", block->name, "write_ops", &block->stats[1].ops);
+  stats_counter ("block", block->name, "write_sectors",
+                 &block->stats[1].sectors);
+  stats_histogram ("block", block->name, "write_latency_log2_ns",
+                   block->stats[1].latency, LATENCY_BUCKETS);
+  stats_counter ("block", block->name, "merged", &block->merged_cnt);
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -211,6 +859,70 @@ block_register (const char *name, enum block_type type,
   return block;
 }
 
+/* Records that BLOCK's driver moves at most CNT consecutive
+   sectors per request to the hardware.  A driver that registers
+   with READV and WRITEV but has a limit calls this right after
+   block_register(). */
+void
+block_set_max_transfer (struct block *block, size_t cnt)
+{
+  ASSERT (cnt > 0);
+  block->max_transfer = cnt;
+}
+
+/* Records that BLOCK's driver can carry out CNT requests at
+   once, each in a thread of its own, so that block_start_queue()
+   starts CNT dispatcher threads and keeps up to CNT batches in
+   flight.  A driver calls this before block_start_queue(). */
+void
+block_set_dispatchers (struct block *block, size_t cnt)
+{
+  ASSERT (cnt > 0);
+  ASSERT (!block->queued);
+  block->dispatcher_cnt = cnt;
+}
+
+/* Records that BLOCK covers the sectors of PARENT starting at
+   START, as a partition does.  Requests submitted to BLOCK then
+   go to PARENT's queue, if it has one. */
+void
+block_set_parent (struct block *block, struct block *parent,
+                  block_sector_t start) 
+{
+  ASSERT (start + block->size <= parent->size);
+  block->parent = parent;
+  block->start = start;
+}
+
+/* Starts dispatcher threads, one unless the driver asked for
+   more with block_set_dispatchers(), to serve a request queue for
+   BLOCK, which must not be part of another device.  From then
+   on, all I/O to BLOCK and the devices within it goes through
+   the queue.  If no thread can be created, BLOCK's I/O stays
+   synchronous. */
+void
+block_start_queue (struct block *block) 
+{
+  char name[sizeof block->name + 3];
+  size_t i;
+
+  ASSERT (block->parent == NULL);
+  ASSERT (!block->queued);
+
+  snprintf (name, sizeof name, "%s-io", block->name);
+  for (i = 0; i < block->dispatcher_cnt; i++)
+    if (thread_create (name, PRI_MAX, dispatcher, block) == TID_ERROR)
+      break;
+  if (i == 0)
+    {
+      printf ("%s: no dispatcher thread, using synchronous I/O\n",
+              block->name);
+      return;
+    }
+  block->dispatcher_cnt = i;
+  block->queued = true;
+}
+
 /* Returns the block device corresponding to LIST_ELEM, or a null
    pointer if LIST_ELEM is the list end of all_blocks. */
 static struct block *
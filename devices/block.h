@@ -1,6 +1,8 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <list.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
 
@@ -53,22 +55,94 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
+void block_readv (struct block *, block_sector_t, void *const buffers[],
+                  size_t cnt);
+void block_writev (struct block *, block_sector_t,
+                   const void *const buffers[], size_t cnt);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
+size_t block_max_transfer (struct block *);
+
+/* Asynchronous requests.
+
+   block_submit() queues a request and returns at once.  Each
+   device with a queue has a dispatcher thread, or several for a
+   driver that can carry out requests in parallel, that serves the
+   queue in C-LOOK order within priority classes, merging requests
+   for adjacent sectors into one driver call, and calls each
+   request's COMPLETE function, in the dispatcher thread, once the
+   request is done.  The synchronous functions above go through
+   the same queue.
+
+   A request's class comes from the priority of the thread that
+   submitted it, donations included: above PRI_DEFAULT, at it, or
+   below it.  The highest class with a request ready goes first,
+   so a batch thread's stream of requests cannot hold up a
+   high-priority thread's one read for long.  So that low classes
+   are not starved, a request moves up a class for every
+   BLOCK_AGE_BATCHES batches the device serves while it waits. */
+#define BLOCK_AGE_BATCHES 16
+struct block_request;
+typedef void block_complete_func (struct block_request *);
+
+/* A request to read or write CNT consecutive sectors.  The
+   caller owns the storage, which must stay valid, along with the
+   buffers, until COMPLETE runs.  COMPLETE must not wait for other
+   I/O on the same device. */
+struct block_request
+  {
+    struct list_elem elem;              /* Element in device queue. */
+    block_sector_t sector;              /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+    void *const *buffers;               /* CNT sector-sized buffers. */
+    bool write;                         /* Write rather than read? */
+    block_complete_func *complete;      /* Called when done. */
+    void *aux;                          /* For COMPLETE's use. */
+    unsigned long long seq;             /* Submission order. */
+    struct block *block;                /* Device it was submitted to. */
+    uint64_t stamp;                     /* timer_cycles() at submission. */
+    int priority;                       /* Submitter's priority. */
+    unsigned long long batch;           /* Device's batch count at
+                                           submission. */
+  };
+
+void block_request_init (struct block_request *, block_sector_t,
+                         size_t cnt, void *const buffers[], bool write,
+                         block_complete_func *, void *aux);
+void block_submit (struct block *, struct block_request *);
 
 /* Statistics. */
+unsigned long long block_io_count (struct block *);
 void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
 
+/* A driver that can move several consecutive sectors in one
+   request provides READV and WRITEV, which transfer CNT sectors
+   starting at the given one to or from the CNT sector-sized
+   BUFFERS; one that cannot leaves them null, and the block layer
+   falls back to one READ or WRITE per sector. */
 struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+    void (*readv) (void *aux, block_sector_t, void *const buffers[],
+                   size_t cnt);
+    void (*writev) (void *aux, block_sector_t, const void *const buffers[],
+                    size_t cnt);
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
+void block_set_max_transfer (struct block *, size_t cnt);
+void block_set_dispatchers (struct block *, size_t cnt);
+void block_set_parent (struct block *, struct block *parent,
+                       block_sector_t start);
+void block_start_queue (struct block *);
 
 #endif /* devices/block.h */
@@ -0,0 +1,29 @@
+#include "devices/debugcon.h"
+#include "threads/io.h"
+
+/* The debug console port that QEMU's isa-debugcon device and
+   Bochs's port_e9_hack provide.  Every byte written to it
+   appears on the host at once, with no line status to poll and
+   no baud rate, and a whole buffer goes out with a single string
+   instruction, which the emulator handles in one exit instead of
+   one exit per byte as for the serial port.  Reading the port
+   returns its own number if the device is there. */
+#define DEBUGCON_PORT 0xe9
+
+/* Whether the port is there, once probed. */
+static enum { UNPROBED, ABSENT, PRESENT } state;
+
+/* Writes the N bytes in BUFFER to the debug console and returns
+   true, if the emulator provides one.  Otherwise returns false,
+   and the caller should use the serial port instead. */
+bool
+debugcon_putbuf (const void *buffer, size_t n) 
+{
+  if (state == UNPROBED)
+    state = inb (DEBUGCON_PORT) == DEBUGCON_PORT ? PRESENT : ABSENT;
+  if (state == ABSENT)
+    return false;
+
+  outsb (DEBUGCON_PORT, buffer, n);
+  return true;
+}
@@ -0,0 +1,9 @@
+#ifndef DEVICES_DEBUGCON_H
+#define DEVICES_DEBUGCON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+bool debugcon_putbuf (const void *, size_t);
+
+#endif /* devices/debugcon.h */
@@ -5,15 +5,21 @@
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
 
-/* ATA command block port addresses. */
+/* ATA command block port addresses.
+   With 48-bit LBA, the sector count and LBA registers are each
+   written twice, high-order byte first. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
 #define reg_error(CHANNEL) ((CHANNEL)->reg_base + 1)    /* Error. */
 #define reg_nsect(CHANNEL) ((CHANNEL)->reg_base + 2)    /* Sector Count. */
@@ -33,7 +39,9 @@
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
+#define STA_DF 0x20             /* Device Fault. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -47,8 +55,62 @@
    Many more are defined but this is the small subset that we
    use. */
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA with retries. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA with retries. */
+
+/* 48-bit LBA versions of the transfer commands [ATA-6]. */
+#define CMD_READ_SECTOR_EXT 0x24        /* READ SECTOR EXT. */
+#define CMD_WRITE_SECTOR_EXT 0x34       /* WRITE SECTOR EXT. */
+#define CMD_READ_MULTIPLE_EXT 0x29      /* READ MULTIPLE EXT. */
+#define CMD_WRITE_MULTIPLE_EXT 0x39     /* WRITE MULTIPLE EXT. */
+#define CMD_READ_DMA_EXT 0x25           /* READ DMA EXT. */
+#define CMD_WRITE_DMA_EXT 0x35          /* WRITE DMA EXT. */
+
+/* Sectors that a 28-bit LBA can address.  Disks that support
+   48-bit LBA are accessed with the EXT commands past this. */
+#define LBA28_LIMIT (1UL << 28)
+
+/* Bus master IDE port addresses [SFF-8038i].  Each channel has
+   its own set of these, 8 bytes apart, in the I/O space named by
+   the controller's PCI BAR4. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
+/* Bus Master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus Master Status Register bits. */
+#define BM_STA_SIMPLEX 0x80     /* Only one channel may use DMA at once. */
+#define BM_STA_IRQ 0x04         /* Interrupt (write 1 to clear). */
+#define BM_STA_ERROR 0x02       /* Error (write 1 to clear). */
+
+/* A Physical Region Descriptor: one physically contiguous piece
+   of a DMA transfer.  A region may not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes, 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the table's last entry. */
+  };
+#define PRD_EOT 0x8000
+
+/* Descriptors in a page-sized PRD table.  A command moves at most
+   MAX_SECTOR_CNT sectors and a sector spans at most two regions,
+   so this always suffices. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
+
+/* Most sectors that we transfer with one command.  (A 48-bit
+   command could move up to 65,536, but the block layer never asks
+   for that many at once, and a PRD table would not describe
+   them.) */
+#define MAX_SECTOR_CNT 256
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +119,15 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    bool use_dma;               /* Transfer data by bus-master DMA? */
+    bool lba48;                 /* Supports 48-bit LBA? */
+    size_t multiple;            /* Sectors per interrupt in READ/WRITE
+                                   MULTIPLE, or 0 to use READ/WRITE
+                                   SECTOR instead. */
+
+    /* Found by identify_ata_device(), for register_ata_device(). */
+    block_sector_t capacity;    /* Size in sectors. */
+    char info[128];             /* Model and serial number. */
   };
 
 /* An ATA channel (aka controller).
@@ -72,6 +143,11 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus master I/O base, 0 if none. */
+    struct prd *prdt;           /* PRD table, if bm_base is nonzero. */
+
+    struct semaphore probed;    /* Up'd when probe_channel() is done. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -81,32 +157,51 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+static uint16_t find_bus_master (void);
+static thread_func probe_channel;
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
-
-static void select_sector (struct ata_disk *, block_sector_t);
+static void register_ata_device (struct ata_disk *);
+
+static void set_multiple_mode (struct ata_disk *, const uint16_t *id);
+static bool need_lba48 (const struct ata_disk *, block_sector_t,
+                        size_t cnt);
+static void select_sectors (struct ata_disk *, block_sector_t, size_t cnt);
+static void pio_transfer (struct ata_disk *, block_sector_t,
+                          void *const buffers[], size_t cnt, bool write);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
+static bool dma_transfer (struct ata_disk *, block_sector_t,
+                          const void *const buffers[], size_t cnt,
+                          bool write);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
+static void poll_delay (unsigned *delay);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
 static void interrupt_handler (struct intr_frame *);
 
-/* Initialize the disk subsystem and detect disks. */
+/* Initialize the disk subsystem and detect disks.
+
+   Resetting a channel and identifying its disks is mostly
+   waiting on the hardware, so each channel is probed by a thread
+   of its own and the channels' waits overlap.  The disks are
+   then registered and scanned for partitions in order, so that
+   block devices always appear in the same order. */
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
+  int dev_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
-      int dev_no;
 
       /* Initialize channel. */
       snprintf (c->name, sizeof c->name, "ide%zu", chan_no);
@@ -126,6 +221,20 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      sema_init (&c->probed, 0);
+
+      /* Set up bus-master DMA, if the controller supports it.  A
+         "simplex" controller can only run one channel's DMA at a
+         time, so in that case give it to the first channel. */
+      c->bm_base = 0;
+      c->prdt = NULL;
+      if (bm_base != 0
+          && (chan_no == 0 || !(inb (bm_base + 2) & BM_STA_SIMPLEX)))
+        {
+          c->prdt = palloc_get_page (0);
+          if (c->prdt != NULL)
+            c->bm_base = bm_base + chan_no * 8;
+        }
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,29 +245,99 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->use_dma = false;
+          d->lba48 = false;
+          d->multiple = 0;
         }
 
       /* Register interrupt handler. */
       intr_register_ext (c->irq, interrupt_handler, c->name);
 
-      /* Reset hardware. */
-      reset_channel (c);
+      /* Probe the channel in the background. */
+      if (thread_create (c->name, PRI_DEFAULT, probe_channel, c)
+          == TID_ERROR)
+        probe_channel (c);
+    }
 
-      /* Distinguish ATA hard disks from other devices. */
-      if (check_device_type (&c->devices[0]))
-        check_device_type (&c->devices[1]);
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      struct channel *c = &channels[chan_no];
 
-      /* Read hard disk identity information. */
+      sema_down (&c->probed);
       for (dev_no = 0; dev_no < 2; dev_no++)
         if (c->devices[dev_no].is_ata)
-          identify_ata_device (&c->devices[dev_no]);
+          register_ata_device (&c->devices[dev_no]);
     }
 }
+
+/* Resets channel C_ and identifies the disks on it, then ups its
+   `probed' semaphore. */
+static void
+probe_channel (void *c_) 
+{
+  struct channel *c = c_;
+  int dev_no;
+
+  /* Reset hardware. */
+  reset_channel (c);
+
+  /* Distinguish ATA hard disks from other devices. */
+  if (check_device_type (&c->devices[0]))
+    check_device_type (&c->devices[1]);
+
+  /* Read hard disk identity information. */
+  for (dev_no = 0; dev_no < 2; dev_no++)
+    if (c->devices[dev_no].is_ata)
+      identify_ata_device (&c->devices[dev_no]);
+
+  sema_up (&c->probed);
+}
 
 /* Disk detection and identification. */
 
 static char *descramble_ata_string (char *, int size);
 
+/* Bus master I/O base found by probe_bus_master(). */
+static uint16_t bus_master_base;
+
+/* Accepts PCI function D if it is an IDE controller that drives
+   the legacy channels and can act as a bus master, and no such
+   controller has been found yet.  If so, enables its bus
+   mastering and records the base of its bus master I/O ports. */
+static bool
+probe_bus_master (struct pci_dev *d)
+{
+  const struct pci_bar *bar4 = &d->bar[4];
+
+  /* Both channels in compatibility mode (programming interface
+     bits 0 and 2 clear) and bus mastering available (bit 7). */
+  if (bus_master_base != 0 || (d->prog_if & 0x85) != 0x80
+      || !bar4->io || bar4->size == 0 || bar4->base == 0)
+    return false;
+
+  pci_enable (d, true);
+  bus_master_base = bar4->base;
+  return true;
+}
+
+/* Binds to mass storage (01), IDE (01) controllers. */
+static const struct pci_driver bus_master_driver =
+  {
+    "ide", PCI_ANY, PCI_ANY, 0x01, 0x01, probe_bus_master
+  };
+
+/* Looks on the PCI bus for an IDE controller that drives the
+   legacy channels and can act as a bus master.  If there is one,
+   enables its bus mastering and returns the base of its bus
+   master I/O ports.  Otherwise returns 0, and all transfers use
+   PIO. */
+static uint16_t
+find_bus_master (void)
+{
+  pci_register_driver (&bus_master_driver);
+  return bus_master_base;
+}
+
 /* Resets an ATA channel and waits for any devices present on it
    to finish the reset. */
 static void
@@ -189,14 +368,16 @@ reset_channel (struct channel *c)
     }
 
   /* Issue soft reset sequence, which selects device 0 as a side effect.
-     Also enable interrupts. */
+     Also enable interrupts.  The devices may take 2 ms after
+     SRST clears to set BSY, so wait that long before polling
+     status. */
   outb (reg_ctl (c), 0);
   timer_usleep (10);
   outb (reg_ctl (c), CTL_SRST);
   timer_usleep (10);
   outb (reg_ctl (c), 0);
 
-  timer_msleep (150);
+  timer_msleep (2);
 
   /* Wait for device 0 to clear BSY. */
   if (present[0]) 
@@ -208,14 +389,15 @@ reset_channel (struct channel *c)
   /* Wait for device 1 to clear BSY. */
   if (present[1])
     {
-      int i;
+      int64_t start = timer_ticks ();
+      unsigned delay = 0;
 
       select_device (&c->devices[1]);
-      for (i = 0; i < 3000; i++) 
+      while (timer_elapsed (start) < 30 * TIMER_FREQ)
         {
           if (inb (reg_nsect (c)) == 1 && inb (reg_lbal (c)) == 1)
             break;
-          timer_msleep (10);
+          poll_delay (&delay);
         }
       wait_while_busy (&c->devices[1]);
     }
@@ -254,17 +436,14 @@ check_device_type (struct ata_disk *d)
 }
 
 /* Sends an IDENTIFY DEVICE command to disk D and reads the
-   response.  Registers the disk with the block device
-   layer. */
+   response, leaving D ready for register_ata_device(), or clears
+   D->is_ata if the disk is not to be used. */
 static void
 identify_ata_device (struct ata_disk *d) 
 {
   struct channel *c = d->channel;
-  char id[BLOCK_SECTOR_SIZE];
-  block_sector_t capacity;
+  uint16_t id[BLOCK_SECTOR_SIZE / 2];
   char *model, *serial;
-  char extra_info[128];
-  struct block *block;
 
   ASSERT (d->is_ata);
 
@@ -281,12 +460,23 @@ identify_ata_device (struct ata_disk *d)
     }
   input_sector (c, id);
 
-  /* Calculate capacity.
+  /* Use DMA if both the controller and the disk support it.  Word
+     49 bit 8 of the identity says whether the disk does. */
+  d->use_dma = c->bm_base != 0 && (id[49] & (1 << 8));
+
+  /* Calculate capacity, from words 100...103 for a disk that
+     supports 48-bit LBA (word 83 bit 10), otherwise from words
+     60...61.  Larger than block_sector_t can count is clamped.
      Read model name and serial number. */
-  capacity = *(uint32_t *) &id[60 * 2];
-  model = descramble_ata_string (&id[10 * 2], 20);
-  serial = descramble_ata_string (&id[27 * 2], 40);
-  snprintf (extra_info, sizeof extra_info,
+  d->lba48 = (id[83] & (1 << 10)) != 0;
+  if (d->lba48)
+    d->capacity = (id[102] || id[103] ? UINT32_MAX
+                   : id[100] | ((uint32_t) id[101] << 16));
+  else
+    d->capacity = id[60] | ((uint32_t) id[61] << 16);
+  model = descramble_ata_string ((char *) &id[10], 20);
+  serial = descramble_ata_string ((char *) &id[27], 40);
+  snprintf (d->info, sizeof d->info,
             "model \"%s\", serial \"%s\"", model, serial);
 
   /* Disable access to IDE disks over 1 GB, which are likely
@@ -294,21 +484,61 @@ identify_ata_device (struct ata_disk *d)
      allow access to those, we're less likely to scribble on
      someone's important data.  You can disable this check by
      hand if you really want to do so. */
-  if (capacity >= 1024 * 1024 * 1024 / BLOCK_SECTOR_SIZE)
+  if (d->capacity >= 1024 * 1024 * 1024 / BLOCK_SECTOR_SIZE)
     {
       printf ("%s: ignoring ", d->name);
-      print_human_readable_size (capacity * 512);
+      print_human_readable_size ((uint64_t) d->capacity * BLOCK_SECTOR_SIZE);
       printf ("disk for safety\n");
       d->is_ata = false;
       return;
     }
 
-  /* Register. */
-  block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
+  set_multiple_mode (d, id);
+}
+
+/* Registers disk D, which identify_ata_device() has accepted,
+   with the block device layer and scans it for partitions. */
+static void
+register_ata_device (struct ata_disk *d) 
+{
+  struct block *block;
+
+  block = block_register (d->name, BLOCK_RAW, d->info, d->capacity,
                           &ide_operations, d);
+  block_set_max_transfer (block, MAX_SECTOR_CNT);
+  block_start_queue (block);
   partition_scan (block);
 }
 
+/* Enables READ/WRITE MULTIPLE on disk D, whose IDENTIFY DEVICE
+   response is ID, with as many sectors per interrupt as the disk
+   allows.  Word 47 bits 0...7 give that limit, with 0 meaning the
+   disk has no multiple mode.  Leaves D->multiple 0 if the disk
+   doesn't support the mode or rejects the command. */
+static void
+set_multiple_mode (struct ata_disk *d, const uint16_t *id)
+{
+  struct channel *c = d->channel;
+  size_t max = id[47] & 0xff;
+  size_t cnt;
+
+  d->multiple = 0;
+  if (max < 2)
+    return;
+
+  /* The block size has to be a power of 2. */
+  for (cnt = 1; cnt * 2 <= max; cnt *= 2)
+    continue;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), cnt);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if (!(inb (reg_alt_status (c)) & (STA_ERR | STA_DF)))
+    d->multiple = cnt;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -337,68 +567,182 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Reads the CNT sectors starting at SEC_NO from disk D into the
+   CNT buffers in BUFFERS, each of which must have room for
+   BLOCK_SECTOR_SIZE bytes.  Each command transfers up to
+   MAX_SECTOR_CNT sectors, by DMA with a single interrupt at the
+   end if possible, otherwise by PIO with an interrupt as each
+   sector, or each block of sectors in multiple mode, becomes
+   ready to be read.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_readv (void *d_, block_sector_t sec_no, void *const buffers[],
+           size_t cnt)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  while (cnt > 0) 
+    {
+      size_t n = cnt < MAX_SECTOR_CNT ? cnt : MAX_SECTOR_CNT;
+
+      if (!d->use_dma
+          || !dma_transfer (d, sec_no, (const void *const *) buffers, n,
+                            false))
+        pio_transfer (d, sec_no, buffers, n, false);
+      sec_no += n;
+      buffers += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
+/* Writes the CNT sectors starting at SEC_NO to disk D from the
+   CNT buffers in BUFFERS, each of which must contain
    BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+   acknowledged receiving the data.  Each command transfers up to
+   MAX_SECTOR_CNT sectors, by DMA with a single interrupt at the
+   end if possible, otherwise by PIO with an interrupt as each
+   sector, or each block of sectors in multiple mode, is
+   accepted.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_writev (void *d_, block_sector_t sec_no, const void *const buffers[],
+            size_t cnt)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  while (cnt > 0) 
+    {
+      size_t n = cnt < MAX_SECTOR_CNT ? cnt : MAX_SECTOR_CNT;
+
+      if (!d->use_dma || !dma_transfer (d, sec_no, buffers, n, true))
+        pio_transfer (d, sec_no, (void *const *) buffers, n, true);
+      sec_no += n;
+      buffers += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  ide_readv (d, sec_no, &buffer, 1);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write (void *d, block_sector_t sec_no, const void *buffer)
+{
+  ide_writev (d, sec_no, &buffer, 1);
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_readv,
+    ide_writev
   };
-
+
+/* Returns true if transferring the CNT sectors starting at
+   SEC_NO on disk D takes a 48-bit LBA command. */
+static bool
+need_lba48 (const struct ata_disk *d, block_sector_t sec_no, size_t cnt)
+{
+  if (sec_no + cnt <= LBA28_LIMIT)
+    return false;
+  ASSERT (d->lba48);
+  return true;
+}
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT, which must be between 1 and
+   MAX_SECTOR_CNT, to the disk's sector selection registers.  (We
+   use LBA mode, with 48-bit addresses if need_lba48() says so.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sectors (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
+  uint8_t dev = DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0);
 
-  ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= MAX_SECTOR_CNT);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  if (need_lba48 (d, sec_no, cnt))
+    {
+      /* High-order bytes first: count 15:8, LBA 31:24, 39:32
+         and 47:40.  block_sector_t has no bits above 31. */
+      outb (reg_nsect (c), cnt >> 8);
+      outb (reg_lbal (c), sec_no >> 24);
+      outb (reg_lbam (c), 0);
+      outb (reg_lbah (c), 0);
+    }
+  else
+    dev |= sec_no >> 24;
+  outb (reg_nsect (c), cnt);    /* 0 means 256. */
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
-  outb (reg_device (c),
-        DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0) | (sec_no >> 24));
+  outb (reg_device (c), dev);
+}
+
+/* Transfers the CNT sectors starting at SEC_NO between disk D and
+   BUFFERS by PIO: from disk to memory if WRITE is false, from
+   memory to disk if it is true.  CNT must be between 1 and
+   MAX_SECTOR_CNT.  In multiple mode the disk interrupts once per
+   block of D->multiple sectors, otherwise once per sector. */
+static void
+pio_transfer (struct ata_disk *d, block_sector_t sec_no,
+              void *const buffers[], size_t cnt, bool write)
+{
+  struct channel *c = d->channel;
+  bool ext = need_lba48 (d, sec_no, cnt);
+  size_t per_block = d->multiple != 0 ? d->multiple : 1;
+  uint8_t command;
+  size_t i;
+
+  if (d->multiple != 0)
+    command = (write
+               ? (ext ? CMD_WRITE_MULTIPLE_EXT : CMD_WRITE_MULTIPLE)
+               : (ext ? CMD_READ_MULTIPLE_EXT : CMD_READ_MULTIPLE));
+  else
+    command = (write
+               ? (ext ? CMD_WRITE_SECTOR_EXT : CMD_WRITE_SECTOR_RETRY)
+               : (ext ? CMD_READ_SECTOR_EXT : CMD_READ_SECTOR_RETRY));
+
+  select_sectors (d, sec_no, cnt);
+  issue_pio_command (c, command);
+  for (i = 0; i < cnt; i += per_block) 
+    {
+      size_t n = cnt - i < per_block ? cnt - i : per_block;
+      size_t j;
+
+      if (!write)
+        sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk %s failed, sector=%"PRDSNu, d->name,
+               write ? "write" : "read", sec_no + i);
+      for (j = 0; j < n; j++)
+        if (write)
+          output_sector (c, buffers[i + j]);
+        else
+          input_sector (c, buffers[i + j]);
+      if (write)
+        sema_down (&c->completion_wait);
+    }
 }
 
 /* Writes COMMAND to channel C and prepares for receiving a
@@ -430,6 +774,97 @@ output_sector (struct channel *c, const void *sector)
   outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
 }
 
+/* Fills in channel C's PRD table to describe the CNT sector
+   buffers in BUFFERS, merging physically adjacent buffers into
+   one region where possible.  Returns false if some buffer can't
+   be the target of DMA. */
+static bool
+build_prdt (struct channel *c, const void *const buffers[], size_t cnt)
+{
+  struct prd *p = c->prdt;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      uintptr_t addr, end;
+
+      if (!is_kernel_vaddr (buffers[i]) || ((uintptr_t) buffers[i] & 1))
+        return false;
+      addr = vtop (buffers[i]);
+      end = addr + BLOCK_SECTOR_SIZE;
+      while (addr < end)
+        {
+          uintptr_t next = (addr | 0xffff) + 1;
+          if (next > end)
+            next = end;
+
+          /* A region that ends short of a 64 kB boundary can
+             grow up to the next one. */
+          if (p > c->prdt && p[-1].addr + p[-1].size == addr
+              && (addr & 0xffff) != 0)
+            p[-1].size = next - p[-1].addr;
+          else
+            {
+              ASSERT (p < c->prdt + PRD_CNT);
+              p->addr = addr;
+              p->size = next - addr;
+              p->flags = 0;
+              p++;
+            }
+          addr = next;
+        }
+    }
+  p[-1].flags = PRD_EOT;
+  return true;
+}
+
+/* Transfers the CNT sectors starting at SEC_NO between disk D and
+   the buffers in BUFFERS by bus-master DMA: from disk to memory
+   if WRITE is false, from memory to disk if it is true.  CNT must
+   be between 1 and MAX_SECTOR_CNT.  Returns false, without
+   touching the disk, if the buffers can't be used for DMA, in
+   which case the caller should fall back to PIO. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no,
+              const void *const buffers[], size_t cnt, bool write)
+{
+  struct channel *c = d->channel;
+  uint8_t direction = write ? 0 : BM_CMD_READ;
+  uint8_t status;
+  bool ext;
+
+  ASSERT (c->bm_base != 0);
+
+  if (!build_prdt (c, buffers, cnt))
+    return false;
+
+  /* Point the controller at the PRD table and clear any stale
+     interrupt or error status. */
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), direction);
+  outb (reg_bm_status (c),
+        inb (reg_bm_status (c)) | BM_STA_IRQ | BM_STA_ERROR);
+
+  /* Issue the command, start the engine, and wait for the single
+     interrupt that signals the end of the transfer. */
+  ext = need_lba48 (d, sec_no, cnt);
+  select_sectors (d, sec_no, cnt);
+  issue_pio_command (c, (write
+                         ? (ext ? CMD_WRITE_DMA_EXT : CMD_WRITE_DMA)
+                         : (ext ? CMD_READ_DMA_EXT : CMD_READ_DMA)));
+  outb (reg_bm_command (c), direction | BM_CMD_START);
+  sema_down (&c->completion_wait);
+  outb (reg_bm_command (c), direction);
+
+  status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), status | BM_STA_IRQ | BM_STA_ERROR);
+  if ((status & BM_STA_ERROR)
+      || (inb (reg_alt_status (c)) & (STA_ERR | STA_DF)))
+    PANIC ("%s: disk %s failed, sectors %"PRDSNu"-%"PRDSNu, d->name,
+           write ? "write" : "read", sec_no, sec_no + cnt - 1);
+  return true;
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
@@ -460,25 +895,48 @@ static bool
 wait_while_busy (const struct ata_disk *d) 
 {
   struct channel *c = d->channel;
-  int i;
+  int64_t start = timer_ticks ();
+  unsigned delay = 0;
+  bool warned = false;
   
-  for (i = 0; i < 3000; i++)
+  while (timer_elapsed (start) < 30 * TIMER_FREQ)
     {
-      if (i == 700)
-        printf ("%s: busy, waiting...", d->name);
+      if (!warned && timer_elapsed (start) >= 7 * TIMER_FREQ)
+        {
+          printf ("%s: busy, waiting...", d->name);
+          warned = true;
+        }
       if (!(inb (reg_alt_status (c)) & STA_BSY)) 
         {
-          if (i >= 700)
+          if (warned)
             printf ("ok\n");
           return (inb (reg_alt_status (c)) & STA_DRQ) != 0;
         }
-      timer_msleep (10);
+      poll_delay (&delay);
     }
 
   printf ("failed\n");
   return false;
 }
 
+/* Longest wait between polls of a device's status, in
+   microseconds. */
+#define POLL_DELAY_MAX 10000
+
+/* Waits before polling a device's status again.  *DELAY, which
+   should start out 0, is the previous wait in microseconds.  Most
+   waits end within microseconds, so the first few polls come
+   quickly, but the wait then doubles up to POLL_DELAY_MAX so
+   that a disk still spinning up does not keep the CPU busy. */
+static void
+poll_delay (unsigned *delay) 
+{
+  *delay = *delay == 0 ? 10 : *delay * 2;
+  if (*delay > POLL_DELAY_MAX)
+    *delay = POLL_DELAY_MAX;
+  timer_usleep (*delay);
+}
+
 /* Program D's channel so that D is now the selected disk. */
 static void
 select_device (const struct ata_disk *d)
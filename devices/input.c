@@ -1,16 +1,78 @@
 #include "devices/input.h"
 #include <debug.h>
-#include "devices/intq.h"
+#include <ring.h>
+#include <stdio.h>
+#include <string.h>
 #include "devices/serial.h"
+#include "threads/interrupt.h"
+#include "threads/poll.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 
-/* Stores keys from the keyboard and serial port. */
-static struct intq buffer;
+/* Input buffer size, in bytes.  Must be a power of 2. */
+#define INPUT_BUFSIZE 4096
+
+/* Stores keys from the keyboard and serial port.
+
+   The keyboard and serial interrupt handlers add keys.  External
+   interrupts do not nest, so they act as a single producer.
+   Readers take reader_lock, so that they, too, act as a single
+   consumer, and read without turning interrupts off. */
+static uint8_t buffer_data[INPUT_BUFSIZE];
+static struct ring buffer;
+static struct lock reader_lock;
+
+/* The reader waiting for a key, if any. */
+static struct thread *reader;
+
+/* Pollers waiting for a key. */
+static struct poll_queue pollers;
+
+/* Line discipline.
+
+   input_read_line() hands the console to readers a line at a
+   time, as a Unix terminal does in canonical mode.  It takes keys
+   from the input buffer into LINE, echoing them and applying the
+   editing keys below, and returns nothing until the line is
+   complete.  A line ends at a carriage return or new-line, which
+   the reader receives as a new-line, or at Ctrl+D.  Ctrl+D on an
+   empty line reads as end of file.
+
+   Keys are edited as the reader takes them, not as they arrive,
+   so that the interrupt handlers stay brief.  Keys typed ahead
+   of a reader are thus echoed when it reads them.  line_lock
+   serializes readers and protects the state below. */
+static struct lock line_lock;
+static uint8_t line[INPUT_LINE_MAX];
+static size_t line_len;                 /* Bytes in LINE. */
+static bool line_complete;              /* LINE holds a whole line? */
+static bool line_eof;                   /* Ctrl+D on an empty line? */
+
+/* Keys taken from the input buffer but not yet edited into
+   LINE, because a line was completed before them. */
+static uint8_t pending[64];
+static size_t pending_ofs, pending_cnt;
+
+/* Room for the echo of a batch of pending keys. */
+#define ECHO_SIZE (3 * sizeof pending)
+
+/* Editing keys. */
+#define CTRL(C) ((C) - 'A' + 1)
+#define KEY_ERASE '\b'                  /* Erase the last character. */
+#define KEY_DELETE 0x7f                 /* Also erases. */
+#define KEY_KILL CTRL ('U')             /* Erase the whole line. */
+#define KEY_EOF CTRL ('D')              /* End the line without a new-line. */
+
+static void wake_reader (void);
 
 /* Initializes the input buffer. */
 void
 input_init (void) 
 {
-  intq_init (&buffer);
+  ring_init (&buffer, buffer_data, sizeof buffer_data);
+  lock_init (&reader_lock);
+  poll_queue_init (&pollers);
+  lock_init (&line_lock);
 }
 
 /* Adds a key to the input buffer.
@@ -19,9 +81,26 @@ void
 input_putc (uint8_t key) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
-  ASSERT (!intq_full (&buffer));
+  ASSERT (!input_full ());
 
-  intq_putc (&buffer, key);
+  ring_putc (&buffer, key);
+  wake_reader ();
+  serial_notify ();
+}
+
+/* Adds CNT keys from KEYS to the input buffer.
+   Interrupts must be off and the buffer must have room for CNT
+   keys. */
+void
+input_putn (const uint8_t *keys, size_t cnt) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (cnt <= input_space ());
+
+  if (cnt == 0)
+    return;
+  ring_put_n (&buffer, keys, cnt);
+  wake_reader ();
   serial_notify ();
 }
 
@@ -30,15 +109,196 @@ input_putc (uint8_t key)
 uint8_t
 input_getc (void) 
 {
-  enum intr_level old_level;
   uint8_t key;
 
+  input_getn (&key, 1);
+  return key;
+}
+
+/* Retrieves as many keys as are available, up to CNT, from the
+   input buffer into KEYS, and returns the number retrieved.  If
+   the buffer is empty, waits for at least one key to be
+   pressed.  CNT must be positive. */
+size_t
+input_getn (uint8_t *keys, size_t cnt) 
+{
+  enum intr_level old_level;
+
+  ASSERT (cnt > 0);
+
+  lock_acquire (&reader_lock);
+  old_level = intr_disable ();
+  while (ring_empty (&buffer)) 
+    {
+      reader = thread_current ();
+      thread_block ();
+    }
+  intr_set_level (old_level);
+
+  cnt = ring_get_n (&buffer, keys, cnt);
+
+  /* Receive interrupts may have been turned off while we were
+     full. */
   old_level = intr_disable ();
-  key = intq_getc (&buffer);
   serial_notify ();
   intr_set_level (old_level);
-  
-  return key;
+  lock_release (&reader_lock);
+
+  return cnt;
+}
+
+/* Returns true if there is a key in the input buffer, so that
+   input_getc() would not wait. */
+bool
+input_ready (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  bool ready = !ring_empty (&buffer);
+
+  intr_set_level (old_level);
+  return ready;
+}
+
+/* Erases the last character of the line being edited, if any,
+   appending the echo that erases it from the screen to ECHO at
+   *ECHO_LEN. */
+static void
+erase (char *echo, size_t *echo_len) 
+{
+  if (line_len > 0)
+    {
+      line_len--;
+      memcpy (echo + *echo_len, "\b \b", 3);
+      *echo_len += 3;
+    }
+}
+
+/* Edits KEY into the line being edited, appending its echo to
+   the ECHO_SIZE bytes at ECHO, of which *ECHO_LEN are in use and
+   at least 3 are free. */
+static void
+edit_key (uint8_t key, char *echo, size_t *echo_len) 
+{
+  switch (key)
+    {
+    case '\r':
+    case '\n':
+      line[line_len++] = '\n';
+      echo[(*echo_len)++] = '\n';
+      line_complete = true;
+      break;
+
+    case KEY_ERASE:
+    case KEY_DELETE:
+      erase (echo, echo_len);
+      break;
+
+    case KEY_KILL:
+      while (line_len > 0)
+        {
+          if (*echo_len + 3 > ECHO_SIZE)
+            {
+              putbuf (echo, *echo_len);
+              *echo_len = 0;
+            }
+          erase (echo, echo_len);
+        }
+      break;
+
+    case KEY_EOF:
+      if (line_len > 0)
+        line_complete = true;
+      else
+        line_eof = true;
+      break;
+
+    default:
+      /* Keep the last byte free for the new-line. */
+      if (line_len < sizeof line - 1)
+        {
+          line[line_len++] = key;
+          echo[(*echo_len)++] = key;
+        }
+      break;
+    }
+}
+
+/* Edits keys into LINE until it holds a complete line or end of
+   file.  If WAIT is false, stops instead when the input buffer
+   runs out of keys.  line_lock must be held. */
+static void
+edit_line (bool wait) 
+{
+  char echo[ECHO_SIZE];
+
+  ASSERT (lock_held_by_current_thread (&line_lock));
+
+  while (!line_complete && !line_eof)
+    {
+      size_t echo_len = 0;
+
+      if (pending_ofs == pending_cnt)
+        {
+          if (!wait && !input_ready ())
+            break;
+          pending_cnt = input_getn (pending, sizeof pending);
+          pending_ofs = 0;
+        }
+      while (pending_ofs < pending_cnt && !line_complete && !line_eof)
+        edit_key (pending[pending_ofs++], echo, &echo_len);
+      putbuf (echo, echo_len);
+    }
+}
+
+/* Reads the next line typed at the console into the SIZE bytes
+   at BUF, and returns the number of bytes read, including the
+   new-line that ends the line, if any.  Waits for a complete
+   line.  If the line is longer than SIZE bytes, the rest of it
+   is left for the next read.  Returns 0 at end of file, that is,
+   if Ctrl+D is typed on an empty line. */
+size_t
+input_read_line (uint8_t *buf, size_t size) 
+{
+  size_t n = 0;
+
+  lock_acquire (&line_lock);
+  edit_line (true);
+  if (line_eof)
+    line_eof = false;
+  else
+    {
+      n = size < line_len ? size : line_len;
+      memcpy (buf, line, n);
+      memmove (line, line + n, line_len - n);
+      line_len -= n;
+      line_complete = line_len > 0;
+    }
+  lock_release (&line_lock);
+  return n;
+}
+
+/* Returns true if input_read_line() would not wait.  Edits any
+   keys that have arrived, echoing them.  Returns false without
+   doing so if another thread is reading, since the line is
+   then its. */
+bool
+input_line_ready (void) 
+{
+  bool ready;
+
+  if (!lock_try_acquire (&line_lock))
+    return false;
+  edit_line (false);
+  ready = line_complete || line_eof;
+  lock_release (&line_lock);
+  return ready;
+}
+
+/* Hooks P onto the queue of pollers woken when a key arrives. */
+void
+input_poll (struct poller *p) 
+{
+  poller_add (p, &pollers);
 }
 
 /* Returns true if the input buffer is full,
@@ -48,5 +308,28 @@ bool
 input_full (void) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
-  return intq_full (&buffer);
+  return ring_full (&buffer);
+}
+
+/* Returns the number of keys that can be added to the input
+   buffer.
+   Interrupts must be off. */
+size_t
+input_space (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  return ring_space (&buffer);
+}
+
+/* Wakes up the reader waiting for a key, if any, and any
+   pollers. */
+static void
+wake_reader (void) 
+{
+  if (reader != NULL) 
+    {
+      thread_unblock (reader);
+      reader = NULL;
+    }
+  poll_wake (&pollers);
 }
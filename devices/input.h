@@ -2,11 +2,25 @@
 #define DEVICES_INPUT_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+struct poller;
+
+/* Longest line that input_read_line() returns at once, including
+   its new-line. */
+#define INPUT_LINE_MAX 256
+
 void input_init (void);
 void input_putc (uint8_t);
+void input_putn (const uint8_t *, size_t);
 uint8_t input_getc (void);
+size_t input_getn (uint8_t *, size_t);
+bool input_ready (void);
+size_t input_read_line (uint8_t *, size_t);
+bool input_line_ready (void);
+void input_poll (struct poller *);
 bool input_full (void);
+size_t input_space (void);
 
 #endif /* devices/input.h */
@@ -0,0 +1,228 @@
+#include "devices/lapic.h"
+#include <debug.h>
+#include "devices/pit.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+
+/* Local APIC driver.  See [IA32-v3a] chapter 10, "Advanced
+   Programmable Interrupt Controller (APIC)". */
+
+/* Model-specific registers. */
+#define MSR_APIC_BASE 0x1b              /* APIC base address. */
+#define APIC_BASE_ENABLE (1u << 11)     /* Global enable bit in it. */
+#define MSR_TSC_DEADLINE 0x6e0          /* Timer deadline, in TSC cycles. */
+
+/* Memory-mapped registers, as byte offsets. */
+#define REG_TPR 0x080                   /* Task priority. */
+#define REG_EOI 0x0b0                   /* End of interrupt. */
+#define REG_SVR 0x0f0                   /* Spurious interrupt vector. */
+#define REG_LVT_TIMER 0x320             /* Timer local vector table entry. */
+#define REG_LVT_LINT0 0x350             /* LINT0 pin entry. */
+#define REG_LVT_LINT1 0x360             /* LINT1 pin entry. */
+#define REG_TIMER_ICR 0x380             /* Timer initial count. */
+#define REG_TIMER_CCR 0x390             /* Timer current count. */
+#define REG_TIMER_DCR 0x3e0             /* Timer divide configuration. */
+
+/* REG_SVR bits. */
+#define SVR_ENABLE 0x100                /* Software enable. */
+
+/* Local vector table entry bits. */
+#define LVT_EXTINT 0x700                /* Deliver as from the 8259A. */
+#define LVT_NMI 0x400                   /* Deliver as an NMI. */
+#define LVT_MASKED (1u << 16)           /* Do not deliver. */
+#define LVT_ONESHOT (0u << 17)          /* Timer counts down once. */
+#define LVT_PERIODIC (1u << 17)         /* Timer reloads itself. */
+#define LVT_DEADLINE (2u << 17)         /* Timer fires at a TSC value. */
+
+/* REG_TIMER_DCR value that divides the bus clock by 16. */
+#define DCR_DIV16 0x3
+
+/* PIT cycles to time the APIC timer over: 5 ms. */
+#define CALIBRATE_COUNT (PIT_HZ / 200)
+
+/* Registers, or a null pointer if the APIC is not in use. */
+static volatile uint32_t *regs;
+
+/* Timer counts per second. */
+static uint32_t timer_hz;
+
+/* TSC cycles per second, if one-shots use TSC-deadline mode,
+   otherwise 0. */
+static uint64_t deadline_hz;
+
+/* True while the timer is in TSC-deadline mode, that is, while a
+   one-shot set in that mode has yet to be replaced by a periodic
+   timer. */
+static bool deadline_mode;
+
+/* Returns the value of the register at byte offset REG. */
+static uint32_t
+reg_read (unsigned reg)
+{
+  return regs[reg / sizeof *regs];
+}
+
+/* Sets the register at byte offset REG to VALUE. */
+static void
+reg_write (unsigned reg, uint32_t value)
+{
+  regs[reg / sizeof *regs] = value;
+}
+
+/* Returns the number of counts the timer has made since it was
+   started with an initial count of UINT32_MAX, for pit_time(). */
+static uint64_t
+timer_elapsed (void)
+{
+  return UINT32_MAX - reg_read (REG_TIMER_CCR);
+}
+
+/* Enables the local APIC of the running CPU and measures its
+   timer's rate.  If TSC_HZ, the time-stamp counter's frequency,
+   is nonzero and the CPU supports it, one-shots use TSC-deadline
+   mode.  Returns true if successful, false if there is no usable
+   APIC, in which case the APIC is left as it was. */
+bool
+lapic_init (uint64_t tsc_hz)
+{
+  uint32_t a, b, c, d;
+  uint64_t base, counts;
+
+  cpuid (1, &a, &b, &c, &d);
+  if ((d & CPUID_APIC) == 0)
+    return false;
+
+  base = rdmsr (MSR_APIC_BASE);
+  regs = paging_map_io (base & 0xfffff000);
+  if (regs == NULL)
+    return false;
+  wrmsr (MSR_APIC_BASE, base | APIC_BASE_ENABLE);
+
+  /* Accept interrupts of every priority and keep the PICs wired
+     through LINT0, as the firmware left them. */
+  reg_write (REG_SVR, SVR_ENABLE | INTR_LAPIC_SPURIOUS);
+  reg_write (REG_TPR, 0);
+  reg_write (REG_LVT_LINT0, LVT_EXTINT);
+  reg_write (REG_LVT_LINT1, LVT_NMI);
+
+  /* Time a masked countdown against the PIT. */
+  reg_write (REG_TIMER_DCR, DCR_DIV16);
+  reg_write (REG_LVT_TIMER, LVT_MASKED | LVT_ONESHOT | INTR_LAPIC_TIMER);
+  reg_write (REG_TIMER_ICR, UINT32_MAX);
+  counts = pit_time (CALIBRATE_COUNT, timer_elapsed);
+  reg_write (REG_TIMER_ICR, 0);
+  timer_hz = counts * PIT_HZ / CALIBRATE_COUNT;
+  if (timer_hz == 0)
+    {
+      reg_write (REG_SVR, INTR_LAPIC_SPURIOUS);
+      wrmsr (MSR_APIC_BASE, base);
+      regs = NULL;
+      return false;
+    }
+
+  if (tsc_hz != 0 && (c & CPUID_TSC_DEADLINE) != 0)
+    deadline_hz = tsc_hz;
+  return true;
+}
+
+/* Returns the number of timer counts per second. */
+uint32_t
+lapic_timer_hz (void)
+{
+  return timer_hz;
+}
+
+/* Returns true if one-shots use TSC-deadline mode. */
+bool
+lapic_tsc_deadline (void)
+{
+  return deadline_hz != 0;
+}
+
+/* Starts the timer interrupting every COUNT counts, the first
+   time COUNT counts from now.  Replaces any one-shot. */
+void
+lapic_timer_periodic (uint32_t count)
+{
+  ASSERT (regs != NULL);
+  ASSERT (count > 0);
+
+  deadline_mode = false;
+  reg_write (REG_LVT_TIMER, LVT_PERIODIC | INTR_LAPIC_TIMER);
+  reg_write (REG_TIMER_ICR, count);
+}
+
+/* Arranges for the timer to interrupt once, COUNT counts from
+   now, and then stop.  Replaces the periodic timer, if it is
+   running.
+
+   In TSC-deadline mode the interrupt arrives when the TSC
+   reaches a given value, which tracks real time more finely
+   than the divided bus clock that ordinary one-shots count. */
+void
+lapic_timer_oneshot (uint32_t count)
+{
+  ASSERT (regs != NULL);
+  ASSERT (count > 0);
+
+  if (deadline_hz != 0)
+    {
+      uint64_t cycles = (count / timer_hz * deadline_hz
+                         + count % timer_hz * deadline_hz / timer_hz);
+
+      if (!deadline_mode)
+        {
+          reg_write (REG_LVT_TIMER, LVT_DEADLINE | INTR_LAPIC_TIMER);
+
+          /* Keep the WRMSR below from overtaking the mode
+             change. */
+          asm volatile ("mfence" : : : "memory");
+          deadline_mode = true;
+        }
+      wrmsr (MSR_TSC_DEADLINE, rdtsc () + (cycles > 0 ? cycles : 1));
+    }
+  else
+    {
+      reg_write (REG_LVT_TIMER, LVT_ONESHOT | INTR_LAPIC_TIMER);
+      reg_write (REG_TIMER_ICR, count);
+    }
+}
+
+/* Returns the number of counts left before the timer next
+   interrupts.  If EXPIRED is nonnull, stores in *EXPIRED whether
+   a one-shot has already run out, in which case the returned
+   count is 0. */
+uint32_t
+lapic_timer_remaining (bool *expired)
+{
+  uint32_t remaining;
+
+  ASSERT (regs != NULL);
+
+  if (deadline_mode)
+    {
+      /* The deadline register reads as 0 once it has fired. */
+      uint64_t deadline = rdmsr (MSR_TSC_DEADLINE);
+      uint64_t now = rdtsc ();
+      uint64_t cycles = deadline > now ? deadline - now : 0;
+
+      remaining = (cycles / deadline_hz * timer_hz
+                   + cycles % deadline_hz * timer_hz / deadline_hz);
+    }
+  else
+    remaining = reg_read (REG_TIMER_CCR);
+
+  if (expired != NULL)
+    *expired = remaining == 0;
+  return remaining;
+}
+
+/* Acknowledges the interrupt being handled, which must have
+   come from the local APIC itself.  Spurious interrupts are not
+   acknowledged. */
+void
+lapic_eoi (void)
+{
+  reg_write (REG_EOI, 0);
+}
@@ -0,0 +1,30 @@
+#ifndef DEVICES_LAPIC_H
+#define DEVICES_LAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Local APIC.
+
+   Every x86 CPU since the Pentium Pro has a local APIC with a
+   timer of its own, which interrupts only that CPU and is
+   programmed with a single register write, unlike the 8254,
+   which needs several slow port accesses.  lapic_init() turns
+   the APIC on, in "virtual wire" mode so that the 8259A PICs
+   keep delivering the other external interrupts, and measures
+   the timer's rate against the PIT.
+
+   Timer counts are in units of the timer's own clock, which
+   runs lapic_timer_hz() times per second. */
+
+bool lapic_init (uint64_t tsc_hz);
+uint32_t lapic_timer_hz (void);
+bool lapic_tsc_deadline (void);
+
+void lapic_timer_periodic (uint32_t count);
+void lapic_timer_oneshot (uint32_t count);
+uint32_t lapic_timer_remaining (bool *expired);
+
+void lapic_eoi (void);
+
+#endif /* devices/lapic.h */
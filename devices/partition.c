@@ -15,7 +15,34 @@ struct partition
 
 static struct block_operations partition_operations;
 
-static void read_partition_table (struct block *, block_sector_t sector,
+/* Sectors read at once while scanning for partition tables.
+
+   The tables in an extended partition form a chain, each giving
+   the location of the next, so they cannot all be requested up
+   front.  They do tend to lie close together, though, so each
+   read fetches the SCAN_WINDOW sectors starting at the table in
+   one multi-sector transfer, and later tables that fall within
+   them are found without going to the device. */
+#define SCAN_WINDOW 16
+
+/* Sectors of a device most recently read by read_scan_sector(). */
+struct scan_window
+  {
+    struct block *block;        /* Device being scanned. */
+    block_sector_t start;       /* First sector in DATA. */
+    size_t cnt;                 /* Number of sectors in DATA. */
+    uint8_t *data;              /* SCAN_WINDOW sectors of storage. */
+    int tables;                 /* Partition tables read so far. */
+  };
+
+/* Most partition tables that we read from one device, so that a
+   corrupt extended partition chain that links back on itself
+   cannot make the scan go on forever. */
+#define MAX_TABLES 64
+
+static const void *read_scan_sector (struct scan_window *,
+                                     block_sector_t);
+static void read_partition_table (struct scan_window *, block_sector_t sector,
                                   block_sector_t primary_extended_sector,
                                   int *part_nr);
 static void found_partition (struct block *, uint8_t type,
@@ -27,14 +54,46 @@ static const char *partition_type_name (uint8_t);
 void
 partition_scan (struct block *block)
 {
+  struct scan_window w;
   int part_nr = 0;
-  read_partition_table (block, 0, 0, &part_nr);
+
+  w.block = block;
+  w.start = 0;
+  w.cnt = 0;
+  w.tables = 0;
+  w.data = malloc (SCAN_WINDOW * BLOCK_SECTOR_SIZE);
+  if (w.data == NULL)
+    PANIC ("Failed to allocate memory for partition table.");
+
+  read_partition_table (&w, 0, 0, &part_nr);
   if (part_nr == 0)
     printf ("%s: Device contains no partitions\n", block_name (block));
+  free (w.data);
+}
+
+/* Returns the contents of SECTOR of W's device, which must
+   exist.  The data stays valid until the next call. */
+static const void *
+read_scan_sector (struct scan_window *w, block_sector_t sector) 
+{
+  if (sector < w->start || sector - w->start >= w->cnt)
+    {
+      void *buffers[SCAN_WINDOW];
+      size_t i;
+
+      w->start = sector;
+      w->cnt = block_size (w->block) - sector;
+      if (w->cnt > SCAN_WINDOW)
+        w->cnt = SCAN_WINDOW;
+      for (i = 0; i < w->cnt; i++)
+        buffers[i] = w->data + i * BLOCK_SECTOR_SIZE;
+      block_readv (w->block, sector, buffers, w->cnt);
+    }
+  return w->data + (sector - w->start) * BLOCK_SECTOR_SIZE;
 }
 
-/* Reads the partition table in the given SECTOR of BLOCK and
-   scans it for partitions of interest to Pintos.
+/* Reads the partition table in the given SECTOR of W's device
+   and scans it for partitions of interest to Pintos.
 
    If SECTOR is 0, so that this is the top-level partition table
    on BLOCK, then PRIMARY_EXTENDED_SECTOR is not meaningful;
@@ -44,13 +103,15 @@ partition_scan (struct block *block)
    comment below).
 
    PART_NR points to the number of non-empty primary or logical
-   partitions already encountered on BLOCK.  It is incremented as
-   partitions are found. */
+   partitions already encountered on the device.  It is
+   incremented as partitions are found. */
 static void
-read_partition_table (struct block *block, block_sector_t sector,
+read_partition_table (struct scan_window *w, block_sector_t sector,
                       block_sector_t primary_extended_sector,
                       int *part_nr)
 {
+  struct block *block = w->block;
+
   /* Format of a partition table entry.  See [Partitions]. */
   struct partition_table_entry
     {
@@ -72,7 +133,8 @@ read_partition_table (struct block *block, block_sector_t sector,
     }
   PACKED;
 
-  struct partition_table *pt;
+  const struct partition_table *pt;
+  struct partition_table_entry entries[4];
   size_t i;
 
   /* Check SECTOR validity. */
@@ -83,12 +145,16 @@ read_partition_table (struct block *block, block_sector_t sector,
       return;
     }
 
+  if (w->tables++ >= MAX_TABLES)
+    {
+      printf ("%s: Too many partition tables, ignoring the rest\n",
+              block_name (block));
+      return;
+    }
+
   /* Read sector. */
   ASSERT (sizeof *pt == BLOCK_SECTOR_SIZE);
-  pt = malloc (sizeof *pt);
-  if (pt == NULL)
-    PANIC ("Failed to allocate memory for partition table.");
-  block_read (block, 0, pt);
+  pt = read_scan_sector (w, sector);
 
   /* Check signature. */
   if (pt->signature != 0xaa55)
@@ -98,14 +164,16 @@ read_partition_table (struct block *block, block_sector_t sector,
       else
         printf ("%s: Invalid extended partition table in sector %"PRDSNu"\n",
                 block_name (block), sector);
-      free (pt);
       return;
     }
 
-  /* Parse partitions. */
-  for (i = 0; i < sizeof pt->partitions / sizeof *pt->partitions; i++)
+  /* Parse partitions, from a copy of the entries, since reading
+     a nested table reuses the window that PT points into. */
+  ASSERT (sizeof entries == sizeof pt->partitions);
+  memcpy (entries, pt->partitions, sizeof entries);
+  for (i = 0; i < sizeof entries / sizeof *entries; i++)
     {
-      struct partition_table_entry *e = &pt->partitions[i];
+      struct partition_table_entry *e = &entries[i];
 
       if (e->size == 0 || e->type == 0)
         {
@@ -128,9 +196,9 @@ read_partition_table (struct block *block, block_sector_t sector,
              is nested, the offset is relative to the start of
              the extended partition that the MBR points to. */
           if (sector == 0)
-            read_partition_table (block, e->offset, e->offset, part_nr);
+            read_partition_table (w, e->offset, e->offset, part_nr);
           else
-            read_partition_table (block, e->offset + primary_extended_sector,
+            read_partition_table (w, e->offset + primary_extended_sector,
                                   primary_extended_sector, part_nr);
         }
       else
@@ -141,8 +209,6 @@ read_partition_table (struct block *block, block_sector_t sector,
                            e->size, *part_nr);
         }
     }
-
-  free (pt);
 }
 
 /* We have found a primary or logical partition of the given TYPE
@@ -169,6 +235,7 @@ found_partition (struct block *block, uint8_t part_type,
                               : part_type == 0x23 ? BLOCK_SWAP
                               : BLOCK_FOREIGN);
       struct partition *p;
+      struct block *part;
       char extra_info[128];
       char name[16];
 
@@ -181,7 +248,10 @@ found_partition (struct block *block, uint8_t part_type,
       snprintf (name, sizeof name, "%s%d", block_name (block), part_nr);
       snprintf (extra_info, sizeof extra_info, "%s (%02x)",
                 partition_type_name (part_type), part_type);
-      block_register (name, type, extra_info, size, &partition_operations, p);
+      part = block_register (name, type, extra_info, size,
+                             &partition_operations, p);
+      block_set_max_transfer (part, block_max_transfer (block));
+      block_set_parent (part, block, start);
     }
 }
 
@@ -317,8 +387,30 @@ partition_write (void *p_, block_sector_t sector, const void *buffer)
   block_write (p->block, p->start + sector, buffer);
 }
 
+/* Reads the CNT sectors starting at SECTOR from partition P
+   into BUFFERS. */
+static void
+partition_readv (void *p_, block_sector_t sector, void *const buffers[],
+                 size_t cnt)
+{
+  struct partition *p = p_;
+  block_readv (p->block, p->start + sector, buffers, cnt);
+}
+
+/* Writes the CNT sectors starting at SECTOR to partition P from
+   BUFFERS. */
+static void
+partition_writev (void *p_, block_sector_t sector,
+                  const void *const buffers[], size_t cnt)
+{
+  struct partition *p = p_;
+  block_writev (p->block, p->start + sector, buffers, cnt);
+}
+
 static struct block_operations partition_operations =
   {
     partition_read,
-    partition_write
+    partition_write,
+    partition_readv,
+    partition_writev
   };
@@ -0,0 +1,351 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/io.h"
+
+/* Configuration mechanism #1 ports.  See section 3.2.2.3.2,
+   "Software Generation of Configuration Transactions", of the
+   PCI Local Bus Specification. */
+#define CONFIG_ADDRESS 0xcf8            /* Selects a register. */
+#define CONFIG_DATA 0xcfc               /* Reads or writes it. */
+#define CONFIG_ENABLE 0x80000000        /* Enable bit in CONFIG_ADDRESS. */
+
+/* Header types, in the low 7 bits of PCI_HEADER_TYPE. */
+#define HEADER_NORMAL 0                 /* Ordinary function. */
+#define HEADER_BRIDGE 1                 /* PCI-to-PCI bridge. */
+#define HEADER_MULTI 0x80               /* Device has several functions. */
+
+/* Bus geometry. */
+#define BUS_CNT 256
+#define DEV_CNT 32                      /* Devices per bus. */
+#define FUNC_CNT 8                      /* Functions per device. */
+
+/* Functions found by pci_init().  An emulator has about half a
+   dozen; real machines rarely have more than a few dozen. */
+#define PCI_DEV_MAX 64
+static struct pci_dev devices[PCI_DEV_MAX];
+static size_t dev_cnt;
+
+/* Buses already scanned, so that a misconfigured bridge cannot
+   send the scan around in circles. */
+static bool bus_scanned[BUS_CNT];
+
+static void scan_bus (uint8_t bus);
+
+/* Selects register REG of function FUNC of device DEV on BUS for
+   the next access to CONFIG_DATA.  The caller must have
+   interrupts off, so that nothing else selects a register in
+   between. */
+static void
+select_reg (uint8_t bus, uint8_t dev, uint8_t func, uint8_t reg)
+{
+  outl (CONFIG_ADDRESS, CONFIG_ENABLE | (uint32_t) bus << 16
+        | (uint32_t) dev << 11 | (uint32_t) func << 8 | (reg & 0xfc));
+}
+
+/* Reads the 32-bit register that contains REG. */
+static uint32_t
+config_read (uint8_t bus, uint8_t dev, uint8_t func, uint8_t reg)
+{
+  enum intr_level old_level;
+  uint32_t data;
+
+  old_level = intr_disable ();
+  select_reg (bus, dev, func, reg);
+  data = inl (CONFIG_DATA);
+  intr_set_level (old_level);
+  return data;
+}
+
+/* Reads the 32-bit register REG of D, which must be aligned. */
+uint32_t
+pci_read32 (const struct pci_dev *d, uint8_t reg)
+{
+  ASSERT (reg % 4 == 0);
+  return config_read (d->bus, d->dev, d->func, reg);
+}
+
+/* Reads the 16-bit register REG of D, which must be aligned. */
+uint16_t
+pci_read16 (const struct pci_dev *d, uint8_t reg)
+{
+  ASSERT (reg % 2 == 0);
+  return config_read (d->bus, d->dev, d->func, reg) >> (reg % 4 * 8);
+}
+
+/* Reads the 8-bit register REG of D. */
+uint8_t
+pci_read8 (const struct pci_dev *d, uint8_t reg)
+{
+  return config_read (d->bus, d->dev, d->func, reg) >> (reg % 4 * 8);
+}
+
+/* Writes DATA to the 32-bit register REG of D, which must be
+   aligned. */
+void
+pci_write32 (const struct pci_dev *d, uint8_t reg, uint32_t data)
+{
+  enum intr_level old_level;
+
+  ASSERT (reg % 4 == 0);
+  old_level = intr_disable ();
+  select_reg (d->bus, d->dev, d->func, reg);
+  outl (CONFIG_DATA, data);
+  intr_set_level (old_level);
+}
+
+/* Writes DATA to the 16-bit register REG of D, which must be
+   aligned.  The other half of the containing 32-bit register is
+   left alone. */
+void
+pci_write16 (const struct pci_dev *d, uint8_t reg, uint16_t data)
+{
+  enum intr_level old_level;
+
+  ASSERT (reg % 2 == 0);
+  old_level = intr_disable ();
+  select_reg (d->bus, d->dev, d->func, reg);
+  outw (CONFIG_DATA + reg % 4, data);
+  intr_set_level (old_level);
+}
+
+/* Writes DATA to the 8-bit register REG of D. */
+void
+pci_write8 (const struct pci_dev *d, uint8_t reg, uint8_t data)
+{
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  select_reg (d->bus, d->dev, d->func, reg);
+  outb (CONFIG_DATA + reg % 4, data);
+  intr_set_level (old_level);
+}
+
+/* Decodes the first CNT base address registers of D.  Each is
+   sized the usual way, by writing all 1s and seeing which bits
+   stick, with decoding turned off meanwhile so that the device
+   does not briefly claim addresses that belong to something
+   else.  A 64-bit memory BAR takes two registers; one that the
+   firmware put above 4 GB is out of reach and left unused. */
+static void
+decode_bars (struct pci_dev *d, int cnt)
+{
+  uint16_t command = pci_read16 (d, PCI_COMMAND);
+  int i;
+
+  pci_write16 (d, PCI_COMMAND,
+               command & ~(PCI_COMMAND_IO | PCI_COMMAND_MEMORY));
+  for (i = 0; i < cnt; i++)
+    {
+      struct pci_bar *bar = &d->bar[i];
+      uint8_t reg = PCI_BAR0 + i * 4;
+      uint32_t orig = pci_read32 (d, reg);
+      uint32_t mask;
+
+      pci_write32 (d, reg, 0xffffffff);
+      mask = pci_read32 (d, reg);
+      pci_write32 (d, reg, orig);
+
+      if (orig & 1)
+        {
+          /* I/O space.  The upper 16 bits may read as 0. */
+          bar->io = true;
+          bar->base = orig & ~3u;
+          if ((mask & 0xfffc) != 0)
+            bar->size = ~((mask | 0xffff0000) & ~3u) + 1;
+        }
+      else
+        {
+          bool wide = ((orig >> 1) & 3) == 2;
+
+          bar->prefetchable = (orig & 8) != 0;
+          bar->base = orig & ~0xfu;
+          if ((mask & ~0xfu) != 0)
+            bar->size = ~(mask & ~0xfu) + 1;
+          if (wide && i + 1 < cnt)
+            {
+              if (pci_read32 (d, reg + 4) != 0)
+                bar->size = 0;
+              i++;
+            }
+        }
+    }
+  pci_write16 (d, PCI_COMMAND, command);
+}
+
+/* Records function FUNC of device DEV on BUS, if it exists, and
+   scans the bus behind it if it is a bridge.  Returns the
+   function's header type, or 0 if there is no such function. */
+static uint8_t
+scan_function (uint8_t bus, uint8_t dev, uint8_t func)
+{
+  uint32_t id = config_read (bus, dev, func, PCI_VENDOR_ID);
+  uint32_t class = config_read (bus, dev, func, PCI_REVISION);
+  uint8_t header, type;
+  struct pci_dev *d;
+
+  if ((id & 0xffff) == 0xffff)
+    return 0;
+  header = config_read (bus, dev, func, PCI_HEADER_TYPE) >> 16;
+  type = header & ~HEADER_MULTI;
+
+  if (dev_cnt < PCI_DEV_MAX)
+    {
+      uint32_t intr = config_read (bus, dev, func, PCI_INTERRUPT_LINE);
+
+      d = &devices[dev_cnt++];
+      memset (d, 0, sizeof *d);
+      d->bus = bus;
+      d->dev = dev;
+      d->func = func;
+      d->vendor = id;
+      d->device = id >> 16;
+      d->revision = class;
+      d->prog_if = class >> 8;
+      d->subclass = class >> 16;
+      d->class = class >> 24;
+      d->irq = (intr >> 8 & 0xff) != 0 ? intr & 0xff : 0xff;
+      if (type == HEADER_NORMAL)
+        decode_bars (d, PCI_BAR_CNT);
+      else if (type == HEADER_BRIDGE)
+        decode_bars (d, 2);
+    }
+  else if (dev_cnt++ == PCI_DEV_MAX)
+    printf ("pci: more than %d functions, ignoring the rest\n",
+            PCI_DEV_MAX);
+
+  if (type == HEADER_BRIDGE)
+    scan_bus (config_read (bus, dev, func, PCI_SECONDARY_BUS) >> 8);
+  return header;
+}
+
+/* Scans every device on BUS. */
+static void
+scan_bus (uint8_t bus)
+{
+  uint8_t dev, func;
+
+  if (bus_scanned[bus])
+    return;
+  bus_scanned[bus] = true;
+
+  for (dev = 0; dev < DEV_CNT; dev++)
+    if (scan_function (bus, dev, 0) & HEADER_MULTI)
+      for (func = 1; func < FUNC_CNT; func++)
+        scan_function (bus, dev, func);
+}
+
+/* Finds every PCI function and prints a line for each. */
+void
+pci_init (void)
+{
+  size_t i;
+
+  /* Machines without PCI, or without mechanism #1, do not latch
+     the enable bit in CONFIG_ADDRESS. */
+  outl (CONFIG_ADDRESS, CONFIG_ENABLE);
+  if (inl (CONFIG_ADDRESS) != CONFIG_ENABLE)
+    {
+      printf ("pci: no configuration mechanism found\n");
+      return;
+    }
+
+  scan_bus (0);
+  if (dev_cnt > PCI_DEV_MAX)
+    dev_cnt = PCI_DEV_MAX;
+
+  for (i = 0; i < dev_cnt; i++)
+    {
+      const struct pci_dev *d = &devices[i];
+      printf ("pci %02x:%02x.%x: %04x:%04x class %02x.%02x.%02x",
+              d->bus, d->dev, d->func, d->vendor, d->device,
+              d->class, d->subclass, d->prog_if);
+      if (d->irq != 0xff)
+        printf (" irq %d", d->irq);
+      printf ("\n");
+    }
+}
+
+/* Returns the number of PCI functions found. */
+size_t
+pci_dev_cnt (void)
+{
+  return dev_cnt;
+}
+
+/* Returns the PCI function with index IDX, which must be less
+   than pci_dev_cnt(). */
+struct pci_dev *
+pci_get (size_t idx)
+{
+  ASSERT (idx < dev_cnt);
+  return &devices[idx];
+}
+
+/* Returns the first function after PREV, or the first function
+   if PREV is null, with the given CLASS and SUBCLASS.  Returns a
+   null pointer if there is none. */
+struct pci_dev *
+pci_find_class (uint8_t class, uint8_t subclass, struct pci_dev *prev)
+{
+  struct pci_dev *d;
+
+  for (d = prev != NULL ? prev + 1 : devices; d < devices + dev_cnt; d++)
+    if (d->class == class && d->subclass == subclass)
+      return d;
+  return NULL;
+}
+
+/* Returns true if DRIVER's identity and class fields match D. */
+static bool
+driver_matches (const struct pci_driver *driver, const struct pci_dev *d)
+{
+  return ((driver->vendor == PCI_ANY || driver->vendor == d->vendor)
+          && (driver->device == PCI_ANY || driver->device == d->device)
+          && (driver->class == PCI_ANY || driver->class == d->class)
+          && (driver->subclass == PCI_ANY
+              || driver->subclass == d->subclass));
+}
+
+/* Offers each unclaimed function that DRIVER matches to its probe
+   function, and binds DRIVER to those it claims.  Returns the
+   number of functions bound. */
+size_t
+pci_register_driver (const struct pci_driver *driver)
+{
+  size_t bound = 0;
+  size_t i;
+
+  ASSERT (driver != NULL);
+  ASSERT (driver->probe != NULL);
+
+  for (i = 0; i < dev_cnt; i++)
+    {
+      struct pci_dev *d = &devices[i];
+      if (d->driver == NULL && driver_matches (driver, d)
+          && driver->probe (d))
+        {
+          d->driver = driver;
+          bound++;
+        }
+    }
+  return bound;
+}
+
+/* Turns on decoding of D's I/O and memory BARs and, if BUS_MASTER
+   is true, lets D initiate DMA. */
+void
+pci_enable (struct pci_dev *d, bool bus_master)
+{
+  uint16_t command = pci_read16 (d, PCI_COMMAND);
+  int i;
+
+  for (i = 0; i < PCI_BAR_CNT; i++)
+    if (d->bar[i].size != 0)
+      command |= d->bar[i].io ? PCI_COMMAND_IO : PCI_COMMAND_MEMORY;
+  if (bus_master)
+    command |= PCI_COMMAND_MASTER;
+  pci_write16 (d, PCI_COMMAND, command);
+}
@@ -0,0 +1,97 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* PCI bus.
+
+   pci_init() walks every bus reachable from bus 0 once, at boot,
+   and records each function it finds, with its decoded base
+   address registers, in a fixed table.  A driver describes the
+   functions it handles with a struct pci_driver and passes it to
+   pci_register_driver(), which offers it each matching function
+   that no other driver has claimed.
+
+   Configuration space is reached through configuration
+   mechanism #1 (ports 0xcf8 and 0xcfc), which every PC chipset
+   and emulator since the original PCI machines provides. */
+
+/* Matches any vendor, device, or class in a struct pci_driver. */
+#define PCI_ANY 0xffff
+
+/* Standard configuration space registers. */
+#define PCI_VENDOR_ID 0x00              /* 16 bits. */
+#define PCI_DEVICE_ID 0x02              /* 16 bits. */
+#define PCI_COMMAND 0x04                /* 16 bits. */
+#define PCI_STATUS 0x06                 /* 16 bits. */
+#define PCI_REVISION 0x08               /* 8 bits. */
+#define PCI_PROG_IF 0x09                /* 8 bits. */
+#define PCI_SUBCLASS 0x0a               /* 8 bits. */
+#define PCI_CLASS 0x0b                  /* 8 bits. */
+#define PCI_HEADER_TYPE 0x0e            /* 8 bits. */
+#define PCI_BAR0 0x10                   /* 6 x 32 bits. */
+#define PCI_SECONDARY_BUS 0x19          /* 8 bits, bridges only. */
+#define PCI_INTERRUPT_LINE 0x3c         /* 8 bits. */
+#define PCI_INTERRUPT_PIN 0x3d          /* 8 bits. */
+
+/* PCI_COMMAND bits. */
+#define PCI_COMMAND_IO 0x0001           /* Decode I/O BARs. */
+#define PCI_COMMAND_MEMORY 0x0002       /* Decode memory BARs. */
+#define PCI_COMMAND_MASTER 0x0004       /* May initiate DMA. */
+
+/* Number of base address registers in a type 0 header. */
+#define PCI_BAR_CNT 6
+
+/* A decoded base address register. */
+struct pci_bar
+  {
+    uint32_t base;                      /* Port or physical address. */
+    uint32_t size;                      /* Length in bytes, 0 if unused. */
+    bool io;                            /* I/O ports, not memory? */
+    bool prefetchable;                  /* Memory without side effects? */
+  };
+
+/* A PCI function found by pci_init(). */
+struct pci_dev
+  {
+    uint8_t bus, dev, func;             /* Location. */
+    uint16_t vendor, device;            /* Identity. */
+    uint8_t class, subclass, prog_if;   /* Function's class code. */
+    uint8_t revision;
+    uint8_t irq;                        /* Interrupt line, 0xff if none. */
+    struct pci_bar bar[PCI_BAR_CNT];
+    const struct pci_driver *driver;    /* Driver bound, if any. */
+  };
+
+/* A driver for PCI functions.  Fields other than NAME and PROBE
+   may be PCI_ANY. */
+struct pci_driver
+  {
+    const char *name;
+    uint16_t vendor, device;            /* Identity to match. */
+    uint16_t class, subclass;           /* Class code to match. */
+
+    /* Called for each matching function not yet bound.  Returns
+       true to claim the function. */
+    bool (*probe) (struct pci_dev *);
+  };
+
+void pci_init (void);
+size_t pci_dev_cnt (void);
+struct pci_dev *pci_get (size_t idx);
+struct pci_dev *pci_find_class (uint8_t class, uint8_t subclass,
+                                struct pci_dev *prev);
+size_t pci_register_driver (const struct pci_driver *);
+
+uint32_t pci_read32 (const struct pci_dev *, uint8_t reg);
+uint16_t pci_read16 (const struct pci_dev *, uint8_t reg);
+uint8_t pci_read8 (const struct pci_dev *, uint8_t reg);
+void pci_write32 (const struct pci_dev *, uint8_t reg, uint32_t);
+void pci_write16 (const struct pci_dev *, uint8_t reg, uint16_t);
+void pci_write8 (const struct pci_dev *, uint8_t reg, uint8_t);
+
+void pci_enable (struct pci_dev *, bool bus_master);
+
+#endif /* devices/pci.h */
@@ -1,6 +1,7 @@
 #include "devices/pit.h"
 #include <debug.h>
 #include <stdint.h>
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 
@@ -11,8 +12,11 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
+/* Channel 2 gate and output, in the PC's system control port. */
+#define PIT_PORT_GATE 0x61      /* System control port B. */
+#define GATE_CH2 0x01           /* Channel 2 gate input. */
+#define GATE_SPEAKER 0x02       /* Connect channel 2 to the speaker. */
+#define GATE_CH2_OUT 0x20       /* Channel 2 output (read-only). */
 
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
@@ -81,3 +85,115 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Starts a one-shot countdown of COUNT PIT cycles on CHANNEL,
+   which must be channel 0.  When the count runs out, the
+   channel's output rises and stays high, so that interrupt line
+   0 fires exactly once.  COUNT must be between 1 and
+   PIT_COUNT_MAX.
+
+   This reprograms the channel in mode 0 ("interrupt on terminal
+   count"); use pit_configure_channel() to return it to periodic
+   operation. */
+void
+pit_start_oneshot (int channel, unsigned count)
+{
+  enum intr_level old_level;
+
+  ASSERT (channel == 0);
+  ASSERT (count >= 1 && count <= PIT_COUNT_MAX);
+
+  /* A count of 0 is interpreted as 65536. */
+  if (count == PIT_COUNT_MAX)
+    count = 0;
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, (channel << 6) | 0x30);
+  outb (PIT_PORT_COUNTER (channel), count);
+  outb (PIT_PORT_COUNTER (channel), count >> 8);
+  intr_set_level (old_level);
+}
+
+/* Returns the number of PIT cycles left before channel 0 ends
+   its current countdown.  If OUTPUT is nonnull, stores the state
+   of the channel's output pin in *OUTPUT; in mode 0, a high
+   output means the one-shot countdown has already run out and
+   the returned count is meaningless.
+
+   Uses the 8254 read-back command, which latches the status and
+   the count together, so the two are consistent. */
+unsigned
+pit_read_count (int channel, bool *output)
+{
+  enum intr_level old_level;
+  uint8_t status, lo, hi;
+  unsigned count;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, 0xc0 | (2 << channel));
+  status = inb (PIT_PORT_COUNTER (channel));
+  lo = inb (PIT_PORT_COUNTER (channel));
+  hi = inb (PIT_PORT_COUNTER (channel));
+  intr_set_level (old_level);
+
+  if (output != NULL)
+    *output = (status & 0x80) != 0;
+  count = lo | (hi << 8);
+  return count != 0 ? count : PIT_COUNT_MAX;
+}
+
+/* Returns the amount by which CLOCK, a function that reads some
+   free-running counter, advances while PIT channel 2 counts down
+   COUNT cycles, which must be between 1 and PIT_COUNT_MAX - 1.
+   Dividing by COUNT / PIT_HZ seconds gives the counter's
+   frequency.
+
+   Channel 2 is used because, unlike channel 0, its output can be
+   read back directly, so no interrupt is needed to see the
+   countdown end.  The speaker is disconnected meanwhile, and
+   interrupts are off for the whole COUNT cycles. */
+uint64_t
+pit_time (unsigned count, uint64_t (*clock) (void))
+{
+  enum intr_level old_level;
+  uint8_t gate;
+  uint64_t start, end;
+
+  ASSERT (count >= 1 && count < PIT_COUNT_MAX);
+
+  old_level = intr_disable ();
+  gate = inb (PIT_PORT_GATE);
+  outb (PIT_PORT_GATE, (gate & ~GATE_SPEAKER) | GATE_CH2);
+
+  /* Mode 0: the output goes low now and rises at terminal
+     count.  Counting starts once the high byte is loaded. */
+  outb (PIT_PORT_CONTROL, (2 << 6) | 0x30);
+  outb (PIT_PORT_COUNTER (2), count);
+  outb (PIT_PORT_COUNTER (2), count >> 8);
+  start = clock ();
+  while ((inb (PIT_PORT_GATE) & GATE_CH2_OUT) == 0)
+    continue;
+  end = clock ();
+
+  outb (PIT_PORT_GATE, gate);
+  intr_set_level (old_level);
+  return end - start;
+}
+
+/* Reads the time-stamp counter, for pit_time_tsc(). */
+static uint64_t
+read_tsc (void)
+{
+  return rdtsc ();
+}
+
+/* Returns the number of CPU time-stamp counter cycles that pass
+   while PIT channel 2 counts down COUNT cycles.  See
+   pit_time(). */
+uint64_t
+pit_time_tsc (unsigned count)
+{
+  return pit_time (count, read_tsc);
+}
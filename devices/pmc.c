@@ -0,0 +1,184 @@
+#include "devices/pmc.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Architectural performance monitoring MSRs.
+   See [IA32-v3b] "Architectural Performance Monitoring". */
+#define MSR_PMC0 0xc1                   /* First counter. */
+#define MSR_PERFEVTSEL0 0x186           /* First event select. */
+#define MSR_PERF_GLOBAL_CTRL 0x38f      /* Counter enables, version 2+. */
+
+/* Event select bits. */
+#define EVTSEL_USR (1u << 16)           /* Count in user mode. */
+#define EVTSEL_OS (1u << 17)            /* Count in kernel mode. */
+#define EVTSEL_EN (1u << 22)            /* Enable counter. */
+
+/* An architectural event. */
+struct event
+  {
+    const char *name;
+    uint8_t event;                      /* Event select. */
+    uint8_t umask;                      /* Unit mask. */
+    uint8_t cpuid_bit;                  /* Bit in leaf 0xA EBX that is
+                                           set if the event is absent. */
+  };
+
+static const struct event events[PMC_EVENT_CNT] =
+  {
+    [PMC_CYCLES] = {"cycles", 0x3c, 0x00, 0},
+    [PMC_INSTRUCTIONS] = {"instructions", 0xc0, 0x00, 1},
+    [PMC_LLC_MISSES] = {"LLC misses", 0x2e, 0x41, 4},
+    [PMC_BRANCH_MISSES] = {"branch misses", 0xc5, 0x00, 6},
+  };
+
+/* Counter programmed for each event, or -1 if none. */
+static int counters[PMC_EVENT_CNT] = {-1, -1, -1, -1};
+static uint64_t counter_mask;           /* Counter width, as a mask. */
+
+/* Raw counter values when the running thread was last charged. */
+static struct pmc_counts last;
+
+static void read_counters (struct pmc_counts *);
+static void thread_counts (struct pmc_counts *);
+
+/* Detects the PMU and starts a counter for each event that it
+   supports and that there is a counter left for. */
+void
+pmc_init (void) 
+{
+  uint32_t a, b, c, d;
+  int version, counter_cnt, width, next, e;
+  uint64_t enables = 0;
+
+  cpuid (0, &a, &b, &c, &d);
+  if (a < 0xa)
+    return;
+  cpuid (0xa, &a, &b, &c, &d);
+  version = a & 0xff;
+  counter_cnt = (a >> 8) & 0xff;
+  width = (a >> 16) & 0xff;
+  if (version == 0 || counter_cnt == 0 || width == 0)
+    return;
+  counter_mask = width < 64 ? ((uint64_t) 1 << width) - 1 : (uint64_t) -1;
+
+  next = 0;
+  for (e = 0; e < PMC_EVENT_CNT && next < counter_cnt; e++)
+    {
+      /* EBX only describes the first (EAX >> 24) events. */
+      if (events[e].cpuid_bit >= (a >> 24)
+          || (b & (1u << events[e].cpuid_bit)) != 0)
+        continue;
+
+      wrmsr (MSR_PERFEVTSEL0 + next, 0);
+      wrmsr (MSR_PMC0 + next, 0);
+      wrmsr (MSR_PERFEVTSEL0 + next,
+             events[e].event | events[e].umask << 8
+             | EVTSEL_USR | EVTSEL_OS | EVTSEL_EN);
+      enables |= 1u << next;
+      counters[e] = next++;
+    }
+  if (version >= 2)
+    wrmsr (MSR_PERF_GLOBAL_CTRL, enables);
+  read_counters (&last);
+
+  printf ("PMC: version %d, %d counters of %d bits:", version,
+          counter_cnt, width);
+  for (e = 0; e < PMC_EVENT_CNT; e++)
+    if (counters[e] >= 0)
+      printf (" %s", events[e].name);
+  printf ("\n");
+}
+
+/* Returns true if EVENT is being counted. */
+bool
+pmc_available (enum pmc_event event) 
+{
+  ASSERT (event < PMC_EVENT_CNT);
+  return counters[event] >= 0;
+}
+
+/* Returns a short name for EVENT. */
+const char *
+pmc_event_name (enum pmc_event event) 
+{
+  ASSERT (event < PMC_EVENT_CNT);
+  return events[event].name;
+}
+
+/* Charges the counts since the last switch to T, which is about
+   to stop running.  Called by the scheduler with interrupts
+   off. */
+void
+pmc_switch (struct thread *t) 
+{
+  struct pmc_counts now;
+  int e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (counter_mask == 0)
+    return;
+
+  read_counters (&now);
+  for (e = 0; e < PMC_EVENT_CNT; e++)
+    t->pmc.count[e] += (now.count[e] - last.count[e]) & counter_mask;
+  last = now;
+}
+
+/* Starts measuring the running thread's counts into C. */
+void
+pmc_begin (struct pmc_counts *c) 
+{
+  thread_counts (c);
+}
+
+/* Replaces the counts in C, which pmc_begin() started, by the
+   running thread's counts since then.  Time spent running other
+   threads in between is not counted. */
+void
+pmc_end (struct pmc_counts *c) 
+{
+  struct pmc_counts now;
+  int e;
+
+  thread_counts (&now);
+  for (e = 0; e < PMC_EVENT_CNT; e++)
+    c->count[e] = now.count[e] - c->count[e];
+}
+
+/* Stores the raw value of every counter in C. */
+static void
+read_counters (struct pmc_counts *c) 
+{
+  int e;
+
+  for (e = 0; e < PMC_EVENT_CNT; e++)
+    c->count[e] = counters[e] >= 0 ? rdpmc (counters[e]) : 0;
+}
+
+/* Stores the running thread's total counts, including those since
+   it was last switched to, in C. */
+static void
+thread_counts (struct pmc_counts *c) 
+{
+  struct thread *t = thread_current ();
+  struct pmc_counts now;
+  enum intr_level old_level;
+  int e;
+
+  if (counter_mask == 0)
+    {
+      memset (c, 0, sizeof *c);
+      return;
+    }
+
+  old_level = intr_disable ();
+  read_counters (&now);
+  for (e = 0; e < PMC_EVENT_CNT; e++)
+    c->count[e] = t->pmc.count[e]
+                  + ((now.count[e] - last.count[e]) & counter_mask);
+  intr_set_level (old_level);
+}
@@ -0,0 +1,46 @@
+#ifndef DEVICES_PMC_H
+#define DEVICES_PMC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Hardware performance counters.
+
+   On CPUs with Intel's architectural performance monitoring
+   (CPUID leaf 0xA), pmc_init() programs one general-purpose
+   counter for each event below that the CPU supports, counting
+   in both kernel and user mode.  The scheduler charges the
+   counts accumulated while each thread runs to that thread, so
+   they can be read per thread, and pmc_begin() and pmc_end()
+   measure a region of code in the running thread.
+
+   Events the CPU lacks, or every event if it has no PMU (as
+   under most emulators), always read as 0. */
+
+/* Counted events. */
+enum pmc_event
+  {
+    PMC_CYCLES,                 /* Unhalted core cycles. */
+    PMC_INSTRUCTIONS,           /* Instructions retired. */
+    PMC_LLC_MISSES,             /* Last-level cache misses. */
+    PMC_BRANCH_MISSES,          /* Mispredicted branches retired. */
+    PMC_EVENT_CNT
+  };
+
+/* A count for every event. */
+struct pmc_counts
+  {
+    uint64_t count[PMC_EVENT_CNT];
+  };
+
+struct thread;
+
+void pmc_init (void);
+bool pmc_available (enum pmc_event);
+const char *pmc_event_name (enum pmc_event);
+void pmc_switch (struct thread *);
+
+void pmc_begin (struct pmc_counts *);
+void pmc_end (struct pmc_counts *);
+
+#endif /* devices/pmc.h */
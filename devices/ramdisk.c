@@ -0,0 +1,109 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* RAM disk.
+
+   A block device whose sectors are kept in memory, for data that
+   never needs to outlive the machine, such as scratch files or
+   swap: it moves sectors with memcpy() instead of programmed I/O
+   and never waits.  The "-ramdisk=SECTORS" option creates one,
+   named "ram0", as a raw device, and the "-scratch", "-swap" and
+   "-filesys" options give it a role.
+
+   Its memory is set aside at boot, all of it, a page for every
+   SECTORS_PER_PAGE sectors, from the user pool, since it holds
+   bulk data.  Requests go straight to the driver, without a
+   queue to sort them: there is no seek time to save. */
+
+/* Sectors in a page. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* The RAM disk's pages. */
+static uint8_t **pages;
+
+static void ramdisk_readv (void *, block_sector_t, void *const buffers[],
+                           size_t cnt);
+static void ramdisk_writev (void *, block_sector_t,
+                            const void *const buffers[], size_t cnt);
+static void ramdisk_read (void *, block_sector_t, void *);
+static void ramdisk_write (void *, block_sector_t, const void *);
+
+static const struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    ramdisk_readv,
+    ramdisk_writev
+  };
+
+/* Creates a RAM disk of SIZE sectors, which must be nonzero, and
+   registers it with the block layer.  Panics if memory is
+   short. */
+void
+ramdisk_init (block_sector_t size) 
+{
+  size_t page_cnt = DIV_ROUND_UP (size, SECTORS_PER_PAGE);
+  size_t i;
+
+  ASSERT (size > 0);
+  pages = malloc (page_cnt * sizeof *pages);
+  if (pages == NULL)
+    PANIC ("ramdisk: out of memory");
+  for (i = 0; i < page_cnt; i++) 
+    {
+      pages[i] = palloc_get_page (PAL_USER | PAL_ZERO);
+      if (pages[i] == NULL)
+        PANIC ("ramdisk: out of memory for %"PRDSNu" sectors", size);
+    }
+  block_register ("ram0", BLOCK_RAW, "RAM disk", size, &ramdisk_operations,
+                  NULL);
+}
+
+/* Returns the memory that holds SECTOR. */
+static uint8_t *
+sector_data (block_sector_t sector) 
+{
+  return (pages[sector / SECTORS_PER_PAGE]
+          + sector % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE);
+}
+
+/* Reads the CNT sectors starting at SECTOR into BUFFERS. */
+static void
+ramdisk_readv (void *aux UNUSED, block_sector_t sector,
+               void *const buffers[], size_t cnt) 
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    memcpy (buffers[i], sector_data (sector + i), BLOCK_SECTOR_SIZE);
+}
+
+/* Writes BUFFERS to the CNT sectors starting at SECTOR. */
+static void
+ramdisk_writev (void *aux UNUSED, block_sector_t sector,
+                const void *const buffers[], size_t cnt) 
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    memcpy (sector_data (sector + i), buffers[i], BLOCK_SECTOR_SIZE);
+}
+
+/* Reads SECTOR into BUFFER. */
+static void
+ramdisk_read (void *aux UNUSED, block_sector_t sector, void *buffer) 
+{
+  memcpy (buffer, sector_data (sector), BLOCK_SECTOR_SIZE);
+}
+
+/* Writes BUFFER to SECTOR. */
+static void
+ramdisk_write (void *aux UNUSED, block_sector_t sector, const void *buffer) 
+{
+  memcpy (sector_data (sector), buffer, BLOCK_SECTOR_SIZE);
+}
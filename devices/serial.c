@@ -1,7 +1,8 @@
 #include "devices/serial.h"
 #include <debug.h>
+#include <list.h>
+#include <ring.h>
 #include "devices/input.h"
-#include "devices/intq.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
@@ -37,6 +38,16 @@
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
 
+/* Interrupt Identification Register bits. */
+#define IIR_FIFO 0xc0           /* FIFOs enabled (both bits set). */
+
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable FIFOs. */
+#define FCR_CLEAR 0x06          /* Clear receive and transmit FIFOs. */
+
+/* Size of the 16550A transmit FIFO. */
+#define FIFO_SIZE 16
+
 /* Line Control Register bits. */
 #define LCR_N81 0x03            /* No parity, 8 data bits, 1 stop bit. */
 #define LCR_DLAB 0x80           /* Divisor Latch Access Bit (DLAB). */
@@ -51,11 +62,24 @@
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
-static struct intq txq;
+/* Data to be transmitted, with room for TXQ_BUFSIZE bytes, a
+   power of 2.  Bytes are added and removed only with interrupts
+   off, which serializes the writers among themselves. */
+#define TXQ_BUFSIZE 256
+static uint8_t txq_data[TXQ_BUFSIZE];
+static struct ring txq;
+
+/* Threads waiting for room in txq. */
+static struct list txq_waiters;
+
+/* Bytes that may be written to THR each time it becomes empty:
+   FIFO_SIZE if the UART has a working FIFO, otherwise 1. */
+static size_t tx_burst;
 
 static void set_serial (int bps);
-static void putc_poll (uint8_t);
+static void init_fifo (void);
+static void putbuf_poll (const uint8_t *, size_t);
+static void put_burst (void);
 static void write_ier (void);
 static intr_handler_func serial_interrupt;
 
@@ -68,10 +92,11 @@ init_poll (void)
 {
   ASSERT (mode == UNINIT);
   outb (IER_REG, 0);                    /* Turn off all interrupts. */
-  outb (FCR_REG, 0);                    /* Disable FIFO. */
   set_serial (9600);                    /* 9.6 kbps, N-8-1. */
+  init_fifo ();                         /* Enable FIFO, if any. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
-  intq_init (&txq);
+  ring_init (&txq, txq_data, sizeof txq_data);
+  list_init (&txq_waiters);
   mode = POLL;
 } 
 
@@ -98,32 +123,58 @@ serial_init_queue (void)
 void
 serial_putc (uint8_t byte) 
 {
+  serial_putbuf (&byte, 1);
+}
+
+/* Sends the N bytes in BUFFER to the serial port.  This is
+   equivalent to calling serial_putc() for each byte, but it
+   disables interrupts only once and queues as many bytes at a
+   time as the transmit queue has room for. */
+void
+serial_putbuf (const void *buffer, size_t n) 
+{
+  const uint8_t *p = buffer;
   enum intr_level old_level = intr_disable ();
 
   if (mode != QUEUE)
     {
       /* If we're not set up for interrupt-driven I/O yet,
-         use dumb polling to transmit a byte. */
+         use dumb polling to transmit the bytes. */
       if (mode == UNINIT)
         init_poll ();
-      putc_poll (byte); 
+      putbuf_poll (p, n);
     }
-  else 
+  else
     {
-      /* Otherwise, queue a byte and update the interrupt enable
+      /* Otherwise, queue bytes and update the interrupt enable
          register. */
-      if (old_level == INTR_OFF && intq_full (&txq)) 
+      while (n > 0)
         {
-          /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-          putc_poll (intq_getc (&txq)); 
+          size_t put;
+
+          if (old_level == INTR_OFF && ring_full (&txq)) 
+            {
+              /* Interrupts are off and the transmit queue is full.
+                 If we wanted to wait for the queue to empty,
+                 we'd have to reenable interrupts.
+                 That's impolite, so we'll send a FIFO's worth
+                 via polling instead. */
+              while ((inb (LSR_REG) & LSR_THRE) == 0)
+                continue;
+              put_burst ();
+            }
+          while (ring_full (&txq)) 
+            {
+              /* Wait for the interrupt handler to make room. */
+              list_push_back (&txq_waiters, &thread_current ()->elem);
+              thread_block ();
+            }
+
+          put = ring_put_n (&txq, p, n);
+          p += put;
+          n -= put;
+          write_ier ();
         }
-
-      intq_putc (&txq, byte); 
-      write_ier ();
     }
   
   intr_set_level (old_level);
@@ -135,8 +186,12 @@ void
 serial_flush (void) 
 {
   enum intr_level old_level = intr_disable ();
-  while (!intq_empty (&txq))
-    putc_poll (intq_getc (&txq));
+  while (!ring_empty (&txq))
+    {
+      while ((inb (LSR_REG) & LSR_THRE) == 0)
+        continue;
+      put_burst ();
+    }
   intr_set_level (old_level);
 }
 
@@ -172,6 +227,23 @@ set_serial (int bps)
   outb (LCR_REG, LCR_N81);
 }
 
+/* Enables the UART's FIFOs and sets tx_burst according to
+   whether that worked.  An 8250 or 16450 has no FIFO, and the
+   original 16550's is unreliable; both read back as not
+   enabled in IIR. */
+static void
+init_fifo (void) 
+{
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR);
+  if ((inb (IIR_REG) & IIR_FIFO) == IIR_FIFO)
+    tx_burst = FIFO_SIZE;
+  else
+    {
+      outb (FCR_REG, 0);
+      tx_burst = 1;
+    }
+}
+
 /* Update interrupt enable register. */
 static void
 write_ier (void) 
@@ -182,7 +254,7 @@ write_ier (void)
 
   /* Enable transmit interrupt if we have any characters to
      transmit. */
-  if (!intq_empty (&txq))
+  if (!ring_empty (&txq))
     ier |= IER_XMIT;
 
   /* Enable receive interrupt if we have room to store any
@@ -193,16 +265,37 @@ write_ier (void)
   outb (IER_REG, ier);
 }
 
-/* Polls the serial port until it's ready,
-   and then transmits BYTE. */
+/* Polls the serial port and transmits the N bytes in BUFFER,
+   a FIFO's worth each time the transmitter empties. */
 static void
-putc_poll (uint8_t byte) 
+putbuf_poll (const uint8_t *buffer, size_t n) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
 
-  while ((inb (LSR_REG) & LSR_THRE) == 0)
-    continue;
-  outb (THR_REG, byte);
+  while (n > 0) 
+    {
+      size_t burst = n < tx_burst ? n : tx_burst;
+
+      while ((inb (LSR_REG) & LSR_THRE) == 0)
+        continue;
+      n -= burst;
+      while (burst-- > 0)
+        outb (THR_REG, *buffer++);
+    }
+}
+
+/* Moves as many bytes from txq to the transmitter as it can
+   take, which must have just been found empty: up to a FIFO's
+   worth, or a single byte without a FIFO. */
+static void
+put_burst (void) 
+{
+  uint8_t burst[FIFO_SIZE];
+  size_t i, n;
+
+  n = ring_get_n (&txq, burst, tx_burst);
+  for (i = 0; i < n; i++)
+    outb (THR_REG, burst[i]);
 }
 
 /* Serial interrupt handler. */
@@ -214,14 +307,31 @@ serial_interrupt (struct intr_frame *f UNUSED)
   inb (IIR_REG);
 
   /* As long as we have room to receive a byte, and the hardware
-     has a byte for us, receive a byte.  */
-  while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
-    input_putc (inb (RBR_REG));
-
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+     has a byte for us, receive a byte.  Pass them to the input
+     buffer in chunks, so that its reader is woken once per chunk
+     instead of once per byte. */
+  for (;;) 
+    {
+      uint8_t chunk[16];
+      size_t room = input_space ();
+      size_t n = 0;
+
+      while (n < room && n < sizeof chunk && (inb (LSR_REG) & LSR_DR) != 0)
+        chunk[n++] = inb (RBR_REG);
+      if (n == 0)
+        break;
+      input_putn (chunk, n);
+    }
+
+  /* If we have bytes to transmit and the transmitter is empty,
+     refill it, a FIFO's worth at a time. */
+  if (!ring_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
+    put_burst ();
+
+  /* Wake up writers waiting for room. */
+  while (!ring_full (&txq) && !list_empty (&txq_waiters))
+    thread_unblock (list_entry (list_pop_front (&txq_waiters),
+                                struct thread, elem));
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
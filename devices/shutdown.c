@@ -4,14 +4,31 @@
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/lockstat.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/profile.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
+#endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/merge.h"
+#include "vm/page.h"
+#include "vm/swap.h"
 #endif
 
 /* Keyboard control register port. */
@@ -129,13 +146,32 @@ static void
 print_stats (void)
 {
   timer_print_stats ();
+  intr_print_stats ();
   thread_print_stats ();
+#ifdef LOCKSTAT
+  lockstat_print ();
+#endif
+  profile_print ();
+  palloc_print_stats ();
+  malloc_print_stats ();
+  kmem_print_stats ();
 #ifdef FILESYS
+  cache_print_stats ();
+  journal_print_stats ();
+  dcache_print_stats ();
   block_print_stats ();
+#endif
+#ifdef VM
+  page_print_stats ();
+  frame_print_stats ();
+  merge_print_stats ();
+  swap_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
+  process_print_stats ();
+  syscall_print_stats ();
 #endif
 }
@@ -3,11 +3,14 @@
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
+#include "devices/lapic.h"
 #include "devices/pit.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
+#include "threads/profile.h"
+#include "threads/stats.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
-#include "lib/kernel/list.h"
 
   
 /* See [8254] for hardware details of the 8254 timer chip. */
@@ -19,33 +22,163 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
-/* Number of timer ticks since OS booted. */
+/* Number of timer ticks since OS booted.  Updated only with
+   interrupts off, under ticks_seq, so that timer_ticks() can
+   read it without disabling interrupts. */
 static int64_t ticks;
+static struct seqlock ticks_seq;
 
-/* Number of loops per timer tick.
-   Initialized by timer_calibrate(). */
+/* True if the CPU has a time-stamp counter.  Set by
+   timer_init(), and cleared by timer_calibrate() if the TSC
+   turns out to be unusable. */
+static bool has_tsc;
+
+/* Time-stamp counter cycles per second, or 0 if the CPU has no
+   usable TSC.  Initialized by timer_calibrate(). */
+static uint64_t tsc_hz;
+
+/* PIT cycles in the window that timer_calibrate() measures the
+   TSC over: 5 ms.  Interrupts are off for the whole window, so
+   it is kept shorter than a timer tick. */
+#define CALIBRATE_COUNT (PIT_HZ / 200)
+
+/* Number of loops per timer tick, used for delays only if there
+   is no TSC.  Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
 static intr_handler_func timer_interrupt;
+static void switch_to_lapic (void);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
 
-static struct list sleeping_threads;                /* List of sleeping thread, should be ordered through insert */ //---------------------------------------------------------------------------
+/* Sleeping threads, kept in a hierarchical timing wheel.
+
+   Level 0 has one slot per tick for the next WHEEL_L0_SIZE ticks.
+   Each higher level has WHEEL_LN_SIZE slots, each covering a
+   whole revolution of the level below it.  A sleeping thread
+   goes into the lowest level whose range contains its deadline,
+   and every time a lower level wraps around, the next slot of
+   the level above is "cascaded": its threads are reinserted
+   one level down.  Inserting a sleeper and expiring a tick are
+   then both amortized O(1), regardless of how many threads are
+   asleep.  Deadlines beyond the top level's range are parked in
+   its farthest slot and reinserted when that slot cascades.
+
+   Slots are FIFO, so threads with equal deadlines wake in the
+   order they went to sleep.  The wheel is only touched with
+   interrupts off. */
+#define WHEEL_L0_BITS 8
+#define WHEEL_LN_BITS 6
+#define WHEEL_L0_SIZE (1 << WHEEL_L0_BITS)
+#define WHEEL_LN_SIZE (1 << WHEEL_LN_BITS)
+#define WHEEL_LN_CNT 4          /* Number of levels above level 0. */
+
+/* Deadline offset covered by the whole wheel. */
+#define WHEEL_SPAN (WHEEL_L0_BITS + WHEEL_LN_CNT * WHEEL_LN_BITS)
+
+static struct list wheel_l0[WHEEL_L0_SIZE];
+static struct list wheel_ln[WHEEL_LN_CNT][WHEEL_LN_SIZE];
+
+/* Next tick the wheel has yet to expire. */
+static int64_t wheel_time;
+
+static void wheel_insert (struct thread *);
+static void wheel_cascade (int level);
+static void wheel_expire (void *aux);
+
+/* Deferred work that runs wheel_expire(). */
+static struct intr_deferred wheel_deferred;
+static int wheel_quiet_ticks (int max);
+
+/* Tick source.
+
+   timer_init() starts the tick on the 8254 PIT.  If the CPU has
+   a usable TSC and a local APIC, timer_calibrate() moves it to
+   the APIC timer, which takes one register write to reprogram
+   instead of several slow port accesses, and masks the PIT's
+   interrupt line. */
+bool timer_pit;
+static bool lapic_tick;
+
+/* PIT cycles per timer tick, as programmed by timer_init(). */
+#define PIT_TICK_COUNTS ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Tick source cycles per timer tick. */
+static uint32_t tick_counts = PIT_TICK_COUNTS;
+
+/* Tickless idle.
+
+   If true, the idle thread stops the periodic tick while the
+   CPU is halted and instead programs the tick source to fire
+   once at the next tick that has work to do (a sleeper's
+   deadline, a wheel cascade, or an MLFQS once-per-second
+   update).  Controlled by kernel command-line option
+   "-tickless".
+
+   The PIT's 16-bit counter limits a one-shot to about 55 ms;
+   the APIC timer's 32-bit counter reaches seconds.  At most
+   oneshot_max_ticks ticks can be skipped at a time. */
+bool timer_tickless;
+static int oneshot_max_ticks = PIT_COUNT_MAX / PIT_TICK_COUNTS;
+
+/* True while a one-shot countdown is running in place of the
+   periodic tick.  The one-shot always ends exactly on the tick
+   boundary at which `ticks' becomes oneshot_end. */
+static bool oneshot_active;
+static int64_t oneshot_end;
+
+static void oneshot_catch_up (void);
+static void source_periodic (void);
+static void source_oneshot (uint32_t count);
+static uint32_t source_remaining (bool *expired);
+
+/* Default timer slack, in ticks, of the initial thread and so,
+   by inheritance, of every thread that does not set its own.
+   Controlled by kernel command-line option "-timerslack=TICKS". */
+int64_t timer_slack_default;
+
+/* Threads woken by wheel_expire() with each disabling of
+   interrupts. */
+#define WAKE_BATCH 16
+
+/* Largest value timer_cycles() has returned from the PIT, so
+   that it stays monotonic across a tick that has wrapped the
+   counter but not yet been credited.  Only touched with
+   interrupts off. */
+static uint64_t pit_cycles_last;
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void
 timer_init (void) 
 {
+  uint32_t a, b, c, d;
+  int i, j;
+
+  cpuid (1, &a, &b, &c, &d);
+  has_tsc = (d & CPUID_TSC) != 0;
+
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
-
-  list_init(&sleeping_threads);                     /* Setup up the list */ //------------------------------------------------------------------------------------------------------------------
+  stats_counter ("timer", NULL, "ticks", &ticks);
+
+  for (i = 0; i < WHEEL_L0_SIZE; i++)
+    list_init (&wheel_l0[i]);
+  for (i = 0; i < WHEEL_LN_CNT; i++)
+    for (j = 0; j < WHEEL_LN_SIZE; j++)
+      list_init (&wheel_ln[i][j]);
+  wheel_time = ticks;
+  intr_deferred_init (&wheel_deferred, wheel_expire, NULL);
+  thread_current ()->timer_slack = timer_slack_default;
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Measures the speed of the CPU, to implement brief delays.
+   With a time-stamp counter, times it against the PIT over a
+   single short window and then moves the tick to the local APIC
+   timer, if there is one.  Otherwise calibrates loops_per_tick
+   by trial, which takes a number of timer ticks. */
 void
 timer_calibrate (void) 
 {
@@ -54,6 +187,18 @@ timer_calibrate (void)
   ASSERT (intr_get_level () == INTR_ON);
   printf ("Calibrating timer...  ");
 
+  if (has_tsc)
+    {
+      tsc_hz = pit_time_tsc (CALIBRATE_COUNT) * PIT_HZ / CALIBRATE_COUNT;
+      if (tsc_hz != 0)
+        {
+          printf ("%'"PRIu64" TSC cycles/s.\n", tsc_hz);
+          switch_to_lapic ();
+          return;
+        }
+      has_tsc = false;
+    }
+
   /* Approximate loops_per_tick as the largest power-of-two
      still less than one timer tick. */
   loops_per_tick = 1u << 10;
@@ -72,13 +217,62 @@ timer_calibrate (void)
   printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
 }
 
+/* Moves the tick from the PIT to the local APIC timer, unless
+   the "-pit" option was given or there is no usable APIC.  Only
+   done with a TSC, because without one timer_cycles() reads the
+   PIT's count. */
+static void
+switch_to_lapic (void) 
+{
+  enum intr_level old_level;
+
+  if (timer_pit || !lapic_init (tsc_hz))
+    return;
+  intr_register_ext (INTR_LAPIC_TIMER, timer_interrupt, "LAPIC Timer");
+
+  /* The new tick starts a full tick from now, so at most one
+     tick's worth of time is credited late. */
+  old_level = intr_disable ();
+  ASSERT (!oneshot_active);
+  intr_unregister_ext (0x20);
+  tick_counts = (lapic_timer_hz () + TIMER_FREQ / 2) / TIMER_FREQ;
+  oneshot_max_ticks = UINT32_MAX / tick_counts - 1;
+  lapic_tick = true;
+  source_periodic ();
+  intr_set_level (old_level);
+
+  printf ("Local APIC timer: %'"PRIu32" counts/s%s.\n", lapic_timer_hz (),
+          lapic_tsc_deadline () ? ", TSC-deadline one-shots" : "");
+}
+
 /* Returns the number of timer ticks since the OS booted. */
 int64_t
 timer_ticks (void) 
 {
-  enum intr_level old_level = intr_disable ();
-  int64_t t = ticks;
-  intr_set_level (old_level);
+  unsigned seq;
+  int64_t t;
+
+  /* While a one-shot replaces the periodic tick, `ticks' lags
+     and has to be brought up to date.  That can only happen
+     while the idle thread is running, so only an interrupt
+     handler can see it here. */
+  if (oneshot_active)
+    {
+      enum intr_level old_level = intr_disable ();
+
+      if (oneshot_active)
+        oneshot_catch_up ();
+      t = ticks;
+      intr_set_level (old_level);
+      return t;
+    }
+
+  do
+    {
+      seq = seqlock_read_begin (&ticks_seq);
+      t = ticks;
+    }
+  while (seqlock_read_retry (&ticks_seq, seq));
   return t;
 }
 
@@ -90,75 +284,145 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
-//My changes
-/* This will have the thread and the time the thread should wake up, the next thread is basically linked list
-can also add wakeup_time in thread.h struct*/
-struct
-sleeping_thread
+/* Returns the current value of the kernel's high-resolution
+   monotonic clock, which ticks timer_cycles_hz() times per
+   second.  This is the time-stamp counter if the CPU has one,
+   and otherwise the PIT's input clock, read by latching the
+   count of the current timer tick.  The TSC costs a single
+   instruction to read; the PIT fallback costs several port
+   accesses and has a resolution of under a microsecond.
+
+   Usable from any context, including interrupt handlers. */
+uint64_t
+timer_cycles (void) 
 {
-  struct thread *thread;
-  int64_t wakeup_time;
-  struct sleeping_thread *next_thread;
-};
+  enum intr_level old_level;
+  unsigned remaining;
+  bool expired;
+  uint64_t cycles;
+
+  if (has_tsc)
+    return rdtsc ();
+
+  old_level = intr_disable ();
+  cycles = timer_ticks () * PIT_TICK_COUNTS;
+  remaining = pit_read_count (0, &expired);
+  if (oneshot_active && expired)
+    remaining = 0;
+  if (remaining < PIT_TICK_COUNTS)
+    cycles += PIT_TICK_COUNTS - remaining;
+  if (cycles < pit_cycles_last)
+    cycles = pit_cycles_last;
+  pit_cycles_last = cycles;
+  intr_set_level (old_level);
 
-/* For sorting the list, in acending order */ //--------------------------------------------------------------------------------------------------------------------------
-bool
-compare (const struct list_elem *a, const struct list_elem *b)
+  return cycles;
+}
+
+/* Returns the frequency of timer_cycles(), in cycles per
+   second.  On a CPU with a TSC, this is 0 until
+   timer_calibrate() has measured it. */
+uint64_t
+timer_cycles_hz (void) 
+{
+  return has_tsc ? tsc_hz : PIT_HZ;
+}
+
+/* Converts CYCLES, a difference between timer_cycles() values,
+   to nanoseconds.  Returns 0 before the TSC is calibrated. */
+uint64_t
+timer_cycles_to_ns (uint64_t cycles) 
 {
-    return list_entry(a, struct thread, sleepelem)->wakeup_time < list_entry(b, struct thread, sleepelem)->wakeup_time;
+  uint64_t hz = timer_cycles_hz ();
+
+  if (hz == 0)
+    return 0;
+
+  /* Split the conversion so that the product cannot overflow
+     for any realistic clock rate. */
+  return cycles / hz * 1000000000 + cycles % hz * 1000000000 / hz;
 }
 
-/* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+/* Returns the value of the high-resolution clock in
+   nanoseconds.  Differences between values are meaningful, but
+   the zero point is arbitrary. */
+uint64_t
+timer_ns (void) 
+{
+  return timer_cycles_to_ns (timer_cycles ());
+}
+
+/* Sleeps for approximately TICKS timer ticks, or up to the
+   running thread's timer slack longer.  Interrupts must be
+   turned on. */
 void
 timer_sleep (int64_t ticks) 
 {
+  timer_sleep_slack (ticks, thread_current ()->timer_slack);
+}
 
-  if (ticks <= 0)                                                                       /* 0 ticks are meaningless and so are negatives */ //----------------------------------------------------------------------
+/* Sleeps for at least TICKS and at most TICKS + SLACK timer
+   ticks.  Within that window the wakeup goes on the tick that is
+   a multiple of the largest power of 2, so that sleepers whose
+   windows overlap tend to wake on the same tick, in one batch,
+   and the ticks in between have no work.  Interrupts must be
+   turned on. */
+void
+timer_sleep_slack (int64_t ticks, int64_t slack) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int64_t earliest, latest, align;
+
+  ASSERT (intr_get_level () == INTR_ON);
+  if (ticks <= 0)
     return;
 
-  int64_t start = timer_ticks();
-
-  //Record the time it should wake up //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-  struct thread *sleepy = thread_current ();
-  sleepy->wakeup_time = start + ticks;
-
-  //Insert thread into the sleeping thread list in correct order //----------------------------------------------------------------------------------------------------------------------------------------------------
-  // if (list_empty(&sleeping_threads) || list_entry(sleeping_threads.head.next, struct thread, sleepelem)->wakeup_time > start + ticks)   /* This thread should be next out, insert to front of linked list */ //----------------------------------------------------
-  // {
-  //   sleepy->sleepelem.next = &sleeping_threads.head->next;                                       /* Replace the sleepy elem next with the head of list */ //----------------------------------------------------------------
-  //   sleeping_threads.head.prev = &sleepy->sleepelem;                                       /* Replace the old head prev with new head */ //---------------------------------------------------------------------------
-  //   sleeping_threads.head = sleepy->sleepelem;                                             /* The head is now sleepy */ //--------------------------------------------------------------------------------------------
-  // }
-  // else
-  // {
-  //   //Go through each link in list //----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-  //   struct list_elem *i = sleeping_threads.head;
-  //   while (i.next != NULL)                                                                 /* Iterrate until last elem; after while loop, sleepy should be inserted after i */ //-------------------------------------
-  //   {
-  //     if (!(list_entry(i.next, struct thread, sleepelem)->wakeup_time <= start + ticks))
-  //       break;
-  //     i = i.next;
-  //   }
-
-  //   //Insert the elem in list //---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-  //   sleepy->sleepelem.next = i.next;
-  //   sleepy->sleepelem.prev = i;
-
-  //   //Update elem around sleepy //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-  //   i->next->prev = sleepy->sleepelem;
-  //   i->next = sleepy->sleepelem;
-
-  //   //Update tail of list iftail is changed //-------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-  //   if (i == sleeping_threads->tail)
-  //     sleeping_threads->tail = sleepy->sleepelem;
-  // }
-  list_insert_ordered(&sleeping_threads, &sleepy->sleepelem, compare, NULL);
-
-  //This will lock the thread and schedule the next one //-------------------------------------------------------------------------------------------------------------------------------------------------------------
-  enum intr_level old_level = intr_disable ();         /* thread_block wants intr_off */ //-----------------------------------------------------------------------------------------------------------------------------
-  thread_block ();                                     /* This will lock the thread and schedule the next one */ //-----------------------------------------------------------------------------------------------------
-  intr_set_level (old_level);                          /* Other functions do this, otherwise kernel errors */ //--------------------------------------------------------------------------------------------------------
+  old_level = intr_disable ();
+  earliest = timer_ticks () + ticks;
+  latest = earliest + (slack > 0 ? slack : 0);
+  for (align = (int64_t) 1 << 62; align > 1; align >>= 1)
+    if ((latest & ~(align - 1)) >= earliest)
+      break;
+  cur->wakeup_time = latest & ~(align - 1);
+  wheel_insert (cur);
+  thread_block ();
+  intr_set_level (old_level);
+}
+
+/* Sets the running thread's timer slack, the number of ticks
+   past its deadline that timer_sleep() may wake it, to SLACK.
+   Threads it creates afterward inherit the setting. */
+void
+timer_set_slack (int64_t slack) 
+{
+  thread_current ()->timer_slack = slack > 0 ? slack : 0;
+}
+
+/* Arranges for blocked thread T, which must be in a timed wait
+   on T->timed_sema, to be woken at tick DEADLINE by way of
+   sema_timeout() unless timer_disarm() is called first.
+   Interrupts must be off. */
+void
+timer_arm (struct thread *t, int64_t deadline) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->timed_sema != NULL);
+
+  t->wakeup_time = deadline;
+  wheel_insert (t);
+}
+
+/* Cancels the timeout armed for T by timer_arm(), which must
+   not have expired yet.  O(1).  Interrupts must be off. */
+void
+timer_disarm (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* T may be in a wheel slot or already in wheel_expire()'s list
+     of expired threads; either way, unlinking it is enough. */
+  list_remove (&t->sleepelem);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -233,26 +497,271 @@ timer_print_stats (void)
 
 /* Timer interrupt handler. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+timer_interrupt (struct intr_frame *args)
 {
+  seqlock_write_begin (&ticks_seq);
+  if (oneshot_active)
+    {
+      /* The one-shot ran out: credit the ticks it skipped and
+         go back to the periodic tick, which starts now, on a
+         tick boundary. */
+      thread_tick_idle (oneshot_end - 1 - ticks);
+      ticks = oneshot_end - 1;
+      oneshot_active = false;
+      source_periodic ();
+    }
   ticks++;
-  thread_tick ();
+  seqlock_write_end (&ticks_seq);
 
-  //In tick function, check if there is a sleeping thread, and then check if that thread should wake up //-------------------------------------------------------------------------------------------------------------
-  while (!list_empty(&sleeping_threads) && ticks >= list_entry(sleeping_threads.head.next, struct thread, sleepelem)->wakeup_time)   /* Wake up all threads that should be woken up at this time */ //------------------------
-  {
-    struct thread *wakey = list_entry (sleeping_threads.head.next, struct thread, sleepelem);
+  thread_tick ((args->cs & 3) == 3);
+  profile_sample (args);
 
-    //Update the sleeping thread list to remove the head //------------------------------------------------------------------------------------------------------------------------------------------------------------
-    // sleeping_threads->head = sleeping_threads->head->next;
-    // sleeping_threads->head->prev = NULL;
-    list_pop_front (&sleeping_threads);
+  /* Waking sleepers may take a while, so do it with interrupts
+     enabled, after the interrupt has been acknowledged. */
+  if (wheel_time <= ticks)
+    intr_defer (&wheel_deferred);
+}
+
+/* Called by the idle thread, with interrupts off, just before
+   it halts the CPU.  In tickless mode, replaces the periodic
+   tick by a one-shot that fires at the next tick with work to
+   do, if that is at least two ticks away. */
+void
+timer_idle_enter (void) 
+{
+  unsigned partial;
+  int skip;
 
-    //wakey is removed from list //------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-    // wakey->sleepelem->prev = NULL;
-    // wakey->sleepelem->next = NULL;
-    thread_unblock (wakey);
-  }
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || oneshot_active)
+    return;
+
+  skip = wheel_quiet_ticks (oneshot_max_ticks);
+  if (skip < 2)
+    return;
+
+  /* Keep the part of the current tick that has already elapsed,
+     so that the one-shot ends on a tick boundary. */
+  partial = source_remaining (NULL);
+  if (partial > tick_counts)
+    partial = tick_counts;
+  source_oneshot (partial + (skip - 1) * tick_counts);
+  oneshot_end = ticks + skip;
+  oneshot_active = true;
+}
+
+/* Called with interrupts off when the idle thread stops
+   running.  If a one-shot is in progress, brings `ticks' up to
+   date and cuts the one-shot short at the next tick boundary,
+   because the thread about to run may depend on the tick. */
+void
+timer_idle_exit (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot_active)
+    oneshot_catch_up ();
+}
+
+/* Credits the ticks that have fully elapsed since the current
+   one-shot started and, if more than one tick boundary remains
+   before it ends, restarts it to end at the very next one.
+   Interrupts must be off. */
+static void
+oneshot_catch_up (void) 
+{
+  uint32_t remaining, boundaries;
+  bool expired;
+
+  remaining = source_remaining (&expired);
+  if (expired)
+    {
+      /* The interrupt is pending, and it will credit the final
+         tick itself. */
+      boundaries = 1;
+    }
+  else
+    boundaries = DIV_ROUND_UP (remaining, tick_counts);
+
+  if (ticks < oneshot_end - boundaries)
+    {
+      thread_tick_idle (oneshot_end - boundaries - ticks);
+      seqlock_write_begin (&ticks_seq);
+      ticks = oneshot_end - boundaries;
+      seqlock_write_end (&ticks_seq);
+    }
+  if (boundaries > 1)
+    {
+      source_oneshot (remaining - (boundaries - 1) * tick_counts);
+      oneshot_end = ticks + 1;
+    }
+}
+
+/* Starts the periodic tick on the tick source. */
+static void
+source_periodic (void) 
+{
+  if (lapic_tick)
+    lapic_timer_periodic (tick_counts);
+  else
+    pit_configure_channel (0, 2, TIMER_FREQ);
+}
+
+/* Starts a one-shot of COUNT source cycles in place of the
+   periodic tick. */
+static void
+source_oneshot (uint32_t count) 
+{
+  if (lapic_tick)
+    lapic_timer_oneshot (count);
+  else
+    pit_start_oneshot (0, count);
+}
+
+/* Returns the number of source cycles before the next timer
+   interrupt and, if EXPIRED is nonnull, stores in *EXPIRED
+   whether a one-shot has already run out. */
+static uint32_t
+source_remaining (bool *expired) 
+{
+  if (lapic_tick)
+    return lapic_timer_remaining (expired);
+  else
+    return pit_read_count (0, expired);
+}
+
+/* Adds sleeping thread T to the slot of the timing wheel that
+   covers T's wakeup_time.  Interrupts must be off. */
+static void
+wheel_insert (struct thread *t) 
+{
+  int64_t expires = t->wakeup_time;
+  int64_t delta = expires - wheel_time;
+  int level, shift;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (delta < 0)
+    {
+      /* Already due: expire on the next tick processed. */
+      expires = wheel_time;
+      delta = 0;
+    }
+  if (delta < WHEEL_L0_SIZE)
+    {
+      list_push_back (&wheel_l0[expires & (WHEEL_L0_SIZE - 1)],
+                      &t->sleepelem);
+      return;
+    }
+  if (delta >= (int64_t) 1 << WHEEL_SPAN)
+    {
+      /* Beyond the wheel's range: park in the farthest slot. */
+      delta = ((int64_t) 1 << WHEEL_SPAN) - 1;
+      expires = wheel_time + delta;
+    }
+
+  shift = WHEEL_L0_BITS;
+  for (level = 0; level < WHEEL_LN_CNT - 1; level++)
+    {
+      if (delta < (int64_t) 1 << (shift + WHEEL_LN_BITS))
+        break;
+      shift += WHEEL_LN_BITS;
+    }
+  list_push_back (&wheel_ln[level][(expires >> shift) & (WHEEL_LN_SIZE - 1)],
+                  &t->sleepelem);
+}
+
+/* Reinserts every thread in the current slot of upper LEVEL,
+   which moves each one to a lower level, and cascades the level
+   above as well when LEVEL wraps around. */
+static void
+wheel_cascade (int level) 
+{
+  int shift = WHEEL_L0_BITS + level * WHEEL_LN_BITS;
+  int idx = (wheel_time >> shift) & (WHEEL_LN_SIZE - 1);
+  struct list *slot = &wheel_ln[level][idx];
+  struct list pending;
+
+  if (idx == 0 && level + 1 < WHEEL_LN_CNT)
+    wheel_cascade (level + 1);
+
+  /* Detach the slot first: threads parked beyond the wheel's
+     range may be reinserted into this same slot. */
+  list_init (&pending);
+  while (!list_empty (slot))
+    list_push_back (&pending, list_pop_front (slot));
+  while (!list_empty (&pending))
+    wheel_insert (list_entry (list_pop_front (&pending),
+                              struct thread, sleepelem));
+}
+
+/* Returns the number of ticks, at most MAX, until the next tick
+   boundary at which the timer interrupt has work to do: a
+   nonempty level-0 slot, a cascade from the upper levels, or,
+   under the MLFQS, a once-per-second recalculation.  Interrupts
+   must be off. */
+static int
+wheel_quiet_ticks (int max) 
+{
+  int64_t t;
+
+  for (t = wheel_time; t < ticks + max; t++)
+    if ((t & (WHEEL_L0_SIZE - 1)) == 0
+        || !list_empty (&wheel_l0[t & (WHEEL_L0_SIZE - 1)])
+        || (thread_mlfqs && t % TIMER_FREQ == 0))
+      break;
+  return t - ticks;
+}
+
+/* Expires every tick up to and including the current one,
+   waking the threads whose deadlines have passed.  Runs as
+   deferred work after the timer interrupt, with interrupts
+   enabled except while the wheel itself is manipulated. */
+static void
+wheel_expire (void *aux UNUSED) 
+{
+  struct list expired;
+  enum intr_level old_level;
+
+  /* Collect due threads.  Moving a whole slot is O(1). */
+  list_init (&expired);
+  old_level = intr_disable ();
+  while (wheel_time <= ticks)
+    {
+      int idx = wheel_time & (WHEEL_L0_SIZE - 1);
+      struct list *slot = &wheel_l0[idx];
+
+      if (idx == 0)
+        wheel_cascade (0);
+      list_splice (list_end (&expired), list_begin (slot), list_end (slot));
+      wheel_time++;
+    }
+  intr_set_level (old_level);
+
+  /* Wake them WAKE_BATCH at a time, each batch going onto the
+     run queue in one pass, so that interrupts are not held off
+     for the whole list. */
+  for (;;)
+    {
+      struct thread *batch[WAKE_BATCH];
+      size_t cnt = 0;
+
+      old_level = intr_disable ();
+      while (cnt < WAKE_BATCH && !list_empty (&expired))
+        {
+          struct thread *t = list_entry (list_pop_front (&expired),
+                                         struct thread, sleepelem);
+          if (t->timed_sema != NULL)
+            sema_timeout (t);
+          batch[cnt++] = t;
+        }
+      thread_unblock_batch (batch, cnt);
+      intr_set_level (old_level);
+      if (cnt < WAKE_BATCH)
+        break;
+    }
+  thread_preempt ();
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -323,5 +832,14 @@ real_time_delay (int64_t num, int32_t denom)
   /* Scale the numerator and denominator down by 1000 to avoid
      the possibility of overflow. */
   ASSERT (denom % 1000 == 0);
-  busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000)); 
+  if (tsc_hz != 0 && num > 0)
+    {
+      uint64_t cycles = tsc_hz / 1000 * num / (denom / 1000);
+      uint64_t start = rdtsc ();
+
+      while (rdtsc () - start < cycles)
+        barrier ();
+    }
+  else if (tsc_hz == 0)
+    busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000)); 
 }
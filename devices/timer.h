@@ -2,10 +2,29 @@
 #define DEVICES_TIMER_H
 
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
-/* Number of timer interrupts per second. */
+struct thread;
+
+/* Number of timer interrupts per second.  Add -DTIMER_FREQ=HZ
+   to DEFINES to build a kernel with a different rate. */
+#ifndef TIMER_FREQ
 #define TIMER_FREQ 100
+#endif
+
+/* If true, drive the tick from the 8254 PIT even if the CPU has
+   a local APIC timer.  Controlled by kernel command-line option
+   "-pit". */
+extern bool timer_pit;
+
+/* If true, stop the periodic tick while idle.
+   Controlled by kernel command-line option "-tickless". */
+extern bool timer_tickless;
+
+/* Timer slack of threads that do not set their own, in ticks.
+   Controlled by kernel command-line option "-timerslack". */
+extern int64_t timer_slack_default;
 
 void timer_init (void);
 void timer_calibrate (void);
@@ -13,17 +32,33 @@ void timer_calibrate (void);
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
 
+/* High-resolution monotonic clock. */
+uint64_t timer_cycles (void);
+uint64_t timer_cycles_hz (void);
+uint64_t timer_cycles_to_ns (uint64_t cycles);
+uint64_t timer_ns (void);
+
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
+void timer_sleep_slack (int64_t ticks, int64_t slack);
+void timer_set_slack (int64_t slack);
 void timer_msleep (int64_t milliseconds);
 void timer_usleep (int64_t microseconds);
 void timer_nsleep (int64_t nanoseconds);
 
+/* Timeouts for timed waits in threads/synch.c. */
+void timer_arm (struct thread *, int64_t deadline);
+void timer_disarm (struct thread *);
+
 /* Busy waits. */
 void timer_mdelay (int64_t milliseconds);
 void timer_udelay (int64_t microseconds);
 void timer_ndelay (int64_t nanoseconds);
 
+/* Tickless idle hooks for the idle thread. */
+void timer_idle_enter (void);
+void timer_idle_exit (void);
+
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
@@ -14,23 +14,37 @@
 #define COL_CNT 80
 #define ROW_CNT 25
 
+/* Rows that fit in the 32 kB of text-mode video memory.  The
+   display shows ROW_CNT of them, starting at row TOP, so
+   scrolling just advances TOP and tells the CRT controller.
+   Only when TOP runs out of room do the visible rows get copied
+   back to the start, once every several screens. */
+#define FB_ROWS (0x8000 / (COL_CNT * 2))
+
 /* Current cursor position.  (0,0) is in the upper left corner of
    the display. */
 static size_t cx, cy;
 
+/* Row of video memory shown at the top of the display. */
+static size_t top;
+
+/* False if output to the display is turned off. */
+static bool enabled = true;
+
 /* Attribute value for gray text on a black background. */
 #define GRAY_ON_BLACK 0x07
 
 /* Framebuffer.  See [FREEVGA] under "VGA Text Mode Operation".
-   The character at (x,y) is fb[y][x][0].
-   The attribute at (x,y) is fb[y][x][1]. */
+   The character at (x,y) on the display is fb[top + y][x][0].
+   The attribute at (x,y) is fb[top + y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
-static void move_cursor (void);
+static void move_display (void);
 static void find_cursor (size_t *x, size_t *y);
+static void put_char (int c, enum intr_level old_level);
 
 /* Initializes the VGA text display. */
 static void
@@ -46,17 +60,55 @@ init (void)
     }
 }
 
+/* Turns output to the VGA display off, for machines that are
+   run headless, where it would only cost time. */
+void
+vga_disable (void) 
+{
+  enabled = false;
+}
+
 /* Writes C to the VGA text display, interpreting control
    characters in the conventional ways.  */
 void
 vga_putc (int c)
 {
+  char ch = c;
+  vga_putbuf (&ch, 1);
+}
+
+/* Writes the N characters in BUFFER to the VGA text display,
+   interpreting control characters in the conventional ways.
+   The hardware cursor and display start are updated only once,
+   at the end. */
+void
+vga_putbuf (const char *buffer, size_t n)
+{
+  enum intr_level old_level;
+
+  if (!enabled)
+    return;
+
   /* Disable interrupts to lock out interrupt handlers
      that might write to the console. */
-  enum intr_level old_level = intr_disable ();
+  old_level = intr_disable ();
 
   init ();
-  
+  while (n-- > 0)
+    put_char (*buffer++, old_level);
+
+  /* Update cursor position. */
+  move_display ();
+
+  intr_set_level (old_level);
+}
+
+/* Writes C to the framebuffer, without moving the hardware
+   cursor.  Interrupts must be off; OLD_LEVEL is the level to
+   restore them to while beeping. */
+static void
+put_char (int c, enum intr_level old_level)
+{
   switch (c) 
     {
     case '\n':
@@ -89,43 +141,38 @@ vga_putc (int c)
       break;
       
     default:
-      fb[cy][cx][0] = c;
-      fb[cy][cx][1] = GRAY_ON_BLACK;
+      fb[top + cy][cx][0] = c;
+      fb[top + cy][cx][1] = GRAY_ON_BLACK;
       if (++cx >= COL_CNT)
         newline ();
       break;
     }
-
-  /* Update cursor position. */
-  move_cursor ();
-
-  intr_set_level (old_level);
 }
-
+
 /* Clears the screen and moves the cursor to the upper left. */
 static void
 cls (void)
 {
   size_t y;
 
+  top = 0;
   for (y = 0; y < ROW_CNT; y++)
     clear_row (y);
 
   cx = cy = 0;
-  move_cursor ();
+  move_display ();
 }
 
-/* Clears row Y to spaces. */
+/* Clears row Y of the display to spaces, two cells per
+   32-bit store. */
 static void
 clear_row (size_t y) 
 {
-  size_t x;
+  uint32_t *p = (uint32_t *) fb[top + y];
+  size_t i;
 
-  for (x = 0; x < COL_CNT; x++)
-    {
-      fb[y][x][0] = ' ';
-      fb[y][x][1] = GRAY_ON_BLACK;
-    }
+  for (i = 0; i < COL_CNT / 2; i++)
+    p[i] = 0x00010001u * (' ' | (GRAY_ON_BLACK << 8));
 }
 
 /* Advances the cursor to the first column in the next line on
@@ -139,17 +186,30 @@ newline (void)
   if (cy >= ROW_CNT)
     {
       cy = ROW_CNT - 1;
-      memmove (&fb[0], &fb[1], sizeof fb[0] * (ROW_CNT - 1));
+      if (top + ROW_CNT < FB_ROWS)
+        top++;
+      else
+        {
+          /* Out of video memory: copy the rows that stay visible
+             back to the start. */
+          memmove (&fb[0], &fb[top + 1], sizeof fb[0] * (ROW_CNT - 1));
+          top = 0;
+        }
       clear_row (ROW_CNT - 1);
     }
 }
 
-/* Moves the hardware cursor to (cx,cy). */
+/* Tells the CRT controller to start the display at row TOP of
+   video memory and moves the hardware cursor to (cx,cy). */
 static void
-move_cursor (void) 
+move_display (void) 
 {
-  /* See [FREEVGA] under "Manipulating the Text-mode Cursor". */
-  uint16_t cp = cx + COL_CNT * cy;
+  /* See [FREEVGA] under "CRTC Registers" and "Manipulating the
+     Text-mode Cursor".  Both addresses count character cells. */
+  uint16_t start = COL_CNT * top;
+  uint16_t cp = start + cx + COL_CNT * cy;
+  outw (0x3d4, 0x0c | (start & 0xff00));
+  outw (0x3d4, 0x0d | (start << 8));
   outw (0x3d4, 0x0e | (cp & 0xff00));
   outw (0x3d4, 0x0f | (cp << 8));
 }
@@ -0,0 +1,513 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Driver for virtio block devices, the paravirtual disks that
+   QEMU provides with "-drive if=virtio".  It speaks the legacy
+   (virtio 0.9.5) interface, which QEMU's transitional devices
+   offer through an I/O BAR, with a single split virtqueue.
+
+   Unlike an IDE channel, which runs one command at a time, the
+   device works on every request in its queue at once, so each
+   disk gets several block layer dispatchers, each with a request
+   in flight, and the device interrupts as requests finish. */
+
+/* PCI identity of a transitional virtio block device. */
+#define VIRTIO_VENDOR 0x1af4
+#define VIRTIO_BLK_DEVICE 0x1001
+
+/* Legacy register offsets within BAR 0, without MSI-X. */
+#define REG_DEVICE_FEATURES 0x00        /* 32 bits, r/o. */
+#define REG_GUEST_FEATURES 0x04         /* 32 bits. */
+#define REG_QUEUE_PFN 0x08              /* 32 bits. */
+#define REG_QUEUE_SIZE 0x0c             /* 16 bits, r/o. */
+#define REG_QUEUE_SELECT 0x0e           /* 16 bits. */
+#define REG_QUEUE_NOTIFY 0x10           /* 16 bits. */
+#define REG_STATUS 0x12                 /* 8 bits. */
+#define REG_ISR 0x13                    /* 8 bits, r/o, read clears. */
+#define REG_CAPACITY 0x14               /* 64 bits, in sectors. */
+#define REG_SIZE_MAX 0x1c               /* 32 bits, bytes per segment. */
+#define REG_SEG_MAX 0x20                /* 32 bits, segments per request. */
+
+/* REG_STATUS bits. */
+#define STATUS_ACKNOWLEDGE 0x01         /* Guest noticed the device. */
+#define STATUS_DRIVER 0x02              /* Guest has a driver for it. */
+#define STATUS_DRIVER_OK 0x04           /* Driver is ready. */
+#define STATUS_FAILED 0x80              /* Driver gave up. */
+
+/* Feature bits. */
+#define F_SIZE_MAX (1u << 1)            /* REG_SIZE_MAX is valid. */
+#define F_SEG_MAX (1u << 2)             /* REG_SEG_MAX is valid. */
+
+/* REG_ISR bits. */
+#define ISR_QUEUE 0x01                  /* Used ring has new entries. */
+
+/* Legacy virtqueues are aligned, and located, in pages. */
+#define QUEUE_ALIGN 4096
+
+/* A virtqueue descriptor: one physically contiguous buffer. */
+struct desc
+  {
+    uint64_t addr;                      /* Physical address. */
+    uint32_t len;                       /* Length in bytes. */
+    uint16_t flags;                     /* DESC_* flags. */
+    uint16_t next;                      /* Next in chain, with DESC_NEXT. */
+  };
+#define DESC_NEXT 0x1                   /* Chain continues at NEXT. */
+#define DESC_WRITE 0x2                  /* Device writes the buffer. */
+
+/* Available ring: chains the driver has handed to the device. */
+struct avail
+  {
+    uint16_t flags;
+    uint16_t idx;                       /* Next entry the driver fills. */
+    uint16_t ring[];                    /* Heads of chains. */
+  };
+
+/* Used ring: chains the device has finished with. */
+struct used_elem
+  {
+    uint32_t id;                        /* Head of chain. */
+    uint32_t len;                       /* Bytes written to the chain. */
+  };
+struct used
+  {
+    uint16_t flags;                     /* USED_NO_NOTIFY. */
+    uint16_t idx;                       /* Next entry the device fills. */
+    struct used_elem ring[];
+  };
+#define USED_NO_NOTIFY 0x1              /* Device does not need kicks. */
+
+/* Request header, the first buffer of every chain. */
+struct req_header
+  {
+    uint32_t type;                      /* REQ_IN or REQ_OUT. */
+    uint32_t reserved;
+    uint64_t sector;                    /* First sector. */
+  };
+#define REQ_IN 0                        /* Read. */
+#define REQ_OUT 1                       /* Write. */
+
+/* Request status, the last buffer of every chain. */
+#define REQ_OK 0
+
+/* Block layer dispatchers per disk, hence most requests in
+   flight. */
+#define DISPATCHER_CNT 8
+
+/* Most sectors per request.  The block layer never merges more
+   than 64 anyway. */
+#define MAX_SECTOR_CNT 128
+
+/* Per-chain state, indexed by the chain's head descriptor. */
+struct slot
+  {
+    struct semaphore done;              /* Up'd when the device is done. */
+  };
+
+/* A virtio block device. */
+struct virtio_blk
+  {
+    char name[8];                       /* Name, e.g. "vda". */
+    uint16_t io_base;                   /* Base of BAR 0. */
+    uint8_t irq;                        /* Interrupt vector. */
+    uint32_t size_max;                  /* Most bytes per descriptor. */
+
+    /* The virtqueue, in QUEUE_SIZE-entry rings. */
+    uint16_t queue_size;
+    struct desc *desc;
+    struct avail *avail;
+    struct used *used;
+    uint16_t used_idx;                  /* Next used entry to look at.
+                                           Interrupt handler only. */
+
+    /* Descriptor allocation.  LOCK also protects the available
+       ring. */
+    struct lock lock;
+    struct condition desc_freed;        /* Signaled when chains are freed. */
+    uint16_t free_head;                 /* First free descriptor. */
+    uint16_t free_cnt;                  /* Number of free descriptors. */
+
+    /* Per-chain state, indexed by head descriptor. */
+    struct slot *slots;
+    struct req_header *headers;
+    uint8_t *statuses;
+  };
+
+/* The devices found, for the interrupt handler. */
+#define DEVICE_MAX 4
+static struct virtio_blk *devices[DEVICE_MAX];
+static size_t device_cnt;
+
+static struct block_operations virtio_blk_operations;
+static bool probe (struct pci_dev *);
+static bool setup_queue (struct virtio_blk *);
+static void interrupt_handler (struct intr_frame *);
+
+static const struct pci_driver virtio_blk_driver =
+  {
+    "virtio-blk", VIRTIO_VENDOR, VIRTIO_BLK_DEVICE, PCI_ANY, PCI_ANY, probe
+  };
+
+/* Finds and registers every virtio block device. */
+void
+virtio_blk_init (void)
+{
+  pci_register_driver (&virtio_blk_driver);
+}
+
+/* Returns true if another device already handles interrupt
+   vector IRQ. */
+static bool
+irq_registered (uint8_t irq)
+{
+  size_t i;
+
+  for (i = 0; i < device_cnt; i++)
+    if (devices[i]->irq == irq)
+      return true;
+  return false;
+}
+
+/* Sets up PCI function P as a virtio block device and registers
+   it with the block layer.  Returns false, leaving the function
+   alone, if that fails. */
+static bool
+probe (struct pci_dev *p)
+{
+  struct virtio_blk *d;
+  struct block *block;
+  uint32_t features, accepted = 0;
+  uint64_t capacity;
+  size_t max_transfer;
+  char info[64];
+
+  if (device_cnt >= DEVICE_MAX || !p->bar[0].io || p->bar[0].size == 0
+      || p->irq >= 16)
+    return false;
+
+  d = calloc (1, sizeof *d);
+  if (d == NULL)
+    return false;
+  snprintf (d->name, sizeof d->name, "vd%c", 'a' + (int) device_cnt);
+  d->io_base = p->bar[0].base;
+  d->irq = p->irq + 0x20;
+  d->size_max = UINT32_MAX;
+  lock_init (&d->lock);
+  cond_init (&d->desc_freed);
+  pci_enable (p, true);
+
+  /* Reset the device, then tell it we found it and can drive
+     it. */
+  outb (d->io_base + REG_STATUS, 0);
+  outb (d->io_base + REG_STATUS, STATUS_ACKNOWLEDGE);
+  outb (d->io_base + REG_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+
+  /* Take only the features that limit request shapes. */
+  features = inl (d->io_base + REG_DEVICE_FEATURES);
+  max_transfer = MAX_SECTOR_CNT;
+  if (features & F_SEG_MAX)
+    {
+      uint32_t seg_max = inl (d->io_base + REG_SEG_MAX);
+      accepted |= F_SEG_MAX;
+      if (seg_max != 0 && seg_max < max_transfer)
+        max_transfer = seg_max;
+    }
+  if (features & F_SIZE_MAX)
+    {
+      uint32_t size_max = inl (d->io_base + REG_SIZE_MAX);
+      accepted |= F_SIZE_MAX;
+      if (size_max >= BLOCK_SECTOR_SIZE)
+        d->size_max = size_max;
+    }
+  outl (d->io_base + REG_GUEST_FEATURES, accepted);
+
+  if (!setup_queue (d))
+    {
+      outb (d->io_base + REG_STATUS, STATUS_FAILED);
+      free (d);
+      return false;
+    }
+  if (max_transfer > d->queue_size - 2u)
+    max_transfer = d->queue_size - 2u;
+
+  capacity = inl (d->io_base + REG_CAPACITY)
+             | (uint64_t) inl (d->io_base + REG_CAPACITY + 4) << 32;
+  if (capacity > UINT32_MAX)
+    capacity = UINT32_MAX;
+
+  if (!irq_registered (d->irq))
+    intr_register_ext (d->irq, interrupt_handler, "virtio-blk");
+  devices[device_cnt++] = d;
+  outb (d->io_base + REG_STATUS,
+        STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+
+  snprintf (info, sizeof info, "virtio, %u-entry queue",
+            (unsigned) d->queue_size);
+  block = block_register (d->name, BLOCK_RAW, info, capacity,
+                          &virtio_blk_operations, d);
+  block_set_max_transfer (block, max_transfer);
+  block_set_dispatchers (block, DISPATCHER_CNT);
+  block_start_queue (block);
+  partition_scan (block);
+  return true;
+}
+
+/* Allocates D's virtqueue, in the size the device dictates, and
+   its per-chain state, and gives the virtqueue to the device.
+   Returns false if the device has no queue or memory is short. */
+static bool
+setup_queue (struct virtio_blk *d)
+{
+  size_t avail_end, used_ofs, size, i;
+  uint8_t *ring;
+  uint16_t n;
+
+  outw (d->io_base + REG_QUEUE_SELECT, 0);
+  n = inw (d->io_base + REG_QUEUE_SIZE);
+  if (n < 3)
+    return false;
+
+  /* Descriptors and available ring, then the used ring on a
+     QUEUE_ALIGN boundary.  See section 2.3, "Virtqueue
+     Configuration", of the legacy virtio specification. */
+  avail_end = sizeof (struct desc) * n + sizeof (struct avail)
+              + sizeof (uint16_t) * (n + 1);
+  used_ofs = ROUND_UP (avail_end, QUEUE_ALIGN);
+  size = used_ofs + ROUND_UP (sizeof (struct used)
+                              + sizeof (struct used_elem) * n
+                              + sizeof (uint16_t), QUEUE_ALIGN);
+  ring = palloc_get_multiple (PAL_ZERO, size / PGSIZE);
+  d->slots = malloc (sizeof *d->slots * n);
+  d->headers = malloc (sizeof *d->headers * n);
+  d->statuses = malloc (n);
+  if (ring == NULL || d->slots == NULL || d->headers == NULL
+      || d->statuses == NULL)
+    {
+      if (ring != NULL)
+        palloc_free_multiple (ring, size / PGSIZE);
+      free (d->slots);
+      free (d->headers);
+      free (d->statuses);
+      return false;
+    }
+
+  d->queue_size = n;
+  d->desc = (struct desc *) ring;
+  d->avail = (struct avail *) (ring + sizeof (struct desc) * n);
+  d->used = (struct used *) (ring + used_ofs);
+  d->used_idx = 0;
+  for (i = 0; i < n; i++)
+    {
+      d->desc[i].next = i + 1;
+      sema_init (&d->slots[i].done, 0);
+    }
+  d->free_head = 0;
+  d->free_cnt = n;
+
+  outl (d->io_base + REG_QUEUE_PFN, vtop (ring) / QUEUE_ALIGN);
+  return true;
+}
+
+/* Returns the number of descriptors needed to describe the CNT
+   sector buffers in BUFFERS, merging physically adjacent ones as
+   far as D's size limit allows. */
+static size_t
+count_segments (const struct virtio_blk *d, const void *const buffers[],
+                size_t cnt)
+{
+  uintptr_t end = 0;
+  size_t len = 0;
+  size_t segs = 0;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      uintptr_t addr = vtop (buffers[i]);
+      if (segs == 0 || addr != end || len + BLOCK_SECTOR_SIZE > d->size_max)
+        {
+          segs++;
+          len = 0;
+        }
+      end = addr + BLOCK_SECTOR_SIZE;
+      len += BLOCK_SECTOR_SIZE;
+    }
+  return segs;
+}
+
+/* Takes a descriptor off D's free list and returns its index.
+   Links the descriptor before it, if PREV is nonnegative, to
+   it. */
+static uint16_t
+alloc_desc (struct virtio_blk *d, int prev)
+{
+  uint16_t idx = d->free_head;
+
+  ASSERT (d->free_cnt > 0);
+  d->free_head = d->desc[idx].next;
+  d->free_cnt--;
+  if (prev >= 0)
+    {
+      d->desc[prev].flags |= DESC_NEXT;
+      d->desc[prev].next = idx;
+    }
+  d->desc[idx].flags = 0;
+  return idx;
+}
+
+/* Transfers the CNT sectors starting at SEC_NO on D to or from
+   BUFFERS as a single request, and waits for it to finish.
+   Other threads may have requests in flight meanwhile. */
+static void
+transfer (struct virtio_blk *d, block_sector_t sec_no,
+          const void *const buffers[], size_t cnt, bool write)
+{
+  size_t segs = count_segments (d, buffers, cnt);
+  uint16_t head, idx;
+  int prev;
+  size_t i;
+
+  lock_acquire (&d->lock);
+  while (d->free_cnt < segs + 2)
+    cond_wait (&d->desc_freed, &d->lock);
+
+  /* Header, data, status. */
+  head = alloc_desc (d, -1);
+  d->headers[head].type = write ? REQ_OUT : REQ_IN;
+  d->headers[head].reserved = 0;
+  d->headers[head].sector = sec_no;
+  d->desc[head].addr = vtop (&d->headers[head]);
+  d->desc[head].len = sizeof d->headers[head];
+  prev = head;
+  for (i = 0; i < cnt; i++)
+    {
+      uintptr_t addr;
+
+      ASSERT (is_kernel_vaddr (buffers[i]));
+      addr = vtop (buffers[i]);
+      if (prev != head
+          && d->desc[prev].addr + d->desc[prev].len == addr
+          && d->desc[prev].len + BLOCK_SECTOR_SIZE <= d->size_max)
+        d->desc[prev].len += BLOCK_SECTOR_SIZE;
+      else
+        {
+          idx = alloc_desc (d, prev);
+          d->desc[idx].addr = addr;
+          d->desc[idx].len = BLOCK_SECTOR_SIZE;
+          d->desc[idx].flags = write ? 0 : DESC_WRITE;
+          prev = idx;
+        }
+    }
+  d->statuses[head] = 0xff;
+  idx = alloc_desc (d, prev);
+  d->desc[idx].addr = vtop (&d->statuses[head]);
+  d->desc[idx].len = 1;
+  d->desc[idx].flags = DESC_WRITE;
+
+  /* Publish the chain, then the new index, then notify the
+     device unless it asked not to be. */
+  d->avail->ring[d->avail->idx % d->queue_size] = head;
+  barrier ();
+  d->avail->idx++;
+  barrier ();
+  if (!(d->used->flags & USED_NO_NOTIFY))
+    outw (d->io_base + REG_QUEUE_NOTIFY, 0);
+  lock_release (&d->lock);
+
+  sema_down (&d->slots[head].done);
+  if (d->statuses[head] != REQ_OK)
+    PANIC ("%s: disk %s failed, sectors %"PRDSNu"-%"PRDSNu, d->name,
+           write ? "write" : "read", sec_no,
+           sec_no + (block_sector_t) cnt - 1);
+
+  /* Put the chain back on the free list. */
+  lock_acquire (&d->lock);
+  for (idx = head; ; idx = d->desc[idx].next)
+    {
+      d->free_cnt++;
+      if (!(d->desc[idx].flags & DESC_NEXT))
+        break;
+    }
+  d->desc[idx].next = d->free_head;
+  d->free_head = head;
+  cond_broadcast (&d->desc_freed, &d->lock);
+  lock_release (&d->lock);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D_ into
+   BUFFERS. */
+static void
+virtio_blk_readv (void *d_, block_sector_t sec_no, void *const buffers[],
+                  size_t cnt)
+{
+  transfer (d_, sec_no, (const void *const *) buffers, cnt, false);
+}
+
+/* Writes the CNT sectors starting at SEC_NO on disk D_ from
+   BUFFERS. */
+static void
+virtio_blk_writev (void *d_, block_sector_t sec_no,
+                   const void *const buffers[], size_t cnt)
+{
+  transfer (d_, sec_no, buffers, cnt, true);
+}
+
+/* Reads sector SEC_NO from disk D into BUFFER. */
+static void
+virtio_blk_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  virtio_blk_readv (d, sec_no, &buffer, 1);
+}
+
+/* Writes sector SEC_NO on disk D from BUFFER. */
+static void
+virtio_blk_write (void *d, block_sector_t sec_no, const void *buffer)
+{
+  virtio_blk_writev (d, sec_no, &buffer, 1);
+}
+
+static struct block_operations virtio_blk_operations =
+  {
+    virtio_blk_read,
+    virtio_blk_write,
+    virtio_blk_readv,
+    virtio_blk_writev
+  };
+
+/* Wakes the thread waiting for each request that a device on
+   this interrupt's vector has finished.  Reading the ISR
+   register acknowledges the interrupt. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  size_t i;
+
+  for (i = 0; i < device_cnt; i++)
+    {
+      struct virtio_blk *d = devices[i];
+
+      if (d->irq != f->vec_no
+          || !(inb (d->io_base + REG_ISR) & ISR_QUEUE))
+        continue;
+      for (;;)
+        {
+          barrier ();
+          if (d->used_idx == d->used->idx)
+            break;
+          sema_up (&d->slots[d->used->ring[d->used_idx
+                                           % d->queue_size].id].done);
+          d->used_idx++;
+        }
+    }
+}
@@ -0,0 +1,59 @@
+/* rusage.c
+
+   Runs a command and prints the resources it used, as the Unix
+   `time' command does. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+int
+main (int argc, char *argv[]) 
+{
+  char command[256];
+  struct rusage u;
+  pid_t pid;
+  int status;
+  int i;
+
+  if (argc < 2) 
+    {
+      printf ("usage: rusage COMMAND [ARG...]\n");
+      return EXIT_FAILURE;
+    }
+
+  /* Put the command line back together. */
+  command[0] = '\0';
+  for (i = 1; i < argc; i++) 
+    {
+      if (i > 1)
+        strlcat (command, " ", sizeof command);
+      strlcat (command, argv[i], sizeof command);
+    }
+
+  pid = exec (command);
+  if (pid == PID_ERROR) 
+    {
+      printf ("%s: exec failed\n", argv[1]);
+      return EXIT_FAILURE;
+    }
+  status = wait (pid);
+
+  /* The child has been waited for, so it is all that the
+     children's totals hold. */
+  if (!getrusage (RUSAGE_CHILDREN, &u)) 
+    {
+      printf ("rusage: getrusage failed\n");
+      return EXIT_FAILURE;
+    }
+  printf ("%s: exit code %d\n", argv[1], status);
+  printf ("%lld user ticks, %lld kernel ticks\n",
+          u.user_ticks, u.kernel_ticks);
+  printf ("%u kB peak resident, %u minor faults, %u major faults\n",
+          u.rss_max * 4, u.minor_faults, u.major_faults);
+  printf ("%llu bytes read, %llu written through system calls\n",
+          u.read_bytes, u.write_bytes);
+  printf ("%llu sectors read, %llu written\n",
+          u.read_sectors, u.write_sectors);
+  return status;
+}
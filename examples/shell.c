@@ -4,7 +4,6 @@
 #include <syscall.h>
 
 static void read_line (char line[], size_t);
-static bool backspace (char **pos, char line[]);
 
 int
 main (void)
@@ -45,60 +44,31 @@ main (void)
 }
 
 /* Reads a line of input from the user into LINE, which has room
-   for SIZE bytes.  Handles backspace and Ctrl+U in the ways
-   expected by Unix users.  On return, LINE will always be
+   for SIZE bytes.  The console edits the line, handling
+   backspace and Ctrl+U in the ways expected by Unix users, and
+   returns it whole.  On return, LINE will always be
    null-terminated and will not end in a new-line character. */
 static void
 read_line (char line[], size_t size) 
 {
-  char *pos = line;
-  for (;;)
-    {
-      char c;
-      read (STDIN_FILENO, &c, 1);
-
-      switch (c) 
-        {
-        case '\r':
-          *pos = '\0';
-          putchar ('\n');
-          return;
-
-        case '\b':
-          backspace (&pos, line);
-          break;
-
-        case ('U' - 'A') + 1:       /* Ctrl+U. */
-          while (backspace (&pos, line))
-            continue;
-          break;
+  int n;
 
-        default:
-          /* Add character to line. */
-          if (pos < line + size - 1) 
-            {
-              putchar (c);
-              *pos++ = c;
-            }
-          break;
-        }
+  fflush (stdout);
+  n = read (STDIN_FILENO, line, size - 1);
+  if (n <= 0)
+    {
+      /* End of file: act as if the user had typed "exit". */
+      strlcpy (line, "exit", size);
+      return;
     }
-}
-
-/* If *POS is past the beginning of LINE, backs up one character
-   position.  Returns true if successful, false if nothing was
-   done. */
-static bool
-backspace (char **pos, char line[]) 
-{
-  if (*pos > line)
+  if (line[n - 1] == '\n')
+    n--;
+  else if ((size_t) n == size - 1)
     {
-      /* Back up cursor, overwrite character, back up
-         again. */
-      printf ("\b \b");
-      (*pos)--;
-      return true;
+      /* Discard the rest of an overlong line. */
+      char c;
+      while (read (STDIN_FILENO, &c, 1) == 1 && c != '\n')
+        continue;
     }
-  else
-    return false;
+  line[n] = '\0';
 }
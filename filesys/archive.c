@@ -0,0 +1,202 @@
+#include "filesys/archive.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include <ustar.h>
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+
+/* Read-only files in place on the scratch device.
+
+   The `mount' action indexes the ustar archive that the `pintos'
+   utility puts on the scratch device, instead of copying its
+   files into the file system as `extract' does.  filesys_open()
+   falls back to the index for a name that the file system does
+   not have, and the file is then read straight from the
+   archive, which suits inputs that are only ever read.
+
+   Each indexed file has an inode, from inode_open_archive(),
+   that the index holds open.  The index is built before anything
+   looks it up and torn down only by archive_unmount(), from the
+   same thread, so lookups need no lock. */
+
+/* Number of hash chains, a power of 2. */
+#define BUCKET_CNT 64
+
+/* A file of the archive. */
+struct member
+  {
+    struct list_elem elem;              /* Element in a hash chain. */
+    struct inode *inode;                /* Held open by the index. */
+    char name[1];                       /* Full name in the archive. */
+  };
+
+static struct list buckets[BUCKET_CNT];
+static bool mounted;
+
+/* Returns the hash chain for NAME. */
+static struct list *
+bucket_of (const char *name)
+{
+  return &buckets[hash_string (name) & (BUCKET_CNT - 1)];
+}
+
+/* Returns the member named NAME, or a null pointer if there is
+   none. */
+static struct member *
+find (const char *name)
+{
+  struct list *bucket = bucket_of (name);
+  struct list_elem *e;
+
+  for (e = list_begin (bucket); e != list_end (bucket); e = list_next (e))
+    {
+      struct member *m = list_entry (e, struct member, elem);
+      if (!strcmp (m->name, name))
+        return m;
+    }
+  return NULL;
+}
+
+/* Adds regular file NAME, of SIZE bytes from sector START of
+   SCRATCH onward, to the index.  Returns false if memory is
+   short. */
+static bool
+add_member (struct block *scratch, const char *name, block_sector_t start,
+            int size)
+{
+  struct member *m = malloc (sizeof *m + strlen (name));
+
+  if (m == NULL)
+    return false;
+  m->inode = inode_open_archive (scratch, start, size);
+  if (m->inode == NULL)
+    {
+      free (m);
+      return false;
+    }
+  strlcpy (m->name, name, strlen (name) + 1);
+  list_push_back (bucket_of (name), &m->elem);
+  return true;
+}
+
+/* Indexes the ustar archive on the scratch device, reading only
+   its headers, and makes its regular files available to
+   filesys_open().  Directories in the archive are skipped: a
+   file's name is its full path within the archive.  Returns true
+   if successful, false if there is no scratch device or the
+   archive is damaged, in which case nothing is mounted. */
+bool
+archive_mount (void)
+{
+  struct block *scratch = block_get_role (BLOCK_SCRATCH);
+  block_sector_t sector = 0;
+  size_t file_cnt = 0;
+  char *header;
+  size_t i;
+
+  ASSERT (!mounted);
+  if (scratch == NULL)
+    return false;
+  header = malloc (BLOCK_SECTOR_SIZE);
+  if (header == NULL)
+    return false;
+  for (i = 0; i < BUCKET_CNT; i++)
+    list_init (&buckets[i]);
+  mounted = true;
+
+  for (;;)
+    {
+      const char *file_name, *error;
+      enum ustar_type type;
+      int size;
+
+      if (sector >= block_size (scratch))
+        {
+          printf ("archive: no end-of-archive marker\n");
+          goto fail;
+        }
+      block_read (scratch, sector++, header);
+      error = ustar_parse_header (header, &file_name, &type, &size);
+      if (error != NULL)
+        {
+          printf ("archive: bad ustar header in sector %"PRDSNu" (%s)\n",
+                  sector - 1, error);
+          goto fail;
+        }
+      if (type == USTAR_EOF)
+        break;
+
+      if (type == USTAR_REGULAR)
+        {
+          if (sector + DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE)
+              > block_size (scratch))
+            {
+              printf ("archive: %s: extends past end of device\n",
+                      file_name);
+              goto fail;
+            }
+          if (find (file_name) == NULL)
+            {
+              if (!add_member (scratch, file_name, sector, size))
+                {
+                  printf ("archive: out of memory\n");
+                  goto fail;
+                }
+              file_cnt++;
+            }
+        }
+      sector += DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
+    }
+
+  printf ("archive: %zu files on %s, read in place\n",
+          file_cnt, block_name (scratch));
+  free (header);
+  return true;
+
+ fail:
+  archive_unmount ();
+  free (header);
+  return false;
+}
+
+/* Removes every file of the archive from the index, so that
+   filesys_open() no longer finds them, for the scratch device to
+   be overwritten.  Files that are still open keep reading
+   whatever is then on the device. */
+void
+archive_unmount (void)
+{
+  size_t i;
+
+  if (!mounted)
+    return;
+  for (i = 0; i < BUCKET_CNT; i++)
+    while (!list_empty (&buckets[i]))
+      {
+        struct member *m = list_entry (list_pop_front (&buckets[i]),
+                                       struct member, elem);
+        inode_close (m->inode);
+        free (m);
+      }
+  mounted = false;
+}
+
+/* Opens the file of the archive named NAME, ignoring leading
+   slashes, and returns its inode, or a null pointer if the
+   archive is not mounted or has no such file. */
+struct inode *
+archive_open (const char *name)
+{
+  struct member *m;
+
+  if (!mounted)
+    return NULL;
+  while (*name == '/')
+    name++;
+  m = find (name);
+  return m != NULL ? inode_reopen (m->inode) : NULL;
+}
@@ -0,0 +1,12 @@
+#ifndef FILESYS_ARCHIVE_H
+#define FILESYS_ARCHIVE_H
+
+#include <stdbool.h>
+
+struct inode;
+
+bool archive_mount (void);
+void archive_unmount (void);
+struct inode *archive_open (const char *name);
+
+#endif /* filesys/archive.h */
@@ -0,0 +1,1240 @@
+#include "filesys/cache.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <flatmap.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/stats.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "threads/workqueue.h"
+#include "userprog/uaccess.h"
+
+/* Buffer cache of file system sectors.
+
+   Every sector that the file system reads or writes passes
+   through one of CACHE_CNT entries.  A write only marks its entry
+   dirty.  A flusher thread writes dirty sectors back every
+   FLUSH_TICKS timer ticks, or sooner when eviction runs short of
+   clean entries, so writers rarely wait for the disk; it also
+   writes out the free map's changes first.  A prefetcher thread
+   reads sectors in ahead of sequential readers.
+
+   Entries are replaced by ARC (Megiddo and Modha's Adaptive
+   Replacement Cache), so that one sequential scan cannot flush
+   the sectors in steady use.  A sector loaded into the cache
+   joins T1, the list of sectors used once lately; used again, it
+   moves to T2, the list of sectors used more than once.  Uses
+   within CORRELATED accesses of the load, such as reading a
+   sector a piece at a time, and a prefetched sector's first use,
+   count as the load itself.  Ghost lists B1 and B2 remember the
+   sectors most recently evicted from T1 and T2.  A miss on a
+   ghost moves `target', the size that T1 is allowed, toward the
+   list that would have kept the sector: up after a B1 ghost,
+   down after a B2 ghost.  Victims come from T1 when it is over
+   target and from T2 otherwise, least recently used first,
+   passing over dirty entries while a clean one is available.
+
+   Sectors that the file system marks as metadata with
+   cache_mark_meta() are, in addition, protected from being
+   evicted to make room for data as long as they hold no more
+   than META_SHARE entries.
+
+   Large one-time streams can bypass the cache, so as not to
+   evict every other thread's sectors: cache_read_direct() and
+   cache_write_direct() move whole sectors between the caller's
+   buffers and the disk, and only touch the entries of sectors
+   that happen to be cached, to keep them coherent.
+
+   Synchronization works in two levels.  cache_lock protects the
+   sector-to-entry map, the replacement lists and ghosts, and each
+   entry's `sector', `pin_cnt' and replacement state.  Each
+   entry's own lock protects its data and `dirty' flag (which
+   cache_lock holders may still read as a hint), and is held
+   across the disk I/O that fills or writes back the entry, so
+   that a sector being read in is not seen half loaded.  Threads
+   that use the same sector wait for one another; threads that
+   use different sectors do not.
+
+   Lock order is cache_lock, then an entry lock.  An entry is
+   pinned, under cache_lock, before its lock is taken and stays
+   pinned until after the lock is released, so a victim, which is
+   never pinned, can always be locked without waiting.
+
+   In a file system with a journal (see journal.c), a metadata
+   sector changed since the last commit is `jdirty', and one whose
+   latest image is in a transaction not yet in the log has that
+   transaction's number in `jseq'.  Either keeps it from being
+   written back or evicted, so that no metadata reaches its home
+   location before the log has it.
+
+   So that a reboot does not start with a cold cache, shutdown
+   records the sectors cached at the time, those used more than
+   once first, in WARM_SECTOR.  The next boot reads them back in
+   the background, in ascending order and in runs of adjacent
+   sectors, one disk request per run. */
+
+/* Entries that metadata holds without being evicted for data. */
+#define META_SHARE (CACHE_CNT / 4)
+
+/* Accesses after loading a sector within which another use
+   still counts as the same one. */
+#define CORRELATED (CACHE_CNT / 4)
+
+/* Timer ticks between write-behind passes. */
+#define FLUSH_TICKS TIMER_FREQ
+
+/* Most sectors that cache_flush_range() writes in one request.
+   It holds the lock of each, which must fit in LOCKDEP_HELD_MAX
+   when lock checking is on. */
+#define RUN_MAX 8
+
+/* Maximum number of queued read-ahead requests, a power of 2. */
+#define PREFETCH_CNT 32
+
+/* WARM_SECTOR's magic number, once formatted to hold a list. */
+#define WARM_MAGIC 0x4d524157
+
+/* On-disk warm start list, in WARM_SECTOR.  Must be exactly
+   BLOCK_SECTOR_SIZE bytes long. */
+struct warm_list
+  {
+    uint32_t magic;                     /* WARM_MAGIC. */
+    uint32_t cnt;                       /* Number of sectors. */
+    block_sector_t sectors[CACHE_CNT];  /* Sectors to load. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 8 - 4 * CACHE_CNT];
+  };
+
+/* A list in LRU order, most recently used first. */
+struct lru
+  {
+    struct list list;           /* Entries or ghosts. */
+    size_t cnt;                 /* Number of elements in LIST. */
+  };
+
+/* A cached sector. */
+struct cache_entry
+  {
+    block_sector_t sector;      /* Cached sector, or BLOCK_SECTOR_NONE. */
+    struct lru *lru;            /* T1 or T2, or null if free. */
+    struct list_elem lru_elem;  /* In LRU's list, or in free_entries. */
+    unsigned long long stamp;   /* access_clock when last counted used. */
+    bool prefetched;            /* Loaded ahead, and not used since? */
+    bool meta;                  /* Holds file system metadata? */
+    int pin_cnt;                /* Number of threads using the entry. */
+    struct lock lock;           /* Protects `data' and `dirty'. */
+    bool dirty;                 /* Modified since read or written back? */
+    bool jdirty;                /* Changed since the last commit? */
+    unsigned jseq;              /* Transaction that logged it, or 0. */
+    uint8_t *data;              /* BLOCK_SECTOR_SIZE bytes. */
+  };
+
+/* A sector recently evicted, remembered in B1 or B2. */
+struct ghost
+  {
+    block_sector_t sector;      /* Evicted sector. */
+    struct lru *lru;            /* B1 or B2. */
+    struct list_elem elem;      /* In LRU's list, or in free_ghosts. */
+  };
+
+/* No sector. */
+#define BLOCK_SECTOR_NONE ((block_sector_t) -1)
+
+static struct cache_entry entries[CACHE_CNT];
+static struct flatmap sector_map;       /* Sector -> entry. */
+static struct lock cache_lock;
+static struct condition entry_unpinned; /* Signaled when pin_cnt hits 0. */
+static struct condition flush_wanted;   /* Wakes the flusher early. */
+
+/* Replacement state, protected by cache_lock. */
+static struct lru t1, t2;               /* Used once, more than once. */
+static struct lru b1, b2;               /* Ghosts from T1, from T2. */
+static struct list free_entries;        /* Entries holding no sector. */
+static struct ghost ghosts[CACHE_CNT];
+static struct flatmap ghost_map;        /* Sector -> ghost. */
+static struct list free_ghosts;         /* Ghosts not in B1 or B2. */
+static size_t target;                   /* Entries T1 may hold. */
+static size_t meta_cnt;                 /* Entries with `meta' set. */
+static unsigned long long access_clock; /* Number of accesses. */
+
+/* Sectors that hold metadata, one bit per file system sector.
+   Written under cache_lock. */
+static struct bitmap *meta_map;
+
+/* Sectors queued for read-ahead, from prefetch_queue[prefetch_head
+   % PREFETCH_CNT] up to but not including the one at
+   prefetch_tail.  Protected by cache_lock. */
+static block_sector_t prefetch_queue[PREFETCH_CNT];
+static size_t prefetch_head, prefetch_tail;
+static struct condition prefetch_wanted; /* Queue became nonempty. */
+
+/* Warm start list, read at boot.  WARM_SECTOR is only written
+   back if it held a valid list, so that a disk formatted before
+   it was reserved keeps whatever data is there. */
+static struct warm_list warm;
+static bool warm_valid;
+
+/* Statistics. */
+static long long hit_cnt, miss_cnt, writeback_cnt, prefetch_cnt;
+static long long direct_cnt, ghost_hit_cnt, warm_cnt;
+
+static thread_func flusher, prefetcher;
+static void write_back_run (struct cache_entry *[], size_t cnt);
+static struct cache_entry *get_entry_loaded (block_sector_t, bool read,
+                                             bool prefetch, bool *loaded);
+
+/* Initializes the buffer cache. */
+void
+cache_init (void) 
+{
+  uint8_t *pages;
+  size_t i;
+
+  stats_counter ("cache", NULL, "hits", &hit_cnt);
+  stats_counter ("cache", NULL, "misses", &miss_cnt);
+  stats_counter ("cache", NULL, "writebacks", &writeback_cnt);
+  stats_counter ("cache", NULL, "prefetches", &prefetch_cnt);
+  stats_counter ("cache", NULL, "direct", &direct_cnt);
+  stats_counter ("cache", NULL, "ghost hits", &ghost_hit_cnt);
+  stats_counter ("cache", NULL, "warm", &warm_cnt);
+
+  ASSERT (sizeof (struct warm_list) == BLOCK_SECTOR_SIZE);
+  pages = palloc_get_multiple (PAL_ASSERT,
+                               CACHE_CNT * BLOCK_SECTOR_SIZE / PGSIZE);
+  meta_map = bitmap_create (block_size (fs_device));
+  if (!flatmap_init (&sector_map, CACHE_CNT)
+      || !flatmap_init (&ghost_map, CACHE_CNT) || meta_map == NULL)
+    PANIC ("cache_init: out of memory");
+  lock_init (&cache_lock);
+  cond_init (&entry_unpinned);
+  cond_init (&flush_wanted);
+  cond_init (&prefetch_wanted);
+  list_init (&t1.list);
+  list_init (&t2.list);
+  list_init (&b1.list);
+  list_init (&b2.list);
+  list_init (&free_entries);
+  list_init (&free_ghosts);
+  for (i = 0; i < CACHE_CNT; i++) 
+    {
+      struct cache_entry *e = &entries[i];
+      e->sector = BLOCK_SECTOR_NONE;
+      e->lru = NULL;
+      list_push_back (&free_entries, &e->lru_elem);
+      e->meta = false;
+      e->pin_cnt = 0;
+      lock_init (&e->lock);
+      e->dirty = false;
+      e->jdirty = false;
+      e->jseq = 0;
+      e->data = pages + i * BLOCK_SECTOR_SIZE;
+      list_push_back (&free_ghosts, &ghosts[i].elem);
+    }
+
+  thread_create ("flusher", PRI_DEFAULT, flusher, NULL);
+  thread_create ("prefetcher", PRI_DEFAULT, prefetcher, NULL);
+}
+
+/* Returns true if E is dirty and may be written back, which
+   metadata that the journal has yet to commit may not.  E's lock
+   must be held, or cache_lock for a hint. */
+static bool
+writable (const struct cache_entry *e) 
+{
+  return (e->dirty && !e->jdirty
+          && (e->jseq == 0 || journal_committed (e->jseq)));
+}
+
+/* Writes E's data back to disk if it is dirty.  E's lock must be
+   held. */
+static void
+write_back (struct cache_entry *e) 
+{
+  ASSERT (lock_held_by_current_thread (&e->lock));
+  if (e->dirty)
+    write_back_run (&e, 1);
+}
+
+/* Writes the CNT dirty entries in RUN, which hold consecutive
+   sectors in ascending order, to disk in one request, and marks
+   them clean.  The caller must hold each entry's lock. */
+static void
+write_back_run (struct cache_entry *run[], size_t cnt) 
+{
+  const void *buffers[RUN_MAX];
+  enum intr_level old_level;
+  size_t i;
+
+  ASSERT (cnt > 0 && cnt <= RUN_MAX);
+  i = 0;
+  do 
+    {
+      ASSERT (lock_held_by_current_thread (&run[i]->lock));
+      ASSERT (writable (run[i]) && run[i]->sector == run[0]->sector + i);
+      buffers[i] = run[i]->data;
+    }
+  while (++i < cnt);
+  block_writev (fs_device, run[0]->sector, buffers, cnt);
+  for (i = 0; i < cnt; i++) 
+    {
+      run[i]->dirty = false;
+      if (run[i]->jseq != 0)
+        {
+          journal_homed (run[i]->jseq);
+          run[i]->jseq = 0;
+        }
+    }
+
+  /* Entries can be written back concurrently, under different
+     locks. */
+  old_level = intr_disable ();
+  writeback_cnt += cnt;
+  intr_set_level (old_level);
+}
+
+/* Adds ELEM to LRU as its most recently used element. */
+static void
+lru_push (struct lru *lru, struct list_elem *elem) 
+{
+  list_push_front (&lru->list, elem);
+  lru->cnt++;
+}
+
+/* Removes ELEM from LRU. */
+static void
+lru_remove (struct lru *lru, struct list_elem *elem) 
+{
+  list_remove (elem);
+  lru->cnt--;
+}
+
+/* Forgets ghost G. */
+static void
+drop_ghost (struct ghost *g) 
+{
+  lru_remove (g->lru, &g->elem);
+  flatmap_remove (&ghost_map, g->sector);
+  list_push_front (&free_ghosts, &g->elem);
+}
+
+/* Returns the least recently used ghost of LRU, which must not be
+   empty. */
+static struct ghost *
+oldest_ghost (struct lru *lru) 
+{
+  return list_entry (list_back (&lru->list), struct ghost, elem);
+}
+
+/* Remembers SECTOR, just evicted from T1 or T2, in B1 or B2
+   respectively, as LRU says.  As in ARC, T1 and B1 together stay
+   within CACHE_CNT, and so, with one ghost per entry at most, do
+   B1 and B2. */
+static void
+add_ghost (block_sector_t sector, struct lru *lru) 
+{
+  struct ghost *g;
+
+  if (lru == &b1 && b1.cnt > 0 && t1.cnt + b1.cnt >= CACHE_CNT)
+    drop_ghost (oldest_ghost (&b1));
+  if (list_empty (&free_ghosts))
+    drop_ghost (oldest_ghost (b2.cnt > 0 ? &b2 : &b1));
+
+  g = list_entry (list_pop_front (&free_ghosts), struct ghost, elem);
+  g->sector = sector;
+  g->lru = lru;
+  lru_push (lru, &g->elem);
+  if (!flatmap_insert (&ghost_map, sector, g))
+    PANIC ("cache: out of memory");
+}
+
+/* Adapts `target' to a miss on ghost G: a sector that T1 would
+   have kept, had it been bigger, makes it bigger, and one that T2
+   would have kept makes it smaller, each by more when the other
+   ghost list is the longer. */
+static void
+adapt (const struct ghost *g) 
+{
+  if (g->lru == &b1) 
+    {
+      size_t delta = b2.cnt > b1.cnt ? b2.cnt / b1.cnt : 1;
+      target = target + delta < CACHE_CNT ? target + delta : CACHE_CNT;
+    }
+  else 
+    {
+      size_t delta = b1.cnt > b2.cnt ? b1.cnt / b2.cnt : 1;
+      target = target > delta ? target - delta : 0;
+    }
+}
+
+/* Counts a use of E, which is cached: a use of a sector in T1
+   other than the first moves it to T2, and a use of one in T2
+   moves it to the front. */
+static void
+touch (struct cache_entry *e) 
+{
+  access_clock++;
+  if (e->lru == &t1
+      && (e->prefetched || access_clock - e->stamp <= CORRELATED)) 
+    {
+      if (e->prefetched)
+        e->stamp = access_clock;
+      e->prefetched = false;
+      return;
+    }
+  lru_remove (e->lru, &e->lru_elem);
+  e->lru = &t2;
+  lru_push (&t2, &e->lru_elem);
+}
+
+/* Returns the unpinned entry of LRU that has gone unused the
+   longest, preferring a clean one, or a null pointer if there is
+   none.  Passes over entries that hold metadata if PROTECT, and
+   dirty ones that may not be written back yet. */
+static struct cache_entry *
+lru_victim (struct lru *lru, bool protect) 
+{
+  struct cache_entry *dirty = NULL;
+  struct list_elem *elem;
+
+  for (elem = list_rbegin (&lru->list); elem != list_rend (&lru->list);
+       elem = list_prev (elem)) 
+    {
+      struct cache_entry *e = list_entry (elem, struct cache_entry,
+                                          lru_elem);
+
+      if (e->pin_cnt > 0 || (protect && e->meta)
+          || (e->dirty && !writable (e)))
+        continue;
+      if (!e->dirty)
+        return e;
+      if (dirty == NULL)
+        dirty = e;
+    }
+  return dirty;
+}
+
+/* Picks an unpinned entry to hold a new sector, which holds
+   metadata if META, and whose ghost, if it has one, is G.  Takes
+   an entry holding no sector if there is one, and otherwise one from
+   T1 if T1 is over target, or from T2 if not, falling back to the
+   other list.  Metadata within its share is evicted only for
+   metadata, unless nothing else can be.  If only a dirty entry can
+   be had, wakes the flusher and returns it.  Returns a null
+   pointer if every entry is pinned.  cache_lock must be held. */
+static struct cache_entry *
+pick_victim (bool meta, const struct ghost *g) 
+{
+  bool protect = !meta && meta_cnt <= META_SHARE;
+  struct lru *first = &t2, *second = &t1;
+  struct cache_entry *e;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  if (!list_empty (&free_entries))
+    return list_entry (list_front (&free_entries), struct cache_entry,
+                       lru_elem);
+  if (t1.cnt > 0
+      && (t1.cnt > target
+          || (g != NULL && g->lru == &b2 && t1.cnt == target))) 
+    {
+      first = &t1;
+      second = &t2;
+    }
+
+  e = lru_victim (first, protect);
+  if (e == NULL)
+    e = lru_victim (second, protect);
+  if (e == NULL && protect) 
+    {
+      e = lru_victim (first, false);
+      if (e == NULL)
+        e = lru_victim (second, false);
+    }
+  if (e != NULL && e->dirty)
+    cond_signal (&flush_wanted, &cache_lock);
+  return e;
+}
+
+/* Returns the entry that holds SECTOR, with its lock held,
+   loading the sector from disk into a recycled entry if it is
+   not cached.  If READ is false, the caller is about to
+   overwrite the whole sector, so a newly loaded entry's data is
+   left as is instead of being read in.  PREFETCH is true for
+   read-ahead, which does not count as a use of the sector.  The
+   caller must release the entry with put_entry(). */
+static struct cache_entry *
+get_entry (block_sector_t sector, bool read, bool prefetch) 
+{
+  return get_entry_loaded (sector, read, prefetch, NULL);
+}
+
+/* Like get_entry(), and also sets *LOADED, if LOADED is not
+   null, to whether the sector had to be loaded into a recycled
+   entry. */
+static struct cache_entry *
+get_entry_loaded (block_sector_t sector, bool read, bool prefetch,
+                  bool *loaded) 
+{
+  struct cache_entry *e;
+  struct ghost *g;
+  bool meta;
+
+  ASSERT (sector != BLOCK_SECTOR_NONE);
+
+  if (loaded != NULL)
+    *loaded = false;
+  lock_acquire (&cache_lock);
+  for (;;) 
+    {
+      e = flatmap_find (&sector_map, sector);
+      if (e != NULL) 
+        {
+          hit_cnt++;
+          if (!prefetch)
+            touch (e);
+          e->pin_cnt++;
+          lock_release (&cache_lock);
+
+          /* Waits for any I/O on the entry to finish. */
+          lock_acquire (&e->lock);
+          return e;
+        }
+
+      g = flatmap_find (&ghost_map, sector);
+      meta = bitmap_test (meta_map, sector);
+      e = pick_victim (meta, g);
+      if (e != NULL)
+        break;
+
+      /* Every entry is in use, or holds metadata that the journal
+         has yet to commit.  Another thread may load SECTOR while
+         we wait, so look it up again afterward. */
+      journal_commit_soon ();
+      cond_wait (&entry_unpinned, &cache_lock);
+    }
+
+  miss_cnt++;
+  if (g != NULL) 
+    {
+      /* Done with G before evicting adds a ghost, which might
+         drop it. */
+      ghost_hit_cnt++;
+      adapt (g);
+      drop_ghost (g);
+    }
+
+  lock_acquire (&e->lock);
+  if (e->lru == NULL)
+    list_remove (&e->lru_elem);
+  else
+    lru_remove (e->lru, &e->lru_elem);
+  if (e->sector != BLOCK_SECTOR_NONE) 
+    {
+      /* Write back the old sector before anyone can miss on it
+         and read it from disk, which is why this happens with
+         cache_lock still held. */
+      write_back (e);
+      flatmap_remove (&sector_map, e->sector);
+      add_ghost (e->sector, e->lru == &t1 ? &b1 : &b2);
+    }
+  if (e->meta)
+    meta_cnt--;
+
+  /* A sector that was a ghost has been used before. */
+  e->sector = sector;
+  e->lru = g != NULL ? &t2 : &t1;
+  lru_push (e->lru, &e->lru_elem);
+  e->stamp = ++access_clock;
+  e->prefetched = prefetch;
+  e->meta = meta;
+  if (meta)
+    meta_cnt++;
+  e->pin_cnt = 1;
+  if (!flatmap_insert (&sector_map, sector, e))
+    PANIC ("cache: out of memory");
+  lock_release (&cache_lock);
+
+  if (loaded != NULL)
+    *loaded = true;
+  if (read)
+    block_read (fs_device, sector, e->data);
+  return e;
+}
+
+/* Releases and unpins E, which was obtained from get_entry(). */
+static void
+put_entry (struct cache_entry *e) 
+{
+  lock_release (&e->lock);
+
+  lock_acquire (&cache_lock);
+  if (--e->pin_cnt == 0)
+    cond_signal (&entry_unpinned, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Returns SECTOR's BLOCK_SECTOR_SIZE bytes of cached data, for
+   the caller to read in place instead of copying them out.  The
+   data must not be modified, and stays valid until the caller
+   returns it with cache_put().  The sector is locked meanwhile,
+   so a thread must return each sector before it borrows another
+   or calls any other cache function. */
+const void *
+cache_get_ro (block_sector_t sector) 
+{
+  return get_entry (sector, true, false)->data;
+}
+
+/* Returns DATA, obtained from cache_get_ro(), to the cache. */
+void
+cache_put (const void *data) 
+{
+  size_t idx = ((const uint8_t *) data - entries[0].data) / BLOCK_SECTOR_SIZE;
+
+  ASSERT (idx < CACHE_CNT && entries[idx].data == data);
+  put_entry (&entries[idx]);
+}
+
+/* Reads SECTOR into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes. */
+void
+cache_read (block_sector_t sector, void *buffer) 
+{
+  cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Reads SIZE bytes starting at offset OFS within SECTOR into
+   BUFFER, a user buffer if USER is true.  Returns false if
+   copying to the user buffer faults. */
+static bool
+read_at (block_sector_t sector, void *buffer, size_t ofs, size_t size,
+         bool user) 
+{
+  struct cache_entry *e;
+  bool ok;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = get_entry (sector, true, false);
+  ok = copy_maybe_user (buffer, e->data + ofs, size, user);
+  put_entry (e);
+  return ok;
+}
+
+/* Reads SIZE bytes starting at offset OFS within SECTOR into
+   BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer, size_t ofs, size_t size) 
+{
+  read_at (sector, buffer, ofs, size, false);
+}
+
+/* Reads SIZE bytes starting at offset OFS within SECTOR straight
+   into user buffer BUFFER, which must lie in user memory (see
+   userprog/uaccess.h).  Returns false if BUFFER is not mapped
+   and writable. */
+bool
+cache_read_at_user (block_sector_t sector, void *buffer,
+                    size_t ofs, size_t size) 
+{
+  return read_at (sector, buffer, ofs, size, true);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER into SECTOR. */
+void
+cache_write (block_sector_t sector, const void *buffer) 
+{
+  cache_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Notes that metadata entry E, whose lock is held, is about to
+   change in the running transaction.  If the log already has an
+   image of it, from an earlier transaction, that image goes home
+   first, so that each transaction's images either reach home or
+   are superseded by the next one, and a checkpoint can always
+   empty the log. */
+static void
+journal_change (struct cache_entry *e) 
+{
+  ASSERT (lock_held_by_current_thread (&e->lock));
+  if (e->jdirty)
+    return;
+  if (e->dirty && e->jseq != 0 && journal_committed (e->jseq))
+    write_back (e);
+  e->jdirty = true;
+  journal_dirtied ();
+}
+
+/* Writes SIZE bytes from BUFFER, a user buffer if USER is true,
+   into SECTOR, starting at offset OFS within the sector.  If NEW
+   is true, the sector has just been allocated, so the rest of it
+   is zeroed instead of read from disk; otherwise the rest keeps
+   its contents.  Returns false if copying from the user buffer
+   faults, in which case the sector holds part of the data. */
+static bool
+write_at (block_sector_t sector, const void *buffer, size_t ofs,
+          size_t size, bool new, bool user) 
+{
+  bool read = !new && size < BLOCK_SECTOR_SIZE;
+  struct cache_entry *e;
+  bool ok;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = get_entry (sector, read, false);
+  if (e->meta && journal_enabled ())
+    journal_change (e);
+  if (new)
+    {
+      memset (e->data, 0, ofs);
+      memset (e->data + ofs + size, 0, BLOCK_SECTOR_SIZE - ofs - size);
+    }
+  ok = copy_maybe_user (e->data + ofs, buffer, size, user);
+  if (!ok && !read)
+    {
+      /* The entry may hold another sector's data past the point
+         where the copy stopped. */
+      memset (e->data + ofs, 0, size);
+    }
+  e->dirty = true;
+  put_entry (e);
+  return ok;
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR, starting at offset
+   OFS within the sector.  The rest of the sector keeps its
+   contents. */
+void
+cache_write_at (block_sector_t sector, const void *buffer,
+                size_t ofs, size_t size) 
+{
+  write_at (sector, buffer, ofs, size, false, false);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR, starting at offset
+   OFS within the sector, like cache_write_at(), for a sector just
+   allocated whose old contents do not matter.  The rest of the
+   sector is zeroed instead of read from disk. */
+void
+cache_write_new (block_sector_t sector, const void *buffer,
+                 size_t ofs, size_t size) 
+{
+  write_at (sector, buffer, ofs, size, true, false);
+}
+
+/* Like cache_write_at(), but BUFFER is a user buffer, which must
+   lie in user memory (see userprog/uaccess.h).  Returns false if
+   BUFFER is not mapped. */
+bool
+cache_write_at_user (block_sector_t sector, const void *buffer,
+                     size_t ofs, size_t size) 
+{
+  return write_at (sector, buffer, ofs, size, false, true);
+}
+
+/* Like cache_write_new(), but BUFFER is a user buffer, which must
+   lie in user memory (see userprog/uaccess.h).  Returns false if
+   BUFFER is not mapped. */
+bool
+cache_write_new_user (block_sector_t sector, const void *buffer,
+                      size_t ofs, size_t size) 
+{
+  return write_at (sector, buffer, ofs, size, true, true);
+}
+
+/* Counts CNT sectors moved around the cache.  Direct transfers
+   run concurrently, under no common lock. */
+static void
+count_direct (size_t cnt) 
+{
+  enum intr_level old_level = intr_disable ();
+  direct_cnt += cnt;
+  intr_set_level (old_level);
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR straight
+   from disk into BUFFERS, each BLOCK_SECTOR_SIZE bytes, without
+   caching them.  Any of them cached dirty are written back first,
+   so that the disk is up to date. */
+void
+cache_read_direct (block_sector_t sector, size_t cnt, void *const buffers[]) 
+{
+  cache_flush_range (sector, cnt);
+  block_readv (fs_device, sector, buffers, cnt);
+  count_direct (cnt);
+}
+
+/* Writes the CNT sectors in BUFFERS, each BLOCK_SECTOR_SIZE
+   bytes, straight to disk at consecutive sectors starting at
+   SECTOR, without caching them.  Any of them already cached are
+   then given the new data.  They stay dirty, because the flusher
+   may have written their old data over the new meanwhile. */
+void
+cache_write_direct (block_sector_t sector, size_t cnt,
+                    const void *const buffers[]) 
+{
+  struct cache_entry *stale[CACHE_CNT];
+  size_t stale_cnt = 0;
+  size_t i;
+
+  block_writev (fs_device, sector, buffers, cnt);
+  count_direct (cnt);
+
+  /* Pin the cached entries in range.  A pinned entry keeps its
+     sector. */
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_CNT; i++) 
+    {
+      struct cache_entry *e = &entries[i];
+
+      if (e->sector != BLOCK_SECTOR_NONE && e->sector - sector < cnt) 
+        {
+          e->pin_cnt++;
+          stale[stale_cnt++] = e;
+        }
+    }
+  lock_release (&cache_lock);
+  if (stale_cnt == 0)
+    return;
+
+  for (i = 0; i < stale_cnt; i++) 
+    {
+      struct cache_entry *e = stale[i];
+
+      lock_acquire (&e->lock);
+      memcpy (e->data, buffers[e->sector - sector], BLOCK_SECTOR_SIZE);
+      e->dirty = true;
+      lock_release (&e->lock);
+    }
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < stale_cnt; i++)
+    if (--stale[i]->pin_cnt == 0)
+      cond_signal (&entry_unpinned, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Marks SECTOR as holding file system metadata, such as an inode
+   or index block, a directory or the free map, to be protected
+   from eviction as described at the top of this file.  It stays
+   marked until cache_clear_meta(). */
+void
+cache_mark_meta (block_sector_t sector) 
+{
+  struct cache_entry *e;
+
+  if (bitmap_test (meta_map, sector))
+    return;
+  lock_acquire (&cache_lock);
+  bitmap_mark (meta_map, sector);
+  e = flatmap_find (&sector_map, sector);
+  if (e != NULL && !e->meta) 
+    {
+      e->meta = true;
+      meta_cnt++;
+    }
+  lock_release (&cache_lock);
+}
+
+/* Unmarks the CNT sectors starting at SECTOR, which have been
+   freed, as metadata, and has the journal revoke them. */
+void
+cache_clear_meta (block_sector_t sector, size_t cnt) 
+{
+  size_t i;
+
+  if (!bitmap_contains (meta_map, sector, cnt, true))
+    return;
+  lock_acquire (&cache_lock);
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (meta_map, sector + i))
+      journal_revoke (sector + i);
+  bitmap_set_multiple (meta_map, sector, cnt, false);
+  for (i = 0; i < CACHE_CNT; i++) 
+    {
+      struct cache_entry *e = &entries[i];
+
+      if (e->meta && e->sector - sector < cnt) 
+        {
+          e->meta = false;
+          meta_cnt--;
+        }
+    }
+  lock_release (&cache_lock);
+}
+
+/* Writes every dirty sector in the cache to disk. */
+void
+cache_flush (void) 
+{
+  cache_flush_range (0, BLOCK_SECTOR_NONE);
+}
+
+/* Writes the dirty sectors among the CNT sectors starting at
+   START to disk, and returns once they are written.  The sectors
+   go out in ascending order, and each run of adjacent dirty
+   sectors goes to the disk in one request.  The entries of a run
+   are locked in ascending order, so concurrent flushes cannot
+   deadlock. */
+void
+cache_flush_range (block_sector_t start, size_t cnt) 
+{
+  struct cache_entry *dirty[CACHE_CNT];
+  size_t dirty_cnt = 0;
+  size_t i, run_cnt;
+
+  /* Pin the dirty entries in range, sorted by sector. */
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_CNT; i++) 
+    {
+      struct cache_entry *e = &entries[i];
+      size_t j;
+
+      if (e->sector == BLOCK_SECTOR_NONE || e->sector - start >= cnt
+          || !writable (e))
+        continue;
+
+      e->pin_cnt++;
+      for (j = dirty_cnt++; j > 0 && dirty[j - 1]->sector > e->sector; j--)
+        dirty[j] = dirty[j - 1];
+      dirty[j] = e;
+    }
+  lock_release (&cache_lock);
+
+  for (i = 0; i < dirty_cnt; i += run_cnt) 
+    {
+      size_t j, k;
+
+      /* Lock the run of adjacent sectors that starts at entry I. */
+      for (run_cnt = 1; run_cnt < RUN_MAX && i + run_cnt < dirty_cnt
+             && dirty[i + run_cnt]->sector == dirty[i]->sector + run_cnt;
+           run_cnt++)
+        continue;
+      for (j = 0; j < run_cnt; j++)
+        lock_acquire (&dirty[i + j]->lock);
+
+      /* Write back each stretch of entries that are still dirty,
+         skipping any written back by another thread meanwhile. */
+      for (j = 0; j < run_cnt; j = k + 1) 
+        {
+          for (k = j; k < run_cnt && writable (dirty[i + k]); k++)
+            continue;
+          if (k > j)
+            write_back_run (&dirty[i + j], k - j);
+        }
+
+      /* Unlock, then unpin. */
+      for (j = 0; j < run_cnt; j++)
+        lock_release (&dirty[i + j]->lock);
+      lock_acquire (&cache_lock);
+      for (j = 0; j < run_cnt; j++)
+        if (--dirty[i + j]->pin_cnt == 0)
+          cond_signal (&entry_unpinned, &cache_lock);
+      lock_release (&cache_lock);
+    }
+}
+
+/* Write-behind thread.  Flushes the free map and then the cache
+   every FLUSH_TICKS ticks, or when woken because eviction found
+   no clean entry.  With a journal, the free map is left to the
+   committer, which writes it into each transaction. */
+static void
+flusher (void *aux UNUSED) 
+{
+  for (;;) 
+    {
+      lock_acquire (&cache_lock);
+      cond_wait_timeout (&flush_wanted, &cache_lock, FLUSH_TICKS);
+      lock_release (&cache_lock);
+
+      if (!journal_enabled ())
+        free_map_flush ();
+      cache_flush ();
+    }
+}
+
+/* Asks for SECTOR to be read into the cache in the background,
+   because it is likely to be read soon.  Returns without waiting.
+   Does nothing if SECTOR is already cached or queued, or if too
+   many requests are already queued. */
+void
+cache_prefetch (block_sector_t sector) 
+{
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  if (flatmap_find (&sector_map, sector) != NULL
+      || prefetch_tail - prefetch_head >= PREFETCH_CNT)
+    goto done;
+  for (i = prefetch_head; i != prefetch_tail; i++)
+    if (prefetch_queue[i % PREFETCH_CNT] == sector)
+      goto done;
+
+  prefetch_queue[prefetch_tail++ % PREFETCH_CNT] = sector;
+  cond_signal (&prefetch_wanted, &cache_lock);
+
+ done:
+  lock_release (&cache_lock);
+}
+
+/* Tells the cache that SECTOR will not be used again soon.  If
+   it is cached, clean, in no one's use and not metadata, its
+   entry is freed right away; a dirty one moves to the old end of
+   T1, to be evicted once it has been written back. */
+void
+cache_demote (block_sector_t sector) 
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  e = flatmap_find (&sector_map, sector);
+  if (e != NULL && e->pin_cnt == 0 && !e->meta) 
+    {
+      lru_remove (e->lru, &e->lru_elem);
+      if (!e->dirty) 
+        {
+          flatmap_remove (&sector_map, sector);
+          e->sector = BLOCK_SECTOR_NONE;
+          e->lru = NULL;
+          list_push_front (&free_entries, &e->lru_elem);
+        }
+      else 
+        {
+          e->lru = &t1;
+          list_push_back (&t1.list, &e->lru_elem);
+          t1.cnt++;
+        }
+    }
+  lock_release (&cache_lock);
+}
+
+/* Read-ahead thread.  Loads the sectors queued by
+   cache_prefetch(), in order. */
+static void
+prefetcher (void *aux UNUSED) 
+{
+  for (;;) 
+    {
+      block_sector_t sector;
+      bool cached;
+
+      lock_acquire (&cache_lock);
+      while (prefetch_head == prefetch_tail)
+        cond_wait (&prefetch_wanted, &cache_lock);
+      sector = prefetch_queue[prefetch_head++ % PREFETCH_CNT];
+      cached = flatmap_find (&sector_map, sector) != NULL;
+      lock_release (&cache_lock);
+
+      if (!cached) 
+        {
+          put_entry (get_entry (sector, true, true));
+          prefetch_cnt++;
+        }
+    }
+}
+
+/* Writes an empty warm start list to WARM_SECTOR, in a file
+   system being formatted. */
+void
+cache_warm_format (void) 
+{
+  memset (&warm, 0, sizeof warm);
+  warm.magic = WARM_MAGIC;
+  block_write (fs_device, WARM_SECTOR, &warm);
+  warm_valid = true;
+}
+
+/* Reads in the RUN_CNT entries in RUN, which hold consecutive
+   sectors in ascending order and were just loaded without their
+   data, in one request, then releases them. */
+static void
+warm_run (struct cache_entry *run[], size_t run_cnt) 
+{
+  void *buffers[RUN_MAX];
+  size_t i;
+
+  if (run_cnt == 0)
+    return;
+  for (i = 0; i < run_cnt; i++)
+    buffers[i] = run[i]->data;
+  block_readv (fs_device, run[0]->sector, buffers, run_cnt);
+  for (i = 0; i < run_cnt; i++)
+    put_entry (run[i]);
+  warm_cnt += run_cnt;
+}
+
+/* Work queue job that loads the sectors on the warm start list,
+   which is in ascending order.  Sectors cached meanwhile are
+   left alone, and each run of adjacent sectors that are not is
+   read in one request.  The entries of a run are locked in
+   ascending order, as in cache_flush_range(). */
+static void
+warm_load (void *aux UNUSED) 
+{
+  struct cache_entry *run[RUN_MAX];
+  size_t run_cnt = 0;
+  size_t i;
+
+  for (i = 0; i < warm.cnt; i++) 
+    {
+      block_sector_t sector = warm.sectors[i];
+      struct cache_entry *e;
+      bool loaded;
+
+      if (run_cnt == RUN_MAX
+          || (run_cnt > 0 && sector != run[run_cnt - 1]->sector + 1))
+        {
+          warm_run (run, run_cnt);
+          run_cnt = 0;
+        }
+      e = get_entry_loaded (sector, false, true, &loaded);
+      if (loaded)
+        run[run_cnt++] = e;
+      else
+        put_entry (e);
+    }
+  warm_run (run, run_cnt);
+}
+
+/* Starts loading the sectors that were cached at the last
+   shutdown, as recorded in WARM_SECTOR, in the background.  Call
+   after the journal has been replayed. */
+void
+cache_warm_start (void) 
+{
+  size_t i, j;
+
+  block_read (fs_device, WARM_SECTOR, &warm);
+  if (warm.magic != WARM_MAGIC || warm.cnt > CACHE_CNT)
+    return;
+  warm_valid = true;
+
+  /* Sort by sector, dropping any that are out of range. */
+  for (i = j = 0; i < warm.cnt; i++) 
+    {
+      block_sector_t sector = warm.sectors[i];
+      size_t k;
+
+      if (sector >= block_size (fs_device))
+        continue;
+      for (k = j++; k > 0 && warm.sectors[k - 1] > sector; k--)
+        warm.sectors[k] = warm.sectors[k - 1];
+      warm.sectors[k] = sector;
+    }
+  warm.cnt = j;
+  if (warm.cnt > 0)
+    workqueue_submit (warm_load, NULL);
+}
+
+/* Records the sectors now cached in WARM_SECTOR, those in T2
+   before those in T1 and the most recently used first in each,
+   for the next boot to load. */
+void
+cache_warm_save (void) 
+{
+  struct lru *lists[2] = { &t2, &t1 };
+  struct warm_list list;
+  size_t i;
+
+  if (!warm_valid)
+    return;
+
+  memset (&list, 0, sizeof list);
+  list.magic = WARM_MAGIC;
+  lock_acquire (&cache_lock);
+  for (i = 0; i < 2; i++) 
+    {
+      struct list_elem *e;
+
+      for (e = list_begin (&lists[i]->list); e != list_end (&lists[i]->list);
+           e = list_next (e))
+        list.sectors[list.cnt++]
+          = list_entry (e, struct cache_entry, lru_elem)->sector;
+    }
+  lock_release (&cache_lock);
+  block_write (fs_device, WARM_SECTOR, &list);
+}
+
+/* Copies the metadata sectors changed since the last commit into
+   IMAGES, BLOCK_SECTOR_SIZE bytes each, and their sector numbers
+   into SECTORS, for transaction SEQ to log, and returns how
+   many.  Each entry's earlier transaction, or 0, goes into
+   OLD_SEQS.  Changed entries that no longer hold metadata are
+   only forgotten about, since their sectors have been freed.
+   They all count as unchanged from here on, and the ones copied
+   stay unwritable until SEQ commits. */
+size_t
+cache_journal_snapshot (unsigned seq, block_sector_t sectors[],
+                        void *images, unsigned old_seqs[]) 
+{
+  struct cache_entry *changed[CACHE_CNT];
+  bool meta[CACHE_CNT];
+  size_t changed_cnt = 0, cnt = 0;
+  size_t i;
+
+  /* Pin the changed entries, noting which are still metadata. */
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_CNT; i++) 
+    {
+      struct cache_entry *e = &entries[i];
+
+      if (e->jdirty) 
+        {
+          e->pin_cnt++;
+          meta[changed_cnt] = e->meta;
+          changed[changed_cnt++] = e;
+        }
+    }
+  lock_release (&cache_lock);
+
+  for (i = 0; i < changed_cnt; i++) 
+    {
+      struct cache_entry *e = changed[i];
+
+      lock_acquire (&e->lock);
+      e->jdirty = false;
+      if (meta[i]) 
+        {
+          memcpy ((uint8_t *) images + cnt * BLOCK_SECTOR_SIZE, e->data,
+                  BLOCK_SECTOR_SIZE);
+          sectors[cnt] = e->sector;
+          old_seqs[cnt++] = e->jseq;
+          e->jseq = seq;
+        }
+      lock_release (&e->lock);
+    }
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < changed_cnt; i++)
+    if (--changed[i]->pin_cnt == 0)
+      cond_signal (&entry_unpinned, &cache_lock);
+  lock_release (&cache_lock);
+  return cnt;
+}
+
+/* Tells the cache that a transaction has been committed, so that
+   the entries it logged may be written back and evicted. */
+void
+cache_journal_committed (void) 
+{
+  lock_acquire (&cache_lock);
+  cond_broadcast (&entry_unpinned, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void) 
+{
+  printf ("Buffer cache: %lld hits, %lld misses, %lld writebacks, "
+          "%lld prefetches, %lld direct, %lld ghost hits, %lld warm\n",
+          hit_cnt, miss_cnt, writeback_cnt, prefetch_cnt, direct_cnt,
+          ghost_hit_cnt, warm_cnt);
+}
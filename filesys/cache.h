@@ -0,0 +1,43 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Number of sectors in the cache. */
+#define CACHE_CNT 64
+
+void cache_init (void);
+void cache_read (block_sector_t, void *);
+void cache_read_at (block_sector_t, void *, size_t ofs, size_t size);
+bool cache_read_at_user (block_sector_t, void *, size_t ofs, size_t size);
+const void *cache_get_ro (block_sector_t);
+void cache_put (const void *);
+void cache_write (block_sector_t, const void *);
+void cache_write_at (block_sector_t, const void *, size_t ofs, size_t size);
+void cache_write_new (block_sector_t, const void *, size_t ofs, size_t size);
+bool cache_write_at_user (block_sector_t, const void *,
+                          size_t ofs, size_t size);
+bool cache_write_new_user (block_sector_t, const void *,
+                           size_t ofs, size_t size);
+void cache_read_direct (block_sector_t, size_t cnt, void *const buffers[]);
+void cache_write_direct (block_sector_t, size_t cnt,
+                         const void *const buffers[]);
+void cache_mark_meta (block_sector_t);
+void cache_clear_meta (block_sector_t, size_t cnt);
+void cache_flush (void);
+void cache_flush_range (block_sector_t, size_t cnt);
+void cache_prefetch (block_sector_t);
+void cache_demote (block_sector_t);
+void cache_warm_format (void);
+void cache_warm_start (void);
+void cache_warm_save (void);
+void cache_print_stats (void);
+
+/* Interface for the journal. */
+size_t cache_journal_snapshot (unsigned seq, block_sector_t sectors[],
+                               void *images, unsigned old_seqs[]);
+void cache_journal_committed (void);
+
+#endif /* filesys/cache.h */
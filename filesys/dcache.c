@@ -0,0 +1,183 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/stats.h"
+#include "threads/synch.h"
+
+/* Directory entry cache.
+
+   Remembers the results of recent directory lookups, keyed on
+   the directory's inode sector and the name looked up, so that
+   opening the same file again, or probing again for a file that
+   does not exist, does not search the directory.  A negative
+   entry, one whose sector is 0, records that the directory has
+   no file by that name; sector 0 holds the free map's inode, so
+   it is never the inode of a file in a directory.
+
+   The cache holds at most DCACHE_CNT entries and replaces the
+   least recently used.  The directory code keeps it coherent by
+   calling dcache_insert() when it adds a file and
+   dcache_invalidate() when it removes one.  dcache_lock protects
+   everything here. */
+
+/* Number of cached directory entries. */
+#define DCACHE_CNT 128
+
+/* Number of hash chains, a power of 2.  The table has a fixed
+   size, unlike a struct hash, so replacing an entry never
+   rehashes. */
+#define BUCKET_CNT 64
+
+/* A cached directory entry. */
+struct dentry
+  {
+    struct list_elem hash_elem;         /* Element in a hash chain. */
+    struct list_elem lru_elem;          /* Element in lru_list. */
+    block_sector_t dir;                 /* Directory's inode sector. */
+    block_sector_t sector;              /* File's inode sector, or 0. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+  };
+
+static struct dentry dentries[DCACHE_CNT];
+static struct list buckets[BUCKET_CNT]; /* Hash chains of dentries. */
+static struct list lru_list;            /* Most recently used first. */
+static struct lock dcache_lock;
+
+/* Statistics. */
+static long long hit_cnt;               /* Lookups answered. */
+static long long negative_cnt;          /* ...of which negative. */
+static long long miss_cnt;              /* Lookups not answered. */
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void) 
+{
+  size_t i;
+
+  for (i = 0; i < BUCKET_CNT; i++)
+    list_init (&buckets[i]);
+  list_init (&lru_list);
+  lock_init (&dcache_lock);
+  stats_counter ("dcache", NULL, "hits", &hit_cnt);
+  stats_counter ("dcache", NULL, "negative_hits", &negative_cnt);
+  stats_counter ("dcache", NULL, "misses", &miss_cnt);
+
+  /* Unused entries wait at the end of the LRU list, in no hash
+     chain. */
+  for (i = 0; i < DCACHE_CNT; i++)
+    list_push_back (&lru_list, &dentries[i].lru_elem);
+}
+
+/* Returns the hash chain for NAME in the directory whose inode
+   is in sector DIR. */
+static struct list *
+bucket_of (block_sector_t dir, const char *name) 
+{
+  return &buckets[(hash_u32 (dir) ^ hash_string (name)) & (BUCKET_CNT - 1)];
+}
+
+/* Returns the cached entry for NAME in the directory whose inode
+   is in sector DIR, or a null pointer if there is none.  Must be
+   called with dcache_lock held. */
+static struct dentry *
+find (block_sector_t dir, const char *name) 
+{
+  struct list *bucket = bucket_of (dir, name);
+  struct list_elem *e;
+
+  for (e = list_begin (bucket); e != list_end (bucket); e = list_next (e)) 
+    {
+      struct dentry *d = list_entry (e, struct dentry, hash_elem);
+      if (d->dir == dir && !strcmp (d->name, name))
+        return d;
+    }
+  return NULL;
+}
+
+/* Looks up NAME in the directory whose inode is in sector DIR.
+   If the cache knows the answer, returns true and sets *SECTORP
+   to the file's inode sector, or to 0 if the directory has no
+   file named NAME.  Otherwise, returns false. */
+bool
+dcache_lookup (block_sector_t dir, const char *name,
+               block_sector_t *sectorp) 
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL) 
+    {
+      list_remove (&d->lru_elem);
+      list_push_front (&lru_list, &d->lru_elem);
+      *sectorp = d->sector;
+      hit_cnt++;
+      if (d->sector == 0)
+        negative_cnt++;
+    }
+  else
+    miss_cnt++;
+  lock_release (&dcache_lock);
+  return d != NULL;
+}
+
+/* Records that NAME in the directory whose inode is in sector
+   DIR names the file whose inode is in SECTOR, or, if SECTOR is
+   0, that the directory has no file named NAME.  Names too long
+   to be in a directory are not cached. */
+void
+dcache_insert (block_sector_t dir, const char *name, block_sector_t sector) 
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d == NULL) 
+    {
+      /* Reuse the least recently used entry. */
+      d = list_entry (list_back (&lru_list), struct dentry, lru_elem);
+      if (d->name[0] != '\0')
+        list_remove (&d->hash_elem);
+      d->dir = dir;
+      strlcpy (d->name, name, sizeof d->name);
+      list_push_front (bucket_of (dir, name), &d->hash_elem);
+    }
+  d->sector = sector;
+  list_remove (&d->lru_elem);
+  list_push_front (&lru_list, &d->lru_elem);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets anything cached about NAME in the directory whose
+   inode is in sector DIR. */
+void
+dcache_invalidate (block_sector_t dir, const char *name) 
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL) 
+    {
+      list_remove (&d->hash_elem);
+      d->name[0] = '\0';
+      list_remove (&d->lru_elem);
+      list_push_back (&lru_list, &d->lru_elem);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Prints directory entry cache statistics. */
+void
+dcache_print_stats (void) 
+{
+  printf ("Dentry cache: %lld hits (%lld negative), %lld misses\n",
+          hit_cnt, negative_cnt, miss_cnt);
+}
@@ -0,0 +1,126 @@
+#include "filesys/defrag.h"
+#include <debug.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "devices/timer.h"
+#include "filesys/directory.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* File compaction.
+
+   defrag_pass() moves the data of each scattered file in the root
+   directory into one run of consecutive sectors, with
+   inode_defrag().  The "defrag" action runs one pass; the
+   "-defrag" option starts a kernel thread at PRI_MIN that runs a
+   pass every DEFRAG_INTERVAL.  That thread only moves a file once
+   the file system device has been idle for DEFRAG_PAUSE, so it
+   keeps out of the way of foreground I/O. */
+
+/* Time between background passes. */
+#define DEFRAG_INTERVAL (60 * TIMER_FREQ)
+
+/* How long the device must be idle before the background thread
+   moves a file. */
+#define DEFRAG_PAUSE (TIMER_FREQ / 2)
+
+static struct semaphore wakeup;         /* Upped to stop the thread. */
+static struct semaphore stopped;        /* Upped once it has stopped. */
+static bool running;                    /* Thread started? */
+static volatile bool stopping;          /* Thread asked to stop? */
+
+/* Waits until the file system device has been idle for
+   DEFRAG_PAUSE.  Returns false if the thread was asked to stop
+   meanwhile. */
+static bool
+wait_for_idle (void) 
+{
+  for (;;) 
+    {
+      unsigned long long before = block_io_count (fs_device);
+      sema_down_timeout (&wakeup, DEFRAG_PAUSE);
+      if (stopping)
+        return false;
+      if (block_io_count (fs_device) == before)
+        return true;
+    }
+}
+
+/* Runs one pass over the root directory, compacting each file.
+   If THROTTLE, waits for the device to go idle before each file.
+   Returns the number of files moved. */
+static int
+run_pass (bool throttle) 
+{
+  struct dir *dir = dir_open_root ();
+  char name[NAME_MAX + 1];
+  int moved = 0;
+
+  if (dir == NULL)
+    return 0;
+  while (dir_readdir (dir, name)) 
+    {
+      struct inode *inode;
+
+      if (throttle && !wait_for_idle ())
+        break;
+      if (dir_lookup (dir, name, &inode)) 
+        {
+          if (inode_defrag (inode))
+            moved++;
+          inode_close (inode);
+        }
+    }
+  dir_close (dir);
+  return moved;
+}
+
+/* Compacts every file in the root directory right away.
+   Returns the number of files moved. */
+int
+defrag_pass (void) 
+{
+  return run_pass (false);
+}
+
+/* The background compaction thread. */
+static void
+defrag_thread (void *aux UNUSED) 
+{
+  while (!stopping) 
+    {
+      run_pass (true);
+      sema_down_timeout (&wakeup, DEFRAG_INTERVAL);
+    }
+  sema_up (&stopped);
+}
+
+/* Starts the background compaction thread, unless the file
+   system is kept in memory, which has nothing to compact. */
+void
+defrag_start (void) 
+{
+  if (fs_device == NULL)
+    return;
+  sema_init (&wakeup, 0);
+  sema_init (&stopped, 0);
+  stopping = false;
+  if (thread_create ("defrag", PRI_MIN, defrag_thread, NULL) == TID_ERROR)
+    PANIC ("couldn't start defrag thread");
+  running = true;
+}
+
+/* Stops the background compaction thread, if it was started, and
+   waits for it to finish the file it is working on. */
+void
+defrag_stop (void) 
+{
+  if (!running)
+    return;
+  stopping = true;
+  sema_up (&wakeup);
+  sema_down (&stopped);
+  running = false;
+}
@@ -0,0 +1,8 @@
+#ifndef FILESYS_DEFRAG_H
+#define FILESYS_DEFRAG_H
+
+void defrag_start (void);
+void defrag_stop (void);
+int defrag_pass (void);
+
+#endif /* filesys/defrag.h */
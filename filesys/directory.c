@@ -1,10 +1,15 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <round.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include <debug.h>
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir 
@@ -21,6 +26,126 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Directory formats.
+
+   A small directory is a linear array of dir_entry structures,
+   searched from the start.  Adding an entry to a linear directory
+   whose first LINEAR_MAX slots are all in use converts it to a
+   hashed directory.  Sector 0 of a hashed directory is a
+   dir_header and every other sector is a dir_bucket.  A name
+   hashes to one of the header's bucket_cnt chains of buckets, so
+   finding it reads the header and one chain rather than the whole
+   directory.
+
+   When the entries would fill more than 3/4 of one bucket per
+   chain, the number of chains doubles, up to MAX_BUCKETS: each
+   new chain starts out as an alias for the chain it splits from,
+   and then gets its own buckets for the entries that hash to it.
+   A chain that cannot be split for lack of disk space stays an
+   alias, which is still correct, only slower.
+
+   A hashed directory is recognized by DIR_MAGIC at offset 0,
+   where a linear directory has the inode sector of its first
+   entry.  No disk is large enough for the two to collide. */
+#define DIR_MAGIC 0x48524944            /* "DIRH". */
+#define BUCKET_ENTRIES (BLOCK_SECTOR_SIZE / sizeof (struct dir_entry))
+#define LINEAR_MAX BUCKET_ENTRIES
+#define INITIAL_BUCKETS 4
+#define MAX_BUCKETS 64
+
+/* Sector 0 of a hashed directory. */
+struct dir_header
+  {
+    uint32_t magic;                     /* DIR_MAGIC. */
+    uint32_t bucket_cnt;                /* Number of chains, a power of 2. */
+    uint32_t sector_cnt;                /* Sectors in use, with header. */
+    uint32_t entry_cnt;                 /* Entries in use. */
+    uint32_t buckets[MAX_BUCKETS];      /* Sector of each chain's head. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - (4 + MAX_BUCKETS) * 4];
+  };
+
+/* A bucket in a hashed directory. */
+struct dir_bucket
+  {
+    struct dir_entry entries[BUCKET_ENTRIES];
+    uint32_t next;                      /* Next bucket in chain, or 0. */
+    uint8_t unused[BLOCK_SECTOR_SIZE
+                   - BUCKET_ENTRIES * sizeof (struct dir_entry) - 4];
+  };
+
+/* Caches for open directories and for directory sectors. */
+static struct kmem_cache *dir_cache;
+static struct kmem_cache *sector_cache;
+
+/* Initializes the directory module. */
+void
+dir_init (void) 
+{
+  dir_cache = kmem_cache_create ("dir", sizeof (struct dir), 0, NULL);
+  sector_cache = kmem_cache_create ("dir sector", BLOCK_SECTOR_SIZE, 0,
+                                    NULL);
+  if (dir_cache == NULL || sector_cache == NULL)
+    PANIC ("dir_init: out of memory");
+  ASSERT (sizeof (struct dir_header) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct dir_bucket) == BLOCK_SECTOR_SIZE);
+}
+
+/* Reads sector IDX of directory inode INODE into BUF.  Returns
+   true if successful, false if INODE is too short. */
+static bool
+read_sector (struct inode *inode, uint32_t idx, void *buf) 
+{
+  return inode_read_at (inode, buf, BLOCK_SECTOR_SIZE,
+                        idx * BLOCK_SECTOR_SIZE) == BLOCK_SECTOR_SIZE;
+}
+
+/* Writes BUF to sector IDX of directory inode INODE.  Returns
+   true if successful, false if the disk is full. */
+static bool
+write_sector (struct inode *inode, uint32_t idx, const void *buf) 
+{
+  return inode_write_at (inode, buf, BLOCK_SECTOR_SIZE,
+                         idx * BLOCK_SECTOR_SIZE) == BLOCK_SECTOR_SIZE;
+}
+
+/* Zeros the CNT sectors starting at IDX of directory inode INODE,
+   so that a partly written change leaves no stray entries. */
+static void
+wipe_sectors (struct inode *inode, uint32_t idx, uint32_t cnt) 
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  while (cnt-- > 0)
+    write_sector (inode, idx++, zeros);
+}
+
+/* Returns true if INODE holds a hashed directory, false if it
+   holds a linear one. */
+static bool
+is_hashed (struct inode *inode) 
+{
+  uint32_t magic;
+
+  return (inode_length (inode) >= BLOCK_SECTOR_SIZE
+          && inode_read_at (inode, &magic, sizeof magic, 0) == sizeof magic
+          && magic == DIR_MAGIC);
+}
+
+/* Returns the byte offset of entry SLOT of the bucket in sector
+   IDX. */
+static off_t
+slot_ofs (uint32_t idx, size_t slot) 
+{
+  return idx * BLOCK_SECTOR_SIZE + slot * sizeof (struct dir_entry);
+}
+
+/* Returns the chain of HDR that NAME hashes to. */
+static uint32_t
+chain_of (const struct dir_header *hdr, const char *name) 
+{
+  return hash_string (name) & (hdr->bucket_cnt - 1);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
@@ -34,17 +159,18 @@ dir_create (block_sector_t sector, size_t entry_cnt)
 struct dir *
 dir_open (struct inode *inode) 
 {
-  struct dir *dir = calloc (1, sizeof *dir);
+  struct dir *dir = kmem_cache_zalloc (dir_cache);
   if (inode != NULL && dir != NULL)
     {
       dir->inode = inode;
       dir->pos = 0;
+      inode_set_meta (inode);
       return dir;
     }
   else
     {
       inode_close (inode);
-      free (dir);
+      kmem_cache_free (dir_cache, dir);
       return NULL; 
     }
 }
@@ -72,7 +198,7 @@ dir_close (struct dir *dir)
   if (dir != NULL)
     {
       inode_close (dir->inode);
-      free (dir);
+      kmem_cache_free (dir_cache, dir);
     }
 }
 
@@ -83,55 +209,352 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Searches the entries in the first CNT slots of ENTRIES, which
+   start at byte offset OFS in DIR, as lookup() does.  Returns
+   true if NAME is found. */
+static bool
+search_entries (const struct dir_entry entries[], size_t cnt, off_t ofs,
+                const char *name, struct dir_entry *ep, off_t *ofsp,
+                off_t *freep) 
+{
+  size_t slot;
+
+  for (slot = 0; slot < cnt; slot++) 
+    {
+      const struct dir_entry *e = &entries[slot];
+      if (e->in_use && !strcmp (name, e->name)) 
+        {
+          if (ep != NULL)
+            *ep = *e;
+          if (ofsp != NULL)
+            *ofsp = ofs + slot * sizeof *e;
+          return true;
+        }
+      if (!e->in_use && freep != NULL && *freep < 0)
+        *freep = ofs + slot * sizeof *e;
+    }
+  return false;
+}
+
+/* Searches the chain of hashed directory DIR that NAME hashes
+   to, as lookup() does.  Reads the header and buckets in place
+   in the buffer cache, one sector at a time. */
+static bool
+lookup_hashed (const struct dir *dir, const char *name,
+               struct dir_entry *ep, off_t *ofsp, off_t *freep) 
+{
+  const struct dir_header *hdr;
+  bool found = false;
+  uint32_t idx;
+
+  hdr = inode_get_ro (dir->inode, 0);
+  idx = hdr->buckets[chain_of (hdr, name)];
+  inode_put_ro (dir->inode, hdr);
+
+  while (idx != 0 && !found) 
+    {
+      const struct dir_bucket *b;
+
+      b = inode_get_ro (dir->inode, idx * BLOCK_SECTOR_SIZE);
+      if (b == NULL)
+        break;
+      found = search_entries (b->entries, BUCKET_ENTRIES,
+                              slot_ofs (idx, 0), name, ep, ofsp, freep);
+      idx = b->next;
+      inode_put_ro (dir->inode, b);
+    }
+  return found;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   otherwise, returns false and ignores EP and OFSP.
+   If FREEP is non-null, sets *FREEP to the offset of a free slot
+   passed over on the way, where NAME may be added, or to -1 if
+   there is none, so that dir_add() need not search again. */
 static bool
 lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp) 
+        struct dir_entry *ep, off_t *ofsp, off_t *freep) 
 {
-  struct dir_entry e;
-  size_t ofs;
+  const struct dir_entry *entries;
+  size_t cnt;
+  bool found;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
-  return false;
+  if (freep != NULL)
+    *freep = -1;
+  if (is_hashed (dir->inode))
+    return lookup_hashed (dir, name, ep, ofsp, freep);
+
+  /* Only the first LINEAR_MAX slots of a linear directory are
+     ever used, and they fit in its first sector. */
+  cnt = inode_length (dir->inode) / sizeof *entries;
+  if (cnt > LINEAR_MAX)
+    cnt = LINEAR_MAX;
+  entries = inode_get_ro (dir->inode, 0);
+  if (entries == NULL)
+    return false;
+  found = search_entries (entries, cnt, 0, name, ep, ofsp, freep);
+  inode_put_ro (dir->inode, entries);
+  return found;
+}
+
+/* Adds E to the chain of hashed directory DIR whose header is HDR
+   that E's name hashes to, appending a bucket to the chain if it
+   is full.  B is scratch space.  Returns true if successful,
+   false if the disk is full. */
+static bool
+insert_hashed (struct dir *dir, struct dir_header *hdr,
+               const struct dir_entry *e, struct dir_bucket *b) 
+{
+  uint32_t idx = hdr->buckets[chain_of (hdr, e->name)];
+  uint32_t new_idx;
+
+  for (;;) 
+    {
+      size_t slot;
+
+      if (!read_sector (dir->inode, idx, b))
+        return false;
+      for (slot = 0; slot < BUCKET_ENTRIES; slot++)
+        if (!b->entries[slot].in_use)
+          return inode_write_at (dir->inode, e, sizeof *e,
+                                 slot_ofs (idx, slot)) == sizeof *e;
+      if (b->next == 0)
+        break;
+      idx = b->next;
+    }
+
+  /* Chain full: append a bucket that holds E. */
+  new_idx = hdr->sector_cnt;
+  b->next = new_idx;
+  if (inode_write_at (dir->inode, &b->next, sizeof b->next,
+                      idx * BLOCK_SECTOR_SIZE
+                      + offsetof (struct dir_bucket, next))
+      != sizeof b->next)
+    return false;
+  memset (b, 0, sizeof *b);
+  b->entries[0] = *e;
+  if (!write_sector (dir->inode, new_idx, b)) 
+    {
+      /* Unlink the bucket again; a zero sector here would read
+         as an empty bucket anyway. */
+      b->next = 0;
+      inode_write_at (dir->inode, &b->next, sizeof b->next,
+                      idx * BLOCK_SECTOR_SIZE
+                      + offsetof (struct dir_bucket, next));
+      return false;
+    }
+  hdr->sector_cnt++;
+  return true;
+}
+
+/* Gives chain J of hashed directory DIR, whose header is HDR and
+   in which J is an alias for another chain, buckets of its own
+   holding the entries that hash to J.  OLD and NEW are scratch
+   space.  Leaves J an alias if no entries hash to it or if the
+   disk fills up. */
+static void
+split_chain (struct dir *dir, struct dir_header *hdr, uint32_t j,
+             struct dir_bucket *old, struct dir_bucket *new) 
+{
+  uint32_t first = hdr->sector_cnt;
+  uint32_t cur = first;
+  size_t moved = 0;
+  uint32_t idx;
+
+  /* Copy the entries that hash to J into new buckets at the end
+     of the directory. */
+  memset (new, 0, sizeof *new);
+  for (idx = hdr->buckets[j]; idx != 0; idx = old->next) 
+    {
+      size_t slot;
+
+      if (!read_sector (dir->inode, idx, old))
+        goto fail;
+      for (slot = 0; slot < BUCKET_ENTRIES; slot++) 
+        {
+          struct dir_entry *e = &old->entries[slot];
+          if (!e->in_use || chain_of (hdr, e->name) != j)
+            continue;
+          if (moved > 0 && moved % BUCKET_ENTRIES == 0) 
+            {
+              new->next = cur + 1;
+              if (!write_sector (dir->inode, cur++, new))
+                goto fail;
+              memset (new, 0, sizeof *new);
+            }
+          new->entries[moved++ % BUCKET_ENTRIES] = *e;
+        }
+    }
+  if (moved == 0)
+    return;
+  if (!write_sector (dir->inode, cur, new))
+    goto fail;
+
+  /* Switch J over to the copies, then erase the originals. */
+  idx = hdr->buckets[j];
+  hdr->buckets[j] = first;
+  hdr->sector_cnt = cur + 1;
+  for (; idx != 0; idx = old->next) 
+    {
+      bool changed = false;
+      size_t slot;
+
+      read_sector (dir->inode, idx, old);
+      for (slot = 0; slot < BUCKET_ENTRIES; slot++) 
+        {
+          struct dir_entry *e = &old->entries[slot];
+          if (e->in_use && chain_of (hdr, e->name) == j) 
+            {
+              e->in_use = false;
+              changed = true;
+            }
+        }
+      if (changed)
+        write_sector (dir->inode, idx, old);
+    }
+  return;
+
+ fail:
+  wipe_sectors (dir->inode, first, cur - first);
+}
+
+/* Doubles the number of chains in hashed directory DIR, whose
+   header is HDR.  B and C are scratch space. */
+static void
+grow_hashed (struct dir *dir, struct dir_header *hdr,
+             struct dir_bucket *b, struct dir_bucket *c) 
+{
+  uint32_t n = hdr->bucket_cnt;
+  uint32_t i;
+
+  for (i = 0; i < n; i++)
+    hdr->buckets[i + n] = hdr->buckets[i];
+  hdr->bucket_cnt = 2 * n;
+  for (i = 0; i < n; i++)
+    split_chain (dir, hdr, i + n, b, c);
+}
+
+/* Converts linear directory DIR, whose first LINEAR_MAX slots
+   hold all its entries, to a hashed directory, leaving its header
+   in HDR.  OLD and B are scratch space.  Returns true if
+   successful, false if the disk is full, in which case DIR's
+   entries are unchanged. */
+static bool
+make_hashed (struct dir *dir, struct dir_header *hdr,
+             struct dir_bucket *old, struct dir_bucket *b) 
+{
+  struct dir_entry *entries = old->entries;
+  size_t entry_cnt;
+  size_t i;
+
+  entry_cnt = inode_read_at (dir->inode, entries, sizeof old->entries, 0)
+              / sizeof *entries;
+
+  memset (hdr, 0, sizeof *hdr);
+  hdr->magic = DIR_MAGIC;
+  hdr->bucket_cnt = INITIAL_BUCKETS;
+  hdr->sector_cnt = 1 + INITIAL_BUCKETS;
+  for (i = 0; i < INITIAL_BUCKETS; i++) 
+    {
+      size_t k, slot = 0;
+
+      hdr->buckets[i] = 1 + i;
+      memset (b, 0, sizeof *b);
+      for (k = 0; k < entry_cnt; k++)
+        if (entries[k].in_use && chain_of (hdr, entries[k].name) == i) 
+          b->entries[slot++] = entries[k];
+      hdr->entry_cnt += slot;
+      if (!write_sector (dir->inode, 1 + i, b)) 
+        {
+          wipe_sectors (dir->inode, 1, i);
+          return false;
+        }
+    }
+  return write_sector (dir->inode, 0, hdr);
 }
 
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.
+   Answers from the directory entry cache when it can. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
-  struct dir_entry e;
+  block_sector_t dir_sector;
+  block_sector_t sector;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  dir_sector = inode_get_inumber (dir->inode);
+  if (!dcache_lookup (dir_sector, name, &sector)) 
+    {
+      struct rwlock *dir_lock = inode_dir_lock (dir->inode);
+      struct dir_entry e;
+
+      /* Holding the lock keeps a concurrent dir_add() or
+         dir_remove() from slipping in between the search and the
+         insertion and leaving a stale entry in the cache. */
+      rw_read_acquire (dir_lock);
+      sector = lookup (dir, name, &e, NULL, NULL) ? e.inode_sector : 0;
+      dcache_insert (dir_sector, name, sector);
+      rw_read_release (dir_lock);
+    }
+  *inode = sector != 0 ? inode_open (sector) : NULL;
 
   return *inode != NULL;
 }
 
+/* Adds E to DIR, converting DIR to a hashed directory first if
+   it is linear, and doubles DIR's chains if it is getting full.
+   If OFS is nonnegative, it is a free slot in the right chain.
+   Returns true if successful, false if the disk is full. */
+static bool
+add_hashed (struct dir *dir, const struct dir_entry *e, off_t ofs) 
+{
+  struct dir_header *hdr = kmem_cache_alloc (sector_cache);
+  struct dir_bucket *b = kmem_cache_alloc (sector_cache);
+  struct dir_bucket *c = kmem_cache_alloc (sector_cache);
+  bool success = false;
+
+  if (hdr == NULL || b == NULL || c == NULL)
+    goto done;
+  if (is_hashed (dir->inode)) 
+    {
+      if (!read_sector (dir->inode, 0, hdr))
+        goto done;
+    }
+  else if (!make_hashed (dir, hdr, c, b))
+    goto done;
+
+  if (ofs >= 0)
+    success = inode_write_at (dir->inode, e, sizeof *e, ofs) == sizeof *e;
+  else
+    success = insert_hashed (dir, hdr, e, b);
+  if (success) 
+    {
+      hdr->entry_cnt++;
+      if (hdr->entry_cnt > hdr->bucket_cnt * BUCKET_ENTRIES * 3 / 4
+          && hdr->bucket_cnt < MAX_BUCKETS)
+        grow_hashed (dir, hdr, b, c);
+    }
+  write_sector (dir->inode, 0, hdr);
+
+ done:
+  kmem_cache_free (sector_cache, c);
+  kmem_cache_free (sector_cache, b);
+  kmem_cache_free (sector_cache, hdr);
+  return success;
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
@@ -152,29 +575,38 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
-  /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  rw_write_acquire (inode_dir_lock (dir->inode));
+
+  /* Check that NAME is not in use, and find a free slot for it
+     on the way. */
+  if (lookup (dir, name, NULL, NULL, &ofs))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+
+  if (is_hashed (dir->inode))
+    success = add_hashed (dir, &e, ofs);
+  else if (ofs >= 0)
+    success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  else 
+    {
+      /* No free slot among the first LINEAR_MAX.  A shorter
+         directory grows; inode_read_at() only returns a short
+         read at end of file, so its length is a whole number of
+         entries. */
+      ofs = inode_length (dir->inode);
+      if (ofs < (off_t) (LINEAR_MAX * sizeof e))
+        success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+      else
+        success = add_hashed (dir, &e, -1);
+    }
+  if (success)
+    dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
 
  done:
+  rw_write_release (inode_dir_lock (dir->inode));
   return success;
 }
 
@@ -192,8 +624,10 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  rw_write_acquire (inode_dir_lock (dir->inode));
+
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  if (!lookup (dir, name, &e, &ofs, NULL))
     goto done;
 
   /* Open inode. */
@@ -205,12 +639,23 @@ dir_remove (struct dir *dir, const char *name)
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+  if (is_hashed (dir->inode)) 
+    {
+      uint32_t entry_cnt;
+      off_t cnt_ofs = offsetof (struct dir_header, entry_cnt);
+
+      inode_read_at (dir->inode, &entry_cnt, sizeof entry_cnt, cnt_ofs);
+      entry_cnt--;
+      inode_write_at (dir->inode, &entry_cnt, sizeof entry_cnt, cnt_ofs);
+    }
 
   /* Remove inode. */
   inode_remove (inode);
   success = true;
 
  done:
+  rw_write_release (inode_dir_lock (dir->inode));
   inode_close (inode);
   return success;
 }
@@ -221,16 +666,97 @@ dir_remove (struct dir *dir, const char *name)
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
+  struct rwlock *dir_lock = inode_dir_lock (dir->inode);
   struct dir_entry e;
+  bool hashed;
+  bool found = false;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  rw_read_acquire (dir_lock);
+  hashed = is_hashed (dir->inode);
+  while (!found) 
     {
+      if (hashed) 
+        {
+          /* Skip the header and the tail of each bucket. */
+          if (dir->pos < BLOCK_SECTOR_SIZE)
+            dir->pos = BLOCK_SECTOR_SIZE;
+          if (dir->pos % BLOCK_SECTOR_SIZE
+              > (off_t) ((BUCKET_ENTRIES - 1) * sizeof e))
+            dir->pos = ROUND_UP (dir->pos, BLOCK_SECTOR_SIZE);
+        }
+      if (inode_read_at (dir->inode, &e, sizeof e, dir->pos) != sizeof e)
+        break;
       dir->pos += sizeof e;
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          found = true;
         } 
     }
-  return false;
+  rw_read_release (dir_lock);
+  return found;
+}
+
+/* Reads up to MAX entries of the directory in INODE into
+   RECORDS, starting at byte offset *POS, which is advanced past
+   them, and returns the number read, which is 0 at the end.
+   Positions are the same as for dir_readdir().
+
+   Each sector is read in place in the buffer cache, once for all
+   the entries in it, rather than once per entry. */
+size_t
+dir_read_batch (struct inode *inode, off_t *pos,
+                struct dir_record records[], size_t max)
+{
+  struct rwlock *dir_lock = inode_dir_lock (inode);
+  size_t cnt = 0;
+  bool hashed;
+
+  rw_read_acquire (dir_lock);
+  hashed = is_hashed (inode);
+  while (cnt < max) 
+    {
+      const struct dir_entry *entries;
+      size_t slot, slot_cnt;
+      off_t base;
+
+      if (hashed) 
+        {
+          /* Skip the header and the tail of each bucket. */
+          if (*pos < BLOCK_SECTOR_SIZE)
+            *pos = BLOCK_SECTOR_SIZE;
+          if (*pos % BLOCK_SECTOR_SIZE
+              > (off_t) ((BUCKET_ENTRIES - 1) * sizeof *entries))
+            *pos = ROUND_UP (*pos, BLOCK_SECTOR_SIZE);
+          base = ROUND_DOWN (*pos, BLOCK_SECTOR_SIZE);
+          slot_cnt = BUCKET_ENTRIES;
+        }
+      else 
+        {
+          /* Only the first LINEAR_MAX slots are ever used. */
+          base = 0;
+          slot_cnt = inode_length (inode) / sizeof *entries;
+          if (slot_cnt > LINEAR_MAX)
+            slot_cnt = LINEAR_MAX;
+        }
+      slot = DIV_ROUND_UP (*pos - base, sizeof *entries);
+      if (slot >= slot_cnt) 
+        break;
+
+      entries = inode_get_ro (inode, base);
+      if (entries == NULL)
+        break;
+      for (; slot < slot_cnt && cnt < max; slot++)
+        if (entries[slot].in_use) 
+          {
+            records[cnt].inumber = entries[slot].inode_sector;
+            strlcpy (records[cnt].name, entries[slot].name,
+                     sizeof records[cnt].name);
+            cnt++;
+          }
+      inode_put_ro (inode, entries);
+      *pos = base + slot * sizeof *entries;
+    }
+  rw_read_release (dir_lock);
+  return cnt;
 }
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include "devices/block.h"
+#include "filesys/off_t.h"
 
 /* Maximum length of a file name component.
    This is the traditional UNIX maximum length.
@@ -13,7 +14,15 @@
 
 struct inode;
 
+/* A directory entry, as dir_read_batch() returns it. */
+struct dir_record
+  {
+    block_sector_t inumber;             /* Sector of the entry's inode. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+  };
+
 /* Opening and closing directories. */
+void dir_init (void);
 bool dir_create (block_sector_t sector, size_t entry_cnt);
 struct dir *dir_open (struct inode *);
 struct dir *dir_open_root (void);
@@ -26,5 +35,7 @@ bool dir_lookup (const struct dir *, const char *name, struct inode **);
 bool dir_add (struct dir *, const char *name, block_sector_t);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
+size_t dir_read_batch (struct inode *, off_t *pos, struct dir_record[],
+                       size_t max);
 
 #endif /* filesys/directory.h */
@@ -1,7 +1,7 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
 
 /* An open file. */
 struct file 
@@ -9,26 +9,43 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    bool direct;                /* Bypass the buffer cache? */
+    enum file_advice pattern;   /* FILE_ADV_NORMAL, _SEQUENTIAL or
+                                   _RANDOM. */
   };
 
+/* Cache for open files. */
+static struct kmem_cache *file_cache;
+
+/* Initializes the file module. */
+void
+file_init (void) 
+{
+  file_cache = kmem_cache_create ("file", sizeof (struct file), 0, NULL);
+  if (file_cache == NULL)
+    PANIC ("file_init: out of memory");
+}
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
 struct file *
 file_open (struct inode *inode) 
 {
-  struct file *file = calloc (1, sizeof *file);
+  struct file *file = kmem_cache_zalloc (file_cache);
   if (inode != NULL && file != NULL)
     {
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->direct = false;
+      file->pattern = FILE_ADV_NORMAL;
       return file;
     }
   else
     {
       inode_close (inode);
-      free (file);
+      kmem_cache_free (file_cache, file);
       return NULL; 
     }
 }
@@ -48,8 +65,9 @@ file_close (struct file *file)
   if (file != NULL)
     {
       file_allow_write (file);
+      file_advise (file, FILE_ADV_NORMAL, 0, 0);
       inode_close (file->inode);
-      free (file); 
+      kmem_cache_free (file_cache, file);
     }
 }
 
@@ -113,6 +131,99 @@ file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Reads SIZE bytes from FILE into user buffer BUFFER, as
+   file_read(), copying straight from the buffer cache to user
+   memory.  Returns -1, leaving the position alone, if BUFFER is
+   not mapped and writable. */
+off_t
+file_read_user (struct file *file, void *buffer, off_t size) 
+{
+  off_t bytes_read = inode_read_at_user (file->inode, buffer, size,
+                                         file->pos);
+  if (bytes_read > 0)
+    file->pos += bytes_read;
+  return bytes_read;
+}
+
+/* Writes SIZE bytes from user buffer BUFFER into FILE, as
+   file_write(), copying straight from user memory to the buffer
+   cache.  Returns -1, leaving the position alone, if BUFFER is
+   not mapped. */
+off_t
+file_write_user (struct file *file, const void *buffer, off_t size) 
+{
+  off_t bytes_written = inode_write_at_user (file->inode, buffer, size,
+                                             file->pos);
+  if (bytes_written > 0)
+    file->pos += bytes_written;
+  return bytes_written;
+}
+
+/* Reads SIZE bytes from FILE into user buffer BUFFER, starting
+   at offset FILE_OFS, as file_read_at().  Returns -1 if BUFFER is
+   not mapped and writable. */
+off_t
+file_read_at_user (struct file *file, void *buffer, off_t size,
+                   off_t file_ofs) 
+{
+  return inode_read_at_user (file->inode, buffer, size, file_ofs);
+}
+
+/* Writes SIZE bytes from user buffer BUFFER into FILE, starting
+   at offset FILE_OFS, as file_write_at().  Returns -1 if BUFFER
+   is not mapped. */
+off_t
+file_write_at_user (struct file *file, const void *buffer, off_t size,
+                    off_t file_ofs) 
+{
+  return inode_write_at_user (file->inode, buffer, size, file_ofs);
+}
+
+/* Reads CNT whole sectors of FILE, starting at offset FILE_OFS,
+   a multiple of BLOCK_SECTOR_SIZE, into the sector buffers in
+   BUFFERS without passing them through the buffer cache.  Reads
+   less, even nothing, near end of file; see inode_read_direct().
+   Returns the number of bytes read.  The file's current position
+   is unaffected. */
+off_t
+file_read_direct (struct file *file, void *const buffers[], size_t cnt,
+                  off_t file_ofs) 
+{
+  return inode_read_direct (file->inode, buffers, cnt, file_ofs);
+}
+
+/* Writes the CNT whole sectors in BUFFERS into FILE, starting at
+   offset FILE_OFS, a multiple of BLOCK_SECTOR_SIZE, without
+   passing them through the buffer cache.  Writes less, even
+   nothing, near end of file; see inode_write_direct().  Returns
+   the number of bytes written.  The file's current position is
+   unaffected. */
+off_t
+file_write_direct (struct file *file, const void *const buffers[],
+                   size_t cnt, off_t file_ofs) 
+{
+  return inode_write_direct (file->inode, buffers, cnt, file_ofs);
+}
+
+/* Sets whether reads and writes of FILE from user programs
+   should bypass the buffer cache where they can, as for a file
+   opened with O_DIRECT. */
+void
+file_set_direct (struct file *file, bool direct) 
+{
+  ASSERT (file != NULL);
+  file->direct = direct;
+}
+
+/* Returns true if FILE's reads and writes should bypass the
+   buffer cache. */
+bool
+file_is_direct (const struct file *file) 
+{
+  ASSERT (file != NULL);
+  return file->direct;
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
@@ -166,3 +277,75 @@ file_tell (struct file *file)
   ASSERT (file != NULL);
   return file->pos;
 }
+
+/* Writes FILE's data to disk and returns once it is written,
+   like POSIX fsync().  Otherwise, written data reaches the disk
+   when the buffer cache gets around to it. */
+void
+file_sync (struct file *file) 
+{
+  ASSERT (file != NULL);
+  inode_sync (file->inode);
+}
+
+/* Sets aside disk space for LENGTH bytes of FILE starting at
+   OFFSET, extending FILE to cover them, so that writing them
+   later does not have to allocate.  Returns true if successful,
+   false if writes to FILE are denied or the disk is full.  See
+   inode_allocate(). */
+bool
+file_allocate (struct file *file, off_t offset, off_t length) 
+{
+  ASSERT (file != NULL);
+  return inode_allocate (file->inode, offset, length);
+}
+
+/* Advises the file system of how FILE is going to be read.
+   FILE_ADV_SEQUENTIAL and FILE_ADV_RANDOM declare FILE's access
+   pattern until it is changed or FILE is closed: in order, which
+   reads ahead as far as it goes from the first read, or at
+   random, which does not read ahead at all.  FILE_ADV_NORMAL
+   goes back to guessing from the reads.  FILE_ADV_WILLNEED and
+   FILE_ADV_DONTNEED apply to LENGTH bytes starting at OFFSET
+   only: the first starts reading them into the buffer cache in
+   the background, and the second lets the cache reuse their
+   entries first. */
+void
+file_advise (struct file *file, enum file_advice advice, off_t offset,
+             off_t length) 
+{
+  ASSERT (file != NULL);
+  ASSERT (offset >= 0 && length >= 0);
+
+  switch (advice) 
+    {
+    case FILE_ADV_NORMAL:
+    case FILE_ADV_SEQUENTIAL:
+    case FILE_ADV_RANDOM:
+      inode_count_pattern (file->inode,
+                           (advice == FILE_ADV_SEQUENTIAL)
+                           - (file->pattern == FILE_ADV_SEQUENTIAL),
+                           (advice == FILE_ADV_RANDOM)
+                           - (file->pattern == FILE_ADV_RANDOM));
+      file->pattern = advice;
+      break;
+
+    case FILE_ADV_WILLNEED:
+      inode_prefetch (file->inode, offset, length);
+      break;
+
+    case FILE_ADV_DONTNEED:
+      inode_demote (file->inode, offset, length);
+      break;
+    }
+}
+
+/* Returns the access pattern last declared for FILE with
+   file_advise(): FILE_ADV_NORMAL, FILE_ADV_SEQUENTIAL or
+   FILE_ADV_RANDOM. */
+enum file_advice
+file_pattern (const struct file *file) 
+{
+  ASSERT (file != NULL);
+  return file->pattern;
+}
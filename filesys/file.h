@@ -1,10 +1,24 @@
 #ifndef FILESYS_FILE_H
 #define FILESYS_FILE_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 
 struct inode;
 
+/* Advice for file_advise(). */
+enum file_advice
+  {
+    FILE_ADV_NORMAL,            /* No particular pattern. */
+    FILE_ADV_SEQUENTIAL,        /* Read in order. */
+    FILE_ADV_RANDOM,            /* Read at random. */
+    FILE_ADV_WILLNEED,          /* Range will be read soon. */
+    FILE_ADV_DONTNEED           /* Range will not be read soon. */
+  };
+
+void file_init (void);
+
 /* Opening and closing files. */
 struct file *file_open (struct inode *);
 struct file *file_reopen (struct file *);
@@ -16,6 +30,19 @@ off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
+off_t file_read_user (struct file *, void *, off_t);
+off_t file_write_user (struct file *, const void *, off_t);
+off_t file_read_at_user (struct file *, void *, off_t size, off_t start);
+off_t file_write_at_user (struct file *, const void *, off_t size,
+                          off_t start);
+
+/* Bypassing the buffer cache. */
+off_t file_read_direct (struct file *, void *const buffers[], size_t cnt,
+                        off_t start);
+off_t file_write_direct (struct file *, const void *const buffers[],
+                         size_t cnt, off_t start);
+void file_set_direct (struct file *, bool);
+bool file_is_direct (const struct file *);
 
 /* Preventing writes. */
 void file_deny_write (struct file *);
@@ -26,4 +53,13 @@ void file_seek (struct file *, off_t);
 off_t file_tell (struct file *);
 off_t file_length (struct file *);
 
+/* Durability. */
+void file_sync (struct file *);
+bool file_allocate (struct file *, off_t offset, off_t length);
+
+/* Access hints. */
+void file_advise (struct file *, enum file_advice, off_t offset,
+                  off_t length);
+enum file_advice file_pattern (const struct file *);
+
 #endif /* filesys/file.h */
@@ -2,32 +2,66 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/archive.h"
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
+#include "filesys/defrag.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
+#include "threads/thread.h"
 
-/* Partition that contains the file system. */
+/* Partition that contains the file system, or a null pointer if
+   the file system is kept in memory. */
 struct block *fs_device;
 
-static void do_format (void);
+/* The root directory, open for as long as the file system is. */
+static struct dir *root_dir;
+
+static void do_format (bool journal);
 
 /* Initializes the file system module.
-   If FORMAT is true, reformats the file system. */
+   If FORMAT is true, reformats the file system, with a metadata
+   journal if JOURNAL is true; see journal.c.  If IN_MEMORY is
+   true, the file system is kept in memory only, without a device
+   or the buffer cache, and starts out empty, as if formatted;
+   see inode.c. */
 void
-filesys_init (bool format) 
+filesys_init (bool format, bool journal, bool in_memory) 
 {
-  fs_device = block_get_role (BLOCK_FILESYS);
-  if (fs_device == NULL)
-    PANIC ("No file system device found, can't initialize file system.");
-
+  if (in_memory) 
+    {
+      fs_device = NULL;
+      format = true;
+    }
+  else 
+    {
+      fs_device = block_get_role (BLOCK_FILESYS);
+      if (fs_device == NULL)
+        PANIC ("No file system device found, "
+               "can't initialize file system.");
+      cache_init ();
+    }
   inode_init ();
+  file_init ();
+  dir_init ();
+  dcache_init ();
   free_map_init ();
 
   if (format) 
-    do_format ();
+    do_format (journal && !in_memory);
+  if (fs_device != NULL)
+    journal_open ();
 
   free_map_open ();
+
+  root_dir = dir_open_root ();
+  if (root_dir == NULL)
+    PANIC ("can't open root directory");
+  if (fs_device != NULL)
+    cache_warm_start ();
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -35,7 +69,94 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  defrag_stop ();
+  dir_close (root_dir);
+  root_dir = NULL;
+  journal_close ();
   free_map_close ();
+  if (fs_device != NULL)
+    {
+      cache_flush ();
+      cache_warm_save ();
+    }
+}
+
+/* Returns the directory that relative paths start from: the
+   running thread's working directory, or else the root. */
+static struct dir *
+cwd (void) 
+{
+  struct dir *dir = thread_current ()->cwd;
+  return dir != NULL ? dir : root_dir;
+}
+
+/* Closes DIR, a directory returned by resolve(), unless it is
+   the root or working directory that resolve() started from. */
+static void
+put_dir (struct dir *dir) 
+{
+  if (dir != root_dir && dir != thread_current ()->cwd)
+    dir_close (dir);
+}
+
+/* Resolves PATH up to its last component, which it copies into
+   NAME, and returns the directory that should contain it.  The
+   caller must release the directory with put_dir().  NAME is
+   empty if PATH names a directory with nothing after it, such as
+   "/".  Returns a null pointer if PATH is empty, a directory
+   along the way does not exist, or a component is longer than
+   NAME_MAX.
+
+   Relative paths start from the working directory, and absolute
+   ones from the root, both of which are kept open, so a
+   one-component path opens nothing.  Each component is looked up
+   through dir_lookup(), so a path walked before costs only
+   dentry cache hits and inode reopens. */
+static struct dir *
+resolve (const char *path, char name[NAME_MAX + 1]) 
+{
+  struct dir *dir = *path == '/' ? root_dir : cwd ();
+
+  name[0] = '\0';
+  if (*path == '\0')
+    return NULL;
+  for (;;) 
+    {
+      const char *end;
+      struct inode *inode;
+      struct dir *next;
+
+      while (*path == '/')
+        path++;
+      if (*path == '\0')
+        return dir;
+
+      end = strchr (path, '/');
+      if (end == NULL)
+        end = path + strlen (path);
+      if (end - path > NAME_MAX)
+        break;
+      memcpy (name, path, end - path);
+      name[end - path] = '\0';
+
+      /* The last component is left for the caller. */
+      path = end;
+      while (*path == '/')
+        path++;
+      if (*path == '\0')
+        return dir;
+
+      if (!dir_lookup (dir, name, &inode))
+        break;
+      next = dir_open (inode);
+      if (next == NULL)
+        break;
+      put_dir (dir);
+      dir = next;
+    }
+
+  put_dir (dir);
+  return NULL;
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -46,32 +167,48 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+  char base[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = resolve (name, base);
+  success = (dir != NULL
+             && free_map_allocate (1, &inode_sector)
+             && inode_create (inode_sector, initial_size)
+             && dir_add (dir, base, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
-  dir_close (dir);
+  if (dir != NULL)
+    put_dir (dir);
+  journal_end ();
 
   return success;
 }
 
 /* Opens the file with the given NAME.
    Returns the new file if successful or a null pointer
-   otherwise.
+   otherwise.  A NAME that is not in the file system is looked up
+   in the scratch archive, if it is mounted; see archive.c.
    Fails if no file named NAME exists,
    or if an internal memory allocation fails. */
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  char base[NAME_MAX + 1];
+  struct dir *dir = resolve (name, base);
   struct inode *inode = NULL;
 
-  if (dir != NULL)
-    dir_lookup (dir, name, &inode);
-  dir_close (dir);
+  if (dir != NULL) 
+    {
+      if (base[0] == '\0')
+        inode = inode_reopen (dir_get_inode (dir));
+      else
+        dir_lookup (dir, base, &inode);
+      put_dir (dir);
+    }
+  if (inode == NULL)
+    inode = archive_open (name);
 
   return file_open (inode);
 }
@@ -83,19 +220,59 @@ filesys_open (const char *name)
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
-  dir_close (dir); 
+  char base[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = resolve (name, base);
+  success = dir != NULL && dir_remove (dir, base);
+  if (dir != NULL)
+    put_dir (dir);
+  journal_end ();
 
   return success;
 }
-
-/* Formats the file system. */
+
+/* Makes the directory named NAME the running thread's working
+   directory, which relative paths then start from.
+   Returns true if successful, false if NAME does not exist or
+   memory runs out. */
+bool
+filesys_chdir (const char *name) 
+{
+  struct thread *t = thread_current ();
+  char base[NAME_MAX + 1];
+  struct dir *dir = resolve (name, base);
+  struct dir *new_cwd;
+  struct inode *inode;
+
+  if (dir == NULL)
+    return false;
+  if (base[0] == '\0')
+    new_cwd = dir_reopen (dir);
+  else
+    new_cwd = dir_lookup (dir, base, &inode) ? dir_open (inode) : NULL;
+  put_dir (dir);
+  if (new_cwd == NULL)
+    return false;
+
+  dir_close (t->cwd);
+  t->cwd = new_cwd;
+  return true;
+}
+
+/* Formats the file system, with a journal if JOURNAL is true. */
 static void
-do_format (void)
+do_format (bool journal)
 {
   printf ("Formatting file system...");
   free_map_create ();
+  if (fs_device != NULL)
+    {
+      journal_format (journal);
+      cache_warm_format ();
+    }
   if (!dir_create (ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
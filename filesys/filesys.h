@@ -7,14 +7,18 @@
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#define JOURNAL_SECTOR 2        /* Journal header sector. */
+#define WARM_SECTOR 3           /* Buffer cache warm start list. */
 
-/* Block device that contains the file system. */
+/* Block device that contains the file system, or a null pointer
+   if the file system is kept in memory. */
 extern struct block *fs_device;
 
-void filesys_init (bool format);
+void filesys_init (bool format, bool journal, bool in_memory);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
 struct file *filesys_open (const char *name);
 bool filesys_remove (const char *name);
+bool filesys_chdir (const char *name);
 
 #endif /* filesys/filesys.h */
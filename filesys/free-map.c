@@ -1,52 +1,213 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <limits.h>
+#include <round.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
+
+/* Allocation and release change only the in-memory free map and
+   mark the sectors of the free map file that hold the changed
+   bits dirty.  free_map_flush() writes just those sectors back,
+   from the buffer cache's flusher thread and when the free map is
+   closed, so an allocation no longer rewrites the whole file.
+
+   With a journal, sectors released go into the `released' map
+   of the running transaction instead, and stay allocated until
+   it commits; see free_map_freeze(). */
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct bitmap *dirty;         /* Dirty free map file sectors. */
+static struct lock free_map_lock;    /* Guards free_map and dirty. */
+static struct lock flush_lock;       /* Serializes free_map_flush(). */
+
+/* Sectors released in the running transaction, and in the one
+   being committed.  Guarded by free_map_lock. */
+static struct bitmap *released[2];
+static int running;                  /* Index of the running one. */
+
+/* Number of inode numbers in a file system kept in memory, which
+   has no sectors for the free map to track, only inodes. */
+#define MEMORY_INODE_CNT 16384
+
+/* Number of free map bits in one sector of the free map file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * CHAR_BIT)
+
+/* Marks the free map file sectors that hold the bits for the CNT
+   sectors starting at SECTOR as dirty. */
+static void
+mark_dirty (block_sector_t sector, size_t cnt) 
+{
+  size_t first = sector / BITS_PER_SECTOR;
+  size_t last = (sector + cnt - 1) / BITS_PER_SECTOR;
+
+  bitmap_set_multiple (dirty, first, last - first + 1, true);
+}
 
 /* Initializes the free map. */
 void
 free_map_init (void) 
 {
-  free_map = bitmap_create (block_size (fs_device));
+  free_map = bitmap_create (fs_device != NULL ? block_size (fs_device)
+                            : MEMORY_INODE_CNT);
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_mark (free_map, JOURNAL_SECTOR);
+  bitmap_mark (free_map, WARM_SECTOR);
+  dirty = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                       BLOCK_SECTOR_SIZE));
+  released[0] = bitmap_create (bitmap_size (free_map));
+  released[1] = bitmap_create (bitmap_size (free_map));
+  if (dirty == NULL || released[0] == NULL || released[1] == NULL)
+    PANIC ("bitmap creation failed--out of memory");
+  lock_init (&free_map_lock);
+  lock_init (&flush_lock);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
-    {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
-    }
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = bitmap_scan_and_flip_next (free_map, cnt, false);
   if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+    mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
+
+  if (sector == BITMAP_ERROR)
+    return false;
+  *sectorp = sector;
+  return true;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Allocates a single sector, the first free one at or after
+   HINT if there is one, or else the first free one on the disk,
+   and stores it into *SECTORP.  Passing the sector after a
+   file's last one as HINT keeps the file's sectors together.
+   Returns true if successful, false if the disk is full. */
+bool
+free_map_allocate_near (block_sector_t hint, block_sector_t *sectorp)
+{
+  block_sector_t sector = BITMAP_ERROR;
+
+  lock_acquire (&free_map_lock);
+  if (hint < bitmap_size (free_map))
+    sector = bitmap_scan_and_flip (free_map, hint, 1, false);
+  if (sector == BITMAP_ERROR)
+    sector = bitmap_scan_and_flip (free_map, 0, 1, false);
+  if (sector != BITMAP_ERROR)
+    mark_dirty (sector, 1);
+  lock_release (&free_map_lock);
+
+  if (sector == BITMAP_ERROR)
+    return false;
+  *sectorp = sector;
+  return true;
+}
+
+/* Makes CNT sectors starting at SECTOR available for use, or,
+   with a journal, once the running transaction has committed.
+   They lose any metadata mark in the buffer cache first, while no
+   one else can have allocated them yet. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  if (fs_device != NULL)
+    cache_clear_meta (sector, cnt);
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  if (journal_enabled ())
+    bitmap_set_multiple (released[running], sector, cnt, true);
+  else 
+    {
+      bitmap_set_multiple (free_map, sector, cnt, false);
+      mark_dirty (sector, cnt);
+    }
+  lock_release (&free_map_lock);
+}
+
+/* Called by the journal as it freezes a transaction for commit:
+   sectors released from now on belong to the next one. */
+void
+free_map_freeze (void) 
+{
+  lock_acquire (&free_map_lock);
+  running = !running;
+  lock_release (&free_map_lock);
+}
+
+/* Called by the journal once the transaction frozen by
+   free_map_freeze() has committed.  Makes the sectors it released
+   available, since committed metadata no longer points to them,
+   and marks them free on disk in the next transaction. */
+void
+free_map_thaw (void) 
+{
+  struct bitmap *frozen;
+  size_t i;
+
+  lock_acquire (&free_map_lock);
+  frozen = released[!running];
+  for (i = 0; (i = bitmap_scan (frozen, i, 1, true)) != BITMAP_ERROR; i++) 
+    {
+      bitmap_reset (frozen, i);
+      bitmap_reset (free_map, i);
+      mark_dirty (i, 1);
+    }
+  lock_release (&free_map_lock);
+}
+
+/* Writes the dirty sectors of the free map file.  Does nothing
+   if the free map file is not open. */
+void
+free_map_flush (void) 
+{
+  size_t i;
+
+  if (free_map_file == NULL)
+    return;
+
+  journal_begin ();
+  lock_acquire (&flush_lock);
+  for (i = 0; ; i++) 
+    {
+      bool ok;
+
+      /* Clean the sector before writing it, so that a change made
+         while it is being written leaves it dirty.  The write
+         itself runs without free_map_lock, so that allocation can
+         go on meanwhile. */
+      lock_acquire (&free_map_lock);
+      i = bitmap_scan (dirty, i, 1, true);
+      if (i != BITMAP_ERROR)
+        bitmap_reset (dirty, i);
+      lock_release (&free_map_lock);
+      if (i == BITMAP_ERROR)
+        break;
+
+      ok = bitmap_write_at (free_map, free_map_file, i * BLOCK_SECTOR_SIZE,
+                            BLOCK_SECTOR_SIZE);
+      if (!ok) 
+        {
+          lock_acquire (&free_map_lock);
+          bitmap_mark (dirty, i);
+          lock_release (&free_map_lock);
+        }
+    }
+  lock_release (&flush_lock);
+  journal_end ();
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -56,6 +217,7 @@ free_map_open (void)
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
+  inode_set_meta (file_get_inode (free_map_file));
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
 }
@@ -64,7 +226,12 @@ free_map_open (void)
 void
 free_map_close (void) 
 {
-  file_close (free_map_file);
+  struct file *file;
+
+  free_map_flush ();
+  file = free_map_file;
+  free_map_file = NULL;
+  file_close (file);
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -80,6 +247,7 @@ free_map_create (void)
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
+  inode_set_meta (file_get_inode (free_map_file));
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
 }
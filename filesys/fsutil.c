@@ -1,16 +1,165 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ustar.h>
+#include "filesys/archive.h"
+#include "filesys/defrag.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
+#include "devices/timer.h"
 #include "threads/vaddr.h"
 
+/* Number of sectors that fsutil_extract() and fsutil_append()
+   move to or from the scratch device per block request, and the
+   pages that takes. */
+#define COPY_SECTORS 64
+#define COPY_PAGES (COPY_SECTORS * BLOCK_SECTOR_SIZE / PGSIZE)
+
+/* Most sectors that fsutil_iobench() moves to or from each
+   device, and the write requests it keeps outstanding. */
+#define BENCH_SECTORS 8192
+#define BENCH_DEPTH 2
+
+/* Number of buffers fsutil_extract() reads ahead into. */
+#define STREAM_BUFS 3
+
+/* The scratch device, read sequentially into a ring of buffers
+   while fsutil_extract() writes the previous ones into the file
+   system.  Each buffer not being consumed has a read request
+   outstanding, so the device keeps busy while the consumer
+   works. */
+struct stream 
+  {
+    struct block *src;                  /* Scratch device. */
+    block_sector_t next;                /* Next sector to request. */
+
+    uint8_t *bufs[STREAM_BUFS];         /* Buffers, COPY_SECTORS each. */
+    void **vecs;                        /* Sector pointers into BUFS. */
+    size_t cnts[STREAM_BUFS];           /* Sectors requested for each. */
+    struct block_request reqs[STREAM_BUFS];     /* Read requests. */
+    struct semaphore ready[STREAM_BUFS];        /* Upped once read. */
+
+    int cur;                            /* Buffer being consumed. */
+    size_t ofs;                         /* Next sector within it. */
+    block_sector_t pos;                 /* Next sector of the device. */
+  };
+
+/* Completion function for stream reads. */
+static void
+stream_read_done (struct block_request *r) 
+{
+  sema_up (r->aux);
+}
+
+/* Starts reading the next sectors of S into buffer I.  A buffer
+   with no sectors marks the end of the device. */
+static void
+stream_fill (struct stream *s, int i) 
+{
+  block_sector_t left = block_size (s->src) - s->next;
+
+  s->cnts[i] = left < COPY_SECTORS ? left : COPY_SECTORS;
+  if (s->cnts[i] == 0)
+    {
+      sema_up (&s->ready[i]);
+      return;
+    }
+  block_request_init (&s->reqs[i], s->next, s->cnts[i],
+                      &s->vecs[i * COPY_SECTORS], false,
+                      stream_read_done, &s->ready[i]);
+  s->next += s->cnts[i];
+  block_submit (s->src, &s->reqs[i]);
+}
+
+/* Starts streaming S from sector START of SRC. */
+static void
+stream_start (struct stream *s, struct block *src, block_sector_t start) 
+{
+  int i, j;
+
+  s->src = src;
+  s->next = start;
+  s->vecs = malloc (STREAM_BUFS * COPY_SECTORS * sizeof *s->vecs);
+  if (s->vecs == NULL)
+    PANIC ("couldn't allocate stream");
+  for (i = 0; i < STREAM_BUFS; i++)
+    {
+      s->bufs[i] = palloc_get_multiple (PAL_ASSERT, COPY_PAGES);
+      for (j = 0; j < COPY_SECTORS; j++)
+        s->vecs[i * COPY_SECTORS + j] = s->bufs[i] + j * BLOCK_SECTOR_SIZE;
+      sema_init (&s->ready[i], 0);
+    }
+  s->cur = 0;
+  s->ofs = 0;
+  s->pos = start;
+
+  for (i = 0; i < STREAM_BUFS; i++)
+    stream_fill (s, i);
+
+  /* Wait for the first buffer. */
+  sema_down (&s->ready[0]);
+}
+
+/* Returns the next sector of S, and stores into *CNT the number
+   of sectors that follow it contiguously in memory, at least 1.
+   Panics at the end of the device. */
+static uint8_t *
+stream_peek (struct stream *s, size_t *cnt) 
+{
+  if (s->ofs == s->cnts[s->cur] && s->cnts[s->cur] > 0) 
+    {
+      /* Refill the buffer, which is now the farthest ahead, and
+         move on to the next. */
+      stream_fill (s, s->cur);
+      s->cur = (s->cur + 1) % STREAM_BUFS;
+      s->ofs = 0;
+      sema_down (&s->ready[s->cur]);
+    }
+  if (s->cnts[s->cur] == 0)
+    PANIC ("ustar archive runs past end of scratch device");
+  *cnt = s->cnts[s->cur] - s->ofs;
+  return s->bufs[s->cur] + s->ofs * BLOCK_SECTOR_SIZE;
+}
+
+/* Returns pointers to each of the sectors that stream_peek()
+   last returned. */
+static void *const *
+stream_vecs (struct stream *s) 
+{
+  return &s->vecs[s->cur * COPY_SECTORS + s->ofs];
+}
+
+/* Consumes CNT sectors of S, which must be no more than
+   stream_peek() last reported. */
+static void
+stream_advance (struct stream *s, size_t cnt) 
+{
+  s->ofs += cnt;
+  s->pos += cnt;
+}
+
+/* Waits for S's outstanding reads and frees S's buffers. */
+static void
+stream_stop (struct stream *s) 
+{
+  int i;
+
+  for (i = 0; i < STREAM_BUFS; i++)
+    {
+      if (i != s->cur)
+        sema_down (&s->ready[i]);
+      palloc_free_multiple (s->bufs[i], COPY_PAGES);
+    }
+  free (s->vecs);
+}
+
 /* List files in the root directory. */
 void
 fsutil_ls (char **argv UNUSED) 
@@ -67,21 +216,40 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Moves the data of each scattered file in the root directory
+   into consecutive sectors. */
+void
+fsutil_defrag (char **argv UNUSED) 
+{
+  printf ("Defragmenting file system...\n");
+  printf ("Moved %d files.\n", defrag_pass ());
+}
+
 /* Extracts a ustar-format tar archive from the scratch block
-   device into the Pintos file system. */
+   device into the Pintos file system.
+
+   Reads of the device, COPY_SECTORS at a time, stay outstanding
+   in the block layer while this thread writes what it has
+   already read into the file system, so the two proceed in
+   parallel.  Each file is
+   created at its full size from its ustar header and then
+   written from start to end, so its sectors are allocated in
+   order near one another.  Its whole sectors go from the stream
+   buffers straight to disk, bypassing the buffer cache, which a
+   large archive would otherwise flush. */
 void
 fsutil_extract (char **argv UNUSED) 
 {
   static block_sector_t sector = 0;
 
   struct block *src;
-  void *header, *data;
+  struct stream s;
+  void *header;
 
-  /* Allocate buffers. */
+  /* Allocate buffer. */
   header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
-  if (header == NULL || data == NULL)
-    PANIC ("couldn't allocate buffers");
+  if (header == NULL)
+    PANIC ("couldn't allocate buffer");
 
   /* Open source block device. */
   src = block_get_role (BLOCK_SCRATCH);
@@ -91,18 +259,23 @@ fsutil_extract (char **argv UNUSED)
   printf ("Extracting ustar archive from scratch device "
           "into file system...\n");
 
+  stream_start (&s, src, sector);
   for (;;)
     {
       const char *file_name;
       const char *error;
       enum ustar_type type;
+      uint8_t *data;
+      size_t cnt;
       int size;
 
-      /* Read and parse ustar header. */
-      block_read (src, sector++, header);
+      /* Read and parse ustar header.  The header is copied out,
+         because FILE_NAME points into it. */
+      memcpy (header, stream_peek (&s, &cnt), BLOCK_SECTOR_SIZE);
+      stream_advance (&s, 1);
       error = ustar_parse_header (header, &file_name, &type, &size);
       if (error != NULL)
-        PANIC ("bad ustar header in sector %"PRDSNu" (%s)", sector - 1, error);
+        PANIC ("bad ustar header in sector %"PRDSNu" (%s)", s.pos - 1, error);
 
       if (type == USTAR_EOF)
         {
@@ -114,6 +287,7 @@ fsutil_extract (char **argv UNUSED)
       else if (type == USTAR_REGULAR)
         {
           struct file *dst;
+          off_t ofs = 0;
 
           printf ("Putting '%s' into the file system...\n", file_name);
 
@@ -124,16 +298,28 @@ fsutil_extract (char **argv UNUSED)
           if (dst == NULL)
             PANIC ("%s: open failed", file_name);
 
-          /* Do copy. */
+          /* Do copy, as much as is in memory at a time. */
           while (size > 0)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
-                                : size);
-              block_read (src, sector++, data);
-              if (file_write (dst, data, chunk_size) != chunk_size)
+              int chunk_size;
+              off_t done;
+
+              data = stream_peek (&s, &cnt);
+              chunk_size = (size > (int) (cnt * BLOCK_SECTOR_SIZE)
+                            ? (int) (cnt * BLOCK_SECTOR_SIZE)
+                            : size);
+              done = file_write_direct (dst,
+                                        (const void *const *) stream_vecs (&s),
+                                        chunk_size / BLOCK_SECTOR_SIZE, ofs);
+              if (done < chunk_size
+                  && (file_write_at (dst, data + done, chunk_size - done,
+                                     ofs + done)
+                      != chunk_size - done))
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
+              ofs += chunk_size;
+              stream_advance (&s, DIV_ROUND_UP (chunk_size,
+                                                BLOCK_SECTOR_SIZE));
               size -= chunk_size;
             }
 
@@ -141,6 +327,8 @@ fsutil_extract (char **argv UNUSED)
           file_close (dst);
         }
     }
+  sector = s.pos;
+  stream_stop (&s);
 
   /* Erase the ustar header from the start of the block device,
      so that the extraction operation is idempotent.  We erase
@@ -151,10 +339,19 @@ fsutil_extract (char **argv UNUSED)
   block_write (src, 0, header);
   block_write (src, 1, header);
 
-  free (data);
   free (header);
 }
 
+/* Makes the files of the ustar archive on the scratch device
+   readable in place, without copying them into the file system.
+   See archive.c. */
+void
+fsutil_mount (char **argv UNUSED) 
+{
+  if (!archive_mount ())
+    PANIC ("couldn't mount ustar archive from scratch device");
+}
+
 /* Copies file FILE_NAME from the file system to the scratch
    device, in ustar format.
 
@@ -162,7 +359,8 @@ fsutil_extract (char **argv UNUSED)
    beginning of the scratch device.  Later calls advance across
    the device.  This position is independent of that used for
    fsutil_extract(), so `extract' should precede all
-   `append's. */
+   `append's.  For the same reason, the first `append' unmounts
+   an archive that `mount' mounted. */
 void
 fsutil_append (char **argv)
 {
@@ -175,11 +373,10 @@ fsutil_append (char **argv)
   off_t size;
 
   printf ("Appending '%s' to ustar archive on scratch device...\n", file_name);
+  archive_unmount ();
 
   /* Allocate buffer. */
-  buffer = malloc (BLOCK_SECTOR_SIZE);
-  if (buffer == NULL)
-    PANIC ("couldn't allocate buffer");
+  buffer = palloc_get_multiple (PAL_ASSERT, COPY_PAGES);
 
   /* Open source file. */
   src = filesys_open (file_name);
@@ -200,13 +397,18 @@ fsutil_append (char **argv)
   /* Do copy. */
   while (size > 0) 
     {
-      int chunk_size = size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size;
-      if (sector >= block_size (dst))
+      int chunk_size = (size > COPY_SECTORS * BLOCK_SECTOR_SIZE
+                        ? COPY_SECTORS * BLOCK_SECTOR_SIZE
+                        : size);
+      size_t sector_cnt = DIV_ROUND_UP (chunk_size, BLOCK_SECTOR_SIZE);
+      if (sector_cnt > block_size (dst) - sector)
         PANIC ("%s: out of space on scratch device", file_name);
       if (file_read (src, buffer, chunk_size) != chunk_size)
         PANIC ("%s: read failed with %"PROTd" bytes unread", file_name, size);
-      memset (buffer + chunk_size, 0, BLOCK_SECTOR_SIZE - chunk_size);
-      block_write (dst, sector++, buffer);
+      memset (buffer + chunk_size, 0,
+              sector_cnt * BLOCK_SECTOR_SIZE - chunk_size);
+      block_write_multiple (dst, sector, sector_cnt, buffer);
+      sector += sector_cnt;
       size -= chunk_size;
     }
 
@@ -219,5 +421,130 @@ fsutil_append (char **argv)
 
   /* Finish up. */
   file_close (src);
-  free (buffer);
+  palloc_free_multiple (buffer, COPY_PAGES);
+}
+
+/* Returns the swap device.  A kernel without VM does not give
+   any device the swap role at startup, so this falls back to the
+   first device of that type. */
+static struct block *
+swap_device (void) 
+{
+  struct block *block = block_get_role (BLOCK_SWAP);
+
+  if (block == NULL)
+    for (block = block_first (); block != NULL; block = block_next (block))
+      if (block_type (block) == BLOCK_SWAP)
+        break;
+  return block;
+}
+
+/* Completion function for fsutil_iobench() writes. */
+static void
+bench_write_done (struct block_request *r) 
+{
+  sema_up (r->aux);
+}
+
+/* Measures how well I/O to two devices overlaps.  Reads up to
+   BENCH_SECTORS sectors from the scratch device, streamed the way
+   fsutil_extract() does, and writes as many to the swap device.
+   First it does one and then the other; then it does both at once
+   from this one thread, keeping reads and writes outstanding at
+   the same time.  On disks on different channels, the second
+   should take about as long as the slower of the two alone.
+   Overwrites the start of the swap device. */
+void
+fsutil_iobench (char **argv UNUSED) 
+{
+  struct block *src = block_get_role (BLOCK_SCRATCH);
+  struct block *swap = swap_device ();
+  struct block_request reqs[BENCH_DEPTH];
+  struct semaphore done[BENCH_DEPTH];
+  struct stream s;
+  uint8_t *buffer;
+  void **vec;
+  block_sector_t cnt, read, written, n;
+  int64_t start, serial, overlapped;
+  int i;
+
+  if (src == NULL || swap == NULL)
+    {
+      printf ("iobench: needs a scratch and a swap device\n");
+      return;
+    }
+  cnt = block_size (src) < block_size (swap) ? block_size (src)
+                                              : block_size (swap);
+  if (cnt > BENCH_SECTORS)
+    cnt = BENCH_SECTORS;
+  printf ("iobench: %'"PRDSNu" sectors from %s, %'"PRDSNu" to %s\n",
+          cnt, block_name (src), cnt, block_name (swap));
+
+  buffer = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, COPY_PAGES);
+  vec = malloc (COPY_SECTORS * sizeof *vec);
+  if (vec == NULL)
+    PANIC ("couldn't allocate buffer");
+  for (i = 0; i < COPY_SECTORS; i++)
+    vec[i] = buffer + i * BLOCK_SECTOR_SIZE;
+
+  /* One device, then the other.  Read the range once beforehand
+     so that neither run benefits from the host's caches more than
+     the other. */
+  for (read = 0; read < cnt; read += n)
+    {
+      n = cnt - read < COPY_SECTORS ? cnt - read : COPY_SECTORS;
+      block_read_multiple (src, read, n, buffer);
+    }
+  start = timer_ticks ();
+  for (read = 0; read < cnt; read += n)
+    {
+      n = cnt - read < COPY_SECTORS ? cnt - read : COPY_SECTORS;
+      block_read_multiple (src, read, n, buffer);
+    }
+  for (written = 0; written < cnt; written += n)
+    {
+      n = cnt - written < COPY_SECTORS ? cnt - written : COPY_SECTORS;
+      block_write_multiple (swap, written, n, buffer);
+    }
+  serial = timer_elapsed (start);
+
+  /* Both at once.  Each write slot's semaphore is up while the
+     slot is free. */
+  for (i = 0; i < BENCH_DEPTH; i++)
+    sema_init (&done[i], 1);
+  start = timer_ticks ();
+  stream_start (&s, src, 0);
+  read = written = 0;
+  for (i = 0; read < cnt || written < cnt; i = (i + 1) % BENCH_DEPTH)
+    {
+      if (written < cnt)
+        {
+          n = cnt - written < COPY_SECTORS ? cnt - written : COPY_SECTORS;
+          sema_down (&done[i]);
+          block_request_init (&reqs[i], written, n, vec, true,
+                              bench_write_done, &done[i]);
+          block_submit (swap, &reqs[i]);
+          written += n;
+        }
+      if (read < cnt)
+        {
+          size_t avail;
+
+          stream_peek (&s, &avail);
+          n = cnt - read < avail ? cnt - read : avail;
+          stream_advance (&s, n);
+          read += n;
+        }
+    }
+  for (i = 0; i < BENCH_DEPTH; i++)
+    sema_down (&done[i]);
+  stream_stop (&s);
+  overlapped = timer_elapsed (start);
+
+  printf ("iobench: one after the other %"PRId64" ms, "
+          "overlapped %"PRId64" ms\n",
+          serial * 1000 / TIMER_FREQ, overlapped * 1000 / TIMER_FREQ);
+
+  free (vec);
+  palloc_free_multiple (buffer, COPY_PAGES);
 }
@@ -1,24 +1,124 @@
 #include "filesys/inode.h"
-#include <list.h>
 #include <debug.h>
+#include <flatmap.h>
 #include <round.h>
+#include <stddef.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "filesys/memfile.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "userprog/uaccess.h"
 
-/* Identifies an inode. */
+/* Identifies an inode whose data is in data sectors. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Identifies an inode whose data, at most INLINE_MAX bytes, is
+   kept in the inode itself, in place of the sector map.  A small
+   file then takes one sector and one read.  It moves to data
+   sectors for good when it grows past INLINE_MAX. */
+#define INODE_INLINE_MAGIC 0x494e4c4e
+
+/* Set in a data sector's pointer, or an extent's start, for a
+   sector that inode_allocate() has set aside but that has not
+   been written yet.  It reads as zeros, like a hole, but writing
+   it only clears the bit, without going to the free map, and
+   without zeroing it first: the first write of it is a whole
+   sector through cache_write_new().  No disk has 2**31
+   sectors. */
+#define UNWRITTEN 0x80000000u
+
+/* Set in the inode number of a file read in place from the
+   scratch archive, which has no inode sector; see
+   inode_open_archive(). */
+#define ARCHIVE_INUMBER 0x80000000u
+
+#ifdef FS_EXTENTS
+/* Extent layout, selected by defining FS_EXTENTS, for example by
+   adding -DFS_EXTENTS to DEFINES in filesys/Make.vars.  An
+   inode's data is a list of extents, each a run of consecutive
+   sectors on disk.  The first INLINE_EXTENTS are in the inode
+   itself and up to SPILL_EXTENTS more spill into one extent
+   block.  Extents are kept in file order and each records the
+   file sector just past its end, so the extent that holds a given
+   sector is found by binary search.  A file whose sectors were
+   allocated in one run takes a single extent, however large.
+   An extent that starts at sector 0 is a hole: its sectors are
+   not allocated yet and read as zeros.
+
+   The layout is not compatible with the block map's, so a disk
+   must be formatted by a kernel built the same way. */
+
+/* A run of sectors. */
+struct extent
+  {
+    block_sector_t start;               /* First sector on disk. */
+    uint32_t end;                       /* File sector just past the run. */
+  };
+
+#define INLINE_EXTENTS 61
+#define SPILL_EXTENTS (BLOCK_SECTOR_SIZE / sizeof (struct extent))
+
+/* On-disk inode.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct inode_disk
+  {
+    off_t length;                       /* File size in bytes. */
+    unsigned magic;                     /* Magic number. */
+    uint32_t extent_cnt;                /* Number of extents. */
+    block_sector_t spill;               /* Extent block, or 0. */
+    block_sector_t next_alloc;          /* Where to look for a free sector. */
+    struct extent extents[INLINE_EXTENTS]; /* First extents. */
+    uint32_t unused;                    /* Not used. */
+  };
+#else
+/* Block map layout, the default.  An inode's data sectors are found through
+   DIRECT_CNT direct pointers in the inode itself, then one
+   indirect block of PTRS_PER_SECTOR pointers, then one doubly
+   indirect block that points to PTRS_PER_SECTOR more indirect
+   blocks.  A pointer of 0 means "not allocated" (sector 0 holds
+   the free map's inode, so it is never a data sector).  A data
+   sector below an inode's length whose pointer is 0 is a hole,
+   which reads as zeros; it is allocated when first written. */
+#define DIRECT_CNT 123
+#define PTRS_PER_SECTOR ((size_t) (BLOCK_SECTOR_SIZE / sizeof (block_sector_t)))
+#define MAX_SECTORS (DIRECT_CNT + PTRS_PER_SECTOR * (PTRS_PER_SECTOR + 1))
+
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    block_sector_t direct[DIRECT_CNT];  /* Direct data sectors. */
+    block_sector_t indirect;            /* Indirect block. */
+    block_sector_t doubly_indirect;     /* Doubly indirect block. */
+    block_sector_t next_alloc;          /* Where to look for a free sector. */
   };
+#endif
+
+/* Where inline data starts in an on-disk inode, just past
+   `length' and `magic', and how much of it fits. */
+#define INLINE_OFS (offsetof (struct inode_disk, magic) + sizeof (unsigned))
+#define INLINE_MAX ((off_t) (BLOCK_SECTOR_SIZE - INLINE_OFS))
+
+/* Returns true if DISK_INODE keeps its data inline. */
+static inline bool
+is_inline (const struct inode_disk *disk_inode) 
+{
+  return disk_inode->magic == INODE_INLINE_MAGIC;
+}
+
+/* Returns DISK_INODE's inline data. */
+static inline uint8_t *
+inline_data (struct inode_disk *disk_inode) 
+{
+  return (uint8_t *) disk_inode + INLINE_OFS;
+}
 
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
@@ -28,283 +128,1435 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* In-memory inode.  `data' is not the last member, so that an
+   inline sector lent out by inode_get_ro() can be read in full. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct inode_disk data;             /* Inode content. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
-    struct inode_disk data;             /* Inode content. */
+    unsigned version;                   /* Bumped after each write. */
+    struct lock grow_lock;              /* Serializes extending writes. */
+    struct rwlock map_lock;             /* Guards data's length and map. */
+    struct rwlock dir_lock;             /* Guards entries, if a directory. */
+    off_t ra_next;                      /* End of last read. */
+    off_t ra_end;                       /* Read-ahead queued up to here. */
+    int ra_window;                      /* Read-ahead sectors, 0 if off. */
+    int seq_cnt;                        /* Openers advising sequential. */
+    int random_cnt;                     /* Openers advising random. */
+    void *exec_data;                    /* Loader's parsed headers, or null. */
+    bool meta;                          /* Data is file system metadata? */
+    struct memfile mem;                 /* Data, if kept in memory. */
+    struct block *archive;              /* Device with the data, or null. */
+    block_sector_t archive_start;       /* First data sector on it. */
   };
 
-/* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
-static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+/* Returns true if INODE is a file of the scratch archive, whose
+   data is read in place from sectors archive_start onward of
+   device `archive'.  Such an inode is read-only and has no map:
+   `data' holds only its length. */
+static inline bool
+is_archived (const struct inode *inode) 
 {
-  ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-  else
-    return -1;
+  return inode->archive != NULL;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Returns true if the file system is kept in memory only.  Then
+   there are no sectors: inodes exist only as struct inodes, each
+   held open from inode_create() until inode_remove(), and their
+   data is in `mem' instead of under `data''s map, which holds
+   only the length. */
+static inline bool
+in_memory (void) 
+{
+  return fs_device == NULL;
+}
 
-/* Initializes the inode module. */
-void
-inode_init (void) 
+/* Largest file, in sectors, that inode_defrag() moves. */
+#define DEFRAG_MAX 1024
+
+/* Read-ahead window bounds, in sectors. */
+#define RA_MIN 2
+#define RA_MAX 16
+
+/* A sector of zeros. */
+static char zeros[BLOCK_SECTOR_SIZE];
+
+/* Allocates a sector for DISK_INODE, as near as possible after
+   its last one so that a file's sectors stay clustered, and
+   stores it in *SECTORP.  If ZERO, the sector is zeroed, as an
+   index block must be; otherwise its contents are left to the
+   caller.  Returns true if successful, false if the disk is
+   full. */
+static bool
+allocate (struct inode_disk *disk_inode, block_sector_t *sectorp, bool zero) 
 {
-  list_init (&open_inodes);
+  if (!free_map_allocate_near (disk_inode->next_alloc, sectorp))
+    return false;
+  if (zero)
+    cache_write (*sectorp, zeros);
+  disk_inode->next_alloc = *sectorp + 1;
+  return true;
 }
 
-/* Initializes an inode with LENGTH bytes of data and
-   writes the new inode to sector SECTOR on the file system
-   device.
-   Returns true if successful.
-   Returns false if memory or disk allocation fails. */
-bool
-inode_create (block_sector_t sector, off_t length)
+#ifdef FS_EXTENTS
+/* Returns extent K of DISK_INODE. */
+static struct extent
+get_extent (const struct inode_disk *disk_inode, size_t k) 
 {
-  struct inode_disk *disk_inode = NULL;
-  bool success = false;
+  struct extent e;
 
-  ASSERT (length >= 0);
+  if (k < INLINE_EXTENTS)
+    return disk_inode->extents[k];
+  cache_mark_meta (disk_inode->spill);
+  cache_read_at (disk_inode->spill, &e, (k - INLINE_EXTENTS) * sizeof e,
+                 sizeof e);
+  return e;
+}
 
-  /* If this assertion fails, the inode structure is not exactly
-     one sector in size, and you should fix that. */
-  ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
+/* Sets extent K of DISK_INODE to E. */
+static void
+put_extent (struct inode_disk *disk_inode, size_t k, struct extent e) 
+{
+  if (k < INLINE_EXTENTS)
+    disk_inode->extents[k] = e;
+  else 
+    {
+      cache_mark_meta (disk_inode->spill);
+      cache_write_at (disk_inode->spill, &e, (k - INLINE_EXTENTS) * sizeof e,
+                      sizeof e);
+    }
+}
 
-  disk_inode = calloc (1, sizeof *disk_inode);
-  if (disk_inode != NULL)
+/* Returns the file sector at which extent K of DISK_INODE
+   starts. */
+static uint32_t
+extent_first (const struct inode_disk *disk_inode, size_t k) 
+{
+  return k > 0 ? get_extent (disk_inode, k - 1).end : 0;
+}
+
+/* Replaces the DEL_CNT extents starting at K in DISK_INODE by the
+   NEW_CNT extents in NEW.  Returns true if successful, false if
+   DISK_INODE has no room for the result. */
+static bool
+splice_extents (struct inode_disk *disk_inode, size_t k, size_t del_cnt,
+                const struct extent new[], size_t new_cnt) 
+{
+  size_t old_cnt = disk_inode->extent_cnt;
+  size_t cnt = old_cnt - del_cnt + new_cnt;
+  size_t i;
+
+  if (cnt > INLINE_EXTENTS + SPILL_EXTENTS
+      || (cnt > INLINE_EXTENTS && disk_inode->spill == 0
+          && !allocate (disk_inode, &disk_inode->spill, true)))
+    return false;
+
+  /* Move the extents after the deleted ones into place. */
+  if (new_cnt > del_cnt)
+    for (i = old_cnt; i-- > k + del_cnt; )
+      put_extent (disk_inode, i + new_cnt - del_cnt,
+                  get_extent (disk_inode, i));
+  else if (new_cnt < del_cnt)
+    for (i = k + del_cnt; i < old_cnt; i++)
+      put_extent (disk_inode, i - del_cnt + new_cnt,
+                  get_extent (disk_inode, i));
+
+  for (i = 0; i < new_cnt; i++)
+    put_extent (disk_inode, k + i, new[i]);
+  disk_inode->extent_cnt = cnt;
+  return true;
+}
+
+/* Returns the index of the extent of DISK_INODE that holds file
+   sector IDX, or the number of extents if none does. */
+static size_t
+find_extent (const struct inode_disk *disk_inode, size_t idx) 
+{
+  size_t lo = 0, hi = disk_inode->extent_cnt;
+
+  /* Find the first extent that ends after IDX. */
+  while (lo < hi) 
     {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = length;
-      disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+      size_t mid = lo + (hi - lo) / 2;
+      if (get_extent (disk_inode, mid).end > idx)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+  return lo;
+}
+
+/* Returns the block that holds extents beyond the first
+   INLINE_EXTENTS, which inode_sync() must also write, or 0. */
+static block_sector_t
+index_block (const struct inode_disk *disk_inode, size_t idx UNUSED) 
+{
+  return disk_inode->spill;
+}
+
+/* Returns data sector IDX of DISK_INODE, or 0 if it is not
+   allocated. */
+static block_sector_t
+lookup_sector (const struct inode_disk *disk_inode, size_t idx) 
+{
+  size_t k = find_extent (disk_inode, idx);
+  struct extent e;
+
+  if (k == disk_inode->extent_cnt)
+    return 0;
+  e = get_extent (disk_inode, k);
+  if (e.start == 0 || (e.start & UNWRITTEN))
+    return 0;
+  return e.start + (idx - extent_first (disk_inode, k));
+}
+
+/* Marks data sector IDX of DISK_INODE, in unwritten extent K, as
+   written.  A sector just past the preceding written extent on
+   disk lengthens that extent, so that writing an unwritten
+   extent from the start moves it over sector by sector; any
+   other splits extent K.  If DISK_INODE has no room for the
+   split, as random writes over a large unwritten extent can
+   cause, the rest of extent K is zeroed on disk instead, and
+   extent K becomes written as a whole. */
+static void
+convert_sector (struct inode_disk *disk_inode, size_t k, size_t idx) 
+{
+  struct extent e = get_extent (disk_inode, k);
+  uint32_t first = extent_first (disk_inode, k);
+  block_sector_t base = e.start & ~UNWRITTEN;
+  block_sector_t sector = base + (idx - first);
+  struct extent parts[3];
+  size_t part_cnt = 0;
+  size_t i;
+
+  if (idx == first && k > 0) 
+    {
+      struct extent prev = get_extent (disk_inode, k - 1);
+      if (prev.start != 0 && !(prev.start & UNWRITTEN)
+          && prev.start + (prev.end - extent_first (disk_inode, k - 1))
+             == sector) 
         {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
+          prev.end++;
+          put_extent (disk_inode, k - 1, prev);
+          if (e.end == prev.end)
+            splice_extents (disk_inode, k, 1, NULL, 0);
+          else 
             {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
+              e.start++;
+              put_extent (disk_inode, k, e);
             }
-          success = true; 
-        } 
-      free (disk_inode);
+          return;
+        }
     }
-  return success;
+
+  if (idx > first)
+    parts[part_cnt++] = (struct extent) { e.start, idx };
+  parts[part_cnt++] = (struct extent) { sector, idx + 1 };
+  if (e.end > idx + 1)
+    parts[part_cnt++] = (struct extent) { (sector + 1) | UNWRITTEN, e.end };
+  if (splice_extents (disk_inode, k, 1, parts, part_cnt))
+    return;
+
+  for (i = first; i < e.end; i++)
+    if (i != idx)
+      cache_write (base + (i - first), zeros);
+  e.start = base;
+  put_extent (disk_inode, k, e);
 }
 
-/* Reads an inode from SECTOR
-   and returns a `struct inode' that contains it.
-   Returns a null pointer if memory allocation fails. */
-struct inode *
-inode_open (block_sector_t sector)
+/* Makes sure that data sector IDX of DISK_INODE, which must be
+   within its length, is allocated.  A sector allocated just past
+   the preceding extent on disk lengthens that extent; any other
+   splits the hole it lands in.  A newly allocated sector's
+   contents are undefined, so the caller must fill it in.
+   Returns true if successful, false if the disk is full or
+   DISK_INODE has no room for another extent. */
+static bool
+allocate_sector (struct inode_disk *disk_inode, size_t idx) 
 {
-  struct list_elem *e;
-  struct inode *inode;
+  size_t k = find_extent (disk_inode, idx);
+  struct extent hole, prev, parts[3];
+  size_t part_cnt = 0;
+  uint32_t first;
+  block_sector_t next = 0;      /* Disk sector just past PREV. */
+  block_sector_t sector;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  ASSERT (k < disk_inode->extent_cnt);
+  hole = get_extent (disk_inode, k);
+  if (hole.start & UNWRITTEN) 
+    {
+      convert_sector (disk_inode, k, idx);
+      return true;
+    }
+  if (hole.start != 0)
+    return true;
+
+  first = extent_first (disk_inode, k);
+  if (idx == first && k > 0) 
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
+      prev = get_extent (disk_inode, k - 1);
+      if (prev.start != 0 && !(prev.start & UNWRITTEN)) 
         {
-          inode_reopen (inode);
-          return inode; 
+          next = prev.start + (prev.end - extent_first (disk_inode, k - 1));
+          disk_inode->next_alloc = next;
         }
     }
+  if (!allocate (disk_inode, &sector, false))
+    return false;
 
-  /* Allocate memory. */
-  inode = malloc (sizeof *inode);
-  if (inode == NULL)
-    return NULL;
+  if (next != 0 && sector == next) 
+    {
+      /* Lengthening PREV also shrinks the hole, which starts where
+         PREV ends. */
+      prev.end++;
+      put_extent (disk_inode, k - 1, prev);
+      if (hole.end == prev.end)
+        splice_extents (disk_inode, k, 1, NULL, 0);
+      return true;
+    }
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
-  inode->sector = sector;
-  inode->open_cnt = 1;
-  inode->deny_write_cnt = 0;
-  inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
-  return inode;
+  if (idx > first)
+    parts[part_cnt++] = (struct extent) { 0, idx };
+  parts[part_cnt++] = (struct extent) { sector, idx + 1 };
+  if (hole.end > idx + 1)
+    parts[part_cnt++] = hole;
+  if (!splice_extents (disk_inode, k, 1, parts, part_cnt)) 
+    {
+      free_map_release (sector, 1);
+      return false;
+    }
+  return true;
 }
 
-/* Reopens and returns INODE. */
-struct inode *
-inode_reopen (struct inode *inode)
+/* Makes room in DISK_INODE's extents for it to grow to LENGTH
+   bytes, by adding a hole that reads as zeros and is allocated
+   only as it is written.  Does not change DISK_INODE's length.
+   Returns false if DISK_INODE has no room for another extent. */
+static bool
+reserve (struct inode_disk *disk_inode, off_t length) 
 {
-  if (inode != NULL)
-    inode->open_cnt++;
-  return inode;
+  size_t cnt = disk_inode->extent_cnt;
+  uint32_t sectors = bytes_to_sectors (length);
+
+  if (sectors > extent_first (disk_inode, cnt)) 
+    {
+      struct extent hole = { 0, sectors };
+
+      if (cnt > 0 && get_extent (disk_inode, cnt - 1).start == 0)
+        put_extent (disk_inode, cnt - 1, hole);
+      else if (!splice_extents (disk_inode, cnt, 0, &hole, 1))
+        return false;
+    }
+  return true;
 }
 
-/* Returns INODE's inode number. */
-block_sector_t
-inode_get_inumber (const struct inode *inode)
+/* Returns the number of sectors of DISK_INODE, up to MAX, that
+   are holes starting from data sector IDX, all in one extent. */
+static size_t
+hole_run (const struct inode_disk *disk_inode, size_t idx, size_t max) 
 {
-  return inode->sector;
+  size_t k = find_extent (disk_inode, idx);
+  struct extent e;
+
+  if (k == disk_inode->extent_cnt)
+    return 0;
+  e = get_extent (disk_inode, k);
+  if (e.start != 0)
+    return 0;
+  return e.end - idx < max ? e.end - idx : max;
 }
 
-/* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
-void
-inode_close (struct inode *inode) 
+/* Points the CNT data sectors of DISK_INODE starting at IDX, a
+   run that hole_run() found, at the CNT consecutive sectors
+   starting at START, as unwritten.  A run that continues the
+   preceding unwritten extent on disk lengthens it.  Returns false
+   if DISK_INODE has no room for another extent, after releasing
+   the run. */
+static bool
+place_run (struct inode_disk *disk_inode, size_t idx, size_t cnt,
+           block_sector_t start) 
 {
-  /* Ignore null pointer. */
-  if (inode == NULL)
-    return;
+  size_t k = find_extent (disk_inode, idx);
+  struct extent hole = get_extent (disk_inode, k);
+  uint32_t first = extent_first (disk_inode, k);
+  struct extent parts[3];
+  size_t part_cnt = 0;
 
-  /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  ASSERT (hole.start == 0 && idx + cnt <= hole.end);
+  if (idx == first && k > 0) 
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
-      if (inode->removed) 
+      struct extent prev = get_extent (disk_inode, k - 1);
+      if ((prev.start & UNWRITTEN)
+          && ((prev.start & ~UNWRITTEN)
+              + (prev.end - extent_first (disk_inode, k - 1))) == start) 
         {
-          free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          prev.end += cnt;
+          put_extent (disk_inode, k - 1, prev);
+          if (hole.end == prev.end)
+            splice_extents (disk_inode, k, 1, NULL, 0);
+          return true;
         }
+    }
 
-      free (inode); 
+  if (idx > first)
+    parts[part_cnt++] = (struct extent) { 0, idx };
+  parts[part_cnt++] = (struct extent) { start | UNWRITTEN, idx + cnt };
+  if (hole.end > idx + cnt)
+    parts[part_cnt++] = hole;
+  if (!splice_extents (disk_inode, k, 1, parts, part_cnt)) 
+    {
+      free_map_release (start, cnt);
+      return false;
     }
+  return true;
 }
 
-/* Marks INODE to be deleted when it is closed by the last caller who
-   has it open. */
-void
-inode_remove (struct inode *inode) 
+/* Releases every data and extent sector of DISK_INODE, but not
+   the sector that holds DISK_INODE itself. */
+static void
+release_sectors (struct inode_disk *disk_inode) 
 {
-  ASSERT (inode != NULL);
-  inode->removed = true;
+  uint32_t first = 0;
+  size_t k;
+
+  for (k = 0; k < disk_inode->extent_cnt; k++) 
+    {
+      struct extent e = get_extent (disk_inode, k);
+      if (e.start != 0)
+        free_map_release (e.start & ~UNWRITTEN, e.end - first);
+      first = e.end;
+    }
+  if (disk_inode->spill != 0)
+    free_map_release (disk_inode->spill, 1);
 }
 
-/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
-   Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
-off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+/* Points DISK_INODE's CNT data sectors, all allocated, at the CNT
+   consecutive sectors starting at START, which hold copies of
+   their data, and releases the old ones. */
+static void
+relocate (struct inode_disk *disk_inode, block_sector_t start, size_t cnt) 
 {
-  uint8_t *buffer = buffer_;
-  off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
-
-  while (size > 0) 
-    {
-      /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
-      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+  release_sectors (disk_inode);
+  memset (disk_inode->extents, 0, sizeof disk_inode->extents);
+  disk_inode->extents[0] = (struct extent) { start, cnt };
+  disk_inode->extent_cnt = 1;
+  disk_inode->spill = 0;
+}
+#else
+/* Returns pointer IDX in index block SECTOR. */
+static block_sector_t
+read_ptr (block_sector_t sector, size_t idx) 
+{
+  block_sector_t ptr;
+  cache_mark_meta (sector);
+  cache_read_at (sector, &ptr, idx * sizeof ptr, sizeof ptr);
+  return ptr;
+}
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+/* Sets pointer IDX in index block SECTOR to PTR. */
+static void
+write_ptr (block_sector_t sector, size_t idx, block_sector_t ptr) 
+{
+  cache_mark_meta (sector);
+  cache_write_at (sector, &ptr, idx * sizeof ptr, sizeof ptr);
+}
 
-      /* Number of bytes to actually copy out of this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
-        break;
+/* Returns the index block that holds the pointer to data sector
+   IDX of DISK_INODE, or 0 if the pointer is in DISK_INODE itself
+   or its index block is not allocated. */
+static block_sector_t
+index_block (const struct inode_disk *disk_inode, size_t idx) 
+{
+  if (idx < DIRECT_CNT)
+    return 0;
+  idx -= DIRECT_CNT;
+  if (idx < PTRS_PER_SECTOR)
+    return disk_inode->indirect;
+  idx -= PTRS_PER_SECTOR;
+  if (disk_inode->doubly_indirect == 0)
+    return 0;
+  return read_ptr (disk_inode->doubly_indirect, idx / PTRS_PER_SECTOR);
+}
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
-      
-      /* Advance. */
-      size -= chunk_size;
-      offset += chunk_size;
-      bytes_read += chunk_size;
-    }
-  free (bounce);
+/* Returns the pointer to data sector IDX of DISK_INODE, which is
+   0 if it is not allocated and has UNWRITTEN set if it has not
+   been written. */
+static block_sector_t
+lookup_ptr (const struct inode_disk *disk_inode, size_t idx) 
+{
+  block_sector_t index;
 
-  return bytes_read;
+  if (idx < DIRECT_CNT)
+    return disk_inode->direct[idx];
+  if (idx >= MAX_SECTORS)
+    return 0;
+  index = index_block (disk_inode, idx);
+  if (index == 0)
+    return 0;
+  return read_ptr (index, (idx - DIRECT_CNT) % PTRS_PER_SECTOR);
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
-   Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
-off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
-                off_t offset) 
+/* Returns data sector IDX of DISK_INODE, or 0 if it is not
+   allocated or not written. */
+static block_sector_t
+lookup_sector (const struct inode_disk *disk_inode, size_t idx) 
 {
-  const uint8_t *buffer = buffer_;
-  off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  block_sector_t ptr = lookup_ptr (disk_inode, idx);
 
-  if (inode->deny_write_cnt)
+  return ptr & UNWRITTEN ? 0 : ptr;
+}
+
+/* Returns *PTR, first allocating a sector for it if it is 0,
+   zeroed if ZERO.  A data sector set aside by inode_allocate()
+   is allocated already, and only has its UNWRITTEN bit
+   cleared.  Returns 0 if allocation fails. */
+static block_sector_t
+get_or_allocate (struct inode_disk *disk_inode, block_sector_t *ptr,
+                 bool zero) 
+{
+  if (*ptr == 0 && !allocate (disk_inode, ptr, zero))
     return 0;
+  *ptr &= ~UNWRITTEN;
+  return *ptr;
+}
 
-  while (size > 0) 
+/* Returns pointer IDX in index block INDEX, first allocating a
+   sector for it if it is 0, zeroed if ZERO.  Returns 0 if INDEX
+   is 0 or if allocation fails. */
+static block_sector_t
+get_or_allocate_ptr (struct inode_disk *disk_inode, block_sector_t index,
+                     size_t idx, bool zero) 
+{
+  block_sector_t ptr;
+
+  if (index == 0)
+    return 0;
+  ptr = read_ptr (index, idx);
+  if (ptr == 0 && allocate (disk_inode, &ptr, zero))
+    write_ptr (index, idx, ptr);
+  else if (ptr & UNWRITTEN)
     {
-      /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
-      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      ptr &= ~UNWRITTEN;
+      write_ptr (index, idx, ptr);
+    }
+  return ptr;
+}
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+/* Returns the index block that points to data sector IDX of
+   DISK_INODE, which must be past the direct pointers, first
+   allocating it, and the doubly indirect block above it, zeroed
+   if they are missing.  Returns 0 if allocation fails. */
+static block_sector_t
+get_or_allocate_index (struct inode_disk *disk_inode, size_t idx) 
+{
+  block_sector_t doubly;
 
-      /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
-        break;
+  idx -= DIRECT_CNT;
+  if (idx < PTRS_PER_SECTOR)
+    return get_or_allocate (disk_inode, &disk_inode->indirect, true);
+  idx -= PTRS_PER_SECTOR;
+  doubly = get_or_allocate (disk_inode, &disk_inode->doubly_indirect, true);
+  return get_or_allocate_ptr (disk_inode, doubly, idx / PTRS_PER_SECTOR,
+                              true);
+}
+
+/* Makes sure that data sector IDX of DISK_INODE is allocated,
+   along with the zeroed index blocks that lead to it.  A newly
+   allocated data sector's contents are undefined, so the caller
+   must fill it in.  Returns true if successful, false if the
+   disk is full or IDX is beyond the largest possible file. */
+static bool
+allocate_sector (struct inode_disk *disk_inode, size_t idx) 
+{
+  if (idx < DIRECT_CNT)
+    return get_or_allocate (disk_inode, &disk_inode->direct[idx],
+                            false) != 0;
+  if (idx >= MAX_SECTORS)
+    return false;
+  return get_or_allocate_ptr (disk_inode,
+                              get_or_allocate_index (disk_inode, idx),
+                              (idx - DIRECT_CNT) % PTRS_PER_SECTOR,
+                              false) != 0;
+}
+
+/* Returns the number of sectors of DISK_INODE, up to MAX, that
+   are holes starting from data sector IDX. */
+static size_t
+hole_run (const struct inode_disk *disk_inode, size_t idx, size_t max) 
+{
+  size_t cnt = 0;
+
+  while (cnt < max && idx + cnt < MAX_SECTORS
+         && lookup_ptr (disk_inode, idx + cnt) == 0)
+    cnt++;
+  return cnt;
+}
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+/* Points the CNT data sectors of DISK_INODE starting at IDX, a
+   run that hole_run() found, at the CNT consecutive sectors
+   starting at START, as unwritten, allocating the zeroed index
+   blocks that lead to them.  Returns false if the disk is full,
+   after releasing the part of the run not yet pointed to. */
+static bool
+place_run (struct inode_disk *disk_inode, size_t idx, size_t cnt,
+           block_sector_t start) 
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++, idx++)
+    {
+      block_sector_t ptr = (start + i) | UNWRITTEN;
+      block_sector_t index;
+
+      if (idx < DIRECT_CNT)
         {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
+          disk_inode->direct[idx] = ptr;
+          continue;
         }
-      else 
+      index = get_or_allocate_index (disk_inode, idx);
+      if (index == 0)
         {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
+          free_map_release (start + i, cnt - i);
+          return false;
+        }
+      write_ptr (index, (idx - DIRECT_CNT) % PTRS_PER_SECTOR, ptr);
+    }
+  return true;
+}
 
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
+/* Releases index block SECTOR and every sector it points to.  An
+   index block of LEVEL 1 points to data sectors, one of LEVEL 2
+   to index blocks of level 1. */
+static void
+release_index (block_sector_t sector, int level) 
+{
+  size_t i;
+
+  for (i = 0; i < PTRS_PER_SECTOR; i++) 
+    {
+      block_sector_t ptr = read_ptr (sector, i);
+      if (ptr != 0) 
+        {
+          if (level > 1)
+            release_index (ptr, level - 1);
           else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
+            free_map_release (ptr & ~UNWRITTEN, 1);
+        }
+    }
+  free_map_release (sector, 1);
+}
+
+/* Releases every data and index sector of DISK_INODE, but not
+   the sector that holds DISK_INODE itself. */
+static void
+release_sectors (struct inode_disk *disk_inode) 
+{
+  size_t i;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    if (disk_inode->direct[i] != 0)
+      free_map_release (disk_inode->direct[i] & ~UNWRITTEN, 1);
+  if (disk_inode->indirect != 0)
+    release_index (disk_inode->indirect, 1);
+  if (disk_inode->doubly_indirect != 0)
+    release_index (disk_inode->doubly_indirect, 2);
+}
+
+/* Points DISK_INODE's CNT data sectors, all allocated, at the CNT
+   consecutive sectors starting at START, which hold copies of
+   their data, and releases the old ones.  The index blocks stay
+   where they are. */
+static void
+relocate (struct inode_disk *disk_inode, block_sector_t start, size_t cnt) 
+{
+  size_t idx;
+
+  for (idx = 0; idx < cnt; idx++) 
+    {
+      free_map_release (lookup_sector (disk_inode, idx), 1);
+      if (idx < DIRECT_CNT)
+        disk_inode->direct[idx] = start + idx;
+      else
+        write_ptr (index_block (disk_inode, idx),
+                   (idx - DIRECT_CNT) % PTRS_PER_SECTOR, start + idx);
+    }
+}
+
+/* Checks that DISK_INODE can grow to LENGTH bytes.  Sectors past
+   its end are holes, which read as zeros and are allocated only
+   when written, so nothing needs to be set up.  Does not change
+   DISK_INODE's length.  Returns false if LENGTH is beyond the
+   largest possible file. */
+static bool
+reserve (struct inode_disk *disk_inode UNUSED, off_t length) 
+{
+  return bytes_to_sectors (length) <= MAX_SECTORS;
+}
+#endif /* FS_EXTENTS */
+
+/* Returns data sector IDX of INODE, or 0 if it is a hole. */
+static block_sector_t
+map_sector (struct inode *inode, size_t idx) 
+{
+  block_sector_t sector;
+
+  rw_read_acquire (&inode->map_lock);
+  sector = lookup_sector (&inode->data, idx);
+  rw_read_release (&inode->map_lock);
+  return sector;
+}
+
+/* Returns the block device sector that contains byte offset POS
+   within INODE, or 0 if that sector is a hole.
+   Returns -1 if INODE does not contain data for a byte at offset
+   POS. */
+static block_sector_t
+byte_to_sector (struct inode *inode, off_t pos) 
+{
+  ASSERT (inode != NULL);
+  if (pos < inode_length (inode))
+    return map_sector (inode, pos / BLOCK_SECTOR_SIZE);
+  else
+    return -1;
+}
+
+/* Map from sector to open inode, so that opening a single inode
+   twice returns the same `struct inode'.  open_inodes_lock
+   protects the map and each inode's `open_cnt' and
+   `exec_data'. */
+static struct flatmap open_inodes;
+static struct lock open_inodes_lock;
+
+/* Caches for in-memory inodes and for on-disk inodes being
+   created. */
+static struct kmem_cache *inode_cache;
+static struct kmem_cache *bounce_cache;
+
+static void drop_exec_data (struct inode *);
+
+/* Initializes the inode module. */
+void
+inode_init (void) 
+{
+  if (!flatmap_init (&open_inodes, 16))
+    PANIC ("inode_init: out of memory");
+  lock_init (&open_inodes_lock);
+  inode_cache = kmem_cache_create ("inode", sizeof (struct inode), 0, NULL);
+  bounce_cache = kmem_cache_create ("bounce", BLOCK_SECTOR_SIZE, 0, NULL);
+  if (inode_cache == NULL || bounce_cache == NULL)
+    PANIC ("inode_init: out of memory");
+}
+
+/* Allocates and returns a new in-memory inode for SECTOR, with
+   one opener, or a null pointer if memory is short.  Its `data'
+   is left for the caller to fill in. */
+static struct inode *
+new_inode (block_sector_t sector) 
+{
+  struct inode *inode = kmem_cache_alloc (inode_cache);
+
+  if (inode == NULL)
+    return NULL;
+  inode->sector = sector;
+  inode->open_cnt = 1;
+  inode->deny_write_cnt = 0;
+  inode->version = 0;
+  inode->removed = false;
+  lock_init (&inode->grow_lock);
+  rw_init (&inode->map_lock);
+  rw_init (&inode->dir_lock);
+  inode->ra_next = 0;
+  inode->ra_end = 0;
+  inode->ra_window = 0;
+  inode->seq_cnt = 0;
+  inode->random_cnt = 0;
+  inode->exec_data = NULL;
+  inode->meta = false;
+  memfile_init (&inode->mem);
+  inode->archive = NULL;
+  inode->archive_start = 0;
+  return inode;
+}
+
+/* Does the work of inode_create() for a file system kept in
+   memory: creates inode SECTOR with LENGTH bytes of zeros, held
+   open on behalf of the file system until inode_remove(). */
+static bool
+create_in_memory (block_sector_t sector, off_t length) 
+{
+  struct inode *inode = new_inode (sector);
+  bool success;
+
+  if (inode == NULL)
+    return false;
+  inode->data.length = length;
+  inode->data.magic = INODE_MAGIC;
+  lock_acquire (&open_inodes_lock);
+  success = (flatmap_find (&open_inodes, sector) == NULL
+             && flatmap_insert (&open_inodes, sector, inode));
+  lock_release (&open_inodes_lock);
+  if (!success)
+    kmem_cache_free (inode_cache, inode);
+  return success;
+}
+
+/* Initializes an inode with LENGTH bytes of data and
+   writes the new inode to sector SECTOR on the file system
+   device.  The data is zeros, kept inline if LENGTH is at most
+   INLINE_MAX and otherwise a hole, so no data sectors are
+   allocated until they are written.
+   Returns true if successful.
+   Returns false if memory allocation fails or LENGTH is too
+   large. */
+bool
+inode_create (block_sector_t sector, off_t length)
+{
+  struct inode_disk *disk_inode = NULL;
+  bool success = false;
+
+  ASSERT (length >= 0);
+
+  /* If this assertion fails, the inode structure is not exactly
+     one sector in size, and you should fix that. */
+  ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
+
+  if (in_memory ())
+    return create_in_memory (sector, length);
+
+  disk_inode = kmem_cache_zalloc (bounce_cache);
+  if (disk_inode != NULL)
+    {
+      disk_inode->length = length;
+      if (length <= INLINE_MAX) 
+        {
+          disk_inode->magic = INODE_INLINE_MAGIC;
+          success = true;
+        }
+      else 
+        {
+          disk_inode->magic = INODE_MAGIC;
+          disk_inode->next_alloc = sector + 1;
+          success = reserve (disk_inode, length);
+        }
+      if (success) 
+        {
+          cache_mark_meta (sector);
+          cache_write (sector, disk_inode);
+        }
+      kmem_cache_free (bounce_cache, disk_inode);
+    }
+  return success;
+}
+
+/* Reads an inode from SECTOR
+   and returns a `struct inode' that contains it.
+   Returns a null pointer if memory allocation fails, or if the
+   file system is kept in memory and has no inode SECTOR. */
+struct inode *
+inode_open (block_sector_t sector)
+{
+  struct inode *inode, *open;
+
+  /* Check whether this inode is already open. */
+  lock_acquire (&open_inodes_lock);
+  inode = flatmap_find (&open_inodes, sector);
+  if (inode != NULL)
+    inode->open_cnt++;
+  lock_release (&open_inodes_lock);
+  if (inode != NULL)
+    return inode;
+
+  /* A file system in memory has every inode open. */
+  if (in_memory ())
+    return NULL;
+
+  /* Allocate and initialize, without holding open_inodes_lock
+     across the read. */
+  inode = new_inode (sector);
+  if (inode == NULL)
+    return NULL;
+  cache_mark_meta (inode->sector);
+  cache_read (inode->sector, &inode->data);
+
+  /* Publish INODE, unless another thread opened SECTOR while it
+     was being read. */
+  lock_acquire (&open_inodes_lock);
+  open = flatmap_find (&open_inodes, sector);
+  if (open != NULL)
+    open->open_cnt++;
+  else if (!flatmap_insert (&open_inodes, sector, inode)) 
+    {
+      lock_release (&open_inodes_lock);
+      kmem_cache_free (inode_cache, inode);
+      return NULL;
+    }
+  lock_release (&open_inodes_lock);
+
+  if (open != NULL) 
+    {
+      kmem_cache_free (inode_cache, inode);
+      inode = open;
+    }
+  return inode;
+}
+
+/* Returns a new inode, with one opener, for a read-only file of
+   LENGTH bytes that lies in place on ARCHIVE from sector START
+   onward, as the files of a ustar archive do, or a null pointer
+   if memory is short.  The inode has no sector of its own, so it
+   is not among the open inodes that inode_open() finds: its
+   inode number is START with ARCHIVE_INUMBER set, which no file
+   system sector has, and it is freed when its last opener closes
+   it. */
+struct inode *
+inode_open_archive (struct block *archive, block_sector_t start,
+                    off_t length) 
+{
+  struct inode *inode;
+
+  ASSERT (start < ARCHIVE_INUMBER);
+
+  inode = new_inode (start | ARCHIVE_INUMBER);
+  if (inode == NULL)
+    return NULL;
+  memset (&inode->data, 0, sizeof inode->data);
+  inode->data.length = length;
+  inode->data.magic = INODE_MAGIC;
+  inode->archive = archive;
+  inode->archive_start = start;
+  return inode;
+}
+
+/* Reopens and returns INODE. */
+struct inode *
+inode_reopen (struct inode *inode)
+{
+  if (inode != NULL) 
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
+  return inode;
+}
+
+/* Returns INODE's inode number. */
+block_sector_t
+inode_get_inumber (const struct inode *inode)
+{
+  return inode->sector;
+}
+
+/* Returns INODE's version, which changes each time data is
+   written to it.  A copy of the data taken when the version was
+   V is still good as long as the version is still V.  The
+   version changes after a write is done, so a copy taken during
+   a write counts as older than the write. */
+unsigned
+inode_get_version (const struct inode *inode)
+{
+  return inode->version;
+}
+
+/* Closes INODE and writes it to disk.
+   If this was the last reference to INODE, frees its memory.
+   If INODE was also a removed inode, frees its blocks.  That
+   changes only the free map, and needs no journal handle: the
+   directory entry that pointed to INODE was removed, and
+   committed, before. */
+void
+inode_close (struct inode *inode) 
+{
+  bool last;
+
+  /* Ignore null pointer. */
+  if (inode == NULL)
+    return;
+
+  /* Release resources if this was the last opener. */
+  lock_acquire (&open_inodes_lock);
+  last = --inode->open_cnt == 0;
+  if (last)
+    flatmap_remove (&open_inodes, inode->sector);
+  lock_release (&open_inodes_lock);
+
+  if (last)
+    {
+      /* Deallocate blocks if removed. */
+      if (inode->removed) 
+        {
+          free_map_release (inode->sector, 1);
+          if (in_memory ())
+            memfile_destroy (&inode->mem);
+          else if (!is_inline (&inode->data))
+            release_sectors (&inode->data);
+        }
+
+      free (inode->exec_data);
+      kmem_cache_free (inode_cache, inode);
+    }
+}
+
+/* Marks INODE to be deleted when it is closed by the last caller who
+   has it open.  In a file system kept in memory, this also drops
+   the file system's own reference, so that the last close can be
+   the caller's. */
+void
+inode_remove (struct inode *inode) 
+{
+  ASSERT (inode != NULL);
+  if (in_memory ()) 
+    {
+      lock_acquire (&open_inodes_lock);
+      if (!inode->removed)
+        inode->open_cnt--;
+      ASSERT (inode->open_cnt > 0);
+      lock_release (&open_inodes_lock);
+    }
+  inode->removed = true;
+}
+
+/* Updates INODE's read-ahead state for a read of SIZE bytes at
+   OFFSET, and queues read-ahead if the reads are sequential.
+   Each read that starts where the previous one ended doubles the
+   read-ahead window, up to RA_MAX sectors; any other read turns
+   read-ahead off until reads are sequential again.  An opener
+   that advised sequential access gets the whole window from the
+   start, whatever the pattern; failing that, one that advised
+   random access gets none; see inode_count_pattern().  The state
+   is shared by all of INODE's openers and is only a hint, so
+   races on it are harmless. */
+static void
+read_ahead (struct inode *inode, off_t offset, off_t size) 
+{
+  off_t pos, end;
+
+  if (size == 0)
+    return;
+
+  if (inode->seq_cnt > 0) 
+    {
+      if (offset != inode->ra_next)
+        inode->ra_end = 0;
+      inode->ra_window = RA_MAX;
+    }
+  else if (inode->random_cnt > 0)
+    inode->ra_window = 0;
+  else if (offset == inode->ra_next) 
+    {
+      inode->ra_window = inode->ra_window == 0 ? RA_MIN : 2 * inode->ra_window;
+      if (inode->ra_window > RA_MAX)
+        inode->ra_window = RA_MAX;
+    }
+  else 
+    {
+      inode->ra_window = 0;
+      inode->ra_end = 0;
+    }
+  inode->ra_next = offset + size;
+  if (inode->ra_window == 0)
+    return;
+
+  /* The sector holding the end of this read is already cached, so
+     start at the next sector boundary, skipping any sectors that
+     are already queued. */
+  end = inode->ra_next + inode->ra_window * BLOCK_SECTOR_SIZE;
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  pos = ROUND_UP (inode->ra_next, BLOCK_SECTOR_SIZE);
+  if (pos < inode->ra_end)
+    pos = inode->ra_end;
+  for (; pos < end; pos += BLOCK_SECTOR_SIZE) 
+    {
+      block_sector_t sector = byte_to_sector (inode, pos);
+      if (sector != 0)
+        cache_prefetch (sector);
+    }
+  inode->ra_end = pos;
+}
+
+/* A sector of zeros, which holes read as and inode_get_ro()
+   lends out for them. */
+static const uint8_t zero_sector[BLOCK_SECTOR_SIZE];
+
+/* Does the work of read_at() for a file of the scratch archive.
+   Nothing is cached: whole sectors bound for kernel memory are
+   read straight into BUFFER, in one request for as many as there
+   are, and the rest go through a bounce buffer. */
+static off_t
+read_archived (struct inode *inode, uint8_t *buffer, off_t size,
+               off_t offset, bool user) 
+{
+  uint8_t *bounce = NULL;
+  off_t bytes_read = 0;
+
+  if (offset >= inode->data.length)
+    return 0;
+  if (size > inode->data.length - offset)
+    size = inode->data.length - offset;
+
+  while (bytes_read < size) 
+    {
+      block_sector_t sector = (inode->archive_start
+                               + offset / BLOCK_SECTOR_SIZE);
+      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      off_t chunk_size = size - bytes_read;
+
+      if (!user && sector_ofs == 0 && chunk_size >= BLOCK_SECTOR_SIZE) 
+        {
+          size_t cnt = chunk_size / BLOCK_SECTOR_SIZE;
+
+          block_read_multiple (inode->archive, sector, cnt,
+                               buffer + bytes_read);
+          chunk_size = cnt * BLOCK_SECTOR_SIZE;
+        }
+      else 
+        {
+          if (chunk_size > BLOCK_SECTOR_SIZE - sector_ofs)
+            chunk_size = BLOCK_SECTOR_SIZE - sector_ofs;
+          if (bounce == NULL)
+            {
+              bounce = kmem_cache_alloc (bounce_cache);
+              if (bounce == NULL)
+                break;
+            }
+          block_read (inode->archive, sector, bounce);
+          if (!copy_maybe_user (buffer + bytes_read, bounce + sector_ofs,
+                                chunk_size, user)) 
+            {
+              bytes_read = -1;
+              break;
+            }
+        }
+      offset += chunk_size;
+      bytes_read += chunk_size;
+    }
+
+  if (bounce != NULL)
+    kmem_cache_free (bounce_cache, bounce);
+  return bytes_read;
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position
+   OFFSET, as inode_read_at(), with BUFFER a user buffer if USER
+   is true.  Returns -1 if copying to a user buffer faults. */
+static off_t
+read_at (struct inode *inode, void *buffer_, off_t size, off_t offset,
+         bool user) 
+{
+  uint8_t *buffer = buffer_;
+  off_t bytes_read = 0;
+  bool ok = true;
+
+  if (is_archived (inode))
+    return read_archived (inode, buffer, size, offset, user);
+  if (in_memory ()) 
+    {
+      rw_read_acquire (&inode->map_lock);
+      if (offset < inode->data.length)
+        {
+          bytes_read = inode->data.length - offset;
+          if (bytes_read > size)
+            bytes_read = size;
+          ok = memfile_read (&inode->mem, buffer, bytes_read, offset, user);
+        }
+      rw_read_release (&inode->map_lock);
+      return ok ? bytes_read : -1;
+    }
+
+  if (is_inline (&inode->data)) 
+    {
+      rw_read_acquire (&inode->map_lock);
+      if (is_inline (&inode->data)) 
+        {
+          if (offset < inode->data.length)
+            {
+              bytes_read = inode->data.length - offset;
+              if (bytes_read > size)
+                bytes_read = size;
+              ok = copy_maybe_user (buffer,
+                                    inline_data (&inode->data) + offset,
+                                    bytes_read, user);
+            }
+          rw_read_release (&inode->map_lock);
+          return ok ? bytes_read : -1;
+        }
+      rw_read_release (&inode->map_lock);
+    }
+
+  while (size > 0) 
+    {
+      /* Disk sector to read, starting byte offset within sector. */
+      block_sector_t sector_idx;
+      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+
+      /* Bytes left in inode, bytes left in sector, lesser of the two. */
+      off_t inode_left = inode_length (inode) - offset;
+      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      int min_left = inode_left < sector_left ? inode_left : sector_left;
+
+      /* Number of bytes to actually copy out of this sector. */
+      int chunk_size = size < min_left ? size : min_left;
+      if (chunk_size <= 0)
+        break;
+
+      /* Hold map_lock while reading, so that inode_defrag()
+         cannot move the sector meanwhile. */
+      rw_read_acquire (&inode->map_lock);
+      sector_idx = lookup_sector (&inode->data, offset / BLOCK_SECTOR_SIZE);
+      if (sector_idx != 0 && inode->meta)
+        cache_mark_meta (sector_idx);
+      if (sector_idx == 0)
+        ok = copy_maybe_user (buffer + bytes_read, zero_sector, chunk_size,
+                              user);
+      else if (user)
+        ok = cache_read_at_user (sector_idx, buffer + bytes_read,
+                                 sector_ofs, chunk_size);
+      else
+        cache_read_at (sector_idx, buffer + bytes_read, sector_ofs,
+                       chunk_size);
+      rw_read_release (&inode->map_lock);
+      if (!ok)
+        return -1;
+      
+      /* Advance. */
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_read += chunk_size;
+    }
+  read_ahead (inode, offset - bytes_read, bytes_read);
+
+  return bytes_read;
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+   Returns the number of bytes actually read, which may be less
+   than SIZE if an error occurs or end of file is reached. */
+off_t
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) 
+{
+  return read_at (inode, buffer, size, offset, false);
+}
+
+/* Reads SIZE bytes from INODE into user buffer BUFFER, starting
+   at position OFFSET, copying each cached sector straight to user
+   memory.  BUFFER must lie in user memory (see
+   userprog/uaccess.h).  Returns the number of bytes read, as
+   inode_read_at(), or -1 if BUFFER is not mapped and
+   writable. */
+off_t
+inode_read_at_user (struct inode *inode, void *buffer, off_t size,
+                    off_t offset) 
+{
+  return read_at (inode, buffer, size, offset, true);
+}
+
+/* Moves INODE's inline data out to a data sector, for it to grow
+   past INLINE_MAX.  The caller must hold INODE's map_lock for
+   writing.  Returns true if successful, false if the disk is
+   full. */
+static bool
+move_out_of_line (struct inode *inode) 
+{
+  struct inode_disk *disk_inode = &inode->data;
+  uint8_t *data = kmem_cache_zalloc (bounce_cache);
+  off_t length = disk_inode->length;
+  bool success = false;
+
+  ASSERT (is_inline (disk_inode));
+  if (data == NULL)
+    return false;
+
+  memcpy (data, inline_data (disk_inode), length);
+  memset (inline_data (disk_inode), 0, INLINE_MAX);
+  disk_inode->magic = INODE_MAGIC;
+  disk_inode->next_alloc = inode->sector + 1;
+  if (reserve (disk_inode, length)
+      && (length == 0 || allocate_sector (disk_inode, 0))) 
+    {
+      if (length > 0)
+        cache_write (lookup_sector (disk_inode, 0), data);
+      cache_write (inode->sector, disk_inode);
+      success = true;
+    }
+  else 
+    {
+      /* Put the inline data back.  reserve() took nothing from
+         the free map, since the length fits in one sector. */
+      memset (inline_data (disk_inode), 0, INLINE_MAX);
+      disk_inode->magic = INODE_INLINE_MAGIC;
+      memcpy (inline_data (disk_inode), data, length);
+    }
+  kmem_cache_free (bounce_cache, data);
+  return success;
+}
+
+/* Writes SIZE bytes from BUFFER, a user buffer if USER is true,
+   to SECTOR at offset OFS through the cache, as cache_write_new()
+   if NEW is true and otherwise as cache_write_at().  Returns
+   false if copying from a user buffer faults. */
+static bool
+write_sector (block_sector_t sector, const void *buffer, int ofs, int size,
+              bool new, bool user) 
+{
+  if (user)
+    return (new ? cache_write_new_user (sector, buffer, ofs, size)
+            : cache_write_at_user (sector, buffer, ofs, size));
+  if (new)
+    cache_write_new (sector, buffer, ofs, size);
+  else
+    cache_write_at (sector, buffer, ofs, size);
+  return true;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   A write past end of file extends the inode, leaving any gap as
+   a hole.  Sectors are allocated as they are written, so the
+   file's layout on disk follows the order in which it is
+   written, not the size it was created with, unless
+   inode_allocate() set them aside beforehand.  Returns the number
+   of bytes actually written, which may be less than SIZE if the
+   disk fills up.
+
+   Writes within the file run concurrently, taking map_lock only
+   to allocate a sector in a hole.  Writes past end of file are
+   serialized by grow_lock, and publish the new length only after
+   the data is in place, so a reader sees either the old length
+   or the new data.
+
+   BUFFER is a user buffer if USER is true.  Returns -1 if
+   copying from a user buffer faults. */
+static off_t
+write_at (struct inode *inode, const void *buffer_, off_t size,
+          off_t offset, bool user) 
+{
+  const uint8_t *buffer = buffer_;
+  off_t bytes_written = 0;
+  off_t end;                    /* End of the space available. */
+  bool growing = false;
+  bool allocated = false;       /* Allocated a sector? */
+  bool ok = true;               /* No user access has faulted? */
+
+  if (inode->deny_write_cnt || is_archived (inode))
+    return 0;
+  if (inode->exec_data != NULL)
+    drop_exec_data (inode);
+
+  if (in_memory ()) 
+    {
+      rw_write_acquire (&inode->map_lock);
+      bytes_written = memfile_write (&inode->mem, buffer, size, offset,
+                                     user);
+      if (bytes_written > 0 && offset + bytes_written > inode->data.length)
+        inode->data.length = offset + bytes_written;
+      rw_write_release (&inode->map_lock);
+      return bytes_written;
+    }
+
+  /* An inode only ever moves out of line, so if it looks out of
+     line it is.  Otherwise check again with the lock held. */
+  if (is_inline (&inode->data)) 
+    {
+      rw_write_acquire (&inode->map_lock);
+      if (is_inline (&inode->data) && offset + size <= INLINE_MAX) 
+        {
+          if (!copy_maybe_user (inline_data (&inode->data) + offset, buffer,
+                                size, user))
+            {
+              rw_write_release (&inode->map_lock);
+              return -1;
+            }
+          if (offset + size > inode->data.length)
+            inode->data.length = offset + size;
+          cache_write (inode->sector, &inode->data);
+          rw_write_release (&inode->map_lock);
+          return size;
+        }
+      if (is_inline (&inode->data) && !move_out_of_line (inode)) 
+        {
+          rw_write_release (&inode->map_lock);
+          return 0;
+        }
+      rw_write_release (&inode->map_lock);
+    }
+
+  end = inode_length (inode);
+  if (offset + size > end) 
+    {
+      lock_acquire (&inode->grow_lock);
+      end = inode_length (inode);
+      if (offset + size > end) 
+        {
+          growing = true;
+          rw_write_acquire (&inode->map_lock);
+          if (reserve (&inode->data, offset + size))
+            end = offset + size;
+          rw_write_release (&inode->map_lock);
+        }
+      else
+        lock_release (&inode->grow_lock);
+    }
+
+  while (size > 0) 
+    {
+      /* Sector to write, starting byte offset within sector. */
+      size_t idx = offset / BLOCK_SECTOR_SIZE;
+      block_sector_t sector_idx;
+      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+
+      /* Bytes left in inode, bytes left in sector, lesser of the two. */
+      off_t inode_left = end - offset;
+      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      int min_left = inode_left < sector_left ? inode_left : sector_left;
+
+      /* Number of bytes to actually write into this sector. */
+      int chunk_size = size < min_left ? size : min_left;
+      if (chunk_size <= 0)
+        break;
+
+      /* As in inode_read_at(), map_lock is held while writing. */
+      rw_read_acquire (&inode->map_lock);
+      sector_idx = lookup_sector (&inode->data, idx);
+      if (sector_idx != 0 && inode->meta)
+        cache_mark_meta (sector_idx);
+      if (sector_idx != 0)
+        ok = write_sector (sector_idx, buffer + bytes_written, sector_ofs,
+                           chunk_size, false, user);
+      rw_read_release (&inode->map_lock);
+      if (!ok)
+        break;
+      if (sector_idx == 0) 
+        {
+          /* Fill a hole.  The new sector gets its data without
+             being read or zeroed first, and with map_lock still
+             held, so that no one can read it before then.  The
+             inode sector is written once, after the loop. */
+          bool have_space = true;
+
+          rw_write_acquire (&inode->map_lock);
+          sector_idx = lookup_sector (&inode->data, idx);
+          if (sector_idx == 0) 
+            {
+              have_space = allocate_sector (&inode->data, idx);
+              if (have_space) 
+                {
+                  sector_idx = lookup_sector (&inode->data, idx);
+                  if (inode->meta)
+                    cache_mark_meta (sector_idx);
+                  ok = write_sector (sector_idx, buffer + bytes_written,
+                                     sector_ofs, chunk_size, true, user);
+                  allocated = true;
+                }
+            }
+          else
+            ok = write_sector (sector_idx, buffer + bytes_written,
+                               sector_ofs, chunk_size, false, user);
+          rw_write_release (&inode->map_lock);
+          if (!have_space || !ok)
+            break;
         }
 
       /* Advance. */
@@ -312,11 +1564,248 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
 
+  if (growing || allocated) 
+    {
+      rw_write_acquire (&inode->map_lock);
+      if (growing && bytes_written > 0 && offset > inode->data.length)
+        inode->data.length = offset;
+      cache_write (inode->sector, &inode->data);
+      rw_write_release (&inode->map_lock);
+      if (growing)
+        lock_release (&inode->grow_lock);
+    }
+
+  return ok ? bytes_written : -1;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   as described above write_at(). */
+off_t
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
+                off_t offset) 
+{
+  off_t bytes_written;
+
+  journal_begin ();
+  bytes_written = write_at (inode, buffer, size, offset, false);
+  journal_end ();
+  if (bytes_written != 0)
+    inode->version++;
+  return bytes_written;
+}
+
+/* Writes SIZE bytes from user buffer BUFFER into INODE, starting
+   at OFFSET, copying straight from user memory into each cached
+   sector.  BUFFER must lie in user memory (see
+   userprog/uaccess.h).  Returns the number of bytes written, as
+   inode_write_at(), or -1 if BUFFER is not mapped. */
+off_t
+inode_write_at_user (struct inode *inode, const void *buffer, off_t size,
+                     off_t offset) 
+{
+  off_t bytes_written;
+
+  journal_begin ();
+  bytes_written = write_at (inode, buffer, size, offset, true);
+  journal_end ();
+  if (bytes_written != 0)
+    inode->version++;
   return bytes_written;
 }
 
+/* Moves the CNT data sectors of DISK_INODE starting at IDX
+   between the disk and the sector buffers in BUFFERS, bypassing
+   the buffer cache, in one request per run of sectors that are
+   consecutive on disk: from disk into BUFFERS if WRITE is false,
+   and the other way if it is true.  Holes read as zeros, and
+   must not be written. */
+static void
+transfer_direct (const struct inode_disk *disk_inode, size_t idx,
+                 void *const buffers[], size_t cnt, bool write) 
+{
+  size_t i, run;
+
+  for (i = 0; i < cnt; i += run) 
+    {
+      block_sector_t sector = lookup_sector (disk_inode, idx + i);
+
+      run = 1;
+      if (sector == 0) 
+        {
+          ASSERT (!write);
+          memset (buffers[i], 0, BLOCK_SECTOR_SIZE);
+          continue;
+        }
+      while (i + run < cnt
+             && lookup_sector (disk_inode, idx + i + run) == sector + run)
+        run++;
+      if (write)
+        cache_write_direct (sector, run, (const void *const *) buffers + i);
+      else
+        cache_read_direct (sector, run, buffers + i);
+    }
+}
+
+/* Returns how many of the CNT sectors of INODE starting at byte
+   OFFSET lie wholly before its end, or 0 if INODE is inline.
+   INODE's map_lock must be held. */
+static size_t
+direct_sectors (const struct inode *inode, size_t cnt, off_t offset) 
+{
+  size_t n;
+
+  if (is_inline (&inode->data) || offset >= inode->data.length)
+    return 0;
+  n = (inode->data.length - offset) / BLOCK_SECTOR_SIZE;
+  return n < cnt ? n : cnt;
+}
+
+/* Reads CNT whole sectors of INODE, starting at OFFSET, which
+   must be a multiple of BLOCK_SECTOR_SIZE, into the sector
+   buffers in BUFFERS straight from disk, without passing them
+   through the buffer cache.  Only sectors that lie wholly before
+   end of file are read, and none of inline data or of a file
+   system in memory, so the caller should read any rest with
+   inode_read_at().  Returns the number of bytes read. */
+off_t
+inode_read_direct (struct inode *inode, void *const buffers[], size_t cnt,
+                   off_t offset) 
+{
+  size_t n;
+
+  ASSERT (offset % BLOCK_SECTOR_SIZE == 0);
+  if (is_archived (inode)) 
+    {
+      n = direct_sectors (inode, cnt, offset);
+      if (n > 0)
+        block_readv (inode->archive,
+                     inode->archive_start + offset / BLOCK_SECTOR_SIZE,
+                     buffers, n);
+      return n * BLOCK_SECTOR_SIZE;
+    }
+  if (in_memory ())
+    return 0;
+  rw_read_acquire (&inode->map_lock);
+  n = direct_sectors (inode, cnt, offset);
+  transfer_direct (&inode->data, offset / BLOCK_SECTOR_SIZE, buffers, n,
+                   false);
+  rw_read_release (&inode->map_lock);
+  return n * BLOCK_SECTOR_SIZE;
+}
+
+/* Writes the CNT whole sectors in BUFFERS into INODE, starting
+   at OFFSET, which must be a multiple of BLOCK_SECTOR_SIZE,
+   straight to disk, without passing them through the buffer
+   cache.  Only sectors that lie wholly before end of file are
+   written, and none of inline data or of a file system in
+   memory, so the caller should write any rest, and grow the
+   file, with inode_write_at().  Returns
+   the number of bytes written, which may be less if the disk
+   fills up.
+
+   map_lock is held across the transfer, for writing if a hole
+   had to be filled, so that no one reads a new sector before its
+   data is in place. */
+off_t
+inode_write_direct (struct inode *inode, const void *const buffers[],
+                    size_t cnt, off_t offset) 
+{
+  struct inode_disk *disk_inode = &inode->data;
+  size_t idx = offset / BLOCK_SECTOR_SIZE;
+  bool filled = false;
+  size_t n, i;
+
+  ASSERT (offset % BLOCK_SECTOR_SIZE == 0);
+  if (inode->deny_write_cnt || in_memory () || is_archived (inode))
+    return 0;
+  if (inode->exec_data != NULL)
+    drop_exec_data (inode);
+
+  journal_begin ();
+  rw_read_acquire (&inode->map_lock);
+  n = direct_sectors (inode, cnt, offset);
+  for (i = 0; i < n; i++)
+    if (lookup_sector (disk_inode, idx + i) == 0)
+      break;
+  if (i < n) 
+    {
+      /* The file only grows and never moves back inline, so N is
+         still good once the lock is upgraded. */
+      rw_read_release (&inode->map_lock);
+      rw_write_acquire (&inode->map_lock);
+      filled = true;
+      for (; i < n; i++)
+        if (lookup_sector (disk_inode, idx + i) == 0
+            && !allocate_sector (disk_inode, idx + i))
+          break;
+      n = i;
+    }
+  transfer_direct (disk_inode, idx, (void *const *) buffers, n, true);
+  if (filled) 
+    {
+      cache_write (inode->sector, disk_inode);
+      rw_write_release (&inode->map_lock);
+    }
+  else
+    rw_read_release (&inode->map_lock);
+  journal_end ();
+  if (n != 0)
+    inode->version++;
+  return n * BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the BLOCK_SECTOR_SIZE bytes of INODE's data in the
+   sector that holds byte offset OFS, for the caller to read in
+   place, or a null pointer if OFS is at or past end of file.
+   Bytes of the sector past end of file are not meaningful.  The
+   caller must return the data with inode_put_ro(), and must do
+   so before borrowing another sector; see cache_get_ro().
+   INODE's map_lock is held for reading meanwhile, so that the
+   sector stays put, and inline data is lent straight out of
+   INODE.  A sector of the scratch archive is read into a bounce
+   buffer, or a null pointer returned if memory is short. */
+const void *
+inode_get_ro (struct inode *inode, off_t ofs) 
+{
+  block_sector_t sector;
+
+  if (ofs >= inode_length (inode))
+    return NULL;
+  if (is_archived (inode)) 
+    {
+      void *bounce = kmem_cache_alloc (bounce_cache);
+      if (bounce != NULL)
+        block_read (inode->archive,
+                    inode->archive_start + ofs / BLOCK_SECTOR_SIZE, bounce);
+      return bounce;
+    }
+  rw_read_acquire (&inode->map_lock);
+  if (in_memory ())
+    return memfile_get (&inode->mem, ROUND_DOWN (ofs, BLOCK_SECTOR_SIZE));
+  if (is_inline (&inode->data))
+    return inline_data (&inode->data);
+  sector = lookup_sector (&inode->data, ofs / BLOCK_SECTOR_SIZE);
+  if (sector != 0 && inode->meta)
+    cache_mark_meta (sector);
+  return sector != 0 ? cache_get_ro (sector) : zero_sector;
+}
+
+/* Returns DATA, obtained from inode_get_ro() on INODE. */
+void
+inode_put_ro (struct inode *inode, const void *data) 
+{
+  if (is_archived (inode)) 
+    {
+      kmem_cache_free (bounce_cache, (void *) data);
+      return;
+    }
+  if (!in_memory () && data != inline_data (&inode->data)
+      && data != zero_sector)
+    cache_put (data);
+  rw_read_release (&inode->map_lock);
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -337,6 +1826,334 @@ inode_allow_write (struct inode *inode)
   inode->deny_write_cnt--;
 }
 
+/* Writes INODE's on-disk inode and data to disk, if they are
+   dirty in the buffer cache, and returns once they are written.
+   With a journal, the metadata is committed to the log instead,
+   after the data is written. */
+void
+inode_sync (struct inode *inode) 
+{
+  struct inode_disk *disk_inode = &inode->data;
+  size_t sector_cnt = bytes_to_sectors (disk_inode->length);
+  block_sector_t run_start = 0, index = 0;
+  size_t run_cnt = 0;
+  size_t idx;
+
+  if (in_memory () || is_archived (inode))
+    return;
+  cache_flush_range (inode->sector, 1);
+  if (is_inline (disk_inode)) 
+    {
+      journal_sync ();
+      return;
+    }
+#ifndef FS_EXTENTS
+  if (disk_inode->doubly_indirect != 0)
+    cache_flush_range (disk_inode->doubly_indirect, 1);
+#endif
+
+  /* Flush data sectors in runs of consecutive sectors, and each
+     index block along the way. */
+  for (idx = 0; idx < sector_cnt; idx++) 
+    {
+      block_sector_t sector, idx_block;
+
+      rw_read_acquire (&inode->map_lock);
+      sector = lookup_sector (disk_inode, idx);
+      idx_block = index_block (disk_inode, idx);
+      rw_read_release (&inode->map_lock);
+
+      if (sector == 0)
+        continue;
+
+      if (idx_block != index && idx_block != 0)
+        cache_flush_range (idx_block, 1);
+      index = idx_block;
+
+      if (run_cnt > 0 && sector == run_start + run_cnt)
+        run_cnt++;
+      else 
+        {
+          if (run_cnt > 0)
+            cache_flush_range (run_start, run_cnt);
+          run_start = sector;
+          run_cnt = 1;
+        }
+    }
+  if (run_cnt > 0)
+    cache_flush_range (run_start, run_cnt);
+  journal_sync ();
+}
+
+/* Returns the program loader's data cached on INODE by
+   inode_set_exec_data(), or a null pointer if there is none.
+   The data stays valid as long as the caller keeps writes to
+   INODE denied. */
+void *
+inode_get_exec_data (struct inode *inode) 
+{
+  void *data;
+
+  lock_acquire (&open_inodes_lock);
+  data = inode->exec_data;
+  lock_release (&open_inodes_lock);
+  return data;
+}
+
+/* Caches DATA, a block obtained from malloc(), on INODE for the
+   program loader, which parses an executable's headers once and
+   then reuses the result for every exec of the same file.  INODE
+   takes ownership of DATA and frees it when INODE is written or
+   freed.  If data is already cached, frees DATA instead.
+   Returns the data now cached. */
+void *
+inode_set_exec_data (struct inode *inode, void *data) 
+{
+  lock_acquire (&open_inodes_lock);
+  if (inode->exec_data == NULL)
+    inode->exec_data = data;
+  else
+    {
+      free (data);
+      data = inode->exec_data;
+    }
+  lock_release (&open_inodes_lock);
+  return data;
+}
+
+/* Frees the loader's data cached on INODE, which is about to
+   change. */
+static void
+drop_exec_data (struct inode *inode) 
+{
+  void *data;
+
+  lock_acquire (&open_inodes_lock);
+  data = inode->exec_data;
+  inode->exec_data = NULL;
+  lock_release (&open_inodes_lock);
+  free (data);
+}
+
+/* Returns the lock that guards the entries of directory INODE.
+   Lookups hold it for reading and changes hold it for writing,
+   so that lookups in one directory run in parallel. */
+struct rwlock *
+inode_dir_lock (struct inode *inode) 
+{
+  return &inode->dir_lock;
+}
+
+/* Adds SEQUENTIAL and RANDOM, each 1, -1 or 0, to INODE's counts
+   of openers that have advised sequential or random access,
+   which steer read_ahead(). */
+void
+inode_count_pattern (struct inode *inode, int sequential, int random) 
+{
+  lock_acquire (&open_inodes_lock);
+  inode->seq_cnt += sequential;
+  inode->random_cnt += random;
+  ASSERT (inode->seq_cnt >= 0 && inode->random_cnt >= 0);
+  lock_release (&open_inodes_lock);
+}
+
+/* Calls HINT for each sector of INODE's data that holds some of
+   bytes OFFSET through OFFSET + LENGTH.  Holes have no sectors,
+   and neither has inline data or a file system in memory. */
+static void
+hint_range (struct inode *inode, off_t offset, off_t length,
+            void (*hint) (block_sector_t)) 
+{
+  off_t pos, end;
+
+  rw_read_acquire (&inode->map_lock);
+  end = inode->data.length;
+  if (length < end - offset)
+    end = offset + length;
+  if (!in_memory () && !is_archived (inode) && !is_inline (&inode->data))
+    for (pos = ROUND_DOWN (offset, BLOCK_SECTOR_SIZE); pos < end;
+         pos += BLOCK_SECTOR_SIZE) 
+      {
+        block_sector_t sector = lookup_sector (&inode->data,
+                                               pos / BLOCK_SECTOR_SIZE);
+        if (sector != 0)
+          hint (sector);
+      }
+  rw_read_release (&inode->map_lock);
+}
+
+/* Asks for the sectors of INODE's bytes OFFSET through OFFSET +
+   LENGTH to be read into the buffer cache in the background,
+   because they will be read soon.  Returns without waiting.  As
+   much as the read-ahead queue holds is queued; the rest is left
+   to be read on demand. */
+void
+inode_prefetch (struct inode *inode, off_t offset, off_t length) 
+{
+  hint_range (inode, offset, length, cache_prefetch);
+}
+
+/* Tells the buffer cache that the sectors of INODE's bytes
+   OFFSET through OFFSET + LENGTH will not be read again soon, so
+   that it reuses their entries first; see cache_demote(). */
+void
+inode_demote (struct inode *inode, off_t offset, off_t length) 
+{
+  hint_range (inode, offset, length, cache_demote);
+}
+
+/* Marks INODE's data, such as a directory's entries or the free
+   map, as file system metadata, so that the buffer cache
+   protects its sectors from eviction. */
+void
+inode_set_meta (struct inode *inode) 
+{
+  inode->meta = true;
+}
+
+/* Moves INODE's data into one run of consecutive sectors if it
+   is scattered over several, so that reading it sequentially does
+   not seek.  Leaves alone a file with holes, one kept inline, and
+   one of more than DEFRAG_MAX sectors, which would hold up other
+   access to the file for too long.  Returns true if INODE's data
+   was moved, false if it was not or if no run of free sectors is
+   long enough.
+
+   The data is copied and the map switched over with grow_lock
+   and map_lock held, which shuts out every reader and writer of
+   INODE, since they hold map_lock while touching a data
+   sector.  With a journal, the copy is written to disk before the
+   switch, which is committed as metadata, so that a crash leaves
+   the file either in its old place or in its new one. */
+bool
+inode_defrag (struct inode *inode) 
+{
+  struct inode_disk *disk_inode = &inode->data;
+  block_sector_t start, prev = 0;
+  size_t cnt, runs = 0;
+  bool moved = false;
+  uint8_t *buffer;
+  size_t idx;
+
+  if (in_memory () || is_archived (inode))
+    return false;
+  buffer = kmem_cache_alloc (bounce_cache);
+  if (buffer == NULL)
+    return false;
+  journal_begin ();
+  lock_acquire (&inode->grow_lock);
+  rw_write_acquire (&inode->map_lock);
+
+  cnt = bytes_to_sectors (disk_inode->length);
+  if (is_inline (disk_inode) || inode->removed || cnt > DEFRAG_MAX)
+    goto done;
+  for (idx = 0; idx < cnt; idx++) 
+    {
+      block_sector_t sector = lookup_sector (disk_inode, idx);
+      if (sector == 0)
+        goto done;
+      if (idx == 0 || sector != prev + 1)
+        runs++;
+      prev = sector;
+    }
+  if (runs <= 1 || !free_map_allocate (cnt, &start))
+    goto done;
+
+  for (idx = 0; idx < cnt; idx++) 
+    {
+      cache_read (lookup_sector (disk_inode, idx), buffer);
+      cache_write (start + idx, buffer);
+    }
+  if (journal_enabled ())
+    cache_flush_range (start, cnt);
+  relocate (disk_inode, start, cnt);
+  disk_inode->next_alloc = start + cnt;
+  cache_write (inode->sector, disk_inode);
+  moved = true;
+
+ done:
+  rw_write_release (&inode->map_lock);
+  lock_release (&inode->grow_lock);
+  journal_end ();
+  kmem_cache_free (bounce_cache, buffer);
+  return moved;
+}
+
+/* Sets aside disk space for bytes OFFSET through OFFSET + LENGTH
+   of INODE, and extends INODE to OFFSET + LENGTH bytes if it is
+   shorter, as posix_fallocate() does.  Each hole in the range
+   gets the longest runs of contiguous sectors that the free map
+   can find, marked UNWRITTEN: they still read as zeros without
+   being zeroed on disk, and writing them later takes nothing
+   from the allocator.  Sectors already written are left alone.
+   Returns true if successful, false if writes to INODE are
+   denied or the disk, or INODE's extents, fill up first, in
+   which case the space set aside by then is kept but INODE's
+   length is not changed. */
+bool
+inode_allocate (struct inode *inode, off_t offset, off_t length) 
+{
+  struct inode_disk *disk_inode = &inode->data;
+  off_t end = offset + length;
+  size_t idx, last;
+  bool success = false;
+
+  if (inode->deny_write_cnt || is_archived (inode)
+      || offset < 0 || length <= 0 || end < offset)
+    return false;
+  if (in_memory ()) 
+    {
+      rw_write_acquire (&inode->map_lock);
+      success = memfile_reserve (&inode->mem, offset, length);
+      if (success && end > disk_inode->length)
+        disk_inode->length = end;
+      rw_write_release (&inode->map_lock);
+      return success;
+    }
+
+  journal_begin ();
+  lock_acquire (&inode->grow_lock);
+  rw_write_acquire (&inode->map_lock);
+  if (is_inline (disk_inode) && end > INLINE_MAX
+      && !move_out_of_line (inode))
+    goto done;
+  if (!is_inline (disk_inode)) 
+    {
+      if (!reserve (disk_inode, end))
+        goto done;
+      last = bytes_to_sectors (end);
+      for (idx = offset / BLOCK_SECTOR_SIZE; idx < last; ) 
+        {
+          size_t cnt = hole_run (disk_inode, idx, last - idx);
+          block_sector_t start;
+
+          if (cnt == 0) 
+            {
+              idx++;
+              continue;
+            }
+          while (cnt > 1 && !free_map_allocate (cnt, &start))
+            cnt /= 2;
+          if (cnt == 1 && !allocate (disk_inode, &start, false))
+            goto done;
+          if (!place_run (disk_inode, idx, cnt, start))
+            goto done;
+          disk_inode->next_alloc = start + cnt;
+          idx += cnt;
+        }
+    }
+  if (end > disk_inode->length)
+    disk_inode->length = end;
+  success = true;
+
+ done:
+  cache_write (inode->sector, disk_inode);
+  rw_write_release (&inode->map_lock);
+  lock_release (&inode->grow_lock);
+  journal_end ();
+  return success;
+}
+
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode)
@@ -6,18 +6,41 @@
 #include "devices/block.h"
 
 struct bitmap;
+struct rwlock;
 
 void inode_init (void);
 bool inode_create (block_sector_t, off_t);
 struct inode *inode_open (block_sector_t);
+struct inode *inode_open_archive (struct block *, block_sector_t start,
+                                  off_t length);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
+unsigned inode_get_version (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+off_t inode_read_at_user (struct inode *, void *, off_t size, off_t offset);
+off_t inode_write_at_user (struct inode *, const void *, off_t size,
+                           off_t offset);
+off_t inode_read_direct (struct inode *, void *const buffers[], size_t cnt,
+                         off_t offset);
+off_t inode_write_direct (struct inode *, const void *const buffers[],
+                          size_t cnt, off_t offset);
+const void *inode_get_ro (struct inode *, off_t offset);
+void inode_put_ro (struct inode *, const void *);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+void inode_sync (struct inode *);
+bool inode_defrag (struct inode *);
+bool inode_allocate (struct inode *, off_t offset, off_t length);
+struct rwlock *inode_dir_lock (struct inode *);
+void inode_set_meta (struct inode *);
+void inode_count_pattern (struct inode *, int sequential, int random);
+void inode_prefetch (struct inode *, off_t offset, off_t length);
+void inode_demote (struct inode *, off_t offset, off_t length);
+void *inode_get_exec_data (struct inode *);
+void *inode_set_exec_data (struct inode *, void *);
 
 #endif /* filesys/inode.h */
@@ -0,0 +1,757 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <flatmap.h>
+#include <hash.h>
+#include <random.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/rtc.h"
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Write-ahead journal of file system metadata.
+
+   A file system formatted with a journal keeps, after the header
+   in JOURNAL_SECTOR, a circular log of LOG_SIZE sectors.  Changes
+   to sectors that the buffer cache holds as metadata (see
+   cache_mark_meta()) do not go to their home locations on disk
+   until the log has a copy of them: the cache keeps such entries
+   dirty, and off limits to write-back and eviction, until the
+   journal has committed them.
+
+   Every operation that changes metadata runs between
+   journal_begin() and journal_end(), and all operations of one
+   commit interval form one transaction.  The committer thread
+   commits every COMMIT_TICKS, or sooner if a transaction grows
+   past TXN_SOFT_MAX sectors: it waits for the operations under
+   way to end, holds off new ones while it writes the free map
+   into the cache and copies every changed metadata sector, then
+   lets them go on and writes the copies to the log in one
+   request.  Many operations from many threads thus cost one
+   synchronous write, and no metadata write has to wait for
+   another to reach the disk first.  Checkpointing is left to the
+   cache's flusher, which writes committed sectors home in the
+   background like any other dirty sector; log space is reclaimed
+   once every sector of a transaction has gone home or been
+   logged again by a later one.
+
+   A transaction is a descriptor sector, the images of its
+   sectors, and the sectors it revokes.  The descriptor's checksum
+   covers the lot, so a torn write reads as no transaction at all.
+   A metadata sector that is freed while the log still has an
+   image of it is revoked, so that replaying the old image cannot
+   overwrite whatever the sector holds after it is reused for file
+   data.  At mount, journal_open() replays every intact
+   transaction from the header's start onward, skipping revoked
+   images, which brings the metadata to its state as of the last
+   commit.
+
+   Sectors released in one transaction stay allocated in memory
+   until it is in the log (see free_map_freeze()), so that none is
+   reused, and overwritten, while committed metadata may still
+   point to it.  A crash in between leaks them.
+
+   Only metadata is journaled.  File data reaches its sectors on
+   the flusher's schedule, so after a crash a file may show old
+   contents in sectors written just before it, but the directory
+   tree and the free map are consistent.  An open file that had
+   been removed keeps its sectors allocated after a crash.
+
+   Operations must begin their handle before taking any file
+   system lock, since a handle that begins may wait for a commit,
+   and the commit for every handle already open to end.
+
+   Lock order is commit_lock, then the buffer cache's and the free
+   map's locks, then journal_lock, which the cache takes from
+   under its own. */
+
+/* JOURNAL_SECTOR's magic number, in a file system with a journal. */
+#define JOURNAL_MAGIC 0x4c4e524a
+
+/* A transaction descriptor's magic number. */
+#define DESC_MAGIC 0x4353444a
+
+/* Size of the log, in sectors. */
+#define LOG_SIZE 256
+
+/* Timer ticks between commits. */
+#define COMMIT_TICKS TIMER_FREQ
+
+/* Sectors changed in a transaction beyond which new operations
+   wait for it to commit, so that changed metadata, which cannot
+   be evicted, leaves most of the cache free. */
+#define TXN_SOFT_MAX (CACHE_CNT / 4)
+
+/* Revoked sectors per sector of a transaction. */
+#define REVOKES_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* Most sectors one transaction revokes.  Only sectors that have
+   images in the log are revoked, so this cannot run out. */
+#define REVOKE_MAX (2 * LOG_SIZE)
+
+/* Largest transaction, in sectors.  The log holds at least three,
+   so that a commit always finds room once everything committed
+   before the previous one has gone home. */
+#define TXN_MAX (1 + CACHE_CNT + REVOKE_MAX / REVOKES_PER_SECTOR)
+
+/* Most transactions in the log at once, each of which takes at
+   least 2 sectors. */
+#define TXN_CNT (LOG_SIZE / 2)
+
+/* On-disk journal header, in JOURNAL_SECTOR.  Must be exactly
+   BLOCK_SECTOR_SIZE bytes long. */
+struct journal_header
+  {
+    uint32_t magic;                     /* JOURNAL_MAGIC, or 0. */
+    uint32_t id;                        /* Tags this log's descriptors. */
+    block_sector_t start;               /* First sector of the log. */
+    uint32_t size;                      /* Sectors in the log. */
+    uint32_t seq;                       /* First transaction to replay. */
+    uint32_t ofs;                       /* Its offset in the log. */
+    uint8_t unused[488];                /* Not used. */
+  };
+
+/* Transaction descriptor, the first sector of a transaction.  The
+   images follow it in the order of SECTORS, then the revoked
+   sectors, REVOKES_PER_SECTOR to a sector.  Must be exactly
+   BLOCK_SECTOR_SIZE bytes long. */
+struct journal_desc
+  {
+    uint32_t magic;                     /* DESC_MAGIC. */
+    uint32_t id;                        /* The header's id. */
+    uint32_t seq;                       /* Sequence number. */
+    uint32_t image_cnt;                 /* Number of images. */
+    uint32_t revoke_cnt;                /* Number of revoked sectors. */
+    uint32_t checksum;                  /* See checksum(). */
+    block_sector_t sectors[CACHE_CNT];  /* Home sectors of the images. */
+    uint8_t unused[232];                /* Not used. */
+  };
+
+/* A committed transaction still in the log. */
+struct txn
+  {
+    uint32_t ofs;                       /* Offset in the log. */
+    uint32_t len;                       /* Sectors. */
+    size_t pending;                     /* Images not yet home or relogged. */
+  };
+
+/* What the committer is doing, as far as handles care. */
+enum commit_state
+  {
+    OPEN,                               /* Nothing: handles may begin. */
+    DRAINING,                           /* Waiting for handles to end. */
+    FROZEN                              /* Copying the transaction. */
+  };
+
+/* Protected by commit_lock, which serializes commits. */
+static struct lock commit_lock;
+static uint8_t *txn_buf;                /* TXN_MAX sectors. */
+static unsigned old_seqs[CACHE_CNT];    /* From cache_journal_snapshot(). */
+
+/* Protected by journal_lock. */
+static struct lock journal_lock;
+static struct condition handles_done;   /* ACTIVE reached 0. */
+static struct condition commit_done;    /* STATE went back to OPEN. */
+static struct condition commit_wanted;  /* Wakes the committer early. */
+static enum commit_state state;
+static int active;                      /* Handles open. */
+static size_t txn_sectors;              /* Sectors changed since last copy. */
+static unsigned running_seq;            /* Transaction being built. */
+static unsigned durable_seq;            /* Last one written to the log. */
+static uint32_t head_ofs;               /* Where the log ends. */
+static struct journal_header header;    /* As last written to disk. */
+static struct txn txns[TXN_CNT];        /* By sequence number. */
+static struct flatmap logged;           /* Sector -> last seq logging it. */
+
+/* Sectors revoked by the transaction being built, and by the one
+   being committed, one list each, swapped at each commit. */
+static block_sector_t revoke_lists[2][REVOKE_MAX];
+static block_sector_t *revokes = revoke_lists[0];
+static size_t revoke_cnt;
+
+/* True while the journal is in use.  Changes only at mount and
+   unmount, when there is no other file system activity. */
+static bool enabled;
+
+/* Statistics. */
+static long long commit_cnt, logged_cnt, revoked_cnt, checkpoint_cnt;
+static long long replayed_cnt;
+
+static thread_func committer;
+
+/* Returns the checksum of descriptor D and the CNT sectors that
+   follow it at DATA. */
+static uint32_t
+checksum (const struct journal_desc *d, const uint8_t *data, size_t cnt)
+{
+  struct journal_desc copy = *d;
+  uint32_t sum;
+  size_t i;
+
+  copy.checksum = 0;
+  sum = hash_bytes (&copy, sizeof copy);
+  for (i = 0; i < cnt; i++)
+    sum = sum * 31 + hash_bytes (data + i * BLOCK_SECTOR_SIZE,
+                                 BLOCK_SECTOR_SIZE);
+  return sum;
+}
+
+/* Writes HEADER to disk. */
+static void
+write_header (void)
+{
+  block_write (fs_device, JOURNAL_SECTOR, &header);
+}
+
+/* Sets up the journal of a file system being formatted, if
+   WANTED, or records that it has none.  The free map must be
+   open. */
+void
+journal_format (bool wanted)
+{
+  block_sector_t start;
+
+  ASSERT (sizeof header == BLOCK_SECTOR_SIZE);
+  memset (&header, 0, sizeof header);
+  if (wanted && !free_map_allocate (LOG_SIZE, &start))
+    {
+      printf ("journal: no room for the log, formatting without one\n");
+      wanted = false;
+    }
+  if (wanted)
+    {
+      /* A fresh id keeps descriptors left in the log's sectors
+         by an earlier file system from being mistaken for
+         ours. */
+      header.magic = JOURNAL_MAGIC;
+      header.id = random_ulong () ^ rtc_get_time ();
+      header.start = start;
+      header.size = LOG_SIZE;
+      header.seq = 1;
+      header.ofs = 0;
+    }
+  write_header ();
+}
+
+/* Reads the transaction numbered SEQ, which should be at offset
+   *OFS in the log or, if it did not fit there, at offset 0, into
+   txn_buf.  Returns true and sets *OFS to where it was if it is
+   intact, false if there is no such transaction. */
+static bool
+read_txn (unsigned seq, uint32_t *ofs)
+{
+  const struct journal_desc *d = (const struct journal_desc *) txn_buf;
+  int try;
+
+  for (try = 0; try < 2; try++)
+    {
+      uint32_t at = try == 0 ? *ofs : 0;
+      size_t len;
+
+      if (try == 1 && *ofs == 0)
+        break;
+      if (at >= header.size)
+        continue;
+      block_read (fs_device, header.start + at, txn_buf);
+      if (d->magic != DESC_MAGIC || d->id != header.id || d->seq != seq
+          || d->image_cnt > CACHE_CNT || d->revoke_cnt > REVOKE_MAX)
+        continue;
+      len = 1 + d->image_cnt + DIV_ROUND_UP (d->revoke_cnt,
+                                             REVOKES_PER_SECTOR);
+      if (at + len > header.size)
+        continue;
+      block_read_multiple (fs_device, header.start + at + 1, len - 1,
+                           txn_buf + BLOCK_SECTOR_SIZE);
+      if (d->checksum != checksum (d, txn_buf + BLOCK_SECTOR_SIZE, len - 1))
+        continue;
+      *ofs = at;
+      return true;
+    }
+  return false;
+}
+
+/* Returns the length in sectors of the transaction in txn_buf. */
+static uint32_t
+txn_len (void)
+{
+  const struct journal_desc *d = (const struct journal_desc *) txn_buf;
+  return 1 + d->image_cnt + DIV_ROUND_UP (d->revoke_cnt, REVOKES_PER_SECTOR);
+}
+
+/* Returns the sectors revoked by the transaction in txn_buf. */
+static const block_sector_t *
+txn_revokes (void)
+{
+  const struct journal_desc *d = (const struct journal_desc *) txn_buf;
+  return (const block_sector_t *) (txn_buf
+                                   + (1 + d->image_cnt) * BLOCK_SECTOR_SIZE);
+}
+
+/* Replays the intact transactions in the log, writing their
+   images home through the buffer cache, and empties the log.
+   Makes two passes: the first finds the transactions and what
+   they revoke, and the second writes each image that no later
+   transaction revokes.
+
+   Sequence numbers then skip ahead past any transaction that a
+   crash may have left in the log beyond the first torn one, so
+   that none of those can pass for a new one. */
+static void
+recover (void)
+{
+  const struct journal_desc *d = (const struct journal_desc *) txn_buf;
+  static uint32_t ofs_of[TXN_CNT];
+  struct flatmap revoked;               /* Sector -> last revoking seq. */
+  unsigned seq = header.seq;
+  uint32_t ofs = header.ofs;
+  size_t cnt, i, j;
+
+  if (!flatmap_init (&revoked, 64))
+    PANIC ("journal: out of memory");
+  for (cnt = 0; cnt < TXN_CNT && read_txn (seq, &ofs); cnt++)
+    {
+      const block_sector_t *r = txn_revokes ();
+
+      for (i = 0; i < d->revoke_cnt; i++)
+        if (!flatmap_insert (&revoked, r[i], (void *) (uintptr_t) seq))
+          PANIC ("journal: out of memory");
+      ofs_of[cnt] = ofs;
+      ofs += txn_len ();
+      seq++;
+    }
+
+  for (i = 0; i < cnt; i++)
+    {
+      unsigned txn_seq = header.seq + i;
+
+      if (!read_txn (txn_seq, &ofs_of[i]))
+        PANIC ("journal: transaction %u changed during recovery", txn_seq);
+      for (j = 0; j < d->image_cnt; j++)
+        {
+          uintptr_t r = (uintptr_t) flatmap_find (&revoked, d->sectors[j]);
+          if (r <= txn_seq)
+            cache_write (d->sectors[j],
+                         txn_buf + (1 + j) * BLOCK_SECTOR_SIZE);
+        }
+    }
+  flatmap_destroy (&revoked);
+
+  if (cnt > 0)
+    {
+      cache_flush ();
+      replayed_cnt = cnt;
+      printf ("journal: replayed %zu transactions\n", cnt);
+    }
+  header.seq = seq + TXN_CNT;
+  header.ofs = ofs < header.size ? ofs : 0;
+  write_header ();
+}
+
+/* Opens the journal of the file system, if it has one, replaying
+   whatever the log holds and starting the committer.  Must be
+   called before anything else reads the file system. */
+void
+journal_open (void)
+{
+  block_read (fs_device, JOURNAL_SECTOR, &header);
+  if (header.magic != JOURNAL_MAGIC)
+    return;
+  if (header.size < 3 * TXN_MAX || header.ofs >= header.size
+      || header.start + header.size > block_size (fs_device))
+    PANIC ("journal: bad header");
+
+  txn_buf = palloc_get_multiple (PAL_ASSERT,
+                                 DIV_ROUND_UP (TXN_MAX * BLOCK_SECTOR_SIZE,
+                                               PGSIZE));
+  if (!flatmap_init (&logged, 2 * LOG_SIZE))
+    PANIC ("journal: out of memory");
+  lock_init (&commit_lock);
+  lock_init (&journal_lock);
+  cond_init (&handles_done);
+  cond_init (&commit_done);
+  cond_init (&commit_wanted);
+
+  recover ();
+  running_seq = header.seq;
+  durable_seq = header.seq - 1;
+  head_ofs = header.ofs;
+  enabled = true;
+  thread_create ("journal", PRI_DEFAULT, committer, NULL);
+}
+
+/* Returns true if the file system is journaled. */
+bool
+journal_enabled (void)
+{
+  return enabled;
+}
+
+/* Opens a handle for an operation that changes metadata, so that
+   its changes commit together.  Handles nest.  Waits while a
+   commit is under way, or if the transaction has grown too
+   large.  Must be called before taking any file system lock. */
+void
+journal_begin (void)
+{
+  struct thread *t = thread_current ();
+
+  if (!enabled || t->journal_depth++ > 0)
+    return;
+  lock_acquire (&journal_lock);
+  while (state != OPEN || txn_sectors >= TXN_SOFT_MAX)
+    {
+      if (txn_sectors >= TXN_SOFT_MAX)
+        cond_signal (&commit_wanted, &journal_lock);
+      cond_wait (&commit_done, &journal_lock);
+    }
+  active++;
+  lock_release (&journal_lock);
+}
+
+/* Closes the handle opened by the matching journal_begin().  Does
+   not wait for the operation to commit. */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+
+  if (t->journal_depth == 0 || --t->journal_depth > 0)
+    return;
+  lock_acquire (&journal_lock);
+  if (--active == 0 && state != OPEN)
+    cond_signal (&handles_done, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Returns true if the log has room for LEN sectors, and stores
+   where into *OFS.  journal_lock must be held. */
+static bool
+find_space (uint32_t len, uint32_t *ofs)
+{
+  uint32_t tail = header.ofs;
+
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+  if (header.seq == durable_seq + 1)
+    {
+      /* Empty. */
+      *ofs = head_ofs + len <= header.size ? head_ofs : 0;
+      return true;
+    }
+  if (head_ofs > tail)
+    {
+      *ofs = head_ofs + len <= header.size ? head_ofs : 0;
+      return *ofs == head_ofs || len <= tail;
+    }
+  *ofs = head_ofs;
+  return head_ofs + len <= tail;
+}
+
+/* Moves the start of the log past the transactions whose images
+   have all gone home, writing the header if it moved.  Returns
+   true if it did.  commit_lock must be held. */
+static bool
+reclaim (void)
+{
+  struct journal_header h;
+  unsigned seq;
+
+  ASSERT (lock_held_by_current_thread (&commit_lock));
+
+  lock_acquire (&journal_lock);
+  for (seq = header.seq;
+       seq <= durable_seq && txns[seq % TXN_CNT].pending == 0; seq++)
+    continue;
+  h = header;
+  h.seq = seq;
+  h.ofs = seq <= durable_seq ? txns[seq % TXN_CNT].ofs : head_ofs;
+  lock_release (&journal_lock);
+  if (h.seq == header.seq)
+    return false;
+
+  block_write (fs_device, JOURNAL_SECTOR, &h);
+
+  lock_acquire (&journal_lock);
+  header = h;
+  for (;;)
+    {
+      /* Forget the sectors whose last image is no longer in the
+         log, a batch at a time, since the map cannot change while
+         it is walked. */
+      block_sector_t stale[64];
+      struct flatmap_slot *s;
+      size_t cnt = 0, i;
+
+      for (s = flatmap_first (&logged); s != NULL && cnt < 64;
+           s = flatmap_next (&logged, s))
+        if ((uintptr_t) s->value < header.seq)
+          stale[cnt++] = s->key;
+      for (i = 0; i < cnt; i++)
+        flatmap_remove (&logged, stale[i]);
+      if (cnt < 64)
+        break;
+    }
+  lock_release (&journal_lock);
+  return true;
+}
+
+/* Finds room in the log for LEN sectors and stores where into
+   *OFS, first reclaiming space and then, if that is not enough,
+   writing every committed sector home.  commit_lock must be
+   held. */
+static void
+reserve (uint32_t len, uint32_t *ofs)
+{
+  int pass;
+
+  for (pass = 0; ; pass++)
+    {
+      bool ok;
+
+      lock_acquire (&journal_lock);
+      ok = find_space (len, ofs);
+      lock_release (&journal_lock);
+      if (ok)
+        return;
+      if (pass == 1)
+        {
+          checkpoint_cnt++;
+          cache_flush ();
+        }
+      else if (pass > 1)
+        PANIC ("journal: log full");
+      reclaim ();
+    }
+}
+
+/* Commits the transaction being built, and returns once it is in
+   the log. */
+static void
+commit (void)
+{
+  struct journal_desc *d = (struct journal_desc *) txn_buf;
+  uint8_t *images = txn_buf + BLOCK_SECTOR_SIZE;
+  struct thread *t = thread_current ();
+  const block_sector_t *txn_revokes;
+  size_t image_cnt, txn_revoke_cnt, revoke_sectors, i;
+  uint32_t len, ofs;
+  unsigned seq;
+
+  ASSERT (t->journal_depth == 0);
+  lock_acquire (&commit_lock);
+  if (!enabled)
+    {
+      lock_release (&commit_lock);
+      return;
+    }
+
+  /* Wait for the operations under way to end, holding off new
+     ones.  Sectors revoked or released from now on belong to the
+     next transaction. */
+  lock_acquire (&journal_lock);
+  state = DRAINING;
+  while (active > 0)
+    cond_wait (&handles_done, &journal_lock);
+  state = FROZEN;
+  txn_revokes = revokes;
+  txn_revoke_cnt = revoke_cnt;
+  revokes = revoke_lists[revokes == revoke_lists[0]];
+  revoke_cnt = 0;
+  lock_release (&journal_lock);
+  free_map_freeze ();
+
+  /* Bring the free map's sectors up to date, under a handle of
+     our own that must not wait for this commit, and copy the
+     changed sectors. */
+  t->journal_depth++;
+  free_map_flush ();
+  t->journal_depth--;
+  seq = running_seq;
+  image_cnt = cache_journal_snapshot (seq, d->sectors, images, old_seqs);
+
+  lock_acquire (&journal_lock);
+  for (i = 0; i < image_cnt; i++)
+    if (!flatmap_insert (&logged, d->sectors[i], (void *) (uintptr_t) seq))
+      PANIC ("journal: out of memory");
+  if (image_cnt + txn_revoke_cnt > 0)
+    running_seq++;
+  txn_sectors = 0;
+  state = OPEN;
+  cond_broadcast (&commit_done, &journal_lock);
+  lock_release (&journal_lock);
+
+  if (image_cnt + txn_revoke_cnt == 0)
+    {
+      free_map_thaw ();
+      lock_release (&commit_lock);
+      return;
+    }
+
+  /* Fill in the rest of the transaction and write it. */
+  revoke_sectors = DIV_ROUND_UP (txn_revoke_cnt, REVOKES_PER_SECTOR);
+  len = 1 + image_cnt + revoke_sectors;
+  memset (images + image_cnt * BLOCK_SECTOR_SIZE, 0,
+          revoke_sectors * BLOCK_SECTOR_SIZE);
+  memcpy (images + image_cnt * BLOCK_SECTOR_SIZE, txn_revokes,
+          txn_revoke_cnt * sizeof *txn_revokes);
+  memset (d->sectors + image_cnt, 0,
+          (CACHE_CNT - image_cnt) * sizeof *d->sectors);
+  memset (d->unused, 0, sizeof d->unused);
+  d->magic = DESC_MAGIC;
+  d->id = header.id;
+  d->seq = seq;
+  d->image_cnt = image_cnt;
+  d->revoke_cnt = txn_revoke_cnt;
+  d->checksum = checksum (d, images, len - 1);
+  reserve (len, &ofs);
+  block_write_multiple (fs_device, header.start + ofs, len, txn_buf);
+
+  /* The images are safe and may go home, and so may the sectors
+     the transaction released be reused.  The images they
+     supersede no longer hold their transactions in the log. */
+  lock_acquire (&journal_lock);
+  ASSERT (seq - header.seq < TXN_CNT);
+  txns[seq % TXN_CNT].ofs = ofs;
+  txns[seq % TXN_CNT].len = len;
+  txns[seq % TXN_CNT].pending = image_cnt;
+  durable_seq = seq;
+  head_ofs = ofs + len;
+  for (i = 0; i < image_cnt; i++)
+    if (old_seqs[i] != 0)
+      {
+        ASSERT (txns[old_seqs[i] % TXN_CNT].pending > 0);
+        txns[old_seqs[i] % TXN_CNT].pending--;
+      }
+  lock_release (&journal_lock);
+  cache_journal_committed ();
+  free_map_thaw ();
+
+  commit_cnt++;
+  logged_cnt += image_cnt;
+  revoked_cnt += txn_revoke_cnt;
+  lock_release (&commit_lock);
+}
+
+/* Commits every operation that has ended, and returns once they
+   are in the log. */
+void
+journal_sync (void)
+{
+  if (enabled)
+    commit ();
+}
+
+/* Commits what is left, writes everything home and empties the
+   log, so that the next mount has nothing to replay, and stops
+   journaling.  The second commit writes the free map with the
+   sectors released in the first. */
+void
+journal_close (void)
+{
+  if (!enabled)
+    return;
+  commit ();
+  commit ();
+  lock_acquire (&commit_lock);
+  cache_flush ();
+  reclaim ();
+  enabled = false;
+  lock_release (&commit_lock);
+}
+
+/* Committer thread.  Commits every COMMIT_TICKS, or when woken
+   because a transaction has grown large or the cache needs its
+   entries back. */
+static void
+committer (void *aux UNUSED)
+{
+  for (;;)
+    {
+      lock_acquire (&journal_lock);
+      cond_wait_timeout (&commit_wanted, &journal_lock, COMMIT_TICKS);
+      lock_release (&journal_lock);
+      commit ();
+    }
+}
+
+/* Asks the committer to commit without waiting for the end of
+   the interval. */
+void
+journal_commit_soon (void)
+{
+  if (!enabled)
+    return;
+  lock_acquire (&journal_lock);
+  cond_signal (&commit_wanted, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Counts a cached metadata sector newly changed in the running
+   transaction. */
+void
+journal_dirtied (void)
+{
+  lock_acquire (&journal_lock);
+  txn_sectors++;
+  lock_release (&journal_lock);
+}
+
+/* Returns true if transaction SEQ is in the log, so that the
+   images it logged may go home.  Transactions commit in order, so
+   the answer, once true, stays so. */
+bool
+journal_committed (unsigned seq)
+{
+  return seq <= durable_seq;
+}
+
+/* Notes that a sector whose image transaction SEQ logged has been
+   written home. */
+void
+journal_homed (unsigned seq)
+{
+  lock_acquire (&journal_lock);
+  ASSERT (txns[seq % TXN_CNT].pending > 0);
+  txns[seq % TXN_CNT].pending--;
+  lock_release (&journal_lock);
+}
+
+/* Notes that SECTOR, which held metadata, is being freed.  If the
+   log has an image of it, or may be about to, the running
+   transaction revokes it. */
+void
+journal_revoke (block_sector_t sector)
+{
+  uintptr_t seq;
+
+  if (!enabled)
+    return;
+  lock_acquire (&journal_lock);
+  seq = (uintptr_t) flatmap_remove (&logged, sector);
+  if (seq >= header.seq || state == FROZEN)
+    {
+      if (revoke_cnt >= REVOKE_MAX)
+        PANIC ("journal: too many sectors revoked");
+      revokes[revoke_cnt++] = sector;
+    }
+  lock_release (&journal_lock);
+}
+
+/* Prints journal statistics, if the file system has a journal. */
+void
+journal_print_stats (void)
+{
+  if (header.magic != JOURNAL_MAGIC)
+    return;
+  printf ("Journal: %lld commits, %lld sectors logged, %lld revoked, "
+          "%lld checkpoints, %lld transactions replayed\n",
+          commit_cnt, logged_cnt, revoked_cnt, checkpoint_cnt,
+          replayed_cnt);
+}
@@ -0,0 +1,25 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+void journal_format (bool);
+void journal_open (void);
+void journal_close (void);
+bool journal_enabled (void);
+
+void journal_begin (void);
+void journal_end (void);
+void journal_sync (void);
+
+/* Interface for the buffer cache. */
+void journal_dirtied (void);
+bool journal_committed (unsigned seq);
+void journal_homed (unsigned seq);
+void journal_revoke (block_sector_t);
+void journal_commit_soon (void);
+
+void journal_print_stats (void);
+
+#endif /* filesys/journal.h */
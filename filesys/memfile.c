@@ -0,0 +1,166 @@
+#include "filesys/memfile.h"
+#include <debug.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "userprog/uaccess.h"
+
+/* Memory-only file contents.
+
+   A file system that lives in memory keeps each file's data in a
+   list of pages, one pointer per PGSIZE bytes of the file, so a
+   byte offset finds its data with a division and an index: there
+   are no sectors to translate, and nothing goes through the
+   buffer cache.  Pages come from the user pool, as they hold bulk
+   data, and are allocated when first written, so that a page
+   never written is a hole that reads as zeros.
+
+   The caller serializes changes to a memfile against each other
+   and against reads; the inode layer does so with INODE's
+   map_lock. */
+
+/* Bytes of zeros, which holes read as. */
+static const uint8_t zero_page[PGSIZE];
+
+/* Initializes MF as empty. */
+void
+memfile_init (struct memfile *mf) 
+{
+  mf->pages = NULL;
+  mf->page_cnt = 0;
+}
+
+/* Frees MF's pages. */
+void
+memfile_destroy (struct memfile *mf) 
+{
+  size_t i;
+
+  for (i = 0; i < mf->page_cnt; i++)
+    palloc_free_page (mf->pages[i]);
+  free (mf->pages);
+  memfile_init (mf);
+}
+
+/* Makes MF's page list long enough for page IDX.  Returns false
+   if memory is short. */
+static bool
+grow (struct memfile *mf, size_t idx) 
+{
+  size_t new_cnt;
+  uint8_t **pages;
+
+  if (idx < mf->page_cnt)
+    return true;
+  new_cnt = mf->page_cnt > 0 ? mf->page_cnt : 4;
+  while (new_cnt <= idx)
+    new_cnt *= 2;
+  pages = realloc (mf->pages, new_cnt * sizeof *pages);
+  if (pages == NULL)
+    return false;
+  memset (pages + mf->page_cnt, 0,
+          (new_cnt - mf->page_cnt) * sizeof *pages);
+  mf->pages = pages;
+  mf->page_cnt = new_cnt;
+  return true;
+}
+
+/* Returns MF's page IDX, allocating it, zeroed, if it is a hole.
+   Returns a null pointer if memory is short. */
+static uint8_t *
+get_page (struct memfile *mf, size_t idx) 
+{
+  if (!grow (mf, idx))
+    return NULL;
+  if (mf->pages[idx] == NULL)
+    mf->pages[idx] = palloc_get_page (PAL_USER | PAL_ZERO);
+  return mf->pages[idx];
+}
+
+/* Returns a pointer to byte OFS of MF, which reads as zero if it
+   is in a hole.  The bytes that follow, up to the end of the
+   page, are MF's too. */
+const void *
+memfile_get (const struct memfile *mf, off_t ofs) 
+{
+  size_t idx = ofs / PGSIZE;
+
+  if (idx < mf->page_cnt && mf->pages[idx] != NULL)
+    return mf->pages[idx] + ofs % PGSIZE;
+  return zero_page + ofs % PGSIZE;
+}
+
+/* Copies SIZE bytes of MF at offset OFS into BUFFER, a user
+   buffer if USER is true.  The caller keeps the range within the
+   file.  Returns false if copying to a user buffer faults. */
+bool
+memfile_read (const struct memfile *mf, void *buffer_, off_t size,
+              off_t ofs, bool user) 
+{
+  uint8_t *buffer = buffer_;
+
+  ASSERT (ofs >= 0 && size >= 0);
+  while (size > 0) 
+    {
+      off_t chunk = PGSIZE - ofs % PGSIZE;
+
+      if (chunk > size)
+        chunk = size;
+      if (!copy_maybe_user (buffer, memfile_get (mf, ofs), chunk, user))
+        return false;
+      buffer += chunk;
+      ofs += chunk;
+      size -= chunk;
+    }
+  return true;
+}
+
+/* Copies SIZE bytes from BUFFER, a user buffer if USER is true,
+   into MF at offset OFS.  Returns the number of bytes written,
+   which is less than SIZE if memory runs out, or -1 if copying
+   from a user buffer faults. */
+off_t
+memfile_write (struct memfile *mf, const void *buffer_, off_t size,
+               off_t ofs, bool user) 
+{
+  const uint8_t *buffer = buffer_;
+  off_t written = 0;
+
+  ASSERT (ofs >= 0 && size >= 0);
+  while (size > 0) 
+    {
+      off_t chunk = PGSIZE - ofs % PGSIZE;
+      uint8_t *page = get_page (mf, ofs / PGSIZE);
+
+      if (page == NULL)
+        break;
+      if (chunk > size)
+        chunk = size;
+      if (!copy_maybe_user (page + ofs % PGSIZE, buffer, chunk, user))
+        return -1;
+      buffer += chunk;
+      ofs += chunk;
+      size -= chunk;
+      written += chunk;
+    }
+  return written;
+}
+
+/* Allocates the pages of MF that hold bytes OFS through OFS +
+   LENGTH, so that writing them later does not run out of memory.
+   Returns false if memory is short, leaving any pages allocated
+   so far in place. */
+bool
+memfile_reserve (struct memfile *mf, off_t ofs, off_t length) 
+{
+  size_t idx;
+
+  if (length == 0)
+    return true;
+  for (idx = ofs / PGSIZE; idx <= (size_t) (ofs + length - 1) / PGSIZE;
+       idx++)
+    if (get_page (mf, idx) == NULL)
+      return false;
+  return true;
+}
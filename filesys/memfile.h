@@ -0,0 +1,26 @@
+#ifndef FILESYS_MEMFILE_H
+#define FILESYS_MEMFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+/* The contents of a file kept in memory only, for a file system
+   that lives in memory; see memfile.c. */
+struct memfile
+  {
+    uint8_t **pages;            /* Page of each PGSIZE bytes, or null. */
+    size_t page_cnt;            /* Number of elements in PAGES. */
+  };
+
+void memfile_init (struct memfile *);
+void memfile_destroy (struct memfile *);
+bool memfile_read (const struct memfile *, void *, off_t size, off_t ofs,
+                   bool user);
+off_t memfile_write (struct memfile *, const void *, off_t size, off_t ofs,
+                     bool user);
+bool memfile_reserve (struct memfile *, off_t ofs, off_t length);
+const void *memfile_get (const struct memfile *, off_t ofs);
+
+#endif /* filesys/memfile.h */
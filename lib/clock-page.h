@@ -0,0 +1,31 @@
+#ifndef __LIB_CLOCK_PAGE_H
+#define __LIB_CLOCK_PAGE_H
+
+#include <stdint.h>
+
+/* The clock page.
+
+   The kernel maps a page into every user process, read-only, at
+   CLOCK_PAGE, and keeps it up to date from the timer interrupt,
+   so that user code can read the time without a system call.
+   The page is the process's own, and is only updated while one
+   of the process's threads is running, so it is brought up to
+   date whenever the process is switched to.
+
+   The kernel makes `seq' odd while it updates the rest, exactly
+   as for a kernel seqlock.  A reader copies what it wants and
+   starts over if `seq' was odd or changed in the meantime. */
+
+/* User address of the clock page. */
+#define CLOCK_PAGE 0x08000000
+
+struct clock_page
+  {
+    volatile uint32_t seq;              /* Odd while being updated. */
+    volatile int64_t ticks;             /* Timer ticks since boot. */
+    volatile int64_t run_ticks;         /* Ticks run by the process. */
+    volatile int32_t load_avg;          /* System load average x 100. */
+    volatile int32_t freq;              /* Timer ticks per second. */
+  };
+
+#endif /* lib/clock-page.h */
@@ -28,6 +28,7 @@ struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    size_t hint;        /* Where bitmap_scan_and_flip_next() starts. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -69,6 +70,59 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns the number of 1-bits in W, which is 32 bits wide on
+   the 80x86.  Written out rather than using
+   __builtin_popcountl(), which would need libgcc. */
+static inline unsigned
+popcount (elem_type w) 
+{
+  w = w - ((w >> 1) & 0x55555555);
+  w = (w & 0x33333333) + ((w >> 2) & 0x33333333);
+  w = (w + (w >> 4)) & 0x0f0f0f0f;
+  return (w * 0x01010101) >> 24;
+}
+
+/* Returns the mask of the bits in element elem_idx(START) that
+   lie at or after START and before END, where END is greater
+   than START and at most the first bit of the next element. */
+static inline elem_type
+range_mask (size_t start, size_t end) 
+{
+  elem_type lo = ~(bit_mask (start) - 1);
+  elem_type hi = end % ELEM_BITS ? bit_mask (end) - 1 : (elem_type) -1;
+  return lo & hi;
+}
+
+/* Returns the index of the first bit in B at or after START and
+   before END that is set to VALUE, or END if there is none.
+   Looks at a whole element at a time, skipping those that hold
+   no candidate and using bsf to find the first one that does. */
+static size_t
+find_bit (const struct bitmap *b, size_t start, size_t end, bool value) 
+{
+  elem_type flip = value ? 0 : (elem_type) -1;
+  size_t idx, last;
+  elem_type w;
+
+  if (start >= end)
+    return end;
+
+  idx = elem_idx (start);
+  last = elem_idx (end - 1);
+  w = (b->bits[idx] ^ flip) & ~(bit_mask (start) - 1);
+  for (;;)
+    {
+      if (w != 0)
+        {
+          size_t bit = idx * ELEM_BITS + __builtin_ctzl (w);
+          return bit < end ? bit : end;
+        }
+      if (++idx > last)
+        return end;
+      w = b->bits[idx] ^ flip;
+    }
+}
+
 /* Creation and destruction. */
 
 /* Creates and returns a pointer to a newly allocated bitmap with room for
@@ -83,6 +137,7 @@ bitmap_create (size_t bit_cnt)
     {
       b->bit_cnt = bit_cnt;
       b->bits = malloc (byte_cnt (bit_cnt));
+      b->hint = 0;
       if (b->bits != NULL || bit_cnt == 0)
         {
           bitmap_set_all (b, false);
@@ -105,6 +160,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *) (b + 1);
+  b->hint = 0;
   bitmap_set_all (b, false);
   return b;
 }
@@ -213,18 +269,30 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Each element is updated atomically, as in bitmap_mark(). */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t end = start + cnt;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  while (start < end)
+    {
+      size_t next = (elem_idx (start) + 1) * ELEM_BITS;
+      size_t stop = next < end ? next : end;
+      elem_type mask = range_mask (start, stop);
+      elem_type *e = &b->bits[elem_idx (start)];
+
+      if (value)
+        asm ("orl %1, %0" : "=m" (*e) : "r" (mask) : "cc");
+      else
+        asm ("andl %1, %0" : "=m" (*e) : "r" (~mask) : "cc");
+      start = stop;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -232,17 +300,22 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t ones = 0;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  while (start < end)
+    {
+      size_t next = (elem_idx (start) + 1) * ELEM_BITS;
+      size_t stop = next < end ? next : end;
+
+      ones += popcount (b->bits[elem_idx (start)] & range_mask (start, stop));
+      start = stop;
+    }
+  return value ? ones : cnt - ones;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -250,16 +323,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return find_bit (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -298,13 +366,23 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
+  if (cnt == 0)
+    return start;
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+
+      /* Jump to the next bit set to VALUE, then look for a bit
+         set to !VALUE in the CNT bits from there.  If there is
+         one, no group can start before the bit after it. */
+      while ((i = find_bit (b, i, last + 1, value)) <= last) 
+        {
+          size_t miss = find_bit (b, i, i + cnt, !value);
+          if (miss == i + cnt)
+            return i;
+          i = miss + 1;
+        }
     }
   return BITMAP_ERROR;
 }
@@ -325,6 +403,29 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
   return idx;
 }
 
+/* Like bitmap_scan_and_flip(), but next-fit: the search starts
+   where the last successful call left off and wraps around to
+   the start of B if necessary.  When the low bits are densely
+   used, as they tend to be, this avoids rescanning them on every
+   call. */
+size_t
+bitmap_scan_and_flip_next (struct bitmap *b, size_t cnt, bool value)
+{
+  size_t idx;
+
+  ASSERT (b != NULL);
+
+  idx = bitmap_scan (b, b->hint, cnt, value);
+  if (idx == BITMAP_ERROR && b->hint > 0)
+    idx = bitmap_scan (b, 0, cnt, value);
+  if (idx != BITMAP_ERROR) 
+    {
+      bitmap_set_multiple (b, idx, cnt, !value);
+      b->hint = idx + cnt < b->bit_cnt ? idx + cnt : 0;
+    }
+  return idx;
+}
+
 /* File input and output. */
 
 #ifdef FILESYS
@@ -358,6 +459,23 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the SIZE bytes of B that start at byte OFS of its file
+   image to the same place in FILE, clipping them to the end of
+   the image.  Return true if successful, false otherwise. */
+bool
+bitmap_write_at (const struct bitmap *b, struct file *file,
+                 size_t ofs, size_t size)
+{
+  size_t file_size = byte_cnt (b->bit_cnt);
+
+  if (ofs >= file_size)
+    return true;
+  if (size > file_size - ofs)
+    size = file_size - ofs;
+  return file_write_at (file, (const uint8_t *) b->bits + ofs, size, ofs)
+         == (off_t) size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -1,14 +1,18 @@
 #include <console.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
+#include "devices/debugcon.h"
 #include "devices/serial.h"
+#include "devices/timer.h"
 #include "devices/vga.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/stats.h"
 #include "threads/synch.h"
 
 static void vprintf_helper (char, void *);
-static void putchar_have_lock (uint8_t c);
+static void putbuf_have_lock (const char *, size_t);
 
 /* The console lock.
    Both the vga and serial layers do their own locking, so it's
@@ -65,6 +69,7 @@ console_init (void)
 {
   lock_init (&console_lock);
   use_console_lock = true;
+  stats_counter ("console", NULL, "chars", &write_cnt);
 }
 
 /* Notifies the console that a kernel panic is underway,
@@ -119,19 +124,39 @@ console_locked_by_current_thread (void)
           || lock_held_by_current_thread (&console_lock));
 }
 
+/* Staging buffer for vprintf().  Output is formatted into the
+   buffer without holding the console lock and then written out
+   in one piece.  Only a message longer than the buffer has to
+   take the lock before it is completely formatted, to flush the
+   part formatted so far. */
+#define PRINTF_BUFSIZE 128
+struct printf_buf
+  {
+    char buf[PRINTF_BUFSIZE];   /* Formatted, not yet written. */
+    size_t len;                 /* Number of bytes in BUF. */
+    int char_cnt;               /* Total number of bytes formatted. */
+    bool locked;                /* Console lock acquired? */
+  };
+
 /* The standard vprintf() function,
    which is like printf() but uses a va_list.
    Writes its output to both vga display and serial port. */
 int
 vprintf (const char *format, va_list args) 
 {
-  int char_cnt = 0;
+  struct printf_buf pb;
 
-  acquire_console ();
-  __vprintf (format, args, vprintf_helper, &char_cnt);
+  pb.len = 0;
+  pb.char_cnt = 0;
+  pb.locked = false;
+  __vprintf (format, args, vprintf_helper, &pb);
+
+  if (!pb.locked)
+    acquire_console ();
+  putbuf_have_lock (pb.buf, pb.len);
   release_console ();
 
-  return char_cnt;
+  return pb.char_cnt;
 }
 
 /* Writes string S to the console, followed by a new-line
@@ -140,9 +165,8 @@ int
 puts (const char *s) 
 {
   acquire_console ();
-  while (*s != '\0')
-    putchar_have_lock (*s++);
-  putchar_have_lock ('\n');
+  putbuf_have_lock (s, strlen (s));
+  putbuf_have_lock ("\n", 1);
   release_console ();
 
   return 0;
@@ -153,8 +177,7 @@ void
 putbuf (const char *buffer, size_t n) 
 {
   acquire_console ();
-  while (n-- > 0)
-    putchar_have_lock (*buffer++);
+  putbuf_have_lock (buffer, n);
   release_console ();
 }
 
@@ -162,30 +185,86 @@ putbuf (const char *buffer, size_t n)
 int
 putchar (int c) 
 {
+  char ch = c;
+
   acquire_console ();
-  putchar_have_lock (c);
+  putbuf_have_lock (&ch, 1);
   release_console ();
   
   return c;
 }
-
+
+/* Prints like printf(), unless more than PRINTF_RATELIMIT_BURST
+   messages have already been printed through RL in the last
+   PRINTF_RATELIMIT_INTERVAL timer ticks.  Once printing resumes,
+   notes how many messages were dropped.  Use this through the
+   printf_ratelimited() macro, which supplies a separate RL for
+   each call site. */
+void
+__printf_ratelimited (struct printf_ratelimit *rl, const char *format, ...) 
+{
+  int64_t now = timer_ticks ();
+  int missed = 0;
+  bool print;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (rl->printed == 0 || now - rl->start >= PRINTF_RATELIMIT_INTERVAL)
+    {
+      missed = rl->missed;
+      rl->start = now;
+      rl->printed = rl->missed = 0;
+    }
+  print = rl->printed < PRINTF_RATELIMIT_BURST;
+  if (print)
+    rl->printed++;
+  else
+    rl->missed++;
+  intr_set_level (old_level);
+
+  if (missed > 0)
+    printf ("(%d messages suppressed)\n", missed);
+  if (print) 
+    {
+      va_list args;
+
+      va_start (args, format);
+      vprintf (format, args);
+      va_end (args);
+    }
+}
+
 /* Helper function for vprintf(). */
 static void
-vprintf_helper (char c, void *char_cnt_) 
+vprintf_helper (char c, void *pb_) 
 {
-  int *char_cnt = char_cnt_;
-  (*char_cnt)++;
-  putchar_have_lock (c);
+  struct printf_buf *pb = pb_;
+
+  if (pb->len >= sizeof pb->buf) 
+    {
+      if (!pb->locked) 
+        {
+          acquire_console ();
+          pb->locked = true;
+        }
+      putbuf_have_lock (pb->buf, pb->len);
+      pb->len = 0;
+    }
+  pb->buf[pb->len++] = c;
+  pb->char_cnt++;
 }
 
-/* Writes C to the vga display and serial port.
-   The caller has already acquired the console lock if
+/* Writes the N characters in BUFFER to the vga display and
+   serial port, or to the emulator's debug console instead of the
+   serial port if there is one, since that takes the whole buffer
+   at once.  The caller has already acquired the console lock if
    appropriate. */
 static void
-putchar_have_lock (uint8_t c) 
+putbuf_have_lock (const char *buffer, size_t n) 
 {
   ASSERT (console_locked_by_current_thread ());
-  write_cnt++;
-  serial_putc (c);
-  vga_putc (c);
+  write_cnt += n;
+  if (!debugcon_putbuf (buffer, n))
+    serial_putbuf (buffer, n);
+  vga_putbuf (buffer, n);
 }
@@ -9,6 +9,7 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/switch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "devices/serial.h"
 #include "devices/shutdown.h"
@@ -36,6 +37,7 @@ debug_panic (const char *file, int line, const char *function,
       va_end (args);
 
       debug_backtrace ();
+      trace_dump ();
     }
   else if (level == 2)
     printf ("Kernel PANIC recursion at %s:%d in %s().\n",
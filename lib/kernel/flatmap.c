@@ -0,0 +1,277 @@
+#include "flatmap.h"
+#include "../debug.h"
+#include "threads/malloc.h"
+
+/* Flat map.  See flatmap.h for an overview. */
+
+/* The map grows once more than 3/4 of its slots are in use. */
+#define MAX_LOAD_NUM 3
+#define MAX_LOAD_DEN 4
+
+/* Smallest number of slots. */
+#define MIN_SLOTS 8
+
+/* Largest probe distance that fits in a dist byte.  Reaching it
+   makes the map grow, which in practice never happens below the
+   maximum load. */
+#define MAX_DIST (UINT8_MAX - 1)
+
+static bool resize (struct flatmap *, size_t slot_cnt);
+static bool place (struct flatmap *, unsigned key, void *value);
+static struct flatmap_slot *first_from (const struct flatmap *, size_t idx);
+
+/* Returns the home slot for KEY in M.  Multiplying by 2**32
+   divided by the golden ratio and keeping the top bits spreads
+   consecutive keys evenly ("Fibonacci hashing"). */
+static inline size_t
+home_slot (const struct flatmap *m, unsigned key) 
+{
+  return (uint32_t) (key * 2654435769u) >> m->shift;
+}
+
+/* Initializes M as an empty map with room for about CAPACITY
+   entries before it has to grow.  Returns true if successful,
+   false if memory could not be allocated. */
+bool
+flatmap_init (struct flatmap *m, size_t capacity) 
+{
+  size_t slot_cnt = MIN_SLOTS;
+
+  while (slot_cnt * MAX_LOAD_NUM / MAX_LOAD_DEN < capacity)
+    slot_cnt *= 2;
+
+  m->slots = NULL;
+  m->dist = NULL;
+  m->mask = 0;
+  m->shift = 32;
+  m->cnt = 0;
+  return resize (m, slot_cnt);
+}
+
+/* Frees M's storage.  The values themselves are the caller's. */
+void
+flatmap_destroy (struct flatmap *m) 
+{
+  free (m->slots);
+  m->slots = NULL;
+  m->dist = NULL;
+  m->cnt = 0;
+}
+
+/* Returns the value for KEY in M, or a null pointer if KEY is
+   not in M. */
+void *
+flatmap_find (const struct flatmap *m, unsigned key) 
+{
+  size_t idx = home_slot (m, key);
+  unsigned dist;
+
+  for (dist = 1; dist <= m->dist[idx]; dist++)
+    {
+      if (m->slots[idx].key == key)
+        return m->slots[idx].value;
+      idx = (idx + 1) & m->mask;
+    }
+  return NULL;
+}
+
+/* Maps KEY to VALUE in M, which must not be null, replacing any
+   value KEY already has.  Returns true if successful, false if M
+   needed to grow and memory could not be allocated. */
+bool
+flatmap_insert (struct flatmap *m, unsigned key, void *value) 
+{
+  size_t idx = home_slot (m, key);
+  unsigned dist;
+
+  ASSERT (value != NULL);
+
+  /* Replace an existing entry. */
+  for (dist = 1; dist <= m->dist[idx]; dist++)
+    {
+      if (m->slots[idx].key == key)
+        {
+          m->slots[idx].value = value;
+          return true;
+        }
+      idx = (idx + 1) & m->mask;
+    }
+
+  /* Add a new one, growing first if M is too full. */
+  if ((m->cnt + 1) * MAX_LOAD_DEN > (m->mask + 1) * MAX_LOAD_NUM
+      && !resize (m, (m->mask + 1) * 2))
+    return false;
+  while (!place (m, key, value))
+    if (!resize (m, (m->mask + 1) * 2))
+      return false;
+  m->cnt++;
+  return true;
+}
+
+/* Removes KEY from M and returns its value, or returns a null
+   pointer if KEY is not in M. */
+void *
+flatmap_remove (struct flatmap *m, unsigned key) 
+{
+  size_t idx = home_slot (m, key);
+  unsigned dist;
+  void *value;
+
+  for (dist = 1; dist <= m->dist[idx]; dist++)
+    {
+      if (m->slots[idx].key == key)
+        break;
+      idx = (idx + 1) & m->mask;
+    }
+  if (dist > m->dist[idx])
+    return NULL;
+  value = m->slots[idx].value;
+
+  /* Shift the entries after it back by one slot, until one that
+     is already in its home slot or an empty slot. */
+  for (;;)
+    {
+      size_t next = (idx + 1) & m->mask;
+      if (m->dist[next] <= 1)
+        break;
+      m->slots[idx] = m->slots[next];
+      m->dist[idx] = m->dist[next] - 1;
+      idx = next;
+    }
+  m->slots[idx].value = NULL;
+  m->dist[idx] = 0;
+  m->cnt--;
+  return value;
+}
+
+/* Returns the number of entries in M. */
+size_t
+flatmap_size (const struct flatmap *m) 
+{
+  return m->cnt;
+}
+
+/* Returns M's first entry, or a null pointer if M is empty. */
+struct flatmap_slot *
+flatmap_first (const struct flatmap *m) 
+{
+  return first_from (m, 0);
+}
+
+/* Returns the entry of M that follows S, or a null pointer if S
+   is the last one. */
+struct flatmap_slot *
+flatmap_next (const struct flatmap *m, struct flatmap_slot *s) 
+{
+  return first_from (m, s - m->slots + 1);
+}
+
+/* Returns the first entry of M in slot IDX or after, or a null
+   pointer if there is none. */
+static struct flatmap_slot *
+first_from (const struct flatmap *m, size_t idx) 
+{
+  for (; m->slots != NULL && idx <= m->mask; idx++)
+    if (m->dist[idx] != 0)
+      return &m->slots[idx];
+  return NULL;
+}
+
+/* Puts KEY, which is not in M, in M with VALUE, displacing
+   entries that are closer to home along the way.  Returns false,
+   having changed nothing, if some entry would end up too far
+   from home to record. */
+static bool
+place (struct flatmap *m, unsigned key, void *value) 
+{
+  size_t idx = home_slot (m, key);
+  unsigned dist = 1;
+  unsigned worst = 1;
+  size_t probe, run = 0;
+
+  /* Every entry that moves stays within the run of occupied
+     slots from IDX to the next empty slot, so none can end up
+     farther from home than the worst distance in the run plus
+     the run's length. */
+  for (probe = idx; m->dist[probe] != 0; probe = (probe + 1) & m->mask)
+    {
+      if (m->dist[probe] > worst)
+        worst = m->dist[probe];
+      if (++run + worst >= MAX_DIST)
+        return false;
+    }
+
+  for (;;)
+    {
+      if (m->dist[idx] == 0)
+        {
+          m->slots[idx].key = key;
+          m->slots[idx].value = value;
+          m->dist[idx] = dist;
+          return true;
+        }
+      if (m->dist[idx] < dist)
+        {
+          /* Robin Hood: take the slot from the richer entry and
+             carry it onward instead. */
+          struct flatmap_slot s = m->slots[idx];
+          unsigned d = m->dist[idx];
+
+          m->slots[idx].key = key;
+          m->slots[idx].value = value;
+          m->dist[idx] = dist;
+          key = s.key;
+          value = s.value;
+          dist = d;
+        }
+      idx = (idx + 1) & m->mask;
+      dist++;
+    }
+}
+
+/* Changes M to have SLOT_CNT slots, a power of 2, reinserting
+   every entry.  Returns true if successful, false if memory
+   could not be allocated, in which case M is unchanged. */
+static bool
+resize (struct flatmap *m, size_t slot_cnt) 
+{
+  struct flatmap old = *m;
+  size_t i;
+  int bits;
+
+  ASSERT (slot_cnt >= MIN_SLOTS && (slot_cnt & (slot_cnt - 1)) == 0);
+
+  /* Slots and distances share one allocation. */
+  m->slots = malloc (slot_cnt * (sizeof *m->slots + sizeof *m->dist));
+  if (m->slots == NULL)
+    {
+      *m = old;
+      return false;
+    }
+  m->dist = (uint8_t *) (m->slots + slot_cnt);
+  for (i = 0; i < slot_cnt; i++)
+    {
+      m->slots[i].value = NULL;
+      m->dist[i] = 0;
+    }
+  for (bits = 0; ((size_t) 1 << bits) < slot_cnt; bits++)
+    continue;
+  m->mask = slot_cnt - 1;
+  m->shift = 32 - bits;
+
+  if (old.slots != NULL)
+    {
+      for (i = 0; i <= old.mask; i++)
+        if (old.dist[i] != 0
+            && !place (m, old.slots[i].key, old.slots[i].value))
+          {
+            /* Some run grew too long even so.  Try twice as many
+               slots again. */
+            free (m->slots);
+            *m = old;
+            return resize (m, slot_cnt * 2);
+          }
+      free (old.slots);
+    }
+  return true;
+}
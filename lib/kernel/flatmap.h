@@ -0,0 +1,68 @@
+#ifndef __LIB_KERNEL_FLATMAP_H
+#define __LIB_KERNEL_FLATMAP_H
+
+/* Open-addressing hash map from unsigned keys to pointers.
+
+   Unlike struct hash, which chains elements embedded in the
+   objects themselves, a flat map stores each key and value in a
+   slot of a single array, so a lookup compares keys in
+   consecutive memory instead of chasing a pointer into each
+   candidate object.  That suits hot lookups keyed by a number,
+   such as an inode sector or a user page number.
+
+   Collisions are resolved by linear probing with Robin Hood
+   insertion: an entry that has probed farther from its home slot
+   takes the place of one that has probed less, which keeps probe
+   sequences short and lets a lookup stop as soon as it meets an
+   entry closer to home than the key it wants would be.  Removal
+   shifts the following entries back one slot instead of leaving
+   a tombstone, so the table never fills up with dead slots.
+
+   Values must not be null.  The map grows itself as needed but
+   does not shrink. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A slot. */
+struct flatmap_slot
+  {
+    unsigned key;               /* Key. */
+    void *value;                /* Value, or null if slot is empty. */
+  };
+
+/* A flat map. */
+struct flatmap
+  {
+    struct flatmap_slot *slots; /* Array of `mask' + 1 slots. */
+    uint8_t *dist;              /* Per slot: probe distance + 1, or 0. */
+    size_t mask;                /* Number of slots minus 1. */
+    int shift;                  /* 32 - log2(number of slots). */
+    size_t cnt;                 /* Number of entries. */
+  };
+
+bool flatmap_init (struct flatmap *, size_t capacity);
+void flatmap_destroy (struct flatmap *);
+
+void *flatmap_find (const struct flatmap *, unsigned key);
+bool flatmap_insert (struct flatmap *, unsigned key, void *value);
+void *flatmap_remove (struct flatmap *, unsigned key);
+
+size_t flatmap_size (const struct flatmap *);
+
+/* Iteration over every entry of a map, in no particular order.
+   The map must not change meanwhile:
+
+      struct flatmap_slot *s;
+
+      for (s = flatmap_first (m); s != NULL; s = flatmap_next (m, s))
+        {
+          ...do something with s->key and s->value...
+        }
+*/
+struct flatmap_slot *flatmap_first (const struct flatmap *);
+struct flatmap_slot *flatmap_next (const struct flatmap *,
+                                   struct flatmap_slot *);
+
+#endif /* lib/kernel/flatmap.h */
@@ -18,6 +18,7 @@ static struct hash_elem *find_elem (struct hash *, struct list *,
 static void insert_elem (struct hash *, struct list *, struct hash_elem *);
 static void remove_elem (struct hash *, struct hash_elem *);
 static void rehash (struct hash *);
+static void migrate (struct hash *, size_t bucket_cnt);
 
 /* Initializes hash table H to compute hash values using HASH and
    compare hash elements using LESS, given auxiliary data AUX. */
@@ -28,6 +29,9 @@ hash_init (struct hash *h,
   h->elem_cnt = 0;
   h->bucket_cnt = 4;
   h->buckets = malloc (sizeof *h->buckets * h->bucket_cnt);
+  h->old_bucket_cnt = 0;
+  h->old_buckets = NULL;
+  h->migrate_idx = 0;
   h->hash = hash;
   h->less = less;
   h->aux = aux;
@@ -55,6 +59,7 @@ hash_clear (struct hash *h, hash_action_func *destructor)
 {
   size_t i;
 
+  migrate (h, SIZE_MAX);
   for (i = 0; i < h->bucket_cnt; i++) 
     {
       struct list *bucket = &h->buckets[i];
@@ -88,6 +93,7 @@ hash_destroy (struct hash *h, hash_action_func *destructor)
 {
   if (destructor != NULL)
     hash_clear (h, destructor);
+  free (h->old_buckets);
   free (h->buckets);
 }
 
@@ -166,6 +172,7 @@ hash_apply (struct hash *h, hash_action_func *action)
   
   ASSERT (action != NULL);
 
+  migrate (h, SIZE_MAX);
   for (i = 0; i < h->bucket_cnt; i++) 
     {
       struct list *bucket = &h->buckets[i];
@@ -195,13 +202,18 @@ hash_apply (struct hash *h, hash_action_func *action)
    Modifying hash table H during iteration, using any of the
    functions hash_clear(), hash_destroy(), hash_insert(),
    hash_replace(), or hash_delete(), invalidates all
-   iterators. */
+   iterators.
+
+   Iterating visits every element anyway, so this first finishes
+   any resize in progress. */
 void
 hash_first (struct hash_iterator *i, struct hash *h) 
 {
   ASSERT (i != NULL);
   ASSERT (h != NULL);
 
+  migrate (h, SIZE_MAX);
+
   i->hash = h;
   i->bucket = i->hash->buckets;
   i->elem = list_elem_to_hash_elem (list_head (i->bucket));
@@ -301,12 +313,92 @@ hash_int (int i)
   return hash_bytes (&i, sizeof i);
 }
 
-/* Returns the bucket in H that E belongs in. */
+/* Murmur3 constants. */
+#define MURMUR_C1 0xcc9e2d51u
+#define MURMUR_C2 0x1b873593u
+
+/* A 32-bit word that may be unaligned and may alias anything. */
+typedef uint32_t word_t __attribute__ ((__may_alias__, __aligned__ (1)));
+
+/* Returns X rotated left by R bits. */
+static inline uint32_t
+rotl32 (uint32_t x, int r) 
+{
+  return x << r | x >> (32 - r);
+}
+
+/* Returns one Murmur3 block K scrambled for mixing into a hash. */
+static inline uint32_t
+murmur_scramble (uint32_t k) 
+{
+  k *= MURMUR_C1;
+  k = rotl32 (k, 15);
+  return k * MURMUR_C2;
+}
+
+/* Returns a hash of the SIZE bytes in BUF: 32-bit MurmurHash3,
+   with seed 0, which takes 4 bytes per round where hash_bytes()
+   multiplies once per byte, and mixes every input bit into the
+   low bits that select a bucket.  Gives different values from
+   hash_bytes(), so a table must stick to one of the two. */
+unsigned
+hash_bytes_fast (const void *buf_, size_t size) 
+{
+  const uint8_t *buf = buf_;
+  uint32_t hash = 0, k = 0;
+  size_t i, tail;
+
+  ASSERT (buf != NULL);
+
+  for (i = 0; i + 4 <= size; i += 4)
+    {
+      hash ^= murmur_scramble (*(const word_t *) (buf + i));
+      hash = rotl32 (hash, 13) * 5 + 0xe6546b64;
+    }
+  for (tail = size & 3; tail > 0; tail--)
+    k = k << 8 | buf[i + tail - 1];
+  if (size & 3)
+    hash ^= murmur_scramble (k);
+
+  return hash_u32 (hash ^ size);
+}
+
+/* Returns a hash of X: Murmur3's finalizer, under which every bit
+   of X affects every bit of the result.  Cheaper than
+   hash_int(), for integer keys. */
+unsigned
+hash_u32 (uint32_t x) 
+{
+  x ^= x >> 16;
+  x *= 0x85ebca6bu;
+  x ^= x >> 13;
+  x *= 0xc2b2ae35u;
+  x ^= x >> 16;
+  return x;
+}
+
+/* Returns a hash of pointer P. */
+unsigned
+hash_ptr (const void *p) 
+{
+  return hash_u32 ((uintptr_t) p);
+}
+
+/* Returns the bucket in H that E belongs in: its old bucket, if
+   a resize is in progress and has not reached that bucket yet,
+   otherwise its new one. */
 static struct list *
 find_bucket (struct hash *h, struct hash_elem *e) 
 {
-  size_t bucket_idx = h->hash (e, h->aux) & (h->bucket_cnt - 1);
-  return &h->buckets[bucket_idx];
+  unsigned hash = h->hash (e, h->aux);
+
+  if (h->old_buckets != NULL)
+    {
+      size_t old_idx = hash & (h->old_bucket_cnt - 1);
+      if (old_idx >= h->migrate_idx)
+        return &h->old_buckets[old_idx];
+    }
+  return &h->buckets[hash & (h->bucket_cnt - 1)];
 }
 
 /* Searches BUCKET in H for a hash element equal to E.  Returns
@@ -344,10 +436,45 @@ is_power_of_2 (size_t x)
 #define BEST_ELEMS_PER_BUCKET 2 /* Ideal elems/bucket. */
 #define MAX_ELEMS_PER_BUCKET  4 /* Elems/bucket > 4: increase # of buckets. */
 
+/* Old buckets moved per insertion or deletion during a resize.
+   A resize finishes long before the element count can double or
+   halve again, which is what would call for the next one. */
+#define MIGRATE_BUCKETS 4
+
+/* Moves up to BUCKET_CNT of H's old buckets into the new bucket
+   array, freeing the old array once it is empty. */
+static void
+migrate (struct hash *h, size_t bucket_cnt) 
+{
+  while (h->old_buckets != NULL && bucket_cnt-- > 0)
+    {
+      struct list *old_bucket = &h->old_buckets[h->migrate_idx++];
+
+      while (!list_empty (old_bucket)) 
+        {
+          struct list_elem *elem = list_pop_front (old_bucket);
+          unsigned hash = h->hash (list_elem_to_hash_elem (elem), h->aux);
+          list_push_front (&h->buckets[hash & (h->bucket_cnt - 1)], elem);
+        }
+
+      if (h->migrate_idx >= h->old_bucket_cnt) 
+        {
+          free (h->old_buckets);
+          h->old_buckets = NULL;
+          h->old_bucket_cnt = 0;
+          h->migrate_idx = 0;
+        }
+    }
+}
+
 /* Changes the number of buckets in hash table H to match the
    ideal.  This function can fail because of an out-of-memory
    condition, but that'll just make hash accesses less efficient;
-   we can still continue. */
+   we can still continue.
+
+   Moving the elements is left to migrate(), which runs a few
+   buckets at a time, here and on later calls.  A new resize does
+   not start until the last one finishes. */
 static void
 rehash (struct hash *h) 
 {
@@ -357,6 +484,11 @@ rehash (struct hash *h)
 
   ASSERT (h != NULL);
 
+  /* Continue any resize in progress. */
+  migrate (h, MIGRATE_BUCKETS);
+  if (h->old_buckets != NULL)
+    return;
+
   /* Save old bucket info for later use. */
   old_buckets = h->buckets;
   old_bucket_cnt = h->bucket_cnt;
@@ -387,29 +519,14 @@ rehash (struct hash *h)
   for (i = 0; i < new_bucket_cnt; i++) 
     list_init (&new_buckets[i]);
 
-  /* Install new bucket info. */
+  /* Install new bucket info, keeping the old buckets until their
+     elements have moved. */
   h->buckets = new_buckets;
   h->bucket_cnt = new_bucket_cnt;
-
-  /* Move each old element into the appropriate new bucket. */
-  for (i = 0; i < old_bucket_cnt; i++) 
-    {
-      struct list *old_bucket;
-      struct list_elem *elem, *next;
-
-      old_bucket = &old_buckets[i];
-      for (elem = list_begin (old_bucket);
-           elem != list_end (old_bucket); elem = next) 
-        {
-          struct list *new_bucket
-            = find_bucket (h, list_elem_to_hash_elem (elem));
-          next = list_next (elem);
-          list_remove (elem);
-          list_push_front (new_bucket, elem);
-        }
-    }
-
-  free (old_buckets);
+  h->old_buckets = old_buckets;
+  h->old_bucket_cnt = old_bucket_cnt;
+  h->migrate_idx = 0;
+  migrate (h, MIGRATE_BUCKETS);
 }
 
 /* Inserts E into BUCKET (in hash table H). */
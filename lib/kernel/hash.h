@@ -18,7 +18,15 @@
    conversion from a struct hash_elem back to a structure object
    that contains it.  This is the same technique used in the
    linked list implementation.  Refer to lib/kernel/list.h for a
-   detailed explanation. */
+   detailed explanation.
+
+   The table resizes itself incrementally.  When it needs more or
+   fewer buckets, it allocates the new bucket array but leaves
+   the elements where they are, then moves a few of the old
+   buckets over on each later insertion or deletion, so no single
+   operation pays for moving the whole table.  Until the move
+   finishes, lookups check whichever array holds the element's
+   bucket at the time. */
 
 #include <stdbool.h>
 #include <stddef.h>
@@ -61,6 +69,9 @@ struct hash
     size_t elem_cnt;            /* Number of elements in table. */
     size_t bucket_cnt;          /* Number of buckets, a power of 2. */
     struct list *buckets;       /* Array of `bucket_cnt' lists. */
+    size_t old_bucket_cnt;      /* Number of buckets in old_buckets. */
+    struct list *old_buckets;   /* Array being moved, or null. */
+    size_t migrate_idx;         /* Old buckets below this are moved. */
     hash_hash_func *hash;       /* Hash function. */
     hash_less_func *less;       /* Comparison function. */
     void *aux;                  /* Auxiliary data for `hash' and `less'. */
@@ -99,5 +110,8 @@ bool hash_empty (struct hash *);
 unsigned hash_bytes (const void *, size_t);
 unsigned hash_string (const char *);
 unsigned hash_int (int);
+unsigned hash_bytes_fast (const void *, size_t);
+unsigned hash_u32 (uint32_t);
+unsigned hash_ptr (const void *);
 
 #endif /* lib/kernel/hash.h */
@@ -0,0 +1,221 @@
+#include "heap.h"
+#include "../debug.h"
+
+/* Our pairing heap is a multiway tree in which every element is
+   no greater than its children.  The children of an element form
+   a doubly linked sibling list through `next' and `prev', except
+   that the leftmost child's `prev' points to its parent.  The
+   root has null `prev' and `next'.
+
+   See M. L. Fredman, R. Sedgewick, D. D. Sleator, and R. E.
+   Tarjan, "The Pairing Heap: A New Form of Self-Adjusting
+   Heap", Algorithmica 1 (1986). */
+
+static struct heap_elem *meld (struct heap *,
+                               struct heap_elem *, struct heap_elem *);
+static struct heap_elem *merge_pairs (struct heap *, struct heap_elem *);
+static void detach (struct heap_elem *);
+
+/* Initializes HEAP as an empty heap ordered by LESS given
+   auxiliary data AUX. */
+void
+heap_init (struct heap *heap, heap_less_func *less, void *aux) 
+{
+  ASSERT (heap != NULL);
+  ASSERT (less != NULL);
+
+  heap->root = NULL;
+  heap->size = 0;
+  heap->less = less;
+  heap->aux = aux;
+}
+
+/* Returns true if HEAP is empty, false otherwise. */
+bool
+heap_empty (const struct heap *heap) 
+{
+  return heap->root == NULL;
+}
+
+/* Returns the number of elements in HEAP. */
+size_t
+heap_size (const struct heap *heap) 
+{
+  return heap->size;
+}
+
+/* Inserts ELEM into HEAP. */
+void
+heap_push (struct heap *heap, struct heap_elem *elem) 
+{
+  ASSERT (heap != NULL);
+  ASSERT (elem != NULL);
+
+  elem->child = elem->next = elem->prev = NULL;
+  heap->root = meld (heap, heap->root, elem);
+  heap->size++;
+}
+
+/* Returns the least element in HEAP, without removing it.
+   HEAP must not be empty. */
+struct heap_elem *
+heap_min (const struct heap *heap) 
+{
+  ASSERT (!heap_empty (heap));
+
+  return heap->root;
+}
+
+/* Removes and returns the least element in HEAP, which must not
+   be empty. */
+struct heap_elem *
+heap_pop_min (struct heap *heap) 
+{
+  struct heap_elem *min;
+
+  ASSERT (!heap_empty (heap));
+
+  min = heap->root;
+  heap->root = merge_pairs (heap, min->child);
+  heap->size--;
+  return min;
+}
+
+/* Removes ELEM, which must be in HEAP, from HEAP. */
+void
+heap_remove (struct heap *heap, struct heap_elem *elem) 
+{
+  ASSERT (!heap_empty (heap));
+  ASSERT (elem != NULL);
+
+  if (elem == heap->root)
+    heap_pop_min (heap);
+  else
+    {
+      detach (elem);
+      heap->root = meld (heap, heap->root, merge_pairs (heap, elem->child));
+      heap->size--;
+    }
+}
+
+/* Restores HEAP's ordering after ELEM's key has changed so that
+   ELEM should come out earlier than before.  ELEM must be in
+   HEAP. */
+void
+heap_decrease (struct heap *heap, struct heap_elem *elem) 
+{
+  ASSERT (!heap_empty (heap));
+  ASSERT (elem != NULL);
+
+  if (elem != heap->root)
+    {
+      /* Cut ELEM's subtree out and meld it with the root.  Its
+         own children are still no less than it. */
+      detach (elem);
+      heap->root = meld (heap, heap->root, elem);
+    }
+}
+
+/* Restores HEAP's ordering after ELEM's key has changed in any
+   way.  ELEM must be in HEAP.  Use heap_decrease() instead if the
+   key only moved toward the front, which is cheaper. */
+void
+heap_update (struct heap *heap, struct heap_elem *elem) 
+{
+  heap_remove (heap, elem);
+  heap_push (heap, elem);
+}
+
+/* Melds the heaps rooted at A and B, either of which may be
+   null, and returns the root of the result. */
+static struct heap_elem *
+meld (struct heap *heap, struct heap_elem *a, struct heap_elem *b) 
+{
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+
+  /* Make A the smaller root.  On a tie, keep A, so that the
+     existing root stays put. */
+  if (heap->less (b, a, heap->aux))
+    {
+      struct heap_elem *t = a;
+      a = b;
+      b = t;
+    }
+
+  /* Make B the leftmost child of A. */
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  a->child = b;
+
+  a->prev = a->next = NULL;
+  return a;
+}
+
+/* Combines the sibling list starting at FIRST into a single heap
+   by the standard two-pass method: meld siblings pairwise from
+   left to right, then meld the pairs from right to left.
+   Returns the new root, or null if FIRST is null. */
+static struct heap_elem *
+merge_pairs (struct heap *heap, struct heap_elem *first) 
+{
+  struct heap_elem *pairs = NULL;       /* Melded pairs, as a stack. */
+  struct heap_elem *result;
+
+  /* First pass.  Each melded pair is pushed onto PAIRS through
+     its `next' member, so the stack is in right-to-left order. */
+  while (first != NULL)
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+      struct heap_elem *pair;
+
+      if (b != NULL)
+        {
+          first = b->next;
+          a->prev = a->next = NULL;
+          b->prev = b->next = NULL;
+          pair = meld (heap, a, b);
+        }
+      else
+        {
+          first = NULL;
+          a->prev = a->next = NULL;
+          pair = a;
+        }
+      pair->next = pairs;
+      pairs = pair;
+    }
+
+  /* Second pass. */
+  result = NULL;
+  while (pairs != NULL)
+    {
+      struct heap_elem *pair = pairs;
+
+      pairs = pair->next;
+      pair->next = NULL;
+      result = meld (heap, result, pair);
+    }
+  return result;
+}
+
+/* Unlinks non-root ELEM, with its subtree, from its parent or
+   siblings. */
+static void
+detach (struct heap_elem *elem) 
+{
+  ASSERT (elem->prev != NULL);
+
+  if (elem->prev->child == elem)
+    elem->prev->child = elem->next;     /* Leftmost child. */
+  else
+    elem->prev->next = elem->next;
+  if (elem->next != NULL)
+    elem->next->prev = elem->prev;
+  elem->prev = elem->next = NULL;
+}
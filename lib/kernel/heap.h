@@ -0,0 +1,88 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Pairing heap.
+
+   A priority queue that, like the list and hash table, requires
+   no dynamically allocated memory.  Each structure that can be
+   in a heap embeds a struct heap_elem member, and heap_entry()
+   converts a struct heap_elem back to the structure that
+   contains it, just like list_entry().
+
+   The heap is ordered by a caller-supplied heap_less_func and
+   yields its least element first.  Costs are:
+
+     - heap_push(), heap_min(): O(1).
+
+     - heap_pop_min(), heap_remove(): O(log n) amortized.
+
+     - heap_decrease(), after an element's key has moved toward
+       the front of the heap: O(1), with an o(log n) amortized
+       effect on later pops.
+
+     - heap_update(), after an element's key has changed in
+       either direction: O(log n) amortized.
+
+   Changing a key without telling the heap leaves the heap
+   structurally valid, but elements may then come out in the
+   wrong order.
+
+   Since the heap never allocates and every operation is bounded
+   by the number of elements, it is safe to use with interrupts
+   off, and it has no capacity limit.  That is also why it is a
+   pairing heap rather than a binary heap, which would need an
+   array of element pointers sized in advance.
+
+   The heap does not keep equal elements in insertion order.
+   Callers that need FIFO order among equals should break ties
+   in their heap_less_func, for example with a sequence number. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem
+  {
+    struct heap_elem *child;    /* Leftmost child. */
+    struct heap_elem *next;     /* Next sibling to the right. */
+    struct heap_elem *prev;     /* Left sibling, or parent if leftmost. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->next     \
+                     - offsetof (STRUCT, MEMBER.next)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A should come out of the
+   heap before B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Heap. */
+struct heap
+  {
+    struct heap_elem *root;     /* Least element, or null if empty. */
+    size_t size;                /* Number of elements. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+
+bool heap_empty (const struct heap *);
+size_t heap_size (const struct heap *);
+
+void heap_push (struct heap *, struct heap_elem *);
+struct heap_elem *heap_min (const struct heap *);
+struct heap_elem *heap_pop_min (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+void heap_decrease (struct heap *, struct heap_elem *);
+void heap_update (struct heap *, struct heap_elem *);
+
+#endif /* lib/kernel/heap.h */
@@ -1,4 +1,5 @@
 #include "list.h"
+#include <limits.h>
 #include "../debug.h"
 
 /* Our doubly linked lists have two header elements: the "head"
@@ -34,149 +35,6 @@
 static bool is_sorted (struct list_elem *a, struct list_elem *b,
                        list_less_func *less, void *aux) UNUSED;
 
-/* Returns true if ELEM is a head, false otherwise. */
-static inline bool
-is_head (struct list_elem *elem)
-{
-  return elem != NULL && elem->prev == NULL && elem->next != NULL;
-}
-
-/* Returns true if ELEM is an interior element,
-   false otherwise. */
-static inline bool
-is_interior (struct list_elem *elem)
-{
-  return elem != NULL && elem->prev != NULL && elem->next != NULL;
-}
-
-/* Returns true if ELEM is a tail, false otherwise. */
-static inline bool
-is_tail (struct list_elem *elem)
-{
-  return elem != NULL && elem->prev != NULL && elem->next == NULL;
-}
-
-/* Initializes LIST as an empty list. */
-void
-list_init (struct list *list)
-{
-  ASSERT (list != NULL);
-  list->head.prev = NULL;
-  list->head.next = &list->tail;
-  list->tail.prev = &list->head;
-  list->tail.next = NULL;
-}
-
-/* Returns the beginning of LIST.  */
-struct list_elem *
-list_begin (struct list *list)
-{
-  ASSERT (list != NULL);
-  return list->head.next;
-}
-
-/* Returns the element after ELEM in its list.  If ELEM is the
-   last element in its list, returns the list tail.  Results are
-   undefined if ELEM is itself a list tail. */
-struct list_elem *
-list_next (struct list_elem *elem)
-{
-  ASSERT (is_head (elem) || is_interior (elem));
-  return elem->next;
-}
-
-/* Returns LIST's tail.
-
-   list_end() is often used in iterating through a list from
-   front to back.  See the big comment at the top of list.h for
-   an example. */
-struct list_elem *
-list_end (struct list *list)
-{
-  ASSERT (list != NULL);
-  return &list->tail;
-}
-
-/* Returns the LIST's reverse beginning, for iterating through
-   LIST in reverse order, from back to front. */
-struct list_elem *
-list_rbegin (struct list *list) 
-{
-  ASSERT (list != NULL);
-  return list->tail.prev;
-}
-
-/* Returns the element before ELEM in its list.  If ELEM is the
-   first element in its list, returns the list head.  Results are
-   undefined if ELEM is itself a list head. */
-struct list_elem *
-list_prev (struct list_elem *elem)
-{
-  ASSERT (is_interior (elem) || is_tail (elem));
-  return elem->prev;
-}
-
-/* Returns LIST's head.
-
-   list_rend() is often used in iterating through a list in
-   reverse order, from back to front.  Here's typical usage,
-   following the example from the top of list.h:
-
-      for (e = list_rbegin (&foo_list); e != list_rend (&foo_list);
-           e = list_prev (e))
-        {
-          struct foo *f = list_entry (e, struct foo, elem);
-          ...do something with f...
-        }
-*/
-struct list_elem *
-list_rend (struct list *list) 
-{
-  ASSERT (list != NULL);
-  return &list->head;
-}
-
-/* Return's LIST's head.
-
-   list_head() can be used for an alternate style of iterating
-   through a list, e.g.:
-
-      e = list_head (&list);
-      while ((e = list_next (e)) != list_end (&list)) 
-        {
-          ...
-        }
-*/
-struct list_elem *
-list_head (struct list *list) 
-{
-  ASSERT (list != NULL);
-  return &list->head;
-}
-
-/* Return's LIST's tail. */
-struct list_elem *
-list_tail (struct list *list) 
-{
-  ASSERT (list != NULL);
-  return &list->tail;
-}
-
-/* Inserts ELEM just before BEFORE, which may be either an
-   interior element or a tail.  The latter case is equivalent to
-   list_push_back(). */
-void
-list_insert (struct list_elem *before, struct list_elem *elem)
-{
-  ASSERT (is_interior (before) || is_tail (before));
-  ASSERT (elem != NULL);
-
-  elem->prev = before->prev;
-  elem->next = before;
-  before->prev->next = elem;
-  before->prev = elem;
-}
-
 /* Removes elements FIRST though LAST (exclusive) from their
    current list, then inserts them just before BEFORE, which may
    be either an interior element or a tail. */
@@ -184,13 +42,13 @@ void
 list_splice (struct list_elem *before,
              struct list_elem *first, struct list_elem *last)
 {
-  ASSERT (is_interior (before) || is_tail (before));
+  ASSERT (list_is_interior (before) || list_is_tail (before));
   if (first == last)
     return;
   last = list_prev (last);
 
-  ASSERT (is_interior (first));
-  ASSERT (is_interior (last));
+  ASSERT (list_is_interior (first));
+  ASSERT (list_is_interior (last));
 
   /* Cleanly remove FIRST...LAST from its current list. */
   first->prev->next = last->next;
@@ -203,95 +61,6 @@ list_splice (struct list_elem *before,
   before->prev = last;
 }
 
-/* Inserts ELEM at the beginning of LIST, so that it becomes the
-   front in LIST. */
-void
-list_push_front (struct list *list, struct list_elem *elem)
-{
-  list_insert (list_begin (list), elem);
-}
-
-/* Inserts ELEM at the end of LIST, so that it becomes the
-   back in LIST. */
-void
-list_push_back (struct list *list, struct list_elem *elem)
-{
-  list_insert (list_end (list), elem);
-}
-
-/* Removes ELEM from its list and returns the element that
-   followed it.  Undefined behavior if ELEM is not in a list.
-
-   A list element must be treated very carefully after removing
-   it from its list.  Calling list_next() or list_prev() on ELEM
-   will return the item that was previously before or after ELEM,
-   but, e.g., list_prev(list_next(ELEM)) is no longer ELEM!
-
-   The list_remove() return value provides a convenient way to
-   iterate and remove elements from a list:
-
-   for (e = list_begin (&list); e != list_end (&list); e = list_remove (e))
-     {
-       ...do something with e...
-     }
-
-   If you need to free() elements of the list then you need to be
-   more conservative.  Here's an alternate strategy that works
-   even in that case:
-
-   while (!list_empty (&list))
-     {
-       struct list_elem *e = list_pop_front (&list);
-       ...do something with e...
-     }
-*/
-struct list_elem *
-list_remove (struct list_elem *elem)
-{
-  ASSERT (is_interior (elem));
-  elem->prev->next = elem->next;
-  elem->next->prev = elem->prev;
-  return elem->next;
-}
-
-/* Removes the front element from LIST and returns it.
-   Undefined behavior if LIST is empty before removal. */
-struct list_elem *
-list_pop_front (struct list *list)
-{
-  struct list_elem *front = list_front (list);
-  list_remove (front);
-  return front;
-}
-
-/* Removes the back element from LIST and returns it.
-   Undefined behavior if LIST is empty before removal. */
-struct list_elem *
-list_pop_back (struct list *list)
-{
-  struct list_elem *back = list_back (list);
-  list_remove (back);
-  return back;
-}
-
-/* Returns the front element in LIST.
-   Undefined behavior if LIST is empty. */
-struct list_elem *
-list_front (struct list *list)
-{
-  ASSERT (!list_empty (list));
-  return list->head.next;
-}
-
-/* Returns the back element in LIST.
-   Undefined behavior if LIST is empty. */
-struct list_elem *
-list_back (struct list *list)
-{
-  ASSERT (!list_empty (list));
-  return list->tail.prev;
-}
-
 /* Returns the number of elements in LIST.
    Runs in O(n) in the number of elements. */
 size_t
@@ -305,13 +74,6 @@ list_size (struct list *list)
   return cnt;
 }
 
-/* Returns true if LIST is empty, false otherwise. */
-bool
-list_empty (struct list *list)
-{
-  return list_begin (list) == list_end (list);
-}
-
 /* Swaps the `struct list_elem *'s that A and B point to. */
 static void
 swap (struct list_elem **a, struct list_elem **b) 
@@ -349,92 +111,138 @@ is_sorted (struct list_elem *a, struct list_elem *b,
   return true;
 }
 
-/* Finds a run, starting at A and ending not after B, of list
-   elements that are in nondecreasing order according to LESS
-   given auxiliary data AUX.  Returns the (exclusive) end of the
-   run.
-   A through B (exclusive) must form a non-empty range. */
+/* Number of elements in each run that list_sort() builds by
+   insertion sort before it starts merging.  Insertion sort is
+   faster than merging for runs this short. */
+#define SORT_RUN 8
+
+/* Merges the sorted, null-terminated chains A and B, linked
+   through their `next' members, and returns the merged chain.
+   Elements of A come before equal elements of B, so merging
+   preserves the order of equal elements as long as A precedes B
+   in the original list. */
 static struct list_elem *
-find_end_of_run (struct list_elem *a, struct list_elem *b,
-                 list_less_func *less, void *aux)
+merge_chains (struct list_elem *a, struct list_elem *b,
+              list_less_func *less, void *aux)
 {
-  ASSERT (a != NULL);
-  ASSERT (b != NULL);
-  ASSERT (less != NULL);
-  ASSERT (a != b);
-  
-  do 
-    {
-      a = list_next (a);
-    }
-  while (a != b && !less (a, list_prev (a), aux));
-  return a;
-}
+  struct list_elem head;
+  struct list_elem *tail = &head;
 
-/* Merges A0 through A1B0 (exclusive) with A1B0 through B1
-   (exclusive) to form a combined range also ending at B1
-   (exclusive).  Both input ranges must be nonempty and sorted in
-   nondecreasing order according to LESS given auxiliary data
-   AUX.  The output range will be sorted the same way. */
-static void
-inplace_merge (struct list_elem *a0, struct list_elem *a1b0,
-               struct list_elem *b1,
-               list_less_func *less, void *aux)
-{
-  ASSERT (a0 != NULL);
-  ASSERT (a1b0 != NULL);
-  ASSERT (b1 != NULL);
-  ASSERT (less != NULL);
-  ASSERT (is_sorted (a0, a1b0, less, aux));
-  ASSERT (is_sorted (a1b0, b1, less, aux));
-
-  while (a0 != a1b0 && a1b0 != b1)
-    if (!less (a1b0, a0, aux)) 
-      a0 = list_next (a0);
+  while (a != NULL && b != NULL)
+    if (less (b, a, aux)) 
+      {
+        tail->next = b;
+        tail = b;
+        b = b->next;
+      }
     else 
       {
-        a1b0 = list_next (a1b0);
-        list_splice (a0, list_prev (a1b0), a1b0);
+        tail->next = a;
+        tail = a;
+        a = a->next;
       }
+  tail->next = a != NULL ? a : b;
+  return head.next;
+}
+
+/* Removes up to SORT_RUN elements from the front of the
+   null-terminated chain *CHAIN and returns them as a sorted
+   chain, built by insertion sort. */
+static struct list_elem *
+take_run (struct list_elem **chain, list_less_func *less, void *aux)
+{
+  struct list_elem *run = NULL;
+  struct list_elem *last = NULL;
+  int i;
+
+  for (i = 0; i < SORT_RUN && *chain != NULL; i++) 
+    {
+      struct list_elem *e = *chain;
+      *chain = e->next;
+
+      if (last == NULL || !less (e, last, aux)) 
+        {
+          /* Common case: E goes at the end. */
+          e->next = NULL;
+          if (last != NULL)
+            last->next = e;
+          else
+            run = e;
+          last = e;
+        }
+      else 
+        {
+          /* Insert E after every element not greater than it. */
+          struct list_elem **p = &run;
+          while (!less (e, *p, aux))
+            p = &(*p)->next;
+          e->next = *p;
+          *p = e;
+        }
+    }
+  return run;
 }
 
 /* Sorts LIST according to LESS given auxiliary data AUX, using a
-   natural iterative merge sort that runs in O(n lg n) time and
-   O(1) space in the number of elements in LIST. */
+   bottom-up merge sort that runs in O(n lg n) time and O(1)
+   space in the number of elements in LIST.  The sort is stable:
+   equal elements keep their relative order.
+
+   The list is first unlinked into a null-terminated chain.  Runs
+   of SORT_RUN elements are cut from its front and fed to
+   pending[], which works like a binary counter: pending[i] is
+   either empty or a sorted run of SORT_RUN * 2**i elements, and
+   adding a run merges it upward through the occupied slots.  So
+   each element is visited once per merge level rather than once
+   per pass over the whole list. */
 void
 list_sort (struct list *list, list_less_func *less, void *aux)
 {
-  size_t output_run_cnt;        /* Number of runs output in current pass. */
+  struct list_elem *pending[sizeof (size_t) * CHAR_BIT];
+  struct list_elem *chain, *run, *prev, *e;
+  size_t level_cnt = 0;
+  size_t i;
 
   ASSERT (list != NULL);
   ASSERT (less != NULL);
 
-  /* Pass over the list repeatedly, merging adjacent runs of
-     nondecreasing elements, until only one run is left. */
-  do
-    {
-      struct list_elem *a0;     /* Start of first run. */
-      struct list_elem *a1b0;   /* End of first run, start of second. */
-      struct list_elem *b1;     /* End of second run. */
+  if (list_empty (list))
+    return;
 
-      output_run_cnt = 0;
-      for (a0 = list_begin (list); a0 != list_end (list); a0 = b1)
+  /* Unlink the elements into a chain. */
+  chain = list_front (list);
+  list_back (list)->next = NULL;
+
+  /* Merge runs into pending[]. */
+  while (chain != NULL) 
+    {
+      run = take_run (&chain, less, aux);
+      for (i = 0; i < level_cnt && pending[i] != NULL; i++) 
         {
-          /* Each iteration produces one output run. */
-          output_run_cnt++;
-
-          /* Locate two adjacent runs of nondecreasing elements
-             A0...A1B0 and A1B0...B1. */
-          a1b0 = find_end_of_run (a0, list_end (list), less, aux);
-          if (a1b0 == list_end (list))
-            break;
-          b1 = find_end_of_run (a1b0, list_end (list), less, aux);
-
-          /* Merge the runs. */
-          inplace_merge (a0, a1b0, b1, less, aux);
+          run = merge_chains (pending[i], run, less, aux);
+          pending[i] = NULL;
         }
+      if (i == level_cnt)
+        level_cnt++;
+      pending[i] = run;
+    }
+
+  /* Merge what is left, from the most recent run to the oldest. */
+  run = NULL;
+  for (i = 0; i < level_cnt; i++)
+    if (pending[i] != NULL)
+      run = run != NULL ? merge_chains (pending[i], run, less, aux) : pending[i];
+
+  /* Relink the sorted chain into LIST, restoring `prev' links. */
+  prev = &list->head;
+  for (e = run; e != NULL; e = e->next) 
+    {
+      prev->next = e;
+      e->prev = prev;
+      prev = e;
     }
-  while (output_run_cnt > 1);
+  prev->next = &list->tail;
+  list->tail.prev = prev;
 
   ASSERT (is_sorted (list_begin (list), list_end (list), less, aux));
 }
@@ -82,10 +82,28 @@
        not have any interior elements.
 */
 
+#include <debug.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+/* The operations that take O(1) time are defined inline at the
+   end of this file, so that walking or updating a list costs no
+   call per step.  LIST_DEBUG says how much they check their
+   arguments: 0 for not at all, 1 (the default) for whether each
+   element is a head, tail, or interior element as expected.
+   Building with -DLIST_DEBUG=0 drops these checks from the hot
+   paths while keeping every other ASSERT; NDEBUG turns off all
+   of them, as usual. */
+#ifndef LIST_DEBUG
+#define LIST_DEBUG 1
+#endif
+#if LIST_DEBUG
+#define LIST_ASSERT(CONDITION) ASSERT (CONDITION)
+#else
+#define LIST_ASSERT(CONDITION) ((void) 0)
+#endif
+
 /* List element. */
 struct list_elem 
   {
@@ -122,39 +140,39 @@ struct list
 #define LIST_INITIALIZER(NAME) { { NULL, &(NAME).tail }, \
                                  { &(NAME).head, NULL } }
 
-void list_init (struct list *);
+static inline void list_init (struct list *);
 
 /* List traversal. */
-struct list_elem *list_begin (struct list *);
-struct list_elem *list_next (struct list_elem *);
-struct list_elem *list_end (struct list *);
+static inline struct list_elem *list_begin (struct list *);
+static inline struct list_elem *list_next (struct list_elem *);
+static inline struct list_elem *list_end (struct list *);
 
-struct list_elem *list_rbegin (struct list *);
-struct list_elem *list_prev (struct list_elem *);
-struct list_elem *list_rend (struct list *);
+static inline struct list_elem *list_rbegin (struct list *);
+static inline struct list_elem *list_prev (struct list_elem *);
+static inline struct list_elem *list_rend (struct list *);
 
-struct list_elem *list_head (struct list *);
-struct list_elem *list_tail (struct list *);
+static inline struct list_elem *list_head (struct list *);
+static inline struct list_elem *list_tail (struct list *);
 
 /* List insertion. */
-void list_insert (struct list_elem *, struct list_elem *);
+static inline void list_insert (struct list_elem *, struct list_elem *);
 void list_splice (struct list_elem *before,
                   struct list_elem *first, struct list_elem *last);
-void list_push_front (struct list *, struct list_elem *);
-void list_push_back (struct list *, struct list_elem *);
+static inline void list_push_front (struct list *, struct list_elem *);
+static inline void list_push_back (struct list *, struct list_elem *);
 
 /* List removal. */
-struct list_elem *list_remove (struct list_elem *);
-struct list_elem *list_pop_front (struct list *);
-struct list_elem *list_pop_back (struct list *);
+static inline struct list_elem *list_remove (struct list_elem *);
+static inline struct list_elem *list_pop_front (struct list *);
+static inline struct list_elem *list_pop_back (struct list *);
 
 /* List elements. */
-struct list_elem *list_front (struct list *);
-struct list_elem *list_back (struct list *);
+static inline struct list_elem *list_front (struct list *);
+static inline struct list_elem *list_back (struct list *);
 
 /* List properties. */
 size_t list_size (struct list *);
-bool list_empty (struct list *);
+static inline bool list_empty (struct list *);
 
 /* Miscellaneous. */
 void list_reverse (struct list *);
@@ -178,4 +196,245 @@ void list_unique (struct list *, struct list *duplicates,
 struct list_elem *list_max (struct list *, list_less_func *, void *aux);
 struct list_elem *list_min (struct list *, list_less_func *, void *aux);
 
+/* Inline operations. */
+
+/* Returns true if ELEM is a head, false otherwise. */
+static inline bool
+list_is_head (struct list_elem *elem)
+{
+  return elem != NULL && elem->prev == NULL && elem->next != NULL;
+}
+
+/* Returns true if ELEM is an interior element,
+   false otherwise. */
+static inline bool
+list_is_interior (struct list_elem *elem)
+{
+  return elem != NULL && elem->prev != NULL && elem->next != NULL;
+}
+
+/* Returns true if ELEM is a tail, false otherwise. */
+static inline bool
+list_is_tail (struct list_elem *elem)
+{
+  return elem != NULL && elem->prev != NULL && elem->next == NULL;
+}
+
+/* Initializes LIST as an empty list. */
+static inline void
+list_init (struct list *list)
+{
+  LIST_ASSERT (list != NULL);
+  list->head.prev = NULL;
+  list->head.next = &list->tail;
+  list->tail.prev = &list->head;
+  list->tail.next = NULL;
+}
+
+/* Returns the beginning of LIST.  */
+static inline struct list_elem *
+list_begin (struct list *list)
+{
+  LIST_ASSERT (list != NULL);
+  return list->head.next;
+}
+
+/* Returns the element after ELEM in its list.  If ELEM is the
+   last element in its list, returns the list tail.  Results are
+   undefined if ELEM is itself a list tail. */
+static inline struct list_elem *
+list_next (struct list_elem *elem)
+{
+  LIST_ASSERT (list_is_head (elem) || list_is_interior (elem));
+  return elem->next;
+}
+
+/* Returns LIST's tail.
+
+   list_end() is often used in iterating through a list from
+   front to back.  See the big comment at the top of list.h for
+   an example. */
+static inline struct list_elem *
+list_end (struct list *list)
+{
+  LIST_ASSERT (list != NULL);
+  return &list->tail;
+}
+
+/* Returns the LIST's reverse beginning, for iterating through
+   LIST in reverse order, from back to front. */
+static inline struct list_elem *
+list_rbegin (struct list *list)
+{
+  LIST_ASSERT (list != NULL);
+  return list->tail.prev;
+}
+
+/* Returns the element before ELEM in its list.  If ELEM is the
+   first element in its list, returns the list head.  Results are
+   undefined if ELEM is itself a list head. */
+static inline struct list_elem *
+list_prev (struct list_elem *elem)
+{
+  LIST_ASSERT (list_is_interior (elem) || list_is_tail (elem));
+  return elem->prev;
+}
+
+/* Returns LIST's head.
+
+   list_rend() is often used in iterating through a list in
+   reverse order, from back to front.  Here's typical usage,
+   following the example from the top of list.h:
+
+      for (e = list_rbegin (&foo_list); e != list_rend (&foo_list);
+           e = list_prev (e))
+        {
+          struct foo *f = list_entry (e, struct foo, elem);
+          ...do something with f...
+        }
+*/
+static inline struct list_elem *
+list_rend (struct list *list)
+{
+  LIST_ASSERT (list != NULL);
+  return &list->head;
+}
+
+/* Return's LIST's head.
+
+   list_head() can be used for an alternate style of iterating
+   through a list, e.g.:
+
+      e = list_head (&list);
+      while ((e = list_next (e)) != list_end (&list))
+        {
+          ...
+        }
+*/
+static inline struct list_elem *
+list_head (struct list *list)
+{
+  LIST_ASSERT (list != NULL);
+  return &list->head;
+}
+
+/* Return's LIST's tail. */
+static inline struct list_elem *
+list_tail (struct list *list)
+{
+  LIST_ASSERT (list != NULL);
+  return &list->tail;
+}
+
+/* Inserts ELEM just before BEFORE, which may be either an
+   interior element or a tail.  The latter case is equivalent to
+   list_push_back(). */
+static inline void
+list_insert (struct list_elem *before, struct list_elem *elem)
+{
+  LIST_ASSERT (list_is_interior (before) || list_is_tail (before));
+  LIST_ASSERT (elem != NULL);
+
+  elem->prev = before->prev;
+  elem->next = before;
+  before->prev->next = elem;
+  before->prev = elem;
+}
+
+/* Inserts ELEM at the beginning of LIST, so that it becomes the
+   front in LIST. */
+static inline void
+list_push_front (struct list *list, struct list_elem *elem)
+{
+  list_insert (list_begin (list), elem);
+}
+
+/* Inserts ELEM at the end of LIST, so that it becomes the
+   back in LIST. */
+static inline void
+list_push_back (struct list *list, struct list_elem *elem)
+{
+  list_insert (list_end (list), elem);
+}
+
+/* Returns true if LIST is empty, false otherwise. */
+static inline bool
+list_empty (struct list *list)
+{
+  return list_begin (list) == list_end (list);
+}
+
+/* Returns the front element in LIST.
+   Undefined behavior if LIST is empty. */
+static inline struct list_elem *
+list_front (struct list *list)
+{
+  LIST_ASSERT (!list_empty (list));
+  return list->head.next;
+}
+
+/* Returns the back element in LIST.
+   Undefined behavior if LIST is empty. */
+static inline struct list_elem *
+list_back (struct list *list)
+{
+  LIST_ASSERT (!list_empty (list));
+  return list->tail.prev;
+}
+
+/* Removes ELEM from its list and returns the element that
+   followed it.  Undefined behavior if ELEM is not in a list.
+
+   A list element must be treated very carefully after removing
+   it from its list.  Calling list_next() or list_prev() on ELEM
+   will return the item that was previously before or after ELEM,
+   but, e.g., list_prev(list_next(ELEM)) is no longer ELEM!
+
+   The list_remove() return value provides a convenient way to
+   iterate and remove elements from a list:
+
+   for (e = list_begin (&list); e != list_end (&list); e = list_remove (e))
+     {
+       ...do something with e...
+     }
+
+   If you need to free() elements of the list then you need to be
+   more conservative.  Here's an alternate strategy that works
+   even in that case:
+
+   while (!list_empty (&list))
+     {
+       struct list_elem *e = list_pop_front (&list);
+       ...do something with e...
+     }
+*/
+static inline struct list_elem *
+list_remove (struct list_elem *elem)
+{
+  LIST_ASSERT (list_is_interior (elem));
+  elem->prev->next = elem->next;
+  elem->next->prev = elem->prev;
+  return elem->next;
+}
+
+/* Removes the front element from LIST and returns it.
+   Undefined behavior if LIST is empty before removal. */
+static inline struct list_elem *
+list_pop_front (struct list *list)
+{
+  struct list_elem *front = list_front (list);
+  list_remove (front);
+  return front;
+}
+
+/* Removes the back element from LIST and returns it.
+   Undefined behavior if LIST is empty before removal. */
+static inline struct list_elem *
+list_pop_back (struct list *list)
+{
+  struct list_elem *back = list_back (list);
+  list_remove (back);
+  return back;
+}
+
 #endif /* lib/kernel/list.h */
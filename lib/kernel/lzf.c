@@ -0,0 +1,168 @@
+#include "lzf.h"
+#include <stdint.h>
+#include <string.h>
+#include "../debug.h"
+
+/* Encoding.  Each item starts with a control byte C:
+
+     - C < 32: C + 1 literal bytes follow.
+
+     - Otherwise a back-reference.  LEN = C >> 5, extended by a
+       following byte if it is 7, and OFS = (C & 0x1f) << 8 plus
+       the next byte.  The item copies LEN + 2 bytes from OFS + 1
+       bytes before the current output position.  The copy may
+       overlap its own output, which repeats a short pattern. */
+
+#define MAX_LIT 32                      /* Longest literal run. */
+#define MAX_OFS (1 << 13)               /* Farthest reference, plus 1. */
+#define MIN_REF 3                       /* Shortest reference. */
+#define MAX_REF (7 + 255 + 2)           /* Longest reference. */
+
+/* The hash table holds, for each hash of 3 bytes, the position
+   plus 1 where such bytes were last seen, or 0. */
+#define HASH_BITS 11
+#define HASH_CNT (1 << HASH_BITS)
+
+/* Returns the hash of the 3 bytes at P. */
+static inline unsigned
+hash3 (const uint8_t *p)
+{
+  uint32_t v = (uint32_t) p[0] << 16 | p[1] << 8 | p[2];
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Appends the LEN literal bytes at LIT to *OP, which must not
+   pass END.  Returns false if there is not room. */
+static bool
+put_literals (uint8_t **op, uint8_t *end, const uint8_t *lit, size_t len)
+{
+  while (len > 0)
+    {
+      size_t n = len < MAX_LIT ? len : MAX_LIT;
+
+      if ((size_t) (end - *op) < n + 1)
+        return false;
+      *(*op)++ = n - 1;
+      memcpy (*op, lit, n);
+      *op += n;
+      lit += n;
+      len -= n;
+    }
+  return true;
+}
+
+/* Compresses the IN_LEN bytes at IN into at most OUT_MAX bytes
+   at OUT, using the LZF_WORK_SIZE bytes at WORK as scratch.
+   Returns the compressed size, or 0 if it would exceed
+   OUT_MAX. */
+size_t
+lzf_compress (const void *in_, size_t in_len, void *out_, size_t out_max,
+              void *work)
+{
+  const uint8_t *in = in_;
+  const uint8_t *ip = in;                 /* Next input byte. */
+  const uint8_t *lit = in;                /* Literals pending from here. */
+  const uint8_t *in_end = in + in_len;
+  uint8_t *op = out_;
+  uint8_t *out_end = op + out_max;
+  uint16_t *table = work;
+
+  ASSERT (in_len < 65536);
+  ASSERT (HASH_CNT * sizeof *table == LZF_WORK_SIZE);
+
+  memset (table, 0, LZF_WORK_SIZE);
+  while (in_end - ip >= MIN_REF)
+    {
+      unsigned h = hash3 (ip);
+      const uint8_t *ref = table[h] != 0 ? in + table[h] - 1 : NULL;
+
+      table[h] = ip - in + 1;
+      if (ref != NULL && ip - ref <= MAX_OFS
+          && ref[0] == ip[0] && ref[1] == ip[1] && ref[2] == ip[2])
+        {
+          size_t ofs = ip - ref - 1;
+          size_t max = in_end - ip < MAX_REF ? in_end - ip : MAX_REF;
+          size_t len = MIN_REF;
+
+          while (len < max && ref[len] == ip[len])
+            len++;
+
+          if (!put_literals (&op, out_end, lit, ip - lit)
+              || out_end - op < 3)
+            return 0;
+          len -= 2;
+          if (len < 7)
+            *op++ = (ofs >> 8) | len << 5;
+          else
+            {
+              *op++ = (ofs >> 8) | 7 << 5;
+              *op++ = len - 7;
+            }
+          *op++ = ofs;
+
+          ip += len + 2;
+          lit = ip;
+          if (in_end - ip >= MIN_REF)
+            table[hash3 (ip - 1)] = ip - in;
+        }
+      else
+        ip++;
+    }
+
+  if (!put_literals (&op, out_end, lit, in_end - lit))
+    return 0;
+  return op - (uint8_t *) out_;
+}
+
+/* Decompresses the IN_LEN bytes at IN into exactly OUT_LEN bytes
+   at OUT.  Returns false if IN is corrupt or does not decompress
+   to exactly OUT_LEN bytes. */
+bool
+lzf_decompress (const void *in_, size_t in_len, void *out_, size_t out_len)
+{
+  const uint8_t *ip = in_;
+  const uint8_t *in_end = ip + in_len;
+  uint8_t *out = out_;
+  uint8_t *op = out;
+  uint8_t *out_end = out + out_len;
+
+  while (ip < in_end)
+    {
+      unsigned c = *ip++;
+
+      if (c < MAX_LIT)
+        {
+          size_t n = c + 1;
+
+          if ((size_t) (in_end - ip) < n || (size_t) (out_end - op) < n)
+            return false;
+          memcpy (op, ip, n);
+          op += n;
+          ip += n;
+        }
+      else
+        {
+          size_t len = c >> 5;
+          size_t ofs;
+          const uint8_t *ref;
+
+          if (len == 7)
+            {
+              if (ip >= in_end)
+                return false;
+              len += *ip++;
+            }
+          if (ip >= in_end)
+            return false;
+          ofs = ((c & 0x1f) << 8 | *ip++) + 1;
+          len += 2;
+          if (ofs > (size_t) (op - out) || (size_t) (out_end - op) < len)
+            return false;
+
+          /* Byte by byte, since the source may overlap OP. */
+          for (ref = op - ofs; len > 0; len--)
+            *op++ = *ref++;
+        }
+    }
+  return op == out_end;
+}
@@ -0,0 +1,30 @@
+#ifndef __LIB_KERNEL_LZF_H
+#define __LIB_KERNEL_LZF_H
+
+/* LZF compression.
+
+   A byte-oriented LZ77 codec in the format of Marc Lehmann's
+   liblzf: the output alternates runs of up to 32 literal bytes
+   with back-references of 3 to 264 bytes to data up to 8 kB
+   earlier.  It finds matches through a small hash table of
+   recent 3-byte sequences, one probe per input position, so it
+   compresses a page in a few microseconds, trading ratio for
+   speed.  Zero-filled and repetitive data, which is common in
+   user memory, shrinks to a small fraction of its size.
+
+   The compressor needs LZF_WORK_SIZE bytes of scratch memory
+   from the caller, since that is too much for a kernel stack.
+   Inputs are limited to 64 kB. */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Bytes of scratch memory that lzf_compress() needs. */
+#define LZF_WORK_SIZE 4096
+
+size_t lzf_compress (const void *in, size_t in_len, void *out,
+                     size_t out_max, void *work);
+bool lzf_decompress (const void *in, size_t in_len, void *out,
+                     size_t out_len);
+
+#endif /* lib/kernel/lzf.h */
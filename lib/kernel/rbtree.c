@@ -0,0 +1,415 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+/* Red-black tree, following the algorithms in [CLRS] chapter 13,
+   "Red-Black Trees", with null pointers as the black leaves.
+
+   The tree keeps these invariants:
+
+     - Every red element has black children.
+
+     - Every path from an element down to a leaf passes through
+       the same number of black elements.
+
+   which together ensure that no path from the root is more than
+   twice as long as any other, so the height is O(log n). */
+
+/* Returns true if E is red.  Leaves are black. */
+static inline bool
+is_red (const struct rb_elem *e) 
+{
+  return e != NULL && e->red;
+}
+
+/* Makes NEW take OLD's place as a child of PARENT, which was
+   OLD's parent, or as the root of T if PARENT is null. */
+static void
+replace_child (struct rb_tree *t, struct rb_elem *parent,
+               struct rb_elem *old, struct rb_elem *new) 
+{
+  if (parent == NULL)
+    t->root = new;
+  else if (parent->left == old)
+    parent->left = new;
+  else
+    parent->right = new;
+}
+
+/* Rotates X's right child up into X's place:
+
+        X              Y
+       / \            / \
+      a   Y    =>    X   c
+         / \        / \
+        b   c      a   b
+*/
+static void
+rotate_left (struct rb_tree *t, struct rb_elem *x) 
+{
+  struct rb_elem *y = x->right;
+
+  x->right = y->left;
+  if (y->left != NULL)
+    y->left->parent = x;
+  y->parent = x->parent;
+  replace_child (t, x->parent, x, y);
+  y->left = x;
+  x->parent = y;
+}
+
+/* Rotates X's left child up into X's place, the mirror image of
+   rotate_left(). */
+static void
+rotate_right (struct rb_tree *t, struct rb_elem *x) 
+{
+  struct rb_elem *y = x->left;
+
+  x->left = y->right;
+  if (y->right != NULL)
+    y->right->parent = x;
+  y->parent = x->parent;
+  replace_child (t, x->parent, x, y);
+  y->right = x;
+  x->parent = y;
+}
+
+/* Returns the leftmost element of the subtree rooted at E. */
+static struct rb_elem *
+leftmost (struct rb_elem *e) 
+{
+  while (e->left != NULL)
+    e = e->left;
+  return e;
+}
+
+/* Returns the rightmost element of the subtree rooted at E. */
+static struct rb_elem *
+rightmost (struct rb_elem *e) 
+{
+  while (e->right != NULL)
+    e = e->right;
+  return e;
+}
+
+/* Initializes T as an empty tree ordered by LESS, given
+   auxiliary data AUX. */
+void
+rb_init (struct rb_tree *t, rb_less_func *less, void *aux) 
+{
+  ASSERT (t != NULL);
+  ASSERT (less != NULL);
+
+  t->root = NULL;
+  t->size = 0;
+  t->less = less;
+  t->aux = aux;
+}
+
+/* Returns true if T is empty, false otherwise. */
+bool
+rb_empty (const struct rb_tree *t) 
+{
+  return t->root == NULL;
+}
+
+/* Returns the number of elements in T. */
+size_t
+rb_size (const struct rb_tree *t) 
+{
+  return t->size;
+}
+
+/* Inserts E into T, after any elements equal to it. */
+void
+rb_insert (struct rb_tree *t, struct rb_elem *e) 
+{
+  struct rb_elem **link = &t->root;
+  struct rb_elem *parent = NULL;
+
+  ASSERT (e != NULL);
+
+  while (*link != NULL)
+    {
+      parent = *link;
+      link = t->less (e, parent, t->aux) ? &parent->left : &parent->right;
+    }
+  e->parent = parent;
+  e->left = e->right = NULL;
+  e->red = true;
+  *link = e;
+  t->size++;
+
+  /* E is red, so the only invariant that can fail is a red
+     element with a red parent.  Move the problem up the tree or
+     resolve it with rotations. */
+  while (is_red (e->parent))
+    {
+      struct rb_elem *p = e->parent;
+      struct rb_elem *g = p->parent;    /* Exists: the root is black. */
+
+      if (p == g->left)
+        {
+          struct rb_elem *uncle = g->right;
+          if (is_red (uncle))
+            {
+              p->red = uncle->red = false;
+              g->red = true;
+              e = g;
+              continue;
+            }
+          if (e == p->right)
+            {
+              rotate_left (t, p);
+              e = p;
+              p = e->parent;
+            }
+          p->red = false;
+          g->red = true;
+          rotate_right (t, g);
+        }
+      else
+        {
+          struct rb_elem *uncle = g->left;
+          if (is_red (uncle))
+            {
+              p->red = uncle->red = false;
+              g->red = true;
+              e = g;
+              continue;
+            }
+          if (e == p->left)
+            {
+              rotate_right (t, p);
+              e = p;
+              p = e->parent;
+            }
+          p->red = false;
+          g->red = true;
+          rotate_left (t, g);
+        }
+    }
+  t->root->red = false;
+}
+
+/* Restores the invariants after removing a black element from
+   T.  X, possibly null, took the removed element's place as a
+   child of PARENT and is one black element short on its paths. */
+static void
+erase_fixup (struct rb_tree *t, struct rb_elem *x, struct rb_elem *parent) 
+{
+  while (x != t->root && !is_red (x))
+    {
+      /* X's sibling W cannot be a leaf, because W's side has more
+         black elements than X's. */
+      if (x == parent->left)
+        {
+          struct rb_elem *w = parent->right;
+          if (w->red)
+            {
+              w->red = false;
+              parent->red = true;
+              rotate_left (t, parent);
+              w = parent->right;
+            }
+          if (!is_red (w->left) && !is_red (w->right))
+            {
+              w->red = true;
+              x = parent;
+              parent = x->parent;
+            }
+          else
+            {
+              if (!is_red (w->right))
+                {
+                  w->left->red = false;
+                  w->red = true;
+                  rotate_right (t, w);
+                  w = parent->right;
+                }
+              w->red = parent->red;
+              parent->red = false;
+              w->right->red = false;
+              rotate_left (t, parent);
+              x = t->root;
+            }
+        }
+      else
+        {
+          struct rb_elem *w = parent->left;
+          if (w->red)
+            {
+              w->red = false;
+              parent->red = true;
+              rotate_right (t, parent);
+              w = parent->left;
+            }
+          if (!is_red (w->left) && !is_red (w->right))
+            {
+              w->red = true;
+              x = parent;
+              parent = x->parent;
+            }
+          else
+            {
+              if (!is_red (w->left))
+                {
+                  w->right->red = false;
+                  w->red = true;
+                  rotate_left (t, w);
+                  w = parent->left;
+                }
+              w->red = parent->red;
+              parent->red = false;
+              w->left->red = false;
+              rotate_right (t, parent);
+              x = t->root;
+            }
+        }
+    }
+  if (x != NULL)
+    x->red = false;
+}
+
+/* Removes E, which must be in T, from T. */
+void
+rb_erase (struct rb_tree *t, struct rb_elem *e) 
+{
+  struct rb_elem *child, *parent;
+  bool removed_red;
+
+  ASSERT (e != NULL);
+  ASSERT (t->size > 0);
+
+  if (e->left == NULL || e->right == NULL)
+    {
+      /* E has at most one child, which takes its place. */
+      child = e->left != NULL ? e->left : e->right;
+      parent = e->parent;
+      removed_red = e->red;
+      if (child != NULL)
+        child->parent = parent;
+      replace_child (t, parent, e, child);
+    }
+  else
+    {
+      /* E's successor Y, which has no left child, takes E's
+         place and color, so the element really removed from the
+         shape of the tree is Y. */
+      struct rb_elem *y = leftmost (e->right);
+
+      removed_red = y->red;
+      child = y->right;
+      if (y->parent == e)
+        parent = y;
+      else
+        {
+          parent = y->parent;
+          parent->left = child;
+          if (child != NULL)
+            child->parent = parent;
+          y->right = e->right;
+          e->right->parent = y;
+        }
+      y->left = e->left;
+      e->left->parent = y;
+      y->parent = e->parent;
+      replace_child (t, e->parent, e, y);
+      y->red = e->red;
+    }
+  t->size--;
+
+  if (!removed_red)
+    erase_fixup (t, child, parent);
+}
+
+/* Returns the first element in T not less than KEY, or a null
+   pointer if there is none. */
+struct rb_elem *
+rb_lower_bound (const struct rb_tree *t, const struct rb_elem *key) 
+{
+  struct rb_elem *e = t->root;
+  struct rb_elem *bound = NULL;
+
+  while (e != NULL)
+    if (!t->less (e, key, t->aux))
+      {
+        bound = e;
+        e = e->left;
+      }
+    else
+      e = e->right;
+  return bound;
+}
+
+/* Returns the first element in T greater than KEY, or a null
+   pointer if there is none. */
+struct rb_elem *
+rb_upper_bound (const struct rb_tree *t, const struct rb_elem *key) 
+{
+  struct rb_elem *e = t->root;
+  struct rb_elem *bound = NULL;
+
+  while (e != NULL)
+    if (t->less (key, e, t->aux))
+      {
+        bound = e;
+        e = e->left;
+      }
+    else
+      e = e->right;
+  return bound;
+}
+
+/* Returns the first element in T equal to KEY, or a null pointer
+   if there is none. */
+struct rb_elem *
+rb_find (const struct rb_tree *t, const struct rb_elem *key) 
+{
+  struct rb_elem *e = rb_lower_bound (t, key);
+
+  return e != NULL && !t->less (key, e, t->aux) ? e : NULL;
+}
+
+/* Returns the least element in T, or a null pointer if T is
+   empty. */
+struct rb_elem *
+rb_first (const struct rb_tree *t) 
+{
+  return t->root != NULL ? leftmost (t->root) : NULL;
+}
+
+/* Returns the greatest element in T, or a null pointer if T is
+   empty. */
+struct rb_elem *
+rb_last (const struct rb_tree *t) 
+{
+  return t->root != NULL ? rightmost (t->root) : NULL;
+}
+
+/* Returns the element after E in its tree, or a null pointer if
+   E is the last. */
+struct rb_elem *
+rb_next (struct rb_elem *e) 
+{
+  ASSERT (e != NULL);
+
+  if (e->right != NULL)
+    return leftmost (e->right);
+  while (e->parent != NULL && e == e->parent->right)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the element before E in its tree, or a null pointer if
+   E is the first. */
+struct rb_elem *
+rb_prev (struct rb_elem *e) 
+{
+  ASSERT (e != NULL);
+
+  if (e->left != NULL)
+    return rightmost (e->left);
+  while (e->parent != NULL && e == e->parent->left)
+    e = e->parent;
+  return e->parent;
+}
@@ -0,0 +1,94 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+
+   A balanced binary search tree that, like the list and hash
+   table, requires no dynamically allocated memory.  Each
+   structure that can be in a tree embeds a struct rb_elem
+   member, and rb_entry() converts a struct rb_elem back to the
+   structure that contains it, just like list_entry().
+
+   The tree is ordered by a caller-supplied rb_less_func.
+   Insertion, removal, and lookup take O(log n) time; stepping to
+   the next or previous element takes O(1) amortized time.
+   Equal elements are allowed and are kept in insertion order.
+
+   Lookups take a "key" element to compare against, as
+   hash_find() does.  Usually that is an rb_elem in a structure
+   on the stack with just its key members filled in.
+
+   Iteration idiom:
+
+      struct rb_elem *e;
+
+      for (e = rb_first (&tree); e != NULL; e = rb_next (e))
+        {
+          struct foo *f = rb_entry (e, struct foo, elem);
+          ...do something with f...
+        }
+
+   Changing an element's key while it is in a tree breaks the
+   tree's ordering.  Remove it, change the key, and insert it
+   again instead. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree element. */
+struct rb_elem
+  {
+    struct rb_elem *parent;     /* Parent, or null at the root. */
+    struct rb_elem *left;       /* Left child, or null. */
+    struct rb_elem *right;      /* Right child, or null. */
+    bool red;                   /* Red or black? */
+  };
+
+/* Converts pointer to tree element RB_ELEM into a pointer to
+   the structure that RB_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the tree element. */
+#define rb_entry(RB_ELEM, STRUCT, MEMBER)                       \
+        ((STRUCT *) ((uint8_t *) &(RB_ELEM)->parent             \
+                     - offsetof (STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_elem *a,
+                           const struct rb_elem *b,
+                           void *aux);
+
+/* Red-black tree. */
+struct rb_tree
+  {
+    struct rb_elem *root;       /* Root, or null if empty. */
+    size_t size;                /* Number of elements. */
+    rb_less_func *less;         /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void rb_init (struct rb_tree *, rb_less_func *, void *aux);
+
+bool rb_empty (const struct rb_tree *);
+size_t rb_size (const struct rb_tree *);
+
+/* Insertion and removal. */
+void rb_insert (struct rb_tree *, struct rb_elem *);
+void rb_erase (struct rb_tree *, struct rb_elem *);
+
+/* Lookup. */
+struct rb_elem *rb_find (const struct rb_tree *, const struct rb_elem *key);
+struct rb_elem *rb_lower_bound (const struct rb_tree *,
+                                const struct rb_elem *key);
+struct rb_elem *rb_upper_bound (const struct rb_tree *,
+                                const struct rb_elem *key);
+
+/* In-order traversal. */
+struct rb_elem *rb_first (const struct rb_tree *);
+struct rb_elem *rb_last (const struct rb_tree *);
+struct rb_elem *rb_next (struct rb_elem *);
+struct rb_elem *rb_prev (struct rb_elem *);
+
+#endif /* lib/kernel/rbtree.h */
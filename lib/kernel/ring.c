@@ -0,0 +1,126 @@
+#include "ring.h"
+#include <string.h>
+#include "../debug.h"
+
+/* Keeps the compiler from moving memory accesses across it.  We
+   run on a uniprocessor, so this is all the ordering that
+   publishing `head' or `tail' needs. */
+#define compiler_barrier() asm volatile ("" : : : "memory")
+
+/* Initializes RING to use the SIZE bytes at BUF, where SIZE is a
+   power of 2. */
+void
+ring_init (struct ring *ring, void *buf, size_t size) 
+{
+  ASSERT (ring != NULL);
+  ASSERT (buf != NULL);
+  ASSERT (size > 0 && (size & (size - 1)) == 0);
+
+  ring->buf = buf;
+  ring->mask = size - 1;
+  ring->head = ring->tail = 0;
+}
+
+/* Returns the number of bytes in RING. */
+size_t
+ring_count (const struct ring *ring) 
+{
+  return ring->head - ring->tail;
+}
+
+/* Returns the number of bytes that can be added to RING. */
+size_t
+ring_space (const struct ring *ring) 
+{
+  return ring->mask + 1 - ring_count (ring);
+}
+
+/* Returns true if RING is empty, false otherwise. */
+bool
+ring_empty (const struct ring *ring) 
+{
+  return ring->head == ring->tail;
+}
+
+/* Returns true if RING is full, false otherwise. */
+bool
+ring_full (const struct ring *ring) 
+{
+  return ring_count (ring) == ring->mask + 1;
+}
+
+/* Adds BYTE to RING, which must not be full.  Producer only. */
+void
+ring_putc (struct ring *ring, uint8_t byte) 
+{
+  unsigned head = ring->head;
+
+  ASSERT (!ring_full (ring));
+
+  ring->buf[head & ring->mask] = byte;
+  compiler_barrier ();
+  ring->head = head + 1;
+}
+
+/* Adds up to SIZE bytes from BUF to RING, as many as fit, and
+   returns the number added.  Producer only. */
+size_t
+ring_put_n (struct ring *ring, const void *buf_, size_t size) 
+{
+  const uint8_t *buf = buf_;
+  unsigned head = ring->head;
+  size_t ofs = head & ring->mask;
+  size_t first;
+
+  if (size > ring_space (ring))
+    size = ring_space (ring);
+
+  /* Copy in at most two pieces, wrapping around the end. */
+  first = ring->mask + 1 - ofs;
+  if (first > size)
+    first = size;
+  memcpy (ring->buf + ofs, buf, first);
+  memcpy (ring->buf, buf + first, size - first);
+  compiler_barrier ();
+  ring->head = head + size;
+  return size;
+}
+
+/* Removes and returns a byte from RING, which must not be empty.
+   Consumer only. */
+uint8_t
+ring_getc (struct ring *ring) 
+{
+  unsigned tail = ring->tail;
+  uint8_t byte;
+
+  ASSERT (!ring_empty (ring));
+
+  byte = ring->buf[tail & ring->mask];
+  compiler_barrier ();
+  ring->tail = tail + 1;
+  return byte;
+}
+
+/* Removes up to SIZE bytes from RING into BUF, as many as RING
+   holds, and returns the number removed.  Consumer only. */
+size_t
+ring_get_n (struct ring *ring, void *buf_, size_t size) 
+{
+  uint8_t *buf = buf_;
+  unsigned tail = ring->tail;
+  size_t ofs = tail & ring->mask;
+  size_t first;
+
+  if (size > ring_count (ring))
+    size = ring_count (ring);
+
+  first = ring->mask + 1 - ofs;
+  if (first > size)
+    first = size;
+  memcpy (buf, ring->buf + ofs, first);
+  memcpy (buf + first, ring->buf, size - first);
+  compiler_barrier ();
+  ring->tail = tail + size;
+  return size;
+}
@@ -0,0 +1,48 @@
+#ifndef __LIB_KERNEL_RING_H
+#define __LIB_KERNEL_RING_H
+
+/* Single-producer, single-consumer byte ring.
+
+   A circular buffer of bytes that needs no lock as long as only
+   one context ever adds bytes (the producer) and only one
+   context ever removes them (the consumer), for example an
+   interrupt handler and a kernel thread.  The producer writes
+   only `head' and the consumer writes only `tail', and each
+   publishes its side only after the bytes themselves have been
+   written or read, so neither can see a half-done update by the
+   other.  Several producers (or several consumers) remain safe
+   if something else serializes them, such as running with
+   interrupts off.
+
+   The buffer is supplied by the caller and its size must be a
+   power of 2.  Bytes can be moved singly or in bulk. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A byte ring. */
+struct ring
+  {
+    uint8_t *buf;               /* Buffer. */
+    unsigned mask;              /* Buffer size minus 1. */
+    volatile unsigned head;     /* Total bytes ever added. */
+    volatile unsigned tail;     /* Total bytes ever removed. */
+  };
+
+void ring_init (struct ring *, void *buf, size_t size);
+
+size_t ring_count (const struct ring *);
+size_t ring_space (const struct ring *);
+bool ring_empty (const struct ring *);
+bool ring_full (const struct ring *);
+
+/* Producer side. */
+void ring_putc (struct ring *, uint8_t);
+size_t ring_put_n (struct ring *, const void *, size_t);
+
+/* Consumer side. */
+uint8_t ring_getc (struct ring *);
+size_t ring_get_n (struct ring *, void *, size_t);
+
+#endif /* lib/kernel/ring.h */
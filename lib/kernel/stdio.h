@@ -1,6 +1,33 @@
 #ifndef __LIB_KERNEL_STDIO_H
 #define __LIB_KERNEL_STDIO_H
 
+#include <stdint.h>
+
 void putbuf (const char *, size_t);
 
+/* Rate limiting for printf() calls on hot paths.  Each call site
+   of printf_ratelimited() prints at most PRINTF_RATELIMIT_BURST
+   messages per PRINTF_RATELIMIT_INTERVAL timer ticks and drops
+   the rest, reporting how many it dropped. */
+#define PRINTF_RATELIMIT_BURST 10
+#define PRINTF_RATELIMIT_INTERVAL 100
+
+struct printf_ratelimit
+  {
+    int64_t start;              /* Start of current interval, in ticks. */
+    int printed;                /* Messages printed in this interval. */
+    int missed;                 /* Messages dropped in this interval. */
+  };
+
+void __printf_ratelimited (struct printf_ratelimit *, const char *, ...)
+  PRINTF_FORMAT (2, 3);
+
+#define printf_ratelimited(...)                                 \
+        do                                                      \
+          {                                                     \
+            static struct printf_ratelimit rl_;                 \
+            __printf_ratelimited (&rl_, __VA_ARGS__);           \
+          }                                                     \
+        while (0)
+
 #endif /* lib/kernel/stdio.h */
@@ -81,3 +81,54 @@ random_ulong (void)
   random_bytes (&ul, sizeof ul);
   return ul;
 }
+
+/* Seeds PRNG with SEED.  Generators given different STREAMs
+   produce different sequences even from the same SEED. */
+void
+prng_seed (struct prng *prng, uint64_t seed, uint64_t stream) 
+{
+  prng->state = 0;
+  prng->inc = (stream << 1) | 1;
+  prng_u32 (prng);
+  prng->state += seed;
+  prng_u32 (prng);
+}
+
+/* Returns a pseudo-random 32-bit number from PRNG. */
+uint32_t
+prng_u32 (struct prng *prng) 
+{
+  uint64_t old = prng->state;
+  uint32_t xorshifted = ((old >> 18) ^ old) >> 27;
+  uint32_t rot = old >> 59;
+
+  prng->state = old * 6364136223846793005ULL + prng->inc;
+  return (xorshifted >> rot) | (xorshifted << (-rot & 31));
+}
+
+/* Returns a pseudo-random number from PRNG in the range 0...N
+   (exclusive), which must be nonempty.  Unlike prng_u32() % N,
+   every value is equally likely.  Needs no 64-bit division: it
+   scales by multiplication and rejects the few outputs that
+   would bias the result. */
+uint32_t
+prng_range (struct prng *prng, uint32_t n) 
+{
+  uint64_t m;
+  uint32_t low;
+
+  ASSERT (n > 0);
+
+  m = (uint64_t) prng_u32 (prng) * n;
+  low = m;
+  if (low < n) 
+    {
+      uint32_t threshold = -n % n;
+      while (low < threshold) 
+        {
+          m = (uint64_t) prng_u32 (prng) * n;
+          low = m;
+        }
+    }
+  return m >> 32;
+}
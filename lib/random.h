@@ -2,9 +2,28 @@
 #define __LIB_RANDOM_H
 
 #include <stddef.h>
+#include <stdint.h>
 
+/* The shared RC4 generator.  Its output depends only on the
+   seed, so a run with a given seed is reproducible, but it is a
+   single global stream that callers must not use concurrently. */
 void random_init (unsigned seed);
 void random_bytes (void *, size_t);
 unsigned long random_ulong (void);
 
+/* A small, fast generator whose state the caller owns, so that
+   each thread (or any other context) can keep its own and needs
+   no locking.  This is PCG32: 64 bits of state, 32 bits of
+   output per step, a few instructions per number.  Not for
+   cryptographic use. */
+struct prng
+  {
+    uint64_t state;             /* Current state. */
+    uint64_t inc;               /* Stream selector, always odd. */
+  };
+
+void prng_seed (struct prng *, uint64_t seed, uint64_t stream);
+uint32_t prng_u32 (struct prng *);
+uint32_t prng_range (struct prng *, uint32_t n);
+
 #endif /* lib/random.h */
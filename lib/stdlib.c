@@ -1,8 +1,11 @@
 #include <ctype.h>
 #include <debug.h>
+#include <limits.h>
 #include <random.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
 
 /* Converts a string representation of a signed decimal integer
    in S into an `int', which is returned. */
@@ -62,7 +65,9 @@ qsort (void *array, size_t cnt, size_t size,
 }
 
 /* Swaps elements with 1-based indexes A_IDX and B_IDX in ARRAY
-   with elements of SIZE bytes each. */
+   with elements of SIZE bytes each.  Elements that are whole,
+   aligned words, such as pointers or ints, are swapped a word at
+   a time rather than byte by byte. */
 static void
 do_swap (unsigned char *array, size_t a_idx, size_t b_idx, size_t size)
 {
@@ -70,6 +75,21 @@ do_swap (unsigned char *array, size_t a_idx, size_t b_idx, size_t size)
   unsigned char *b = array + (b_idx - 1) * size;
   size_t i;
 
+  if (size % sizeof (uintptr_t) == 0
+      && ((uintptr_t) array % sizeof (uintptr_t)) == 0) 
+    {
+      uintptr_t *wa = (uintptr_t *) a;
+      uintptr_t *wb = (uintptr_t *) b;
+
+      for (i = 0; i < size / sizeof (uintptr_t); i++) 
+        {
+          uintptr_t t = wa[i];
+          wa[i] = wb[i];
+          wb[i] = t;
+        }
+      return;
+    }
+
   for (i = 0; i < size; i++)
     {
       unsigned char t = a[i];
@@ -169,6 +189,57 @@ bsearch (const void *key, const void *array, size_t cnt,
   return binary_search (key, array, cnt, size, compare_thunk, &compare);
 }
 
+/* Sorts the CNT integers in ARRAY into ascending order, using
+   TMP, which must have room for CNT integers, as scratch space.
+   Uses an LSD radix sort, which makes one pass over ARRAY for
+   each byte of the keys and skips any byte that is the same in
+   every key, so it runs in O(n) time.  Faster than sort() for
+   more than a few dozen keys. */
+void
+radix_sort (unsigned *array, size_t cnt, unsigned *tmp) 
+{
+  unsigned *src = array;
+  unsigned *dst = tmp;
+  unsigned shift;
+
+  ASSERT (array != NULL || cnt == 0);
+  ASSERT (tmp != NULL || cnt == 0);
+
+  for (shift = 0; shift < sizeof *array * CHAR_BIT; shift += 8) 
+    {
+      size_t counts[256];
+      size_t i, ofs;
+      unsigned *t;
+
+      /* Count the keys with each value of this byte. */
+      memset (counts, 0, sizeof counts);
+      for (i = 0; i < cnt; i++)
+        counts[(src[i] >> shift) & 0xff]++;
+      if (cnt == 0 || counts[(src[0] >> shift) & 0xff] == cnt)
+        continue;
+
+      /* Turn the counts into starting offsets, then distribute
+         the keys.  Keys with equal bytes keep their order, which
+         is what makes the passes compose. */
+      ofs = 0;
+      for (i = 0; i < 256; i++) 
+        {
+          size_t n = counts[i];
+          counts[i] = ofs;
+          ofs += n;
+        }
+      for (i = 0; i < cnt; i++)
+        dst[counts[(src[i] >> shift) & 0xff]++] = src[i];
+
+      t = src;
+      src = dst;
+      dst = t;
+    }
+
+  if (src != array)
+    memcpy (array, src, cnt * sizeof *array);
+}
+
 /* Searches ARRAY, which contains CNT elements of SIZE bytes
    each, for the given KEY.  Returns a match is found, otherwise
    a null pointer.  If there are multiple matches, returns an
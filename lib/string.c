@@ -1,23 +1,112 @@
 #include <string.h>
 #include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* memcpy(), memmove() and memset() move 32-bit words rather
+   than bytes.  Short blocks go through a C loop that aligns the
+   destination, moves whole words, and finishes with the odd
+   bytes.  Blocks of REP_THRESHOLD bytes or more use the string
+   instructions "rep movsl" and "rep stosl", whose startup cost
+   only pays off once there is enough to copy.  The variants are
+   also exported, as memcpy_words() and so on, for benchmarking.
+   The 80x86 allows unaligned word access, so only the
+   destination is aligned. */
+#define REP_THRESHOLD 64
+
+/* A word that may alias any other type. */
+typedef uint32_t word_t __attribute__ ((__may_alias__));
+
+/* The searching functions below also scan a word at a time.  A
+   word read from an aligned address never crosses a page
+   boundary, so reading the whole word that holds a string's
+   last byte cannot fault, even if the rest lies past the end. */
+
+/* Returns true if any byte in W is zero.  Subtracting 1 from
+   each byte borrows into its top bit only if the byte was 0 (or
+   a borrow passed through it, which needs a 0 byte lower down);
+   "& ~W" discards bytes whose top bit was already set. */
+static inline bool
+has_zero (uint32_t w) 
+{
+  return ((w - 0x01010101u) & ~w & 0x80808080u) != 0;
+}
 
-/* Copies SIZE bytes from SRC to DST, which must not overlap.
-   Returns DST. */
+/* Returns a word with each byte set to C. */
+static inline uint32_t
+repeat_byte (unsigned char c) 
+{
+  return c * 0x01010101u;
+}
+
+/* Returns true if P is word-aligned. */
+static inline bool
+is_aligned (const void *p) 
+{
+  return ((uintptr_t) p & 3) == 0;
+}
+
+/* Copies SIZE bytes from SRC to DST, which must not overlap, a
+   word at a time.  Returns DST. */
 void *
-memcpy (void *dst_, const void *src_, size_t size) 
+memcpy_words (void *dst_, const void *src_, size_t size) 
 {
   unsigned char *dst = dst_;
   const unsigned char *src = src_;
 
-  ASSERT (dst != NULL || size == 0);
-  ASSERT (src != NULL || size == 0);
-
+  for (; size > 0 && ((uintptr_t) dst & 3) != 0; size--)
+    *dst++ = *src++;
+  for (; size >= 4; size -= 4, dst += 4, src += 4)
+    *(word_t *) dst = *(const word_t *) src;
   while (size-- > 0)
     *dst++ = *src++;
 
   return dst_;
 }
 
+/* Copies SIZE bytes from SRC to DST, which must not overlap,
+   with "rep movsl".  Returns DST. */
+void *
+memcpy_rep (void *dst_, const void *src_, size_t size) 
+{
+  void *dst = dst_;
+  const void *src = src_;
+  size_t head = -(uintptr_t) dst & 3;
+  size_t cnt;
+
+  if (head > size)
+    head = size;
+  size -= head;
+  cnt = head;
+  asm volatile ("rep movsb"
+                : "+D" (dst), "+S" (src), "+c" (cnt) : : "memory");
+  cnt = size / 4;
+  asm volatile ("rep movsl"
+                : "+D" (dst), "+S" (src), "+c" (cnt) : : "memory");
+  cnt = size % 4;
+  asm volatile ("rep movsb"
+                : "+D" (dst), "+S" (src), "+c" (cnt) : : "memory");
+
+  return dst_;
+}
+
+/* Copies SIZE bytes from SRC to DST, which must not overlap.
+   Returns DST. */
+void *
+memcpy (void *dst_, const void *src_, size_t size) 
+{
+  void *dst = dst_;
+  const void *src = src_;
+
+  ASSERT (dst != NULL || size == 0);
+  ASSERT (src != NULL || size == 0);
+
+  if (size >= REP_THRESHOLD)
+    return memcpy_rep (dst, src, size);
+  else
+    return memcpy_words (dst, src, size);
+}
+
 /* Copies SIZE bytes from SRC to DST, which are allowed to
    overlap.  Returns DST. */
 void *
@@ -29,20 +118,27 @@ memmove (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  if (dst < src) 
+  /* Copying forward, even word by word, never overwrites source
+     bytes that are still to be read unless DST lies inside the
+     source block. */
+  if (dst <= src || dst >= src + size) 
+    return memcpy (dst, src, size);
+
+  /* Copy backward, aligning the end of DST. */
+  dst += size;
+  src += size;
+  for (; size > 0 && ((uintptr_t) dst & 3) != 0; size--)
+    *--dst = *--src;
+  for (; size >= 4; size -= 4)
     {
-      while (size-- > 0)
-        *dst++ = *src++;
-    }
-  else 
-    {
-      dst += size;
-      src += size;
-      while (size-- > 0)
-        *--dst = *--src;
+      dst -= 4;
+      src -= 4;
+      *(word_t *) dst = *(const word_t *) src;
     }
+  while (size-- > 0)
+    *--dst = *--src;
 
-  return dst;
+  return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -78,6 +174,22 @@ strcmp (const char *a_, const char *b_)
   ASSERT (a != NULL);
   ASSERT (b != NULL);
 
+  /* If A and B are equally misaligned, compare a word at a time
+     once both are aligned, as long as the words match and A's
+     has no null terminator. */
+  if (((uintptr_t) a & 3) == ((uintptr_t) b & 3)) 
+    {
+      for (; !is_aligned (a); a++, b++)
+        if (*a == '\0' || *a != *b)
+          return *a < *b ? -1 : *a > *b;
+      while (*(const word_t *) a == *(const word_t *) b
+             && !has_zero (*(const word_t *) a))
+        {
+          a += 4;
+          b += 4;
+        }
+    }
+
   while (*a != '\0' && *a == *b) 
     {
       a++;
@@ -95,9 +207,16 @@ memchr (const void *block_, int ch_, size_t size)
 {
   const unsigned char *block = block_;
   unsigned char ch = ch_;
+  uint32_t pattern = repeat_byte (ch);
 
   ASSERT (block != NULL || size == 0);
 
+  for (; size > 0 && !is_aligned (block); size--, block++)
+    if (*block == ch)
+      return (void *) block;
+  for (; size >= 4; size -= 4, block += 4)
+    if (has_zero (*(const word_t *) block ^ pattern))
+      break;
   for (; size-- > 0; block++)
     if (*block == ch)
       return (void *) block;
@@ -113,9 +232,23 @@ char *
 strchr (const char *string, int c_) 
 {
   char c = c_;
+  uint32_t pattern = repeat_byte (c);
 
   ASSERT (string != NULL);
 
+  /* Skip whole words that contain neither C nor a null. */
+  for (; !is_aligned (string); string++)
+    if (*string == c)
+      return (char *) string;
+    else if (*string == '\0')
+      return NULL;
+  for (;; string += 4) 
+    {
+      uint32_t w = *(const word_t *) string;
+      if (has_zero (w) || has_zero (w ^ pattern))
+        break;
+    }
+
   for (;;) 
     if (*string == c)
       return (char *) string;
@@ -278,16 +411,57 @@ strtok_r (char *s, const char *delimiters, char **save_ptr)
 void *
 memset (void *dst_, int value, size_t size) 
 {
-  unsigned char *dst = dst_;
+  void *dst = dst_;
 
   ASSERT (dst != NULL || size == 0);
-  
+
+  if (size >= REP_THRESHOLD)
+    return memset_rep (dst, value, size);
+  else
+    return memset_words (dst, value, size);
+}
+
+/* Sets the SIZE bytes in DST to VALUE a word at a time.
+   Returns DST. */
+void *
+memset_words (void *dst_, int value, size_t size) 
+{
+  unsigned char *dst = dst_;
+  word_t word = (unsigned char) value * 0x01010101u;
+
+  for (; size > 0 && ((uintptr_t) dst & 3) != 0; size--)
+    *dst++ = value;
+  for (; size >= 4; size -= 4, dst += 4)
+    *(word_t *) dst = word;
   while (size-- > 0)
     *dst++ = value;
 
   return dst_;
 }
 
+/* Sets the SIZE bytes in DST to VALUE with "rep stosl".
+   Returns DST. */
+void *
+memset_rep (void *dst_, int value, size_t size) 
+{
+  void *dst = dst_;
+  uint32_t word = (unsigned char) value * 0x01010101u;
+  size_t head = -(uintptr_t) dst & 3;
+  size_t cnt;
+
+  if (head > size)
+    head = size;
+  size -= head;
+  cnt = head;
+  asm volatile ("rep stosb" : "+D" (dst), "+c" (cnt) : "a" (word) : "memory");
+  cnt = size / 4;
+  asm volatile ("rep stosl" : "+D" (dst), "+c" (cnt) : "a" (word) : "memory");
+  cnt = size % 4;
+  asm volatile ("rep stosb" : "+D" (dst), "+c" (cnt) : "a" (word) : "memory");
+
+  return dst_;
+}
+
 /* Returns the length of STRING. */
 size_t
 strlen (const char *string) 
@@ -296,7 +470,12 @@ strlen (const char *string)
 
   ASSERT (string != NULL);
 
-  for (p = string; *p != '\0'; p++)
+  for (p = string; !is_aligned (p); p++)
+    if (*p == '\0')
+      return p - string;
+  while (!has_zero (*(const word_t *) p))
+    p += 4;
+  for (; *p != '\0'; p++)
     continue;
   return p - string;
 }
@@ -306,9 +485,15 @@ strlen (const char *string)
 size_t
 strnlen (const char *string, size_t maxlen) 
 {
-  size_t length;
-
-  for (length = 0; string[length] != '\0' && length < maxlen; length++)
+  size_t length = 0;
+
+  for (; length < maxlen && !is_aligned (string + length); length++)
+    if (string[length] == '\0')
+      return length;
+  while (maxlen - length >= 4
+         && !has_zero (*(const word_t *) (string + length)))
+    length += 4;
+  for (; length < maxlen && string[length] != '\0'; length++)
     continue;
   return length;
 }
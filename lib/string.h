@@ -25,6 +25,13 @@ size_t strlcat (char *, const char *, size_t);
 char *strtok_r (char *, const char *, char **);
 size_t strnlen (const char *, size_t);
 
+/* Fixed variants of memcpy() and memset(), which choose between
+   them by size.  Exported for benchmarking. */
+void *memcpy_words (void *, const void *, size_t);
+void *memcpy_rep (void *, const void *, size_t);
+void *memset_words (void *, int, size_t);
+void *memset_rep (void *, int, size_t);
+
 /* Try to be helpful. */
 #define strcpy dont_use_strcpy_use_strlcpy
 #define strncpy dont_use_strncpy_use_strlcpy
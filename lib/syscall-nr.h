@@ -28,7 +28,36 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_READV,                  /* Read into several buffers. */
+    SYS_WRITEV,                 /* Write from several buffers. */
+    SYS_PREAD,                  /* Read from a given file offset. */
+    SYS_PWRITE,                 /* Write at a given file offset. */
+    SYS_SUBMIT,                 /* Make a batch of system calls. */
+    SYS_FORK,                   /* Duplicate the calling process. */
+    SYS_THREAD_CREATE,          /* Start a thread in this process. */
+    SYS_THREAD_JOIN,            /* Wait for a thread to exit. */
+    SYS_FUTEX_WAIT,             /* Sleep on a word of user memory. */
+    SYS_FUTEX_WAKE,             /* Wake sleepers on a word. */
+    SYS_SBRK,                   /* Grow the heap. */
+    SYS_WAIT_ANY,               /* Wait for whichever child exits first. */
+    SYS_GROUP_CREATE,           /* Start a weighted process group. */
+    SYS_GROUP_JOIN,             /* Move into a process group. */
+    SYS_GROUP_SET_WEIGHT,       /* Change a process group's weight. */
+    SYS_PIPE,                   /* Create a pipe. */
+    SYS_SHM_CREATE,             /* Create a shared memory segment. */
+    SYS_SHM_MAP,                /* Map a shared memory segment. */
+    SYS_POLL,                   /* Wait for any of several events. */
+    SYS_AIO_SUBMIT,             /* Queue asynchronous file I/O. */
+    SYS_AIO_WAIT,               /* Reap finished asynchronous I/O. */
+    SYS_GETDENTS,               /* Read many directory entries. */
+    SYS_FALLOCATE,              /* Set aside space in a file. */
+    SYS_OPEN_FLAGS,             /* Open a file, with flags. */
+    SYS_FADVISE,                /* Declare a file access pattern. */
+    SYS_MADVISE,                /* Declare a memory access pattern. */
+    SYS_GETRUSAGE               /* Report resource use. */
   };
 
 #endif /* lib/syscall-nr.h */
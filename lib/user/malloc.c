@@ -0,0 +1,229 @@
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+/* User heap allocator.
+
+   The heap grows with sbrk() in whole arenas of ARENA_SIZE
+   bytes.  Small blocks come from size-class bins, one per power
+   of 2 from MIN_BLOCK to MAX_SMALL bytes.  An empty bin is
+   refilled by carving a fresh arena into blocks of its size, so
+   a run of allocations costs one system call per arena rather
+   than one per object, and freeing a block just pushes it back
+   on its bin.
+
+   A larger block is rounded up to whole arenas and taken from a
+   list of freed large blocks, first fit, or else from sbrk().
+
+   Every block starts with a header recording its size, which is
+   what free() needs to find its bin.  Memory is never given back
+   to the kernel.  There is no locking, so threads of one
+   process must not allocate at once. */
+
+#define ARENA_SIZE 4096         /* Unit of heap growth. */
+#define MIN_BLOCK 16            /* Smallest block, with header. */
+#define MAX_SMALL 2048          /* Largest block in a bin. */
+#define BIN_CNT 8               /* log2 (MAX_SMALL / MIN_BLOCK) + 1. */
+
+/* Precedes each block's usable space. */
+struct header
+  {
+    size_t size;                /* Block size, with header. */
+    struct header *next;        /* Next free block, while free. */
+  };
+
+static struct header *bins[BIN_CNT];    /* Free small blocks. */
+static struct header *large_free;       /* Free large blocks. */
+
+/* Returns the usable space in block H. */
+static void *
+block_data (struct header *h) 
+{
+  return (uint8_t *) h + offsetof (struct header, next);
+}
+
+/* Returns the block whose usable space starts at P. */
+static struct header *
+data_block (void *p) 
+{
+  return (struct header *) ((uint8_t *) p - offsetof (struct header, next));
+}
+
+/* Returns the bin for blocks of SIZE bytes, which must be at
+   most MAX_SMALL. */
+static int
+bin_index (size_t size) 
+{
+  int i = 0;
+
+  while ((size_t) MIN_BLOCK << i < size)
+    i++;
+  return i;
+}
+
+/* Grows the heap by SIZE bytes, a multiple of ARENA_SIZE, and
+   returns the new memory, arena-aligned, or a null pointer if
+   the heap cannot grow. */
+static void *
+grow_heap (size_t size) 
+{
+  uintptr_t brk = (uintptr_t) sbrk (0);
+  size_t pad = ROUND_UP (brk, ARENA_SIZE) - brk;
+  uint8_t *p;
+
+  /* Someone else may have moved the break off an arena boundary. */
+  if (pad > 0 && sbrk (pad) == (void *) -1)
+    return NULL;
+  p = sbrk (size);
+  return p != (void *) -1 ? p : NULL;
+}
+
+/* Carves a new arena into blocks for bin I.  Returns false if
+   the heap cannot grow. */
+static bool
+refill_bin (int i) 
+{
+  size_t size = (size_t) MIN_BLOCK << i;
+  uint8_t *arena = grow_heap (ARENA_SIZE);
+  uint8_t *p;
+
+  if (arena == NULL)
+    return false;
+  for (p = arena; p < arena + ARENA_SIZE; p += size)
+    {
+      struct header *h = (struct header *) p;
+      h->size = size;
+      h->next = bins[i];
+      bins[i] = h;
+    }
+  return true;
+}
+
+/* Returns a large block of at least SIZE bytes, SIZE a multiple
+   of ARENA_SIZE, or a null pointer if memory is short. */
+static struct header *
+get_large (size_t size) 
+{
+  struct header **hp, *h;
+
+  for (hp = &large_free; *hp != NULL; hp = &(*hp)->next)
+    if ((*hp)->size >= size)
+      {
+        h = *hp;
+        *hp = h->next;
+        return h;
+      }
+
+  h = grow_heap (size);
+  if (h != NULL)
+    h->size = size;
+  return h;
+}
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size) 
+{
+  size_t block_size = size + offsetof (struct header, next);
+  struct header *h;
+
+  if (size == 0)
+    return NULL;
+  if (block_size < size)
+    return NULL;
+
+  if (block_size <= MAX_SMALL)
+    {
+      int i = bin_index (block_size);
+
+      if (bins[i] == NULL && !refill_bin (i))
+        return NULL;
+      h = bins[i];
+      bins[i] = h->next;
+    }
+  else
+    {
+      if (block_size > SIZE_MAX - ARENA_SIZE)
+        return NULL;
+      h = get_large (ROUND_UP (block_size, ARENA_SIZE));
+      if (h == NULL)
+        return NULL;
+    }
+  return block_data (h);
+}
+
+/* Allocates and returns A times B bytes initialized to zeros.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b) 
+{
+  size_t size = a * b;
+  void *p;
+
+  if (b != 0 && size / b != a)
+    return NULL;
+  p = malloc (size);
+  if (p != NULL)
+    memset (p, 0, size);
+  return p;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.  If successful, returns the new
+   block; on failure, returns a null pointer.  A call with null
+   OLD_BLOCK is equivalent to malloc(NEW_SIZE).  A call with zero
+   NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size) 
+{
+  size_t old_size;
+  void *new_block;
+
+  if (new_size == 0)
+    {
+      free (old_block);
+      return NULL;
+    }
+  if (old_block == NULL)
+    return malloc (new_size);
+
+  /* Keep the block if it is big enough already. */
+  old_size = data_block (old_block)->size - offsetof (struct header, next);
+  if (new_size <= old_size)
+    return old_block;
+
+  new_block = malloc (new_size);
+  if (new_block != NULL)
+    {
+      memcpy (new_block, old_block, old_size);
+      free (old_block);
+    }
+  return new_block;
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p) 
+{
+  struct header *h;
+
+  if (p == NULL)
+    return;
+  h = data_block (p);
+  if (h->size <= MAX_SMALL)
+    {
+      int i = bin_index (h->size);
+      h->next = bins[i];
+      bins[i] = h;
+    }
+  else
+    {
+      h->next = large_free;
+      large_free = h;
+    }
+}
@@ -0,0 +1,458 @@
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Buffered streams.
+
+   Each stream has a BUFSIZ buffer that holds either bytes
+   written and not yet passed to write(), or bytes read ahead and
+   not yet consumed, never both.  A run of small writes or reads
+   thus costs one system call per buffer rather than one per
+   call.
+
+   stdout, the console, is line buffered, so that each line
+   reaches the console as a whole as soon as it is complete.
+   Streams opened on files are fully buffered.  stdin is line
+   buffered too: reading the console returns a line at a time,
+   so a read ahead never waits for more than the next line.
+
+   exit() flushes every stream, as do halt() and fork(), so that
+   output is neither lost nor written twice.  The streams have no
+   locking: threads of one process must not use a stream at
+   once. */
+
+/* What a stream's buffer holds. */
+enum stream_state
+  {
+    STREAM_IDLE,                /* Nothing. */
+    STREAM_READ,                /* Bytes read ahead, from POS to LEN. */
+    STREAM_WRITE                /* Bytes to write, up to LEN. */
+  };
+
+struct FILE
+  {
+    int fd;                     /* File descriptor, or -1 if closed. */
+    int mode;                   /* _IOFBF, _IOLBF, or _IONBF. */
+    enum stream_state state;    /* What BUF holds. */
+    size_t pos;                 /* Next byte of BUF to read. */
+    size_t len;                 /* Bytes in use in BUF. */
+    bool eof;                   /* Has a read hit end of file? */
+    bool error;                 /* Has a transfer failed? */
+    char *buf;                  /* BUFSIZ bytes. */
+  };
+
+/* Buffers, kept apart from the streams so that they go in BSS. */
+static char buffers[FOPEN_MAX][BUFSIZ];
+
+static FILE streams[FOPEN_MAX] =
+  {
+    {STDIN_FILENO, _IOLBF, STREAM_IDLE, 0, 0, false, false, buffers[0]},
+    {STDOUT_FILENO, _IOLBF, STREAM_IDLE, 0, 0, false, false, buffers[1]},
+    [2 ... FOPEN_MAX - 1] = {.fd = -1},
+  };
+
+FILE *stdin = &streams[0];
+FILE *stdout = &streams[1];
+
+/* Writes out the bytes buffered in F.  Returns 0 if successful,
+   EOF on error. */
+static int
+flush_write (FILE *f) 
+{
+  size_t len = f->len;
+
+  f->state = STREAM_IDLE;
+  f->len = 0;
+  if (len > 0 && (size_t) write (f->fd, f->buf, len) != len)
+    {
+      f->error = true;
+      return EOF;
+    }
+  return 0;
+}
+
+/* Discards the bytes F has read ahead, moving the file position
+   back to the first one not consumed. */
+static void
+drop_read (FILE *f) 
+{
+  if (f->pos < f->len && f->fd != STDIN_FILENO)
+    seek (f->fd, tell (f->fd) - (f->len - f->pos));
+  f->state = STREAM_IDLE;
+  f->pos = f->len = 0;
+}
+
+/* Readies F for writing. */
+static void
+start_write (FILE *f) 
+{
+  if (f->state == STREAM_READ)
+    drop_read (f);
+  f->state = STREAM_WRITE;
+}
+
+/* Reads ahead into F's empty buffer.  Returns false at end of
+   file or on error. */
+static bool
+fill (FILE *f) 
+{
+  int n;
+
+  if (f->state == STREAM_WRITE && flush_write (f) == EOF)
+    return false;
+
+  /* Show any prompt before waiting for the console. */
+  if (f->fd == STDIN_FILENO)
+    fflush (stdout);
+
+  n = read (f->fd, f->buf, f->mode == _IONBF ? 1 : BUFSIZ);
+  f->state = STREAM_IDLE;
+  f->pos = f->len = 0;
+  if (n <= 0)
+    {
+      if (n == 0)
+        f->eof = true;
+      else
+        f->error = true;
+      return false;
+    }
+  f->state = STREAM_READ;
+  f->len = n;
+  return true;
+}
+
+/* Returns a closed stream, or a null pointer if all are open. */
+static FILE *
+alloc_stream (void) 
+{
+  int i;
+
+  for (i = 0; i < FOPEN_MAX; i++)
+    if (streams[i].fd < 0)
+      {
+        streams[i].buf = buffers[i];
+        return &streams[i];
+      }
+  return NULL;
+}
+
+/* Opens a stream on FD, which should already be open.  MODE is
+   not used, because a Pintos fd can be both read and written.
+   Returns the stream, or a null pointer if too many are open. */
+FILE *
+fdopen (int fd, const char *mode UNUSED) 
+{
+  FILE *f = alloc_stream ();
+
+  if (f == NULL)
+    return NULL;
+  f->fd = fd;
+  f->mode = (fd == STDOUT_FILENO ? _IOLBF
+             : fd == STDIN_FILENO ? _IOLBF
+             : _IOFBF);
+  f->state = STREAM_IDLE;
+  f->pos = f->len = 0;
+  f->eof = f->error = false;
+  return f;
+}
+
+/* Opens the file called NAME as a stream.  If MODE starts with
+   'w' or 'a', creates the file if it does not exist, and with
+   'a', starts at its end.  Pintos cannot truncate files, so 'w'
+   does not.  Returns the stream, or a null pointer on failure. */
+FILE *
+fopen (const char *name, const char *mode) 
+{
+  FILE *f;
+  int fd;
+
+  if (mode[0] == 'w' || mode[0] == 'a')
+    create (name, 0);
+  fd = open (name);
+  if (fd < 0)
+    return NULL;
+  f = fdopen (fd, mode);
+  if (f == NULL)
+    {
+      close (fd);
+      return NULL;
+    }
+  if (mode[0] == 'a')
+    seek (fd, filesize (fd));
+  return f;
+}
+
+/* Flushes and closes F.  The console fds stay open. */
+int
+fclose (FILE *f) 
+{
+  int retval = fflush (f);
+
+  if (f->fd != STDIN_FILENO && f->fd != STDOUT_FILENO)
+    close (f->fd);
+  f->fd = -1;
+  return retval;
+}
+
+/* Writes out what F has buffered, and gives back to the file
+   what it has read ahead.  If F is a null pointer, does so for
+   every stream.  Returns 0 if successful, EOF on error. */
+int
+fflush (FILE *f) 
+{
+  int retval = 0;
+
+  if (f == NULL)
+    {
+      int i;
+
+      for (i = 0; i < FOPEN_MAX; i++)
+        if (streams[i].fd >= 0 && fflush (&streams[i]) == EOF)
+          retval = EOF;
+      return retval;
+    }
+
+  if (f->state == STREAM_WRITE)
+    retval = flush_write (f);
+  else if (f->state == STREAM_READ)
+    drop_read (f);
+  return retval;
+}
+
+int
+fileno (FILE *f) 
+{
+  return f->fd;
+}
+
+int
+feof (FILE *f) 
+{
+  return f->eof;
+}
+
+int
+ferror (FILE *f) 
+{
+  return f->error;
+}
+
+/* Writes C to F.  Returns C, or EOF on error. */
+int
+fputc (int c, FILE *f) 
+{
+  start_write (f);
+  f->buf[f->len++] = c;
+  if (f->len >= BUFSIZ || f->mode == _IONBF
+      || (f->mode == _IOLBF && c == '\n'))
+    {
+      if (flush_write (f) == EOF)
+        return EOF;
+    }
+  return (unsigned char) c;
+}
+
+int
+putc (int c, FILE *f) 
+{
+  return fputc (c, f);
+}
+
+/* Writes string S to F, without a new-line.  Returns 0, or EOF
+   on error. */
+int
+fputs (const char *s, FILE *f) 
+{
+  size_t len = strlen (s);
+
+  return fwrite (s, 1, len, f) == len ? 0 : EOF;
+}
+
+/* Writes CNT objects of SIZE bytes each from BUFFER to F.
+   Returns the number written in full. */
+size_t
+fwrite (const void *buffer, size_t size, size_t cnt, FILE *f) 
+{
+  const char *p = buffer;
+  size_t total = size * cnt;
+  size_t left = total;
+
+  if (total == 0)
+    return 0;
+  start_write (f);
+
+  /* A write that would fill the buffer anyway goes straight to
+     the file, after what is buffered ahead of it. */
+  if (f->len + left >= BUFSIZ || f->mode == _IONBF)
+    {
+      int n;
+
+      if (flush_write (f) == EOF)
+        return 0;
+      n = write (f->fd, p, left);
+      if (n < 0 || (size_t) n != left)
+        {
+          f->error = true;
+          return n > 0 ? n / size : 0;
+        }
+      return cnt;
+    }
+
+  memcpy (f->buf + f->len, p, left);
+  f->len += left;
+  if (f->mode == _IOLBF && memchr (p, '\n', left) != NULL
+      && flush_write (f) == EOF)
+    return 0;
+  return cnt;
+}
+
+/* Auxiliary data for vfprintf_helper(). */
+struct vfprintf_aux
+  {
+    FILE *f;                    /* Stream to write. */
+    int char_cnt;               /* Characters written so far. */
+  };
+
+/* Writes C to the stream in AUX_. */
+static void
+vfprintf_helper (char c, void *aux_) 
+{
+  struct vfprintf_aux *aux = aux_;
+
+  fputc (c, aux->f);
+  aux->char_cnt++;
+}
+
+/* Formats FORMAT with ARGS onto F.  Returns the number of
+   characters written. */
+int
+vfprintf (FILE *f, const char *format, va_list args) 
+{
+  struct vfprintf_aux aux;
+
+  aux.f = f;
+  aux.char_cnt = 0;
+  __vprintf (format, args, vfprintf_helper, &aux);
+  return aux.char_cnt;
+}
+
+int
+fprintf (FILE *f, const char *format, ...) 
+{
+  va_list args;
+  int retval;
+
+  va_start (args, format);
+  retval = vfprintf (f, format, args);
+  va_end (args);
+  return retval;
+}
+
+/* Reads and returns a byte from F, or EOF at end of file or on
+   error. */
+int
+fgetc (FILE *f) 
+{
+  if ((f->state != STREAM_READ || f->pos >= f->len) && !fill (f))
+    return EOF;
+  return (unsigned char) f->buf[f->pos++];
+}
+
+int
+getc (FILE *f) 
+{
+  return fgetc (f);
+}
+
+int
+getchar (void) 
+{
+  return fgetc (stdin);
+}
+
+/* Reads a line from F into S, a buffer of SIZE bytes: up to and
+   including a new-line, or up to SIZE - 1 bytes, whichever comes
+   first, followed by a null terminator.  Returns S, or a null
+   pointer if nothing could be read. */
+char *
+fgets (char *s, int size, FILE *f) 
+{
+  size_t left = size - 1;
+  char *p = s;
+
+  if (size <= 0)
+    return NULL;
+  while (left > 0)
+    {
+      const char *start, *nl;
+      size_t n;
+
+      if ((f->state != STREAM_READ || f->pos >= f->len) && !fill (f))
+        break;
+
+      start = f->buf + f->pos;
+      n = f->len - f->pos < left ? f->len - f->pos : left;
+      nl = memchr (start, '\n', n);
+      if (nl != NULL)
+        n = nl - start + 1;
+      memcpy (p, start, n);
+      p += n;
+      f->pos += n;
+      left -= n;
+      if (nl != NULL)
+        break;
+    }
+  if (p == s)
+    return NULL;
+  *p = '\0';
+  return s;
+}
+
+/* Reads up to CNT objects of SIZE bytes each from F into BUFFER.
+   Returns the number read in full. */
+size_t
+fread (void *buffer, size_t size, size_t cnt, FILE *f) 
+{
+  char *p = buffer;
+  size_t total = size * cnt;
+  size_t left = total;
+
+  while (left > 0)
+    {
+      size_t n;
+
+      if (f->state != STREAM_READ || f->pos >= f->len)
+        {
+          /* Read big requests straight into BUFFER. */
+          if (left >= BUFSIZ && f->mode != _IONBF)
+            {
+              int r;
+
+              if (f->state == STREAM_WRITE && flush_write (f) == EOF)
+                break;
+              f->state = STREAM_IDLE;
+              r = read (f->fd, p, left);
+              if (r <= 0)
+                {
+                  if (r == 0)
+                    f->eof = true;
+                  else
+                    f->error = true;
+                  break;
+                }
+              p += r;
+              left -= r;
+              continue;
+            }
+          if (!fill (f))
+            break;
+        }
+
+      n = f->len - f->pos < left ? f->len - f->pos : left;
+      memcpy (p, f->buf + f->pos, n);
+      p += n;
+      f->pos += n;
+      left -= n;
+    }
+  return (total - left) / size;
+}
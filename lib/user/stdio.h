@@ -4,4 +4,41 @@
 int hprintf (int, const char *, ...) PRINTF_FORMAT (2, 3);
 int vhprintf (int, const char *, va_list) PRINTF_FORMAT (2, 0);
 
+/* Buffered streams, in lib/user/stdio.c. */
+typedef struct FILE FILE;
+
+#define EOF (-1)                /* Returned at end of file or on error. */
+#define BUFSIZ 512              /* Size of each stream's buffer. */
+#define FOPEN_MAX 8             /* Streams open at once, counting stdin
+                                   and stdout. */
+
+/* Buffering modes. */
+#define _IOFBF 0                /* Write out only when the buffer fills. */
+#define _IOLBF 1                /* Also write out at each new-line. */
+#define _IONBF 2                /* Transfer every byte at once. */
+
+extern FILE *stdin;
+extern FILE *stdout;
+
+FILE *fopen (const char *name, const char *mode);
+FILE *fdopen (int fd, const char *mode);
+int fclose (FILE *);
+int fflush (FILE *);
+int fileno (FILE *);
+int feof (FILE *);
+int ferror (FILE *);
+
+int fputc (int, FILE *);
+int putc (int, FILE *);
+int fputs (const char *, FILE *);
+size_t fwrite (const void *, size_t size, size_t cnt, FILE *);
+int fprintf (FILE *, const char *, ...) PRINTF_FORMAT (2, 3);
+int vfprintf (FILE *, const char *, va_list) PRINTF_FORMAT (2, 0);
+
+int fgetc (FILE *);
+int getc (FILE *);
+int getchar (void);
+char *fgets (char *, int size, FILE *);
+size_t fread (void *, size_t size, size_t cnt, FILE *);
+
 #endif /* lib/user/stdio.h */
@@ -1,4 +1,7 @@
 #include <syscall.h>
+#include <clock-page.h>
+#include <stddef.h>
+#include <stdio.h>
 #include "../syscall-nr.h"
 
 /* Invokes syscall NUMBER, passing no arguments, and returns the
@@ -61,9 +64,29 @@
           retval;                                               \
         })
 
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2,
+   and ARG3, and returns the return value as an `int'. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg3]; pushl %[arg2]; pushl %[arg1]; "    \
+             "pushl %[arg0]; pushl %[number]; int $0x30; "      \
+             "addl $20, %%esp"                                  \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [arg0] "r" (ARG0),                             \
+                 [arg1] "r" (ARG1),                             \
+                 [arg2] "r" (ARG2),                             \
+                 [arg3] "g" (ARG3)                              \
+               : "memory");                                     \
+          retval;                                               \
+        })
+
 void
 halt (void) 
 {
+  fflush (NULL);
   syscall0 (SYS_HALT);
   NOT_REACHED ();
 }
@@ -71,6 +94,7 @@ halt (void)
 void
 exit (int status)
 {
+  fflush (NULL);
   syscall1 (SYS_EXIT, status);
   NOT_REACHED ();
 }
@@ -87,6 +111,15 @@ wait (pid_t pid)
   return syscall1 (SYS_WAIT, pid);
 }
 
+/* Waits for whichever child exits first, stores its exit status
+   in *STATUS unless STATUS is null, and returns its pid.  Returns
+   PID_ERROR if there are no children to wait for. */
+pid_t
+wait_any (int *status)
+{
+  return syscall1 (SYS_WAIT_ANY, status);
+}
+
 bool
 create (const char *file, unsigned initial_size)
 {
@@ -182,3 +215,314 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+readv (int fd, const struct iovec *iov, int iov_cnt) 
+{
+  return syscall3 (SYS_READV, fd, iov, iov_cnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iov_cnt) 
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iov_cnt);
+}
+
+int
+pread (int fd, void *buffer, unsigned size, unsigned offset) 
+{
+  return syscall4 (SYS_PREAD, fd, buffer, size, offset);
+}
+
+int
+pwrite (int fd, const void *buffer, unsigned size, unsigned offset) 
+{
+  return syscall4 (SYS_PWRITE, fd, buffer, size, offset);
+}
+
+int
+submit (struct syscall_req *reqs, int cnt) 
+{
+  return syscall2 (SYS_SUBMIT, reqs, cnt);
+}
+
+pid_t
+fork (void)
+{
+  /* Otherwise both processes would write out what is buffered. */
+  fflush (NULL);
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+/* Runs first in a thread started by thread_create(), which
+   leaves FUNC and AUX on the new stack as arguments.  A thread
+   that returns from FUNC exits with its return value. */
+static void
+thread_start (int (*func) (void *), void *aux) 
+{
+  exit (func (aux));
+}
+
+/* Starts a new thread in this process that runs FUNC (AUX) on
+   the stack that ends at STACK_TOP and returns its id, or
+   TID_ERROR.  The thread exits when FUNC returns. */
+tid_t
+thread_create (int (*func) (void *), void *aux, void *stack_top) 
+{
+  void **sp = stack_top;
+
+  *--sp = aux;
+  *--sp = func;
+  *--sp = NULL;                 /* Return address. */
+  return (tid_t) syscall2 (SYS_THREAD_CREATE, thread_start, sp);
+}
+
+int
+thread_join (tid_t tid) 
+{
+  return syscall1 (SYS_THREAD_JOIN, tid);
+}
+
+int
+futex_wait (int *uaddr, int val) 
+{
+  return syscall2 (SYS_FUTEX_WAIT, uaddr, val);
+}
+
+int
+futex_wake (int *uaddr, int cnt) 
+{
+  return syscall2 (SYS_FUTEX_WAKE, uaddr, cnt);
+}
+
+/* Grows the heap by INCREMENT bytes, or shrinks it if INCREMENT
+   is negative, and returns the old end of the heap, or
+   (void *) -1 on failure.  The heap cannot shrink below where
+   it started, and shrinking it past memory that malloc() handed
+   out frees that memory out from under malloc(). */
+void *
+sbrk (int increment) 
+{
+  return (void *) syscall1 (SYS_SBRK, increment);
+}
+
+/* Moves the calling thread into a new process group with the
+   given WEIGHT, between 1 and 10000, and returns the group's
+   number, or -1 on failure.  Within a priority level, groups
+   share the CPU in proportion to their weights; group 0, where
+   every process starts, has weight 100.  Threads and processes
+   started afterward join the caller's group. */
+int
+group_create (int weight) 
+{
+  return syscall1 (SYS_GROUP_CREATE, weight);
+}
+
+/* Moves the calling thread into process GROUP.  Returns false
+   if there is no such group. */
+bool
+group_join (int group) 
+{
+  return syscall1 (SYS_GROUP_JOIN, group);
+}
+
+/* Sets the weight of process GROUP.  Returns false if there is
+   no such group or WEIGHT is out of range. */
+bool
+group_set_weight (int group, int weight) 
+{
+  return syscall2 (SYS_GROUP_SET_WEIGHT, group, weight);
+}
+
+/* Creates a pipe.  Stores the fd of its read end in FDS[0] and
+   of its write end in FDS[1], and returns true, or returns false
+   if the kernel is out of memory.  A read blocks until there is
+   data, and returns 0 once every write end is closed and the
+   data is gone.  A write blocks until all of it fits, and fails
+   if every read end is closed.  Both ends are inherited across
+   fork(). */
+bool
+pipe (int fds[2]) 
+{
+  return syscall1 (SYS_PIPE, fds);
+}
+
+/* Creates a shared memory segment of SIZE bytes, rounded up to
+   whole pages, that reads as zeros, and returns its id, or -1 on
+   failure.  The segment lasts as long as some process that
+   created or mapped it, or was forked from one that did, is
+   alive. */
+int
+shm_create (size_t size) 
+{
+  return syscall1 (SYS_SHM_CREATE, size);
+}
+
+/* Maps all of shared memory segment ID, writable, at ADDR, which
+   must be page-aligned, and returns true.  Returns false if
+   there is no such segment, or if part of its range is already
+   in use.  A futex in the segment is shared by every process
+   that maps it. */
+bool
+shm_map (int id, void *addr) 
+{
+  return syscall2 (SYS_SHM_MAP, id, addr);
+}
+
+/* Waits until at least one of the CNT entries in FDS has one of
+   its events, or until TIMEOUT timer ticks have passed, or
+   forever if TIMEOUT is negative.  Sets each entry's revents and
+   returns the number of entries with any, 0 on timeout, or -1
+   if CNT is too large or memory is short.
+
+   An entry watches its fd, which may be the console, a pipe
+   end, or a file, which is always ready, unless it is negative;
+   or, if its events include POLLCHILD, the child with its fd as
+   pid, or any child if the fd is -1, for an exit that wait() or
+   wait_any() can reap without waiting. */
+int
+poll (struct pollfd *fds, unsigned cnt, int timeout) 
+{
+  return syscall3 (SYS_POLL, fds, cnt, timeout);
+}
+
+/* Queues the CNT requests that CBS points to, in order, and
+   returns at once with the number queued, which is less than CNT
+   if the next request's fd is not an open file or its size is 0
+   or too large, or if AIO_MAX requests are already outstanding.
+   Each request and its buffer must be left alone until
+   aio_wait() returns it. */
+int
+aio_submit (struct aiocb *cbs[], int cnt) 
+{
+  return syscall2 (SYS_AIO_SUBMIT, cbs, cnt);
+}
+
+/* Waits until at least one queued request has finished, or
+   until TIMEOUT timer ticks have passed, or forever if TIMEOUT
+   is negative.  Then stores pointers to up to MAX finished
+   requests into DONE, in the order they finished, with each
+   one's result set to the number of bytes it transferred or -1,
+   and returns how many it stored.  Returns -1 at once if no
+   requests are outstanding. */
+int
+aio_wait (struct aiocb *done[], int max, int timeout) 
+{
+  return syscall3 (SYS_AIO_WAIT, done, max, timeout);
+}
+
+/* Reads as many entries as fit in the SIZE bytes at DENTS from
+   directory FD, continuing where the last call, or readdir(),
+   left off, and returns the number read, 0 at the end of the
+   directory, or -1 if FD is not open. */
+int
+getdents (int fd, struct dirent *dents, unsigned size) 
+{
+  return syscall3 (SYS_GETDENTS, fd, dents, size);
+}
+
+/* Copies the clock page into *C, retrying until the copy is not
+   torn by a kernel update. */
+static void
+read_clock (struct clock_page *c) 
+{
+  const struct clock_page *page = (const struct clock_page *) CLOCK_PAGE;
+  uint32_t seq;
+
+  do
+    {
+      seq = page->seq;
+      c->ticks = page->ticks;
+      c->run_ticks = page->run_ticks;
+      c->load_avg = page->load_avg;
+    }
+  while ((seq & 1) != 0 || page->seq != seq);
+}
+
+/* Returns the number of timer ticks since the OS booted. */
+int64_t
+clock_ticks (void) 
+{
+  struct clock_page c;
+
+  read_clock (&c);
+  return c.ticks;
+}
+
+/* Returns the number of timer ticks for which this process's
+   threads have run. */
+int64_t
+clock_run_ticks (void) 
+{
+  struct clock_page c;
+
+  read_clock (&c);
+  return c.run_ticks;
+}
+
+/* Returns 100 times the system load average. */
+int
+clock_load_avg (void) 
+{
+  struct clock_page c;
+
+  read_clock (&c);
+  return c.load_avg;
+}
+
+/* Sets aside disk space for the LENGTH bytes of FD starting at
+   OFFSET, extending the file to cover them if needed, so that
+   writing them later does not wait on the allocator.  The space
+   reads as zeros until written.  Returns true if successful. */
+bool
+fallocate (int fd, unsigned offset, unsigned length) 
+{
+  return syscall3 (SYS_FALLOCATE, fd, offset, length);
+}
+
+/* Opens FILE as open() does, with the O_* FLAGS.  With O_DIRECT,
+   reads and writes whose buffer and file offset are both
+   multiples of 512 bytes move whole sectors between the buffer
+   and the disk without going through the buffer cache, which
+   suits large one-time streams.  Returns the new fd, or -1. */
+int
+open_flags (const char *file, int flags) 
+{
+  return syscall2 (SYS_OPEN_FLAGS, file, flags);
+}
+
+/* Tells the kernel how FD is going to be read.  FADV_SEQUENTIAL
+   and FADV_RANDOM hold until changed or FD is closed: the first
+   reads ahead as far as it goes, the second not at all, and
+   FADV_NORMAL goes back to guessing.  FADV_WILLNEED starts
+   reading the LENGTH bytes at OFFSET into the buffer cache in
+   the background, and FADV_DONTNEED lets the cache give them up
+   first.  Returns true if successful. */
+bool
+fadvise (int fd, unsigned offset, unsigned length, int advice) 
+{
+  return syscall4 (SYS_FADVISE, fd, offset, length, advice);
+}
+
+/* Tells the kernel how the LENGTH bytes of memory at ADDR, which
+   must be page-aligned, are going to be used.  MADV_WILLNEED
+   starts bringing their pages in from files, or brings them in
+   from swap; MADV_DONTNEED gives up the frames of pages that are
+   unmodified since they were brought in, to be brought back on
+   the next access.  Returns true if successful. */
+bool
+madvise (void *addr, unsigned length, int advice) 
+{
+  return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+/* Stores the resource use of this process, if WHO is
+   RUSAGE_SELF, or the totals of the children it has waited for,
+   and of theirs in turn, if WHO is RUSAGE_CHILDREN, in *USAGE.
+   For children, rss is 0 and rss_max is the largest child's
+   peak.  Returns true if successful. */
+bool
+getrusage (int who, struct rusage *usage) 
+{
+  return syscall2 (SYS_GETRUSAGE, who, usage);
+}
@@ -2,12 +2,18 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <debug.h>
+#include <stdint.h>
 
 /* Process identifier. */
 typedef int pid_t;
 #define PID_ERROR ((pid_t) -1)
 
+/* Thread identifier, for threads within a process. */
+typedef int tid_t;
+#define TID_ERROR ((tid_t) -1)
+
 /* Map region identifier. */
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
@@ -15,6 +21,95 @@ typedef int mapid_t;
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* One directory entry, as getdents() returns it. */
+struct dirent
+  {
+    int inumber;                        /* Inode number. */
+    char name[READDIR_MAX_LEN + 1];     /* Null-terminated name. */
+  };
+
+/* One buffer for readv() and writev(). */
+struct iovec
+  {
+    void *iov_base;             /* Start of buffer. */
+    unsigned iov_len;           /* Length of buffer in bytes. */
+  };
+
+/* One system call in a batch for submit(). */
+struct syscall_req
+  {
+    int number;                 /* SYS_* number from <syscall-nr.h>. */
+    unsigned args[4];           /* Arguments, as 32-bit words. */
+    int result;                 /* Return value, filled in by submit(). */
+  };
+
+/* One fd, or child, for poll() to watch. */
+struct pollfd
+  {
+    int fd;                     /* Fd, or pid with POLLCHILD. */
+    short events;               /* POLL* events to watch for. */
+    short revents;              /* Those that happened, from poll(). */
+  };
+
+/* Events for poll().  POLLERR, POLLHUP, and POLLNVAL are
+   reported whether or not they are asked for. */
+#define POLLIN 0x01             /* Reading would not wait. */
+#define POLLOUT 0x04            /* Writing would not wait. */
+#define POLLERR 0x08            /* Every read end of the pipe closed. */
+#define POLLHUP 0x10            /* Every write end of the pipe closed. */
+#define POLLNVAL 0x20           /* Fd not open, or no such child. */
+#define POLLCHILD 0x40          /* Child exited, for wait(). */
+
+/* Flags for open_flags(). */
+#define O_DIRECT 0x01           /* Bypass the buffer cache. */
+
+/* Advice for fadvise(). */
+#define FADV_NORMAL 0           /* No particular pattern. */
+#define FADV_SEQUENTIAL 1       /* Read in order. */
+#define FADV_RANDOM 2           /* Read at random. */
+#define FADV_WILLNEED 3         /* Range will be read soon. */
+#define FADV_DONTNEED 4         /* Range will not be read soon. */
+
+/* Advice for madvise(). */
+#define MADV_NORMAL 0           /* No particular pattern. */
+#define MADV_WILLNEED 3         /* Range will be used soon. */
+#define MADV_DONTNEED 4         /* Range will not be used soon. */
+
+/* One asynchronous read or write, for aio_submit(). */
+struct aiocb
+  {
+    int fd;                     /* File to read or write. */
+    void *buf;                  /* Buffer. */
+    unsigned size;              /* Bytes, at most AIO_SIZE_MAX. */
+    unsigned offset;            /* Offset in the file. */
+    bool write;                 /* Write rather than read? */
+    int result;                 /* Set by aio_wait(). */
+  };
+
+/* Largest request for aio_submit(), in bytes, and most requests
+   a process may have outstanding. */
+#define AIO_SIZE_MAX (32 * 1024)
+#define AIO_MAX 32
+
+/* Resource use, for getrusage().  Ticks are timer ticks,
+   TIMER_FREQ a second; sectors are 512 bytes, counting disk
+   transfers made while a thread of the process was running. */
+struct rusage
+  {
+    unsigned rss;               /* Pages resident now. */
+    unsigned rss_max;           /* Most pages resident at once. */
+    unsigned minor_faults;      /* Faults served from memory. */
+    unsigned major_faults;      /* Faults that read a file or swap. */
+    uint64_t read_bytes;        /* Read through system calls. */
+    uint64_t write_bytes;       /* Written through system calls. */
+    uint64_t read_sectors;      /* Read from disk. */
+    uint64_t write_sectors;     /* Written to disk. */
+    int64_t user_ticks;         /* Timer ticks in user mode. */
+    int64_t kernel_ticks;       /* Timer ticks in the kernel. */
+  };
+#define RUSAGE_SELF 0           /* The calling process. */
+#define RUSAGE_CHILDREN 1       /* Children it has waited for. */
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -45,4 +140,38 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+int readv (int fd, const struct iovec *, int iov_cnt);
+int writev (int fd, const struct iovec *, int iov_cnt);
+int pread (int fd, void *buffer, unsigned length, unsigned offset);
+int pwrite (int fd, const void *buffer, unsigned length, unsigned offset);
+int submit (struct syscall_req *, int cnt);
+pid_t fork (void);
+pid_t wait_any (int *status);
+tid_t thread_create (int (*func) (void *), void *aux, void *stack_top);
+int thread_join (tid_t);
+int futex_wait (int *uaddr, int val);
+int futex_wake (int *uaddr, int cnt);
+void *sbrk (int increment);
+int group_create (int weight);
+bool group_join (int group);
+bool group_set_weight (int group, int weight);
+bool pipe (int fds[2]);
+int shm_create (size_t size);
+bool shm_map (int id, void *addr);
+int poll (struct pollfd *, unsigned cnt, int timeout);
+int aio_submit (struct aiocb *cbs[], int cnt);
+int aio_wait (struct aiocb *done[], int max, int timeout);
+int getdents (int fd, struct dirent *, unsigned size);
+bool fallocate (int fd, unsigned offset, unsigned length);
+int open_flags (const char *file, int flags);
+bool fadvise (int fd, unsigned offset, unsigned length, int advice);
+bool madvise (void *addr, unsigned length, int advice);
+bool getrusage (int who, struct rusage *);
+
+/* Read from the clock page, without a system call. */
+int64_t clock_ticks (void);
+int64_t clock_run_ticks (void);
+int clock_load_avg (void);
+
 #endif /* lib/user/syscall.h */
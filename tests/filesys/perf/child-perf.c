@@ -0,0 +1,54 @@
+/* Child process for perf-parallel test.
+   Writes a file of its own sequentially, reads it back several
+   times, and deletes it. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/perf/perf-parallel.h"
+
+static char buf[BLOCK_SIZE];
+static char data[BLOCK_SIZE];
+
+int
+main (int argc, const char *argv[]) 
+{
+  char file_name[16];
+  int child_idx;
+  size_t ofs;
+  int fd;
+  int i;
+
+  test_name = "child-perf";
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+  snprintf (file_name, sizeof file_name, "par%d", child_idx);
+
+  random_init (child_idx);
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += BLOCK_SIZE)
+    if (write (fd, buf, BLOCK_SIZE) != BLOCK_SIZE)
+      fail ("write %d bytes at offset %zu in \"%s\" failed",
+            BLOCK_SIZE, ofs, file_name);
+  for (i = 0; i < READ_PASSES; i++) 
+    {
+      seek (fd, 0);
+      for (ofs = 0; ofs < FILE_SIZE; ofs += BLOCK_SIZE) 
+        {
+          if (read (fd, data, BLOCK_SIZE) != BLOCK_SIZE)
+            fail ("read %d bytes at offset %zu in \"%s\" failed",
+                  BLOCK_SIZE, ofs, file_name);
+          compare_bytes (data, buf, BLOCK_SIZE, ofs, file_name);
+        }
+    }
+  close (fd);
+  CHECK (remove (file_name), "remove \"%s\"", file_name);
+
+  return child_idx;
+}
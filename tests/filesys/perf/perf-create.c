@@ -0,0 +1,34 @@
+/* Creates and then deletes a batch of empty files, several
+   times over, to measure the rate of creations and deletions. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 50
+#define ROUNDS 8
+
+void
+test_main (void) 
+{
+  char name[16];
+  int round, i;
+
+  msg ("create and remove %d files %d times", FILE_CNT, ROUNDS);
+  for (round = 0; round < ROUNDS; round++) 
+    {
+      for (i = 0; i < FILE_CNT; i++) 
+        {
+          snprintf (name, sizeof name, "file%d", i);
+          if (!create (name, 0))
+            fail ("create \"%s\" failed in round %d", name, round);
+        }
+      for (i = 0; i < FILE_CNT; i++) 
+        {
+          snprintf (name, sizeof name, "file%d", i);
+          if (!remove (name))
+            fail ("remove \"%s\" failed in round %d", name, round);
+        }
+    }
+}
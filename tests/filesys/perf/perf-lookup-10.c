@@ -0,0 +1,6 @@
+/* Opens the files of a directory with 10 entries over and over,
+   to measure the rate of directory lookups. */
+
+#define ENTRY_CNT 10
+#define LOOKUP_CNT 4000
+#include "tests/filesys/perf/perf-lookup.inc"
@@ -0,0 +1,17 @@
+/* Spawns several child processes that each write and then read
+   back a file of their own at the same time, to measure how
+   throughput scales with concurrent readers and writers. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/perf/perf-parallel.h"
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+
+  exec_children ("child-perf", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+}
@@ -0,0 +1,9 @@
+#ifndef TESTS_FILESYS_PERF_PERF_PARALLEL_H
+#define TESTS_FILESYS_PERF_PERF_PARALLEL_H
+
+#define CHILD_CNT 4
+#define FILE_SIZE (64 * 1024)
+#define BLOCK_SIZE 4096
+#define READ_PASSES 4
+
+#endif /* tests/filesys/perf/perf-parallel.h */
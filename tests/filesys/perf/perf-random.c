@@ -0,0 +1,58 @@
+/* Reads and writes single 512-byte blocks at random offsets
+   within a 256 kB file, alternating between the two, to measure
+   random I/O operations per second. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (256 * 1024)
+#define BLOCK_SIZE 512
+#define BLOCK_CNT (FILE_SIZE / BLOCK_SIZE)
+#define OP_CNT 4096
+
+static char buf[FILE_SIZE];
+static char block[BLOCK_SIZE];
+
+static const char file_name[] = "random";
+
+void
+test_main (void) 
+{
+  int fd;
+  int i;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write \"%s\"", file_name);
+
+  msg ("%d random %d-byte reads and writes", OP_CNT, BLOCK_SIZE);
+  for (i = 0; i < OP_CNT; i++) 
+    {
+      size_t ofs = random_ulong () % BLOCK_CNT * BLOCK_SIZE;
+
+      seek (fd, ofs);
+      if (i % 2 == 0) 
+        {
+          if (read (fd, block, BLOCK_SIZE) != BLOCK_SIZE)
+            fail ("read %d bytes at offset %zu in \"%s\" failed",
+                  BLOCK_SIZE, ofs, file_name);
+          compare_bytes (block, buf + ofs, BLOCK_SIZE, ofs, file_name);
+        }
+      else 
+        {
+          random_bytes (buf + ofs, BLOCK_SIZE);
+          if (write (fd, buf + ofs, BLOCK_SIZE) != BLOCK_SIZE)
+            fail ("write %d bytes at offset %zu in \"%s\" failed",
+                  BLOCK_SIZE, ofs, file_name);
+        }
+    }
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, buf, sizeof buf);
+}
@@ -0,0 +1,6 @@
+/* Writes a 128 kB file sequentially, 4 kB at a time, then reads it
+   back 8 times, to measure sequential throughput. */
+
+#define TEST_SIZE 131072
+#define READ_PASSES 8
+#include "tests/filesys/perf/perf-seq.inc"
@@ -0,0 +1,6 @@
+/* Writes a 16 kB file sequentially, 4 kB at a time, then reads it
+   back 64 times, to measure sequential throughput. */
+
+#define TEST_SIZE 16384
+#define READ_PASSES 64
+#include "tests/filesys/perf/perf-seq.inc"
@@ -0,0 +1,6 @@
+/* Writes a 1 MB file sequentially, 4 kB at a time, then reads it
+   back twice, to measure sequential throughput. */
+
+#define TEST_SIZE 1048576
+#define READ_PASSES 2
+#include "tests/filesys/perf/perf-seq.inc"
@@ -0,0 +1,68 @@
+# -*- perl -*-
+
+# Checks that a file system performance test ran to completion
+# and reports what it cost.
+#
+# A user program has no clock of its own, so the figures come
+# from the statistics the kernel prints on shutdown and cover the
+# whole run, including booting and loading the test program.
+# Each test therefore does one kind of work, enough of it to
+# dominate the run.  Pass BYTES for a test that moves data, to get
+# a throughput, or OPS for one that counts operations, to get a
+# rate.  The report goes to the terminal, not the result file, so
+# that a run passes or fails just as other tests do.
+
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+
+sub check_perf {
+    my (%args) = @_;
+    my (@output) = read_text_file ("$test.output");
+
+    common_checks ("run", @output);
+
+    my ($name) = $test =~ m|([^/]+)$|;
+    my (@core) = get_core_output ("run", @output);
+    fail "missing end in output"
+      unless grep ($_ eq "($name) end", @core);
+
+    my ($ticks, $hits, $misses, $reads, $writes, $dhits, $dmisses);
+    for (@output) {
+	($ticks) = /^Timer: (\d+) ticks$/ if /^Timer:/;
+	($hits, $misses) = /^Buffer cache: (\d+) hits, (\d+) misses/
+	  if /^Buffer cache:/;
+	($dhits, $dmisses) = /^Dentry cache: (\d+) hits .*, (\d+) misses$/
+	  if /^Dentry cache:/;
+	($reads, $writes) = /\(filesys\): (\d+) reads, (\d+) writes$/
+	  if /\(filesys\):/;
+    }
+    fail "missing timer statistics in output" unless defined $ticks;
+    fail "missing buffer cache statistics in output" unless defined $hits;
+    fail "missing block statistics in output" unless defined $reads;
+
+    # The timer runs at 100 Hz.
+    my ($secs) = ($ticks > 0 ? $ticks : 1) / 100;
+    my (@report) = ("$name: $ticks ticks");
+    push (@report, sprintf ("  %.2f MB/s", $args{BYTES} / $secs / 1048576))
+      if defined $args{BYTES};
+    push (@report, sprintf ("  %.0f ops/s", $args{OPS} / $secs))
+      if defined $args{OPS};
+    push (@report, sprintf ("  buffer cache hit rate %.1f%% "
+			    . "(%d hits, %d misses)",
+			    100 * $hits / ($hits + $misses || 1),
+			    $hits, $misses));
+    push (@report, sprintf ("  dentry cache hit rate %.1f%% "
+			    . "(%d hits, %d misses)",
+			    100 * $dhits / ($dhits + $dmisses || 1),
+			    $dhits, $dmisses))
+      if defined $dhits;
+    push (@report, "  filesys device: $reads reads, $writes writes");
+    print STDOUT "$_\n" foreach @report;
+
+    pass;
+}
+
+1;
@@ -0,0 +1,67 @@
+/* Puts THREAD_CNT threads to sleep with overlapping slack
+   windows and checks that each wakes within its own window and
+   that between them they wake on at most two ticks, where
+   without slack they would wake on THREAD_CNT different ones. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 8
+#define SLACK 16
+
+static struct semaphore done;
+static int64_t woke[THREAD_CNT];
+static bool late[THREAD_CNT];
+
+static thread_func sleeper;
+
+void
+test_alarm_slack (void) 
+{
+  int distinct = 0;
+  int i, j;
+
+  sema_init (&done, 0);
+
+  /* Start right after a tick, so that the sleepers all start on
+     the same one. */
+  timer_sleep (1);
+  for (i = 0; i < THREAD_CNT; i++)
+    thread_create ("sleeper", PRI_DEFAULT + 1, sleeper, (void *) i);
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      if (late[i])
+        fail ("Sleeper %d woke outside its slack window.", i);
+      for (j = 0; j < i; j++)
+        if (woke[j] == woke[i])
+          break;
+      if (j == i)
+        distinct++;
+    }
+  msg ("All sleepers woke within their slack windows.");
+  if (distinct > 2)
+    fail ("Sleepers woke on %d different ticks.", distinct);
+  msg ("Sleepers woke on at most 2 different ticks.");
+}
+
+/* Sleeps for 10 + AUX ticks with SLACK ticks of slack. */
+static void
+sleeper (void *aux) 
+{
+  int i = (int) aux;
+  int64_t start = timer_ticks ();
+  int64_t ticks = 10 + i;
+
+  timer_sleep_slack (ticks, SLACK);
+  woke[i] = timer_ticks ();
+  late[i] = (woke[i] < start + ticks
+             || woke[i] > start + ticks + SLACK + 1);
+  sema_up (&done);
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-slack) begin
+(alarm-slack) All sleepers woke within their slack windows.
+(alarm-slack) Sleepers woke on at most 2 different ticks.
+(alarm-slack) end
+EOF
+pass;
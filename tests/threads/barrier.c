@@ -0,0 +1,75 @@
+/* Runs several threads through a few phases separated by a
+   barrier, checking that no thread starts a phase before all of
+   them have finished the previous one, then has the main thread
+   wait for all of them on a latch. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define THREAD_CNT 4
+#define PHASE_CNT 3
+
+static struct barrier barrier;
+static struct latch done;
+static int finished[PHASE_CNT];
+static int last_arrivals;
+static bool out_of_phase;
+
+static thread_func worker;
+
+void
+test_barrier (void) 
+{
+  int i;
+
+  barrier_init (&barrier, THREAD_CNT);
+  latch_init (&done, THREAD_CNT);
+
+  for (i = 0; i < THREAD_CNT; i++) 
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "worker %d", i);
+      thread_create (name, PRI_DEFAULT, worker, NULL);
+    }
+  latch_wait (&done);
+
+  for (i = 0; i < PHASE_CNT; i++)
+    msg ("Phase %d: %d of %d threads finished.", i, finished[i], THREAD_CNT);
+  msg ("Last arrivals: %d of %d phases.", last_arrivals, PHASE_CNT);
+  if (out_of_phase)
+    fail ("A thread started a phase before the previous one ended.");
+}
+
+static void
+worker (void *aux UNUSED) 
+{
+  int phase;
+
+  for (phase = 0; phase < PHASE_CNT; phase++) 
+    {
+      enum intr_level old_level;
+
+      if (phase > 0 && finished[phase - 1] != THREAD_CNT)
+        out_of_phase = true;
+
+      /* Give the others a chance to run ahead, if they could. */
+      thread_yield ();
+
+      old_level = intr_disable ();
+      finished[phase]++;
+      intr_set_level (old_level);
+
+      if (barrier_wait (&barrier))
+        {
+          old_level = intr_disable ();
+          last_arrivals++;
+          intr_set_level (old_level);
+        }
+    }
+  latch_countdown (&done);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(barrier) begin
+(barrier) Phase 0: 4 of 4 threads finished.
+(barrier) Phase 1: 4 of 4 threads finished.
+(barrier) Phase 2: 4 of 4 threads finished.
+(barrier) Last arrivals: 3 of 3 phases.
+(barrier) end
+EOF
+pass;
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench (RESULTS => ['Pages copied and zeroed correctly.'],
+	     TIMINGS => [qr/zero 4096 bytes: scalar \d+(, SSE2 \d+)? cycles/]);
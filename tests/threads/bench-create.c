@@ -0,0 +1,47 @@
+/* Times thread_create() for threads that exit as soon as they
+   run.  Each thread has a higher priority than the main thread,
+   so it runs and exits before thread_create() returns, and each
+   iteration covers creation, one switch in, thread_exit(), and
+   one switch back that frees the dead thread's page.  Every
+   thread must have run and exited by the end. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/thread.h"
+
+#define THREAD_CNT 1000
+
+static int exited;
+
+static thread_func quick_exit;
+
+void
+test_bench_create (void) 
+{
+  uint64_t start, cycles;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  start = rdtsc ();
+  for (i = 0; i < THREAD_CNT; i++)
+    if (thread_create ("quick", PRI_DEFAULT + 1, quick_exit, NULL)
+        == TID_ERROR)
+      fail ("thread_create failed after %d threads", i);
+  cycles = rdtsc () - start;
+
+  if (exited != THREAD_CNT)
+    fail ("%d of %d threads exited", exited, THREAD_CNT);
+  msg ("%d threads created and exited.", exited);
+  msg ("%d threads: %llu cycles per create and exit.",
+       THREAD_CNT, cycles / THREAD_CNT);
+}
+
+static void
+quick_exit (void *aux UNUSED) 
+{
+  exited++;
+}
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench (RESULTS => ['1000 threads created and exited.'],
+	     TIMINGS => [qr/\d+ threads: \d+ cycles per create and exit\./]);
@@ -0,0 +1,102 @@
+/* Times 64-bit division in lib/arithmetic.c against a bit-by-bit
+   shift-and-subtract loop, for the kinds of divisor the kernel
+   uses, and checks every quotient and remainder against that
+   loop. */
+
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+
+#define VALUE_CNT 256
+
+/* Divides N by D one bit at a time.  Returns the quotient and
+   stores the remainder in *R. */
+static uint64_t
+divide_bits (uint64_t n, uint64_t d, uint64_t *r) 
+{
+  uint64_t q = 0, rem = 0;
+  int i;
+
+  for (i = 63; i >= 0; i--)
+    {
+      rem = (rem << 1) | ((n >> i) & 1);
+      if (rem >= d)
+        {
+          rem -= d;
+          q |= (uint64_t) 1 << i;
+        }
+    }
+  *r = rem;
+  return q;
+}
+
+static uint64_t
+random_u64 (void) 
+{
+  return ((uint64_t) random_ulong () << 32) | random_ulong ();
+}
+
+static uint64_t ns[VALUE_CNT], ds[VALUE_CNT];
+
+/* Keeps the timed quotients from being optimized away. */
+static volatile uint64_t sink;
+
+/* Fills ns[] and ds[] with random dividends shifted right by
+   N_SHIFT and random divisors shifted right by D_SHIFT, or with
+   random powers of 2 if D_SHIFT is negative, then times both
+   ways of dividing them. */
+static void
+bench (const char *name, int n_shift, int d_shift) 
+{
+  uint64_t start, bits_cycles, div_cycles;
+  int i;
+
+  for (i = 0; i < VALUE_CNT; i++)
+    {
+      ns[i] = random_u64 () >> n_shift;
+      if (d_shift < 0)
+        ds[i] = (uint64_t) 1 << (random_ulong () & 63);
+      else
+        ds[i] = (random_u64 () >> d_shift) | 1;
+    }
+
+  for (i = 0; i < VALUE_CNT; i++)
+    {
+      uint64_t r, q = divide_bits (ns[i], ds[i], &r);
+      if (ns[i] / ds[i] != q || ns[i] % ds[i] != r)
+        fail ("%s: %llu / %llu gave %llu rem %llu, expected %llu rem %llu",
+              name, ns[i], ds[i], ns[i] / ds[i], ns[i] % ds[i], q, r);
+    }
+  msg ("%s: %d quotients and remainders correct", name, VALUE_CNT);
+
+  start = rdtsc ();
+  for (i = 0; i < VALUE_CNT; i++)
+    {
+      uint64_t r;
+      sink = divide_bits (ns[i], ds[i], &r);
+    }
+  bits_cycles = (rdtsc () - start) / VALUE_CNT;
+
+  start = rdtsc ();
+  for (i = 0; i < VALUE_CNT; i++)
+    sink = ns[i] / ds[i];
+  div_cycles = (rdtsc () - start) / VALUE_CNT;
+
+  msg ("%s: bit by bit %llu, divide %llu cycles",
+       name, bits_cycles, div_cycles);
+}
+
+void
+test_bench_divide (void) 
+{
+  random_init (421);
+
+  /* Tick counts divided by a timer frequency. */
+  bench ("32-bit by 32-bit", 32, 32);
+  /* Byte counts divided by a block size. */
+  bench ("64-bit by 32-bit", 0, 32);
+  bench ("64-bit by power of 2", 0, -1);
+  bench ("64-bit by 64-bit", 0, 8);
+}
@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench (RESULTS => [map ("$_: 256 quotients and remainders correct",
+			      '32-bit by 32-bit', '64-bit by 32-bit',
+			      '64-bit by power of 2', '64-bit by 64-bit')],
+	     TIMINGS => [qr/64-bit by 64-bit: .* cycles/]);
@@ -0,0 +1,104 @@
+/* Times insertion and lookup of the same keys in a chained
+   struct hash and in a flat map, and checks that both find every
+   key and that removing every key empties the map. */
+
+#include <flatmap.h>
+#include <hash.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/malloc.h"
+
+#define ITEM_CNT 1024
+#define ROUNDS 8
+
+/* An object indexed by key, as an in-memory inode is. */
+struct item
+  {
+    unsigned key;
+    struct hash_elem elem;
+  };
+
+static struct item *items[ITEM_CNT];
+
+static unsigned
+item_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  return hash_int (hash_entry (e, struct item, elem)->key);
+}
+
+static bool
+item_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED) 
+{
+  return (hash_entry (a, struct item, elem)->key
+          < hash_entry (b, struct item, elem)->key);
+}
+
+void
+test_bench_flatmap (void) 
+{
+  struct hash hash;
+  struct flatmap map;
+  uint64_t start, hash_insert_cycles, hash_find_cycles;
+  uint64_t map_insert_cycles, map_find_cycles;
+  int misses = 0;
+  int i, round;
+
+  for (i = 0; i < ITEM_CNT; i++)
+    {
+      items[i] = malloc (sizeof *items[i]);
+      if (items[i] == NULL)
+        fail ("out of memory");
+      items[i]->key = i * 4096;
+    }
+  if (!hash_init (&hash, item_hash, item_less, NULL)
+      || !flatmap_init (&map, 0))
+    fail ("out of memory");
+
+  start = rdtsc ();
+  for (i = 0; i < ITEM_CNT; i++)
+    hash_insert (&hash, &items[i]->elem);
+  hash_insert_cycles = rdtsc () - start;
+
+  start = rdtsc ();
+  for (i = 0; i < ITEM_CNT; i++)
+    flatmap_insert (&map, items[i]->key, items[i]);
+  map_insert_cycles = rdtsc () - start;
+
+  start = rdtsc ();
+  for (round = 0; round < ROUNDS; round++)
+    for (i = 0; i < ITEM_CNT; i++)
+      {
+        struct item probe;
+        probe.key = ((i * 7) % ITEM_CNT) * 4096;
+        if (hash_find (&hash, &probe.elem) == NULL)
+          misses++;
+      }
+  hash_find_cycles = rdtsc () - start;
+
+  start = rdtsc ();
+  for (round = 0; round < ROUNDS; round++)
+    for (i = 0; i < ITEM_CNT; i++)
+      if (flatmap_find (&map, ((i * 7) % ITEM_CNT) * 4096) == NULL)
+        misses++;
+  map_find_cycles = rdtsc () - start;
+
+  msg ("hash: %llu cycles per insert, %llu per lookup",
+       hash_insert_cycles / ITEM_CNT, hash_find_cycles / (ROUNDS * ITEM_CNT));
+  msg ("flatmap: %llu cycles per insert, %llu per lookup",
+       map_insert_cycles / ITEM_CNT, map_find_cycles / (ROUNDS * ITEM_CNT));
+  msg ("%d lookups missed", misses);
+
+  /* Removing every key must leave the map empty. */
+  for (i = 0; i < ITEM_CNT; i++)
+    if (flatmap_remove (&map, items[i]->key) != items[i])
+      fail ("flatmap_remove did not find key %u", items[i]->key);
+  msg ("flatmap holds %zu entries after removal", flatmap_size (&map));
+
+  flatmap_destroy (&map);
+  hash_destroy (&hash, NULL);
+  for (i = 0; i < ITEM_CNT; i++)
+    free (items[i]);
+}
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench (RESULTS => ['0 lookups missed',
+			 'flatmap holds 0 entries after removal'],
+	     TIMINGS => [qr/flatmap: \d+ cycles per insert, \d+ per lookup/]);
@@ -0,0 +1,144 @@
+/* Times hash_bytes() against hash_bytes_fast() on a page and on
+   short names, checks hash_bytes_fast() against known MurmurHash3
+   values, and checks how evenly each hash function spreads a few
+   sets of regular keys, as tables in the kernel see them, over
+   BUCKET_CNT buckets: no bucket may hold more than twice its
+   share. */
+
+#include <hash.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+#define ROUNDS 16
+#define KEY_CNT 4096
+#define BUCKET_CNT 256
+
+static unsigned buckets[BUCKET_CNT];
+
+/* Returns a hash of the Ith key of a key set. */
+typedef unsigned key_hash_func (unsigned i);
+
+static unsigned
+name_fnv (unsigned i) 
+{
+  char name[16];
+  snprintf (name, sizeof name, "file%u", i);
+  return hash_string (name);
+}
+
+static unsigned
+name_fast (unsigned i) 
+{
+  char name[16];
+  snprintf (name, sizeof name, "file%u", i);
+  return hash_bytes_fast (name, strlen (name));
+}
+
+static unsigned
+sector_int (unsigned i) 
+{
+  return hash_int (i * 8);
+}
+
+static unsigned
+sector_u32 (unsigned i) 
+{
+  return hash_u32 (i * 8);
+}
+
+static unsigned
+page_ptr (unsigned i) 
+{
+  return hash_ptr ((void *) (0xc0000000u + i * PGSIZE));
+}
+
+/* Hashes KEY_CNT keys with HASH into BUCKET_CNT buckets and
+   returns the most that went into any one. */
+static unsigned
+worst_bucket (key_hash_func *hash) 
+{
+  unsigned worst = 0;
+  unsigned i;
+
+  memset (buckets, 0, sizeof buckets);
+  for (i = 0; i < KEY_CNT; i++)
+    buckets[hash (i) & (BUCKET_CNT - 1)]++;
+  for (i = 0; i < BUCKET_CNT; i++)
+    if (buckets[i] > worst)
+      worst = buckets[i];
+  return worst;
+}
+
+void
+test_bench_hash (void) 
+{
+  static const struct
+    {
+      const char *name;
+      key_hash_func *hash;
+    }
+  sets[] =
+    {
+      {"names, hash_string", name_fnv},
+      {"names, hash_bytes_fast", name_fast},
+      {"sectors, hash_int", sector_int},
+      {"sectors, hash_u32", sector_u32},
+      {"kernel pages, hash_ptr", page_ptr},
+    };
+  const char *fox = "The quick brown fox jumps over the lazy dog";
+  uint8_t *page;
+  uint64_t start, slow_cycles, fast_cycles;
+  volatile unsigned sink;
+  size_t i, over = 0;
+  int round;
+
+  if (hash_bytes_fast ("hello", 5) != 0x248bfa47
+      || hash_bytes_fast (fox, strlen (fox)) != 0x2e4ff723
+      || hash_bytes_fast ("", 0) != 0)
+    fail ("hash_bytes_fast does not match MurmurHash3");
+  msg ("hash_bytes_fast matches MurmurHash3");
+
+  page = palloc_get_page (PAL_ASSERT);
+  for (i = 0; i < PGSIZE; i++)
+    page[i] = i * 7 + (i >> 8);
+
+  start = rdtsc ();
+  for (round = 0; round < ROUNDS; round++)
+    sink = hash_bytes (page, PGSIZE);
+  slow_cycles = rdtsc () - start;
+  start = rdtsc ();
+  for (round = 0; round < ROUNDS; round++)
+    sink = hash_bytes_fast (page, PGSIZE);
+  fast_cycles = rdtsc () - start;
+  msg ("page: hash_bytes %llu cycles, hash_bytes_fast %llu",
+       slow_cycles / ROUNDS, fast_cycles / ROUNDS);
+
+  start = rdtsc ();
+  for (round = 0; round < ROUNDS; round++)
+    sink = hash_bytes (fox, 16);
+  slow_cycles = rdtsc () - start;
+  start = rdtsc ();
+  for (round = 0; round < ROUNDS; round++)
+    sink = hash_bytes_fast (fox, 16);
+  fast_cycles = rdtsc () - start;
+  msg ("16 bytes: hash_bytes %llu cycles, hash_bytes_fast %llu",
+       slow_cycles / ROUNDS, fast_cycles / ROUNDS);
+  (void) sink;
+  palloc_free_page (page);
+
+  for (i = 0; i < sizeof sets / sizeof *sets; i++)
+    {
+      unsigned worst = worst_bucket (sets[i].hash);
+
+      msg ("%s: worst bucket holds %u of %u keys, %u expected",
+           sets[i].name, worst, KEY_CNT, KEY_CNT / BUCKET_CNT);
+      if (worst > 2 * KEY_CNT / BUCKET_CNT)
+        over++;
+    }
+  msg ("%zu key sets spread unevenly", over);
+}
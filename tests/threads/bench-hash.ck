@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench (RESULTS => ['hash_bytes_fast matches MurmurHash3',
+			 '0 key sets spread unevenly'],
+	     TIMINGS => [qr/page: hash_bytes \d+ cycles, hash_bytes_fast \d+/]);
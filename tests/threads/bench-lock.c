@@ -0,0 +1,97 @@
+/* Times lock_acquire() and lock_release(), first by a single
+   thread with the lock always free, then by 2, 4, and 8 threads
+   that yield while holding the lock, so that nearly every
+   acquisition finds it held and has to block, donate priority,
+   and be woken.  The lock must keep the contenders' increments
+   of a shared counter from being lost. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define UNCONTENDED_CNT 100000
+#define CONTENDED_CNT 1000
+
+static struct lock lock;
+static struct latch done;
+static int counter;
+
+static thread_func contender;
+static void contend (int thread_cnt);
+
+void
+test_bench_lock (void) 
+{
+  uint64_t start, cycles;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  lock_init (&lock);
+
+  start = rdtsc ();
+  for (i = 0; i < UNCONTENDED_CNT; i++) 
+    {
+      lock_acquire (&lock);
+      lock_release (&lock);
+    }
+  cycles = rdtsc () - start;
+  msg ("Uncontended: %llu cycles per acquire and release.",
+       cycles / UNCONTENDED_CNT);
+
+  contend (2);
+  contend (4);
+  contend (8);
+}
+
+/* Runs THREAD_CNT contenders to completion and reports the
+   average cost of one of their acquisitions. */
+static void
+contend (int thread_cnt) 
+{
+  uint64_t start, cycles;
+  int i;
+
+  counter = 0;
+  latch_init (&done, thread_cnt);
+
+  start = rdtsc ();
+  for (i = 0; i < thread_cnt; i++) 
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "lock %d", i);
+      thread_create (name, PRI_DEFAULT, contender, NULL);
+    }
+  latch_wait (&done);
+  cycles = rdtsc () - start;
+
+  if (counter != thread_cnt * CONTENDED_CNT)
+    fail ("counter is %d, expected %d", counter,
+          thread_cnt * CONTENDED_CNT);
+  msg ("%d threads: counter reached %d.", thread_cnt, counter);
+  msg ("%d threads: %llu cycles per contended acquire and release.",
+       thread_cnt, cycles / (thread_cnt * CONTENDED_CNT));
+}
+
+static void
+contender (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < CONTENDED_CNT; i++) 
+    {
+      int value;
+
+      lock_acquire (&lock);
+      value = counter;
+      thread_yield ();
+      counter = value + 1;
+      lock_release (&lock);
+    }
+  latch_countdown (&done);
+}
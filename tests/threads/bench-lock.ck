@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench (RESULTS => ['2 threads: counter reached 2000.',
+			 '4 threads: counter reached 4000.',
+			 '8 threads: counter reached 8000.'],
+	     TIMINGS => [qr/8 threads: \d+ cycles per contended .*\./]);
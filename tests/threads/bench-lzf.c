@@ -0,0 +1,116 @@
+/* Compresses pages of zeros, of text, of small integers, and of
+   random bytes with the LZF codec that the compressed swap cache
+   uses, times compressing and expanding each, and checks that
+   every page comes back intact.  A page that would not shrink
+   reports a compressed size of 0. */
+
+#include <lzf.h>
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+#define ROUNDS 16
+
+/* Fills PAGE with one kind of content. */
+typedef void fill_func (uint8_t *page);
+
+static void
+fill_zero (uint8_t *page) 
+{
+  memset (page, 0, PGSIZE);
+}
+
+static void
+fill_text (uint8_t *page) 
+{
+  static const char *words[] =
+    {"the ", "page ", "is ", "swapped ", "out ", "and ", "in ", "again ",
+     "under ", "memory ", "pressure ", "\n"};
+  size_t ofs = 0;
+
+  while (ofs < PGSIZE) 
+    {
+      const char *w = words[random_ulong () % 12];
+      size_t n = strlen (w);
+      if (n > PGSIZE - ofs)
+        n = PGSIZE - ofs;
+      memcpy (page + ofs, w, n);
+      ofs += n;
+    }
+}
+
+static void
+fill_ints (uint8_t *page) 
+{
+  uint32_t *p = (uint32_t *) page;
+  size_t i;
+
+  for (i = 0; i < PGSIZE / sizeof *p; i++)
+    p[i] = random_ulong () % 100;
+}
+
+static void
+fill_random (uint8_t *page) 
+{
+  random_bytes (page, PGSIZE);
+}
+
+void
+test_bench_lzf (void) 
+{
+  static const struct
+    {
+      const char *name;
+      fill_func *fill;
+    }
+  kinds[] = 
+    {
+      {"zero", fill_zero},
+      {"text", fill_text},
+      {"ints", fill_ints},
+      {"random", fill_random},
+    };
+  uint8_t *in = palloc_get_page (PAL_ASSERT);
+  uint8_t *out = palloc_get_page (PAL_ASSERT);
+  uint8_t *back = palloc_get_page (PAL_ASSERT);
+  void *work = palloc_get_page (PAL_ASSERT);
+  size_t k;
+  int bad = 0;
+
+  for (k = 0; k < sizeof kinds / sizeof *kinds; k++) 
+    {
+      uint64_t start, compress_cycles, expand_cycles;
+      size_t size = 0;
+      int round;
+
+      kinds[k].fill (in);
+      start = rdtsc ();
+      for (round = 0; round < ROUNDS; round++)
+        size = lzf_compress (in, PGSIZE, out, PGSIZE, work);
+      compress_cycles = (rdtsc () - start) / ROUNDS;
+
+      start = rdtsc ();
+      for (round = 0; round < ROUNDS && size > 0; round++)
+        if (!lzf_decompress (out, size, back, PGSIZE))
+          break;
+      expand_cycles = (rdtsc () - start) / ROUNDS;
+
+      if (size > 0 && (round < ROUNDS || memcmp (in, back, PGSIZE)))
+        bad++;
+      if (k == 0 && (size == 0 || size > PGSIZE / 32))
+        fail ("zero page compressed to %zu bytes", size);
+      msg ("%s: %d bytes to %zu, %llu cycles to compress, %llu to expand",
+           kinds[k].name, PGSIZE, size, compress_cycles, expand_cycles);
+    }
+  msg ("%d pages did not round-trip", bad);
+
+  palloc_free_page (in);
+  palloc_free_page (out);
+  palloc_free_page (back);
+  palloc_free_page (work);
+}
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench (RESULTS => ['0 pages did not round-trip'],
+	     TIMINGS => [qr/zero: 4096 bytes to \d+, .* to expand/]);
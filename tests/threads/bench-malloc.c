@@ -0,0 +1,138 @@
+/* Times the kernel allocators: malloc() and free() for each
+   block size, palloc_get_page() and palloc_get_multiple() for
+   single pages and runs of pages, and reports how well malloc()
+   packs blocks into pages after a long run of random allocations
+   and frees.  Finally, checks that freeing everything gives
+   every page back.  On a CPU with performance counters, also
+   reports cache and branch misses for malloc() and free(). */
+
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "devices/pmc.h"
+#include "threads/cpu.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+#define BATCH 64                /* Blocks live at once when timing. */
+#define ROUNDS 32               /* Batches per size. */
+#define CHURN_LIVE 512          /* Blocks live at once in churn. */
+#define CHURN_OPS 20000         /* Random frees and reallocations. */
+#define CHURN_SIZE_MAX 1024     /* Largest block in churn. */
+
+static void *blocks[CHURN_LIVE];
+static size_t sizes[CHURN_LIVE];
+
+static void bench_malloc (size_t size);
+static void bench_palloc (size_t page_cnt);
+
+void
+test_bench_malloc (void) 
+{
+  size_t base_pages, used_pages, live_bytes, size;
+  int i;
+
+  for (size = 16; size <= 2 * PGSIZE; size *= 2)
+    bench_malloc (size);
+  bench_palloc (1);
+  bench_palloc (4);
+  bench_palloc (16);
+
+  /* Churn: keep CHURN_LIVE blocks of random size live, freeing
+     and replacing a random one at each step. */
+  random_init (421);
+  malloc_flush ();
+  base_pages = palloc_kernel_used ();
+  for (i = 0; i < CHURN_LIVE; i++)
+    {
+      sizes[i] = random_ulong () % CHURN_SIZE_MAX + 1;
+      blocks[i] = malloc (sizes[i]);
+      if (blocks[i] == NULL)
+        fail ("out of memory during churn");
+    }
+  for (i = 0; i < CHURN_OPS; i++)
+    {
+      int victim = random_ulong () % CHURN_LIVE;
+
+      free (blocks[victim]);
+      sizes[victim] = random_ulong () % CHURN_SIZE_MAX + 1;
+      blocks[victim] = malloc (sizes[victim]);
+      if (blocks[victim] == NULL)
+        fail ("out of memory during churn");
+    }
+
+  live_bytes = 0;
+  for (i = 0; i < CHURN_LIVE; i++)
+    live_bytes += sizes[i];
+  used_pages = palloc_kernel_used () - base_pages;
+  msg ("After churn: %zu bytes live in %zu pages, %zu%% used.",
+       live_bytes, used_pages,
+       live_bytes * 100 / (used_pages * PGSIZE));
+
+  for (i = 0; i < CHURN_LIVE; i++)
+    free (blocks[i]);
+  malloc_flush ();
+  if (palloc_kernel_used () != base_pages)
+    fail ("%zu pages still in use after freeing every block",
+          palloc_kernel_used () - base_pages);
+  msg ("Every page given back after churn.");
+}
+
+/* Times allocating and freeing batches of SIZE-byte blocks. */
+static void
+bench_malloc (size_t size) 
+{
+  void *batch[BATCH];
+  struct pmc_counts pmc;
+  uint64_t start, cycles;
+  int round, i;
+
+  /* Warm up this thread's magazine and the arenas. */
+  for (i = 0; i < BATCH; i++)
+    batch[i] = malloc (size);
+  for (i = 0; i < BATCH; i++)
+    free (batch[i]);
+
+  pmc_begin (&pmc);
+  start = rdtsc ();
+  for (round = 0; round < ROUNDS; round++)
+    {
+      for (i = 0; i < BATCH; i++)
+        if ((batch[i] = malloc (size)) == NULL)
+          fail ("malloc (%zu) failed", size);
+      for (i = 0; i < BATCH; i++)
+        free (batch[i]);
+    }
+  cycles = rdtsc () - start;
+  pmc_end (&pmc);
+  msg ("malloc %zu bytes: %llu cycles per malloc and free.",
+       size, cycles / (ROUNDS * BATCH));
+  if (pmc_available (PMC_LLC_MISSES) && pmc_available (PMC_BRANCH_MISSES))
+    msg ("malloc %zu bytes: %llu LLC misses, %llu branch misses.",
+         size, pmc.count[PMC_LLC_MISSES], pmc.count[PMC_BRANCH_MISSES]);
+}
+
+/* Times allocating and freeing batches of PAGE_CNT pages. */
+static void
+bench_palloc (size_t page_cnt) 
+{
+  void *batch[BATCH];
+  uint64_t start, cycles;
+  int round, i, cnt;
+
+  start = rdtsc ();
+  for (round = 0; round < ROUNDS; round++)
+    {
+      for (cnt = 0; cnt < BATCH; cnt++)
+        if ((batch[cnt] = palloc_get_multiple (0, page_cnt)) == NULL)
+          break;
+      if (cnt == 0)
+        fail ("palloc_get_multiple (%zu) failed", page_cnt);
+      for (i = 0; i < cnt; i++)
+        palloc_free_multiple (batch[i], page_cnt);
+    }
+  cycles = rdtsc () - start;
+  msg ("palloc %zu pages: %llu cycles per allocation and free.",
+       page_cnt, cycles / (ROUNDS * cnt));
+}
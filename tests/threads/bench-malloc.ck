@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench (RESULTS => ['Every page given back after churn.'],
+	     TIMINGS => [qr/malloc 16 bytes: \d+ cycles per malloc and free\./,
+			 qr/After churn: \d+ bytes live in \d+ pages, \d+% used\./]);
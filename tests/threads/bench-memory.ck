@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench (RESULTS => ['Every page reads back as zeros.'],
+	     TIMINGS => [qr/Sector copy: \d+ cycles per sector\./]);
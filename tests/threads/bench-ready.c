@@ -0,0 +1,88 @@
+/* Times thread_yield() with 10, 100, and 500 threads on the ready
+   queue.  Every thread yields in a loop, so each yield costs one
+   pick from a queue of that length plus one switch; a scheduler
+   whose pick is linear in the number of ready threads shows it
+   here.
+
+   A thread is a whole page of memory, so the larger runs stop
+   early if the kernel pool fills up.  Round-robin scheduling
+   must give every spinner a turn in each run. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define YIELD_CNT 20000
+
+static struct latch done;
+static volatile bool stop;
+static int yields;
+static int started;             /* Spinners that have run. */
+
+static thread_func spinner;
+static void run (int thread_cnt);
+
+void
+test_bench_ready (void) 
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  run (10);
+  run (100);
+  run (500);
+}
+
+/* Puts THREAD_CNT threads on the ready queue and reports the
+   average cost of a yield among them. */
+static void
+run (int thread_cnt) 
+{
+  uint64_t start, cycles;
+  int requested = thread_cnt;
+  int created;
+
+  stop = false;
+  yields = started = 0;
+  latch_init (&done, thread_cnt);
+  for (created = 0; created < thread_cnt; created++)
+    if (thread_create ("spinner", PRI_DEFAULT, spinner, NULL)
+        == TID_ERROR)
+      break;
+  if (created == 0)
+    fail ("could not create any threads");
+  while (thread_cnt-- > created)
+    latch_countdown (&done);
+
+  /* Let every spinner run once before timing. */
+  thread_yield ();
+
+  start = rdtsc ();
+  yields = 0;
+  while (yields < YIELD_CNT)
+    thread_yield ();
+  cycles = rdtsc () - start;
+
+  stop = true;
+  latch_wait (&done);
+  if (started != created)
+    fail ("%d of %d spinners ran", started, created);
+  msg ("Every spinner ran in the %d-thread run.", requested);
+  msg ("%d ready threads: %llu cycles per yield.",
+       created, cycles / yields);
+}
+
+static void
+spinner (void *aux UNUSED) 
+{
+  started++;
+  while (!stop) 
+    {
+      yields++;
+      thread_yield ();
+    }
+  latch_countdown (&done);
+}
@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench (RESULTS => ['Every spinner ran in the 10-thread run.',
+			 'Every spinner ran in the 100-thread run.',
+			 'Every spinner ran in the 500-thread run.'],
+	     TIMINGS => [qr/\d+ ready threads: \d+ cycles per yield\./]);
@@ -0,0 +1,109 @@
+/* Measures how late timer_sleep() wakes its callers, with 1, 100,
+   and 1000 threads asleep at once.  Each sleeper picks a wakeup
+   tick spread over a few ticks, sleeps until it, and records how
+   far past the start of that tick it resumed, in whole ticks and
+   in nanoseconds of the high-resolution clock.  Tick starts are
+   extrapolated from one observed tick boundary, so the
+   nanosecond figures are only as exact as timer_calibrate().
+
+   A thread is a whole page of memory, so the larger runs stop
+   early if the kernel pool fills up.  No sleeper may wake before
+   its tick. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SLEEPER_MAX 1000
+#define SPREAD 8                        /* Ticks the wakeups span. */
+
+static struct latch done;
+static int64_t base_tick;            /* Tick that began at BASE_NS. */
+static uint64_t base_ns;
+static uint64_t late_ns_total, late_ns_max;
+static int late_ticks_total, early_cnt;
+
+static thread_func sleeper;
+static void run (int sleeper_cnt);
+
+void
+test_bench_sleep (void) 
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  run (1);
+  run (100);
+  run (SLEEPER_MAX);
+}
+
+/* Puts SLEEPER_CNT threads to sleep and reports how late they
+   woke up. */
+static void
+run (int sleeper_cnt) 
+{
+  int requested = sleeper_cnt;
+  int created;
+
+  late_ns_total = late_ns_max = 0;
+  late_ticks_total = early_cnt = 0;
+
+  /* Wait for a tick boundary to time the wakeups against. */
+  base_tick = timer_ticks ();
+  while (timer_ticks () == base_tick)
+    continue;
+  base_ns = timer_ns ();
+  base_tick++;
+
+  /* Create the sleepers at a higher priority than ours, so that
+     each goes to sleep before the next is created. */
+  latch_init (&done, sleeper_cnt);
+  for (created = 0; created < sleeper_cnt; created++)
+    if (thread_create ("sleeper", PRI_DEFAULT + 1, sleeper,
+                       (void *) created) == TID_ERROR)
+      break;
+  if (created == 0)
+    fail ("could not create any sleepers");
+
+  /* Count off the sleepers we could not create. */
+  while (sleeper_cnt-- > created)
+    latch_countdown (&done);
+  latch_wait (&done);
+
+  if (early_cnt > 0)
+    fail ("%d of %d sleepers woke early", early_cnt, created);
+  msg ("No sleeper woke early in the %d-sleeper run.", requested);
+  msg ("%d sleepers: %llu ns average, %llu ns worst, "
+       "%d.%02d ticks average late.",
+       created, late_ns_total / created, late_ns_max,
+       late_ticks_total / created, late_ticks_total * 100 / created % 100);
+}
+
+/* Sleeps until tick AUX % SPREAD after the next, well after
+   all the sleepers have been created, and records how late it
+   woke. */
+static void
+sleeper (void *aux) 
+{
+  int64_t wakeup = base_tick + SPREAD + (int) aux % SPREAD;
+  uint64_t wakeup_ns, now_ns, late_ns;
+  int64_t now;
+
+  timer_sleep (wakeup - timer_ticks ());
+  now_ns = timer_ns ();
+  now = timer_ticks ();
+
+  wakeup_ns = base_ns + (wakeup - base_tick) * (1000000000 / TIMER_FREQ);
+  late_ns = now_ns > wakeup_ns ? now_ns - wakeup_ns : 0;
+
+  if (now < wakeup)
+    early_cnt++;
+  late_ticks_total += now - wakeup;
+  late_ns_total += late_ns;
+  if (late_ns > late_ns_max)
+    late_ns_max = late_ns;
+  latch_countdown (&done);
+}
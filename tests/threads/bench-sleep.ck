@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench (RESULTS => ['No sleeper woke early in the 1-sleeper run.',
+			 'No sleeper woke early in the 100-sleeper run.',
+			 'No sleeper woke early in the 1000-sleeper run.'],
+	     TIMINGS => [qr/\d+ sleepers: .* ticks average late\./]);
@@ -0,0 +1,231 @@
+/* Checks the memcpy(), memset() and memmove() variants in
+   lib/string.c against plain byte loops, then times them over a
+   range of block sizes, to show where the "rep" instructions
+   start to beat the word loop.
+
+   The checks cover every alignment of the head and tail of a
+   block, sizes on both sides of the 64-byte point where memcpy()
+   and memset() switch to "rep", and memmove() between blocks
+   that overlap either way.  A wrong byte fails the test, as does
+   a write outside the block. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+#define ROUNDS 64
+
+static void *
+copy_bytes (void *dst_, const void *src_, size_t size) 
+{
+  unsigned char *dst = dst_;
+  const volatile unsigned char *src = src_;
+
+  while (size-- > 0)
+    *dst++ = *src++;
+  return dst_;
+}
+
+static void *
+set_bytes (void *dst_, int value, size_t size) 
+{
+  volatile unsigned char *dst = dst_;
+
+  while (size-- > 0)
+    *dst++ = value;
+  return dst_;
+}
+
+typedef void *copy_func (void *, const void *, size_t);
+typedef void *set_func (void *, int, size_t);
+
+/* Block sizes checked: small ones that end at every alignment,
+   and ones around the 64-byte "rep" threshold and beyond. */
+static const size_t check_sizes[] =
+  { 0, 1, 2, 3, 4, 5, 7, 8, 15, 31, 63, 64, 65, 66, 67, 127, 128, 131, 200 };
+#define CHECK_SIZE_CNT (sizeof check_sizes / sizeof *check_sizes)
+
+/* Check buffers: room for the largest block, plus margins on
+   both sides that must come through untouched. */
+#define CHECK_BUF 256
+static uint8_t check_src[CHECK_BUF];
+static uint8_t check_buf[CHECK_BUF];
+static uint8_t check_ref[CHECK_BUF];
+
+/* Number of cases checked. */
+static unsigned check_cnt;
+
+/* Fills BUF with a pattern that differs for each SEED. */
+static void
+fill_pattern (uint8_t *buf, int seed) 
+{
+  size_t i;
+
+  for (i = 0; i < CHECK_BUF; i++)
+    buf[i] = i * 7 + seed * 31 + 1;
+}
+
+/* Fails unless check_buf matches check_ref, reporting NAME, SIZE
+   and the offsets DST_OFS and SRC_OFS. */
+static void
+compare_check (const char *name, size_t size, int dst_ofs, int src_ofs) 
+{
+  size_t i;
+
+  for (i = 0; i < CHECK_BUF; i++)
+    if (check_buf[i] != check_ref[i])
+      fail ("%s of %zu bytes, destination offset %d, source offset %d: "
+            "byte %zu is %d, not %d", name, size, dst_ofs, src_ofs,
+            i, check_buf[i], check_ref[i]);
+  check_cnt++;
+}
+
+/* Checks COPY, named NAME, for every size in check_sizes from
+   and to every alignment. */
+static void
+check_copy (const char *name, copy_func *copy) 
+{
+  size_t i, j;
+  int dst_ofs, src_ofs;
+
+  for (i = 0; i < CHECK_SIZE_CNT; i++)
+    for (dst_ofs = 16; dst_ofs < 20; dst_ofs++)
+      for (src_ofs = 16; src_ofs < 20; src_ofs++)
+        {
+          size_t size = check_sizes[i];
+
+          fill_pattern (check_src, 1);
+          fill_pattern (check_buf, 2);
+          fill_pattern (check_ref, 2);
+          for (j = 0; j < size; j++)
+            check_ref[dst_ofs + j] = check_src[src_ofs + j];
+          if (copy (check_buf + dst_ofs, check_src + src_ofs, size)
+              != check_buf + dst_ofs)
+            fail ("%s of %zu bytes returned the wrong pointer", name, size);
+          compare_check (name, size, dst_ofs, src_ofs);
+        }
+}
+
+/* Checks SET, named NAME, for every size in check_sizes at every
+   alignment, with a value that only its low byte should count
+   in. */
+static void
+check_set (const char *name, set_func *set) 
+{
+  size_t i, j;
+  int dst_ofs;
+
+  for (i = 0; i < CHECK_SIZE_CNT; i++)
+    for (dst_ofs = 16; dst_ofs < 20; dst_ofs++)
+      {
+        size_t size = check_sizes[i];
+
+        fill_pattern (check_buf, 3);
+        fill_pattern (check_ref, 3);
+        for (j = 0; j < size; j++)
+          check_ref[dst_ofs + j] = 0xa5;
+        if (set (check_buf + dst_ofs, 0x3a5, size) != check_buf + dst_ofs)
+          fail ("%s of %zu bytes returned the wrong pointer", name, size);
+        compare_check (name, size, dst_ofs, 0);
+      }
+}
+
+/* Checks memmove() for every size in check_sizes between blocks
+   that overlap, with the destination before or after the source
+   by a few bytes, at every alignment. */
+static void
+check_move (void) 
+{
+  static const int shifts[] = { -9, -4, -3, -1, 1, 2, 4, 7 };
+  static uint8_t tmp[CHECK_BUF];
+  size_t i, j, k;
+  int src_ofs;
+
+  for (i = 0; i < CHECK_SIZE_CNT; i++)
+    for (k = 0; k < sizeof shifts / sizeof *shifts; k++)
+      for (src_ofs = 16; src_ofs < 20; src_ofs++)
+        {
+          size_t size = check_sizes[i];
+          int dst_ofs = src_ofs + shifts[k];
+
+          fill_pattern (check_buf, 4);
+          fill_pattern (check_ref, 4);
+          for (j = 0; j < size; j++)
+            tmp[j] = check_ref[src_ofs + j];
+          for (j = 0; j < size; j++)
+            check_ref[dst_ofs + j] = tmp[j];
+          if (memmove (check_buf + dst_ofs, check_buf + src_ofs, size)
+              != check_buf + dst_ofs)
+            fail ("memmove of %zu bytes returned the wrong pointer", size);
+          compare_check ("memmove", size, dst_ofs, src_ofs);
+        }
+}
+
+/* Returns the average cycles for COPY to move SIZE bytes from
+   SRC to DST. */
+static unsigned
+time_copy (copy_func *copy, void *dst, const void *src, size_t size) 
+{
+  uint64_t start = rdtsc ();
+  int i;
+
+  for (i = 0; i < ROUNDS; i++)
+    copy (dst, src, size);
+  return (rdtsc () - start) / ROUNDS;
+}
+
+/* Returns the average cycles for SET to fill SIZE bytes at DST. */
+static unsigned
+time_set (set_func *set, void *dst, size_t size) 
+{
+  uint64_t start = rdtsc ();
+  int i;
+
+  for (i = 0; i < ROUNDS; i++)
+    set (dst, i, size);
+  return (rdtsc () - start) / ROUNDS;
+}
+
+void
+test_bench_string (void) 
+{
+  static const size_t sizes[] = { 16, 64, 512, 4096 };
+  uint8_t *src, *dst;
+  size_t i;
+
+  check_copy ("memcpy_words", memcpy_words);
+  check_copy ("memcpy_rep", memcpy_rep);
+  check_copy ("memcpy", memcpy);
+  check_copy ("memmove", memmove);
+  check_set ("memset_words", memset_words);
+  check_set ("memset_rep", memset_rep);
+  check_set ("memset", memset);
+  check_move ();
+  msg ("%u cases agree with byte loops", check_cnt);
+
+  src = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  dst = palloc_get_page (PAL_ASSERT);
+
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      size_t size = sizes[i];
+
+      msg ("memcpy %zu bytes: bytes %u, words %u, rep %u, memcpy %u cycles",
+           size, time_copy (copy_bytes, dst, src, size),
+           time_copy (memcpy_words, dst, src, size),
+           time_copy (memcpy_rep, dst, src, size),
+           time_copy (memcpy, dst, src, size));
+      msg ("memset %zu bytes: bytes %u, words %u, rep %u, memset %u cycles",
+           size, time_set (set_bytes, dst, size),
+           time_set (memset_words, dst, size),
+           time_set (memset_rep, dst, size),
+           time_set (memset, dst, size));
+    }
+
+  palloc_free_page (src);
+  palloc_free_page (dst);
+}
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench (RESULTS => ['2052 cases agree with byte loops'],
+	     TIMINGS => [qr/memset 4096 bytes: .* cycles/]);
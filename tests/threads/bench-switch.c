@@ -0,0 +1,64 @@
+/* Times a context-switch round trip: two threads of equal
+   priority hand a pair of semaphores back and forth, so that
+   each round trip is two sema_up() calls, two sema_down() calls,
+   and two switches.  The partner counts the pings it answers,
+   and must have answered every one. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define ROUND_CNT 10000
+
+static struct semaphore ping, pong;
+static int answered;
+
+static thread_func partner;
+
+void
+test_bench_switch (void) 
+{
+  uint64_t start, cycles;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&ping, 0);
+  sema_init (&pong, 0);
+  thread_create ("partner", PRI_DEFAULT, partner, NULL);
+
+  /* Let the partner reach its first sema_down(). */
+  sema_up (&ping);
+  sema_down (&pong);
+
+  start = rdtsc ();
+  for (i = 0; i < ROUND_CNT; i++) 
+    {
+      sema_up (&ping);
+      sema_down (&pong);
+    }
+  cycles = rdtsc () - start;
+
+  if (answered != ROUND_CNT + 1)
+    fail ("partner answered %d of %d pings", answered, ROUND_CNT + 1);
+  msg ("Partner answered all %d pings.", answered);
+  msg ("%d round trips: %llu cycles per round trip.",
+       ROUND_CNT, cycles / ROUND_CNT);
+}
+
+static void
+partner (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < ROUND_CNT + 1; i++) 
+    {
+      sema_down (&ping);
+      answered++;
+      sema_up (&pong);
+    }
+}
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench (RESULTS => ['Partner answered all 10001 pings.'],
+	     TIMINGS => [qr/\d+ round trips: \d+ cycles per round trip\./]);
@@ -0,0 +1,98 @@
+/* Times waking each of 100 and 400 blocked threads and letting
+   it run.  Every round, the main thread ups a semaphore once per
+   thread; each up unblocks a waiter, which outranks the main
+   thread and so runs at once, reports back, and blocks again.  With this
+   many threads, struct thread no longer stays in the cache
+   between rounds, so the cost shows how many cache lines the
+   scheduler touches per thread.
+
+   A thread is a whole page of memory, so the larger run stops
+   early if the kernel pool fills up.  Each up must wake exactly
+   one waiter, so the waiters together report back once per up. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define ROUND_CNT 50
+
+static struct semaphore go;
+static struct semaphore ran;
+static volatile bool stop;
+static int answered;            /* Wakeups reported back. */
+
+static thread_func waiter;
+static void run (int thread_cnt);
+
+void
+test_bench_wakeall (void) 
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  run (100);
+  run (400);
+}
+
+/* Blocks THREAD_CNT threads on a semaphore and reports the
+   average cost of waking one and switching to it. */
+static void
+run (int thread_cnt) 
+{
+  uint64_t start, cycles;
+  int requested = thread_cnt;
+  int created, round, i;
+
+  stop = false;
+  answered = 0;
+  sema_init (&go, 0);
+  sema_init (&ran, 0);
+  for (created = 0; created < thread_cnt; created++)
+    if (thread_create ("waiter", PRI_DEFAULT + 1, waiter, NULL)
+        == TID_ERROR)
+      break;
+  if (created == 0)
+    fail ("could not create any threads");
+
+  /* The waiters outrank us, so each one has run up to its first
+     sema_down() by now. */
+  start = rdtsc ();
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      for (i = 0; i < created; i++)
+        sema_up (&go);
+      for (i = 0; i < created; i++)
+        sema_down (&ran);
+    }
+  cycles = rdtsc () - start;
+  if (answered != created * ROUND_CNT)
+    fail ("%d of %d wakeups answered", answered, created * ROUND_CNT);
+
+  stop = true;
+  for (i = 0; i < created; i++)
+    sema_up (&go);
+  for (i = 0; i < created; i++)
+    sema_down (&ran);
+  msg ("Every wakeup answered in the %d-thread run.", requested);
+  msg ("%d threads: %llu cycles per wakeup.",
+       created, cycles / ((uint64_t) created * ROUND_CNT));
+}
+
+/* Waits to be woken, reports having run, and repeats until
+   told to stop. */
+static void
+waiter (void *aux UNUSED) 
+{
+  for (;;)
+    {
+      sema_down (&go);
+      if (stop)
+        break;
+      answered++;
+      sema_up (&ran);
+    }
+  sema_up (&ran);
+}
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench (RESULTS => ['Every wakeup answered in the 100-thread run.',
+			 'Every wakeup answered in the 400-thread run.'],
+	     TIMINGS => [qr/\d+ threads: \d+ cycles per wakeup\./]);
@@ -0,0 +1,121 @@
+/* Measures how late sleeping threads wake up.  Many threads each
+   sleep a series of random numbers of ticks, and compare when
+   they resumed with when they asked to, both in ticks and on the
+   high-resolution clock, measured from the start of the tick
+   they should have woken in.  Tick starts are extrapolated from
+   one tick boundary observed at the start, so the nanosecond
+   figures are only as exact as timer_calibrate().  The results
+   are printed as a histogram of lateness.
+
+   Build the kernel with -DINTROFF to see, at shutdown, the
+   longest stretches with interrupts off, which delay wakeups.
+   No sleep may end early, and the histogram must account for
+   every one. */
+
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SLEEPER_CNT 50
+#define SLEEP_CNT 10            /* Sleeps per thread. */
+#define BUCKET_CNT 16           /* Bucket B: late by < 2**B us. */
+
+static struct latch done;
+static int64_t base_tick;               /* Tick that began at BASE_NS. */
+static uint64_t base_ns;
+static unsigned long long late_us[BUCKET_CNT];
+static uint64_t late_us_max;
+static int late_ticks_total, late_ticks_max, early_cnt;
+
+static thread_func sleeper;
+static void record_late (uint64_t us);
+
+void
+test_bench_wakeup (void) 
+{
+  unsigned long long recorded = 0;
+  int i, last;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Wait for a tick boundary to time the wakeups against. */
+  base_tick = timer_ticks ();
+  while (timer_ticks () == base_tick)
+    continue;
+  base_ns = timer_ns ();
+  base_tick++;
+
+  latch_init (&done, SLEEPER_CNT);
+  for (i = 0; i < SLEEPER_CNT; i++)
+    thread_create ("sleeper", PRI_DEFAULT, sleeper, (void *) i);
+  latch_wait (&done);
+
+  if (early_cnt > 0)
+    fail ("%d sleeps ended early", early_cnt);
+  for (i = 0; i < BUCKET_CNT; i++)
+    recorded += late_us[i];
+  if (recorded != SLEEPER_CNT * SLEEP_CNT)
+    fail ("histogram holds %llu of %d sleeps",
+          recorded, SLEEPER_CNT * SLEEP_CNT);
+  msg ("%d sleeps, none early.", SLEEPER_CNT * SLEEP_CNT);
+  msg ("%d sleeps: %d.%02d ticks average late, %d worst.",
+       SLEEPER_CNT * SLEEP_CNT, late_ticks_total / (SLEEPER_CNT * SLEEP_CNT),
+       late_ticks_total * 100 / (SLEEPER_CNT * SLEEP_CNT) % 100,
+       late_ticks_max);
+  for (last = BUCKET_CNT - 1; last > 0 && late_us[last] == 0; last--)
+    continue;
+  for (i = 0; i <= last; i++)
+    msg ("Late by < %d us: %llu", 1 << i, late_us[i]);
+  msg ("Worst: %llu us late.", late_us_max);
+}
+
+/* Sleeps SLEEP_CNT times and records how late each wakeup was. */
+static void
+sleeper (void *aux) 
+{
+  struct prng prng;
+  int i;
+
+  prng_seed (&prng, 421, (int) aux);
+  for (i = 0; i < SLEEP_CNT; i++)
+    {
+      int64_t wakeup = timer_ticks () + prng_u32 (&prng) % 5 + 1;
+      uint64_t wakeup_ns, now_ns;
+      int64_t now;
+
+      timer_sleep (wakeup - timer_ticks ());
+      now_ns = timer_ns ();
+      now = timer_ticks ();
+
+      if (now < wakeup)
+        early_cnt++;
+      else
+        {
+          late_ticks_total += now - wakeup;
+          if (now - wakeup > late_ticks_max)
+            late_ticks_max = now - wakeup;
+        }
+      wakeup_ns = base_ns + (wakeup - base_tick) * (1000000000 / TIMER_FREQ);
+      record_late (now_ns > wakeup_ns ? (now_ns - wakeup_ns) / 1000 : 0);
+    }
+  latch_countdown (&done);
+}
+
+/* Adds a wakeup that was US microseconds late to the
+   histogram. */
+static void
+record_late (uint64_t us) 
+{
+  int bucket = 0;
+
+  while (bucket < BUCKET_CNT - 1 && us >= (1u << bucket))
+    bucket++;
+  late_us[bucket]++;
+  if (us > late_us_max)
+    late_us_max = us;
+}
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::threads::bench;
+check_bench (RESULTS => ['500 sleeps, none early.'],
+	     TIMINGS => [qr/Worst: \d+ us late\./]);
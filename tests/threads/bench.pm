@@ -0,0 +1,40 @@
+# -*- perl -*-
+
+# Checks that a tests/threads bench-* test ran to completion with
+# the right results.
+#
+# Each benchmark checks what it computes and reports it in lines
+# that read the same on every run.  Pass them, without the
+# "(bench-...) " prefix, as RESULTS; each must appear.  The lines
+# that report timings differ from run to run, so TIMINGS gives
+# just a pattern that each kind must match.
+
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+
+sub check_bench {
+    my (%args) = @_;
+    my (@output) = read_text_file ("$test.output");
+
+    common_checks ("run", @output);
+
+    my ($name) = $test =~ m|([^/]+)$|;
+    my (@core) = get_core_output ("run", @output);
+    for my $result (@{$args{RESULTS} || []}) {
+	fail "missing \"$result\" in output"
+	  unless grep ($_ eq "($name) $result", @core);
+    }
+    for my $timing (@{$args{TIMINGS} || []}) {
+	fail "missing timings in output"
+	  unless grep (/^\(\Q$name\E\) $timing$/, @core);
+    }
+    fail "missing end in output"
+      unless grep ($_ eq "($name) end", @core);
+
+    pass;
+}
+
+1;
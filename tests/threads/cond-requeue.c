@@ -0,0 +1,55 @@
+/* Wakes a group of threads waiting on a condition variable with
+   cond_broadcast_requeue() and checks that they all get the lock
+   in priority order, each only once it has been released. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define WAITER_CNT 5
+
+static struct lock lock;
+static struct condition condition;
+
+static thread_func waiter;
+
+void
+test_cond_requeue (void) 
+{
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  lock_init (&lock);
+  cond_init (&condition);
+
+  thread_set_priority (PRI_MIN);
+  for (i = 0; i < WAITER_CNT; i++) 
+    {
+      int priority = PRI_DEFAULT - (i + 7) % 10 - 1;
+      char name[16];
+
+      snprintf (name, sizeof name, "priority %d", priority);
+      thread_create (name, priority, waiter, NULL);
+    }
+
+  lock_acquire (&lock);
+  cond_broadcast_requeue (&condition, &lock);
+  msg ("Broadcast; main priority is now %d.", thread_get_priority ());
+  lock_release (&lock);
+  msg ("Main done.");
+}
+
+static void
+waiter (void *aux UNUSED) 
+{
+  lock_acquire (&lock);
+  msg ("Thread %s starting.", thread_name ());
+  cond_wait (&condition, &lock);
+  msg ("Thread %s woke up holding the lock: %d.",
+       thread_name (), lock_held_by_current_thread (&lock));
+  lock_release (&lock);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(cond-requeue) begin
+(cond-requeue) Thread priority 23 starting.
+(cond-requeue) Thread priority 22 starting.
+(cond-requeue) Thread priority 21 starting.
+(cond-requeue) Thread priority 30 starting.
+(cond-requeue) Thread priority 29 starting.
+(cond-requeue) Broadcast; main priority is now 30.
+(cond-requeue) Thread priority 30 woke up holding the lock: 1.
+(cond-requeue) Thread priority 29 woke up holding the lock: 1.
+(cond-requeue) Thread priority 23 woke up holding the lock: 1.
+(cond-requeue) Thread priority 22 woke up holding the lock: 1.
+(cond-requeue) Thread priority 21 woke up holding the lock: 1.
+(cond-requeue) Main done.
+(cond-requeue) end
+EOF
+pass;
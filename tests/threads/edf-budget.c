@@ -0,0 +1,111 @@
+/* Checks admission control and budget enforcement in the
+   earliest-deadline-first scheduling class.  The main thread
+   reserves 2 ticks in every 10 and spins for RUN_TICKS ticks
+   alongside an ordinary thread, which should get the rest of
+   the CPU. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define RUN_TICKS 100
+
+static struct semaphore done;
+static bool child_big, child_small;
+static volatile bool stop;
+static int spinner_ticks;
+
+static thread_func admit_child;
+static thread_func spinner;
+static int spin_ticks (int64_t end);
+
+void
+test_edf_budget (void) 
+{
+  int main_ticks;
+
+  sema_init (&done, 0);
+
+  msg ("Full CPU: %s.",
+       thread_set_realtime (10, 10) ? "admitted" : "rejected");
+  msg ("60%% of CPU: %s.",
+       thread_set_realtime (6, 10) ? "admitted" : "rejected");
+
+  /* The child can only run while we are blocked: it is not in
+     the EDF class, so it never preempts us. */
+  thread_create ("child", PRI_DEFAULT, admit_child, NULL);
+  sema_down (&done);
+  msg ("Another 40%%: %s.", child_big ? "admitted" : "rejected");
+  msg ("Another 30%%: %s.", child_small ? "admitted" : "rejected");
+
+  msg ("20%% of CPU: %s.",
+       thread_set_realtime (2, 10) ? "admitted" : "rejected");
+  thread_create ("spinner", PRI_DEFAULT, spinner, NULL);
+  timer_sleep (1);
+  main_ticks = spin_ticks (timer_ticks () + RUN_TICKS);
+  thread_set_realtime (0, 10);
+  stop = true;
+  sema_down (&done);
+
+  if (main_ticks < RUN_TICKS * 15 / 100 || main_ticks > RUN_TICKS * 30 / 100)
+    fail ("EDF thread ran during %d of %d ticks, expected about %d.",
+          main_ticks, RUN_TICKS, RUN_TICKS * 2 / 10);
+  msg ("EDF thread stayed within its budget.");
+  if (spinner_ticks < RUN_TICKS / 2)
+    fail ("Other thread ran during only %d of %d ticks.",
+          spinner_ticks, RUN_TICKS);
+  msg ("Other thread got the rest of the CPU.");
+}
+
+/* Tries to reserve 40% and then 30% of the CPU, with 60% already
+   taken by the main thread, and exits, giving the 30% back. */
+static void
+admit_child (void *aux UNUSED) 
+{
+  child_big = thread_set_realtime (4, 10);
+  child_small = thread_set_realtime (3, 10);
+  sema_up (&done);
+}
+
+/* Spins until the main thread is finished, counting the ticks
+   during which it got to run. */
+static void
+spinner (void *aux UNUSED) 
+{
+  int64_t last = -1;
+
+  while (!stop)
+    {
+      int64_t now = timer_ticks ();
+      if (now != last)
+        {
+          spinner_ticks++;
+          last = now;
+        }
+    }
+  sema_up (&done);
+}
+
+/* Spins until timer tick END and returns the number of distinct
+   ticks during which the caller ran. */
+static int
+spin_ticks (int64_t end) 
+{
+  int64_t last = -1;
+  int cnt = 0;
+
+  for (;;)
+    {
+      int64_t now = timer_ticks ();
+      if (now >= end)
+        return cnt;
+      if (now != last)
+        {
+          cnt++;
+          last = now;
+        }
+    }
+}
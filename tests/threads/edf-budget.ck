@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(edf-budget) begin
+(edf-budget) Full CPU: rejected.
+(edf-budget) 60% of CPU: admitted.
+(edf-budget) Another 40%: rejected.
+(edf-budget) Another 30%: admitted.
+(edf-budget) 20% of CPU: admitted.
+(edf-budget) EDF thread stayed within its budget.
+(edf-budget) Other thread got the rest of the CPU.
+(edf-budget) end
+EOF
+pass;
@@ -0,0 +1,65 @@
+/* Checks that readers share a reader-writer lock, that a writer
+   waits for the readers already inside, and that readers
+   arriving after a waiting writer queue behind it. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static struct rwlock rw;
+static struct semaphore gate;
+
+static thread_func first_reader;
+static thread_func writer;
+static thread_func second_reader;
+
+void
+test_rwlock (void) 
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  rw_init (&rw);
+  sema_init (&gate, 0);
+
+  rw_read_acquire (&rw);
+  thread_create ("reader 1", PRI_DEFAULT + 1, first_reader, NULL);
+  thread_create ("writer", PRI_DEFAULT + 3, writer, NULL);
+  thread_create ("reader 2", PRI_DEFAULT + 2, second_reader, NULL);
+
+  msg ("main: releasing read lock.");
+  rw_read_release (&rw);
+  msg ("main: letting reader 1 go.");
+  sema_up (&gate);
+  msg ("main: done.");
+}
+
+static void
+first_reader (void *aux UNUSED) 
+{
+  rw_read_acquire (&rw);
+  msg ("reader 1: in, %u readers.", rw.readers);
+  sema_down (&gate);
+  rw_read_release (&rw);
+  msg ("reader 1: done.");
+}
+
+static void
+writer (void *aux UNUSED) 
+{
+  rw_write_acquire (&rw);
+  msg ("writer: in, %u readers.", rw.readers);
+  rw_write_release (&rw);
+  msg ("writer: done.");
+}
+
+static void
+second_reader (void *aux UNUSED) 
+{
+  rw_read_acquire (&rw);
+  msg ("reader 2: in, %u readers.", rw.readers);
+  rw_read_release (&rw);
+  msg ("reader 2: done.");
+}
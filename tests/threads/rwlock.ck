@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock) begin
+(rwlock) reader 1: in, 2 readers.
+(rwlock) main: releasing read lock.
+(rwlock) main: letting reader 1 go.
+(rwlock) writer: in, 0 readers.
+(rwlock) writer: done.
+(rwlock) reader 2: in, 1 readers.
+(rwlock) reader 2: done.
+(rwlock) reader 1: done.
+(rwlock) main: done.
+(rwlock) end
+EOF
+pass;
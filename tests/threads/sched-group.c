@@ -0,0 +1,78 @@
+/* Checks that process groups share the CPU by weight rather
+   than by thread count.  A group of weight 300 with one spinning
+   thread runs alongside a group of weight 100 with four, and
+   should get about three quarters of the CPU. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define RUN_TICKS 200
+#define SMALL_CNT 4
+
+static struct semaphore done;
+static volatile bool stop;
+
+static thread_func spinner;
+
+void
+test_sched_group (void) 
+{
+  int big_ticks = 0, small_ticks = 0;
+  int big, small, i;
+
+  sema_init (&done, 0);
+
+  /* Each spinner inherits its group from us. */
+  big = sched_group_create (300);
+  thread_create ("big", PRI_DEFAULT, spinner, &big_ticks);
+  small = sched_group_create (100);
+  for (i = 0; i < SMALL_CNT; i++)
+    thread_create ("small", PRI_DEFAULT, spinner, &small_ticks);
+  ASSERT (big > 0 && small > 0 && big != small);
+  sched_group_join (0);
+  msg ("Created groups of weight 300 and 100.");
+
+  timer_sleep (RUN_TICKS);
+  stop = true;
+  for (i = 0; i < 1 + SMALL_CNT; i++)
+    sema_down (&done);
+
+  if (big_ticks < small_ticks * 2 || big_ticks > small_ticks * 4)
+    fail ("Weight 300 group ran %d ticks, weight 100 group %d.",
+          big_ticks, small_ticks);
+  msg ("CPU was shared in proportion to weight.");
+
+  /* Let the spinners finish exiting. */
+  thread_set_priority (PRI_MIN);
+  thread_set_priority (PRI_DEFAULT);
+  if (sched_group_join (big) || sched_group_join (small))
+    fail ("Group outlived its last thread.");
+  msg ("Groups went away with their threads.");
+}
+
+/* Spins until told to stop, adding the ticks during which it
+   ran to the int that AUX points to. */
+static void
+spinner (void *aux) 
+{
+  int *ticks = aux;
+  int64_t last = -1;
+
+  while (!stop)
+    {
+      int64_t now = timer_ticks ();
+      if (now != last)
+        {
+          enum intr_level old_level = intr_disable ();
+          (*ticks)++;
+          intr_set_level (old_level);
+          last = now;
+        }
+    }
+  sema_up (&done);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sched-group) begin
+(sched-group) Created groups of weight 300 and 100.
+(sched-group) CPU was shared in proportion to weight.
+(sched-group) Groups went away with their threads.
+(sched-group) end
+EOF
+pass;
@@ -17,6 +17,7 @@ static const struct test tests[] =
     {"alarm-priority", test_alarm_priority},
     {"alarm-zero", test_alarm_zero},
     {"alarm-negative", test_alarm_negative},
+    {"alarm-slack", test_alarm_slack},
     {"priority-change", test_priority_change},
     {"priority-donate-one", test_priority_donate_one},
     {"priority-donate-multiple", test_priority_donate_multiple},
@@ -38,6 +39,28 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"workqueue", test_workqueue},
+    {"rwlock", test_rwlock},
+    {"timed-wait", test_timed_wait},
+    {"cond-requeue", test_cond_requeue},
+    {"barrier", test_barrier},
+    {"edf-budget", test_edf_budget},
+    {"sched-group", test_sched_group},
+    {"bench-memory", test_bench_memory},
+    {"bench-string", test_bench_string},
+    {"bench-copy", test_bench_copy},
+    {"bench-flatmap", test_bench_flatmap},
+    {"bench-hash", test_bench_hash},
+    {"bench-lzf", test_bench_lzf},
+    {"bench-divide", test_bench_divide},
+    {"bench-switch", test_bench_switch},
+    {"bench-create", test_bench_create},
+    {"bench-lock", test_bench_lock},
+    {"bench-sleep", test_bench_sleep},
+    {"bench-ready", test_bench_ready},
+    {"bench-malloc", test_bench_malloc},
+    {"bench-wakeup", test_bench_wakeup},
+    {"bench-wakeall", test_bench_wakeall},
   };
 
 static const char *test_name;
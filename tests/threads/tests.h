@@ -11,6 +11,7 @@ extern test_func test_alarm_simultaneous;
 extern test_func test_alarm_priority;
 extern test_func test_alarm_zero;
 extern test_func test_alarm_negative;
+extern test_func test_alarm_slack;
 extern test_func test_priority_change;
 extern test_func test_priority_donate_one;
 extern test_func test_priority_donate_multiple;
@@ -32,6 +33,28 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_workqueue;
+extern test_func test_rwlock;
+extern test_func test_timed_wait;
+extern test_func test_cond_requeue;
+extern test_func test_barrier;
+extern test_func test_edf_budget;
+extern test_func test_sched_group;
+extern test_func test_bench_memory;
+extern test_func test_bench_string;
+extern test_func test_bench_copy;
+extern test_func test_bench_flatmap;
+extern test_func test_bench_hash;
+extern test_func test_bench_lzf;
+extern test_func test_bench_divide;
+extern test_func test_bench_switch;
+extern test_func test_bench_create;
+extern test_func test_bench_lock;
+extern test_func test_bench_sleep;
+extern test_func test_bench_ready;
+extern test_func test_bench_malloc;
+extern test_func test_bench_wakeup;
+extern test_func test_bench_wakeall;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
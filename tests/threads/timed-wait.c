@@ -0,0 +1,67 @@
+/* Checks that sema_down_timeout(), lock_acquire_timeout(), and
+   cond_wait_timeout() give up after their timeouts, succeed when
+   woken in time, and leave no waiter behind when they give up. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static struct semaphore sema;
+static struct lock lock;
+static struct condition cond;
+
+static thread_func upper;
+static thread_func holder;
+
+void
+test_timed_wait (void) 
+{
+  int64_t start;
+  bool ok;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&sema, 0);
+  lock_init (&lock);
+  cond_init (&cond);
+
+  start = timer_ticks ();
+  ok = sema_down_timeout (&sema, 10);
+  msg ("sema: acquired %d, waited long enough %d.",
+       ok, timer_elapsed (start) >= 10);
+
+  thread_create ("upper", PRI_DEFAULT, upper, NULL);
+  ok = sema_down_timeout (&sema, 1000);
+  msg ("sema: acquired %d after up.", ok);
+
+  thread_create ("holder", PRI_DEFAULT + 1, holder, NULL);
+  ok = lock_acquire_timeout (&lock, 5);
+  msg ("lock: acquired %d while held.", ok);
+  ok = lock_acquire_timeout (&lock, 1000);
+  msg ("lock: acquired %d after release.", ok);
+
+  ok = cond_wait_timeout (&cond, &lock, 5);
+  msg ("cond: signaled %d, lock held %d.",
+       ok, lock_held_by_current_thread (&lock));
+  cond_signal (&cond, &lock);
+  lock_release (&lock);
+}
+
+static void
+upper (void *aux UNUSED) 
+{
+  timer_sleep (5);
+  sema_up (&sema);
+}
+
+static void
+holder (void *aux UNUSED) 
+{
+  lock_acquire (&lock);
+  timer_sleep (20);
+  lock_release (&lock);
+}
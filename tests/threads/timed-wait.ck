@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(timed-wait) begin
+(timed-wait) sema: acquired 0, waited long enough 1.
+(timed-wait) sema: acquired 1 after up.
+(timed-wait) lock: acquired 0 while held.
+(timed-wait) lock: acquired 1 after release.
+(timed-wait) cond: signaled 0, lock held 1.
+(timed-wait) end
+EOF
+pass;
@@ -0,0 +1,64 @@
+/* Queues jobs to the kernel work queues singly, in a batch, and
+   from the preallocated pool, then verifies that draining each
+   queue waits for all of its jobs to finish. */
+
+#include <list.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+#include "devices/timer.h"
+
+#define JOB_CNT 32
+
+static struct work works[JOB_CNT];
+static int done[WQ_CLASS_CNT];
+
+static void
+job (void *class_) 
+{
+  int class = (int) class_;
+  enum intr_level old_level;
+
+  /* Sleep a little so that drain really has to wait. */
+  timer_sleep (1);
+  old_level = intr_disable ();
+  done[class]++;
+  intr_set_level (old_level);
+}
+
+void
+test_workqueue (void) 
+{
+  struct list batch;
+  int i;
+
+  /* Singly queued, caller-owned jobs. */
+  for (i = 0; i < JOB_CNT; i++)
+    {
+      work_init (&works[i], job, (void *) WQ_HIGH);
+      workqueue_queue (WQ_HIGH, &works[i]);
+    }
+  workqueue_drain (WQ_HIGH);
+  msg ("high: %d of %d jobs done after drain", done[WQ_HIGH], JOB_CNT);
+
+  /* One batch. */
+  list_init (&batch);
+  for (i = 0; i < JOB_CNT; i++)
+    {
+      work_init (&works[i], job, (void *) WQ_LOW);
+      list_push_back (&batch, &works[i].elem);
+    }
+  workqueue_queue_batch (WQ_LOW, &batch);
+  workqueue_drain (WQ_LOW);
+  msg ("low: %d of %d jobs done after drain", done[WQ_LOW], JOB_CNT);
+
+  /* Pool-allocated jobs. */
+  for (i = 0; i < JOB_CNT; i++)
+    if (!workqueue_submit (job, (void *) WQ_NORMAL))
+      fail ("workqueue_submit failed");
+  workqueue_drain (WQ_NORMAL);
+  msg ("normal: %d of %d jobs done after drain", done[WQ_NORMAL], JOB_CNT);
+}
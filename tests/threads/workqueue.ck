@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(workqueue) begin
+(workqueue) high: 32 of 32 jobs done after drain
+(workqueue) low: 32 of 32 jobs done after drain
+(workqueue) normal: 32 of 32 jobs done after drain
+(workqueue) end
+EOF
+pass;
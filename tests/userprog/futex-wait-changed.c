@@ -0,0 +1,18 @@
+/* Calls futex_wait() on a word that no longer holds the value
+   passed in, which must return 1 at once instead of sleeping,
+   and futex_wake() on a word nobody waits on, which must wake
+   no one. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int word;
+
+void
+test_main (void) 
+{
+  word = 1;
+  CHECK (futex_wait (&word, 0) == 1, "futex_wait on a changed word");
+  CHECK (futex_wake (&word, 1) == 0, "futex_wake with no waiters");
+}
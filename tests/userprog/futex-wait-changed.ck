@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(futex-wait-changed) begin
+(futex-wait-changed) futex_wait on a changed word
+(futex-wait-changed) futex_wake with no waiters
+(futex-wait-changed) end
+futex-wait-changed: exit(0)
+EOF
+pass;
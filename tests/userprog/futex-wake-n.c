@@ -0,0 +1,60 @@
+/* Puts several threads to sleep on a futex and checks that
+   futex_wake() releases exactly as many of them as it is asked
+   to, and reports that number, leaving the others asleep. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+
+static char stacks[THREAD_CNT][4096] __attribute__ ((aligned (16)));
+static int word;
+static volatile int asleep;     /* Threads about to wait on WORD. */
+static volatile int woken;      /* Threads back from futex_wait(). */
+
+/* Sleeps on WORD until woken, then counts itself. */
+static int
+sleeper (void *aux UNUSED) 
+{
+  __sync_fetch_and_add (&asleep, 1);
+  futex_wait (&word, 0);
+  __sync_fetch_and_add (&woken, 1);
+  return 0;
+}
+
+/* Spins for TICKS timer ticks, giving every other thread time to
+   run up to its next sleep. */
+static void
+spin (int ticks) 
+{
+  int64_t end = clock_ticks () + ticks;
+
+  while (clock_ticks () < end)
+    continue;
+}
+
+void
+test_main (void) 
+{
+  tid_t tids[THREAD_CNT];
+  int i;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      tids[i] = thread_create (sleeper, NULL, stacks[i] + sizeof stacks[i]);
+      CHECK (tids[i] != TID_ERROR, "thread_create %d", i);
+    }
+  while (asleep < THREAD_CNT)
+    spin (1);
+  spin (10);
+
+  CHECK (futex_wake (&word, 2) == 2, "futex_wake 2 of %d", THREAD_CNT);
+  spin (10);
+  CHECK (woken == 2, "exactly 2 woke up");
+  CHECK (futex_wake (&word, THREAD_CNT) == THREAD_CNT - 2,
+         "futex_wake wakes the other %d", THREAD_CNT - 2);
+  for (i = 0; i < THREAD_CNT; i++)
+    CHECK (thread_join (tids[i]) == 0, "thread_join %d", i);
+  CHECK (woken == THREAD_CNT, "all %d woke up", THREAD_CNT);
+}
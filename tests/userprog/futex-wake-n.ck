@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(futex-wake-n) begin
+(futex-wake-n) thread_create 0
+(futex-wake-n) thread_create 1
+(futex-wake-n) thread_create 2
+(futex-wake-n) thread_create 3
+(futex-wake-n) futex_wake 2 of 4
+(futex-wake-n) exactly 2 woke up
+(futex-wake-n) futex_wake wakes the other 2
+(futex-wake-n) thread_join 0
+(futex-wake-n) thread_join 1
+(futex-wake-n) thread_join 2
+(futex-wake-n) thread_join 3
+(futex-wake-n) all 4 woke up
+(futex-wake-n) end
+futex-wake-n: exit(0)
+EOF
+pass;
@@ -0,0 +1,16 @@
+/* Child process for the perf-spawn tests.
+   Exits at once with the status given as its argument, so that
+   starting it costs nearly all of its run. */
+
+#include <stdlib.h>
+#include "tests/lib.h"
+
+int
+main (int argc, const char *argv[]) 
+{
+  test_name = "child-spawn";
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  return atoi (argv[1]);
+}
@@ -0,0 +1,101 @@
+/* Writes a file with many asynchronous writes outstanding at
+   once, then reads it back the same way, in reverse order, and
+   checks that every request completes exactly once with the
+   right data. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define REQ_CNT 16              /* Requests in flight. */
+#define REQ_SIZE 4096           /* Bytes per request. */
+
+static char bufs[REQ_CNT][REQ_SIZE];
+static struct aiocb cbs[REQ_CNT];
+
+/* Returns the byte at offset OFS in the file. */
+static char
+file_byte (int ofs) 
+{
+  return ofs * 13 + ofs / REQ_SIZE;
+}
+
+/* Submits every request in CBS and waits for all of them,
+   failing unless each transfers REQ_SIZE bytes. */
+static void
+run_all (const char *what) 
+{
+  struct aiocb *ptrs[REQ_CNT];
+  bool seen[REQ_CNT];
+  int done = 0, i;
+
+  for (i = 0; i < REQ_CNT; i++)
+    {
+      ptrs[i] = &cbs[i];
+      seen[i] = false;
+    }
+  if (aio_submit (ptrs, REQ_CNT) != REQ_CNT)
+    fail ("%s: aio_submit failed", what);
+  while (done < REQ_CNT)
+    {
+      struct aiocb *finished[REQ_CNT];
+      int n = aio_wait (finished, REQ_CNT, -1);
+
+      if (n <= 0)
+        fail ("%s: aio_wait returned %d", what, n);
+      for (i = 0; i < n; i++)
+        {
+          int idx = finished[i] - cbs;
+
+          if (idx < 0 || idx >= REQ_CNT || seen[idx])
+            fail ("%s: bogus completion", what);
+          if (finished[i]->result != REQ_SIZE)
+            fail ("%s: request %d returned %d", what, idx,
+                  finished[i]->result);
+          seen[idx] = true;
+        }
+      done += n;
+    }
+  if (aio_wait (NULL, 0, 0) != -1)
+    fail ("%s: requests left over", what);
+}
+
+void
+test_main (void) 
+{
+  int64_t start;
+  int fd, i, j;
+
+  CHECK (create ("aio-data", 0), "create \"aio-data\"");
+  CHECK ((fd = open ("aio-data")) > 1, "open \"aio-data\"");
+
+  start = clock_ticks ();
+  for (i = 0; i < REQ_CNT; i++)
+    {
+      for (j = 0; j < REQ_SIZE; j++)
+        bufs[i][j] = file_byte (i * REQ_SIZE + j);
+      cbs[i].fd = fd;
+      cbs[i].buf = bufs[i];
+      cbs[i].size = REQ_SIZE;
+      cbs[i].offset = i * REQ_SIZE;
+      cbs[i].write = true;
+    }
+  run_all ("write");
+  CHECK (filesize (fd) == REQ_CNT * REQ_SIZE, "file has grown");
+
+  for (i = 0; i < REQ_CNT; i++)
+    {
+      cbs[i].buf = bufs[REQ_CNT - 1 - i];
+      cbs[i].write = false;
+    }
+  memset (bufs, 0, sizeof bufs);
+  run_all ("read");
+  for (i = 0; i < REQ_CNT; i++)
+    for (j = 0; j < REQ_SIZE; j++)
+      if (bufs[REQ_CNT - 1 - i][j] != file_byte (i * REQ_SIZE + j))
+        fail ("byte %d read back wrong", i * REQ_SIZE + j);
+  msg ("%d bytes out and back in %lld ticks", 2 * REQ_CNT * REQ_SIZE,
+       clock_ticks () - start);
+  close (fd);
+}
@@ -0,0 +1,75 @@
+/* Streams a file through an O_DIRECT fd while another fd reads
+   and writes the same file through the buffer cache, and checks
+   that each fd sees the other's data: sectors cached dirty reach
+   a direct read, and a direct write reaches sectors already
+   cached.  The file does not end on a sector boundary, so the
+   last part goes through the cache either way. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (64 * 1024 + 100)     /* Bytes in the file. */
+#define CACHED 4096                     /* Bytes first written cached. */
+
+static char buf[FILE_SIZE] __attribute__ ((aligned (512)));
+
+/* Returns byte OFS of the file's contents after pass PASS. */
+static char
+file_byte (int ofs, int pass) 
+{
+  return ofs * (pass + 3) + ofs / 512;
+}
+
+/* Fails unless the first SIZE bytes of BUF are those of PASS. */
+static void
+check_buf (int size, int pass, const char *what) 
+{
+  int i;
+
+  for (i = 0; i < size; i++)
+    if (buf[i] != file_byte (i, pass))
+      fail ("%s: byte %d is wrong", what, i);
+}
+
+void
+test_main (void) 
+{
+  int64_t start;
+  int cached_fd, direct_fd, i;
+
+  CHECK (create ("direct-data", FILE_SIZE), "create \"direct-data\"");
+  CHECK ((cached_fd = open ("direct-data")) > 1, "open \"direct-data\"");
+  CHECK ((direct_fd = open_flags ("direct-data", O_DIRECT)) > 1,
+         "open \"direct-data\" with O_DIRECT");
+  CHECK (open_flags ("direct-data", 0x80) == -1, "reject unknown flags");
+
+  for (i = 0; i < CACHED; i++)
+    buf[i] = file_byte (i, 0);
+  CHECK (write (cached_fd, buf, CACHED) == CACHED, "write through cache");
+  memset (buf, 0, sizeof buf);
+  CHECK (read (direct_fd, buf, CACHED) == CACHED, "read direct");
+  check_buf (CACHED, 0, "direct read of cached data");
+
+  start = clock_ticks ();
+  for (i = 0; i < FILE_SIZE; i++)
+    buf[i] = file_byte (i, 1);
+  seek (direct_fd, 0);
+  CHECK (write (direct_fd, buf, FILE_SIZE) == FILE_SIZE, "write direct");
+  memset (buf, 0, sizeof buf);
+  seek (direct_fd, 0);
+  CHECK (read (direct_fd, buf, FILE_SIZE) == FILE_SIZE, "read direct");
+  check_buf (FILE_SIZE, 1, "direct read of direct data");
+  msg ("%d bytes out and back in direct in %lld ticks", 2 * FILE_SIZE,
+       clock_ticks () - start);
+
+  memset (buf, 0, sizeof buf);
+  seek (cached_fd, 0);
+  CHECK (read (cached_fd, buf, FILE_SIZE) == FILE_SIZE,
+         "read through cache");
+  check_buf (FILE_SIZE, 1, "cached read of direct data");
+
+  close (direct_fd);
+  close (cached_fd);
+}
@@ -0,0 +1,66 @@
+/* Reads a file through in small pieces with each fadvise() access
+   pattern, checking the data and timing each pass, and checks
+   that WILLNEED and DONTNEED leave the data alone and that bad
+   advice is refused. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 65536         /* Bytes in the file. */
+#define CHUNK 128               /* Bytes per read. */
+
+static char buf[FILE_SIZE];
+
+/* Returns the byte at offset OFS in the file. */
+static char
+file_byte (int ofs) 
+{
+  return ofs * 13 + ofs / 251;
+}
+
+/* Reads the file through from the start, CHUNK bytes at a time,
+   after giving it ADVICE, and checks what it holds.  Reports how
+   long the reads took. */
+static void
+read_through (int fd, int advice, const char *what) 
+{
+  int64_t start;
+  int ofs, i;
+
+  CHECK (fadvise (fd, 0, 0, advice), "fadvise %s", what);
+  start = clock_ticks ();
+  seek (fd, 0);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK)
+    if (read (fd, buf + ofs, CHUNK) != CHUNK)
+      fail ("%s: short read at %d", what, ofs);
+  msg ("%s: %d bytes read in %lld ticks", what, FILE_SIZE,
+       clock_ticks () - start);
+  for (i = 0; i < FILE_SIZE; i++)
+    if (buf[i] != file_byte (i))
+      fail ("%s: byte %d is wrong", what, i);
+}
+
+void
+test_main (void) 
+{
+  int fd, i;
+
+  for (i = 0; i < FILE_SIZE; i++)
+    buf[i] = file_byte (i);
+  CHECK (create ("advised", FILE_SIZE), "create \"advised\"");
+  CHECK ((fd = open ("advised")) > 1, "open \"advised\"");
+  CHECK (write (fd, buf, FILE_SIZE) == FILE_SIZE, "write \"advised\"");
+
+  read_through (fd, FADV_SEQUENTIAL, "sequential");
+  read_through (fd, FADV_RANDOM, "random");
+  read_through (fd, FADV_NORMAL, "normal");
+
+  CHECK (fadvise (fd, 0, FILE_SIZE, FADV_DONTNEED), "fadvise dontneed");
+  CHECK (fadvise (fd, 0, FILE_SIZE / 2, FADV_WILLNEED), "fadvise willneed");
+  read_through (fd, FADV_NORMAL, "after dontneed and willneed");
+
+  CHECK (!fadvise (fd, 0, 0, 99), "bad advice refused");
+  CHECK (!fadvise (99, 0, 0, FADV_NORMAL), "bad fd refused");
+  close (fd);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+foreach my $what ('sequential', 'random', 'normal',
+                  'after dontneed and willneed') {
+    fail "missing $what timing in output"
+      unless grep (/^\(perf-fadvise\) $what: \d+ bytes read in \d+ ticks$/,
+                   @output);
+}
+fail "missing end in output"
+  unless grep ($_ eq '(perf-fadvise) end', @output);
+
+pass;
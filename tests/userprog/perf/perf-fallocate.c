@@ -0,0 +1,69 @@
+/* Sets aside space for a file with fallocate(), checks that it
+   reads as zeros, fills it in back to front, and checks that a
+   second fallocate() over the written part leaves the data
+   alone. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 65536         /* Bytes set aside. */
+#define CHUNK 512               /* Bytes per write. */
+
+static char buf[FILE_SIZE];
+
+/* Returns the byte at offset OFS in the file. */
+static char
+file_byte (int ofs) 
+{
+  return ofs * 7 + ofs / CHUNK;
+}
+
+/* Reads the whole file into BUF and compares it with what it
+   should hold, zeros if ZEROS and otherwise file_byte(). */
+static void
+check_data (int fd, bool zeros, const char *what) 
+{
+  int i;
+
+  seek (fd, 0);
+  if (read (fd, buf, FILE_SIZE) != FILE_SIZE)
+    fail ("%s: short read", what);
+  for (i = 0; i < FILE_SIZE; i++)
+    if (buf[i] != (zeros ? 0 : file_byte (i)))
+      fail ("%s: byte %d is wrong", what, i);
+}
+
+void
+test_main (void) 
+{
+  int64_t start;
+  int fd, ofs, i;
+
+  CHECK (create ("falloc-data", 0), "create \"falloc-data\"");
+  CHECK ((fd = open ("falloc-data")) > 1, "open \"falloc-data\"");
+
+  start = clock_ticks ();
+  CHECK (fallocate (fd, 0, FILE_SIZE), "fallocate %d bytes", FILE_SIZE);
+  CHECK (filesize (fd) == FILE_SIZE, "file has grown");
+  check_data (fd, true, "set aside");
+
+  for (ofs = FILE_SIZE - CHUNK; ofs >= 0; ofs -= CHUNK)
+    {
+      for (i = 0; i < CHUNK; i++)
+        buf[i] = file_byte (ofs + i);
+      seek (fd, ofs);
+      if (write (fd, buf, CHUNK) != CHUNK)
+        fail ("write at %d failed", ofs);
+    }
+  check_data (fd, false, "written");
+  msg ("%d bytes set aside and written in %lld ticks", FILE_SIZE,
+       clock_ticks () - start);
+
+  CHECK (fallocate (fd, FILE_SIZE / 2, FILE_SIZE),
+         "fallocate over written data");
+  CHECK (filesize (fd) == FILE_SIZE / 2 * 3, "file has grown again");
+  check_data (fd, false, "after second fallocate");
+  close (fd);
+}
@@ -0,0 +1,73 @@
+/* Creates enough files that the root directory turns from a
+   linear array into a hashed one, then lists it with getdents()
+   in batches of various sizes and checks that every file shows
+   up exactly once each time. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 60
+
+/* Lists the directory open as FD, BATCH entries at a time, from
+   the start, which FD must be at. */
+static void
+list (int fd, int batch) 
+{
+  struct dirent dents[FILE_CNT];
+  bool seen[FILE_CNT];
+  int total = 0, n, i;
+
+  for (i = 0; i < FILE_CNT; i++)
+    seen[i] = false;
+  while ((n = getdents (fd, dents, batch * sizeof *dents)) > 0)
+    for (i = 0; i < n; i++)
+      {
+        int idx;
+
+        if (memcmp (dents[i].name, "gd", 2))
+          continue;
+        idx = atoi (dents[i].name + 2);
+        if (idx < 0 || idx >= FILE_CNT || seen[idx])
+          fail ("batch %d: bogus or repeated entry \"%s\"",
+                batch, dents[i].name);
+        seen[idx] = true;
+        total++;
+      }
+  if (n < 0)
+    fail ("batch %d: getdents failed", batch);
+  if (total != FILE_CNT)
+    fail ("batch %d: listed %d files, not %d", batch, total, FILE_CNT);
+}
+
+void
+test_main (void) 
+{
+  static const int batches[] = {1, 7, FILE_CNT};
+  int64_t start;
+  size_t i;
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "gd%d", (int) i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+
+  start = clock_ticks ();
+  for (i = 0; i < sizeof batches / sizeof *batches; i++)
+    {
+      int fd = open ("/");
+
+      CHECK (fd > 1, "open \"/\"");
+      list (fd, batches[i]);
+      close (fd);
+    }
+  msg ("listed %d files %d times in %lld ticks", FILE_CNT,
+       (int) (sizeof batches / sizeof *batches), clock_ticks () - start);
+}
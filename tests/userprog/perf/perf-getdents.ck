@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing timing in output"
+  unless grep (/^\(perf-getdents\) listed \d+ files \d+ times in \d+ ticks$/, @output);
+fail "missing end in output"
+  unless grep ($_ eq '(perf-getdents) end', @output);
+
+pass;
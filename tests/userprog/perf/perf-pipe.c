@@ -0,0 +1,92 @@
+/* Streams data from a forked child to its parent through a pipe:
+   first in small writes that go through the ring's pages, then
+   in whole page-aligned pages that the pipe can take without
+   copying.  The child rewrites its buffer after each page-sized
+   write, so the parent also checks that a spliced page keeps
+   the contents it had when it was written. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define SMALL_WRITE 100         /* Bytes per small write. */
+#define SMALL_CNT 400           /* Number of small writes. */
+#define PAGE_CNT 64             /* Number of page writes. */
+#define TOTAL (SMALL_WRITE * SMALL_CNT + PAGE_SIZE * PAGE_CNT)
+
+static char page[PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+
+/* Returns the byte at offset OFS in the stream. */
+static char
+stream_byte (int ofs) 
+{
+  return ofs * 7 + ofs / PAGE_SIZE;
+}
+
+/* Fills BUF with the SIZE bytes of the stream at OFS. */
+static void
+fill (char *buf, int ofs, int size) 
+{
+  int i;
+
+  for (i = 0; i < size; i++)
+    buf[i] = stream_byte (ofs + i);
+}
+
+static void
+writer (int fd) 
+{
+  int ofs = 0;
+  int i;
+
+  for (i = 0; i < SMALL_CNT; i++, ofs += SMALL_WRITE)
+    {
+      fill (page, ofs, SMALL_WRITE);
+      if (write (fd, page, SMALL_WRITE) != SMALL_WRITE)
+        fail ("small write %d failed", i);
+    }
+  for (i = 0; i < PAGE_CNT; i++, ofs += PAGE_SIZE)
+    {
+      fill (page, ofs, PAGE_SIZE);
+      if (write (fd, page, PAGE_SIZE) != PAGE_SIZE)
+        fail ("page write %d failed", i);
+    }
+  fill (page, 0, PAGE_SIZE);
+  close (fd);
+  exit (0);
+}
+
+void
+test_main (void) 
+{
+  static char buf[PAGE_SIZE + 123];
+  int fds[2];
+  int64_t start;
+  int ofs, n, i;
+  pid_t child;
+
+  CHECK (pipe (fds), "pipe");
+  start = clock_ticks ();
+  child = fork ();
+  if (child == 0)
+    {
+      close (fds[0]);
+      writer (fds[1]);
+    }
+  CHECK (child != PID_ERROR, "fork");
+  close (fds[1]);
+
+  for (ofs = 0; (n = read (fds[0], buf, sizeof buf)) > 0; ofs += n)
+    for (i = 0; i < n; i++)
+      if (buf[i] != stream_byte (ofs + i))
+        fail ("byte %d is %d, not %d", ofs + i, buf[i],
+              stream_byte (ofs + i));
+  if (n < 0)
+    fail ("read failed");
+  if (ofs != TOTAL)
+    fail ("read %d bytes, not %d", ofs, TOTAL);
+  CHECK (wait (child) == 0, "wait for writer");
+  close (fds[0]);
+  msg ("%d bytes in %lld ticks", TOTAL, clock_ticks () - start);
+}
@@ -0,0 +1,109 @@
+/* Has two forked children each write a stream of messages down
+   its own pipe, and reads both streams in the parent with
+   poll(), which also reports each child's exit.  Checks that an
+   empty pipe polls as not ready, and that a closed one polls as
+   hung up once drained. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 2
+#define MSG_CNT 200             /* Messages per child. */
+#define MSG_SIZE 64             /* Bytes per message. */
+
+static void
+writer (int fd, int id) 
+{
+  char msg[MSG_SIZE];
+  int i;
+
+  for (i = 0; i < MSG_CNT; i++)
+    {
+      memset (msg, id * MSG_CNT + i, sizeof msg);
+      if (write (fd, msg, sizeof msg) != sizeof msg)
+        fail ("child %d: write %d failed", id, i);
+    }
+  exit (id);
+}
+
+void
+test_main (void) 
+{
+  struct pollfd fds[CHILD_CNT + 1];
+  int received[CHILD_CNT];
+  pid_t children[CHILD_CNT];
+  int pipes[CHILD_CNT][2];
+  int open_cnt, exit_cnt, i;
+  int64_t start;
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      CHECK (pipe (pipes[i]), "pipe %d", i);
+      fds[i].fd = pipes[i][0];
+      fds[i].events = POLLIN;
+      received[i] = 0;
+    }
+  fds[CHILD_CNT].fd = -1;
+  fds[CHILD_CNT].events = POLLCHILD;
+  CHECK (poll (fds, CHILD_CNT, 0) == 0, "empty pipes are not ready");
+
+  start = clock_ticks ();
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      children[i] = fork ();
+      if (children[i] == 0)
+        writer (pipes[i][1], i);
+      CHECK (children[i] != PID_ERROR, "fork %d", i);
+      close (pipes[i][1]);
+    }
+
+  open_cnt = CHILD_CNT;
+  exit_cnt = 0;
+  while (open_cnt > 0 || exit_cnt < CHILD_CNT)
+    {
+      int n = poll (fds, CHILD_CNT + 1, -1);
+
+      if (n <= 0)
+        fail ("poll returned %d", n);
+      for (i = 0; i < CHILD_CNT; i++)
+        if (fds[i].revents & POLLIN)
+          {
+            char msg[MSG_SIZE];
+            int expected = i * MSG_CNT + received[i];
+
+            if (read (fds[i].fd, msg, sizeof msg) != sizeof msg)
+              fail ("short read from child %d", i);
+            if (msg[0] != (char) expected
+                || msg[MSG_SIZE - 1] != (char) expected)
+              fail ("child %d: message %d garbled", i, received[i]);
+            received[i]++;
+          }
+        else if (fds[i].revents & POLLHUP)
+          {
+            if (received[i] != MSG_CNT)
+              fail ("child %d hung up after %d messages",
+                    i, received[i]);
+            close (fds[i].fd);
+            fds[i].fd = -1;
+            open_cnt--;
+          }
+      if (fds[CHILD_CNT].revents & POLLCHILD)
+        {
+          int status;
+          pid_t pid = wait_any (&status);
+
+          if (pid == PID_ERROR || status != (pid == children[0] ? 0 : 1))
+            fail ("wait_any returned %d, status %d", pid, status);
+          if (++exit_cnt == CHILD_CNT)
+            fds[CHILD_CNT].events = 0;
+        }
+    }
+  fds[0].fd = -1;
+  fds[0].events = POLLCHILD;
+  CHECK (poll (fds, 1, 0) == 1 && fds[0].revents == POLLNVAL,
+         "no children left");
+  msg ("%d messages in %lld ticks", CHILD_CNT * MSG_CNT,
+       clock_ticks () - start);
+}
@@ -0,0 +1,73 @@
+/* Plays ping-pong between a process and its forked child through
+   a shared memory segment: each waits on a futex in the segment
+   for its turn and then hands the turn to the other.  Also
+   checks that a second segment, mapped by the child alone after
+   the fork, is seen by the parent once it maps it too, which it
+   does before its last turn so that the child is still alive to
+   hold the segment. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ROUNDS 500              /* Turns each side takes. */
+#define SEG_ADDR ((void *) 0x10000000)
+#define SEG2_ADDR ((void *) 0x10100000)
+
+/* Shared state, at SEG_ADDR. */
+struct shared
+  {
+    int turn;                   /* Next turn number.  Even: parent. */
+    int seg2;                   /* Id of the child's segment. */
+  };
+
+/* Waits until S->turn has parity SIDE, then takes the turn. */
+static void
+take_turn (struct shared *s, int side) 
+{
+  int turn;
+
+  while (((turn = s->turn) & 1) != side)
+    futex_wait (&s->turn, turn);
+  s->turn = turn + 1;
+  futex_wake (&s->turn, 1);
+}
+
+void
+test_main (void) 
+{
+  struct shared *s = SEG_ADDR;
+  int64_t start;
+  int id, i;
+  pid_t child;
+
+  id = shm_create (sizeof *s);
+  CHECK (id >= 0, "shm_create");
+  CHECK (shm_map (id, SEG_ADDR), "shm_map");
+  CHECK (!shm_map (id, SEG_ADDR), "shm_map over a mapping fails");
+  CHECK (s->turn == 0, "segment starts zeroed");
+
+  start = clock_ticks ();
+  child = fork ();
+  if (child == 0)
+    {
+      int *word = SEG2_ADDR;
+
+      s->seg2 = shm_create (1);
+      if (s->seg2 < 0 || !shm_map (s->seg2, SEG2_ADDR))
+        fail ("child's segment");
+      *word = 421;
+      for (i = 0; i <= ROUNDS; i++)
+        take_turn (s, 1);
+      exit (0);
+    }
+  CHECK (child != PID_ERROR, "fork");
+
+  for (i = 0; i < ROUNDS; i++)
+    take_turn (s, 0);
+  CHECK (shm_map (s->seg2, SEG2_ADDR), "map child's segment");
+  CHECK (*(int *) SEG2_ADDR == 421, "child's write is visible");
+  take_turn (s, 0);
+  CHECK (wait (child) == 0, "wait for child");
+  msg ("%d turns in %lld ticks", s->turn, clock_ticks () - start);
+}
@@ -0,0 +1,23 @@
+/* Starts batches of child processes that run at the same time,
+   to measure exec throughput when many copies of one program
+   start at once. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/userprog/perf/perf-spawn.h"
+
+void
+test_main (void) 
+{
+  pid_t children[PARALLEL_CNT];
+  int round;
+
+  msg ("exec %d children at once, %d times",
+       PARALLEL_CNT, PARALLEL_ROUNDS);
+  for (round = 0; round < PARALLEL_ROUNDS; round++) 
+    {
+      exec_children ("child-spawn", children, PARALLEL_CNT);
+      wait_children (children, PARALLEL_CNT);
+    }
+}
@@ -0,0 +1,29 @@
+/* Starts child processes one after another, waiting for each to
+   exit before starting the next, to measure the latency of
+   exec. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/userprog/perf/perf-spawn.h"
+
+void
+test_main (void) 
+{
+  int i;
+
+  msg ("exec and wait for %d children, one at a time", SERIAL_CNT);
+  for (i = 0; i < SERIAL_CNT; i++) 
+    {
+      char cmd_line[32];
+      pid_t pid;
+      int status;
+
+      snprintf (cmd_line, sizeof cmd_line, "child-spawn %d", i);
+      CHECK ((pid = exec (cmd_line)) != PID_ERROR, "exec \"%s\"", cmd_line);
+      status = wait (pid);
+      if (status != i)
+        fail ("wait for \"%s\" returned %d", cmd_line, status);
+    }
+}
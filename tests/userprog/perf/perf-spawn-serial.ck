@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::userprog::perf::perf;
+check_spawn (EXECS => 32);
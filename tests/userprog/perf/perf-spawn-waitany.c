@@ -0,0 +1,39 @@
+/* Starts batches of child processes that run at the same time and
+   reaps each batch with wait_any(), in whatever order the
+   children exit, checking that each child is reaped exactly once
+   with its own exit status. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/userprog/perf/perf-spawn.h"
+
+void
+test_main (void) 
+{
+  pid_t children[PARALLEL_CNT];
+  int round;
+
+  msg ("exec %d children at once, %d times, reaping any",
+       PARALLEL_CNT, PARALLEL_ROUNDS);
+  for (round = 0; round < PARALLEL_ROUNDS; round++) 
+    {
+      int reaped;
+
+      exec_children ("child-spawn", children, PARALLEL_CNT);
+      for (reaped = 0; reaped < PARALLEL_CNT; reaped++) 
+        {
+          int status;
+          pid_t pid = wait_any (&status);
+
+          CHECK (pid != PID_ERROR, "wait_any for child %d of %d",
+                 reaped + 1, PARALLEL_CNT);
+          CHECK (status >= 0 && status < PARALLEL_CNT
+                 && children[status] == pid,
+                 "wait_any returned pid %d with status %d", pid, status);
+          children[status] = PID_ERROR;
+        }
+      CHECK (wait_any (NULL) == PID_ERROR,
+             "wait_any with no children left returns PID_ERROR");
+    }
+}
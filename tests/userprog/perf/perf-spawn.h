@@ -0,0 +1,12 @@
+#ifndef TESTS_USERPROG_PERF_PERF_SPAWN_H
+#define TESTS_USERPROG_PERF_PERF_SPAWN_H
+
+/* Children started one at a time by perf-spawn-serial. */
+#define SERIAL_CNT 32
+
+/* Children running at once in each round of perf-spawn-parallel,
+   and the number of rounds. */
+#define PARALLEL_CNT 8
+#define PARALLEL_ROUNDS 4
+
+#endif /* tests/userprog/perf/perf-spawn.h */
@@ -0,0 +1,56 @@
+# -*- perl -*-
+
+# Checks that a process spawn test ran to completion and reports
+# what exec cost.
+#
+# The figures come from the statistics the kernel prints on
+# shutdown.  The overall rate covers the whole run, including
+# booting, so it is only a rough guide.  The "Exec:" lines break
+# down the time spent in each phase of starting a process, from
+# process_execute() to the first user instruction, and are
+# reported per exec.  Pass EXECS, the number of children the test
+# starts.  The report goes to the terminal, not the result file,
+# so that a run passes or fails just as other tests do.
+
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+
+sub check_spawn {
+    my (%args) = @_;
+    my (@output) = read_text_file ("$test.output");
+
+    common_checks ("run", @output);
+
+    my ($name) = $test =~ m|([^/]+)$|;
+    my (@core) = get_core_output ("run", @output);
+    fail "missing end in output"
+      unless grep ($_ eq "($name) end", @core);
+
+    my ($ticks);
+    my (@phases);
+    for (@output) {
+	($ticks) = /^Timer: (\d+) ticks$/ if /^Timer:/;
+	push (@phases, [$1, $2, $3])
+	  if /^Exec: (.+) (\d+) times, (\d+) ns total$/;
+    }
+    fail "missing timer statistics in output" unless defined $ticks;
+    fail "missing exec statistics in output" unless @phases;
+
+    # The timer runs at 100 Hz.
+    my ($secs) = ($ticks > 0 ? $ticks : 1) / 100;
+    my (@report) = ("$name: $ticks ticks");
+    push (@report, sprintf ("  %.0f execs/s", $args{EXECS} / $secs));
+    for my $phase (@phases) {
+	my ($phase_name, $cnt, $ns) = @$phase;
+	push (@report, sprintf ("  %-16s %8.1f us/exec",
+				$phase_name, $ns / ($cnt || 1) / 1000));
+    }
+    print STDOUT "$_\n" foreach @report;
+
+    pass;
+}
+
+1;
@@ -0,0 +1,55 @@
+/* Reads and writes a file at explicit offsets with pread() and
+   pwrite(), including offsets at and past the end of file, and
+   checks that none of them moves the file position. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Returns true if all SIZE bytes at BUF are zero. */
+static bool
+all_zero (const char *buf, size_t size) 
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (buf[i] != 0)
+      return false;
+  return true;
+}
+
+void
+test_main (void) 
+{
+  char buf[32];
+  int fd;
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (write (fd, "0123456789", 10) == 10, "write 10 bytes");
+
+  CHECK (pread (fd, buf, 4, 3) == 4 && !memcmp (buf, "3456", 4),
+         "pread 4 bytes at 3");
+  CHECK (pwrite (fd, "XY", 2, 1) == 2, "pwrite 2 bytes at 1");
+  CHECK (pread (fd, buf, 4, 8) == 2 && !memcmp (buf, "89", 2),
+         "pread across end of file is short");
+  CHECK (pread (fd, buf, 4, 10) == 0, "pread at end of file");
+  CHECK (pread (fd, buf, 4, 100) == 0, "pread past end of file");
+  CHECK (tell (fd) == 10, "position is still 10");
+
+  CHECK (pwrite (fd, "ab", 2, 20) == 2, "pwrite 2 bytes at 20");
+  CHECK (filesize (fd) == 22, "file grew to 22 bytes");
+  CHECK (tell (fd) == 10, "position is still 10");
+  CHECK (read (fd, buf, sizeof buf) == 12, "read the rest");
+  CHECK (all_zero (buf, 10) && !memcmp (buf + 10, "ab", 2),
+         "gap before the pwrite reads as zeros");
+
+  seek (fd, 0);
+  CHECK (read (fd, buf, 10) == 10 && !memcmp (buf, "0XY3456789", 10),
+         "pwrite landed at 1");
+  close (fd);
+
+  CHECK (pread (fd, buf, 4, 0) == -1, "pread closed fd");
+  CHECK (pwrite (fd, buf, 4, 0) == -1, "pwrite closed fd");
+}
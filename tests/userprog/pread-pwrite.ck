@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pread-pwrite) begin
+(pread-pwrite) create "data"
+(pread-pwrite) open "data"
+(pread-pwrite) write 10 bytes
+(pread-pwrite) pread 4 bytes at 3
+(pread-pwrite) pwrite 2 bytes at 1
+(pread-pwrite) pread across end of file is short
+(pread-pwrite) pread at end of file
+(pread-pwrite) pread past end of file
+(pread-pwrite) position is still 10
+(pread-pwrite) pwrite 2 bytes at 20
+(pread-pwrite) file grew to 22 bytes
+(pread-pwrite) position is still 10
+(pread-pwrite) read the rest
+(pread-pwrite) gap before the pwrite reads as zeros
+(pread-pwrite) pwrite landed at 1
+(pread-pwrite) pread closed fd
+(pread-pwrite) pwrite closed fd
+(pread-pwrite) end
+pread-pwrite: exit(0)
+EOF
+pass;
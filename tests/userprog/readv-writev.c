@@ -0,0 +1,46 @@
+/* Writes a file with writev(), including an empty buffer, and
+   reads it back with readv() into buffers that add up to more
+   than the file holds.  The read must stop at the first buffer
+   it cannot fill, leaving the buffers after it untouched. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char a[4], b[10], c[5];
+  struct iovec out[3] =
+    {
+      {"abc", 3},
+      {"", 0},
+      {"defgh", 5},
+    };
+  struct iovec in[3] =
+    {
+      {a, sizeof a},
+      {b, sizeof b},
+      {c, sizeof c},
+    };
+  int fd;
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (writev (fd, out, 3) == 8, "writev 3 buffers, 8 bytes");
+  CHECK (tell (fd) == 8, "position is 8");
+  CHECK (writev (fd, out, 0) == 0, "writev no buffers");
+
+  seek (fd, 0);
+  memset (c, 'x', sizeof c);
+  CHECK (readv (fd, in, 3) == 8, "readv 8 bytes into 19");
+  CHECK (!memcmp (a, "abcd", 4), "first buffer filled");
+  CHECK (!memcmp (b, "efgh", 4), "second buffer short");
+  CHECK (!memcmp (c, "xxxxx", 5), "third buffer untouched");
+  CHECK (readv (fd, in, 3) == 0, "readv at end of file");
+  close (fd);
+
+  CHECK (readv (fd, in, 3) == -1, "readv closed fd");
+  CHECK (writev (fd, out, 3) == -1, "writev closed fd");
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(readv-writev) begin
+(readv-writev) create "data"
+(readv-writev) open "data"
+(readv-writev) writev 3 buffers, 8 bytes
+(readv-writev) position is 8
+(readv-writev) writev no buffers
+(readv-writev) readv 8 bytes into 19
+(readv-writev) first buffer filled
+(readv-writev) second buffer short
+(readv-writev) third buffer untouched
+(readv-writev) readv at end of file
+(readv-writev) readv closed fd
+(readv-writev) writev closed fd
+(readv-writev) end
+readv-writev: exit(0)
+EOF
+pass;
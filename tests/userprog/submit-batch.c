@@ -0,0 +1,64 @@
+/* Makes batches of system calls with submit() and checks each
+   one's result.  A nested submit and a fork must be refused with
+   -1 without being made: the nested batch's create must not
+   happen, and there must be no child to wait for. */
+
+#include <string.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static void
+make_req (struct syscall_req *req, int number,
+          unsigned arg0, unsigned arg1, unsigned arg2)
+{
+  memset (req, 0, sizeof *req);
+  req->number = number;
+  req->args[0] = arg0;
+  req->args[1] = arg1;
+  req->args[2] = arg2;
+}
+
+void
+test_main (void) 
+{
+  struct syscall_req nested[1] =
+    {
+      {SYS_CREATE, {(unsigned) "nested", 0}, 0},
+    };
+  struct syscall_req first[6] =
+    {
+      {SYS_CREATE, {(unsigned) "data", 0}, 0},
+      {SYS_OPEN, {(unsigned) "data"}, 0},
+      {SYS_OPEN, {(unsigned) "no-such-file"}, 0},
+      {SYS_SUBMIT, {(unsigned) nested, 1}, 0},
+      {SYS_FORK, {0}, 0},
+      {9999, {0}, 0},
+    };
+  struct syscall_req second[4];
+  char buf[5];
+  int fd;
+
+  CHECK (submit (first, 6) == 6, "submit 6 requests");
+  CHECK (first[0].result == 1, "create returned true");
+  CHECK ((fd = first[1].result) > 1, "open returned an fd");
+  CHECK (first[2].result == -1, "open of a missing file returned -1");
+  CHECK (first[3].result == -1, "nested submit returned -1");
+  CHECK (nested[0].result == 0, "nested request was not made");
+  CHECK (open ("nested") == -1, "nested create did not happen");
+  CHECK (first[4].result == -1, "fork returned -1");
+  CHECK (wait_any (NULL) == -1, "fork made no child");
+  CHECK (first[5].result == -1, "bad number returned -1");
+
+  make_req (&second[0], SYS_WRITE, fd, (unsigned) "hello", 5);
+  make_req (&second[1], SYS_SEEK, fd, 1, 0);
+  make_req (&second[2], SYS_READ, fd, (unsigned) buf, 4);
+  make_req (&second[3], SYS_TELL, fd, 0, 0);
+  CHECK (submit (second, 4) == 4, "submit write, seek, read, tell");
+  CHECK (second[0].result == 5, "write returned 5");
+  CHECK (second[2].result == 4 && !memcmp (buf, "ello", 4),
+         "read returned what was written");
+  CHECK (second[3].result == 5, "tell returned 5");
+  CHECK (submit (second, 0) == 0, "submit no requests");
+}
@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(submit-batch) begin
+(submit-batch) submit 6 requests
+(submit-batch) create returned true
+(submit-batch) open returned an fd
+(submit-batch) open of a missing file returned -1
+(submit-batch) nested submit returned -1
+(submit-batch) nested request was not made
+(submit-batch) nested create did not happen
+(submit-batch) fork returned -1
+(submit-batch) fork made no child
+(submit-batch) bad number returned -1
+(submit-batch) submit write, seek, read, tell
+(submit-batch) write returned 5
+(submit-batch) read returned what was written
+(submit-batch) tell returned 5
+(submit-batch) submit no requests
+(submit-batch) end
+submit-batch: exit(0)
+EOF
+pass;
@@ -0,0 +1,38 @@
+/* Starts threads in this process and joins them, checking that
+   thread_join() returns each one's return value, that a thread
+   can be joined only once, and that joining the caller or a
+   thread that does not exist fails. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 3
+
+static char stacks[THREAD_CNT][4096] __attribute__ ((aligned (16)));
+
+/* Returns a value that depends on AUX, so that each thread's
+   result is distinct. */
+static int
+child (void *aux) 
+{
+  return 100 + (int) aux;
+}
+
+void
+test_main (void) 
+{
+  tid_t tids[THREAD_CNT];
+  int i;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      tids[i] = thread_create (child, (void *) i,
+                               stacks[i] + sizeof stacks[i]);
+      CHECK (tids[i] != TID_ERROR, "thread_create %d", i);
+    }
+  for (i = THREAD_CNT - 1; i >= 0; i--)
+    CHECK (thread_join (tids[i]) == 100 + i, "thread_join %d", i);
+  CHECK (thread_join (tids[0]) == -1, "joining thread 0 again fails");
+  CHECK (thread_join (0x0c020301) == -1, "joining a bogus tid fails");
+}
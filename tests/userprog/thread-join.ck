@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-join) begin
+(thread-join) thread_create 0
+(thread-join) thread_create 1
+(thread-join) thread_create 2
+(thread-join) thread_join 2
+(thread-join) thread_join 1
+(thread-join) thread_join 0
+(thread-join) joining thread 0 again fails
+(thread-join) joining a bogus tid fails
+(thread-join) end
+thread-join: exit(0)
+EOF
+pass;
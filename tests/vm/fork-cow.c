@@ -0,0 +1,62 @@
+/* Checks that fork() gives parent and child private copies of
+   memory that was shared copy-on-write at the fork.  The child
+   writes page A and the parent must still see its old contents;
+   the parent writes page B and the child must still see its old
+   contents.  A pipe makes the child wait for the parent's write
+   before it looks. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+
+static char page_a[PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+static char page_b[PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+
+/* Returns true if all SIZE bytes at BUF are C. */
+static bool
+all_bytes (const char *buf, size_t size, char c) 
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (buf[i] != c)
+      return false;
+  return true;
+}
+
+void
+test_main (void) 
+{
+  int fds[2];
+  pid_t child;
+  int status;
+
+  memset (page_a, 'a', sizeof page_a);
+  memset (page_b, 'b', sizeof page_b);
+  CHECK (pipe (fds), "pipe");
+
+  child = fork ();
+  if (child == 0)
+    {
+      char c;
+
+      memset (page_a, 'c', sizeof page_a);
+      if (read (fds[0], &c, 1) != 1)
+        exit (2);
+      exit (all_bytes (page_b, sizeof page_b, 'b')
+            && all_bytes (page_a, sizeof page_a, 'c') ? 0 : 1);
+    }
+  CHECK (child != PID_ERROR, "fork");
+
+  memset (page_b, 'p', sizeof page_b);
+  CHECK (write (fds[1], "x", 1) == 1, "write page B, then signal child");
+  status = wait (child);
+  CHECK (status == 0, "child sees its own copy of page B");
+  CHECK (all_bytes (page_a, sizeof page_a, 'a'),
+         "parent sees its own copy of page A");
+  CHECK (all_bytes (page_b, sizeof page_b, 'p'),
+         "parent sees its write to page B");
+}
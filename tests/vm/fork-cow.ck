@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-cow) begin
+(fork-cow) pipe
+(fork-cow) fork
+(fork-cow) write page B, then signal child
+fork-cow: exit(0)
+(fork-cow) child sees its own copy of page B
+(fork-cow) parent sees its own copy of page A
+(fork-cow) parent sees its write to page B
+(fork-cow) end
+fork-cow: exit(0)
+EOF
+pass;
@@ -0,0 +1,109 @@
+/* Allocates small and large blocks with the user malloc() until
+   the heap has grown several times, fills each block with its
+   own byte, and checks them all, so that blocks from every arena
+   and from both sides of each sbrk() boundary are read back.
+   Then frees them and checks that allocating the same sizes
+   again reuses the memory without growing the heap. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SMALL_CNT 256           /* Small blocks. */
+#define SMALL_SIZE 100          /* Bytes in each small block. */
+#define LARGE_CNT 4             /* Large blocks. */
+#define LARGE_SIZE 10000        /* Bytes in each large block. */
+
+static char *small[SMALL_CNT];
+static char *large[LARGE_CNT];
+
+/* Returns true if all SIZE bytes at BUF are C. */
+static bool
+all_bytes (const char *buf, size_t size, char c) 
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (buf[i] != c)
+      return false;
+  return true;
+}
+
+/* Allocates every block and fills it with its own byte. */
+static void
+allocate_all (void) 
+{
+  int i;
+
+  for (i = 0; i < SMALL_CNT; i++)
+    {
+      small[i] = malloc (SMALL_SIZE);
+      if (small[i] == NULL)
+        fail ("malloc small block %d", i);
+      memset (small[i], i, SMALL_SIZE);
+    }
+  for (i = 0; i < LARGE_CNT; i++)
+    {
+      large[i] = malloc (LARGE_SIZE);
+      if (large[i] == NULL)
+        fail ("malloc large block %d", i);
+      memset (large[i], 'A' + i, LARGE_SIZE);
+    }
+}
+
+/* Checks that every block still holds its own byte. */
+static void
+check_all (void) 
+{
+  int i;
+
+  for (i = 0; i < SMALL_CNT; i++)
+    if (!all_bytes (small[i], SMALL_SIZE, i))
+      fail ("small block %d was overwritten", i);
+  for (i = 0; i < LARGE_CNT; i++)
+    if (!all_bytes (large[i], LARGE_SIZE, 'A' + i))
+      fail ("large block %d was overwritten", i);
+}
+
+/* Frees every block. */
+static void
+free_all (void) 
+{
+  int i;
+
+  for (i = 0; i < SMALL_CNT; i++)
+    free (small[i]);
+  for (i = 0; i < LARGE_CNT; i++)
+    free (large[i]);
+}
+
+void
+test_main (void) 
+{
+  char *start, *brk;
+  char *p;
+
+  start = sbrk (0);
+  msg ("allocate");
+  allocate_all ();
+  brk = sbrk (0);
+  CHECK (brk - start > 8 * 4096, "heap grew past 8 pages");
+  msg ("check");
+  check_all ();
+
+  msg ("free and allocate again");
+  free_all ();
+  allocate_all ();
+  check_all ();
+  CHECK (sbrk (0) == brk, "heap did not grow");
+
+  CHECK ((p = calloc (3, 2000)) != NULL, "calloc");
+  CHECK (all_bytes (p, 6000, 0), "calloc memory is zeroed");
+  memset (p, 'z', 6000);
+  CHECK ((p = realloc (p, 20000)) != NULL, "realloc larger");
+  CHECK (all_bytes (p, 6000, 'z'), "realloc kept the contents");
+  free (p);
+  check_all ();
+}
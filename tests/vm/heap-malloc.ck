@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(heap-malloc) begin
+(heap-malloc) allocate
+(heap-malloc) heap grew past 8 pages
+(heap-malloc) check
+(heap-malloc) free and allocate again
+(heap-malloc) heap did not grow
+(heap-malloc) calloc
+(heap-malloc) calloc memory is zeroed
+(heap-malloc) realloc larger
+(heap-malloc) realloc kept the contents
+(heap-malloc) end
+heap-malloc: exit(0)
+EOF
+pass;
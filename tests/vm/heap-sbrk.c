@@ -0,0 +1,102 @@
+/* Grows the heap with sbrk() in two steps, checks that the new
+   memory reads as zeros, and moves data across the boundary
+   between the steps through write() and read().  Then shrinks
+   the heap, checks that what is left keeps its contents, that a
+   page given back is gone, and that pages grown again read as
+   zeros.  The heap must not shrink below where it started. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+
+/* Returns true if all SIZE bytes at BUF are zero. */
+static bool
+all_zero (const char *buf, size_t size) 
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (buf[i] != 0)
+      return false;
+  return true;
+}
+
+/* Returns the byte the pattern has at offset I. */
+static char
+pattern (size_t i) 
+{
+  return i % 251;
+}
+
+/* Returns true if the SIZE bytes at BUF hold the pattern. */
+static bool
+has_pattern (const char *buf, size_t size) 
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (buf[i] != pattern (i))
+      return false;
+  return true;
+}
+
+void
+test_main (void) 
+{
+  char *base, *second, *end;
+  size_t i;
+  pid_t child;
+  int fd;
+
+  base = sbrk (0);
+  CHECK (base != (void *) -1, "sbrk (0)");
+  CHECK (sbrk (2 * PAGE_SIZE + 100) == base, "grow by 2 pages and 100 bytes");
+  second = base + 2 * PAGE_SIZE + 100;
+  CHECK (sbrk (PAGE_SIZE) == second, "grow by another page");
+  end = second + PAGE_SIZE;
+  CHECK (sbrk (0) == end, "break is past both");
+  CHECK (all_zero (base, end - base), "new memory reads as zeros");
+
+  for (i = 0; i < (size_t) (end - base); i++)
+    base[i] = pattern (i);
+
+  /* Copy the 2 pages around the boundary out to a file and back
+     in over zeros. */
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (write (fd, second - PAGE_SIZE, 2 * PAGE_SIZE) == 2 * PAGE_SIZE,
+         "write across the boundary");
+  memset (second - PAGE_SIZE, 0, 2 * PAGE_SIZE);
+  seek (fd, 0);
+  CHECK (read (fd, second - PAGE_SIZE, 2 * PAGE_SIZE) == 2 * PAGE_SIZE,
+         "read across the boundary");
+  close (fd);
+  CHECK (has_pattern (base, end - base), "heap holds what was written");
+
+  CHECK (sbrk (-(2 * PAGE_SIZE)) == end, "shrink by 2 pages");
+  end -= 2 * PAGE_SIZE;
+  CHECK (sbrk (0) == end, "break moved down");
+  CHECK (has_pattern (base, end - base), "rest of heap is unchanged");
+
+  child = fork ();
+  if (child == 0)
+    {
+      volatile char *p = base + 2 * PAGE_SIZE;
+      msg ("child read %d past the break", *p);
+      exit (0);
+    }
+  CHECK (child > 0, "fork");
+  CHECK (wait (child) == -1, "child killed reading a freed page");
+
+  CHECK (sbrk (-(end - base) - 1) == (void *) -1,
+         "shrink below the start of the heap fails");
+  CHECK (sbrk (0) == end, "break did not move");
+
+  CHECK (sbrk (2 * PAGE_SIZE) == end, "grow by 2 pages again");
+  CHECK (all_zero (base + 2 * PAGE_SIZE, PAGE_SIZE),
+         "page grown again reads as zeros");
+  CHECK (has_pattern (base, end - base), "old part of heap is unchanged");
+}
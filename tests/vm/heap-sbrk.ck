@@ -0,0 +1,31 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(heap-sbrk) begin
+(heap-sbrk) sbrk (0)
+(heap-sbrk) grow by 2 pages and 100 bytes
+(heap-sbrk) grow by another page
+(heap-sbrk) break is past both
+(heap-sbrk) new memory reads as zeros
+(heap-sbrk) create "data"
+(heap-sbrk) open "data"
+(heap-sbrk) write across the boundary
+(heap-sbrk) read across the boundary
+(heap-sbrk) heap holds what was written
+(heap-sbrk) shrink by 2 pages
+(heap-sbrk) break moved down
+(heap-sbrk) rest of heap is unchanged
+heap-sbrk: exit(-1)
+(heap-sbrk) fork
+(heap-sbrk) child killed reading a freed page
+(heap-sbrk) shrink below the start of the heap fails
+(heap-sbrk) break did not move
+(heap-sbrk) grow by 2 pages again
+(heap-sbrk) page grown again reads as zeros
+(heap-sbrk) old part of heap is unchanged
+(heap-sbrk) end
+heap-sbrk: exit(0)
+EOF
+pass;
@@ -0,0 +1,71 @@
+/* Checks that madvise() refuses misaligned and kernel ranges and
+   unknown advice, and that after MADV_DONTNEED a clean anonymous
+   page reads back as zeros, a page modified since it came in
+   keeps its contents, and a page of a mapped file reads back
+   from the file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+
+static char clean[PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+static char dirty[PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+
+/* Returns true if all SIZE bytes at BUF are C. */
+static bool
+all_bytes (const char *buf, size_t size, char c) 
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (buf[i] != c)
+      return false;
+  return true;
+}
+
+void
+test_main (void) 
+{
+  char *actual = (char *) 0x10000000;
+  char *top = (char *) 0xc0000000 - PAGE_SIZE;
+  int handle;
+  mapid_t map;
+
+  CHECK (!madvise (clean + 1, PAGE_SIZE, MADV_DONTNEED),
+         "misaligned address is refused");
+  CHECK (!madvise ((char *) 0xc0000000, PAGE_SIZE, MADV_DONTNEED),
+         "kernel address is refused");
+  CHECK (!madvise (top, 2 * PAGE_SIZE, MADV_DONTNEED),
+         "range into the kernel is refused");
+  CHECK (!madvise (clean, PAGE_SIZE, 1), "unknown advice is refused");
+  CHECK (!madvise (clean, PAGE_SIZE, 99), "bad advice is refused");
+  CHECK (madvise (clean, PAGE_SIZE, MADV_NORMAL), "MADV_NORMAL");
+
+  CHECK (all_bytes (clean, PAGE_SIZE, 0), "clean page reads as zeros");
+  CHECK (madvise (clean, PAGE_SIZE, MADV_DONTNEED),
+         "MADV_DONTNEED on clean page");
+  CHECK (all_bytes (clean, PAGE_SIZE, 0), "clean page still reads as zeros");
+
+  memset (dirty, 'd', PAGE_SIZE);
+  CHECK (madvise (dirty, PAGE_SIZE, MADV_DONTNEED),
+         "MADV_DONTNEED on modified page");
+  CHECK (all_bytes (dirty, PAGE_SIZE, 'd'), "modified page kept its contents");
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, actual)) != MAP_FAILED, "mmap \"sample.txt\"");
+  CHECK (!memcmp (actual, sample, strlen (sample)), "mapping reads the file");
+  CHECK (madvise (actual, PAGE_SIZE, MADV_DONTNEED),
+         "MADV_DONTNEED on mapping");
+  CHECK (!memcmp (actual, sample, strlen (sample)),
+         "mapping reads the file again");
+  CHECK (madvise (actual, PAGE_SIZE, MADV_WILLNEED),
+         "MADV_WILLNEED on mapping");
+  CHECK (!memcmp (actual, sample, strlen (sample)),
+         "mapping still reads the file");
+  munmap (map);
+  close (handle);
+}
@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(madvise) begin
+(madvise) misaligned address is refused
+(madvise) kernel address is refused
+(madvise) range into the kernel is refused
+(madvise) unknown advice is refused
+(madvise) bad advice is refused
+(madvise) MADV_NORMAL
+(madvise) clean page reads as zeros
+(madvise) MADV_DONTNEED on clean page
+(madvise) clean page still reads as zeros
+(madvise) MADV_DONTNEED on modified page
+(madvise) modified page kept its contents
+(madvise) open "sample.txt"
+(madvise) mmap "sample.txt"
+(madvise) mapping reads the file
+(madvise) MADV_DONTNEED on mapping
+(madvise) mapping reads the file again
+(madvise) MADV_WILLNEED on mapping
+(madvise) mapping still reads the file
+(madvise) end
+madvise: exit(0)
+EOF
+pass;
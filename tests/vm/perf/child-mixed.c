@@ -0,0 +1,165 @@
+/* Child process for perf-mixed.
+   Does one round of each kind of work, checking every result:
+   writes files and looks them up by name again and again, reads
+   a file through a mapping, fills memory bigger than its share of
+   frames, and streams data from a forked child through a pipe. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/vm/perf/perf-mixed.h"
+
+static char file_buf[FILE_SIZE];
+static char read_buf[FILE_SIZE];
+static char memory[MEM_SIZE];
+static char pipe_buf[PIPE_WRITE];
+
+/* Fills FILE_BUF with the contents of file IDX of child
+   CHILD_IDX. */
+static void
+fill_file (int child_idx, int idx) 
+{
+  size_t i;
+
+  for (i = 0; i < FILE_SIZE; i++)
+    file_buf[i] = i * 7 + idx + child_idx * FILE_CNT;
+}
+
+/* Creates FILE_CNT files, opens each by name LOOKUP_PASSES times
+   to read it back, and removes them. */
+static void
+do_files (int child_idx) 
+{
+  char name[16];
+  int fd, i, pass;
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "mx%d-%d", child_idx, i);
+      fill_file (child_idx, i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+      CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+      if (write (fd, file_buf, FILE_SIZE) != FILE_SIZE)
+        fail ("write \"%s\" failed", name);
+      close (fd);
+    }
+  for (pass = 0; pass < LOOKUP_PASSES; pass++)
+    for (i = 0; i < FILE_CNT; i++)
+      {
+        snprintf (name, sizeof name, "mx%d-%d", child_idx, i);
+        fill_file (child_idx, i);
+        CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+        if (read (fd, read_buf, FILE_SIZE) != FILE_SIZE)
+          fail ("read \"%s\" failed", name);
+        compare_bytes (read_buf, file_buf, FILE_SIZE, 0, name);
+        close (fd);
+      }
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "mx%d-%d", child_idx, i);
+      CHECK (remove (name), "remove \"%s\"", name);
+    }
+}
+
+/* Maps MAP_FILE and checks its contents. */
+static void
+do_mmap (void) 
+{
+  char *map_addr = (char *) 0x10000000;
+  mapid_t map;
+  size_t ofs;
+  int fd;
+
+  CHECK ((fd = open (MAP_FILE)) > 1, "open \"%s\"", MAP_FILE);
+  CHECK ((map = mmap (fd, map_addr)) != MAP_FAILED, "mmap \"%s\"", MAP_FILE);
+  for (ofs = 0; ofs < MAP_SIZE; ofs++)
+    if (map_addr[ofs] != map_byte (ofs))
+      fail ("byte %zu of mapped \"%s\" is wrong", ofs, MAP_FILE);
+  munmap (map);
+  close (fd);
+}
+
+/* Fills MEMORY twice with a pattern, one word in 16, checking it
+   after each pass, so that its pages are swapped out and back. */
+static void
+do_memory (int child_idx) 
+{
+  size_t i;
+  int pass;
+
+  for (pass = 0; pass < 2; pass++)
+    {
+      for (i = 0; i < MEM_SIZE; i += 64)
+        memory[i] = i / 64 + child_idx + pass;
+      for (i = 0; i < MEM_SIZE; i += 64)
+        if (memory[i] != (char) (i / 64 + child_idx + pass))
+          fail ("memory byte %zu is wrong in pass %d", i, pass);
+    }
+}
+
+/* Returns the byte at offset OFS in the pipe stream. */
+static char
+pipe_byte (int ofs) 
+{
+  return ofs * 3 + ofs / PIPE_WRITE;
+}
+
+/* Forks a child that writes PIPE_BYTES into a pipe, and reads
+   and checks them. */
+static void
+do_pipe (void) 
+{
+  int fds[2];
+  int ofs, n, i;
+  pid_t pid;
+
+  CHECK (pipe (fds), "pipe");
+  pid = fork ();
+  if (pid == 0)
+    {
+      close (fds[0]);
+      for (ofs = 0; ofs < PIPE_BYTES; ofs += PIPE_WRITE)
+        {
+          for (i = 0; i < PIPE_WRITE; i++)
+            pipe_buf[i] = pipe_byte (ofs + i);
+          if (write (fds[1], pipe_buf, PIPE_WRITE) != PIPE_WRITE)
+            fail ("pipe write at %d failed", ofs);
+        }
+      close (fds[1]);
+      exit (0);
+    }
+  CHECK (pid != PID_ERROR, "fork");
+  close (fds[1]);
+
+  for (ofs = 0; (n = read (fds[0], pipe_buf, sizeof pipe_buf)) > 0;
+       ofs += n)
+    for (i = 0; i < n; i++)
+      if (pipe_buf[i] != pipe_byte (ofs + i))
+        fail ("pipe byte %d is wrong", ofs + i);
+  if (n < 0)
+    fail ("pipe read failed");
+  if (ofs != PIPE_BYTES)
+    fail ("read %d bytes from pipe, not %d", ofs, PIPE_BYTES);
+  CHECK (wait (pid) == 0, "wait for writer");
+  close (fds[0]);
+}
+
+int
+main (int argc, const char *argv[]) 
+{
+  int child_idx;
+
+  test_name = "child-mixed";
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+
+  do_files (child_idx);
+  do_mmap ();
+  do_memory (child_idx);
+  do_pipe ();
+  return child_idx;
+}
@@ -0,0 +1,50 @@
+/* Runs CHILD_CNT children at once, ROUNDS times over, each doing
+   a round of file, directory lookup, mmap, paging, and pipe work,
+   so that the scheduler, buffer cache, allocator, and virtual
+   memory are measured together under one load.  perf.pm turns
+   the time taken into a score and reports it with each
+   subsystem's statistics. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/vm/perf/perf-mixed.h"
+
+static char buf[MAP_SIZE];
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  struct rusage u;
+  int64_t start;
+  size_t ofs;
+  int fd, i;
+
+  for (ofs = 0; ofs < MAP_SIZE; ofs++)
+    buf[ofs] = map_byte (ofs);
+  CHECK (create (MAP_FILE, MAP_SIZE), "create \"%s\"", MAP_FILE);
+  CHECK ((fd = open (MAP_FILE)) > 1, "open \"%s\"", MAP_FILE);
+  CHECK (write (fd, buf, MAP_SIZE) == MAP_SIZE, "write \"%s\"", MAP_FILE);
+  close (fd);
+
+  start = clock_ticks ();
+  for (i = 0; i < ROUNDS; i++)
+    {
+      exec_children ("child-mixed", children, CHILD_CNT);
+      wait_children (children, CHILD_CNT);
+    }
+  msg ("%d rounds in %lld ticks", ROUNDS * CHILD_CNT, clock_ticks () - start);
+
+  /* The children have all been waited for, and so have the ones
+     they forked, so the children's totals cover the whole load. */
+  CHECK (getrusage (RUSAGE_CHILDREN, &u), "getrusage");
+  msg ("children: %u minor faults, %u major, %u kB peak resident",
+       u.minor_faults, u.major_faults, u.rss_max * 4);
+  msg ("children: %llu bytes read, %llu written, "
+       "%llu sectors read, %llu written",
+       u.read_bytes, u.write_bytes, u.read_sectors, u.write_sectors);
+  msg ("children: %lld user ticks, %lld kernel",
+       u.user_ticks, u.kernel_ticks);
+  CHECK (remove (MAP_FILE), "remove \"%s\"", MAP_FILE);
+}
@@ -0,0 +1,36 @@
+#ifndef TESTS_VM_PERF_PERF_MIXED_H
+#define TESTS_VM_PERF_PERF_MIXED_H
+
+#include <stddef.h>
+
+/* Children running at once, and the number of rounds of them
+   that perf-mixed starts. */
+#define CHILD_CNT 4
+#define ROUNDS 3
+
+/* Files each child creates, their size, and how many times it
+   looks each one up by name and reads it back. */
+#define FILE_CNT 8
+#define FILE_SIZE 4096
+#define LOOKUP_PASSES 4
+
+/* File that perf-mixed creates for the children to map. */
+#define MAP_FILE "mixed.dat"
+#define MAP_SIZE (16 * 1024)
+
+/* Memory each child fills and checks, with user memory limited
+   so that the children page against swap. */
+#define MEM_SIZE (256 * 1024)
+
+/* Bytes each child passes through a pipe, and per write. */
+#define PIPE_BYTES (32 * 1024)
+#define PIPE_WRITE 512
+
+/* Returns the byte at offset OFS in MAP_FILE. */
+static inline char
+map_byte (size_t ofs) 
+{
+  return ofs * 13 + ofs / 4096;
+}
+
+#endif /* tests/vm/perf/perf-mixed.h */
@@ -0,0 +1,67 @@
+# -*- perl -*-
+
+# Checks that the mixed workload ran to completion and scores it.
+#
+# The score is rounds of child work per second, timed by the test
+# itself from the clock page.  The "stats" action that follows
+# the run dumps the kernel's statistics registry as KEY=VALUE
+# lines; they are reported by subsystem, leaving out histogram
+# buckets.  All of them, with the score, are also written to
+# $test.stats, one KEY=VALUE per line in sorted order, so that
+# two runs can be compared with diff.  The report goes to the
+# terminal, not the result file, as for the other perf tests.
+
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+
+sub check_mixed {
+    my (@output) = read_text_file ("$test.output");
+
+    common_checks ("run", @output);
+
+    my ($name) = $test =~ m|([^/]+)$|;
+    my (@core) = get_core_output ("run", @output);
+    fail "missing end in output"
+      unless grep ($_ eq "($name) end", @core);
+
+    my ($rounds, $ticks);
+    for (@core) {
+	($rounds, $ticks) = /^\(\Q$name\E\) (\d+) rounds in (\d+) ticks$/
+	  if /rounds in/;
+    }
+    fail "missing timing in output" unless defined $ticks;
+
+    my (%stats);
+    for (@output) {
+	$stats{$1} = $2 if /^([^=\s]+)=(\d+)$/;
+    }
+    fail "missing statistics registry in output" unless %stats;
+
+    # The timer runs at 100 Hz.
+    my ($score) = $rounds / (($ticks > 0 ? $ticks : 1) / 100);
+    my (@report) = (sprintf ("%s: %.2f rounds/s (%d rounds in %d ticks)",
+			     $name, $score, $rounds, $ticks));
+
+    my (%subsys);
+    for my $key (sort keys %stats) {
+	next if $key =~ /\.\d+$/;
+	my ($sub) = $key =~ /^([^.]+)\./;
+	push (@{$subsys{$sub}}, substr ($key, length ($sub) + 1)
+	      . "=$stats{$key}") if defined $sub;
+    }
+    push (@report, "  $_: " . join (' ', @{$subsys{$_}}))
+      foreach sort keys %subsys;
+
+    open (STATS, '>', "$test.stats") or die "$test.stats: create: $!\n";
+    printf STATS "score=%.2f\n", $score;
+    print STATS "$_=$stats{$_}\n" foreach sort keys %stats;
+    close (STATS);
+
+    print STDOUT "$_\n" foreach @report;
+    pass;
+}
+
+1;
@@ -0,0 +1,190 @@
+#include "threads/copy.h"
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/cpu.h"
+#include "threads/fpu.h"
+#include "threads/vaddr.h"
+
+/* True if block_copy() and block_zero() use SSE2. */
+static bool use_sse2;
+
+/* Chooses the SSE2 routines if the CPU has SSE2 and fpu_init()
+   enabled the FPU. */
+void
+copy_init (void) 
+{
+  uint32_t a, b, c, d;
+
+  cpuid (1, &a, &b, &c, &d);
+  use_sse2 = fpu_available () && (d & CPUID_SSE2) != 0;
+}
+
+/* Returns true if the SSE2 routines may be used. */
+bool
+copy_has_sse2 (void) 
+{
+  return use_sse2;
+}
+
+/* Returns true if a block of SIZE bytes at DST and SRC suits the
+   SSE2 routines. */
+static inline bool
+sse2_ok (const void *dst, const void *src, size_t size) 
+{
+  return (use_sse2
+          && size >= BLOCK_SSE_MIN
+          && size % 64 == 0
+          && (((uintptr_t) dst | (uintptr_t) src) & 15) == 0);
+}
+
+/* Copies SIZE bytes from SRC to DST, which must not overlap. */
+void
+block_copy (void *dst, const void *src, size_t size) 
+{
+  if (sse2_ok (dst, src, size))
+    block_copy_sse2 (dst, src, size);
+  else
+    memcpy (dst, src, size);
+}
+
+/* Sets the SIZE bytes at DST to zero. */
+void
+block_zero (void *dst, size_t size) 
+{
+  if (sse2_ok (dst, dst, size))
+    block_zero_sse2 (dst, size);
+  else
+    memset (dst, 0, size);
+}
+
+/* Copies SIZE bytes from SRC to DST with the general-purpose
+   registers. */
+void
+block_copy_scalar (void *dst, const void *src, size_t size) 
+{
+  memcpy (dst, src, size);
+}
+
+/* Zeros SIZE bytes at DST with the general-purpose registers. */
+void
+block_zero_scalar (void *dst, size_t size) 
+{
+  memset (dst, 0, size);
+}
+
+/* Interrupts stay off between kernel_fpu_begin() and
+   kernel_fpu_end(), so the SSE2 routines give them a chance to
+   arrive after every chunk of this many bytes. */
+#define CHUNK_SIZE PGSIZE
+
+/* Copies SIZE bytes from SRC to DST through xmm0 to xmm3, with
+   non-temporal stores if NT is true. */
+static void
+copy_chunk (uint8_t *dst, const uint8_t *src, size_t size, bool nt) 
+{
+  struct kernel_fpu f;
+
+  kernel_fpu_begin (&f);
+  if (nt)
+    for (; size > 0; size -= 64, dst += 64, src += 64)
+      asm volatile ("movdqa 0(%1), %%xmm0\n\t"
+                    "movdqa 16(%1), %%xmm1\n\t"
+                    "movdqa 32(%1), %%xmm2\n\t"
+                    "movdqa 48(%1), %%xmm3\n\t"
+                    "movntdq %%xmm0, 0(%0)\n\t"
+                    "movntdq %%xmm1, 16(%0)\n\t"
+                    "movntdq %%xmm2, 32(%0)\n\t"
+                    "movntdq %%xmm3, 48(%0)"
+                    : : "r" (dst), "r" (src) : "memory");
+  else
+    for (; size > 0; size -= 64, dst += 64, src += 64)
+      asm volatile ("movdqa 0(%1), %%xmm0\n\t"
+                    "movdqa 16(%1), %%xmm1\n\t"
+                    "movdqa 32(%1), %%xmm2\n\t"
+                    "movdqa 48(%1), %%xmm3\n\t"
+                    "movdqa %%xmm0, 0(%0)\n\t"
+                    "movdqa %%xmm1, 16(%0)\n\t"
+                    "movdqa %%xmm2, 32(%0)\n\t"
+                    "movdqa %%xmm3, 48(%0)"
+                    : : "r" (dst), "r" (src) : "memory");
+  kernel_fpu_end (&f);
+}
+
+/* Zeros SIZE bytes at DST from xmm0, with non-temporal stores if
+   NT is true. */
+static void
+zero_chunk (uint8_t *dst, size_t size, bool nt) 
+{
+  struct kernel_fpu f;
+
+  kernel_fpu_begin (&f);
+  asm volatile ("pxor %%xmm0, %%xmm0" : : : "memory");
+  if (nt)
+    for (; size > 0; size -= 64, dst += 64)
+      asm volatile ("movntdq %%xmm0, 0(%0)\n\t"
+                    "movntdq %%xmm0, 16(%0)\n\t"
+                    "movntdq %%xmm0, 32(%0)\n\t"
+                    "movntdq %%xmm0, 48(%0)"
+                    : : "r" (dst) : "memory");
+  else
+    for (; size > 0; size -= 64, dst += 64)
+      asm volatile ("movdqa %%xmm0, 0(%0)\n\t"
+                    "movdqa %%xmm0, 16(%0)\n\t"
+                    "movdqa %%xmm0, 32(%0)\n\t"
+                    "movdqa %%xmm0, 48(%0)"
+                    : : "r" (dst) : "memory");
+  kernel_fpu_end (&f);
+}
+
+/* Copies SIZE bytes from SRC to DST 64 bytes at a time with
+   SSE2.  DST and SRC must be 16-byte aligned and SIZE a multiple
+   of 64.  See [IA32-v2a] "MOVDQA" and [IA32-v2b] "MOVNTDQ". */
+void
+block_copy_sse2 (void *dst_, const void *src_, size_t size) 
+{
+  uint8_t *dst = dst_;
+  const uint8_t *src = src_;
+  bool nt = size >= BLOCK_NT_MIN;
+
+  ASSERT (use_sse2);
+  ASSERT ((((uintptr_t) dst | (uintptr_t) src) & 15) == 0);
+  ASSERT (size % 64 == 0);
+
+  while (size > 0)
+    {
+      size_t chunk = size < CHUNK_SIZE ? size : CHUNK_SIZE;
+      copy_chunk (dst, src, chunk, nt);
+      dst += chunk;
+      src += chunk;
+      size -= chunk;
+    }
+
+  /* Non-temporal stores are weakly ordered; make them visible
+     before anything that follows. */
+  if (nt)
+    asm volatile ("sfence" : : : "memory");
+}
+
+/* Zeros SIZE bytes at DST 64 bytes at a time with SSE2.  DST
+   must be 16-byte aligned and SIZE a multiple of 64. */
+void
+block_zero_sse2 (void *dst_, size_t size) 
+{
+  uint8_t *dst = dst_;
+  bool nt = size >= BLOCK_NT_MIN;
+
+  ASSERT (use_sse2);
+  ASSERT (((uintptr_t) dst & 15) == 0);
+  ASSERT (size % 64 == 0);
+
+  while (size > 0)
+    {
+      size_t chunk = size < CHUNK_SIZE ? size : CHUNK_SIZE;
+      zero_chunk (dst, chunk, nt);
+      dst += chunk;
+      size -= chunk;
+    }
+  if (nt)
+    asm volatile ("sfence" : : : "memory");
+}
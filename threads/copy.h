@@ -0,0 +1,38 @@
+#ifndef THREADS_COPY_H
+#define THREADS_COPY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Page- and sector-sized copies and clears.
+
+   block_copy() and block_zero() behave like memcpy() and
+   memset(..., 0, ...), but aligned blocks of at least
+   BLOCK_SSE_MIN bytes go through the 128-bit SSE2 registers if
+   copy_init() found SSE2 at boot.  Blocks of BLOCK_NT_MIN bytes
+   or more, such as whole pages, are written with non-temporal
+   stores that bypass the cache, since a page just cleared or
+   copied is seldom read again before the cache would evict it
+   anyway.
+
+   The _scalar and _sse2 variants are exported for
+   benchmarking. */
+
+/* Smallest block worth the cost of kernel_fpu_begin(). */
+#define BLOCK_SSE_MIN 512
+
+/* Smallest block written with non-temporal stores. */
+#define BLOCK_NT_MIN 4096
+
+void copy_init (void);
+bool copy_has_sse2 (void);
+
+void block_copy (void *dst, const void *src, size_t size);
+void block_zero (void *dst, size_t size);
+
+void block_copy_scalar (void *dst, const void *src, size_t size);
+void block_zero_scalar (void *dst, size_t size);
+void block_copy_sse2 (void *dst, const void *src, size_t size);
+void block_zero_sse2 (void *dst, size_t size);
+
+#endif /* threads/copy.h */
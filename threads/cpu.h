@@ -0,0 +1,75 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <stdint.h>
+
+/* Returns the processor's time-stamp counter, which counts CPU
+   cycles since reset.  Cheap enough to read on every context
+   switch.  See [IA32-v2b] "RDTSC". */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Executes CPUID with EAX = LEAF and returns the four result
+   registers through the pointers.  See [IA32-v2a] "CPUID". */
+static inline void
+cpuid (uint32_t leaf, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d)
+{
+  asm volatile ("cpuid" : "=a" (*a), "=b" (*b), "=c" (*c), "=d" (*d)
+                : "a" (leaf));
+}
+
+/* Returns model-specific register MSR.  See [IA32-v2b] "RDMSR". */
+static inline uint64_t
+rdmsr (uint32_t msr)
+{
+  uint64_t value;
+  asm volatile ("rdmsr" : "=A" (value) : "c" (msr));
+  return value;
+}
+
+/* Sets model-specific register MSR to VALUE.  See [IA32-v2b]
+   "WRMSR". */
+static inline void
+wrmsr (uint32_t msr, uint64_t value)
+{
+  asm volatile ("wrmsr" : : "c" (msr), "A" (value));
+}
+
+/* Returns performance-monitoring counter IDX.  See [IA32-v2b]
+   "RDPMC". */
+static inline uint64_t
+rdpmc (uint32_t idx)
+{
+  uint64_t value;
+  asm volatile ("rdpmc" : "=A" (value) : "c" (idx));
+  return value;
+}
+
+/* CPUID leaf 1 EDX feature bits. */
+#define CPUID_PSE (1u << 3)     /* Page size extensions: 4 MB pages. */
+#define CPUID_TSC (1u << 4)     /* Time-stamp counter: RDTSC. */
+#define CPUID_APIC (1u << 9)    /* On-chip local APIC. */
+#define CPUID_FXSR (1u << 24)   /* FXSAVE and FXRSTOR. */
+#define CPUID_SSE (1u << 25)    /* Streaming SIMD extensions. */
+#define CPUID_SSE2 (1u << 26)   /* SSE2: 128-bit integer operations. */
+
+/* CPUID leaf 1 ECX feature bits. */
+#define CPUID_TSC_DEADLINE (1u << 24) /* Local APIC TSC-deadline mode. */
+
+/* CR0 bits. */
+#define CR0_MP (1u << 1)        /* WAIT honors TS. */
+#define CR0_EM (1u << 2)        /* (Floating-point) Emulation. */
+#define CR0_TS (1u << 3)        /* Task switched: FPU use traps. */
+#define CR0_NE (1u << 5)        /* Report x87 errors as #MF. */
+
+/* CR4 bits. */
+#define CR4_PSE (1u << 4)       /* Enable 4 MB pages. */
+#define CR4_OSFXSR (1u << 9)    /* OS saves SSE state with FXSAVE. */
+#define CR4_OSXMMEXCPT (1u << 10) /* OS handles #XF. */
+
+#endif /* threads/cpu.h */
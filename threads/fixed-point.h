@@ -0,0 +1,94 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Signed 17.14 fixed-point arithmetic, as used by the
+   multi-level feedback queue scheduler.
+
+   A fixed-point number is an ordinary int whose low FP_Q bits
+   hold the fraction, so it covers roughly +/-131,071.99 with a
+   resolution of 1/16,384.  Everything here is integer math, so
+   it is safe to use from the timer interrupt, where the kernel
+   must never touch the floating-point unit.
+
+   Functions with an "_int" suffix take an integer second
+   operand; the others take two fixed-point operands. */
+typedef int fixed_t;
+
+#define FP_Q 14                         /* Number of fraction bits. */
+#define FP_F (1 << FP_Q)                /* Fixed-point 1.0. */
+
+/* Converts integer N to fixed point. */
+static inline fixed_t
+fp_from_int (int n)
+{
+  return n * FP_F;
+}
+
+/* Converts X to an integer, rounding toward zero. */
+static inline int
+fp_to_int (fixed_t x)
+{
+  return x / FP_F;
+}
+
+/* Converts X to an integer, rounding to nearest. */
+static inline int
+fp_round (fixed_t x)
+{
+  return x >= 0 ? (x + FP_F / 2) / FP_F : (x - FP_F / 2) / FP_F;
+}
+
+static inline fixed_t
+fp_add (fixed_t x, fixed_t y)
+{
+  return x + y;
+}
+
+static inline fixed_t
+fp_sub (fixed_t x, fixed_t y)
+{
+  return x - y;
+}
+
+static inline fixed_t
+fp_add_int (fixed_t x, int n)
+{
+  return x + n * FP_F;
+}
+
+static inline fixed_t
+fp_sub_int (fixed_t x, int n)
+{
+  return x - n * FP_F;
+}
+
+/* Multiplies X by Y.  The intermediate product is 64 bits wide
+   so that it cannot overflow. */
+static inline fixed_t
+fp_mul (fixed_t x, fixed_t y)
+{
+  return ((int64_t) x) * y / FP_F;
+}
+
+static inline fixed_t
+fp_mul_int (fixed_t x, int n)
+{
+  return x * n;
+}
+
+/* Divides X by Y, which must be nonzero. */
+static inline fixed_t
+fp_div (fixed_t x, fixed_t y)
+{
+  return ((int64_t) x) * FP_F / y;
+}
+
+static inline fixed_t
+fp_div_int (fixed_t x, int n)
+{
+  return x / n;
+}
+
+#endif /* threads/fixed-point.h */
@@ -0,0 +1,249 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
+
+/* Size and alignment of an FXSAVE area.  See [IA32-v2a]
+   "FXSAVE". */
+#define FPU_STATE_SIZE 512
+#define FPU_STATE_ALIGN 16
+
+/* True if the CPU has FXSAVE, so that the FPU is enabled. */
+static bool enabled;
+
+/* Save areas for threads that have used the FPU. */
+static struct kmem_cache *state_cache;
+
+/* State a thread starts with: FNINIT's, with SSE exceptions
+   masked. */
+static uint8_t initial_state[FPU_STATE_SIZE]
+  __attribute__ ((aligned (FPU_STATE_ALIGN)));
+
+/* Thread whose state is in the FPU registers, or NULL if it
+   exited.  Its save area is stale until fpu_trap() or
+   fpu_fork() saves into it. */
+static struct thread *owner;
+
+/* True if CR0.TS is clear, so FPU instructions do not trap. */
+static bool ts_clear;
+
+static inline void
+fxsave (void *area) 
+{
+  asm volatile ("fxsave %0" : "=m" (*(uint8_t (*)[FPU_STATE_SIZE]) area));
+}
+
+static inline void
+fxrstor (const void *area) 
+{
+  asm volatile ("fxrstor %0"
+                : : "m" (*(const uint8_t (*)[FPU_STATE_SIZE]) area));
+}
+
+/* Clears CR0.TS.  See [IA32-v2a] "CLTS". */
+static inline void
+clts (void) 
+{
+  asm volatile ("clts" : : : "memory");
+  ts_clear = true;
+}
+
+/* Sets CR0.TS, so that the next FPU instruction raises #NM. */
+static inline void
+stts (void) 
+{
+  uint32_t cr0;
+
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0 | CR0_TS) : "memory");
+  ts_clear = false;
+}
+
+/* Enables the FPU, and SSE if the CPU has it, if the CPU can
+   save their state with FXSAVE.  start.S leaves CR0.EM set,
+   which keeps the FPU off otherwise. */
+void
+fpu_init (void) 
+{
+  uint32_t a, b, c, d, cr0, cr4;
+
+  cpuid (1, &a, &b, &c, &d);
+  if ((d & CPUID_FXSR) == 0)
+    return;
+  state_cache = kmem_cache_create ("fpu", FPU_STATE_SIZE,
+                                   FPU_STATE_ALIGN, NULL);
+  if (state_cache == NULL)
+    return;
+
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  cr4 |= CR4_OSFXSR;
+  if (d & CPUID_SSE)
+    cr4 |= CR4_OSXMMEXCPT;
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  cr0 = (cr0 & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE;
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0) : "memory");
+
+  /* Capture the state new threads start with.  MXCSR is not
+     reset by FNINIT, so set its power-up value, which masks all
+     SSE exceptions. */
+  asm volatile ("fninit");
+  if (d & CPUID_SSE)
+    {
+      uint32_t mxcsr = 0x1f80;
+      asm volatile ("ldmxcsr %0" : : "m" (mxcsr));
+    }
+  fxsave (initial_state);
+  stts ();
+  enabled = true;
+}
+
+/* Returns true if user programs may use the FPU. */
+bool
+fpu_available (void) 
+{
+  return enabled;
+}
+
+/* Arranges for NEXT, which is about to run, to trap on its first
+   FPU instruction unless its state is already in the registers.
+   Called by the scheduler with interrupts off. */
+void
+fpu_switch (struct thread *next) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (!enabled)
+    return;
+
+  if (next == owner)
+    {
+      if (!ts_clear)
+        clts ();
+    }
+  else if (ts_clear)
+    stts ();
+}
+
+/* Handles #NM in the running thread: saves the previous owner's
+   state, loads the running thread's, allocating it on first use,
+   and lets FPU instructions run.  Returns false if the FPU is
+   disabled or no memory is left for the save area. */
+bool
+fpu_trap (void) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  if (!enabled)
+    return false;
+  if (cur->fpu_state == NULL)
+    {
+      void *state = kmem_cache_alloc (state_cache);
+      if (state == NULL)
+        return false;
+      memcpy (state, initial_state, FPU_STATE_SIZE);
+      cur->fpu_state = state;
+    }
+
+  old_level = intr_disable ();
+  clts ();
+  if (owner != cur)
+    {
+      if (owner != NULL)
+        fxsave (owner->fpu_state);
+      fxrstor (cur->fpu_state);
+      owner = cur;
+    }
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Gives the running thread, the child of a fork, a copy of
+   PARENT's FPU state, if PARENT has used the FPU.  PARENT must
+   be blocked.  Returns false if out of memory. */
+bool
+fpu_fork (struct thread *parent) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  void *state;
+
+  if (parent->fpu_state == NULL)
+    return true;
+  state = kmem_cache_alloc (state_cache);
+  if (state == NULL)
+    return false;
+
+  old_level = intr_disable ();
+  if (owner == parent)
+    {
+      /* The parent's state is live in the registers.  Save it
+         straight into the copy; the parent still owns them. */
+      clts ();
+      fxsave (state);
+      stts ();
+    }
+  else
+    memcpy (state, parent->fpu_state, FPU_STATE_SIZE);
+  cur->fpu_state = state;
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Frees T's save area, if any.  Called as T exits. */
+void
+fpu_release (struct thread *t) 
+{
+  enum intr_level old_level;
+
+  if (t->fpu_state == NULL)
+    return;
+  old_level = intr_disable ();
+  if (owner == t)
+    owner = NULL;
+  intr_set_level (old_level);
+  kmem_cache_free (state_cache, t->fpu_state);
+  t->fpu_state = NULL;
+}
+
+/* Lets kernel code use xmm0 through xmm3 until the matching
+   kernel_fpu_end(), saving their contents in F.  Interrupts are
+   off in between, so the code must not sleep or nest, but no
+   thread loses its state: only the borrowed registers are
+   saved, not the whole FXSAVE area, so a user thread that owns
+   the FPU keeps it without another #NM.  The FPU must be
+   enabled. */
+void
+kernel_fpu_begin (struct kernel_fpu *f) 
+{
+  ASSERT (enabled);
+
+  f->old_level = intr_disable ();
+  f->set_ts = !ts_clear;
+  if (f->set_ts)
+    clts ();
+  asm volatile ("movdqu %%xmm0, 0(%0)\n\t"
+                "movdqu %%xmm1, 16(%0)\n\t"
+                "movdqu %%xmm2, 32(%0)\n\t"
+                "movdqu %%xmm3, 48(%0)"
+                : : "r" (f->xmm) : "memory");
+}
+
+/* Gives back the registers that kernel_fpu_begin() saved in F. */
+void
+kernel_fpu_end (struct kernel_fpu *f) 
+{
+  asm volatile ("movdqu 0(%0), %%xmm0\n\t"
+                "movdqu 16(%0), %%xmm1\n\t"
+                "movdqu 32(%0), %%xmm2\n\t"
+                "movdqu 48(%0), %%xmm3"
+                : : "r" (f->xmm) : "memory");
+  if (f->set_ts)
+    stts ();
+  intr_set_level (f->old_level);
+}
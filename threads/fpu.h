@@ -0,0 +1,51 @@
+#ifndef THREADS_FPU_H
+#define THREADS_FPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+
+/* Lazy floating-point and SSE context switching.
+
+   switch_threads() saves only the integer registers.  Rather
+   than also saving the 512-byte FPU and SSE state on every
+   switch, the scheduler sets CR0.TS whenever the thread it
+   switches to does not own the registers' current contents.
+   The first FPU or SSE instruction that thread executes then
+   raises #NM ("device not available"), and fpu_trap() saves the
+   owner's state, loads the running thread's, and clears TS.  A
+   thread that never touches the FPU never pays for it and never
+   gets a save area.
+
+   The kernel itself is compiled with -msoft-float, so it uses
+   the vector registers only between kernel_fpu_begin() and
+   kernel_fpu_end(), which save and restore the registers it
+   borrows around code that must not sleep.  CPUs without FXSAVE
+   keep CR0.EM set, so the FPU stays disabled and floating-point
+   instructions kill the process, as before. */
+
+struct thread;
+
+/* XMM registers, xmm0 through xmm3, that kernel code may use
+   between kernel_fpu_begin() and kernel_fpu_end(). */
+#define KERNEL_XMM_CNT 4
+
+/* What kernel_fpu_begin() saves for kernel_fpu_end(). */
+struct kernel_fpu
+  {
+    uint8_t xmm[KERNEL_XMM_CNT][16];    /* Borrowed registers. */
+    enum intr_level old_level;          /* Interrupt level to restore. */
+    bool set_ts;                        /* Set CR0.TS again at the end? */
+  };
+
+void fpu_init (void);
+bool fpu_available (void);
+void fpu_switch (struct thread *next);
+bool fpu_trap (void);
+bool fpu_fork (struct thread *parent);
+void fpu_release (struct thread *);
+
+void kernel_fpu_begin (struct kernel_fpu *);
+void kernel_fpu_end (struct kernel_fpu *);
+
+#endif /* threads/fpu.h */
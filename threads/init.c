@@ -10,55 +10,120 @@
 #include <string.h>
 #include "devices/kbd.h"
 #include "devices/input.h"
+#include "devices/pci.h"
+#include "devices/pmc.h"
 #include "devices/serial.h"
 #include "devices/shutdown.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/copy.h"
+#include "threads/cpu.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/profile.h"
 #include "threads/pte.h"
+#include "threads/stats.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
+#include "userprog/aio.h"
 #include "userprog/exception.h"
+#include "userprog/futex.h"
 #include "userprog/gdt.h"
+#include "userprog/pagedir.h"
+#include "userprog/shm.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/merge.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
 #else
 #include "tests/threads/tests.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
+#include "devices/virtio-blk.h"
+#include "filesys/defrag.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
+size_t init_large_pages;
+
+/* -nopse: Map physical memory with 4 kB pages only? */
+static bool no_pse;
 
 #ifdef FILESYS
 /* -f: Format the file system? */
 static bool format_filesys;
 
+/* -journal: Format the file system with a metadata journal? */
+static bool journal_filesys;
+
+/* -defrag: Compact files in the background? */
+static bool defrag_filesys;
+
+/* -memfs: Keep the file system in memory only? */
+static bool memory_filesys;
+
+/* -ramdisk: Size of the RAM disk in sectors, or 0 for none. */
+static block_sector_t ramdisk_size;
+
 /* -filesys, -scratch, -swap: Names of block devices to use,
    overriding the defaults. */
 static const char *filesys_bdev_name;
 static const char *scratch_bdev_name;
 #ifdef VM
 static const char *swap_bdev_name;
+
+/* -ksm: Merge identical user pages? */
+static bool merge_pages;
 #endif
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+/* -bootprof: Print how long each phase of booting took?
+
+   Phases are timed with the TSC from the start of main(), if the
+   CPU has one.  Otherwise there is no clock until timer_init(),
+   and phases before it go untimed.  Times are converted to
+   nanoseconds only at the end, once timer_calibrate() knows the
+   TSC's rate. */
+static bool boot_profile;
+#define BOOT_PHASE_MAX 24
+struct boot_phase
+  {
+    const char *name;           /* Phase name. */
+    uint64_t end;               /* boot_clock() at its end. */
+  };
+static struct boot_phase boot_phases[BOOT_PHASE_MAX];
+static size_t boot_phase_cnt;
+static uint64_t boot_start;     /* boot_clock() on entry to main(). */
+static bool boot_has_tsc;       /* Does the CPU have a TSC? */
+static bool boot_timer_up;      /* Has timer_init() run? */
+
 static void bss_init (void);
 static void paging_init (void);
+static uint64_t boot_clock (void);
+static void boot_phase (const char *name);
+static void print_boot_profile (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -77,18 +142,24 @@ int
 main (void)
 {
   char **argv;
+  uint32_t a, b, c, d;
 
   /* Clear BSS. */  
   bss_init ();
+  cpuid (1, &a, &b, &c, &d);
+  boot_has_tsc = (d & CPUID_TSC) != 0;
+  boot_start = boot_clock ();
 
   /* Break command line into arguments and parse options. */
   argv = read_command_line ();
   argv = parse_options (argv);
+  boot_phase ("command line");
 
   /* Initialize ourselves as a thread so we can use locks,
      then enable console locking. */
   thread_init ();
   console_init ();  
+  boot_phase ("thread, console");
 
   /* Greet user. */
   printf ("Pintos booting with %'"PRIu32" kB RAM...\n",
@@ -96,8 +167,11 @@ main (void)
 
   /* Initialize memory system. */
   palloc_init (user_page_limit);
+  boot_phase ("palloc");
   malloc_init ();
   paging_init ();
+  trace_init ();
+  boot_phase ("malloc, paging");
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -108,26 +182,69 @@ main (void)
   /* Initialize interrupt handlers. */
   intr_init ();
   timer_init ();
+  boot_timer_up = true;
   kbd_init ();
   input_init ();
+  boot_phase ("interrupts");
 #ifdef USERPROG
   exception_init ();
   syscall_init ();
+  process_init ();
+  pagedir_init ();
+  futex_init ();
+  shm_init ();
+  aio_init ();
+  boot_phase ("userprog");
 #endif
+#ifdef VM
+  frame_init ();
+  page_init ();
+  mmap_init ();
+  boot_phase ("vm");
+#endif
+
+  /* Find the devices on the PCI bus. */
+  pci_init ();
+  boot_phase ("pci");
+
+  /* Start counting hardware events and enable the FPU and
+     vector copies, if the CPU can. */
+  pmc_init ();
+  fpu_init ();
+  copy_init ();
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  workqueue_init ();
   serial_init_queue ();
+  boot_phase ("scheduler");
   timer_calibrate ();
+  boot_phase ("timer calibration");
 
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  virtio_blk_init ();
+  if (ramdisk_size > 0)
+    ramdisk_init (ramdisk_size);
   locate_block_devices ();
-  filesys_init (format_filesys);
+  boot_phase ("disks");
+  filesys_init (format_filesys, journal_filesys, memory_filesys);
+  boot_phase ("file system");
+#ifdef VM
+  swap_init ();
+  frame_start_pager ();
+  if (merge_pages)
+    merge_start ();
+  boot_phase ("swap");
+#endif
+  if (defrag_filesys)
+    defrag_start ();
 #endif
 
   printf ("Boot complete.\n");
+  if (boot_profile)
+    print_boot_profile ();
   
   /* Run actions specified on kernel command line. */
   run_actions (argv);
@@ -137,6 +254,51 @@ main (void)
   thread_exit ();
 }
 
+/* Returns the time for the boot profile, in timer_cycles()
+   units, or 0 if there is no clock yet. */
+static uint64_t
+boot_clock (void) 
+{
+  if (boot_has_tsc)
+    return rdtsc ();
+  return boot_timer_up ? timer_cycles () : 0;
+}
+
+/* Records that the boot phase NAME has just ended. */
+static void
+boot_phase (const char *name) 
+{
+  if (boot_phase_cnt < BOOT_PHASE_MAX)
+    {
+      boot_phases[boot_phase_cnt].name = name;
+      boot_phases[boot_phase_cnt].end = boot_clock ();
+      boot_phase_cnt++;
+    }
+}
+
+/* Prints how long each boot phase took. */
+static void
+print_boot_profile (void) 
+{
+  uint64_t start = boot_start;
+  size_t i;
+
+  for (i = 0; i < boot_phase_cnt; i++) 
+    {
+      const struct boot_phase *p = &boot_phases[i];
+
+      if (start != 0 && p->end != 0)
+        printf ("Boot: %-20s %'10"PRIu64" us\n", p->name,
+                timer_cycles_to_ns (p->end - start) / 1000);
+      else
+        printf ("Boot: %-20s %10s\n", p->name, "untimed");
+      start = p->end;
+    }
+  if (boot_start != 0)
+    printf ("Boot: %-20s %'10"PRIu64" us\n", "total",
+            timer_cycles_to_ns (boot_clock () - boot_start) / 1000);
+}
+
 /* Clear the "BSS", a segment that should be initialized to
    zeros.  It isn't actually stored on disk or zeroed by the
    kernel loader, so we have to zero it ourselves.
@@ -150,15 +312,36 @@ bss_init (void)
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* Returns true if the CPU supports 4 MB pages. */
+static bool
+pse_supported (void) 
+{
+  uint32_t a, b, c, d;
+
+  cpuid (1, &a, &b, &c, &d);
+  return (d & CPUID_PSE) != 0;
+}
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU has page size extensions, each aligned 4 MB of
+   physical memory is mapped by a single 4 MB page, which takes
+   one TLB entry instead of 1,024.  The 4 MB that holds the
+   kernel's text keeps 4 kB pages so that the text can stay
+   read-only, as does a partial 4 MB at the end of RAM.  No other
+   code needs per-page control of the kernel's mapping.  With
+   -hugepages, user processes get 4 MB pages too, which also needs
+   page size extensions; without them, -hugepages is ignored. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
+  bool pse = !no_pse && pse_supported ();
+  bool enable_pse;
   extern char _start, _end_kernel_text;
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -171,6 +354,16 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (pse && pte_idx == 0
+          && page + PTSPAN / PGSIZE <= init_ram_pages
+          && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_large (vaddr, true);
+          init_large_pages++;
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -184,10 +377,59 @@ paging_init (void)
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
-     of the Page Directory". */
+     of the Page Directory".  4 MB pages must be enabled in CR4
+     first. */
+  enable_pse = init_large_pages > 0;
+#ifdef VM
+  if (!pse)
+    frame_huge_pages = false;
+  enable_pse = enable_pse || frame_huge_pages;
+#endif
+  if (enable_pse)
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PSE));
+    }
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
 }
 
+/* Kernel virtual addresses of device registers mapped by
+   paging_map_io(): the last 4 MB of the address space, which
+   the linear map of RAM reaches only on a machine with a full
+   gigabyte. */
+#define IO_BASE ((char *) 0xffc00000)
+
+/* Maps the page of device registers at physical address PADDR,
+   uncached, into the kernel's address space and returns its
+   virtual address, or a null pointer if no room is left.  Since
+   processes copy init_page_dir's kernel mappings when they are
+   created, this must be called before the first one is. */
+void *
+paging_map_io (uintptr_t paddr)
+{
+  static uint32_t *io_pt;
+  static size_t io_pages;
+  uint32_t *pde = &init_page_dir[pd_no (IO_BASE)];
+
+  ASSERT (paddr % PGSIZE == 0);
+
+  if (io_pt == NULL)
+    {
+      if (*pde != 0)
+        return NULL;
+      io_pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+      *pde = pde_create (io_pt);
+    }
+  if (io_pages >= PGSIZE / sizeof *io_pt)
+    return NULL;
+
+  /* The entry was not present, so no stale translation of it can
+     be in the TLB. */
+  io_pt[io_pages] = paddr | PTE_PCD | PTE_PWT | PTE_W | PTE_P;
+  return IO_BASE + io_pages++ * PGSIZE;
+}
+
 /* Breaks the kernel command line into words and returns them as
    an argv-like array. */
 static char **
@@ -243,6 +485,14 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-journal"))
+        journal_filesys = true;
+      else if (!strcmp (name, "-defrag"))
+        defrag_filesys = true;
+      else if (!strcmp (name, "-memfs"))
+        memory_filesys = true;
+      else if (!strcmp (name, "-ramdisk"))
+        ramdisk_size = atoi (value);
       else if (!strcmp (name, "-filesys"))
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
@@ -250,15 +500,54 @@ parse_options (char **argv)
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
+      else if (!strcmp (name, "-zswap"))
+        swap_cache_pages = atoi (value);
+      else if (!strcmp (name, "-ksm"))
+        merge_pages = true;
+      else if (!strcmp (name, "-hugepages"))
+        frame_huge_pages = true;
 #endif
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
-        thread_mlfqs = true;
+        {
+#ifdef SCHED_POLICY
+          if (!thread_mlfqs)
+            PANIC ("kernel built without the MLFQS scheduler");
+#else
+          thread_mlfqs = true;
+#endif
+        }
+      else if (!strcmp (name, "-stackcheck"))
+        thread_stack_check = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-pit"))
+        timer_pit = true;
+      else if (!strcmp (name, "-timerslack"))
+        timer_slack_default = atoi (value);
+      else if (!strcmp (name, "-nopse"))
+        no_pse = true;
+      else if (!strcmp (name, "-novga"))
+        vga_disable ();
+      else if (!strcmp (name, "-bootprof"))
+        boot_profile = true;
+      else if (!strcmp (name, "-malloctag"))
+        malloc_tag_start ();
+      else if (!strcmp (name, "-trace"))
+        {
+          if (value == NULL || !trace_enable (value))
+            PANIC ("unknown event in `%s' (use -h for help)",
+                   value != NULL ? value : "");
+        }
+      else if (!strcmp (name, "-profile"))
+        profile_start (value != NULL && atoi (value) > 0 ? atoi (value) : 1);
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-rusage"))
+        process_print_usage = true;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -292,6 +581,20 @@ run_task (char **argv)
   printf ("Execution of '%s' complete.\n", task);
 }
 
+/* Prints the registered statistics. */
+static void
+run_stats (char **argv UNUSED)
+{
+  stats_dump ();
+}
+
+/* Prints the event trace ring. */
+static void
+run_trace (char **argv UNUSED)
+{
+  trace_dump ();
+}
+
 /* Executes all of the actions specified in ARGV[]
    up to the null pointer sentinel. */
 static void
@@ -309,12 +612,17 @@ run_actions (char **argv)
   static const struct action actions[] = 
     {
       {"run", 2, run_task},
+      {"trace", 1, run_trace},
+      {"stats", 1, run_stats},
 #ifdef FILESYS
       {"ls", 1, fsutil_ls},
       {"cat", 2, fsutil_cat},
       {"rm", 2, fsutil_rm},
+      {"defrag", 1, fsutil_defrag},
       {"extract", 1, fsutil_extract},
+      {"mount", 1, fsutil_mount},
       {"append", 2, fsutil_append},
+      {"iobench", 1, fsutil_iobench},
 #endif
       {NULL, 0, NULL},
     };
@@ -357,12 +665,17 @@ usage (void)
 #else
           "  run TEST           Run TEST.\n"
 #endif
+          "  trace              Print the event trace.\n"
+          "  stats              Print every statistic as KEY=VALUE lines.\n"
 #ifdef FILESYS
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
           "  rm FILE            Delete FILE.\n"
+          "  defrag             Move each file's data into one run.\n"
+          "  iobench            Time scratch reads overlapped with swap writes.\n"
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
+          "  mount              Read files in place from scratch device.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
 #endif
           "\nOptions:\n"
@@ -371,16 +684,37 @@ usage (void)
           "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
           "  -f                 Format file system device during startup.\n"
+          "  -journal           With -f, give it a metadata journal.\n"
+          "  -defrag            Compact files in the background.\n"
+          "  -memfs             Keep the file system in memory only.\n"
+          "  -ramdisk=SECTORS   Add a RAM disk, ram0, of SECTORS sectors.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -zswap=PAGES       Keep up to PAGES pages of swap compressed\n"
+          "                     in memory, in front of the swap device.\n"
+          "  -ksm               Share identical user pages copy-on-write.\n"
+          "  -hugepages         Map fully resident 4 MB user regions with\n"
+          "                     4 MB pages.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -stackcheck        Report each thread's deepest stack use.\n"
+          "  -tickless          Stop the periodic timer tick while idle.\n"
+          "  -pit               Tick from the PIT, not the local APIC.\n"
+          "  -timerslack=TICKS  Let sleeps wake up to TICKS late.\n"
+          "  -nopse             Map kernel memory with 4 kB pages only.\n"
+          "  -novga             Don't echo console output to the display.\n"
+          "  -bootprof          Print how long each phase of booting took.\n"
+          "  -malloctag         Record where each allocation came from.\n"
+          "  -trace=EVENTS      Trace EVENTS: switch,unblock,sema,lock,\n"
+          "                     block,fault, or all.\n"
+          "  -profile[=TICKS]   Sample the CPU every TICKS timer ticks.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -rusage            Print each process's resource use at exit.\n"
 #endif
           );
   shutdown_power_off ();
@@ -9,4 +9,9 @@
 /* Page directory with kernel mappings only. */
 extern uint32_t *init_page_dir;
 
+/* Number of 4 MB pages in init_page_dir's map of physical memory. */
+extern size_t init_large_pages;
+
+void *paging_map_io (uintptr_t paddr);
+
 #endif /* threads/init.h */
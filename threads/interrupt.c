@@ -1,14 +1,21 @@
 #include "threads/interrupt.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "devices/lapic.h"
 #include "devices/timer.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/process.h"
+#endif
 
 /* Programmable Interrupt Controller (PIC) registers.
    A PC has two PICs, called the master and slave PICs, with the
@@ -37,6 +44,48 @@ static const char *intr_names[INTR_CNT];
    unexpected interrupt is one that has no registered handler. */
 static unsigned int unexpected_cnt[INTR_CNT];
 
+/* Statistics for each vector.  Every interrupt is counted, but
+   only external interrupt handlers are timed, because the others
+   run with interrupts on and may sleep, so that their time is
+   not theirs alone.  Times are in timer_cycles(). */
+struct intr_stats
+  {
+    unsigned long long cnt;     /* Times the vector was taken. */
+    uint64_t cycles;            /* Total time in the handler. */
+    uint64_t max_cycles;        /* Longest time in the handler. */
+  };
+static struct intr_stats intr_stats[INTR_CNT];
+
+#ifdef INTROFF
+/* Interrupts-off tracking.
+
+   A critical section runs from an intr_disable() or
+   intr_set_level() that turns interrupts off to the call that
+   turns them back on, possibly in another thread if the first
+   one switched away in between.  Sections are kept per call site
+   that opened them, the longest of each with the site that
+   closed it.  Times are read from the TSC directly, because
+   timer_cycles() may itself turn interrupts off.
+
+   Compiled in only when INTROFF is defined, for example by adding
+   -DINTROFF to DEFINES in a project's Make.vars. */
+#define INTROFF_SITES 64        /* Must be a power of 2. */
+struct introff_site
+  {
+    uintptr_t start;            /* Return address that opened it. */
+    uintptr_t end;              /* ...that closed the longest one. */
+    unsigned long long cnt;     /* Sections. */
+    uint64_t cycles;            /* Total length. */
+    uint64_t max_cycles;        /* Longest. */
+  };
+static struct introff_site introff_sites[INTROFF_SITES];
+static unsigned long long introff_dropped;  /* Sections, table full. */
+static void *introff_caller;    /* Opener of the current section. */
+static uint64_t introff_start;  /* TSC when it was opened. */
+
+static void introff_end (void *caller);
+#endif
+
 /* External interrupts are those generated by devices outside the
    CPU, such as the timer.  External interrupts run with
    interrupts turned off, so they never nest, nor are they ever
@@ -47,9 +96,24 @@ static unsigned int unexpected_cnt[INTR_CNT];
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+/* Deferred interrupt work ("bottom halves").  An external
+   interrupt handler may queue work with intr_defer() to keep
+   the time it runs with interrupts off short.  Queued work runs
+   after the handler returns and the interrupt is acknowledged,
+   with interrupts enabled but before returning to the
+   interrupted thread.  Deferred work counts as interrupt
+   context: it may not sleep, but it may call
+   intr_yield_on_return().  If another external interrupt
+   arrives meanwhile, its own deferred work joins the queue and
+   runs in the same pass. */
+static struct list deferred_list; /* Queued struct intr_deferred. */
+static bool in_deferred;        /* Are we running deferred work? */
+static void run_deferred (void);
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
+static bool is_external (uint8_t vec_no);
 
 /* Interrupt Descriptor Table helpers. */
 static uint64_t make_intr_gate (void (*) (void), int dpl);
@@ -75,21 +139,45 @@ intr_get_level (void)
   return flags & FLAG_IF ? INTR_ON : INTR_OFF;
 }
 
+static enum intr_level enable (void *caller);
+static enum intr_level disable (void *caller);
+
 /* Enables or disables interrupts as specified by LEVEL and
    returns the previous interrupt status. */
 enum intr_level
 intr_set_level (enum intr_level level) 
 {
-  return level == INTR_ON ? intr_enable () : intr_disable ();
+  void *caller = __builtin_return_address (0);
+  return level == INTR_ON ? enable (caller) : disable (caller);
 }
 
 /* Enables interrupts and returns the previous interrupt status. */
 enum intr_level
 intr_enable (void) 
+{
+  return enable (__builtin_return_address (0));
+}
+
+/* Disables interrupts and returns the previous interrupt status. */
+enum intr_level
+intr_disable (void) 
+{
+  return disable (__builtin_return_address (0));
+}
+
+/* Enables interrupts for CALLER and returns the previous
+   interrupt status. */
+static enum intr_level
+enable (void *caller UNUSED) 
 {
   enum intr_level old_level = intr_get_level ();
   ASSERT (!intr_context ());
 
+#ifdef INTROFF
+  if (old_level == INTR_OFF)
+    introff_end (caller);
+#endif
+
   /* Enable interrupts by setting the interrupt flag.
 
      See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
@@ -99,9 +187,10 @@ intr_enable (void)
   return old_level;
 }
 
-/* Disables interrupts and returns the previous interrupt status. */
-enum intr_level
-intr_disable (void) 
+/* Disables interrupts for CALLER and returns the previous
+   interrupt status. */
+static enum intr_level
+disable (void *caller UNUSED) 
 {
   enum intr_level old_level = intr_get_level ();
 
@@ -110,8 +199,53 @@ intr_disable (void)
      Hardware Interrupts". */
   asm volatile ("cli" : : : "memory");
 
+#ifdef INTROFF
+  if (old_level == INTR_ON)
+    {
+      introff_caller = caller;
+      introff_start = rdtsc ();
+    }
+#endif
   return old_level;
 }
+
+#ifdef INTROFF
+/* Closes the current interrupts-off section, if any, at CALLER.
+   Interrupts must be off. */
+static void
+introff_end (void *caller) 
+{
+  uint64_t cycles;
+  size_t i, n;
+
+  if (introff_caller == NULL)
+    return;
+  cycles = rdtsc () - introff_start;
+
+  i = ((uintptr_t) introff_caller >> 2) & (INTROFF_SITES - 1);
+  for (n = 0; n < INTROFF_SITES; n++, i = (i + 1) & (INTROFF_SITES - 1))
+    {
+      struct introff_site *s = &introff_sites[i];
+
+      if (s->cnt == 0)
+        s->start = (uintptr_t) introff_caller;
+      if (s->start == (uintptr_t) introff_caller)
+        {
+          s->cnt++;
+          s->cycles += cycles;
+          if (cycles >= s->max_cycles)
+            {
+              s->max_cycles = cycles;
+              s->end = (uintptr_t) caller;
+            }
+          break;
+        }
+    }
+  if (n == INTROFF_SITES)
+    introff_dropped++;
+  introff_caller = NULL;
+}
+#endif
 
 /* Initializes the interrupt system. */
 void
@@ -133,6 +267,8 @@ intr_init (void)
   idtr_operand = make_idtr_operand (sizeof idt - 1, idt);
   asm volatile ("lidt %0" : : "m" (idtr_operand));
 
+  list_init (&deferred_list);
+
   /* Initialize intr_names. */
   for (i = 0; i < INTR_CNT; i++)
     intr_names[i] = "unknown";
@@ -174,6 +310,14 @@ register_handler (uint8_t vec_no, int dpl, enum intr_level level,
   intr_names[vec_no] = name;
 }
 
+/* Returns true if VEC_NO is an external interrupt: one of the
+   PICs' or the local APIC timer's. */
+static bool
+is_external (uint8_t vec_no) 
+{
+  return (vec_no >= 0x20 && vec_no <= 0x2f) || vec_no == INTR_LAPIC_TIMER;
+}
+
 /* Registers external interrupt VEC_NO to invoke HANDLER, which
    is named NAME for debugging purposes.  The handler will
    execute with interrupts disabled. */
@@ -181,10 +325,28 @@ void
 intr_register_ext (uint8_t vec_no, intr_handler_func *handler,
                    const char *name) 
 {
-  ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+  ASSERT (is_external (vec_no));
   register_handler (vec_no, 0, INTR_OFF, handler, name);
 }
 
+/* Masks PIC interrupt VEC_NO, which must be 0x20...0x2f, and
+   removes its handler, so that another can be registered in its
+   place. */
+void
+intr_unregister_ext (uint8_t vec_no) 
+{
+  enum intr_level old_level;
+  int port = vec_no < 0x28 ? PIC0_DATA : PIC1_DATA;
+
+  ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+
+  old_level = intr_disable ();
+  outb (port, inb (port) | (1 << (vec_no & 7)));
+  intr_handlers[vec_no] = NULL;
+  intr_names[vec_no] = "unknown";
+  intr_set_level (old_level);
+}
+
 /* Registers internal interrupt VEC_NO to invoke HANDLER, which
    is named NAME for debugging purposes.  The interrupt handler
    will be invoked with interrupt status LEVEL.
@@ -202,16 +364,47 @@ void
 intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
                    intr_handler_func *handler, const char *name)
 {
-  ASSERT (vec_no < 0x20 || vec_no > 0x2f);
+  ASSERT (!is_external (vec_no));
   register_handler (vec_no, dpl, level, handler, name);
 }
 
-/* Returns true during processing of an external interrupt
-   and false at all other times. */
+/* Returns true during processing of an external interrupt,
+   including its deferred work, and false at all other times. */
 bool
 intr_context (void) 
 {
-  return in_external_intr;
+  return in_external_intr || in_deferred;
+}
+
+/* Initializes D to run FUNC(AUX) when deferred. */
+void
+intr_deferred_init (struct intr_deferred *d,
+                    intr_deferred_func *func, void *aux) 
+{
+  ASSERT (d != NULL);
+  ASSERT (func != NULL);
+
+  d->func = func;
+  d->aux = aux;
+  d->queued = false;
+}
+
+/* Queues D to run once the current external interrupt's handler
+   returns.  If D is already queued, does nothing, so any number
+   of requests before D runs are serviced by a single call.  May
+   only be called from an external interrupt handler or from
+   deferred work. */
+void
+intr_defer (struct intr_deferred *d) 
+{
+  ASSERT (intr_context ());
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!d->queued)
+    {
+      d->queued = true;
+      list_push_back (&deferred_list, &d->elem);
+    }
 }
 
 /* During processing of an external interrupt, directs the
@@ -346,26 +539,48 @@ intr_handler (struct intr_frame *frame)
 {
   bool external;
   intr_handler_func *handler;
+  struct intr_stats *stats;
+  uint64_t start = 0;
 
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
      and they need to be acknowledged on the PIC (see below).
      An external interrupt handler cannot sleep. */
-  external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+  external = is_external (frame->vec_no);
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
-      ASSERT (!intr_context ());
+      ASSERT (!in_external_intr);
 
       in_external_intr = true;
-      yield_on_return = false;
+      if (!in_deferred)
+        yield_on_return = false;
+#ifdef INTROFF
+      /* Interrupts were on when this one arrived, so any open
+         section was ended by an IRET rather than a call to
+         intr_enable().  Forget it. */
+      introff_caller = NULL;
+#endif
     }
 
   /* Invoke the interrupt's handler. */
+  stats = &intr_stats[frame->vec_no];
+  if (external)
+    {
+      stats->cnt++;
+      start = timer_cycles ();
+    }
+  else
+    {
+      enum intr_level old_level = intr_disable ();
+      stats->cnt++;
+      intr_set_level (old_level);
+    }
   handler = intr_handlers[frame->vec_no];
   if (handler != NULL)
     handler (frame);
-  else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f)
+  else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f
+           || frame->vec_no == INTR_LAPIC_SPURIOUS)
     {
       /* There is no handler, but this interrupt can trigger
          spuriously due to a hardware fault or hardware race
@@ -377,15 +592,61 @@ intr_handler (struct intr_frame *frame)
   /* Complete the processing of an external interrupt. */
   if (external) 
     {
+      uint64_t cycles = timer_cycles () - start;
+
       ASSERT (intr_get_level () == INTR_OFF);
-      ASSERT (intr_context ());
+      ASSERT (in_external_intr);
+
+      stats->cycles += cycles;
+      if (cycles > stats->max_cycles)
+        stats->max_cycles = cycles;
 
       in_external_intr = false;
-      pic_end_of_interrupt (frame->vec_no); 
+      if (frame->vec_no == INTR_LAPIC_TIMER)
+        lapic_eoi ();
+      else
+        pic_end_of_interrupt (frame->vec_no); 
+
+      /* If we interrupted deferred work, the outer invocation
+         will pick up our deferred work and yield for us. */
+      if (!in_deferred)
+        {
+          run_deferred ();
+          if (yield_on_return) 
+            thread_yield (); 
+        }
+    }
+
+#ifdef USERPROG
+  /* A thread of a process with several threads checks, before
+     going back to user mode, whether the process is exiting. */
+  if (frame->cs == SEL_UCSEG && thread_current ()->group != NULL)
+    {
+      intr_disable ();
+      process_check_dying ();
+    }
+#endif
+}
+
+/* Runs queued deferred work until the queue is empty, with
+   interrupts enabled while each item runs.  Interrupts must be
+   off on entry and are off again on return. */
+static void
+run_deferred (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
 
-      if (yield_on_return) 
-        thread_yield (); 
+  in_deferred = true;
+  while (!list_empty (&deferred_list))
+    {
+      struct intr_deferred *d = list_entry (list_pop_front (&deferred_list),
+                                            struct intr_deferred, elem);
+      d->queued = false;
+      intr_enable ();
+      d->func (d->aux);
+      intr_disable ();
     }
+  in_deferred = false;
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
@@ -436,3 +697,56 @@ intr_name (uint8_t vec)
 {
   return intr_names[vec];
 }
+
+/* Prints interrupt statistics. */
+void
+intr_print_stats (void) 
+{
+  size_t vec;
+
+  for (vec = 0; vec < INTR_CNT; vec++) 
+    {
+      const struct intr_stats *s = &intr_stats[vec];
+
+      if (s->cnt == 0)
+        continue;
+      if (is_external (vec))
+        printf ("Interrupt: %#04zx %s: %llu, %"PRIu64" ns total, "
+                "%"PRIu64" ns max\n", vec, intr_names[vec], s->cnt,
+                timer_cycles_to_ns (s->cycles),
+                timer_cycles_to_ns (s->max_cycles));
+      else
+        printf ("Interrupt: %#04zx %s: %llu\n",
+                vec, intr_names[vec], s->cnt);
+    }
+
+#ifdef INTROFF
+  {
+    /* The longest sections first, a few at a time, by repeatedly
+       picking the longest not yet printed. */
+    bool printed[INTROFF_SITES] = {false};
+    int i;
+
+    printf ("Interrupts off: %llu sections not tracked\n", introff_dropped);
+    for (i = 0; i < 16; i++)
+      {
+        const struct introff_site *best = NULL;
+        size_t j;
+
+        for (j = 0; j < INTROFF_SITES; j++)
+          if (!printed[j] && introff_sites[j].cnt != 0
+              && (best == NULL
+                  || introff_sites[j].max_cycles > best->max_cycles))
+            best = &introff_sites[j];
+        if (best == NULL)
+          break;
+        printed[best - introff_sites] = true;
+        printf ("Interrupts off: 0x%08"PRIxPTR" to 0x%08"PRIxPTR": "
+                "%"PRIu64" ns max, %"PRIu64" ns average, %llu times\n",
+                best->start, best->end,
+                timer_cycles_to_ns (best->max_cycles),
+                timer_cycles_to_ns (best->cycles / best->cnt), best->cnt);
+      }
+  }
+#endif
+}
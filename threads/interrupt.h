@@ -1,6 +1,7 @@
 #ifndef THREADS_INTERRUPT_H
 #define THREADS_INTERRUPT_H
 
+#include <list.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -57,14 +58,38 @@ struct intr_frame
 
 typedef void intr_handler_func (struct intr_frame *);
 
+/* Vectors of the local APIC's own interrupts, above those of the
+   PICs (0x20...0x2f) and of system calls (0x30).  The timer's is
+   an external interrupt.  The spurious vector's low 4 bits must
+   be set on older APICs. */
+#define INTR_LAPIC_TIMER 0xf0
+#define INTR_LAPIC_SPURIOUS 0xff
+
 void intr_init (void);
 void intr_register_ext (uint8_t vec, intr_handler_func *, const char *name);
+void intr_unregister_ext (uint8_t vec);
 void intr_register_int (uint8_t vec, int dpl, enum intr_level,
                         intr_handler_func *, const char *name);
 bool intr_context (void);
 void intr_yield_on_return (void);
 
+/* Deferred interrupt work, run after an external interrupt
+   handler returns, with interrupts enabled. */
+typedef void intr_deferred_func (void *aux);
+struct intr_deferred
+  {
+    struct list_elem elem;      /* Element in deferred work queue. */
+    intr_deferred_func *func;   /* Function to call. */
+    void *aux;                  /* Argument to FUNC. */
+    bool queued;                /* In the queue? */
+  };
+
+void intr_deferred_init (struct intr_deferred *,
+                         intr_deferred_func *, void *aux);
+void intr_defer (struct intr_deferred *);
+
 void intr_dump_frame (const struct intr_frame *);
 const char *intr_name (uint8_t vec);
+void intr_print_stats (void);
 
 #endif /* threads/interrupt.h */
@@ -0,0 +1,285 @@
+#include "threads/lockdep.h"
+
+#ifdef LOCKDEP
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Capacities of the graph.  LOCKDEP_CLASSES may not exceed 64,
+   the number of bits in an adjacency row. */
+#define LOCKDEP_CLASSES 64      /* Lock classes. */
+#define LOCKDEP_EDGES 256       /* Edges with a saved backtrace. */
+#define LOCKDEP_FRAMES 8        /* Return addresses per backtrace. */
+
+/* Lock classes, indexed by id - 1. */
+static struct lockdep_class *classes[LOCKDEP_CLASSES];
+static int class_cnt;
+
+/* Adjacency matrix: bit B of after[A] is set if a lock of class
+   A has been held while acquiring one of class B. */
+static uint64_t after[LOCKDEP_CLASSES];
+
+/* An edge of the graph, with where it was first seen. */
+struct lockdep_edge
+  {
+    uint8_t from, to;                   /* Class indexes. */
+    void *trace[LOCKDEP_FRAMES];        /* Return addresses. */
+  };
+
+static struct lockdep_edge edges[LOCKDEP_EDGES];
+static int edge_cnt;
+
+/* True while printing a report.  Printing takes the console
+   lock, which must not be checked recursively. */
+static bool reporting;
+
+/* Set once a capacity has been exceeded and reported. */
+static bool classes_full, edges_full, held_full;
+
+static bool find_path (int from, int to, int parent[]);
+static void add_edge (int from, int to);
+static void report_cycle (struct lock *, struct lock *held, int parent[]);
+static void print_trace (void *const trace[]);
+
+/* Returns the graph index of LOCK's class, or -1 if there is
+   none. */
+static inline int
+class_of (const struct lock *lock) 
+{
+  return lock->dep_class != NULL ? lock->dep_class->id - 1 : -1;
+}
+
+/* Sets LOCK's class to CLASS, giving CLASS an index in the
+   graph the first time it is seen. */
+void
+lockdep_init_lock (struct lock *lock, struct lockdep_class *class) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  lock->dep_class = class;
+  if (class->id == 0)
+    {
+      if (class_cnt < LOCKDEP_CLASSES)
+        {
+          classes[class_cnt++] = class;
+          class->id = class_cnt;
+        }
+      else if (!classes_full)
+        {
+          classes_full = true;
+          printf ("lockdep: more than %d lock classes, "
+                  "not checking %s (%s:%d) and later ones\n",
+                  LOCKDEP_CLASSES, class->name, class->file, class->line);
+        }
+    }
+  intr_set_level (old_level);
+}
+
+/* Checks that the running thread, which is about to wait for
+   LOCK, does not thereby acquire locks in an order that
+   contradicts one seen before.  Interrupts must be off. */
+void
+lockdep_acquire (struct lock *lock) 
+{
+  struct thread *cur = thread_current ();
+  int to = class_of (lock);
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (to < 0 || reporting)
+    return;
+  for (i = 0; i < cur->lockdep_depth; i++) 
+    {
+      int from = class_of (cur->lockdep_held[i]);
+      int parent[LOCKDEP_CLASSES];
+
+      if (from < 0 || from == to || (after[from] & ((uint64_t) 1 << to)))
+        continue;
+
+      /* First time FROM -> TO: it closes a cycle if TO already
+         leads back to FROM. */
+      if (find_path (to, from, parent))
+        report_cycle (lock, cur->lockdep_held[i], parent);
+      add_edge (from, to);
+    }
+}
+
+/* Pushes LOCK, just acquired, onto the running thread's stack of
+   held locks.  Interrupts must be off. */
+void
+lockdep_acquired (struct lock *lock) 
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (cur->lockdep_depth < LOCKDEP_HELD_MAX)
+    cur->lockdep_held[cur->lockdep_depth++] = lock;
+  else if (!held_full && !reporting)
+    {
+      held_full = true;
+      reporting = true;
+      printf ("lockdep: thread %s holds more than %d locks, "
+              "not checking the rest\n", cur->name, LOCKDEP_HELD_MAX);
+      reporting = false;
+    }
+}
+
+/* Removes LOCK, about to be released, from the running thread's
+   stack of held locks.  Locks need not be released in the
+   reverse of the order they were acquired.  Interrupts must be
+   off. */
+void
+lockdep_release (struct lock *lock) 
+{
+  struct thread *cur = thread_current ();
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = cur->lockdep_depth - 1; i >= 0; i--)
+    if (cur->lockdep_held[i] == lock)
+      {
+        for (; i + 1 < cur->lockdep_depth; i++)
+          cur->lockdep_held[i] = cur->lockdep_held[i + 1];
+        cur->lockdep_depth--;
+        break;
+      }
+}
+
+/* Returns the index of the lowest set bit in nonzero X.  (GCC's
+   64-bit __builtin_ctzll() needs libgcc, which the kernel does
+   not link with.) */
+static inline int
+lowest_bit (uint64_t x) 
+{
+  uint32_t lo = x;
+
+  return lo != 0 ? __builtin_ctz (lo) : 32 + __builtin_ctz (x >> 32);
+}
+
+/* Searches the graph breadth-first for a path from class FROM to
+   class TO.  If there is one, returns true and leaves in
+   PARENT[] the class preceding each class on it, back to FROM. */
+static bool
+find_path (int from, int to, int parent[]) 
+{
+  int queue[LOCKDEP_CLASSES];
+  uint64_t seen = (uint64_t) 1 << from;
+  int head = 0, tail = 0;
+
+  queue[tail++] = from;
+  while (head < tail) 
+    {
+      int c = queue[head++];
+      uint64_t next = after[c] & ~seen;
+
+      while (next != 0) 
+        {
+          int n = lowest_bit (next);
+
+          next &= next - 1;
+          seen |= (uint64_t) 1 << n;
+          parent[n] = c;
+          if (n == to)
+            return true;
+          queue[tail++] = n;
+        }
+    }
+  return false;
+}
+
+/* Records edge FROM -> TO, with the current backtrace if there
+   is room for it. */
+static void
+add_edge (int from, int to) 
+{
+  after[from] |= (uint64_t) 1 << to;
+  if (edge_cnt < LOCKDEP_EDGES)
+    {
+      struct lockdep_edge *e = &edges[edge_cnt++];
+      void **frame;
+      int i = 0;
+
+      e->from = from;
+      e->to = to;
+      for (frame = __builtin_frame_address (0);
+           (uintptr_t) frame >= 0x1000 && frame[0] != NULL
+             && i < LOCKDEP_FRAMES;
+           frame = frame[0])
+        e->trace[i++] = frame[1];
+      for (; i < LOCKDEP_FRAMES; i++)
+        e->trace[i] = NULL;
+    }
+  else
+    edges_full = true;
+}
+
+/* Prints the class of graph index C. */
+static void
+print_class (int c) 
+{
+  printf ("%s (%s:%d)", classes[c]->name, classes[c]->file,
+          classes[c]->line);
+}
+
+/* Reports that acquiring LOCK while holding HELD closes a cycle
+   in the graph, whose path from LOCK's class back to HELD's
+   class is given by PARENT[]. */
+static void
+report_cycle (struct lock *lock, struct lock *held, int parent[]) 
+{
+  int from = class_of (held);
+  int to = class_of (lock);
+  int c;
+
+  reporting = true;
+  printf ("lockdep: possible deadlock in thread %s\n",
+          thread_current ()->name);
+  printf ("  acquiring ");
+  print_class (to);
+  printf ("\n  while holding ");
+  print_class (from);
+  printf ("\n  but the opposite order was seen before:\n");
+  for (c = from; c != to; c = parent[c]) 
+    {
+      int p = parent[c];
+      int i;
+
+      printf ("  ");
+      print_class (p);
+      printf (" -> ");
+      print_class (c);
+      printf ("\n    first seen at: ");
+      for (i = 0; i < edge_cnt; i++)
+        if (edges[i].from == p && edges[i].to == c)
+          break;
+      if (i < edge_cnt)
+        print_trace (edges[i].trace);
+      else
+        printf ("(not recorded)\n");
+    }
+  printf ("  now at: ");
+  debug_backtrace ();
+  if (edges_full)
+    printf ("  (edge table full; some backtraces were not saved)\n");
+  reporting = false;
+}
+
+/* Prints saved return addresses TRACE in the same format as
+   debug_backtrace(). */
+static void
+print_trace (void *const trace[]) 
+{
+  int i;
+
+  printf ("Call stack:");
+  for (i = 0; i < LOCKDEP_FRAMES && trace[i] != NULL; i++)
+    printf (" %p", trace[i]);
+  printf (".\n");
+}
+#endif /* LOCKDEP */
@@ -0,0 +1,60 @@
+#ifndef THREADS_LOCKDEP_H
+#define THREADS_LOCKDEP_H
+
+/* Lock-order validator.
+
+   Learns the order in which lock classes are acquired and
+   reports, with backtraces, the first time some thread acquires
+   locks in an order that could deadlock against an order seen
+   earlier, even if the deadlock never actually happened.
+
+   A lock class is all the locks initialized by one call to
+   lock_init(), named after its argument, e.g. "&c->lock".  The
+   first time a thread acquires a lock of class B while holding
+   one of class A, lockdep records the edge A -> B in a fixed-size
+   graph, together with a backtrace.  If B could already reach A
+   through the graph, the new edge would close a cycle, and the
+   report shows the cycle's edges and where each was first seen.
+
+   Each thread keeps the locks it holds in a small array, so once
+   the edges in use have been seen, checking an acquisition is a
+   scan of that array testing one bit per held lock.  Nothing is
+   allocated.
+
+   Nesting two locks of the same class is not checked, because
+   there is no way to tell which order between them is intended.
+   Locks taken with lock_try_acquire() never wait, so they add no
+   edges, but they are still tracked as held.
+
+   Lockdep is compiled in only when LOCKDEP is defined, for
+   example by adding -DLOCKDEP to DEFINES in a project's
+   Make.vars. */
+
+/* Maximum number of locks a thread may hold at once and still
+   be checked. */
+#define LOCKDEP_HELD_MAX 8
+
+#ifdef LOCKDEP
+struct lock;
+
+/* A lock class. */
+struct lockdep_class
+  {
+    const char *name;           /* Argument to lock_init(), as text. */
+    const char *file;           /* Source file of the lock_init() call. */
+    int line;                   /* Line of the lock_init() call. */
+    int id;                     /* Index in the graph plus 1, or 0. */
+  };
+
+/* Initializer for a struct lockdep_class for locks named NAME,
+   initialized at the current source line. */
+#define LOCKDEP_CLASS_INITIALIZER(NAME) \
+        { .name = (NAME), .file = __FILE__, .line = __LINE__ }
+
+void lockdep_init_lock (struct lock *, struct lockdep_class *);
+void lockdep_acquire (struct lock *);
+void lockdep_acquired (struct lock *);
+void lockdep_release (struct lock *);
+#endif
+
+#endif /* threads/lockdep.h */
@@ -0,0 +1,67 @@
+#include "threads/lockstat.h"
+
+#ifdef LOCKSTAT
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+
+/* Every lock class that has had a lock initialized. */
+static struct list registry = LIST_INITIALIZER (registry);
+
+/* Adds STAT to the registry, unless it is already there. */
+void
+lockstat_register (struct lockstat *stat) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (!stat->registered)
+    {
+      stat->registered = true;
+      list_push_back (&registry, &stat->elem);
+    }
+  intr_set_level (old_level);
+}
+
+/* Orders lock classes by descending total wait. */
+static bool
+more_wait (const struct list_elem *a_, const struct list_elem *b_,
+           void *aux UNUSED) 
+{
+  const struct lockstat *a = list_entry (a_, struct lockstat, elem);
+  const struct lockstat *b = list_entry (b_, struct lockstat, elem);
+
+  return a->wait_total > b->wait_total;
+}
+
+/* Prints the statistics for every lock class that has been
+   acquired at least once, longest total wait first. */
+void
+lockstat_print (void) 
+{
+  enum intr_level old_level;
+  struct list_elem *e;
+
+  old_level = intr_disable ();
+  list_sort (&registry, more_wait, NULL);
+  intr_set_level (old_level);
+
+  printf ("Lock statistics (ns):\n");
+  printf ("%10s %10s %14s %12s %14s  %s\n",
+          "acquired", "contended", "wait total", "wait max", "hold total",
+          "lock");
+  for (e = list_begin (&registry); e != list_end (&registry);
+       e = list_next (e))
+    {
+      struct lockstat *s = list_entry (e, struct lockstat, elem);
+
+      if (s->acquisitions == 0)
+        continue;
+      printf ("%10u %10u %14"PRIu64" %12"PRIu64" %14"PRIu64"  %s (%s:%d)\n",
+              s->acquisitions, s->contended,
+              timer_cycles_to_ns (s->wait_total),
+              timer_cycles_to_ns (s->wait_max),
+              timer_cycles_to_ns (s->hold_total), s->name, s->file, s->line);
+    }
+}
+#endif /* LOCKSTAT */
@@ -0,0 +1,55 @@
+#ifndef THREADS_LOCKSTAT_H
+#define THREADS_LOCKSTAT_H
+
+/* Lock contention statistics.
+
+   Counts, for each lock, how often it is acquired, how often an
+   acquirer has to wait, how long acquirers wait, and how long the
+   lock is held.  Times are kept in cycles of timer_cycles(),
+   because most waits are much shorter than a timer tick, and
+   printed in nanoseconds.  The
+   statistics are printed at shutdown, locks that were waited for
+   the longest first.
+
+   Statistics are kept per lock class: all the locks initialized
+   by the same call to lock_init() share one struct lockstat,
+   named after that call's argument, e.g. "&pool->lock".  The
+   struct lockstat is static, so the registry never refers to a
+   lock whose memory has been freed.
+
+   Statistics are compiled in only when LOCKSTAT is defined, for
+   example by adding -DLOCKSTAT to DEFINES in a project's
+   Make.vars.  Otherwise struct lock carries no extra members and
+   lock_acquire() does no extra work. */
+
+#ifdef LOCKSTAT
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Statistics for one lock class. */
+struct lockstat
+  {
+    const char *name;           /* Argument to lock_init(), as text. */
+    const char *file;           /* Source file of the lock_init() call. */
+    int line;                   /* Line of the lock_init() call. */
+    bool registered;            /* In the registry yet? */
+    struct list_elem elem;      /* Registry element. */
+
+    unsigned acquisitions;      /* Number of times acquired. */
+    unsigned contended;         /* Acquisitions that had to wait. */
+    uint64_t wait_total;        /* Total cycles spent waiting. */
+    uint64_t wait_max;          /* Longest single wait. */
+    uint64_t hold_total;        /* Total cycles held. */
+  };
+
+/* Initializer for a struct lockstat for locks named NAME,
+   initialized at the current source line. */
+#define LOCKSTAT_INITIALIZER(NAME) \
+        { .name = (NAME), .file = __FILE__, .line = __LINE__ }
+
+void lockstat_register (struct lockstat *);
+void lockstat_print (void);
+#endif
+
+#endif /* threads/lockstat.h */
@@ -2,11 +2,15 @@
 #include <debug.h>
 #include <list.h>
 #include <round.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
+#include "threads/loader.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
@@ -28,17 +32,53 @@
    blocks, we remove all of the arena's blocks from the free list
    and give the arena back to the page allocator.
 
-   We can't handle blocks bigger than 2 kB using this scheme,
-   because they're too big to fit in a single page with a
-   descriptor.  We handle those by allocating contiguous pages
-   with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   Blocks bigger than 1 kB fit poorly in a single page with a
+   descriptor, so the descriptors from 1.5 kB to 16 kB use arenas
+   of several contiguous pages instead, sized so that their
+   blocks, packed end to end across page boundaries, leave at
+   most an eighth of the arena unused.  A block of such an arena
+   finds the arena's header through page_back[], which records
+   how many pages into a multi-page arena each page lies.  These
+   blocks bypass the magazines, which would otherwise hoard
+   whole arenas per thread.  A request that nearly fills a whole
+   number of pages still gets a big block, below, when that
+   wastes less than its share of an arena would.
+
+   We handle blocks bigger than 16 kB by allocating contiguous
+   pages with the page allocator and sticking the allocation size
+   at the beginning of the allocated block's arena header.
+
+   To keep the descriptor locks off the common path, each thread
+   also keeps a small "magazine" of blocks it freed recently for
+   every descriptor.  malloc() pops from the current thread's
+   magazine and free() pushes onto it, neither taking a lock.
+   An empty magazine is refilled, and a full one is half
+   flushed, MAG_BATCH blocks at a time under the descriptor
+   lock.  Blocks sitting in a magazine count as in use as far as
+   their arena is concerned.
+
+   With the "-malloctag" option, every allocation is also tagged
+   with the address of the code that asked for it.  A table
+   counts calls, live blocks, and live bytes per call site, and
+   another maps each live block to its site, so that the sites
+   printed at shutdown show both where memory is allocated most
+   often and where blocks that were never freed came from.
+   Passing the addresses to "backtrace" names the functions. */
+
+/* Blocks a magazine holds per descriptor, and the number moved
+   to or from the descriptor at a time. */
+#define MAG_SIZE 8
+#define MAG_BATCH (MAG_SIZE / 2)
+
+/* Most pages in a multi-page arena. */
+#define ARENA_PAGES_MAX 16
 
 /* Descriptor. */
 struct desc
   {
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    size_t arena_pages;         /* Number of pages in an arena. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
   };
@@ -58,29 +98,130 @@ struct arena
 struct block 
   {
     struct list_elem free_elem; /* Free list element. */
+    struct block *mag_next;     /* Next block in a magazine. */
   };
 
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[MALLOC_DESC_MAX]; /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Block sizes served by multi-page arenas. */
+static const size_t multi_sizes[] =
+  { 1536, 2048, 2560, 3072, 4096, 5120, 6144, 8192, 10240, 12288, 16384 };
+
+/* For each page of RAM, the number of pages between it and the
+   start of the multi-page arena it lies in, or 0. */
+static uint8_t *page_back;
+
+/* Pages held by arenas and big blocks, and the subset in
+   multi-page arenas.  Updated with interrupts off. */
+static size_t held_pages;
+static size_t multi_pages;
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static struct block *desc_get (struct desc *);
+static void desc_put (struct desc *, struct block *);
+static void *alloc (size_t);
+static void count_pages (struct desc *, size_t page_cnt, bool add);
+
+/* Number of call sites and of live blocks that tagging can
+   track.  Both must be powers of 2. */
+#define TAG_SITES 256
+#define TAG_BLOCKS 4096
+
+/* Allocations made from one call site. */
+struct tag_site
+  {
+    uintptr_t caller;           /* Return address; 0 if unused. */
+    uint32_t alloc_cnt;         /* Allocations made. */
+    uint32_t live_cnt;          /* Blocks not yet freed. */
+    size_t live_bytes;          /* Bytes requested in those blocks. */
+  };
+
+/* A live block and where it came from. */
+struct tag_block
+  {
+    void *block;                /* Block; null if unused. */
+    size_t size;                /* Bytes requested. */
+    struct tag_site *site;      /* Site that allocated it. */
+  };
+
+/* Both tables are open addressed with linear probing, and are
+   only touched with interrupts off.  They take about 52 kB, so
+   malloc_init() allocates them from the page allocator, and only
+   with "-malloctag". */
+static bool tag_requested;              /* "-malloctag" given? */
+static bool tagging;                    /* Tables allocated? */
+static struct tag_site *tag_sites;      /* TAG_SITES entries. */
+static struct tag_block *tag_blocks;    /* TAG_BLOCKS entries. */
+static unsigned long long tag_cnt;      /* Allocations tagged. */
+static unsigned long long untracked_cnt; /* ...not tracked, table full. */
+
+static void tag_add (void *, size_t, void *caller);
+static struct tag_block *tag_find (void *);
+static void tag_remove (void *);
+
+/* Returns the number of pages for an arena of BLOCK_SIZE-byte
+   blocks: the fewest that waste at most an eighth of the arena,
+   or ARENA_PAGES_MAX if no count does. */
+static size_t
+pick_arena_pages (size_t block_size) 
+{
+  size_t page_cnt;
+
+  for (page_cnt = 1; page_cnt < ARENA_PAGES_MAX; page_cnt++)
+    {
+      size_t bytes = page_cnt * PGSIZE;
+      size_t blocks = (bytes - sizeof (struct arena)) / block_size;
+      if (blocks > 0 && (bytes - blocks * block_size) * 8 <= bytes)
+        break;
+    }
+  return page_cnt;
+}
+
+/* Adds a descriptor for BLOCK_SIZE-byte blocks in arenas of
+   PAGE_CNT pages. */
+static void
+add_desc (size_t block_size, size_t page_cnt) 
+{
+  struct desc *d = &descs[desc_cnt++];
+
+  ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+  d->block_size = block_size;
+  d->arena_pages = page_cnt;
+  d->blocks_per_arena = ((page_cnt * PGSIZE - sizeof (struct arena))
+                         / block_size);
+  list_init (&d->free_list);
+  lock_init (&d->lock);
+}
 
 /* Initializes the malloc() descriptors. */
 void
 malloc_init (void) 
 {
   size_t block_size;
+  size_t i;
 
   for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
+    add_desc (block_size, 1);
+  for (i = 0; i < sizeof multi_sizes / sizeof *multi_sizes; i++)
+    add_desc (multi_sizes[i], pick_arena_pages (multi_sizes[i]));
+
+  page_back = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                                   DIV_ROUND_UP (init_ram_pages, PGSIZE));
+
+  if (tag_requested)
     {
-      struct desc *d = &descs[desc_cnt++];
-      ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
-      d->block_size = block_size;
-      d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
-      list_init (&d->free_list);
-      lock_init (&d->lock);
+      tag_sites = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                                       DIV_ROUND_UP (TAG_SITES
+                                                     * sizeof *tag_sites,
+                                                     PGSIZE));
+      tag_blocks = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                                        DIV_ROUND_UP (TAG_BLOCKS
+                                                      * sizeof *tag_blocks,
+                                                      PGSIZE));
+      tagging = true;
     }
 }
 
@@ -88,10 +229,23 @@ malloc_init (void)
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) 
+{
+  void *p = alloc (size);
+
+  tag_add (p, size, __builtin_return_address (0));
+  return p;
+}
+
+/* Does the work of malloc(), without tagging. */
+static void *
+alloc (size_t size) 
 {
   struct desc *d;
+  struct malloc_mag *m;
   struct block *b;
   struct arena *a;
+  size_t page_cnt;
+  size_t idx;
 
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
@@ -102,11 +256,14 @@ malloc (size_t size)
   for (d = descs; d < descs + desc_cnt; d++)
     if (d->block_size >= size)
       break;
-  if (d == descs + desc_cnt) 
+  page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
+  if (d == descs + desc_cnt
+      || (d->arena_pages > 1
+          && page_cnt * d->blocks_per_arena <= d->arena_pages)) 
     {
-      /* SIZE is too big for any descriptor.
+      /* SIZE is too big for any descriptor, or just fits whole
+         pages better than a share of a multi-page arena.
          Allocate enough pages to hold SIZE plus an arena. */
-      size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
       a = palloc_get_multiple (0, page_cnt);
       if (a == NULL)
         return NULL;
@@ -116,23 +273,72 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = NULL;
       a->free_cnt = page_cnt;
+      count_pages (NULL, page_cnt, true);
       return a + 1;
     }
 
+  /* Blocks of multi-page arenas come straight from the
+     descriptor. */
+  if (d->arena_pages > 1)
+    {
+      lock_acquire (&d->lock);
+      b = desc_get (d);
+      lock_release (&d->lock);
+      return b;
+    }
+
+  /* Take the most recently freed block from our magazine. */
+  m = &thread_current ()->malloc_mag;
+  idx = d - descs;
+  if (m->cnt[idx] > 0)
+    {
+      b = m->top[idx];
+      m->top[idx] = b->mag_next;
+      m->cnt[idx]--;
+      return b;
+    }
+
+  /* The magazine is empty.  Refill it with a batch of blocks
+     from the descriptor, keeping one to return. */
   lock_acquire (&d->lock);
+  b = desc_get (d);
+  if (b != NULL)
+    while (m->cnt[idx] < MAG_BATCH - 1)
+      {
+        struct block *extra = desc_get (d);
+        if (extra == NULL)
+          break;
+        extra->mag_next = m->top[idx];
+        m->top[idx] = extra;
+        m->cnt[idx]++;
+      }
+  lock_release (&d->lock);
+  return b;
+}
+
+/* Removes a block from descriptor D's free list and returns it,
+   creating a new arena if the list is empty.  Returns a null
+   pointer if memory is not available.  D's lock must be held. */
+static struct block *
+desc_get (struct desc *d) 
+{
+  struct block *b;
+  struct arena *a;
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
 
   /* If the free list is empty, create a new arena. */
   if (list_empty (&d->free_list))
     {
       size_t i;
 
-      /* Allocate a page. */
-      a = palloc_get_page (0);
+      /* Allocate the arena's pages. */
+      a = palloc_get_multiple (0, d->arena_pages);
       if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
+        return NULL; 
+      for (i = 1; i < d->arena_pages; i++)
+        page_back[vtop (a) / PGSIZE + i] = i;
+      count_pages (d, d->arena_pages, true);
 
       /* Initialize arena and add its blocks to the free list. */
       a->magic = ARENA_MAGIC;
@@ -145,14 +351,97 @@ malloc (size_t size)
         }
     }
 
-  /* Get a block from free list and return it. */
+  /* Get a block from free list. */
   b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
   a = block_to_arena (b);
   a->free_cnt--;
-  lock_release (&d->lock);
   return b;
 }
 
+/* Returns block B to descriptor D's free list, giving its arena
+   back to the page allocator if the arena is now entirely
+   unused.  D's lock must be held. */
+static void
+desc_put (struct desc *d, struct block *b) 
+{
+  struct arena *a = block_to_arena (b);
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  /* Add block to free list. */
+  list_push_front (&d->free_list, &b->free_elem);
+
+  /* If the arena is now entirely unused, free it. */
+  if (++a->free_cnt >= d->blocks_per_arena) 
+    {
+      size_t i;
+
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_remove (&b->free_elem);
+        }
+      for (i = 1; i < d->arena_pages; i++)
+        page_back[vtop (a) / PGSIZE + i] = 0;
+      count_pages (d, d->arena_pages, false);
+      palloc_free_multiple (a, d->arena_pages);
+    }
+}
+
+/* Counts PAGE_CNT pages as added to, or if ADD is false removed
+   from, those held by an arena of D, or by a big block if D is
+   null. */
+static void
+count_pages (struct desc *d, size_t page_cnt, bool add) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (add)
+    held_pages += page_cnt;
+  else
+    held_pages -= page_cnt;
+  if (d != NULL && d->arena_pages > 1)
+    {
+      if (add)
+        multi_pages += page_cnt;
+      else
+        multi_pages -= page_cnt;
+    }
+  intr_set_level (old_level);
+}
+
+/* Moves up to CNT blocks from the top of magazine M's stack for
+   descriptor IDX back to the descriptor. */
+static void
+mag_flush (struct malloc_mag *m, size_t idx, size_t cnt) 
+{
+  struct desc *d = &descs[idx];
+
+  lock_acquire (&d->lock);
+  while (cnt-- > 0 && m->cnt[idx] > 0)
+    {
+      struct block *b = m->top[idx];
+      m->top[idx] = b->mag_next;
+      m->cnt[idx]--;
+      desc_put (d, b);
+    }
+  lock_release (&d->lock);
+}
+
+/* Returns every block cached in the current thread's magazines
+   to the shared free lists.  Called when a thread exits. */
+void
+malloc_flush (void) 
+{
+  struct malloc_mag *m = &thread_current ()->malloc_mag;
+  size_t idx;
+
+  for (idx = 0; idx < desc_cnt; idx++)
+    if (m->cnt[idx] > 0)
+      mag_flush (m, idx, m->cnt[idx]);
+}
+
 /* Allocates and return A times B bytes initialized to zeroes.
    Returns a null pointer if memory is not available. */
 void *
@@ -167,9 +456,10 @@ calloc (size_t a, size_t b)
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc (size);
+  p = alloc (size);
   if (p != NULL)
     memset (p, 0, size);
+  tag_add (p, size, __builtin_return_address (0));
 
   return p;
 }
@@ -185,12 +475,46 @@ block_size (void *block)
   return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
 
+/* Tries to make BLOCK hold at least SIZE bytes without moving
+   it.  Returns true if successful, false if BLOCK must move. */
+static bool
+resize_in_place (void *block, size_t size) 
+{
+  struct arena *a = block_to_arena (block);
+  size_t page_cnt;
+
+  if (a->desc != NULL)
+    return size <= a->desc->block_size;
+
+  page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
+  if (page_cnt < a->free_cnt)
+    {
+      /* Give back the unneeded pages at the end. */
+      palloc_free_multiple ((uint8_t *) a + page_cnt * PGSIZE,
+                            a->free_cnt - page_cnt);
+      count_pages (NULL, a->free_cnt - page_cnt, false);
+      a->free_cnt = page_cnt;
+    }
+  else if (page_cnt > a->free_cnt)
+    {
+      if (!palloc_extend (a, a->free_cnt, page_cnt))
+        return false;
+      count_pages (NULL, page_cnt - a->free_cnt, true);
+      a->free_cnt = page_cnt;
+    }
+  return true;
+}
+
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
    moving it in the process.
    If successful, returns the new block; on failure, returns a
    null pointer.
    A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
-   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK).
+
+   OLD_BLOCK is returned unchanged if NEW_SIZE still fits in it.
+   A block of whole pages can also shrink by freeing pages at its
+   end, or grow in place if the pages just past it are free. */
 void *
 realloc (void *old_block, size_t new_size) 
 {
@@ -199,9 +523,25 @@ realloc (void *old_block, size_t new_size)
       free (old_block);
       return NULL;
     }
+  else if (old_block != NULL && resize_in_place (old_block, new_size))
+    {
+      struct tag_block *t;
+      enum intr_level old_level = intr_disable ();
+
+      t = tag_find (old_block);
+      if (t != NULL)
+        {
+          t->site->live_bytes += new_size - t->size;
+          t->size = new_size;
+        }
+      intr_set_level (old_level);
+      return old_block;
+    }
   else 
     {
-      void *new_block = malloc (new_size);
+      void *new_block = alloc (new_size);
+
+      tag_add (new_block, new_size, __builtin_return_address (0));
       if (old_block != NULL && new_block != NULL)
         {
           size_t old_size = block_size (old_block);
@@ -223,40 +563,38 @@ free (void *p)
       struct block *b = p;
       struct arena *a = block_to_arena (b);
       struct desc *d = a->desc;
-      
+
+      tag_remove (p);
       if (d != NULL) 
         {
           /* It's a normal block.  We handle it here. */
+          struct malloc_mag *m = &thread_current ()->malloc_mag;
+          size_t idx = d - descs;
 
 #ifndef NDEBUG
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
-  
-          lock_acquire (&d->lock);
-
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
 
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          if (d->arena_pages > 1)
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
+              lock_acquire (&d->lock);
+              desc_put (d, b);
+              lock_release (&d->lock);
+              return;
             }
 
-          lock_release (&d->lock);
+          /* Make room in a full magazine, then push the block. */
+          if (m->cnt[idx] >= MAG_SIZE)
+            mag_flush (m, idx, MAG_BATCH);
+          b->mag_next = m->top[idx];
+          m->top[idx] = b;
+          m->cnt[idx]++;
         }
       else
         {
           /* It's a big block.  Free its pages. */
+          count_pages (NULL, a->free_cnt, false);
           palloc_free_multiple (a, a->free_cnt);
           return;
         }
@@ -267,15 +605,20 @@ free (void *p)
 static struct arena *
 block_to_arena (struct block *b)
 {
-  struct arena *a = pg_round_down (b);
+  uint8_t *page = pg_round_down (b);
+  struct arena *a;
+
+  /* Step back to the first page of a multi-page arena. */
+  ASSERT (page != NULL);
+  a = (struct arena *) (page - page_back[vtop (page) / PGSIZE] * PGSIZE);
 
   /* Check that the arena is valid. */
-  ASSERT (a != NULL);
   ASSERT (a->magic == ARENA_MAGIC);
 
   /* Check that the block is properly aligned for the arena. */
   ASSERT (a->desc == NULL
-          || (pg_ofs (b) - sizeof *a) % a->desc->block_size == 0);
+          || ((uint8_t *) b - (uint8_t *) a - sizeof *a)
+             % a->desc->block_size == 0);
   ASSERT (a->desc != NULL || pg_ofs (b) == sizeof *a);
 
   return a;
@@ -292,3 +635,145 @@ arena_to_block (struct arena *a, size_t idx)
                            + sizeof *a
                            + idx * a->desc->block_size);
 }
+
+/* Arranges for malloc_init() to start tagging allocations with
+   their call sites.  Must be called before malloc_init(). */
+void
+malloc_tag_start (void) 
+{
+  tag_requested = true;
+}
+
+/* Returns the slot in tag_blocks[] where a search for BLOCK
+   starts. */
+static size_t
+tag_hash (const void *block) 
+{
+  return ((uintptr_t) block >> 4) & (TAG_BLOCKS - 1);
+}
+
+/* Records that CALLER allocated SIZE bytes at BLOCK, if tagging
+   is on and BLOCK is not null. */
+static void
+tag_add (void *block, size_t size, void *caller) 
+{
+  struct tag_site *site = NULL;
+  enum intr_level old_level;
+  size_t i, n;
+
+  if (!tagging || block == NULL)
+    return;
+
+  old_level = intr_disable ();
+  tag_cnt++;
+
+  i = ((uintptr_t) caller >> 2) & (TAG_SITES - 1);
+  for (n = 0; n < TAG_SITES; n++, i = (i + 1) & (TAG_SITES - 1))
+    if (tag_sites[i].caller == 0 || tag_sites[i].caller == (uintptr_t) caller)
+      {
+        site = &tag_sites[i];
+        site->caller = (uintptr_t) caller;
+        site->alloc_cnt++;
+        break;
+      }
+
+  i = tag_hash (block);
+  for (n = 0; site != NULL && n < TAG_BLOCKS;
+       n++, i = (i + 1) & (TAG_BLOCKS - 1))
+    if (tag_blocks[i].block == NULL)
+      {
+        tag_blocks[i].block = block;
+        tag_blocks[i].size = size;
+        tag_blocks[i].site = site;
+        site->live_cnt++;
+        site->live_bytes += size;
+        intr_set_level (old_level);
+        return;
+      }
+  untracked_cnt++;
+  intr_set_level (old_level);
+}
+
+/* Returns BLOCK's entry in tag_blocks[], or a null pointer if it
+   is not tracked.  Interrupts must be off. */
+static struct tag_block *
+tag_find (void *block) 
+{
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (!tagging)
+    return NULL;
+
+  for (i = tag_hash (block); tag_blocks[i].block != NULL;
+       i = (i + 1) & (TAG_BLOCKS - 1))
+    if (tag_blocks[i].block == block)
+      return &tag_blocks[i];
+  return NULL;
+}
+
+/* Stops tracking BLOCK, which is being freed. */
+static void
+tag_remove (void *block) 
+{
+  struct tag_block *t;
+  enum intr_level old_level;
+  size_t hole, i;
+
+  if (!tagging)
+    return;
+
+  old_level = intr_disable ();
+  t = tag_find (block);
+  if (t != NULL)
+    {
+      t->site->live_cnt--;
+      t->site->live_bytes -= t->size;
+
+      /* Close the gap, so that searches never stop early: move
+         each following entry back into the hole unless the slot
+         it hashes to lies after the hole. */
+      hole = t - tag_blocks;
+      for (i = (hole + 1) & (TAG_BLOCKS - 1); tag_blocks[i].block != NULL;
+           i = (i + 1) & (TAG_BLOCKS - 1))
+        {
+          size_t home = tag_hash (tag_blocks[i].block);
+          if (((i - home) & (TAG_BLOCKS - 1))
+              >= ((i - hole) & (TAG_BLOCKS - 1)))
+            {
+              tag_blocks[hole] = tag_blocks[i];
+              hole = i;
+            }
+        }
+      tag_blocks[hole].block = NULL;
+    }
+  intr_set_level (old_level);
+}
+
+/* Prints the allocation sites, and how much of the memory
+   malloc() holds was requested, if tagging is on. */
+void
+malloc_print_stats (void) 
+{
+  size_t live_bytes = 0;
+  size_t held_bytes = held_pages * PGSIZE;
+  size_t i;
+
+  if (!tagging)
+    return;
+  printf ("Malloc: %llu allocations tagged, %llu not tracked\n",
+          tag_cnt, untracked_cnt);
+  for (i = 0; i < TAG_SITES; i++)
+    live_bytes += tag_sites[i].live_bytes;
+  printf ("Malloc: %zu bytes live in %zu pages (%zu in multi-page "
+          "arenas), %zu%% wasted\n",
+          live_bytes, held_pages, multi_pages,
+          held_bytes > live_bytes
+          ? (held_bytes - live_bytes) * 100 / held_bytes : 0);
+  for (i = 0; i < TAG_SITES; i++)
+    if (tag_sites[i].caller != 0)
+      printf ("Malloc: %"PRIu32" calls, %"PRIu32" live, %zu bytes "
+              "from 0x%08"PRIxPTR"\n",
+              tag_sites[i].alloc_cnt, tag_sites[i].live_cnt,
+              tag_sites[i].live_bytes, tag_sites[i].caller);
+}
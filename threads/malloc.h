@@ -3,11 +3,27 @@
 
 #include <debug.h>
 #include <stddef.h>
+#include <stdint.h>
+
+/* Maximum number of block-size descriptors. */
+#define MALLOC_DESC_MAX 20
+
+/* Per-thread cache of recently freed blocks, one stack per
+   descriptor.  Only the owning thread touches it, so the common
+   malloc()/free() pair needs no lock. */
+struct malloc_mag
+  {
+    void *top[MALLOC_DESC_MAX];         /* Most recently freed block. */
+    uint8_t cnt[MALLOC_DESC_MAX];       /* Number of cached blocks. */
+  };
 
 void malloc_init (void);
+void malloc_flush (void);
 void *malloc (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
 void free (void *);
+void malloc_tag_start (void);
+void malloc_print_stats (void);
 
 #endif /* threads/malloc.h */
@@ -2,13 +2,15 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/copy.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,22 +25,94 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is managed as a binary buddy system.  Free pages are
+   kept in blocks of 2**K pages, for K from 0 to MAX_ORDER, each
+   aligned to a multiple of its size relative to the pool base,
+   on one free list per order.  An allocation takes the smallest
+   free block that is big enough, splitting larger blocks as
+   needed, and gives back whatever it does not use.  A freed block
+   merges with its "buddy", the other half of the block of twice
+   its size, whenever the buddy is free too.  Allocating or
+   freeing one page is O(MAX_ORDER).
+
+   Pool operations are short, so they run with interrupts off
+   rather than under a lock.  That also makes it safe to free
+   pages from the scheduler, as thread.c does.
+
+   Each pool also keeps a small stock of single pages that are
+   already zeroed, which the idle thread tops up by calling
+   palloc_prezero() instead of halting.  A one-page PAL_ZERO
+   request, such as a new thread's page or a process's first
+   stack page, takes one of those instead of clearing 4 kB
+   itself.  The stock is handed back to the buddy lists if the
+   pool otherwise runs dry.
+
+   Caches that hold pages they could do without register a
+   shrinker.  When an allocation fails, and the caller could
+   sleep, palloc calls the shrinkers in priority order, retrying
+   after each one that frees something, before giving up. */
+
+/* Most pre-zeroed pages kept in a pool. */
+#define ZEROED_MAX 32
+
+/* Largest block order.  Larger requests fail. */
+#define MAX_ORDER 10
+#define ORDER_CNT (MAX_ORDER + 1)
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    struct bitmap *used_map;            /* Bitmap of allocated pages. */
+    uint8_t *free_order;                /* Per page: 1 + order, if the page
+                                           starts a free block, else 0. */
+    struct list free[ORDER_CNT];        /* Free blocks of each order. */
+    unsigned nonempty;                  /* Bit K set if free[K] nonempty. */
+    size_t page_cnt;                    /* Number of pages. */
     uint8_t *base;                      /* Base of pool. */
+    struct list zeroed;                 /* Pre-zeroed pages. */
+    size_t zeroed_cnt;                  /* Number of pages in zeroed. */
+    size_t zeroed_max;                  /* Most pages to keep in zeroed. */
+    const char *name;                   /* Name, for statistics. */
+
+    /* Statistics. */
+    unsigned long long alloc_cnt;       /* Successful allocations. */
+    unsigned long long free_cnt;        /* Frees. */
+    unsigned long long fail_cnt;        /* Failed allocations. */
+    unsigned long long zeroed_hits;     /* Served from zeroed. */
+    unsigned long long reclaim_cnt;     /* Saved by a shrinker. */
+    size_t used_pages;                  /* Pages handed out now. */
+    size_t used_max;                    /* High-water mark of used_pages. */
+  };
+
+/* A free block.  Stored in the first page of the block. */
+struct free_block
+  {
+    struct list_elem elem;              /* Element in free list. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* Registered shrinkers, highest priority first. */
+static struct list shrinkers = LIST_INITIALIZER (shrinkers);
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t pool_alloc (struct pool *, size_t page_cnt);
+static void pool_free (struct pool *, size_t page_idx, size_t page_cnt);
+static bool pool_claim (struct pool *, size_t page_idx, size_t page_cnt);
+static size_t pool_claim_aligned (struct pool *, size_t page_cnt,
+                                  size_t align);
+static void *take_zeroed (struct pool *);
+static bool drain_zeroed (struct pool *);
+static size_t pool_alloc_any (struct pool *, size_t page_cnt);
+static size_t reclaim (struct pool *, enum palloc_flags, size_t page_cnt);
+static list_less_func shrinker_higher;
+static void count_alloc (struct pool *, size_t page_cnt);
+static void print_pool_stats (struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -71,15 +145,36 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
   void *pages;
   size_t page_idx;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  old_level = intr_disable ();
+  if (page_cnt == 1 && (flags & PAL_ZERO)
+      && (pages = take_zeroed (pool)) != NULL)
+    {
+      pool->zeroed_hits++;
+      count_alloc (pool, 1);
+      intr_set_level (old_level);
+      return pages;
+    }
+  page_idx = pool_alloc_any (pool, page_cnt);
+  intr_set_level (old_level);
+
+  /* Ask the shrinkers for memory, unless the caller is in no
+     position to wait for them. */
+  if (page_idx == BITMAP_ERROR && old_level == INTR_ON && !intr_context ())
+    page_idx = reclaim (pool, flags, page_cnt);
+
+  old_level = intr_disable ();
+  if (page_idx != BITMAP_ERROR)
+    count_alloc (pool, page_cnt);
+  else
+    pool->fail_cnt++;
+  intr_set_level (old_level);
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
@@ -89,7 +184,7 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   if (pages != NULL) 
     {
       if (flags & PAL_ZERO)
-        memset (pages, 0, PGSIZE * page_cnt);
+        block_zero (pages, PGSIZE * page_cnt);
     }
   else 
     {
@@ -100,6 +195,46 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   return pages;
 }
 
+/* Obtains PAGE_CNT contiguous free pages, as
+   palloc_get_multiple() does, whose physical address is a
+   multiple of ALIGN pages, a power of 2.  Buddy blocks are only
+   aligned relative to the pool base, so this looks for a free
+   run at each aligned address in turn.  It does not call the
+   shrinkers: it is for callers, such as huge page promotion,
+   that can do without the memory. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt, size_t align)
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
+  size_t page_idx;
+  void *pages;
+
+  ASSERT (align > 0 && (align & (align - 1)) == 0);
+  if (page_cnt == 0)
+    return NULL;
+
+  old_level = intr_disable ();
+  page_idx = pool_claim_aligned (pool, page_cnt, align);
+  if (page_idx == BITMAP_ERROR && drain_zeroed (pool))
+    page_idx = pool_claim_aligned (pool, page_cnt, align);
+  if (page_idx != BITMAP_ERROR)
+    count_alloc (pool, page_cnt);
+  else
+    pool->fail_cnt++;
+  intr_set_level (old_level);
+
+  pages = page_idx != BITMAP_ERROR ? pool->base + PGSIZE * page_idx : NULL;
+  if (pages != NULL)
+    {
+      if (flags & PAL_ZERO)
+        block_zero (pages, PGSIZE * page_cnt);
+    }
+  else if (flags & PAL_ASSERT)
+    PANIC ("palloc_get: out of pages");
+  return pages;
+}
+
 /* Obtains a single free page and returns its kernel virtual
    address.
    If PAL_USER is set, the page is obtained from the user pool,
@@ -119,6 +254,7 @@ palloc_free_multiple (void *pages, size_t page_cnt)
 {
   struct pool *pool;
   size_t page_idx;
+  enum intr_level old_level;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
@@ -137,8 +273,91 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = intr_disable ();
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  pool_free (pool, page_idx, page_cnt);
+  pool->free_cnt++;
+  pool->used_pages -= page_cnt;
+  intr_set_level (old_level);
+}
+
+/* Frees the CNT single pages whose addresses are in PAGES[].
+   This does the work of CNT calls to palloc_free_page() with
+   interrupts turned off only once, for callers such as
+   pagedir_destroy() that free many scattered pages at a time.
+   The pages may come from either pool. */
+void
+palloc_free_pages (void *pages[], size_t cnt) 
+{
+  enum intr_level old_level;
+  size_t i;
+
+#ifndef NDEBUG
+  for (i = 0; i < cnt; i++)
+    memset (pages[i], 0xcc, PGSIZE);
+#endif
+
+  old_level = intr_disable ();
+  for (i = 0; i < cnt; i++) 
+    {
+      struct pool *pool;
+      size_t page_idx;
+
+      ASSERT (pages[i] != NULL && pg_ofs (pages[i]) == 0);
+      if (page_from_pool (&user_pool, pages[i]))
+        pool = &user_pool;
+      else if (page_from_pool (&kernel_pool, pages[i]))
+        pool = &kernel_pool;
+      else
+        NOT_REACHED ();
+
+      page_idx = pg_no (pages[i]) - pg_no (pool->base);
+      ASSERT (bitmap_test (pool->used_map, page_idx));
+      bitmap_reset (pool->used_map, page_idx);
+      pool_free (pool, page_idx, 1);
+      pool->free_cnt++;
+      pool->used_pages--;
+    }
+  intr_set_level (old_level);
+}
+
+/* Tries to grow the PAGE_CNT-page block at PAGES, which must
+   have come from palloc_get_multiple(), to NEW_CNT pages without
+   moving it.  Succeeds, returning true, only if the NEW_CNT -
+   PAGE_CNT pages just past the block are all free. */
+bool
+palloc_extend (void *pages, size_t page_cnt, size_t new_cnt) 
+{
+  struct pool *pool;
+  size_t page_idx;
+  enum intr_level old_level;
+  bool success;
+
+  ASSERT (pg_ofs (pages) == 0);
+  ASSERT (new_cnt >= page_cnt);
+  if (new_cnt == page_cnt)
+    return true;
+
+  if (page_from_pool (&kernel_pool, pages))
+    pool = &kernel_pool;
+  else if (page_from_pool (&user_pool, pages))
+    pool = &user_pool;
+  else
+    NOT_REACHED ();
+
+  page_idx = pg_no (pages) - pg_no (pool->base);
+  old_level = intr_disable ();
+  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+  success = pool_claim (pool, page_idx + page_cnt, new_cnt - page_cnt);
+  if (success)
+    {
+      pool->used_pages += new_cnt - page_cnt;
+      if (pool->used_pages > pool->used_max)
+        pool->used_max = pool->used_pages;
+    }
+  intr_set_level (old_level);
+  return success;
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +367,294 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Returns the first page of the user pool, and stores the number
+   of pages in the pool into *PAGE_CNT. */
+void *
+palloc_user_pool (size_t *page_cnt) 
+{
+  *page_cnt = user_pool.page_cnt;
+  return user_pool.base;
+}
+
+/* Returns the number of free pages in the user pool. */
+size_t
+palloc_user_free (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  size_t free_pages = user_pool.page_cnt - user_pool.used_pages;
+  intr_set_level (old_level);
+  return free_pages;
+}
+
+/* Returns the number of pages in use in the kernel pool. */
+size_t
+palloc_kernel_used (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  size_t used_pages = kernel_pool.used_pages;
+  intr_set_level (old_level);
+  return used_pages;
+}
+
+/* Adds shrinker S to the list called under memory pressure.
+   Shrinkers are meant to be registered during initialization and
+   never removed. */
+void
+palloc_register_shrinker (struct palloc_shrinker *s) 
+{
+  enum intr_level old_level;
+
+  ASSERT (s != NULL);
+  ASSERT (s->shrink != NULL);
+
+  old_level = intr_disable ();
+  list_insert_ordered (&shrinkers, &s->elem, shrinker_higher, NULL);
+  intr_set_level (old_level);
+}
+
+/* Returns true if shrinker A has higher priority than B. */
+static bool
+shrinker_higher (const struct list_elem *a_, const struct list_elem *b_,
+                 void *aux UNUSED) 
+{
+  const struct palloc_shrinker *a
+    = list_entry (a_, struct palloc_shrinker, elem);
+  const struct palloc_shrinker *b
+    = list_entry (b_, struct palloc_shrinker, elem);
+
+  return a->priority > b->priority;
+}
+
+/* Allocates PAGE_CNT pages from POOL, falling back on its
+   pre-zeroed stock if the buddy lists alone cannot do it.
+   Returns the index of the first page, or BITMAP_ERROR.
+   Interrupts must be off. */
+static size_t
+pool_alloc_any (struct pool *pool, size_t page_cnt) 
+{
+  size_t page_idx = pool_alloc (pool, page_cnt);
+
+  if (page_idx == BITMAP_ERROR && drain_zeroed (pool))
+    page_idx = pool_alloc (pool, page_cnt);
+  return page_idx;
+}
+
+/* Calls the shrinkers in priority order, asking each to free
+   PAGE_CNT pages for POOL, and retries the allocation after each
+   one that frees anything.  Returns the index of the first page
+   allocated, or BITMAP_ERROR if the shrinkers could not help.
+   Interrupts must be on. */
+static size_t
+reclaim (struct pool *pool, enum palloc_flags flags, size_t page_cnt) 
+{
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  for (e = list_begin (&shrinkers); e != list_end (&shrinkers);
+       e = list_next (e))
+    {
+      struct palloc_shrinker *s
+        = list_entry (e, struct palloc_shrinker, elem);
+      enum intr_level old_level;
+      size_t page_idx;
+
+      if (s->shrink (flags & PAL_USER, page_cnt, s->aux) == 0)
+        continue;
+
+      old_level = intr_disable ();
+      page_idx = pool_alloc_any (pool, page_cnt);
+      if (page_idx != BITMAP_ERROR)
+        pool->reclaim_cnt++;
+      intr_set_level (old_level);
+      if (page_idx != BITMAP_ERROR)
+        return page_idx;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void) 
+{
+  print_pool_stats (&kernel_pool);
+  print_pool_stats (&user_pool);
+}
+
+/* Records a successful allocation of PAGE_CNT pages from POOL.
+   Interrupts must be off. */
+static void
+count_alloc (struct pool *pool, size_t page_cnt) 
+{
+  pool->alloc_cnt++;
+  pool->used_pages += page_cnt;
+  if (pool->used_pages > pool->used_max)
+    pool->used_max = pool->used_pages;
+}
+
+/* Prints statistics for POOL, including how fragmented its free
+   memory is: the largest block the buddy lists can hand out and
+   the longest run of free pages, which can be longer when it
+   straddles block boundaries. */
+static void
+print_pool_stats (struct pool *pool) 
+{
+  struct pool snap;
+  size_t free_pages, longest, run, i;
+  size_t orders[ORDER_CNT];
+  enum intr_level old_level;
+  int order;
+
+  old_level = intr_disable ();
+  snap = *pool;
+  free_pages = longest = run = 0;
+  for (order = 0; order < ORDER_CNT; order++)
+    {
+      orders[order] = list_size (&pool->free[order]);
+      free_pages += orders[order] << order;
+    }
+  for (i = 0; i < pool->page_cnt; i++)
+    if (!bitmap_test (pool->used_map, i))
+      {
+        if (++run > longest)
+          longest = run;
+      }
+    else
+      run = 0;
+  intr_set_level (old_level);
+
+  for (order = MAX_ORDER; order >= 0 && orders[order] == 0; order--)
+    continue;
+  printf ("%s: %zu pages, %zu in use (max %zu), %zu free, "
+          "%zu pre-zeroed\n",
+          snap.name, snap.page_cnt, snap.used_pages, snap.used_max,
+          free_pages, snap.zeroed_cnt);
+  printf ("  largest free block %zu pages, longest free run %zu pages\n",
+          order >= 0 ? (size_t) 1 << order : 0, longest);
+  printf ("  %llu allocs (%llu pre-zeroed, %llu after reclaim), "
+          "%llu frees, %llu failures\n",
+          snap.alloc_cnt, snap.zeroed_hits, snap.reclaim_cnt,
+          snap.free_cnt, snap.fail_cnt);
+}
+
+/* Zeroes one free page and adds it to a pool's stock of
+   pre-zeroed pages, if any pool is short.  Returns true if it did
+   so, false if every stock is full or no page could be spared.
+   Meant to be called from the idle thread with interrupts on. */
+bool
+palloc_prezero (void) 
+{
+  struct pool *pools[] = { &kernel_pool, &user_pool };
+  size_t i;
+
+  for (i = 0; i < sizeof pools / sizeof *pools; i++)
+    {
+      struct pool *pool = pools[i];
+      enum intr_level old_level;
+      size_t page_idx;
+      void *page;
+
+      if (pool->zeroed_cnt >= pool->zeroed_max)
+        continue;
+
+      old_level = intr_disable ();
+      page_idx = pool_alloc (pool, 1);
+      intr_set_level (old_level);
+      if (page_idx == BITMAP_ERROR)
+        continue;
+
+      /* The page is ours alone until it goes on the list, so it
+         is cleared with interrupts on. */
+      page = pool->base + PGSIZE * page_idx;
+      block_zero (page, PGSIZE);
+
+      old_level = intr_disable ();
+      list_push_front (&pool->zeroed, &((struct free_block *) page)->elem);
+      pool->zeroed_cnt++;
+      intr_set_level (old_level);
+      return true;
+    }
+  return false;
+}
+
+/* Removes and returns a page from POOL's stock of pre-zeroed
+   pages, or a null pointer if the stock is empty.  Interrupts
+   must be off. */
+static void *
+take_zeroed (struct pool *pool) 
+{
+  struct free_block *b;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (list_empty (&pool->zeroed))
+    return NULL;
+  b = list_entry (list_pop_front (&pool->zeroed), struct free_block, elem);
+  pool->zeroed_cnt--;
+
+  /* Only the list element was written since the page was
+     cleared. */
+  memset (b, 0, sizeof *b);
+  return b;
+}
+
+/* Returns all of POOL's pre-zeroed pages to its free lists.
+   Returns true if there were any.  Interrupts must be off. */
+static bool
+drain_zeroed (struct pool *pool) 
+{
+  bool any = !list_empty (&pool->zeroed);
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (!list_empty (&pool->zeroed))
+    {
+      uint8_t *page = (uint8_t *) list_pop_front (&pool->zeroed);
+      size_t page_idx = (page - pool->base) / PGSIZE;
+
+      bitmap_reset (pool->used_map, page_idx);
+      pool_free (pool, page_idx, 1);
+    }
+  pool->zeroed_cnt = 0;
+  return any;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
+  /* We'll put the pool's used_map and free_order array at its
+     base.  Calculate the space needed for them and subtract it
+     from the pool's size. */
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t meta_pages = DIV_ROUND_UP (bm_size + page_cnt, PGSIZE);
+  int i;
+
+  if (meta_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  page_cnt -= meta_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  /* Initialize the pool with every page allocated, then free
+     them all into the buddy lists. */
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->free_order = (uint8_t *) base + bm_size;
+  memset (p->free_order, 0, page_cnt);
+  for (i = 0; i < ORDER_CNT; i++)
+    list_init (&p->free[i]);
+  p->nonempty = 0;
+  p->page_cnt = page_cnt;
+  p->base = base + meta_pages * PGSIZE;
+  list_init (&p->zeroed);
+  p->zeroed_cnt = 0;
+  p->name = name;
+  p->alloc_cnt = p->free_cnt = p->fail_cnt = p->zeroed_hits = 0;
+  p->reclaim_cnt = 0;
+  p->used_pages = p->used_max = 0;
+  p->zeroed_max = page_cnt / 16 < ZEROED_MAX ? page_cnt / 16 : ZEROED_MAX;
+  pool_free (p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +664,182 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the free block header for page PAGE_IDX of POOL. */
+static struct free_block *
+block_at (struct pool *pool, size_t page_idx) 
+{
+  return (struct free_block *) (pool->base + page_idx * PGSIZE);
+}
+
+/* Adds the free block of 2**ORDER pages at PAGE_IDX to POOL's
+   free lists. */
+static void
+push_block (struct pool *pool, size_t page_idx, int order) 
+{
+  pool->free_order[page_idx] = order + 1;
+  list_push_front (&pool->free[order], &block_at (pool, page_idx)->elem);
+  pool->nonempty |= 1u << order;
+}
+
+/* Removes the free block of 2**ORDER pages at PAGE_IDX from
+   POOL's free lists. */
+static void
+remove_block (struct pool *pool, size_t page_idx, int order) 
+{
+  pool->free_order[page_idx] = 0;
+  list_remove (&block_at (pool, page_idx)->elem);
+  if (list_empty (&pool->free[order]))
+    pool->nonempty &= ~(1u << order);
+}
+
+/* Returns the smallest order whose blocks hold PAGE_CNT pages,
+   or ORDER_CNT if PAGE_CNT pages are too many. */
+static int
+order_for (size_t page_cnt) 
+{
+  int order = 0;
+
+  while (order < ORDER_CNT && ((size_t) 1 << order) < page_cnt)
+    order++;
+  return order;
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first one, or BITMAP_ERROR if no free block is
+   big enough.  Interrupts must be off. */
+static size_t
+pool_alloc (struct pool *pool, size_t page_cnt) 
+{
+  int want = order_for (page_cnt);
+  unsigned candidates;
+  size_t page_idx;
+  int order;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (want >= ORDER_CNT)
+    return BITMAP_ERROR;
+  candidates = pool->nonempty & ~((1u << want) - 1);
+  if (candidates == 0)
+    return BITMAP_ERROR;
+
+  /* Take the smallest big-enough block. */
+  order = __builtin_ctz (candidates);
+  page_idx = (uint8_t *) list_front (&pool->free[order]) - pool->base;
+  page_idx /= PGSIZE;
+  remove_block (pool, page_idx, order);
+
+  /* Split it down to the order we want, freeing upper halves. */
+  while (order > want)
+    {
+      order--;
+      push_block (pool, page_idx + ((size_t) 1 << order), order);
+    }
+
+  /* Give back the pages beyond PAGE_CNT. */
+  pool_free (pool, page_idx + page_cnt, ((size_t) 1 << want) - page_cnt);
+  ASSERT (!bitmap_any (pool->used_map, page_idx, page_cnt));
+  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+  return page_idx;
+}
+
+/* Returns the PAGE_CNT pages starting at PAGE_IDX to POOL's free
+   lists, splitting them into the largest aligned blocks possible
+   and merging each with its buddy while the buddy is free.
+   Interrupts must be off, or the pool not yet in use. */
+static void
+pool_free (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  while (page_cnt > 0)
+    {
+      size_t idx = page_idx;
+      int order = 0;
+
+      /* Largest block that starts at PAGE_IDX, is aligned, and
+         fits in PAGE_CNT. */
+      while (order < MAX_ORDER
+             && (page_idx & ((size_t) 1 << order)) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+
+      /* Merge with free buddies. */
+      for (; order < MAX_ORDER; order++)
+        {
+          size_t buddy = idx ^ ((size_t) 1 << order);
+
+          if (buddy + ((size_t) 1 << order) > pool->page_cnt
+              || pool->free_order[buddy] != order + 1)
+            break;
+          remove_block (pool, buddy, order);
+          if (buddy < idx)
+            idx = buddy;
+        }
+      push_block (pool, idx, order);
+    }
+}
+
+/* Allocates the particular PAGE_CNT pages starting at PAGE_IDX
+   from POOL, if they are all free, and returns true.  Otherwise,
+   returns false without changing anything.  Each free block that
+   overlaps the range is taken off its list and whatever part of
+   it lies outside the range is freed again.  Interrupts must be
+   off. */
+static bool
+pool_claim (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  size_t end = page_idx + page_cnt;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (end > pool->page_cnt || end < page_idx
+      || bitmap_any (pool->used_map, page_idx, page_cnt))
+    return false;
+
+  while (page_idx < end)
+    {
+      size_t start = page_idx, block_end, claim_end;
+      int order;
+
+      /* Find the free block that contains PAGE_IDX. */
+      for (order = 0; order < ORDER_CNT; order++)
+        {
+          start = page_idx & ~(((size_t) 1 << order) - 1);
+          if (pool->free_order[start] == order + 1)
+            break;
+        }
+      ASSERT (order < ORDER_CNT);
+      remove_block (pool, start, order);
+
+      /* Keep the part inside the range, free the rest. */
+      block_end = start + ((size_t) 1 << order);
+      claim_end = block_end < end ? block_end : end;
+      bitmap_set_multiple (pool->used_map, page_idx, claim_end - page_idx,
+                           true);
+      pool_free (pool, start, page_idx - start);
+      pool_free (pool, claim_end, block_end - claim_end);
+      page_idx = claim_end;
+    }
+  return true;
+}
+
+/* Allocates PAGE_CNT free pages from POOL whose physical address
+   is a multiple of ALIGN pages, trying each aligned run in turn.
+   Returns the index of the first page, or BITMAP_ERROR.
+   Interrupts must be off. */
+static size_t
+pool_claim_aligned (struct pool *pool, size_t page_cnt, size_t align) 
+{
+  size_t page_idx = (align - vtop (pool->base) / PGSIZE % align) % align;
+
+  for (; page_idx + page_cnt <= pool->page_cnt; page_idx += align)
+    if (pool_claim (pool, page_idx, page_cnt))
+      return page_idx;
+  return BITMAP_ERROR;
+}
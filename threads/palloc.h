@@ -1,6 +1,8 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
+#include <list.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -11,10 +13,37 @@ enum palloc_flags
     PAL_USER = 004              /* User page. */
   };
 
+/* Memory-pressure callback.  Asked to give back about PAGE_CNT
+   pages to the pool named by FLAGS (PAL_USER or not), and
+   returns how many it freed.  Runs with interrupts on, in the
+   thread whose allocation failed, which may hold any lock, so it
+   must not block on one (lock_try_acquire() is fine). */
+typedef size_t palloc_shrink_func (enum palloc_flags flags,
+                                   size_t page_cnt, void *aux);
+
+/* A registered shrinker. */
+struct palloc_shrinker
+  {
+    const char *name;                   /* Name, for debugging. */
+    int priority;                       /* Higher runs first. */
+    palloc_shrink_func *shrink;         /* Callback. */
+    void *aux;                          /* Passed to SHRINK. */
+    struct list_elem elem;              /* Element in shrinker list. */
+  };
+
 void palloc_init (size_t user_page_limit);
+void palloc_register_shrinker (struct palloc_shrinker *);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
+void *palloc_get_aligned (enum palloc_flags, size_t page_cnt, size_t align);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+void palloc_free_pages (void *pages[], size_t cnt);
+void *palloc_user_pool (size_t *page_cnt);
+size_t palloc_user_free (void);
+size_t palloc_kernel_used (void);
+bool palloc_extend (void *, size_t page_cnt, size_t new_cnt);
+bool palloc_prezero (void);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
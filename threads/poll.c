@@ -0,0 +1,84 @@
+#include "threads/poll.h"
+#include <debug.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+
+/* Initializes Q as an empty poll queue. */
+void
+poll_queue_init (struct poll_queue *q) 
+{
+  list_init (&q->hooks);
+}
+
+/* Wakes every poller on Q.  May be called from an interrupt
+   handler. */
+void
+poll_wake (struct poll_queue *q) 
+{
+  enum intr_level old_level = intr_disable ();
+  struct list_elem *e;
+
+  for (e = list_begin (&q->hooks); e != list_end (&q->hooks);
+       e = list_next (e))
+    sema_up (&list_entry (e, struct poll_hook, elem)->poller->sema);
+  intr_set_level (old_level);
+}
+
+/* Initializes P as a poller that can be hooked onto up to
+   HOOK_MAX queues, using HOOKS, an array of that many elements,
+   which must last until poller_destroy(). */
+void
+poller_init (struct poller *p, struct poll_hook *hooks, size_t hook_max) 
+{
+  sema_init (&p->sema, 0);
+  p->hooks = hooks;
+  p->hook_max = hook_max;
+  p->hook_cnt = 0;
+}
+
+/* Hooks P onto Q.  Q must last until P is destroyed. */
+void
+poller_add (struct poller *p, struct poll_queue *q) 
+{
+  struct poll_hook *h;
+  enum intr_level old_level;
+
+  ASSERT (p->hook_cnt < p->hook_max);
+
+  h = &p->hooks[p->hook_cnt++];
+  h->poller = p;
+  old_level = intr_disable ();
+  list_push_back (&q->hooks, &h->elem);
+  intr_set_level (old_level);
+}
+
+/* Waits until one of P's queues is woken, unless one has been
+   since P last waited, or until timer_ticks() reaches DEADLINE,
+   if DEADLINE is nonnegative.  The caller must check for itself
+   what became ready, if anything did. */
+void
+poller_wait (struct poller *p, int64_t deadline) 
+{
+  if (deadline < 0)
+    sema_down (&p->sema);
+  else if (!sema_down_timeout (&p->sema, deadline - timer_ticks ()))
+    return;
+
+  /* Several wakeups may have piled up.  One check covers them
+     all. */
+  while (sema_try_down (&p->sema))
+    continue;
+}
+
+/* Unhooks P from all of its queues. */
+void
+poller_destroy (struct poller *p) 
+{
+  enum intr_level old_level = intr_disable ();
+  size_t i;
+
+  for (i = 0; i < p->hook_cnt; i++)
+    list_remove (&p->hooks[i].elem);
+  intr_set_level (old_level);
+  p->hook_cnt = 0;
+}
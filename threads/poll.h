@@ -0,0 +1,55 @@
+#ifndef THREADS_POLL_H
+#define THREADS_POLL_H
+
+#include <list.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/synch.h"
+
+/* Waiting for the first of several events.
+
+   Anything that a thread may want to wait for alongside other
+   things keeps a poll queue, and calls poll_wake() on it
+   whenever it might have become ready.  A thread that wants to
+   wait for several of them sets up one poller, hooks it onto
+   each of their queues with poller_add(), and then alternates
+   between checking whether any is ready and poller_wait().
+   Since poller_wait() returns at once if anything was woken
+   since the poller was hooked on or last waited, checking after
+   hooking on never misses a wakeup.
+
+   Queues are protected by turning interrupts off, so that
+   interrupt handlers can call poll_wake(). */
+
+/* A queue of pollers. */
+struct poll_queue
+  {
+    struct list hooks;          /* struct poll_hook's. */
+  };
+
+/* One poller's place on one queue. */
+struct poll_hook
+  {
+    struct list_elem elem;      /* Element in a queue's `hooks'. */
+    struct poller *poller;      /* The poller. */
+  };
+
+/* A thread waiting for any of several queues. */
+struct poller
+  {
+    struct semaphore sema;      /* Upped by poll_wake(). */
+    struct poll_hook *hooks;    /* Array of HOOK_MAX hooks. */
+    size_t hook_max;            /* Number of elements in HOOKS. */
+    size_t hook_cnt;            /* Number in use. */
+  };
+
+void poll_queue_init (struct poll_queue *);
+void poll_wake (struct poll_queue *);
+
+void poller_init (struct poller *, struct poll_hook *hooks,
+                  size_t hook_max);
+void poller_add (struct poller *, struct poll_queue *);
+void poller_wait (struct poller *, int64_t deadline);
+void poller_destroy (struct poller *);
+
+#endif /* threads/poll.h */
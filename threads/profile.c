@@ -0,0 +1,94 @@
+#include "threads/profile.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Number of entries in the table.  Must be a power of 2. */
+#define PROFILE_SLOTS 1024
+
+/* Samples taken at one instruction, in one mode, by one thread. */
+struct profile_entry
+  {
+    uintptr_t eip;              /* Instruction address. */
+    int32_t key;                /* Running thread's tid times 2,
+                                   plus 1 for user mode. */
+    uint32_t count;             /* Samples; 0 if the entry is free. */
+  };
+
+/* The table, open addressed with linear probing.  Only the
+   timer interrupt writes it. */
+static struct profile_entry table[PROFILE_SLOTS];
+
+static int interval;            /* Ticks per sample, or 0 if off. */
+static int countdown;           /* Ticks until the next sample. */
+static unsigned long long sample_cnt;   /* Samples taken. */
+static unsigned long long user_cnt;     /* ...in user mode. */
+static unsigned long long drop_cnt;     /* ...not counted, table full. */
+
+/* Starts sampling every INTERVAL timer ticks. */
+void
+profile_start (int interval_) 
+{
+  ASSERT (interval_ > 0);
+  interval = countdown = interval_;
+}
+
+/* Called by the timer interrupt handler with the frame it
+   interrupted. */
+void
+profile_sample (const struct intr_frame *f) 
+{
+  int32_t key;
+  bool user;
+  size_t i, n;
+
+  ASSERT (intr_context ());
+  if (interval == 0 || --countdown > 0)
+    return;
+  countdown = interval;
+
+  user = (f->cs & 3) == 3;
+  key = thread_current ()->tid * 2 + user;
+  sample_cnt++;
+  if (user)
+    user_cnt++;
+
+  i = ((uintptr_t) f->eip >> 2 ^ key) & (PROFILE_SLOTS - 1);
+  for (n = 0; n < PROFILE_SLOTS; n++, i = (i + 1) & (PROFILE_SLOTS - 1))
+    {
+      struct profile_entry *e = &table[i];
+
+      if (e->count == 0)
+        {
+          e->eip = (uintptr_t) f->eip;
+          e->key = key;
+        }
+      if (e->eip == (uintptr_t) f->eip && e->key == key)
+        {
+          e->count++;
+          return;
+        }
+    }
+  drop_cnt++;
+}
+
+/* Prints the samples, if profiling is on. */
+void
+profile_print (void) 
+{
+  size_t i;
+
+  if (interval == 0)
+    return;
+  printf ("Profile: %llu samples every %d ticks, %llu in user mode, "
+          "%llu dropped\n", sample_cnt, interval, user_cnt, drop_cnt);
+  for (i = 0; i < PROFILE_SLOTS; i++)
+    if (table[i].count != 0)
+      printf ("Profile: %"PRIu32" %s %"PRId32" 0x%08"PRIxPTR"\n",
+              table[i].count, table[i].key & 1 ? "user" : "kernel",
+              table[i].key / 2, table[i].eip);
+}
@@ -0,0 +1,20 @@
+#ifndef THREADS_PROFILE_H
+#define THREADS_PROFILE_H
+
+/* Sampling profiler.
+
+   When enabled with the "-profile" option, the timer interrupt
+   samples the interrupted instruction every so many ticks, and
+   counts the samples in a fixed table keyed by instruction
+   address, by whether the CPU was in user or kernel mode, and by
+   the running thread.  The table is printed at shutdown, one
+   "Profile:" line per entry; "backtrace --profile" turns those
+   lines into a flat profile of kernel functions. */
+
+struct intr_frame;
+
+void profile_start (int interval);
+void profile_sample (const struct intr_frame *);
+void profile_print (void);
+
+#endif /* threads/profile.h */
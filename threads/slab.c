@@ -0,0 +1,366 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Each slab is one page: a struct slab header followed by the
+   object slots.  A free slot holds a pointer to the next free
+   slot in the same slab.  For caches with a constructor, the
+   pointer follows the object rather than overlaying it, so that
+   freeing does not destroy the constructed state.
+
+   A cache keeps its slabs on three lists, by how many of their
+   objects are in use, and allocates from partial slabs first to
+   keep the number of slabs down.  It keeps at most one empty
+   slab around for reuse; other slabs that become empty go back
+   to the page allocator. */
+
+/* An object cache. */
+struct kmem_cache
+  {
+    const char *name;           /* Name, for statistics. */
+    size_t size;                /* Object size requested. */
+    size_t slot_size;           /* Bytes per slot. */
+    size_t link_ofs;            /* Offset of free link in a slot. */
+    size_t first_ofs;           /* Offset of first slot in a slab. */
+    size_t slots_per_slab;      /* Slots in a slab. */
+    kmem_ctor_func *ctor;       /* Constructor, or null. */
+
+    struct lock lock;           /* Protects the members below. */
+    struct list partial;        /* Slabs with some objects in use. */
+    struct list full;           /* Slabs with all objects in use. */
+    struct list empty;          /* Slabs with no objects in use. */
+
+    /* Statistics. */
+    unsigned long long alloc_cnt;       /* Objects allocated. */
+    unsigned long long free_cnt;        /* Objects freed. */
+    unsigned in_use;                    /* Objects now allocated. */
+    unsigned slab_cnt;                  /* Slabs now held. */
+    unsigned slab_max;                  /* Most slabs ever held. */
+
+    struct list_elem elem;      /* Element in `caches'. */
+  };
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Slab header, at the start of each slab's page. */
+struct slab
+  {
+    unsigned magic;             /* Always SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in one of the cache's lists. */
+    size_t in_use;              /* Objects allocated from this slab. */
+    void *free;                 /* First free slot, or null. */
+  };
+
+/* All caches, for kmem_print_stats(). */
+static struct list caches = LIST_INITIALIZER (caches);
+
+static palloc_shrink_func shrink_caches;
+
+/* Gives back caches' spare empty slabs under memory pressure.
+   Rebuilding one costs only a slab_create(), so it runs early. */
+static struct palloc_shrinker slab_shrinker =
+  {
+    .name = "slab",
+    .priority = 10,
+    .shrink = shrink_caches,
+  };
+
+static struct slab *slab_create (struct kmem_cache *);
+static struct slab *obj_to_slab (struct kmem_cache *, void *);
+
+/* Returns a pointer to the free link of OBJ in cache C. */
+static inline void **
+free_link (const struct kmem_cache *c, void *obj) 
+{
+  return (void **) ((uint8_t *) obj + c->link_ofs);
+}
+
+/* Creates and returns a cache of SIZE-byte objects aligned on
+   ALIGN-byte boundaries, where ALIGN is a power of 2 or 0 for
+   the natural alignment of a pointer.  If CTOR is nonnull, it is
+   called on each object when its slab is created.  NAME, which
+   must remain valid, is used in statistics.  Returns a null
+   pointer if memory is not available. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, size_t align,
+                   kmem_ctor_func *ctor) 
+{
+  struct kmem_cache *c;
+  enum intr_level old_level;
+
+  ASSERT (name != NULL);
+  ASSERT (size > 0);
+  ASSERT ((align & (align - 1)) == 0);
+
+  if (align < sizeof (void *))
+    align = sizeof (void *);
+
+  c = malloc (sizeof *c);
+  if (c == NULL)
+    return NULL;
+
+  c->name = name;
+  c->size = size;
+  c->ctor = ctor;
+  if (ctor != NULL)
+    {
+      c->link_ofs = ROUND_UP (size, sizeof (void *));
+      c->slot_size = ROUND_UP (c->link_ofs + sizeof (void *), align);
+    }
+  else
+    {
+      c->link_ofs = 0;
+      c->slot_size = ROUND_UP (size < sizeof (void *)
+                               ? sizeof (void *) : size, align);
+    }
+  c->first_ofs = ROUND_UP (sizeof (struct slab), align);
+  ASSERT (c->first_ofs + c->slot_size <= PGSIZE);
+  c->slots_per_slab = (PGSIZE - c->first_ofs) / c->slot_size;
+
+  lock_init (&c->lock);
+  list_init (&c->partial);
+  list_init (&c->full);
+  list_init (&c->empty);
+  c->alloc_cnt = c->free_cnt = 0;
+  c->in_use = c->slab_cnt = c->slab_max = 0;
+
+  old_level = intr_disable ();
+  if (list_empty (&caches))
+    palloc_register_shrinker (&slab_shrinker);
+  list_push_back (&caches, &c->elem);
+  intr_set_level (old_level);
+  return c;
+}
+
+/* Allocates and returns an object from cache C, or a null
+   pointer if memory is not available.  If C has a constructor,
+   the object is in its constructed state; otherwise its contents
+   are arbitrary. */
+void *
+kmem_cache_alloc (struct kmem_cache *c) 
+{
+  struct slab *s;
+  void *obj;
+
+  ASSERT (c != NULL);
+
+  lock_acquire (&c->lock);
+  if (!list_empty (&c->partial))
+    s = list_entry (list_front (&c->partial), struct slab, elem);
+  else if (!list_empty (&c->empty))
+    {
+      s = list_entry (list_pop_front (&c->empty), struct slab, elem);
+      list_push_front (&c->partial, &s->elem);
+    }
+  else
+    {
+      s = slab_create (c);
+      if (s == NULL)
+        {
+          lock_release (&c->lock);
+          return NULL;
+        }
+      list_push_front (&c->partial, &s->elem);
+    }
+
+  obj = s->free;
+  s->free = *free_link (c, obj);
+  if (++s->in_use == c->slots_per_slab)
+    {
+      list_remove (&s->elem);
+      list_push_front (&c->full, &s->elem);
+    }
+  c->alloc_cnt++;
+  c->in_use++;
+  lock_release (&c->lock);
+
+  return obj;
+}
+
+/* Allocates an object from cache C, which must not have a
+   constructor, and zeros it.  Returns a null pointer if memory
+   is not available. */
+void *
+kmem_cache_zalloc (struct kmem_cache *c) 
+{
+  void *obj;
+
+  ASSERT (c->ctor == NULL);
+
+  obj = kmem_cache_alloc (c);
+  if (obj != NULL)
+    memset (obj, 0, c->size);
+  return obj;
+}
+
+/* Returns OBJ, which must have been allocated from cache C, to
+   C.  If C has a constructor, OBJ must be back in its
+   constructed state.  A null OBJ is ignored. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj) 
+{
+  struct slab *s;
+  void *page = NULL;
+
+  ASSERT (c != NULL);
+  if (obj == NULL)
+    return;
+
+  s = obj_to_slab (c, obj);
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs, unless
+     that would destroy its constructed state. */
+  if (c->ctor == NULL)
+    memset (obj, 0xcc, c->size);
+#endif
+
+  lock_acquire (&c->lock);
+  ASSERT (s->in_use > 0);
+  *free_link (c, obj) = s->free;
+  s->free = obj;
+  if (s->in_use-- == c->slots_per_slab)
+    {
+      /* Was full, now partial. */
+      list_remove (&s->elem);
+      list_push_front (&c->partial, &s->elem);
+    }
+  if (s->in_use == 0)
+    {
+      list_remove (&s->elem);
+      if (list_empty (&c->empty))
+        list_push_front (&c->empty, &s->elem);
+      else
+        {
+          s->magic = 0;
+          c->slab_cnt--;
+          page = s;
+        }
+    }
+  c->free_cnt++;
+  c->in_use--;
+  lock_release (&c->lock);
+
+  if (page != NULL)
+    palloc_free_page (page);
+}
+
+/* Shrinker: frees the empty slabs that caches keep for reuse,
+   up to PAGE_CNT of them.  Caches whose lock is busy, perhaps
+   held by the very thread whose allocation failed, are skipped. */
+static size_t
+shrink_caches (enum palloc_flags flags, size_t page_cnt,
+               void *aux UNUSED) 
+{
+  struct list_elem *e;
+  enum intr_level old_level;
+  size_t freed = 0;
+
+  /* Slabs come from the kernel pool. */
+  if (flags & PAL_USER)
+    return 0;
+
+  old_level = intr_disable ();
+  for (e = list_begin (&caches); e != list_end (&caches) && freed < page_cnt;
+       e = list_next (e))
+    {
+      struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+      struct slab *s = NULL;
+
+      if (!lock_try_acquire (&c->lock))
+        continue;
+      if (!list_empty (&c->empty))
+        {
+          s = list_entry (list_pop_front (&c->empty), struct slab, elem);
+          s->magic = 0;
+          c->slab_cnt--;
+        }
+      lock_release (&c->lock);
+
+      if (s != NULL)
+        {
+          palloc_free_page (s);
+          freed++;
+        }
+    }
+  intr_set_level (old_level);
+  return freed;
+}
+
+/* Prints statistics for every cache that has been used. */
+void
+kmem_print_stats (void) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&caches); e != list_end (&caches); e = list_next (e))
+    {
+      struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+
+      if (c->alloc_cnt == 0)
+        continue;
+      printf ("Cache %s: %zu-byte objects, %zu per slab, "
+              "%llu allocs, %llu frees, %u in use, %u slabs (max %u)\n",
+              c->name, c->size, c->slots_per_slab, c->alloc_cnt,
+              c->free_cnt, c->in_use, c->slab_cnt, c->slab_max);
+    }
+}
+
+/* Creates a new slab for cache C, threads all of its slots onto
+   its free list, and runs C's constructor on each of them.
+   Returns the new slab, or a null pointer if memory is not
+   available.  C's lock must be held. */
+static struct slab *
+slab_create (struct kmem_cache *c) 
+{
+  struct slab *s;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+
+  s = palloc_get_page (0);
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->in_use = 0;
+  s->free = NULL;
+  for (i = c->slots_per_slab; i-- > 0; )
+    {
+      void *obj = (uint8_t *) s + c->first_ofs + i * c->slot_size;
+
+      if (c->ctor != NULL)
+        c->ctor (obj);
+      *free_link (c, obj) = s->free;
+      s->free = obj;
+    }
+
+  if (++c->slab_cnt > c->slab_max)
+    c->slab_max = c->slab_cnt;
+  return s;
+}
+
+/* Returns the slab that contains OBJ, which must have been
+   allocated from cache C. */
+static struct slab *
+obj_to_slab (struct kmem_cache *c, void *obj) 
+{
+  struct slab *s = pg_round_down (obj);
+
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+  ASSERT ((pg_ofs (obj) - c->first_ofs) % c->slot_size == 0);
+
+  return s;
+}
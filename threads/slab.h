@@ -0,0 +1,32 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+/* Object caches.
+
+   A cache hands out objects of a single size from "slabs", pages
+   carved into exactly as many object-sized slots as fit.  Unlike
+   malloc(), which rounds each request up to a power of 2, a
+   cache wastes at most the tail of each page, and each cache has
+   its own lock, so unrelated object types do not contend.
+
+   If a constructor is given, it runs once per object when its
+   slab is created, not on every allocation.  Callers must free
+   objects back in their constructed state, so that the next
+   kmem_cache_alloc() can skip initialization that every object
+   shares (initialized locks and lists, for example). */
+
+struct kmem_cache;
+
+/* Initializes an object just after its slab is created. */
+typedef void kmem_ctor_func (void *obj);
+
+struct kmem_cache *kmem_cache_create (const char *name, size_t size,
+                                      size_t align, kmem_ctor_func *);
+void *kmem_cache_alloc (struct kmem_cache *);
+void *kmem_cache_zalloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+void kmem_print_stats (void);
+
+#endif /* threads/slab.h */
@@ -0,0 +1,105 @@
+#include "threads/stats.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+
+/* Maximum number of registered statistics, and of buckets in a
+   histogram. */
+#define STATS_MAX 256
+#define STATS_BUCKET_MAX 64
+
+/* A registered counter or histogram. */
+struct stats_entry
+  {
+    const char *subsys;                 /* Subsystem. */
+    const char *instance;               /* Instance, or null. */
+    const char *name;                   /* Statistic within it. */
+    const unsigned long long *values;   /* The counter or buckets. */
+    size_t bucket_cnt;                  /* Buckets, or 0 for a counter. */
+  };
+
+/* Registered statistics, in order of registration.  Registration
+   happens during initialization, so only the dump reads this
+   table concurrently, and it disables interrupts to do so. */
+static struct stats_entry entries[STATS_MAX];
+static size_t entry_cnt;
+
+static void add (const char *subsys, const char *instance,
+                 const char *name, const void *values, size_t bucket_cnt);
+
+/* Registers the 64-bit COUNTER under SUBSYS.INSTANCE.NAME, or
+   SUBSYS.NAME if INSTANCE is null.  The strings and the counter
+   must stay valid forever. */
+void
+stats_counter (const char *subsys, const char *instance,
+               const char *name, const void *counter) 
+{
+  add (subsys, instance, name, counter, 0);
+}
+
+/* Registers the histogram whose BUCKET_CNT 64-bit buckets begin
+   at BUCKETS, under the same kind of key as stats_counter(). */
+void
+stats_histogram (const char *subsys, const char *instance,
+                 const char *name, const void *buckets, size_t bucket_cnt) 
+{
+  ASSERT (bucket_cnt > 0 && bucket_cnt <= STATS_BUCKET_MAX);
+  add (subsys, instance, name, buckets, bucket_cnt);
+}
+
+/* Adds an entry to the table. */
+static void
+add (const char *subsys, const char *instance, const char *name,
+     const void *values, size_t bucket_cnt) 
+{
+  enum intr_level old_level;
+  struct stats_entry *e;
+
+  ASSERT (subsys != NULL && name != NULL && values != NULL);
+
+  old_level = intr_disable ();
+  if (entry_cnt >= STATS_MAX)
+    PANIC ("too many statistics registered");
+  e = &entries[entry_cnt++];
+  intr_set_level (old_level);
+
+  e->subsys = subsys;
+  e->instance = instance;
+  e->name = name;
+  e->values = values;
+  e->bucket_cnt = bucket_cnt;
+}
+
+/* Prints every registered statistic as a "key=value" line. */
+void
+stats_dump (void) 
+{
+  size_t i;
+
+  for (i = 0; i < entry_cnt; i++)
+    {
+      const struct stats_entry *e = &entries[i];
+      unsigned long long values[STATS_BUCKET_MAX];
+      size_t cnt = e->bucket_cnt > 0 ? e->bucket_cnt : 1;
+      enum intr_level old_level;
+      size_t j;
+
+      old_level = intr_disable ();
+      for (j = 0; j < cnt; j++)
+        values[j] = e->values[j];
+      intr_set_level (old_level);
+
+      for (j = 0; j < cnt; j++)
+        {
+          if (e->bucket_cnt > 0 && values[j] == 0)
+            continue;
+          printf ("%s.", e->subsys);
+          if (e->instance != NULL)
+            printf ("%s.", e->instance);
+          if (e->bucket_cnt > 0)
+            printf ("%s.%zu=%llu\n", e->name, j, values[j]);
+          else
+            printf ("%s=%llu\n", e->name, values[j]);
+        }
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef THREADS_STATS_H
+#define THREADS_STATS_H
+
+#include <stddef.h>
+
+/* Statistics registry.
+
+   Subsystems register their counters and histograms here, by
+   address, once at initialization, and keep updating them as
+   they always have.  stats_dump(), run by the "stats" action,
+   prints every one of them as "key=value" lines that a script
+   can collect and compare between runs.
+
+   A key is SUBSYS.NAME, or SUBSYS.INSTANCE.NAME for statistics
+   kept per device or the like.  A histogram prints one key per
+   nonempty bucket, with the bucket number appended, so a missing
+   key means 0.  Every value is a 64-bit unsigned long long (or
+   long long, which must not be negative), read with interrupts
+   off, which gives a consistent value for counters that are only
+   changed with interrupts off. */
+
+void stats_counter (const char *subsys, const char *instance,
+                    const char *name, const void *counter);
+void stats_histogram (const char *subsys, const char *instance,
+                      const char *name, const void *buckets,
+                      size_t bucket_cnt);
+void stats_dump (void);
+
+#endif /* threads/stats.h */
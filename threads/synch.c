@@ -31,7 +31,38 @@
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "lib/kernel/list.h"
+#include "devices/timer.h"
+
+/* Arrival counter for semaphore and condition variable waiters,
+   so that waiters of equal priority are woken FIFO.  Protected
+   by disabling interrupts (semaphores) or by the monitor lock
+   plus disabling interrupts (condition variables). */
+static unsigned wait_seq;
+
+/* Returns true if a waiter keyed on priority PA and sequence
+   number SA should be woken before one keyed on PB and SB. */
+static inline bool
+wakes_first (int pa, unsigned sa, int pb, unsigned sb) 
+{
+  if (pa != pb)
+    return pa > pb;
+  return (int) (sa - sb) < 0;
+}
+
+/* Orders semaphore waiters by descending priority, then by
+   arrival. */
+static bool
+waiter_less (const struct heap_elem *a_, const struct heap_elem *b_,
+             void *aux UNUSED)
+{
+  const struct thread *a = heap_entry (a_, struct thread, waitelem);
+  const struct thread *b = heap_entry (b_, struct thread, waitelem);
+
+  return wakes_first (a->wait_priority, a->wait_seq,
+                      b->wait_priority, b->wait_seq);
+}
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -48,23 +79,14 @@ sema_init (struct semaphore *sema, unsigned value)
   ASSERT (sema != NULL);
 
   sema->value = value;
-  list_init (&sema->waiters);
+  heap_init (&sema->waiters, waiter_less, NULL);
 }
 
-/* helper function for list_insert_order; it should place the new
-   elem right after elem are equal and or less than new elem in terms of priority. */ //==========================================================================================
-bool
-priority_ordering_wait (const struct list_elem *a, const struct list_elem *b, void *aux)
-{
-  //return true if priority of a is greater than or equal to b ========================================================================================
-  struct thread *thread_a = list_entry(a, struct thread, elem);
-  struct thread *thread_b = list_entry(b, struct thread, elem);
-  //int priority_a = thread_get_priority();
-  int priority_a = (thread_a->eff_priority > thread_a->priority) ? thread_a->eff_priority : thread_a->priority;
-  int priority_b = (thread_b->eff_priority > thread_b->priority) ? thread_b->eff_priority : thread_b->priority;
+/* Maximum length of a chain of nested priority donations.  A
+   donation that would travel further is dropped, which bounds
+   the cost of lock_acquire(). */
+#define DONATION_DEPTH 8
 
-  return (priority_a > priority_b);
-}
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
    to become positive and then atomically decrements it.
@@ -84,14 +106,70 @@ sema_down (struct semaphore *sema)
   old_level = intr_disable ();
   while (sema->value == 0) 
     {
-      //list_push_back (&sema->waiters, &thread_current ()->elem);
-      list_insert_ordered(&sema->waiters, &thread_current ()->elem, priority_ordering_wait, NULL);      /* based on priority*/ //======================================================
+      struct thread *cur = thread_current ();
+
+      cur->wait_priority = thread_effective_priority (cur);
+      cur->wait_seq = wait_seq++;
+      heap_push (&sema->waiters, &cur->waitelem);
+      cur->wait_sema = sema;
+      TRACE (TRACE_SEMA_SLEEP, thread_current (), (uintptr_t) sema, 0);
       thread_block ();
     }
   sema->value--;
   intr_set_level (old_level);
 }
 
+/* Like sema_down(), but gives up after about TICKS timer ticks.
+   Returns true if SEMA was decremented, false if the wait timed
+   out.  If TICKS is zero or negative, does not wait at all.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler.  This function may be called with
+   interrupts disabled, but if it sleeps then the next scheduled
+   thread will probably turn interrupts back on. */
+bool
+sema_down_timeout (struct semaphore *sema, int64_t ticks) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int64_t deadline;
+  bool success = true;
+
+  ASSERT (sema != NULL);
+  ASSERT (!intr_context ());
+
+  if (ticks <= 0)
+    return sema_try_down (sema);
+
+  old_level = intr_disable ();
+  deadline = timer_ticks () + ticks;
+  while (sema->value == 0) 
+    {
+      if (timer_ticks () >= deadline)
+        {
+          success = false;
+          break;
+        }
+
+      /* Whichever of sema_up() and sema_timeout() comes first
+         takes us off both the waiters and the timing wheel and
+         clears timed_sema. */
+      cur->wait_priority = thread_effective_priority (cur);
+      cur->wait_seq = wait_seq++;
+      heap_push (&sema->waiters, &cur->waitelem);
+      cur->wait_sema = sema;
+      cur->timed_sema = sema;
+      timer_arm (cur, deadline);
+      TRACE (TRACE_SEMA_SLEEP, cur, (uintptr_t) sema, 0);
+      thread_block ();
+    }
+  if (success)
+    sema->value--;
+  intr_set_level (old_level);
+
+  return success;
+}
+
 /* Down or "P" operation on a semaphore, but only if the
    semaphore is not already 0.  Returns true if the semaphore is
    decremented, false otherwise.
@@ -129,21 +207,62 @@ sema_up (struct semaphore *sema)
 
   ASSERT (sema != NULL);
 
-  struct thread *unwait = NULL;
-
   old_level = intr_disable ();
-  if (!list_empty (&sema->waiters)) {
-    unwait = list_entry (list_pop_front (&sema->waiters), struct thread, elem);
-    thread_unblock (unwait);
-  }
+  if (!heap_empty (&sema->waiters)) 
+    {
+      struct thread *t = heap_entry (heap_pop_min (&sema->waiters),
+                                     struct thread, waitelem);
+      t->wait_sema = NULL;
+      if (t->timed_sema != NULL)
+        {
+          t->timed_sema = NULL;
+          timer_disarm (t);
+        }
+      thread_unblock (t);
+    }
   sema->value++;
   intr_set_level (old_level);
-  //yield if priority is higher =======================================================================================================================================
-  if (unwait != NULL) {
-    int unwait_priority = (unwait->eff_priority > unwait->priority) ? unwait->eff_priority : unwait->priority;
-    int curr_priority = (thread_current()->eff_priority > thread_current()->priority) ? thread_current()->eff_priority : thread_current()->priority;
-    thread_yield();
-  }
+
+  /* Let the woken thread run now if it outranks us. */
+  thread_preempt ();
+}
+
+/* Called by the timer, with interrupts off, when blocked thread
+   T's wait in sema_down_timeout() expires, just before it
+   unblocks T.  Takes T off its semaphore's waiters. */
+void
+sema_timeout (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->timed_sema != NULL);
+
+  heap_remove (&t->timed_sema->waiters, &t->waitelem);
+  t->wait_sema = NULL;
+  t->timed_sema = NULL;
+}
+
+static void cond_requeue (struct thread *, int priority);
+
+/* Called by thread_requeue(), with interrupts off, when the
+   effective priority of blocked thread T may have changed, by
+   an MLFQS recomputation or a donation.  Moves T to its new
+   place among the waiters of the semaphore and the condition
+   variable it waits on, if any, so that wakeups follow current
+   priorities rather than those at arrival. */
+void
+sema_requeue (struct thread *t) 
+{
+  int priority = thread_effective_priority (t);
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->wait_sema != NULL && t->wait_priority != priority)
+    {
+      t->wait_priority = priority;
+      heap_update (&t->wait_sema->waiters, &t->waitelem);
+    }
+  if (t->cond_waiter != NULL)
+    cond_requeue (t, priority);
 }
 
 static void sema_test_helper (void *sema_);
@@ -183,25 +302,6 @@ sema_test_helper (void *sema_)
     }
 }
 
-/* helper function for list_insert_order; it should place the new
-   elem right after elem are equal and or less than new elem in terms of priority. */ //==========================================================================================
-bool
-priority_ordering_donators (const struct list_elem *a, const struct list_elem *b, void *aux)
-{
-  //return true if priority of a is greater than or equal to b ========================================================================================
-  struct thread *thread_a = list_entry(a, struct thread, donatorselem);
-  struct thread *thread_b = list_entry(b, struct thread, donatorselem);
-  //int priority_a = thread_get_priority();
-  int priority_a = thread_a->priority;
-  if(thread_a->priority < thread_a->eff_priority)
-    priority_a = thread_a->eff_priority;
-  int priority_b = thread_b->priority;
-  if(thread_b->priority < thread_b->eff_priority)
-    priority_b = thread_b->eff_priority;
-
-  return (priority_a > priority_b);
-}
-
 /* Initializes LOCK.  A lock can be held by at most a single
    thread at any given time.  Our locks are not "recursive", that
    is, it is an error for the thread currently holding a lock to
@@ -216,16 +316,141 @@ priority_ordering_donators (const struct list_elem *a, const struct list_elem *b
    another one "up" it, but with a lock the same thread must both
    acquire and release it.  When these restrictions prove
    onerous, it's a good sign that a semaphore should be used,
-   instead of a lock. */
+   instead of a lock.
+
+   With LOCKSTAT or LOCKDEP, lock_init() is also a macro (see
+   synch.h), hence the parentheses here. */
 void
-lock_init (struct lock *lock)
+(lock_init) (struct lock *lock)
 {
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
+  lock->max_priority = PRI_MIN - 1;
   sema_init (&lock->semaphore, 1);
 }
 
+#ifdef LOCKSTAT
+/* Arranges for the contention statistics of LOCK, which has
+   just been initialized, to be accumulated into STAT. */
+void
+lock_init_stat (struct lock *lock, struct lockstat *stat) 
+{
+  lock->stat = stat;
+  lockstat_register (stat);
+}
+
+/* Records that LOCK has just been acquired by a thread that
+   started trying at timer_cycles() value START and found it held if
+   CONTENDED.  Interrupts must be off. */
+static void
+lockstat_acquired (struct lock *lock, uint64_t start, bool contended) 
+{
+  struct lockstat *s = lock->stat;
+
+  lock->acquired = timer_cycles ();
+  s->acquisitions++;
+  if (contended)
+    {
+      uint64_t wait = lock->acquired - start;
+
+      s->contended++;
+      s->wait_total += wait;
+      if (wait > s->wait_max)
+        s->wait_max = wait;
+    }
+}
+
+/* Records that LOCK is about to be released.  Interrupts must be
+   off. */
+static void
+lockstat_released (struct lock *lock) 
+{
+  lock->stat->hold_total += timer_cycles () - lock->acquired;
+}
+
+#define lockstat_now() timer_cycles ()
+#else
+#define lockstat_acquired(LOCK, START, CONTENDED) \
+        ((void) (LOCK), (void) (START), (void) (CONTENDED))
+#define lockstat_released(LOCK) ((void) (LOCK))
+#define lockstat_now() 0
+#endif /* LOCKSTAT */
+
+#ifndef LOCKDEP
+#define lockdep_acquire(LOCK) ((void) (LOCK))
+#define lockdep_acquired(LOCK) ((void) (LOCK))
+#define lockdep_release(LOCK) ((void) (LOCK))
+#endif
+
+/* Returns the highest effective priority among the threads
+   waiting for LOCK, or PRI_MIN - 1 if there are none.
+   Interrupts must be off. */
+static int
+lock_waiter_priority (struct lock *lock) 
+{
+  struct heap *waiters = &lock->semaphore.waiters;
+
+  if (heap_empty (waiters))
+    return PRI_MIN - 1;
+  return heap_entry (heap_min (waiters), struct thread, waitelem)->wait_priority;
+}
+
+/* Recomputes the priority donated to T as the highest
+   max_priority over the locks T holds.  This costs O(locks held).
+   Interrupts must be off. */
+static void
+recompute_donation (struct thread *t) 
+{
+  struct list_elem *e;
+  int donated = PRI_MIN - 1;
+
+  for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+       e = list_next (e))
+    {
+      struct lock *l = list_entry (e, struct lock, elem);
+      if (l->max_priority > donated)
+        donated = l->max_priority;
+    }
+  t->donated_priority = donated;
+  thread_requeue (t);
+}
+
+/* Donates the running thread's priority to the holder of LOCK,
+   which it is about to wait for, and onward along the chain of
+   locks that holder is itself waiting for, for at most
+   DONATION_DEPTH steps.  The walk stops early at the first lock
+   whose max_priority is already high enough.  Interrupts must be
+   off. */
+static void
+donate_priority (struct lock *lock) 
+{
+  int priority = thread_effective_priority (thread_current ());
+  int depth;
+
+  for (depth = 0; lock != NULL && depth < DONATION_DEPTH; depth++)
+    {
+      struct thread *holder = lock->holder;
+
+      if (holder == NULL || lock->max_priority >= priority)
+        break;
+      lock->max_priority = priority;
+      if (holder->donated_priority >= priority)
+        break;
+
+      holder->donated_priority = priority;
+      TRACE (TRACE_LOCK_WAIT, thread_current (), holder->tid, priority);
+
+      /* Moves the holder up in the run queue or, if it is blocked
+         on another lock, in that lock's waiters, before the
+         donation goes on to that lock's holder. */
+      thread_requeue (holder);
+      lock = holder->waiting_lock;
+    }
+}
+
+static void lock_take (struct lock *);
+
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
@@ -237,24 +462,102 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  uint64_t start = lockstat_now ();
+  bool contended;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  //General idea: record list of threads that are waiting for the lock, set priority of lock to the highest priority. ==================================================================
-  //Holder will inherit the priority of lock
-  
-  //Holder record list of donators in order of highest to lowest, effective priority is head of list priority
-  //Donator should only donate once, so record the thread that is doanted to.
-  //For nested donation, the thread will share the effective priority.
-  //If holder is donating, donate new effective priority to the holder of holder.
-  if (lock->holder != NULL) {
-    int donation = (thread_current()->eff_priority > thread_current()->priority) ? thread_current()->eff_priority : thread_current()->priority;
-    lock->holder->eff_priority = donation;
-  }
+  old_level = intr_disable ();
+  lockdep_acquire (lock);
+  contended = lock->holder != NULL;
+  if (contended && !thread_mlfqs)
+    {
+      cur->waiting_lock = lock;
+      donate_priority (lock);
+    }
 
   sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  lock_take (lock);
+  lockstat_acquired (lock, start, contended);
+  lockdep_acquired (lock);
+  intr_set_level (old_level);
+}
+
+/* Like lock_acquire(), but gives up after about TICKS timer
+   ticks.  Returns true if LOCK was acquired, false if the wait
+   timed out.  If TICKS is zero or negative, does not wait at
+   all.
+
+   On a timeout, the holder stops receiving our donation.
+   Priority that was passed further along a chain of nested
+   donations stays with those threads until they release their
+   locks, which errs on the side of too high. */
+bool
+lock_acquire_timeout (struct lock *lock, int64_t ticks)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  uint64_t start = lockstat_now ();
+  bool contended;
+  bool success;
+
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!lock_held_by_current_thread (lock));
+
+  if (ticks <= 0)
+    return lock_try_acquire (lock);
+
+  old_level = intr_disable ();
+  lockdep_acquire (lock);
+  contended = lock->holder != NULL;
+  if (contended && !thread_mlfqs)
+    {
+      cur->waiting_lock = lock;
+      donate_priority (lock);
+    }
+
+  success = sema_down_timeout (&lock->semaphore, ticks);
+  if (success)
+    {
+      lock_take (lock);
+      lockstat_acquired (lock, start, contended);
+      lockdep_acquired (lock);
+    }
+  else
+    {
+      cur->waiting_lock = NULL;
+      if (!thread_mlfqs && lock->holder != NULL)
+        {
+          lock->max_priority = lock_waiter_priority (lock);
+          recompute_donation (lock->holder);
+        }
+    }
+  intr_set_level (old_level);
+  return success;
+}
+
+/* Makes the running thread, which has just downed LOCK's
+   semaphore, LOCK's holder.  Any threads still waiting now
+   donate to it.  Interrupts must be off. */
+static void
+lock_take (struct lock *lock) 
+{
+  struct thread *cur = thread_current ();
+
+  cur->waiting_lock = NULL;
+  lock->holder = cur;
+  if (!thread_mlfqs)
+    {
+      lock->max_priority = lock_waiter_priority (lock);
+      list_push_back (&cur->held_locks, &lock->elem);
+      if (lock->max_priority > cur->donated_priority)
+        cur->donated_priority = lock->max_priority;
+    }
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -266,18 +569,32 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->holder = thread_current ();
+      if (!thread_mlfqs)
+        {
+          lock->max_priority = lock_waiter_priority (lock);
+          list_push_back (&lock->holder->held_locks, &lock->elem);
+        }
+      lockstat_acquired (lock, lockstat_now (), false);
+      lockdep_acquired (lock);
+    }
+  intr_set_level (old_level);
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Drops whatever priority the lock's waiters were donating; if
+   that leaves a ready thread with higher priority, yields to it.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -285,22 +602,22 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
-
-  lock->holder->eff_priority = 0;
-  // if(!list_empty(&(&lock->semaphore)->waiters && false)){
-  //   struct list_elem *next_waiter_elem = list_front(&(&lock->semaphore)->waiters);
-  //   struct thread *next_waiter = list_entry(next_waiter_elem, struct thread, elem);
-  //   int next_priority = (next_waiter->eff_priority > next_waiter->priority) ? next_waiter->eff_priority : next_waiter->priority;
-  //   lock->holder->eff_priority = next_priority;
-  // }
-  // else {
-  //   lock->holder->eff_priority = 31;
-  // }
-
+  old_level = intr_disable ();
+  lockstat_released (lock);
+  lockdep_release (lock);
+  if (!thread_mlfqs)
+    {
+      list_remove (&lock->elem);
+      recompute_donation (lock->holder);
+    }
   lock->holder = NULL;
+  intr_set_level (old_level);
+
   sema_up (&lock->semaphore);
 }
 
@@ -314,14 +631,256 @@ lock_held_by_current_thread (const struct lock *lock)
 
   return lock->holder == thread_current ();
 }
+
+/* Initializes RW as a reader-writer lock.  Any number of readers
+   may hold RW at once, or a single writer.
+
+   A writer holds RW's internal lock for as long as it holds RW
+   and readers take the same lock briefly on the way in, so:
+
+   - A writer that has arrived blocks readers that arrive after
+     it, even while it is still waiting for earlier readers to
+     leave.  Readers therefore cannot starve writers.
+
+   - Readers and writers that wait for a writer donate their
+     priority to it, exactly as for an ordinary lock.  Readers
+     are anonymous, so a writer waiting for readers to leave
+     does not donate to them.
+
+   Like a lock, RW is not recursive, and it may not be acquired
+   for reading by a thread that holds it for writing. */
+void
+rw_init (struct rwlock *rw) 
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->writer);
+  rw->readers = 0;
+  rw->writer_waiting = false;
+  sema_init (&rw->drained, 0);
+}
+
+/* Acquires RW for reading, sleeping until no writer holds it or
+   is waiting for it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rw_read_acquire (struct rwlock *rw) 
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!lock_held_by_current_thread (&rw->writer));
+
+  lock_acquire (&rw->writer);
+  old_level = intr_disable ();
+  rw->readers++;
+  intr_set_level (old_level);
+  lock_release (&rw->writer);
+}
+
+/* Releases RW, which the current thread must hold for reading.
+   If this is the last reader and a writer is waiting, lets it
+   in. */
+void
+rw_read_release (struct rwlock *rw) 
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+
+  old_level = intr_disable ();
+  ASSERT (rw->readers > 0);
+  if (--rw->readers == 0 && rw->writer_waiting)
+    {
+      rw->writer_waiting = false;
+      sema_up (&rw->drained);
+    }
+  intr_set_level (old_level);
+}
+
+/* Acquires RW for writing, sleeping until any other writer has
+   released it and all readers have left.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rw_write_acquire (struct rwlock *rw) 
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rw->writer);
+  old_level = intr_disable ();
+  while (rw->readers > 0)
+    {
+      rw->writer_waiting = true;
+      sema_down (&rw->drained);
+    }
+  intr_set_level (old_level);
+}
+
+/* Releases RW, which the current thread must hold for
+   writing. */
+void
+rw_write_release (struct rwlock *rw) 
+{
+  ASSERT (rw != NULL);
+  ASSERT (rw_write_held_by_current_thread (rw));
+
+  lock_release (&rw->writer);
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise. */
+bool
+rw_write_held_by_current_thread (const struct rwlock *rw) 
+{
+  ASSERT (rw != NULL);
+
+  return lock_held_by_current_thread (&rw->writer);
+}
 
+/* Unblocks every thread in WAITERS, a list of blocked threads
+   linked through their `elem' members, in a single pass with
+   interrupts off, then lets the best of them run if it outranks
+   the running thread.  Interrupts are restored to OLD_LEVEL
+   before preempting. */
+static void
+wake_all (struct list *waiters, enum intr_level old_level) 
+{
+  while (!list_empty (waiters))
+    thread_unblock (list_entry (list_pop_front (waiters),
+                                struct thread, elem));
+  intr_set_level (old_level);
+  thread_preempt ();
+}
+
+/* Initializes BARRIER for phases of COUNT threads each.  A
+   barrier holds the first COUNT - 1 threads that call
+   barrier_wait() until the COUNT'th does, then releases all of
+   them at once and starts over with the next phase. */
+void
+barrier_init (struct barrier *barrier, unsigned count) 
+{
+  ASSERT (barrier != NULL);
+  ASSERT (count > 0);
+
+  barrier->count = count;
+  barrier->arrived = 0;
+  list_init (&barrier->waiters);
+}
+
+/* Waits until BARRIER's current phase is complete.  Returns
+   true in exactly one thread of each phase, the one that arrived
+   last, and false in the others.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+barrier_wait (struct barrier *barrier) 
+{
+  enum intr_level old_level;
+
+  ASSERT (barrier != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  if (++barrier->arrived < barrier->count)
+    {
+      list_push_back (&barrier->waiters, &thread_current ()->elem);
+      thread_block ();
+      intr_set_level (old_level);
+      return false;
+    }
+
+  /* Last to arrive: release this phase and start the next. */
+  barrier->arrived = 0;
+  wake_all (&barrier->waiters, old_level);
+  return true;
+}
+
+/* Initializes LATCH to open after COUNT calls to
+   latch_countdown().  A latch initialized with COUNT 0 is open
+   from the start. */
+void
+latch_init (struct latch *latch, unsigned count) 
+{
+  ASSERT (latch != NULL);
+
+  latch->count = count;
+  list_init (&latch->waiters);
+}
+
+/* Counts LATCH down by one.  The last count-down releases every
+   thread waiting in latch_wait().  LATCH must not already be
+   open.
+
+   This function may be called from an interrupt handler. */
+void
+latch_countdown (struct latch *latch) 
+{
+  enum intr_level old_level;
+
+  ASSERT (latch != NULL);
+
+  old_level = intr_disable ();
+  ASSERT (latch->count > 0);
+  if (--latch->count == 0)
+    wake_all (&latch->waiters, old_level);
+  else
+    intr_set_level (old_level);
+}
+
+/* Waits until LATCH has been counted down to 0.  Returns at once
+   if it already has.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+latch_wait (struct latch *latch) 
+{
+  enum intr_level old_level;
+
+  ASSERT (latch != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  if (latch->count > 0)
+    {
+      list_push_back (&latch->waiters, &thread_current ()->elem);
+      thread_block ();
+    }
+  intr_set_level (old_level);
+}
+
 /* One semaphore in a list. */
 struct semaphore_elem 
   {
-    struct list_elem elem;              /* List element. */
+    struct heap_elem elem;              /* Heap element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct condition *cond;             /* Condition variable waited on. */
+    struct thread *thread;              /* Waiting thread. */
+    int priority;                       /* Waiter's effective priority. */
+    unsigned seq;                       /* Arrival order. */
   };
 
+/* Orders condition variable waiters by descending priority,
+   then by arrival. */
+static bool
+cond_waiter_less (const struct heap_elem *a_, const struct heap_elem *b_,
+                  void *aux UNUSED)
+{
+  const struct semaphore_elem *a = heap_entry (a_, struct semaphore_elem, elem);
+  const struct semaphore_elem *b = heap_entry (b_, struct semaphore_elem, elem);
+
+  return wakes_first (a->priority, a->seq, b->priority, b->seq);
+}
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -330,17 +889,57 @@ cond_init (struct condition *cond)
 {
   ASSERT (cond != NULL);
 
-  list_init (&cond->waiters);
+  heap_init (&cond->waiters, cond_waiter_less, NULL);
 }
 
-/* ordering similar to everything else */ //===========================================================================================================================================
-bool
-priority_sort_cond_waiter (const struct list_elem* a, const struct list_elem *b, void* aux)
+/* Adds the running thread to COND's waiters as WAITER.  COND's
+   waiters are touched only with interrupts off, since
+   sema_requeue() reorders them from the timer interrupt. */
+static void
+cond_push (struct condition *cond, struct semaphore_elem *waiter) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  sema_init (&waiter->semaphore, 0);
+  waiter->cond = cond;
+  waiter->thread = cur;
+  old_level = intr_disable ();
+  waiter->priority = thread_effective_priority (cur);
+  waiter->seq = wait_seq++;
+  heap_push (&cond->waiters, &waiter->elem);
+  cur->cond_waiter = waiter;
+  intr_set_level (old_level);
+}
+
+/* Removes and returns the first of COND's waiters, or returns a
+   null pointer if there are none.  Interrupts must be off. */
+static struct semaphore_elem *
+cond_pop (struct condition *cond) 
 {
-  struct semaphore_elem *elem_a = list_entry(a, struct semaphore_elem, elem);
-  struct semaphore_elem *elem_b = list_entry(b, struct semaphore_elem, elem);
+  struct semaphore_elem *w;
+
+  ASSERT (intr_get_level () == INTR_OFF);
 
-  return (elem_a->semaphore.priority > elem_b->semaphore.priority);
+  if (heap_empty (&cond->waiters))
+    return NULL;
+  w = heap_entry (heap_pop_min (&cond->waiters), struct semaphore_elem, elem);
+  w->thread->cond_waiter = NULL;
+  return w;
+}
+
+/* Rekeys blocked thread T among the waiters of the condition
+   variable it waits on at PRIORITY.  Interrupts must be off. */
+static void
+cond_requeue (struct thread *t, int priority) 
+{
+  struct semaphore_elem *w = t->cond_waiter;
+
+  if (w->priority != priority)
+    {
+      w->priority = priority;
+      heap_update (&w->cond->waiters, &w->elem);
+    }
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -373,19 +972,57 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
   
-  sema_init (&waiter.semaphore, 0);
+  cond_push (cond, &waiter);
 
-  //Set priority of the semaphore =============================================================================================================================================
-  int curr_priority = (thread_current()->eff_priority > thread_current()->priority) ? thread_current()->eff_priority : thread_current()->priority;
-  waiter.semaphore.priority = curr_priority;
+  lock_release (lock);
+  sema_down (&waiter.semaphore);
+  lock_acquire (lock);
+}
 
-  //list_push_back (&cond->waiters, &waiter.elem);
-  //Order the waiters ===========================================================================================================================================================
-  list_insert_ordered(&cond->waiters, &waiter.elem, priority_sort_cond_waiter, NULL);
+/* Like cond_wait(), but gives up waiting for a signal after
+   about TICKS timer ticks.  Returns true if COND was signaled,
+   false if the wait timed out.  Either way, LOCK is held again
+   on return.  A zero or negative TICKS times out at once.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+cond_wait_timeout (struct condition *cond, struct lock *lock, int64_t ticks) 
+{
+  struct semaphore_elem waiter;
+  enum intr_level old_level;
+  bool signaled;
+
+  ASSERT (cond != NULL);
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock_held_by_current_thread (lock));
+
+  if (ticks <= 0)
+    return false;
+
+  cond_push (cond, &waiter);
 
   lock_release (lock);
-  sema_down (&waiter.semaphore);
+  signaled = sema_down_timeout (&waiter.semaphore, ticks);
   lock_acquire (lock);
+
+  /* Signalers pop waiters while holding LOCK, so now that we
+     hold it again we either are still among COND's waiters or
+     were signaled after timing out.  Don't lose such a signal. */
+  if (!signaled)
+    {
+      old_level = intr_disable ();
+      if (sema_try_down (&waiter.semaphore))
+        signaled = true;
+      else
+        {
+          heap_remove (&cond->waiters, &waiter.elem);
+          thread_current ()->cond_waiter = NULL;
+        }
+      intr_set_level (old_level);
+    }
+  return signaled;
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
@@ -398,14 +1035,19 @@ cond_wait (struct condition *cond, struct lock *lock)
 void
 cond_signal (struct condition *cond, struct lock *lock UNUSED) 
 {
+  struct semaphore_elem *w;
+  enum intr_level old_level;
+
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+  old_level = intr_disable ();
+  w = cond_pop (cond);
+  intr_set_level (old_level);
+  if (w != NULL) 
+    sema_up (&w->semaphore);
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -420,6 +1062,75 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
 
-  while (!list_empty (&cond->waiters))
+  while (!heap_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Like cond_broadcast(), but wakes only the highest-priority
+   waiter.  The others are moved straight onto LOCK's waiters, as
+   if each had been woken and then found LOCK held, so they are
+   woken one at a time by lock_release() instead of all waking
+   now only to go back to sleep on LOCK.  LOCK must be held
+   before calling this function.
+
+   A waiter in cond_wait_timeout(), or one that has not yet gone
+   to sleep, is simply signaled as by cond_signal(). */
+void
+cond_broadcast_requeue (struct condition *cond, struct lock *lock) 
+{
+  struct semaphore_elem *first;
+  enum intr_level old_level;
+
+  ASSERT (cond != NULL);
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock_held_by_current_thread (lock));
+
+  old_level = intr_disable ();
+  first = cond_pop (cond);
+  if (first == NULL)
+    {
+      intr_set_level (old_level);
+      return;
+    }
+  while (!heap_empty (&cond->waiters)) 
+    {
+      struct semaphore_elem *w = cond_pop (cond);
+      struct heap *sleepers = &w->semaphore.waiters;
+      struct thread *t;
+
+      if (heap_empty (sleepers)
+          || heap_entry (heap_min (sleepers), struct thread,
+                         waitelem)->timed_sema != NULL)
+        {
+          sema_up (&w->semaphore);
+          continue;
+        }
+
+      /* Pre-up W's semaphore, so that once lock_release() wakes T
+         its sema_down() in cond_wait() returns at once and it
+         goes on to retake LOCK. */
+      t = heap_entry (heap_pop_min (sleepers), struct thread, waitelem);
+      w->semaphore.value = 1;
+      heap_push (&lock->semaphore.waiters, &t->waitelem);
+      t->wait_sema = &lock->semaphore;
+
+      /* T now waits for LOCK, as if it had called lock_acquire(),
+         so a donation to T must be passed on to LOCK's holder. */
+      if (!thread_mlfqs)
+        t->waiting_lock = lock;
+    }
+
+  /* The moved waiters donate to us, as LOCK's holder. */
+  if (!thread_mlfqs)
+    {
+      struct thread *cur = thread_current ();
+
+      lock->max_priority = lock_waiter_priority (lock);
+      if (lock->max_priority > cur->donated_priority)
+        cur->donated_priority = lock->max_priority;
+    }
+  intr_set_level (old_level);
+
+  sema_up (&first->semaphore);
+}
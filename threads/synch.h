@@ -1,22 +1,30 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <heap.h>
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "threads/lockdep.h"
+#include "threads/lockstat.h"
+
+struct thread;
+struct semaphore_elem;
 
 /* A counting semaphore. */
 struct semaphore 
   {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
-
-    int priority;               /* Priority of sema */ //=============================================================================================
+    struct heap waiters;        /* Waiting threads, by priority. */
   };
 
 void sema_init (struct semaphore *, unsigned value);
 void sema_down (struct semaphore *);
+bool sema_down_timeout (struct semaphore *, int64_t ticks);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
+void sema_timeout (struct thread *);
+void sema_requeue (struct thread *);
 void sema_self_test (void);
 
 /* Lock. */
@@ -24,26 +32,109 @@ struct lock
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
-
-    int priority;               /* Priority of sema or use sema TBD */ //=============================================================================================
+    struct list_elem elem;      /* Element in holder's held_locks. */
+    int max_priority;           /* Highest waiter priority donated. */
+#ifdef LOCKSTAT
+    struct lockstat *stat;      /* Statistics for this lock's class. */
+    uint64_t acquired;          /* rdtsc() when last acquired. */
+#endif
+#ifdef LOCKDEP
+    struct lockdep_class *dep_class;    /* Class for lock ordering. */
+#endif
   };
 
 void lock_init (struct lock *);
 void lock_acquire (struct lock *);
+bool lock_acquire_timeout (struct lock *, int64_t ticks);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
 
+/* With LOCKSTAT or LOCKDEP, lock_init() also gives each of its
+   call sites its own static statistics and lock-order class,
+   named after its argument. */
+#ifdef LOCKSTAT
+void lock_init_stat (struct lock *, struct lockstat *);
+#define LOCK_INIT_STAT(LOCK, NAME)                                      \
+        do {                                                            \
+          static struct lockstat stat_ = LOCKSTAT_INITIALIZER (NAME);   \
+          lock_init_stat (LOCK, &stat_);                                \
+        } while (0)
+#else
+#define LOCK_INIT_STAT(LOCK, NAME) ((void) 0)
+#endif
+#ifdef LOCKDEP
+#define LOCK_INIT_DEP(LOCK, NAME)                                       \
+        do {                                                            \
+          static struct lockdep_class class_                            \
+            = LOCKDEP_CLASS_INITIALIZER (NAME);                         \
+          lockdep_init_lock (LOCK, &class_);                            \
+        } while (0)
+#else
+#define LOCK_INIT_DEP(LOCK, NAME) ((void) 0)
+#endif
+#if defined LOCKSTAT || defined LOCKDEP
+#define lock_init(LOCK)                                                 \
+        ({                                                              \
+          struct lock *lock_ = (LOCK);                                  \
+          (lock_init) (lock_);                                          \
+          LOCK_INIT_STAT (lock_, #LOCK);                                \
+          LOCK_INIT_DEP (lock_, #LOCK);                                 \
+        })
+#endif
+
+/* Reader-writer lock.  Any number of readers, or one writer. */
+struct rwlock 
+  {
+    struct lock writer;         /* Held by the writer, briefly by readers. */
+    unsigned readers;           /* Number of readers holding the lock. */
+    bool writer_waiting;        /* Writer waiting for readers to leave? */
+    struct semaphore drained;   /* Upped when the last reader leaves. */
+  };
+
+void rw_init (struct rwlock *);
+void rw_read_acquire (struct rwlock *);
+void rw_read_release (struct rwlock *);
+void rw_write_acquire (struct rwlock *);
+void rw_write_release (struct rwlock *);
+bool rw_write_held_by_current_thread (const struct rwlock *);
+
 /* Condition variable. */
 struct condition 
   {
-    struct list waiters;        /* List of waiting threads. */
+    struct heap waiters;        /* Waiting threads, by priority. */
   };
 
 void cond_init (struct condition *);
 void cond_wait (struct condition *, struct lock *);
+bool cond_wait_timeout (struct condition *, struct lock *, int64_t ticks);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
+void cond_broadcast_requeue (struct condition *, struct lock *);
+
+/* Barrier.  Holds threads until a fixed number of them have
+   arrived, then releases them all, and resets for reuse. */
+struct barrier 
+  {
+    unsigned count;             /* Threads per phase. */
+    unsigned arrived;           /* Threads arrived in this phase. */
+    struct list waiters;        /* Threads waiting in this phase. */
+  };
+
+void barrier_init (struct barrier *, unsigned count);
+bool barrier_wait (struct barrier *);
+
+/* Latch.  Holds threads until it has been counted down to 0,
+   then lets everyone through from then on. */
+struct latch 
+  {
+    unsigned count;             /* Count-downs still needed. */
+    struct list waiters;        /* Threads waiting for 0. */
+  };
+
+void latch_init (struct latch *, unsigned count);
+void latch_countdown (struct latch *);
+void latch_wait (struct latch *);
 
 /* Optimization barrier.
 
@@ -52,4 +143,73 @@ void cond_broadcast (struct condition *, struct lock *);
    reference guide for more information.*/
 #define barrier() asm volatile ("" : : : "memory")
 
+/* Sequence lock.
+
+   Protects data that is read far more often than it is written,
+   and written only with interrupts off, e.g. by an interrupt
+   handler.  Readers never block or disable interrupts: they read
+   the data optimistically and retry if a writer got in the way:
+
+       unsigned seq;
+       do
+         {
+           seq = seqlock_read_begin (&s);
+           ...copy the data...
+         }
+       while (seqlock_read_retry (&s, seq));
+
+   A writer makes the sequence number odd for the duration of its
+   update.  Because writers run with interrupts off, a reader can
+   only ever see a write that interrupted it, never one in
+   progress. */
+struct seqlock 
+  {
+    unsigned seq;               /* Odd while a write is in progress. */
+  };
+
+/* Initializer for a struct seqlock. */
+#define SEQLOCK_INITIALIZER { 0 }
+
+static inline void
+seqlock_init (struct seqlock *s) 
+{
+  s->seq = 0;
+}
+
+/* Starts a read of the data protected by S.  Returns a value to
+   pass to seqlock_read_retry(). */
+static inline unsigned
+seqlock_read_begin (const struct seqlock *s) 
+{
+  unsigned seq = s->seq;
+  barrier ();
+  return seq;
+}
+
+/* Returns true if the data read since seqlock_read_begin()
+   returned SEQ may be inconsistent and must be read again. */
+static inline bool
+seqlock_read_retry (const struct seqlock *s, unsigned seq) 
+{
+  barrier ();
+  return (seq & 1) != 0 || s->seq != seq;
+}
+
+/* Starts an update of the data protected by S.  Interrupts must
+   be off until the matching seqlock_write_end(). */
+static inline void
+seqlock_write_begin (struct seqlock *s) 
+{
+  s->seq++;
+  barrier ();
+}
+
+/* Ends an update of the data protected by S. */
+static inline void
+seqlock_write_end (struct seqlock *s) 
+{
+  barrier ();
+  s->seq++;
+}
+
 #endif /* threads/synch.h */
@@ -2,38 +2,172 @@
 #include <debug.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "threads/cpu.h"
+#include "threads/fixed-point.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/stats.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
+#ifdef FILESYS
+#include "filesys/directory.h"
+#endif
 
 /* Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+#define PRI_CNT (PRI_MAX - PRI_MIN + 1)
+
+/* Process groups.
+
+   Within a priority level, the priority classes share the CPU
+   between process groups in proportion to their weights, however
+   many threads each group has.  Each group's virtual run time
+   advances by GROUP_VTICK / weight for every tick its threads
+   run, and the group furthest behind runs next.  A group that
+   comes back after all its threads slept starts at the least
+   virtual run time of the groups still running, so that sleeping
+   does not bank CPU time.  Group 0, which the initial thread and
+   so by default every thread belongs to, always exists. */
+#define GROUP_MAX 8
+#define GROUP_VTICK 1000000
+struct sched_group
+  {
+    bool in_use;                /* Allocated? */
+    int weight;                 /* Share of the CPU, relatively. */
+    int64_t vruntime;           /* Weighted run time, GROUP_VTICK units. */
+    long long run_ticks;        /* Timer ticks its threads ran. */
+    int thread_cnt;             /* Number of threads in the group. */
+  };
+static struct sched_group sched_groups[GROUP_MAX];
+
+static void sched_group_add (struct thread *, int group);
+static void sched_group_remove (struct thread *);
+
+/* # of THREAD_READY threads queued. */
+static int ready_cnt;
+
+/* Run queue of the priority classes, holding processes in
+   THREAD_READY state, that is, processes that are ready to run
+   but not actually running.
+
+   There is one FIFO list per process group and priority level,
+   indexed by effective priority, and per group a bitmap with bit
+   P set exactly when the group's list for level P is nonempty.
+   ready_bitmap is the union of the group bitmaps.  Finding the
+   highest-priority ready thread is then a bit scan instead of a
+   list walk, followed by a look at each group's bitmap to choose
+   among them. */
+static struct list ready_queues[GROUP_MAX][PRI_CNT];
+static uint64_t group_bitmaps[GROUP_MAX];
+static uint64_t ready_bitmap;
+static int64_t min_vruntime;    /* Least vruntime of groups running. */
+
+/* Run queues of the earliest-deadline-first class: threads with
+   run time left in their period, in deadline order, and threads
+   that used it up, waiting for the next period. */
+static struct list rt_queue;
+static struct list rt_throttled;
+static int rt_util;             /* Admitted utilization, RT_UTIL_SCALE. */
+
+/* Idle thread. */
+static struct thread *idle_thread;
+
+/* A scheduling class: a policy for ordering the ready threads
+   that belong to it.  A thread of a class with lower RANK always
+   runs before one of a class with higher RANK; within a class,
+   the class decides.  All of these are called with interrupts
+   off. */
+struct sched_class
+  {
+    const char *name;
+    int rank;
+
+    /* Adds ready thread T to the class's queues. */
+    void (*enqueue) (struct thread *t);
+
+    /* Removes T from the class's queues. */
+    void (*dequeue) (struct thread *t);
+
+    /* Returns the thread of this class to run next, without
+       removing it, or a null pointer if there is none. */
+    struct thread *(*pick_next) (void);
+
+    /* Returns true if ready thread T should displace CUR, which
+       is running and of the same class. */
+    bool (*preempts) (const struct thread *t, const struct thread *cur);
+
+    /* Called at each timer tick, in the timer interrupt, with CUR
+       the running thread, which need not be of this class. */
+    void (*tick) (struct thread *cur);
+  };
+
+static const struct sched_class rt_class;
+static const struct sched_class prio_class;
+static const struct sched_class mlfqs_class;
+
+/* Scheduling classes in rank order.  New threads start in the
+   second, which is the MLFQS with "-o mlfqs" and the priority
+   scheduler otherwise. */
+#define SCHED_CLASS_CNT 2
+#ifdef SCHED_POLICY
+static const struct sched_class *const sched_classes[SCHED_CLASS_CNT] =
+  {&rt_class, thread_mlfqs ? &mlfqs_class : &prio_class};
+#else
+static const struct sched_class *sched_classes[SCHED_CLASS_CNT];
+#endif
+#define fair_class (sched_classes[SCHED_CLASS_CNT - 1])
+
+/* EDF admission control.  Utilization is run time over period,
+   scaled by RT_UTIL_SCALE, and the admitted threads together may
+   use at most RT_UTIL_MAX of it, so that the other classes are
+   never starved outright. */
+#define RT_UTIL_SCALE 1000
+#define RT_UTIL_MAX 950
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
-/* Idle thread. */
-static struct thread *idle_thread;
-
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
+/* Cache of pages freed by dying threads, reused by
+   thread_create() without going back through the page
+   allocator.  Only touched with interrupts off. */
+#define THREAD_CACHE_SIZE 16
+static void *thread_cache[THREAD_CACHE_SIZE];
+static int thread_cache_cnt;
+static long long thread_cache_hits;     /* Creations served by the cache. */
+static long long thread_cache_misses;   /* Creations served by palloc. */
+
+static long long rt_throttles;  /* EDF threads that used up a budget. */
+
+static palloc_shrink_func shrink_thread_cache;
+
+/* Empties the cache under memory pressure.  A cached page saves
+   only a page allocation, so it goes early. */
+static struct palloc_shrinker thread_cache_shrinker =
+  {
+    .name = "thread cache",
+    .priority = 20,
+    .shrink = shrink_thread_cache,
+  };
+
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
@@ -49,15 +183,62 @@ struct kernel_thread_frame
 static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
+static struct seqlock tick_stats_seq;   /* Protects the three above. */
+
+/* Wakeup-to-run latency histogram.  Bucket B counts wakeups
+   that waited at least 2**B nanoseconds (bucket 0 also counts
+   shorter waits) between thread_unblock() and running. */
+#define LATENCY_BUCKETS 40
+static long long latency_hist[LATENCY_BUCKETS];
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
+static unsigned slice_ticks;    /* # of timer ticks since last yield. */
+static bool yield_is_preempt;   /* Is the pending yield a preemption? */
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
-   Controlled by kernel command-line option "-o mlfqs". */
+   Controlled by kernel command-line option "-o mlfqs", unless
+   SCHED_POLICY fixes it at compile time. */
+#ifndef SCHED_POLICY
 bool thread_mlfqs;
+#endif
+
+/* If true, fill each new thread's stack with STACK_PAINT, so that
+   how deep it ever got can be measured from how much of the
+   pattern is left.  Controlled by kernel command-line option
+   "-stackcheck". */
+bool thread_stack_check;
+
+/* Stack depth measurement.  The deepest use seen is kept per
+   thread name, since threads with the same name run the same
+   code. */
+#define STACK_PAINT 0x57ac57ac
+#define STACK_NAME_CNT 32
+struct stack_depth
+  {
+    char name[16];              /* Thread name; empty if unused. */
+    size_t max_used;            /* Deepest use, in bytes. */
+    unsigned exit_cnt;          /* Threads measured at exit. */
+  };
+static struct stack_depth stack_depths[STACK_NAME_CNT];
+
+static void paint_stack (struct thread *);
+static size_t stack_used (const struct thread *);
+static void record_stack_depth (const struct thread *, bool exiting);
+
+/* Multi-level feedback queue scheduler state.
+   See [4.4BSD] and the "4.4BSD Scheduler" appendix of the
+   Pintos reference guide. */
+#define NICE_MIN -20            /* Nicest (lowest priority) value. */
+#define NICE_DEFAULT 0          /* Default nice value. */
+#define NICE_MAX 20             /* Least nice value. */
+#define PRIORITY_FREQ 4         /* Recompute priority every N ticks. */
+static fixed_t load_avg;        /* System load average. */
+
+static void mlfqs_update_priority (struct thread *, void *aux);
+static void mlfqs_update_recent_cpu (struct thread *, void *aux);
+static void mlfqs_update_load_avg (void);
 
 static void kernel_thread (thread_func *, void *aux);
 
@@ -70,6 +251,12 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static struct thread *thread_page_get (void);
+static void thread_page_put (struct thread *);
+static void ready_enqueue (struct thread *, uint64_t stamp);
+static void ready_dequeue (struct thread *);
+static struct thread *ready_next (void);
+static int ready_highest (void);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -87,10 +274,32 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  palloc_register_shrinker (&thread_cache_shrinker);
+  stats_counter ("thread", NULL, "idle_ticks", &idle_ticks);
+  stats_counter ("thread", NULL, "kernel_ticks", &kernel_ticks);
+  stats_counter ("thread", NULL, "user_ticks", &user_ticks);
+  stats_counter ("thread", NULL, "page_cache_hits", &thread_cache_hits);
+  stats_counter ("thread", NULL, "page_cache_misses", &thread_cache_misses);
+  stats_counter ("thread", NULL, "rt_throttles", &rt_throttles);
+  stats_histogram ("thread", NULL, "wakeup_latency_log2_ns", latency_hist,
+                   LATENCY_BUCKETS);
+#ifndef SCHED_POLICY
+  sched_classes[0] = &rt_class;
+  sched_classes[1] = thread_mlfqs ? &mlfqs_class : &prio_class;
+#endif
+  for (i = 0; i < GROUP_MAX * PRI_CNT; i++)
+    list_init (&ready_queues[i / PRI_CNT][i % PRI_CNT]);
+  ready_bitmap = 0;
+  sched_groups[0].in_use = true;
+  sched_groups[0].weight = SCHED_WEIGHT_DEFAULT;
+  sched_groups[0].thread_cnt = 1;
+  list_init (&rt_queue);
+  list_init (&rt_throttled);
   list_init (&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -118,13 +327,17 @@ thread_start (void)
 }
 
 /* Called by the timer interrupt handler at each timer tick.
-   Thus, this function runs in an external interrupt context. */
+   Thus, this function runs in an external interrupt context.
+   USER is true if the tick interrupted user code. */
 void
-thread_tick (void) 
+thread_tick (bool user UNUSED) 
 {
   struct thread *t = thread_current ();
+  int i;
 
   /* Update statistics. */
+  t->run_ticks++;
+  seqlock_write_begin (&tick_stats_seq);
   if (t == idle_thread)
     idle_ticks++;
 #ifdef USERPROG
@@ -133,18 +346,122 @@ thread_tick (void)
 #endif
   else
     kernel_ticks++;
+  seqlock_write_end (&tick_stats_seq);
+#ifdef USERPROG
+  process_tick (user);
+#endif
 
-  /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
-    intr_yield_on_return ();
+  for (i = 0; i < SCHED_CLASS_CNT; i++)
+    sched_classes[i]->tick (t);
+}
+
+/* Accounts for CNT timer ticks that went by while the CPU was
+   halted in the idle thread with the periodic tick stopped (see
+   timer_idle_enter()).  Interrupts must be off. */
+void
+thread_tick_idle (int64_t cnt) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  seqlock_write_begin (&tick_stats_seq);
+  idle_ticks += cnt;
+  seqlock_write_end (&tick_stats_seq);
 }
 
 /* Prints thread statistics. */
 void
 thread_print_stats (void) 
 {
+  long long idle, kernel, user;
+  struct list_elem *e;
+  unsigned seq;
+  int i, last;
+
+  do
+    {
+      seq = seqlock_read_begin (&tick_stats_seq);
+      idle = idle_ticks;
+      kernel = kernel_ticks;
+      user = user_ticks;
+    }
+  while (seqlock_read_retry (&tick_stats_seq, seq));
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
-          idle_ticks, kernel_ticks, user_ticks);
+          idle, kernel, user);
+  printf ("Thread: %lld page cache hits, %lld misses\n",
+          thread_cache_hits, thread_cache_misses);
+  if (thread_stack_check)
+    {
+      /* Fold in the threads still running, then print the deepest
+         use for each name, out of the room left by struct thread. */
+      for (e = list_begin (&all_list); e != list_end (&all_list);
+           e = list_next (e))
+        record_stack_depth (list_entry (e, struct thread, allelem), false);
+      for (i = 0; i < STACK_NAME_CNT && stack_depths[i].name[0] != '\0'; i++)
+        printf ("Thread stack: %s: %zu of %zu bytes used, "
+                "%u exited\n", stack_depths[i].name,
+                stack_depths[i].max_used,
+                PGSIZE - sizeof (struct thread), stack_depths[i].exit_cnt);
+    }
+
+  /* Per-thread accounting, for threads still alive. */
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, allelem);
+      printf ("Thread %d (%s): %lld ticks, %u voluntary and %u "
+              "involuntary switches, ready wait %llu ns total, "
+              "%llu max\n",
+              t->tid, t->name, t->run_ticks, t->voluntary_switches,
+              t->involuntary_switches, timer_cycles_to_ns (t->ready_wait),
+              timer_cycles_to_ns (t->ready_wait_max));
+      if (pmc_available (PMC_CYCLES)) 
+        {
+          enum pmc_event ev;
+
+          printf ("Thread %d (%s):", t->tid, t->name);
+          for (ev = 0; ev < PMC_EVENT_CNT; ev++)
+            if (pmc_available (ev))
+              printf (" %llu %s", t->pmc.count[ev], pmc_event_name (ev));
+          printf ("\n");
+        }
+    }
+
+  /* CPU use by process group. */
+  for (i = 0; i < GROUP_MAX; i++)
+    if (sched_groups[i].in_use)
+      printf ("Thread group %d: weight %d, %d threads, %lld ticks\n",
+              i, sched_groups[i].weight, sched_groups[i].thread_cnt,
+              sched_groups[i].run_ticks);
+
+  /* Latency histogram, trimmed to the last nonempty bucket. */
+  for (last = LATENCY_BUCKETS - 1; last > 0; last--)
+    if (latency_hist[last] != 0)
+      break;
+  printf ("Wakeup latency (ns):");
+  for (i = 0; i <= last; i++)
+    printf (" <2^%d:%lld", i + 1, latency_hist[i]);
+  printf ("\n");
+}
+
+/* Records that thread T, which just started running, waited
+   WAIT cycles of timer_cycles() in the run queue. */
+static void
+account_ready_wait (struct thread *t, uint64_t wait) 
+{
+  t->ready_wait += wait;
+  if (wait > t->ready_wait_max)
+    t->ready_wait_max = wait;
+
+  if (t->woken)
+    {
+      uint64_t ns = timer_cycles_to_ns (wait);
+      int bucket = 0;
+
+      while (bucket < LATENCY_BUCKETS - 1 && ns >> (bucket + 1) != 0)
+        bucket++;
+      latency_hist[bucket]++;
+      t->woken = false;
+    }
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -175,13 +492,28 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = thread_page_get ();
   if (t == NULL)
     return TID_ERROR;
 
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
+  t->timer_slack = thread_current ()->timer_slack;
+  sched_group_add (t, thread_current ()->sched_group);
+  if (thread_mlfqs)
+    {
+      /* A new thread inherits its scheduling history from its
+         parent. */
+      t->nice = thread_current ()->nice;
+      t->recent_cpu = thread_current ()->recent_cpu;
+      mlfqs_update_priority (t, NULL);
+    }
+#ifdef FILESYS
+  /* A new thread starts out in its parent's working directory. */
+  if (thread_current ()->cwd != NULL)
+    t->cwd = dir_reopen (thread_current ()->cwd);
+#endif
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -201,14 +533,8 @@ thread_create (const char *name, int priority,
   /* Add to run queue. */
   thread_unblock (t);
 
-  // initiate list of donators ===============================================================================
-  list_init (&t->donators);
-
-  //Now that priority is at play, if it is created and highest priority, it should immediatly run ========================================================================
-  int curr_priority = (thread_current()->eff_priority > thread_current()->priority) ? thread_current()->eff_priority : thread_current()->priority;
-  if(priority > curr_priority){
-    thread_yield();
-  }
+  /* Run the new thread right away if it outranks us. */
+  thread_preempt ();
 
   return tid;
 }
@@ -229,20 +555,6 @@ thread_block (void)
   schedule ();
 }
 
-/* helper function for list_insert_order; it should place the new
-   elem right after elem are equal and or less than new elem in terms of priority. */ //==========================================================================================
-bool
-priority_ordering (const struct list_elem *a, const struct list_elem *b, void *aux)
-{
-  //return true if priority of a is greater than or equal to b ========================================================================================
-  struct thread *thread_a = list_entry(a, struct thread, elem);
-  struct thread *thread_b = list_entry(b, struct thread, elem);
-  int priority_a = (thread_a->eff_priority > thread_a->priority) ? thread_a->eff_priority : thread_a->priority;
-  int priority_b = (thread_b->eff_priority > thread_b->priority) ? thread_b->eff_priority : thread_b->priority;
-
-  return (priority_a > priority_b);
-}
-
 /* Transitions a blocked thread T to the ready-to-run state.
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
@@ -260,17 +572,83 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  //Use list_insert_ordered instead for priority sorted list =========================================================================================================================!
-  //list_push_back (&ready_list, &t->elem);
-  list_insert_ordered (&ready_list, &t->elem, priority_ordering, NULL);       /* instead of pushing to back of list, insert it in list based on order of priority */ //======================
+  ready_enqueue (t, timer_cycles ());
   t->status = THREAD_READY;
+  t->woken = true;
+  TRACE (TRACE_UNBLOCK, thread_current (), t->tid,
+         thread_effective_priority (t));
   intr_set_level (old_level);
-  //Now that priority is at play, if it is created and highest priority, it should immediatly run ========================================================================
-  // int priority = (t->eff_priority > t->priority) ? t->eff_priority : t->priority;
-  // int curr_priority = (thread_current()->eff_priority > thread_current()->priority) ? thread_current()->eff_priority : thread_current()->priority;
-  // if(thread_current() != idle_thread && priority > curr_priority){
-  //   thread_yield();
-  // }
+}
+
+/* Transitions the CNT blocked threads in THREADS to the
+   ready-to-run state, like calling thread_unblock() on each in
+   turn but in a single pass with interrupts off and one reading
+   of the clock for all of their run queue arrival times.  Does
+   not preempt the running thread. */
+void
+thread_unblock_batch (struct thread **threads, size_t cnt) 
+{
+  enum intr_level old_level;
+  uint64_t now;
+  size_t i;
+
+  old_level = intr_disable ();
+  now = timer_cycles ();
+  for (i = 0; i < cnt; i++)
+    {
+      struct thread *t = threads[i];
+
+      ASSERT (is_thread (t));
+      ASSERT (t->status == THREAD_BLOCKED);
+      ready_enqueue (t, now);
+      t->status = THREAD_READY;
+      t->woken = true;
+      TRACE (TRACE_UNBLOCK, thread_current (), t->tid,
+             thread_effective_priority (t));
+    }
+  intr_set_level (old_level);
+}
+
+/* Yields the CPU if some ready thread should run instead of the
+   running thread: because it belongs to a scheduling class of
+   lower rank, because its class says so (for the priority
+   classes, if it has a higher effective priority), or because
+   the idle thread is running.  Within an interrupt handler,
+   where yielding is not possible, arranges to yield just before
+   the handler returns instead.
+
+   Every path that can make a thread ready or raise its priority
+   (thread_create(), sema_up(), timer wakeups, priority changes)
+   calls this afterward, so that the highest-priority ready
+   thread runs without waiting for the time slice to expire. */
+void
+thread_preempt (void) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  struct thread *next;
+  bool preempt;
+
+  old_level = intr_disable ();
+  next = ready_next ();
+  if (next == NULL)
+    preempt = false;
+  else if (cur == idle_thread)
+    preempt = true;
+  else if (next->sched_class->rank != cur->sched_class->rank)
+    preempt = next->sched_class->rank < cur->sched_class->rank;
+  else
+    preempt = next->sched_class->preempts (next, cur);
+  intr_set_level (old_level);
+
+  if (preempt)
+    {
+      yield_is_preempt = true;
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_yield ();
+    }
 }
 
 /* Returns the name of the running thread. */
@@ -316,11 +694,24 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+#ifdef FILESYS
+  dir_close (thread_current ()->cwd);
+  thread_current ()->cwd = NULL;
+#endif
+
+  /* Hand cached malloc() blocks back to the shared free lists. */
+  fpu_release (thread_current ());
+  malloc_flush ();
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
+  if (thread_current ()->sched_class == &rt_class)
+    rt_util -= thread_current ()->rt_util;
+  sched_group_remove (thread_current ());
+  if (thread_stack_check)
+    record_stack_depth (thread_current (), true);
   list_remove (&thread_current()->allelem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
@@ -339,8 +730,7 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    //list_push_back (&ready_list, &cur->elem);
-    list_insert_ordered (&ready_list, &cur->elem, priority_ordering, NULL);       /* instead of pushing to back of list, insert it in list based on order of priority */ //======================
+    ready_enqueue (cur, timer_cycles ());
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -368,57 +758,292 @@ void
 thread_set_priority (int new_priority) 
 {
   enum intr_level old_level;
+
+  /* The MLFQS computes priorities itself. */
+  if (thread_mlfqs)
+    return;
+
   old_level = intr_disable ();
-  thread_current()->priority = new_priority;
-
-  //If the next thread exists and has higher priority, yield thread ============================================================================================================
-  if (!list_empty(&ready_list)) {
-    struct thread *next_thread = list_entry(list_front(&ready_list), struct thread, elem);
-    int next_thread_priority = (next_thread->eff_priority > next_thread->priority) ? next_thread->eff_priority : next_thread->priority;
-    if (next_thread_priority > new_priority) {
-      thread_yield(); 
-    }                          /* Might have to change the behavior of yield to insert to list in order of priority */ //=======================================
-  }
+  thread_current ()->priority = new_priority;
   intr_set_level (old_level);
+
+  thread_preempt ();
 }
 
 /* Returns the current thread's priority. */
 int
 thread_get_priority (void) 
 {
-  //Return the highest of effective priority and original prirority =============================================================================
-  return (thread_current()->eff_priority > thread_current()->priority) ? thread_current()->eff_priority : thread_current()->priority;
+  return thread_effective_priority (thread_current ());
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE, recomputes its
+   priority, and yields if it no longer has the highest
+   priority. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  if (nice < NICE_MIN)
+    nice = NICE_MIN;
+  else if (nice > NICE_MAX)
+    nice = NICE_MAX;
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority (cur, NULL);
+  intr_set_level (old_level);
+
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
+}
+
+/* Moves the current thread into the earliest-deadline-first
+   class, guaranteeing it RUNTIME timer ticks of CPU time in
+   every PERIOD ticks, or back to the class it started in if
+   RUNTIME is 0.  While it has run time left in its period, the
+   thread runs ahead of every thread outside the class and of
+   those in the class with a later deadline.  Once it has used
+   the run time up, it does not run again until the period
+   ends.
+
+   Returns false, changing nothing, if the arguments are out of
+   range or admitting the thread would commit more than
+   RT_UTIL_MAX of the CPU to the class.  Threads the caller
+   creates afterward start outside the class. */
+bool
+thread_set_realtime (int64_t runtime, int64_t period) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int util, old_util;
+
+  if (period <= 0 || runtime < 0 || runtime > period)
+    return false;
+  util = DIV_ROUND_UP (runtime * RT_UTIL_SCALE, period);
+
+  old_level = intr_disable ();
+  old_util = cur->sched_class == &rt_class ? cur->rt_util : 0;
+  if (rt_util - old_util + util > RT_UTIL_MAX)
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  rt_util += util - old_util;
+  if (runtime == 0)
+    {
+      cur->sched_class = fair_class;
+      cur->rt_util = 0;
+    }
+  else
+    {
+      cur->sched_class = &rt_class;
+      cur->rt_runtime = cur->rt_budget = runtime;
+      cur->rt_period = period;
+      cur->rt_deadline = timer_ticks () + period;
+      cur->rt_util = util;
+    }
+  intr_set_level (old_level);
+
+  thread_preempt ();
+  return true;
+}
+
+/* Creates a process group with the given WEIGHT, between 1 and
+   SCHED_WEIGHT_MAX, and moves the current thread into it.
+   Threads it creates afterward, including the threads of
+   processes it starts, join the group too.  Returns the new
+   group's number, or -1 if WEIGHT is out of range or there are
+   already GROUP_MAX groups.  A group goes away when its last
+   thread leaves it. */
+int
+sched_group_create (int weight) 
+{
+  enum intr_level old_level;
+  int i;
+
+  if (weight < 1 || weight > SCHED_WEIGHT_MAX)
+    return -1;
+
+  old_level = intr_disable ();
+  for (i = 1; i < GROUP_MAX; i++)
+    if (!sched_groups[i].in_use)
+      {
+        struct sched_group *g = &sched_groups[i];
+
+        g->in_use = true;
+        g->weight = weight;
+        g->vruntime = min_vruntime;
+        g->run_ticks = 0;
+        g->thread_cnt = 0;
+        sched_group_remove (thread_current ());
+        sched_group_add (thread_current (), i);
+        break;
+      }
+  intr_set_level (old_level);
+
+  return i < GROUP_MAX ? i : -1;
+}
+
+/* Moves the current thread into existing process GROUP.
+   Returns false if there is no such group. */
+bool
+sched_group_join (int group) 
+{
+  enum intr_level old_level;
+  bool ok;
+
+  old_level = intr_disable ();
+  ok = group >= 0 && group < GROUP_MAX && sched_groups[group].in_use;
+  if (ok && group != thread_current ()->sched_group)
+    {
+      sched_group_remove (thread_current ());
+      sched_group_add (thread_current (), group);
+    }
+  intr_set_level (old_level);
+
+  return ok;
+}
+
+/* Sets the weight of process GROUP to WEIGHT, between 1 and
+   SCHED_WEIGHT_MAX.  Returns false if WEIGHT is out of range or
+   there is no such group. */
+bool
+sched_group_set_weight (int group, int weight) 
+{
+  enum intr_level old_level;
+  bool ok;
+
+  if (weight < 1 || weight > SCHED_WEIGHT_MAX)
+    return false;
+
+  old_level = intr_disable ();
+  ok = group >= 0 && group < GROUP_MAX && sched_groups[group].in_use;
+  if (ok)
+    sched_groups[group].weight = weight;
+  intr_set_level (old_level);
+
+  return ok;
+}
+
+/* Returns the current thread's process group. */
+int
+sched_group_current (void) 
+{
+  return thread_current ()->sched_group;
+}
+
+/* Adds T, which must not be in the run queue, to GROUP.
+   Interrupts must be off. */
+static void
+sched_group_add (struct thread *t, int group) 
+{
+  ASSERT (sched_groups[group].in_use);
+
+  t->sched_group = group;
+  sched_groups[group].thread_cnt++;
+}
+
+/* Takes T, which must not be in the run queue, out of its group,
+   releasing the group if T was its last thread.  Interrupts must
+   be off. */
+static void
+sched_group_remove (struct thread *t) 
+{
+  struct sched_group *g = &sched_groups[t->sched_group];
+
+  if (--g->thread_cnt == 0 && t->sched_group != 0)
+    g->in_use = false;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load = fp_round (fp_mul_int (load_avg, 100));
+  intr_set_level (old_level);
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent = fp_round (fp_mul_int (thread_current ()->recent_cpu, 100));
+  intr_set_level (old_level);
+  return recent;
+}
+
+/* Recomputes T's MLFQS priority from its recent_cpu and nice
+   values:
+
+       priority = PRI_MAX - (recent_cpu / 4) - (nice * 2),
+
+   clamped to PRI_MIN...PRI_MAX, and moves T to the matching run
+   queue level if it is ready.  Interrupts must be off. */
+static void
+mlfqs_update_priority (struct thread *t, void *aux UNUSED) 
+{
+  int priority;
+
+  if (t == idle_thread)
+    return;
+
+  priority = PRI_MAX - fp_to_int (fp_div_int (t->recent_cpu, 4))
+             - t->nice * 2;
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+
+  t->priority = priority;
+  thread_requeue (t);
+}
+
+/* Decays T's recent_cpu once per second:
+
+       recent_cpu = (2*load_avg)/(2*load_avg + 1) * recent_cpu + nice.
+
+   AUX points to the decay coefficient, which the caller computes
+   once per pass rather than once per thread. */
+static void
+mlfqs_update_recent_cpu (struct thread *t, void *aux) 
+{
+  fixed_t coeff = *(fixed_t *) aux;
+
+  if (t == idle_thread)
+    return;
+
+  t->recent_cpu = fp_add_int (fp_mul (coeff, t->recent_cpu), t->nice);
+}
+
+/* Updates the system load average once per second:
+
+       load_avg = (59/60)*load_avg + (1/60)*ready_threads,
+
+   where ready_threads counts the running thread (unless it is
+   the idle thread) and every thread in the run queue. */
+static void
+mlfqs_update_load_avg (void) 
+{
+  int ready_threads = ready_cnt;
+
+  if (thread_current () != idle_thread)
+    ready_threads++;
+
+  load_avg = fp_add (fp_div_int (fp_mul_int (load_avg, 59), 60),
+                     fp_div_int (fp_from_int (ready_threads), 60));
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -443,6 +1068,20 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Spend the idle time zeroing pages for later PAL_ZERO
+         requests.  Interrupts are on meanwhile, so a thread that
+         becomes ready preempts us as usual. */
+      intr_enable ();
+      while (palloc_prezero ())
+        continue;
+      intr_disable ();
+
+      /* Stop the periodic tick, if no tick soon has work.  A
+         tick ends a throttled EDF thread's wait for its next
+         period, so keep ticking while there is one. */
+      if (list_empty (&rt_throttled))
+        timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -503,22 +1142,54 @@ init_thread (struct thread *t, const char *name, int priority)
   ASSERT (name != NULL);
 
   memset (t, 0, sizeof *t);
+  if (thread_stack_check)
+    paint_stack (t);
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
+  t->nice = NICE_DEFAULT;
+  t->recent_cpu = 0;
+  t->sched_class = fair_class;
+  t->donated_priority = PRI_MIN - 1;
+  list_init (&t->held_locks);
+  t->waiting_lock = NULL;
+  t->timed_sema = NULL;
+  t->wait_sema = NULL;
+  t->cond_waiter = NULL;
+#ifdef LOCKDEP
+  t->lockdep_depth = 0;
+#endif
+#ifdef USERPROG
+  t->exit_status = -1;
+  t->leader = t;
+  t->group = NULL;
+  t->uthread = NULL;
+  t->heap_start = t->brk = t->heap_end = NULL;
+  t->clock = NULL;
+  t->child = NULL;
+  list_init (&t->children);
+  list_init (&t->exited);
+  cond_init (&t->child_exited);
+  poll_queue_init (&t->child_pollers);
+  list_init (&t->shm_refs);
+  t->aio = NULL;
+  t->fds = NULL;
+  t->fd_map = NULL;
+  t->fd_cnt = 0;
+#endif
+#ifdef VM
+  t->fault_next = NULL;
+  t->fault_window = 0;
+  list_init (&t->mappings);
+  t->next_mapid = 0;
+#endif
+  prng_seed (&t->prng, rdtsc () ^ timer_ticks (), (uintptr_t) t);
   t->magic = THREAD_MAGIC;
 
   old_level = intr_disable ();
   list_push_back (&all_list, &t->allelem);
-  
   intr_set_level (old_level);
-
-  //initialize effective priority to -1 ====================================================================================================================================
-  t->eff_priority = -1;
-
-  //set waiting for to NULL
-  t->waiting_for = NULL;
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -542,10 +1213,379 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  struct thread *t = ready_next ();
+
+  if (t == NULL)
     return idle_thread;
+
+  ready_dequeue (t);
+  return t;
+}
+
+/* Returns the thread the scheduling classes would run next,
+   without removing it from the run queue, or a null pointer if
+   nothing is ready.  Interrupts must be off. */
+static struct thread *
+ready_next (void) 
+{
+  int i;
+
+  for (i = 0; i < SCHED_CLASS_CNT; i++)
+    {
+      struct thread *t = sched_classes[i]->pick_next ();
+      if (t != NULL)
+        return t;
+    }
+  return NULL;
+}
+
+/* Adds T to the run queue, in its scheduling
+   class, recording STAMP, a timer_cycles() reading, as when it
+   became ready.  Interrupts must be off. */
+static void
+ready_enqueue (struct thread *t, uint64_t stamp) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  t->ready_stamp = stamp;
+  ready_cnt++;
+  t->sched_class->enqueue (t);
+}
+
+/* Removes T from the run queue.  Interrupts must be off. */
+static void
+ready_dequeue (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  ready_cnt--;
+  t->sched_class->dequeue (t);
+}
+
+/* Priority classes.
+
+   The priority scheduler and the MLFQS share ready_queues and
+   differ only in where priorities come from: the MLFQS
+   recomputes them from recent CPU use on the timer tick. */
+
+/* Appends T to the back of its group's run queue level for its
+   current effective priority. */
+static void
+prio_enqueue (struct thread *t) 
+{
+  int level = thread_effective_priority (t);
+  uint64_t bit = (uint64_t) 1 << level;
+  struct sched_group *g = &sched_groups[t->sched_group];
+
+  ASSERT (PRI_MIN <= level && level <= PRI_MAX);
+
+  if (group_bitmaps[t->sched_group] == 0 && g->vruntime < min_vruntime)
+    g->vruntime = min_vruntime;
+
+  t->ready_level = level;
+  list_push_back (&ready_queues[t->sched_group][level], &t->elem);
+  group_bitmaps[t->sched_group] |= bit;
+  ready_bitmap |= bit;
+}
+
+/* Removes T from its run queue level. */
+static void
+prio_dequeue (struct thread *t) 
+{
+  int level = t->ready_level;
+  uint64_t bit = (uint64_t) 1 << level;
+  int i;
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[t->sched_group][level]))
+    {
+      group_bitmaps[t->sched_group] &= ~bit;
+      for (i = 0; i < GROUP_MAX; i++)
+        if (group_bitmaps[i] & bit)
+          return;
+      ready_bitmap &= ~bit;
+    }
+}
+
+/* Returns the thread at the front of the highest nonempty run
+   queue level of the group with the least virtual run time
+   among those with threads at that level, or a null pointer if
+   all are empty. */
+static struct thread *
+prio_pick_next (void) 
+{
+  int level, best, i;
+  uint64_t bit;
+
+  if (ready_bitmap == 0)
+    return NULL;
+
+  level = ready_highest ();
+  bit = (uint64_t) 1 << level;
+  best = -1;
+  for (i = 0; i < GROUP_MAX; i++)
+    if ((group_bitmaps[i] & bit)
+        && (best < 0
+            || sched_groups[i].vruntime < sched_groups[best].vruntime))
+      best = i;
+  return list_entry (list_front (&ready_queues[best][level]),
+                     struct thread, elem);
+}
+
+/* A ready thread preempts the running one only with a higher
+   effective priority; equal priorities take turns at the end of
+   each time slice. */
+static bool
+prio_preempts (const struct thread *t, const struct thread *cur) 
+{
+  return thread_effective_priority (t) > thread_effective_priority (cur);
+}
+
+/* Charges the running thread's group for the tick and ends the
+   thread's time slice after TIME_SLICE ticks. */
+static void
+prio_tick (struct thread *cur) 
+{
+  struct sched_group *g = &sched_groups[cur->sched_group];
+  int64_t least;
+  int i;
+
+  if (cur->sched_class != fair_class)
+    return;
+
+  if (cur != idle_thread)
+    {
+      g->vruntime += GROUP_VTICK / g->weight;
+      g->run_ticks++;
+      least = g->vruntime;
+      for (i = 0; i < GROUP_MAX; i++)
+        if (group_bitmaps[i] != 0 && sched_groups[i].vruntime < least)
+          least = sched_groups[i].vruntime;
+      if (least > min_vruntime)
+        min_vruntime = least;
+    }
+
+  if (++slice_ticks >= TIME_SLICE)
+    {
+      yield_is_preempt = true;
+      intr_yield_on_return ();
+    }
+}
+
+/* Updates recent_cpu, the load average, and priorities as the
+   MLFQS requires, then enforces the time slice. */
+static void
+mlfqs_tick (struct thread *cur) 
+{
+  int64_t now = timer_ticks ();
+
+  /* Only the running thread's recent_cpu changes between
+     one-second boundaries, so that is the only thread whose
+     priority needs recomputing every PRIORITY_FREQ ticks.
+     Everyone else is handled by the once-per-second pass, which
+     keeps the common case O(1) in the thread count. */
+  if (cur != idle_thread)
+    cur->recent_cpu = fp_add_int (cur->recent_cpu, 1);
+  if (now % TIMER_FREQ == 0)
+    {
+      fixed_t twice_load, coeff;
+
+      mlfqs_update_load_avg ();
+      twice_load = fp_mul_int (load_avg, 2);
+      coeff = fp_div (twice_load, fp_add_int (twice_load, 1));
+      thread_foreach (mlfqs_update_recent_cpu, &coeff);
+      thread_foreach (mlfqs_update_priority, NULL);
+    }
+  else if (now % PRIORITY_FREQ == 0)
+    mlfqs_update_priority (cur, NULL);
+
+  thread_preempt ();
+  prio_tick (cur);
+}
+
+static const struct sched_class prio_class =
+  {
+    .name = "priority",
+    .rank = 1,
+    .enqueue = prio_enqueue,
+    .dequeue = prio_dequeue,
+    .pick_next = prio_pick_next,
+    .preempts = prio_preempts,
+    .tick = prio_tick,
+  };
+
+static const struct sched_class mlfqs_class =
+  {
+    .name = "mlfqs",
+    .rank = 1,
+    .enqueue = prio_enqueue,
+    .dequeue = prio_dequeue,
+    .pick_next = prio_pick_next,
+    .preempts = prio_preempts,
+    .tick = mlfqs_tick,
+  };
+
+/* Returns the highest priority level that has a ready thread, or
+   PRI_MIN - 1 if the priority run queue is empty. */
+static int
+ready_highest (void) 
+{
+  uint64_t bitmap = ready_bitmap;
+  uint32_t hi = bitmap >> 32;
+  uint32_t lo = bitmap;
+
+  if (hi != 0)
+    return 32 + (31 - __builtin_clz (hi));
+  else if (lo != 0)
+    return 31 - __builtin_clz (lo);
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    return PRI_MIN - 1;
+}
+
+/* Earliest-deadline-first class.
+
+   Each thread is entitled to rt_runtime ticks in every period
+   of rt_period ticks, the current one ending at rt_deadline.
+   The ready thread with the earliest deadline runs.  The tick
+   charges the running thread's budget, and a thread that spends
+   its budget waits on the rt_throttled list until its period
+   ends.  Admission control in thread_set_realtime() keeps the
+   total demand schedulable. */
+
+/* Starts T's next period, no earlier than NOW. */
+static void
+rt_replenish (struct thread *t, int64_t now) 
+{
+  t->rt_deadline += t->rt_period;
+  if (t->rt_deadline <= now)
+    t->rt_deadline = now + t->rt_period;
+  t->rt_budget = t->rt_runtime;
+}
+
+/* Orders threads by deadline. */
+static bool
+rt_deadline_less (const struct list_elem *a_, const struct list_elem *b_,
+                  void *aux UNUSED) 
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->rt_deadline < b->rt_deadline;
+}
+
+/* Queues T by deadline, or as throttled if it has no budget
+   left.  A thread that was blocked past the end of its period
+   starts the next one. */
+static void
+rt_enqueue (struct thread *t) 
+{
+  int64_t now = timer_ticks ();
+
+  if (t->rt_deadline <= now)
+    rt_replenish (t, now);
+  if (t->rt_budget > 0)
+    list_insert_ordered (&rt_queue, &t->elem, rt_deadline_less, NULL);
+  else
+    list_push_back (&rt_throttled, &t->elem);
+}
+
+/* Removes T from whichever EDF list it is in. */
+static void
+rt_dequeue (struct thread *t) 
+{
+  list_remove (&t->elem);
+}
+
+/* Returns the unthrottled thread with the earliest deadline. */
+static struct thread *
+rt_pick_next (void) 
+{
+  if (list_empty (&rt_queue))
+    return NULL;
+  return list_entry (list_front (&rt_queue), struct thread, elem);
+}
+
+static bool
+rt_preempts (const struct thread *t, const struct thread *cur) 
+{
+  return t->rt_deadline < cur->rt_deadline;
+}
+
+/* Charges the running thread's budget, throttling it when the
+   budget runs out, and releases throttled threads whose period
+   has ended. */
+static void
+rt_tick (struct thread *cur) 
+{
+  int64_t now = timer_ticks ();
+  bool released = false;
+  struct list_elem *e;
+
+  for (e = list_begin (&rt_throttled); e != list_end (&rt_throttled);)
+    {
+      struct thread *t = list_entry (e, struct thread, elem);
+
+      e = list_next (e);
+      if (t->rt_deadline <= now)
+        {
+          list_remove (&t->elem);
+          rt_replenish (t, now);
+          list_insert_ordered (&rt_queue, &t->elem,
+                               rt_deadline_less, NULL);
+          released = true;
+        }
+    }
+
+  if (cur->sched_class == &rt_class)
+    {
+      cur->rt_budget--;
+      if (cur->rt_deadline <= now)
+        rt_replenish (cur, now);
+      else if (cur->rt_budget <= 0)
+        {
+          rt_throttles++;
+          yield_is_preempt = true;
+          intr_yield_on_return ();
+        }
+    }
+
+  if (released)
+    thread_preempt ();
+}
+
+static const struct sched_class rt_class =
+  {
+    .name = "edf",
+    .rank = 0,
+    .enqueue = rt_enqueue,
+    .dequeue = rt_dequeue,
+    .pick_next = rt_pick_next,
+    .preempts = rt_preempts,
+    .tick = rt_tick,
+  };
+
+/* Moves ready thread T to the run queue level that matches its
+   current effective priority, or blocked thread T to its place
+   among the waiters it is queued with (see sema_requeue()).
+   Call this after changing the priority of a thread that may be
+   ready or blocked; it does nothing for a running or dying
+   thread, or for a ready thread in the EDF class, which ignores
+   priorities.  Interrupts must be off. */
+void
+thread_requeue (struct thread *t) 
+{
+  ASSERT (is_thread (t));
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->status == THREAD_READY && t != idle_thread
+      && t->sched_class != &rt_class
+      && t->ready_level != thread_effective_priority (t))
+    {
+      ready_dequeue (t);
+      ready_enqueue (t, t->ready_stamp);
+    }
+  else if (t->status == THREAD_BLOCKED)
+    sema_requeue (t);
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -574,8 +1614,15 @@ thread_schedule_tail (struct thread *prev)
   /* Mark us as running. */
   cur->status = THREAD_RUNNING;
 
+  /* Charge the time spent waiting to run.  The idle thread runs
+     when nothing is ready, not from the run queue, so its
+     ready_stamp is stale and it has no wait to charge. */
+  if (prev != NULL && cur != idle_thread)
+    account_ready_wait (cur, timer_cycles () - cur->ready_stamp);
+
   /* Start new time slice. */
-  thread_ticks = 0;
+  slice_ticks = 0;
+  yield_is_preempt = false;
 
 #ifdef USERPROG
   /* Activate the new address space. */
@@ -590,7 +1637,7 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      thread_page_put (prev);
     }
 }
 
@@ -612,11 +1659,152 @@ schedule (void)
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  if (cur == idle_thread)
+    timer_idle_exit ();
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      /* Switching away while still runnable means we were
+         preempted or yielded; otherwise we blocked or exited. */
+      if (cur->status == THREAD_READY)
+        cur->involuntary_switches++;
+      else
+        cur->voluntary_switches++;
+      TRACE (TRACE_SWITCH, cur, next->tid,
+             cur->status == THREAD_BLOCKED ? TRACE_BLOCK
+             : cur->status == THREAD_DYING ? TRACE_EXIT
+             : yield_is_preempt ? TRACE_PREEMPT : TRACE_YIELD);
+      pmc_switch (cur);
+      fpu_switch (next);
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
+/* Fills the unused part of T's stack with STACK_PAINT.  If T is
+   the running thread, which only happens for the initial thread,
+   stops a little below the stack pointer, leaving this
+   function's own frame alone. */
+static void
+paint_stack (struct thread *t) 
+{
+  uint32_t *p = (uint32_t *) ROUND_UP ((uintptr_t) (t + 1), 4);
+  uint32_t *end = (uint32_t *) ((uint8_t *) t + PGSIZE);
+
+  if (t == running_thread ())
+    {
+      uint32_t *esp;
+      asm ("mov %%esp, %0" : "=g" (esp));
+      end = esp - 16;
+    }
+  while (p < end)
+    *p++ = STACK_PAINT;
+}
+
+/* Returns how many bytes at the top of T's page, which must have
+   been painted, have been written since. */
+static size_t
+stack_used (const struct thread *t) 
+{
+  const uint32_t *p = (const uint32_t *) ROUND_UP ((uintptr_t) (t + 1), 4);
+  const uint8_t *end = (const uint8_t *) t + PGSIZE;
+
+  while ((const uint8_t *) p < end && *p == STACK_PAINT)
+    p++;
+  return end - (const uint8_t *) p;
+}
+
+/* Folds T's stack use into the maximum for its name, counting T
+   as exited if EXITING.  A name that finds the table full is not
+   recorded. */
+static void
+record_stack_depth (const struct thread *t, bool exiting) 
+{
+  size_t used = stack_used (t);
+  enum intr_level old_level;
+  int i;
+
+  old_level = intr_disable ();
+  for (i = 0; i < STACK_NAME_CNT; i++)
+    {
+      struct stack_depth *d = &stack_depths[i];
+
+      if (d->name[0] == '\0')
+        strlcpy (d->name, t->name, sizeof d->name);
+      if (!strcmp (d->name, t->name))
+        {
+          if (used > d->max_used)
+            d->max_used = used;
+          if (exiting)
+            d->exit_cnt++;
+          break;
+        }
+    }
+  intr_set_level (old_level);
+}
+
+/* Returns a page for a new thread, preferring one cached from a
+   thread that has exited, or a null pointer if no memory is
+   available.  A cached page is not cleared, because
+   init_thread() clears the struct thread at its base and the
+   rest of the page is stack, which needs no initialization. */
+static struct thread *
+thread_page_get (void) 
+{
+  enum intr_level old_level;
+  struct thread *t = NULL;
+
+  old_level = intr_disable ();
+  if (thread_cache_cnt > 0)
+    {
+      t = thread_cache[--thread_cache_cnt];
+      thread_cache_hits++;
+    }
+  else
+    thread_cache_misses++;
+  intr_set_level (old_level);
+
+  if (t == NULL)
+    t = palloc_get_page (PAL_ZERO);
+  return t;
+}
+
+/* Releases dead thread T's page, caching it if there is room.
+   Called from thread_schedule_tail() with interrupts off, so
+   freeing to the page allocator is the rare case. */
+static void
+thread_page_put (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  t->magic = 0;
+  if (thread_cache_cnt < THREAD_CACHE_SIZE)
+    thread_cache[thread_cache_cnt++] = t;
+  else
+    palloc_free_page (t);
+}
+
+/* Shrinker: frees up to PAGE_CNT cached thread pages. */
+static size_t
+shrink_thread_cache (enum palloc_flags flags, size_t page_cnt,
+                     void *aux UNUSED) 
+{
+  enum intr_level old_level;
+  size_t freed = 0;
+
+  /* Thread pages come from the kernel pool. */
+  if (flags & PAL_USER)
+    return 0;
+
+  old_level = intr_disable ();
+  while (freed < page_cnt && thread_cache_cnt > 0)
+    {
+      palloc_free_page (thread_cache[--thread_cache_cnt]);
+      freed++;
+    }
+  intr_set_level (old_level);
+  return freed;
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid (void) 
@@ -2,8 +2,21 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <flatmap.h>
+#include <heap.h>
 #include <list.h>
+#include <random.h>
+#include <stdbool.h>
 #include <stdint.h>
+#include "devices/pmc.h"
+#include "threads/fixed-point.h"
+#include "threads/lockdep.h"
+#include "threads/malloc.h"
+#include "threads/poll.h"
+#include "threads/synch.h"
+
+/* Scheduling policies (thread.c). */
+struct sched_class;
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -24,6 +37,25 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+#ifdef USERPROG
+/* Resources a user process has used, kept by its leader and
+   charged by all of its threads (userprog/process.c).  Resident
+   pages are the page directory's to count. */
+struct process_usage
+  {
+    unsigned long long minor_faults;    /* Faults served from memory. */
+    unsigned long long major_faults;    /* ...that read a file or swap. */
+    unsigned long long read_bytes;      /* Read through system calls. */
+    unsigned long long write_bytes;     /* Written through system calls. */
+    unsigned long long read_sectors;    /* Read from disk while running. */
+    unsigned long long write_sectors;   /* Written to disk while running. */
+    long long user_ticks;               /* Timer ticks in user mode. */
+    long long kernel_ticks;             /* ...in the kernel. */
+    size_t rss_max;                     /* Most pages resident at once, set
+                                           at exit. */
+  };
+#endif
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -75,55 +107,175 @@ typedef int tid_t;
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
 /* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+   the run queue (thread.c), or it can be an element in a list of
+   blocked threads.  It can be used these two ways only because
+   they are mutually exclusive: only a thread in the ready state
+   is on the run queue, whereas only a thread in the blocked
+   state waits on such a list.  Semaphores, whose waiters are a
+   heap rather than a list, use `waitelem' instead. */
 struct thread
   {
-    /* Owned by thread.c. */
-    tid_t tid;                          /* Thread identifier. */
-    enum thread_status status;          /* Thread state. */
-    char name[16];                      /* Name (for debugging purposes). */
+    /* Owned by thread.c.
+
+       The members up to `tid' are all that schedule(),
+       thread_unblock(), and picking from a run queue touch, and
+       they fit in the first 64 bytes, one cache line, so that
+       switching among hundreds of threads in turn costs one line
+       per thread.  Keep them together and at the front. */
     uint8_t *stack;                     /* Saved stack pointer. */
+    enum thread_status status;          /* Thread state. */
     int priority;                       /* Priority. */
+    int donated_priority;               /* Highest donation, or PRI_MIN - 1. */
+    const struct sched_class *sched_class; /* Scheduling policy. */
+    int sched_group;                    /* Process group, for CPU shares. */
+    int ready_level;                    /* Run queue level while ready. */
+    bool woken;                         /* Made ready by thread_unblock()? */
+    struct list_elem elem;              /* List element, shared between
+                                           thread.c and synch.c. */
+    uint64_t ready_stamp;               /* timer_cycles() when made ready. */
+    tid_t tid;                          /* Thread identifier. */
+
+    char name[16];                      /* Name (for debugging purposes). */
     struct list_elem allelem;           /* List element for all threads list. */
 
-    int wakeup_time;                    /* I Added this so that I dont have to make a whole new struct for sleeping threads. */ //---------------------------------------------------------------
-    struct list_elem sleepelem;         /* List element for sleeping threads list. It should know its relative position to the thread address*/ //-----------------------------------------------
-    //struct list waiting_threads;        /* List of all threads that is waiting for this thread */ //=============================================================================================
-    //struct list_elem waitingelem        /* List element for being in the waiting list of another thread */ //====================================================================================
+    int64_t wakeup_time;                /* Tick to wake up at, if sleeping. */
+    int64_t timer_slack;                /* Ticks a sleep may overrun. */
+    struct list_elem sleepelem;         /* Element in a timer wheel slot. */
+
+    /* Priority donation (synch.c), with donated_priority above. */
+    struct list held_locks;             /* Locks held, for recomputing it. */
+    struct lock *waiting_lock;          /* Lock being waited for, if any. */
+
+    /* Semaphore wait queue membership (synch.c). */
+    struct heap_elem waitelem;          /* Element in a semaphore's waiters. */
+    int wait_priority;                  /* Priority the waiters are keyed on. */
+    unsigned wait_seq;                  /* Arrival order, to break ties. */
+    struct semaphore *timed_sema;       /* Semaphore of a timed wait, if any. */
+    struct semaphore *wait_sema;        /* Semaphore whose waiters hold us. */
+    struct semaphore_elem *cond_waiter; /* Our entry in a condition's
+                                           waiters, if any. */
+
+#ifdef LOCKDEP
+    /* Lock-order validation (lockdep.c). */
+    struct lock *lockdep_held[LOCKDEP_HELD_MAX];  /* Locks held. */
+    int lockdep_depth;                  /* Number of locks in lockdep_held. */
+#endif
+
+    /* Earliest-deadline-first scheduling, in timer ticks. */
+    int64_t rt_runtime;                 /* Run time allowed per period. */
+    int64_t rt_period;                  /* Period length. */
+    int64_t rt_deadline;                /* End of the current period. */
+    int64_t rt_budget;                  /* Run time left this period. */
+    int rt_util;                        /* Admitted share of the CPU. */
+
+    int nice;                           /* MLFQS niceness. */
+    fixed_t recent_cpu;                 /* MLFQS recent CPU. */
 
-    //int holder_prev_priority;           /* This is to record the effective priority of the holder before it would updated by this thread; -1/NULL means effective priority isn't in effect */ //=
-    struct thread *waiting_for;         /* The thread that this thread is waiting for; NULL means it isnt waiting for anyone(no nested) */ //====================================================
-    struct thread *donator;
-    struct list donators;               /* List of donators in order of highest donation to lowest */ //====================================================================
-    struct list_elem donatorselem;       /* List element for donator list */
+    /* Scheduler accounting. */
+    long long run_ticks;                /* Timer ticks spent running. */
+    unsigned voluntary_switches;        /* Switches away by blocking. */
+    unsigned involuntary_switches;      /* Switches away while runnable. */
+    uint64_t ready_wait;                /* Total cycles spent ready. */
+    uint64_t ready_wait_max;            /* Longest single ready wait. */
+    struct pmc_counts pmc;              /* Hardware events while running. */
 
-    int eff_priority;                   /* Effective Priority */ //======================================================================================================================================
+    /* Owned by threads/fpu.c. */
+    void *fpu_state;                    /* FXSAVE area, or NULL if unused. */
 
-    /* Shared between thread.c and synch.c. */
-    struct list_elem elem;              /* List element. */
+    /* Owned by malloc.c. */
+    struct malloc_mag malloc_mag;       /* Cached free blocks. */
+    struct prng prng;                   /* For random_u32(). */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+    int exit_status;                    /* Reported by process_exit(). */
+    struct thread *leader;              /* Owner of the process's files
+                                           and memory; may be self. */
+    struct thread_group *group;         /* Process's threads, or NULL if
+                                           it has only ever had one. */
+    struct uthread *uthread;            /* Own record, if not the leader. */
+    uint8_t *heap_start;                /* Start of the heap. */
+    uint8_t *brk;                       /* End of the heap. */
+    uint8_t *heap_end;                  /* End of the heap's pages. */
+    struct clock_page *clock;           /* Kernel view of the clock page. */
+    struct child *child;                /* Own exit record, or NULL. */
+    struct list children;               /* Records of unreaped children. */
+    struct list exited;                 /* ...of those that have exited. */
+    struct condition child_exited;      /* Signaled when a child exits. */
+    struct poll_queue child_pollers;    /* Woken when a child exits. */
+    struct process_usage usage;         /* Resources used so far. */
+    struct process_usage child_usage;   /* ...by children waited for. */
+
+    /* Owned by userprog/shm.c. */
+    struct list shm_refs;               /* Shared memory segments held. */
+
+    /* Owned by userprog/aio.c. */
+    struct aio_ctx *aio;                /* Asynchronous I/O, or NULL. */
+
+    /* Owned by userprog/syscall.c. */
+    void *user_esp;                     /* User esp at system call entry. */
+    struct fd_entry *fds;               /* Open files and pipes, by fd. */
+    struct bitmap *fd_map;              /* fds in use. */
+    size_t fd_cnt;                      /* Size of fds and fd_map. */
+#endif
+#ifdef VM
+    /* Owned by userprog/process.c. */
+    struct file *exec_file;             /* Executable, paged in on demand. */
+
+    /* Owned by vm/page.c. */
+    struct flatmap pages;               /* Supplemental page table. */
+    void *fault_next;                   /* Page after the last brought in. */
+    unsigned fault_window;              /* Pages to bring in on a fault. */
+
+    /* Owned by vm/mmap.c. */
+    struct list mappings;               /* Memory-mapped files. */
+    int next_mapid;                     /* Id for the next mapping. */
+#endif
+
+#ifdef FILESYS
+    /* Owned by filesys/filesys.c. */
+    struct dir *cwd;                    /* Working directory, or NULL for root. */
+
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Journal handles open. */
 #endif
 
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
   };
 
+/* Scheduling policies for SCHED_POLICY. */
+#define SCHED_PRIORITY 1        /* Priority scheduler with donation. */
+#define SCHED_MLFQS 2           /* Multi-level feedback queue scheduler. */
+
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
-   Controlled by kernel command-line option "-o mlfqs". */
+   Controlled by kernel command-line option "-o mlfqs".
+
+   A kernel can instead be built for one policy only, by adding
+   -DSCHED_POLICY=SCHED_PRIORITY or -DSCHED_POLICY=SCHED_MLFQS to
+   DEFINES in a project's Make.vars.  thread_mlfqs is then a
+   constant, so the compiler drops the other policy's code from
+   the scheduler, priority donation, and the timer tick. */
+#ifndef SCHED_POLICY
 extern bool thread_mlfqs;
+#elif SCHED_POLICY == SCHED_PRIORITY
+#define thread_mlfqs false
+#elif SCHED_POLICY == SCHED_MLFQS
+#define thread_mlfqs true
+#else
+#error SCHED_POLICY must be SCHED_PRIORITY or SCHED_MLFQS.
+#endif
+
+/* Measure kernel stack depth?  Controlled by "-stackcheck". */
+extern bool thread_stack_check;
 
 void thread_init (void);
 void thread_start (void);
 
-void thread_tick (void);
+void thread_tick (bool user);
+void thread_tick_idle (int64_t cnt);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -131,6 +283,9 @@ tid_t thread_create (const char *name, int priority, thread_func *, void *);
 
 void thread_block (void);
 void thread_unblock (struct thread *);
+void thread_unblock_batch (struct thread **, size_t cnt);
+void thread_requeue (struct thread *);
+void thread_preempt (void);
 
 struct thread *thread_current (void);
 tid_t thread_tid (void);
@@ -143,11 +298,54 @@ void thread_yield (void);
 typedef void thread_action_func (struct thread *t, void *aux);
 void thread_foreach (thread_action_func *, void *);
 
+/* Returns the priority T is scheduled at: its own priority or
+   the priority donated to it, whichever is higher.  The MLFQS
+   never donates. */
+static inline int
+thread_effective_priority (const struct thread *t)
+{
+#if defined SCHED_POLICY && SCHED_POLICY == SCHED_MLFQS
+  return t->priority;
+#else
+  return t->donated_priority > t->priority ? t->donated_priority : t->priority;
+#endif
+}
+
+/* Returns a pseudo-random number from the running thread's own
+   generator, which needs no locking.  The generators are seeded
+   from the time stamp counter and timer ticks, so unlike
+   random_ulong() the numbers differ from run to run even with
+   -rs.  Not for use in interrupt handlers, which would disturb
+   the interrupted thread's generator. */
+static inline uint32_t
+random_u32 (void) 
+{
+  return prng_u32 (&thread_current ()->prng);
+}
+
+/* Returns a pseudo-random number in the range 0...N (exclusive),
+   with N nonzero, from the running thread's generator. */
+static inline uint32_t
+random_range (uint32_t n) 
+{
+  return prng_range (&thread_current ()->prng, n);
+}
+
 int thread_get_priority (void);
 void thread_set_priority (int);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
+bool thread_set_realtime (int64_t runtime, int64_t period);
+
+/* Process group weights. */
+#define SCHED_WEIGHT_DEFAULT 100        /* Weight of group 0. */
+#define SCHED_WEIGHT_MAX 10000          /* Highest weight. */
+int sched_group_create (int weight);
+bool sched_group_join (int group);
+bool sched_group_set_weight (int group, int weight);
+int sched_group_current (void);
+
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
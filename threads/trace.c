@@ -0,0 +1,234 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Number of events kept.  Must be a power of 2. */
+#define TRACE_SIZE 1024
+
+/* A trace event. */
+struct trace_event
+  {
+    uint32_t tick;              /* Low 32 bits of timer_ticks(). */
+    uint8_t type;               /* A trace_type. */
+    uint8_t priority;           /* Running thread's priority. */
+    int32_t tid;                /* Running thread's tid. */
+    int32_t a, b;               /* Event-specific arguments. */
+  };
+
+/* Ring of events.  trace_head counts every event ever recorded,
+   so the most recent one is at index (trace_head - 1) modulo
+   TRACE_SIZE.  Writers run with interrupts off, which is all the
+   synchronization a uniprocessor kernel needs.  The ring takes
+   about 20 kB, so it comes from the page allocator, the first
+   time an event type is turned on. */
+static struct trace_event *trace_ring;
+static unsigned trace_head;
+
+/* A TRACE() site, as laid down in .tracepoints. */
+struct trace_site
+  {
+    uint8_t *nop;               /* The 5-byte NOP. */
+    uint8_t *call;              /* Code that calls trace_record(). */
+    uint32_t type;              /* A trace_type. */
+  };
+
+/* Bounds of .tracepoints, from the linker script. */
+extern struct trace_site _start_tracepoints[], _end_tracepoints[];
+
+/* Names for trace_enable(), indexed by trace_type. */
+static const char *type_names[TRACE_TYPE_CNT] =
+  {"switch", "unblock", "sema", "lock", "block", "fault"};
+
+/* Types turned on, one bit per trace_type. */
+static unsigned enabled;
+
+/* Types named by trace_enable() before trace_init() ran, which
+   trace_init() turns on. */
+static unsigned pending;
+static bool initialized;
+
+/* CR0 write-protect bit, which makes the kernel's read-only text
+   read-only to the kernel itself. */
+#define CR0_WP 0x00010000
+
+static void patch (uint8_t *, const uint8_t[5]);
+
+/* Turns on the event types left pending by trace_enable().
+   Called once the page allocator is up. */
+void
+trace_init (void) 
+{
+  int type;
+
+  initialized = true;
+  for (type = 0; type < TRACE_TYPE_CNT; type++)
+    if ((pending >> type) & 1)
+      trace_set (type, true);
+}
+
+/* Turns on the event types named in TYPES, a comma-separated list
+   of names from type_names[] or "all".  Returns false if a name
+   is not recognized, after turning on the others.  Before
+   trace_init(), as for the "-trace" option, the types are only
+   noted, and turned on by trace_init(). */
+bool
+trace_enable (const char *types) 
+{
+  char copy[64];
+  char *name, *save_ptr;
+  bool ok = true;
+
+  strlcpy (copy, types, sizeof copy);
+  for (name = strtok_r (copy, ",", &save_ptr); name != NULL;
+       name = strtok_r (NULL, ",", &save_ptr))
+    {
+      int type;
+
+      for (type = 0; type < TRACE_TYPE_CNT; type++)
+        if (!strcmp (name, "all") || !strcmp (name, type_names[type]))
+          {
+            if (initialized)
+              trace_set (type, true);
+            else
+              pending |= 1u << type;
+          }
+      if (strcmp (name, "all"))
+        {
+          for (type = 0; type < TRACE_TYPE_CNT; type++)
+            if (!strcmp (name, type_names[type]))
+              break;
+          ok = ok && type < TRACE_TYPE_CNT;
+        }
+    }
+  return ok;
+}
+
+/* Turns TYPE's TRACE() sites on or off by patching each one into
+   a jump to its call or back into a NOP.  Turning on the first
+   type allocates the ring, so this must not be called before
+   trace_init() or from an interrupt handler. */
+void
+trace_set (enum trace_type type, bool on) 
+{
+  static const uint8_t nop[5] = {0x0f, 0x1f, 0x44, 0x00, 0x00};
+  struct trace_site *s;
+
+  ASSERT (type < TRACE_TYPE_CNT);
+  ASSERT (initialized);
+  if (((enabled >> type) & 1) == on)
+    return;
+  if (on && trace_ring == NULL)
+    trace_ring = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                                      DIV_ROUND_UP (TRACE_SIZE
+                                                    * sizeof *trace_ring,
+                                                    PGSIZE));
+  enabled ^= 1u << type;
+
+  for (s = _start_tracepoints; s < _end_tracepoints; s++)
+    if (s->type == type)
+      {
+        if (on)
+          {
+            /* JMP rel32, relative to the end of the instruction. */
+            uint32_t rel = s->call - (s->nop + 5);
+            uint8_t jmp[5] = {0xe9, rel, rel >> 8, rel >> 16, rel >> 24};
+            patch (s->nop, jmp);
+          }
+        else
+          patch (s->nop, nop);
+      }
+}
+
+/* Overwrites the 5-byte instruction at SITE with CODE.  The
+   kernel's text is mapped read-only, so this briefly lets the
+   kernel write read-only pages.  Interrupts are off meanwhile so
+   that nothing executes a half-written instruction; a single CPU
+   notices the change by the time it next reaches SITE. */
+static void
+patch (uint8_t *site, const uint8_t code[5]) 
+{
+  enum intr_level old_level = intr_disable ();
+  uint32_t cr0;
+
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0 & ~CR0_WP) : "memory");
+  memcpy (site, code, 5);
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0) : "memory");
+  intr_set_level (old_level);
+}
+
+/* Appends an event of the given TYPE, which happened while
+   thread T was running, with arguments A and B to the ring,
+   overwriting the oldest event.  May be called from any context,
+   including interrupt handlers and the scheduler. */
+void
+trace_record (enum trace_type type, const struct thread *t, int a, int b)
+{
+  enum intr_level old_level = intr_disable ();
+  struct trace_event *e = &trace_ring[trace_head++ & (TRACE_SIZE - 1)];
+
+  e->tick = timer_ticks ();
+  e->type = type;
+  e->priority = thread_effective_priority (t);
+  e->tid = t->tid;
+  e->a = a;
+  e->b = b;
+  intr_set_level (old_level);
+}
+
+/* Prints the contents of the ring, oldest event first. */
+void
+trace_dump (void)
+{
+  static const char *reasons[] = {"block", "yield", "exit", "preempt"};
+  unsigned i, start;
+
+  if (enabled == 0)
+    return;
+
+  start = trace_head > TRACE_SIZE ? trace_head - TRACE_SIZE : 0;
+  printf ("Event trace (%u events, showing last %u):\n",
+          trace_head, trace_head - start);
+  for (i = start; i != trace_head; i++)
+    {
+      const struct trace_event *e = &trace_ring[i & (TRACE_SIZE - 1)];
+
+      printf ("%10"PRIu32" tid %d pri %d: ", e->tick, e->tid, e->priority);
+      switch (e->type)
+        {
+        case TRACE_SWITCH:
+          printf ("switch to %d (%s)\n", e->a,
+                  e->b >= 0 && e->b <= TRACE_PREEMPT ? reasons[e->b] : "?");
+          break;
+        case TRACE_UNBLOCK:
+          printf ("unblock %d at pri %d\n", e->a, e->b);
+          break;
+        case TRACE_SEMA_SLEEP:
+          printf ("sleep on sema %#"PRIx32"\n", (uint32_t) e->a);
+          break;
+        case TRACE_LOCK_WAIT:
+          printf ("wait for lock held by %d, donating %d\n", e->a, e->b);
+          break;
+        case TRACE_BLOCK_IO:
+          printf ("%s %d sectors in %d us\n", e->a & 1 ? "write" : "read",
+                  e->a / 2, e->b);
+          break;
+        case TRACE_PAGE_FAULT:
+          printf ("page fault at %#"PRIx32", error %#x\n",
+                  (uint32_t) e->a, e->b);
+          break;
+        default:
+          printf ("event %d (%d, %d)\n", e->type, e->a, e->b);
+          break;
+        }
+    }
+}
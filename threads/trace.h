@@ -0,0 +1,71 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+
+/* Kernel event trace.
+
+   A fixed-size ring of the most recent scheduling decisions,
+   synchronization events, block requests, and page faults, for
+   reconstructing what led up to a priority inversion or latency
+   spike.  Each event is a small binary record; formatting it is
+   left to trace_dump(), which runs on kernel panic and for the
+   "trace" action.
+
+   Every TRACE() site is compiled in, but as a 5-byte NOP that
+   costs nothing until its event type is turned on, normally by
+   the "-trace=" option at boot.  Turning a type on patches each
+   of its sites into a jump to an out-of-line call to
+   trace_record(), so a disabled site evaluates none of its
+   arguments.  The sites are found through a table that TRACE()
+   builds in the .tracepoints section. */
+
+/* Kinds of trace events.  The meaning of the A and B arguments
+   to TRACE() is given for each.  T is always the thread that was
+   running when the event happened. */
+enum trace_type
+  {
+    TRACE_SWITCH,       /* A: next tid, B: trace_reason. */
+    TRACE_UNBLOCK,      /* A: woken tid, B: its priority. */
+    TRACE_SEMA_SLEEP,   /* A: low bits of semaphore address, B: 0. */
+    TRACE_LOCK_WAIT,    /* A: holder tid, B: donated priority. */
+    TRACE_BLOCK_IO,     /* A: sectors * 2 + write, B: microseconds. */
+    TRACE_PAGE_FAULT,   /* A: fault address, B: error code. */
+    TRACE_TYPE_CNT
+  };
+
+/* Why the running thread gave up the CPU, for TRACE_SWITCH. */
+enum trace_reason
+  {
+    TRACE_BLOCK,        /* Thread blocked. */
+    TRACE_YIELD,        /* Thread yielded voluntarily. */
+    TRACE_EXIT,         /* Thread exited. */
+    TRACE_PREEMPT       /* Thread was preempted. */
+  };
+
+struct thread;
+void trace_init (void);
+bool trace_enable (const char *types);
+void trace_set (enum trace_type, bool on);
+void trace_record (enum trace_type, const struct thread *t, int a, int b);
+void trace_dump (void);
+
+/* Records an event of the given TYPE if that type is on.  The
+   NOP is followed by an entry in .tracepoints holding its
+   address, the address of the call, and TYPE. */
+#define TRACE(TYPE, T, A, B)                                            \
+  do                                                                    \
+    {                                                                   \
+      __label__ trace_on;                                               \
+      asm goto ("1: .byte 0x0f, 0x1f, 0x44, 0x00, 0x00\n\t"             \
+                ".pushsection .tracepoints, \"aw\"\n\t"                 \
+                ".long 1b, %l[trace_on], %c0\n\t"                       \
+                ".popsection"                                           \
+                : : "i" (TYPE) : : trace_on);                           \
+      break;                                                            \
+    trace_on:                                                           \
+      trace_record (TYPE, T, A, B);                                     \
+    }                                                                   \
+  while (0)
+
+#endif /* threads/trace.h */
@@ -0,0 +1,229 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Number of worker threads per class. */
+#define WQ_WORKERS 2
+
+/* Number of preallocated jobs for workqueue_submit(). */
+#define WORK_POOL_SIZE 64
+
+/* A work queue: one per class. */
+struct workqueue
+  {
+    struct list pending;        /* Jobs not yet started. */
+    struct semaphore jobs;      /* Counts jobs in PENDING. */
+    int running;                /* Number of jobs being run. */
+    int drainers;               /* Threads waiting in drain. */
+    struct semaphore drained;   /* Ups once per drainer when idle. */
+  };
+
+/* The queues.  Their lists and counters are protected by
+   disabling interrupts, so that jobs can be queued from
+   interrupt handlers. */
+static struct workqueue queues[WQ_CLASS_CNT];
+
+/* Worker thread priority for each class. */
+static const int class_priority[WQ_CLASS_CNT] =
+  {
+    PRI_DEFAULT + 10,           /* WQ_HIGH. */
+    PRI_DEFAULT,                /* WQ_NORMAL. */
+    PRI_MIN + 1,                /* WQ_LOW. */
+  };
+
+/* Preallocated jobs, so that workqueue_submit() never has to
+   allocate memory.  Also protected by disabling interrupts. */
+static struct work work_pool[WORK_POOL_SIZE];
+static struct list free_work;
+
+static void worker (void *wq_);
+
+/* Initializes the work queues and starts their worker threads.
+   Must be called after thread_start(). */
+void
+workqueue_init (void) 
+{
+  int c, i;
+
+  list_init (&free_work);
+  for (i = 0; i < WORK_POOL_SIZE; i++)
+    {
+      work_pool[i].pooled = true;
+      list_push_back (&free_work, &work_pool[i].elem);
+    }
+
+  for (c = 0; c < WQ_CLASS_CNT; c++)
+    {
+      struct workqueue *wq = &queues[c];
+
+      list_init (&wq->pending);
+      sema_init (&wq->jobs, 0);
+      wq->running = 0;
+      wq->drainers = 0;
+      sema_init (&wq->drained, 0);
+      for (i = 0; i < WQ_WORKERS; i++)
+        {
+          char name[16];
+
+          snprintf (name, sizeof name, "worker%d.%d", c, i);
+          if (thread_create (name, class_priority[c], worker, wq)
+              == TID_ERROR)
+            PANIC ("could not start work queue threads");
+        }
+    }
+}
+
+/* Initializes W to run FUNC(AUX) when queued. */
+void
+work_init (struct work *w, work_func *func, void *aux) 
+{
+  ASSERT (w != NULL);
+  ASSERT (func != NULL);
+
+  w->func = func;
+  w->aux = aux;
+  w->pooled = false;
+}
+
+/* Queues W, which must have been initialized with work_init(),
+   to run on a worker of class CLASS.  W must not be modified or
+   queued again until its function has started running.  Never
+   sleeps or allocates, so it may be called from an interrupt
+   handler. */
+void
+workqueue_queue (enum wq_class class, struct work *w) 
+{
+  struct workqueue *wq;
+  enum intr_level old_level;
+
+  ASSERT (class < WQ_CLASS_CNT);
+  ASSERT (w != NULL && w->func != NULL);
+
+  wq = &queues[class];
+  old_level = intr_disable ();
+  list_push_back (&wq->pending, &w->elem);
+  intr_set_level (old_level);
+  sema_up (&wq->jobs);
+}
+
+/* Queues every struct work in list WORKS, in order, to run on
+   workers of class CLASS.  WORKS is left empty.  The jobs are
+   all queued before any worker is woken, so a high-priority
+   worker cannot preempt the caller in the middle of the
+   batch. */
+void
+workqueue_queue_batch (enum wq_class class, struct list *works) 
+{
+  struct workqueue *wq;
+  enum intr_level old_level;
+  int cnt = 0;
+
+  ASSERT (class < WQ_CLASS_CNT);
+  ASSERT (works != NULL);
+
+  wq = &queues[class];
+  old_level = intr_disable ();
+  while (!list_empty (works))
+    {
+      list_push_back (&wq->pending, list_pop_front (works));
+      cnt++;
+    }
+  intr_set_level (old_level);
+
+  while (cnt-- > 0)
+    sema_up (&wq->jobs);
+}
+
+/* Submits FUNC(AUX) to run on a worker of class WQ_NORMAL.
+   Returns true if successful, false if the pool of preallocated
+   jobs is exhausted.  Never sleeps or allocates, so it may be
+   called from an interrupt handler. */
+bool
+workqueue_submit (work_func *func, void *aux) 
+{
+  return workqueue_submit_class (WQ_NORMAL, func, aux);
+}
+
+/* Submits FUNC(AUX) to run on a worker of class CLASS.  Returns
+   true if successful, false if the pool of preallocated jobs is
+   exhausted.  Never sleeps or allocates, so it may be called
+   from an interrupt handler. */
+bool
+workqueue_submit_class (enum wq_class class, work_func *func, void *aux) 
+{
+  struct work *w = NULL;
+  enum intr_level old_level;
+
+  ASSERT (func != NULL);
+
+  old_level = intr_disable ();
+  if (!list_empty (&free_work))
+    w = list_entry (list_pop_front (&free_work), struct work, elem);
+  intr_set_level (old_level);
+  if (w == NULL)
+    return false;
+
+  w->func = func;
+  w->aux = aux;
+  workqueue_queue (class, w);
+  return true;
+}
+
+/* Waits until class CLASS has no pending or running jobs.  Jobs
+   queued while waiting are waited for as well. */
+void
+workqueue_drain (enum wq_class class) 
+{
+  struct workqueue *wq;
+  enum intr_level old_level;
+
+  ASSERT (class < WQ_CLASS_CNT);
+  ASSERT (!intr_context ());
+
+  wq = &queues[class];
+  old_level = intr_disable ();
+  while (!list_empty (&wq->pending) || wq->running > 0)
+    {
+      wq->drainers++;
+      sema_down (&wq->drained);
+    }
+  intr_set_level (old_level);
+}
+
+/* Worker thread: runs jobs from WQ_ forever. */
+static void
+worker (void *wq_) 
+{
+  struct workqueue *wq = wq_;
+
+  for (;;) 
+    {
+      enum intr_level old_level;
+      struct work *w;
+      work_func *func;
+      void *aux;
+
+      sema_down (&wq->jobs);
+
+      old_level = intr_disable ();
+      w = list_entry (list_pop_front (&wq->pending), struct work, elem);
+      wq->running++;
+      func = w->func;
+      aux = w->aux;
+      if (w->pooled)
+        list_push_back (&free_work, &w->elem);
+      intr_set_level (old_level);
+
+      func (aux);
+
+      old_level = intr_disable ();
+      wq->running--;
+      if (wq->running == 0 && list_empty (&wq->pending))
+        for (; wq->drainers > 0; wq->drainers--)
+          sema_up (&wq->drained);
+      intr_set_level (old_level);
+    }
+}
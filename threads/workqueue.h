@@ -0,0 +1,46 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+
+/* Kernel work queues.
+
+   A small, fixed set of worker threads per priority class runs
+   deferred jobs on behalf of the rest of the kernel, so that a
+   subsystem that needs something done asynchronously (write-
+   behind, read-ahead, page zeroing, ...) does not have to spawn
+   and tear down a thread of its own for each job. */
+
+/* Priority classes.  Each has its own queue and workers. */
+enum wq_class
+  {
+    WQ_HIGH,                    /* Latency-sensitive work. */
+    WQ_NORMAL,                  /* Ordinary work. */
+    WQ_LOW,                     /* Background work. */
+    WQ_CLASS_CNT
+  };
+
+/* A job to run.  AUX is passed to FUNC. */
+typedef void work_func (void *aux);
+
+/* A queued job.  Embed one in a longer-lived structure and pass
+   it to workqueue_queue() to submit without any allocation. */
+struct work
+  {
+    struct list_elem elem;      /* Queue element. */
+    work_func *func;            /* Function to run. */
+    void *aux;                  /* Argument to FUNC. */
+    bool pooled;                /* Owned by the work queue? */
+  };
+
+void workqueue_init (void);
+
+void work_init (struct work *, work_func *, void *aux);
+void workqueue_queue (enum wq_class, struct work *);
+void workqueue_queue_batch (enum wq_class, struct list *);
+bool workqueue_submit (work_func *, void *aux);
+bool workqueue_submit_class (enum wq_class, work_func *, void *aux);
+void workqueue_drain (enum wq_class);
+
+#endif /* threads/workqueue.h */
@@ -0,0 +1,243 @@
+#include "userprog/aio.h"
+#include <debug.h>
+#include <list.h>
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+#include "userprog/process.h"
+#include "userprog/uaccess.h"
+
+/* Asynchronous file I/O.
+
+   aio_submit() queues a read or write of part of a file and
+   returns at once, so that a process can have up to AIO_MAX of
+   them outstanding and keep the disk's request queue, and its
+   elevator, busy.  Each request runs as a job on the kernel work
+   queue, whose workers go through the buffer cache like any
+   other reader or writer.  aio_wait() reaps finished requests,
+   in the order they finished.
+
+   The workers never touch user memory: they have no page
+   directory of their own, and a process could otherwise pin any
+   amount of memory by never reaping.  Instead each request has a
+   kernel buffer.  aio_submit() copies a write's data into it,
+   and aio_wait() copies a read's data out of it, both in the
+   process's own context.
+
+   A process's requests hang off its leader's `aio' context,
+   created by its first aio_submit().  aio_exit() waits for those
+   still running before it frees them.  aio_lock protects every
+   context. */
+
+/* A request. */
+struct aio_req
+  {
+    struct list_elem elem;      /* Element in the context's `done'. */
+    struct work work;           /* Job that runs the request. */
+    struct aio_ctx *ctx;        /* Context it belongs to. */
+    struct file *file;          /* Own handle on the file. */
+    off_t ofs;                  /* Offset in the file. */
+    unsigned size;              /* Bytes to transfer. */
+    bool write;                 /* Write rather than read? */
+    void *ubuf;                 /* User buffer. */
+    uint8_t *kbuf;              /* Kernel buffer, SIZE bytes. */
+    uint32_t tag;               /* For the process's use. */
+    int result;                 /* Bytes transferred, or -1. */
+  };
+
+/* A process's requests. */
+struct aio_ctx
+  {
+    struct list done;           /* Finished, not yet reaped. */
+    int running;                /* Queued or running. */
+    struct condition finished;  /* Signaled when one finishes. */
+  };
+
+static struct lock aio_lock;
+
+static work_func run_request;
+
+/* Initializes asynchronous I/O. */
+void
+aio_init (void) 
+{
+  lock_init (&aio_lock);
+}
+
+/* Returns the running process's context, creating it if
+   necessary, or a null pointer if memory is short.  The caller
+   must hold aio_lock. */
+static struct aio_ctx *
+get_ctx (void) 
+{
+  struct thread *leader = thread_current ()->leader;
+
+  if (leader->aio == NULL)
+    {
+      struct aio_ctx *ctx = malloc (sizeof *ctx);
+      if (ctx == NULL)
+        return NULL;
+      list_init (&ctx->done);
+      ctx->running = 0;
+      cond_init (&ctx->finished);
+      leader->aio = ctx;
+    }
+  return leader->aio;
+}
+
+/* Frees R, which has finished. */
+static void
+free_request (struct aio_req *r) 
+{
+  file_close (r->file);
+  free (r->kbuf);
+  free (r);
+}
+
+/* Queues a read of SIZE bytes from FILE at offset OFS into user
+   buffer BUFFER, or a write of them from BUFFER if WRITE is
+   true, to be reaped by aio_wait() along with TAG.  SIZE must be
+   between 1 and AIO_SIZE_MAX, and BUFFER must have passed
+   user_range_ok().  Returns 1 if the request was queued, 0 if
+   the running process already has AIO_MAX requests or memory is
+   short, or -1 if BUFFER is not mapped. */
+int
+aio_submit (struct file *file, void *buffer, unsigned size, off_t ofs,
+            bool write, uint32_t tag) 
+{
+  struct aio_ctx *ctx;
+  struct aio_req *r;
+
+  ASSERT (size > 0 && size <= AIO_SIZE_MAX);
+
+  r = malloc (sizeof *r);
+  if (r == NULL)
+    return 0;
+  r->kbuf = malloc (size);
+  r->file = file_reopen (file);
+  if (r->kbuf == NULL || r->file == NULL)
+    {
+      free_request (r);
+      return 0;
+    }
+  if (write && !copy_from_user (r->kbuf, buffer, size))
+    {
+      free_request (r);
+      return -1;
+    }
+  r->ofs = ofs;
+  r->size = size;
+  r->write = write;
+  r->ubuf = buffer;
+  r->tag = tag;
+  r->result = -1;
+  work_init (&r->work, run_request, r);
+
+  lock_acquire (&aio_lock);
+  ctx = get_ctx ();
+  if (ctx == NULL
+      || ctx->running + (int) list_size (&ctx->done) >= AIO_MAX)
+    {
+      lock_release (&aio_lock);
+      free_request (r);
+      return 0;
+    }
+  r->ctx = ctx;
+  ctx->running++;
+  lock_release (&aio_lock);
+
+  workqueue_queue (WQ_NORMAL, &r->work);
+  return 1;
+}
+
+/* Runs request R_, on a work queue thread. */
+static void
+run_request (void *r_) 
+{
+  struct aio_req *r = r_;
+  struct aio_ctx *ctx = r->ctx;
+
+  r->result = (r->write
+               ? file_write_at (r->file, r->kbuf, r->size, r->ofs)
+               : file_read_at (r->file, r->kbuf, r->size, r->ofs));
+
+  lock_acquire (&aio_lock);
+  list_push_back (&ctx->done, &r->elem);
+  ctx->running--;
+  cond_broadcast (&ctx->finished, &aio_lock);
+  lock_release (&aio_lock);
+}
+
+/* Waits until one of the running process's requests has
+   finished, or until timer_ticks() reaches DEADLINE if DEADLINE
+   is nonnegative, then reaps up to MAX finished requests into
+   RESULTS, copying the data that reads read into their user
+   buffers.  A read whose buffer is no longer mapped has -1 as
+   its result.  Returns the number reaped, or -1 at once if the
+   process has no requests at all.  The caller must not hold
+   aio_lock. */
+int
+aio_wait (struct aio_result results[], int max, int64_t deadline) 
+{
+  struct aio_ctx *ctx;
+  int cnt = 0;
+
+  lock_acquire (&aio_lock);
+  ctx = thread_current ()->leader->aio;
+  if (ctx == NULL || (ctx->running == 0 && list_empty (&ctx->done)))
+    {
+      lock_release (&aio_lock);
+      return -1;
+    }
+  while (list_empty (&ctx->done) && !process_dying ())
+    if (deadline < 0)
+      cond_wait (&ctx->finished, &aio_lock);
+    else if (timer_ticks () >= deadline
+             || !cond_wait_timeout (&ctx->finished, &aio_lock,
+                                    deadline - timer_ticks ()))
+      break;
+
+  while (cnt < max && !list_empty (&ctx->done))
+    {
+      struct aio_req *r = list_entry (list_pop_front (&ctx->done),
+                                      struct aio_req, elem);
+
+      /* Copying out may fault, so do it without the lock. */
+      lock_release (&aio_lock);
+      if (!r->write && r->result > 0
+          && !copy_to_user (r->ubuf, r->kbuf, r->result))
+        r->result = -1;
+      results[cnt].tag = r->tag;
+      results[cnt].result = r->result;
+      cnt++;
+      free_request (r);
+      lock_acquire (&aio_lock);
+    }
+  lock_release (&aio_lock);
+  return cnt;
+}
+
+/* Waits for the running process's requests to finish and frees
+   them, reaped or not.  Called by its leader as it exits. */
+void
+aio_exit (void) 
+{
+  struct thread *t = thread_current ();
+  struct aio_ctx *ctx = t->aio;
+
+  if (ctx == NULL)
+    return;
+  lock_acquire (&aio_lock);
+  while (ctx->running > 0)
+    cond_wait (&ctx->finished, &aio_lock);
+  lock_release (&aio_lock);
+
+  while (!list_empty (&ctx->done))
+    free_request (list_entry (list_pop_front (&ctx->done),
+                              struct aio_req, elem));
+  t->aio = NULL;
+  free (ctx);
+}
@@ -0,0 +1,30 @@
+#ifndef USERPROG_AIO_H
+#define USERPROG_AIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+struct file;
+
+/* Largest single request, in bytes. */
+#define AIO_SIZE_MAX (32 * 1024)
+
+/* Most requests a process may have outstanding, counting those
+   that are done but not yet reaped. */
+#define AIO_MAX 32
+
+/* A finished request, as reaped by aio_wait(). */
+struct aio_result
+  {
+    uint32_t tag;               /* As passed to aio_submit(). */
+    int result;                 /* Bytes transferred, or -1. */
+  };
+
+void aio_init (void);
+int aio_submit (struct file *, void *buffer, unsigned size, off_t ofs,
+                bool write, uint32_t tag);
+int aio_wait (struct aio_result[], int max, int64_t deadline);
+void aio_exit (void);
+
+#endif /* userprog/aio.h */
@@ -2,14 +2,38 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "userprog/uaccess.h"
+#include "devices/timer.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
+#include "threads/stats.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
+/* Faults the kernel handled, rather than killing the process or
+   failing a user memory accessor, are also timed.  Bucket 0
+   counts those that took under 1 us, and bucket N those that
+   took under 2**N us; the last takes all the rest.  Updated with
+   interrupts off, along with cow_fault_cnt. */
+#define LATENCY_BUCKETS 16
+static unsigned long long fault_latency[LATENCY_BUCKETS];
+static unsigned long long cow_fault_cnt;  /* Copy-on-write faults. */
+
+static void record_latency (uint64_t start, bool cow);
+
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
+static void device_not_available (struct intr_frame *);
+static bool uaccess_fixup (struct intr_frame *);
 
 /* Registers handlers for interrupts that can be caused by user
    programs.
@@ -29,6 +53,11 @@ static void page_fault (struct intr_frame *);
 void
 exception_init (void) 
 {
+  stats_counter ("exception", NULL, "page_faults", &page_fault_cnt);
+  stats_counter ("exception", NULL, "cow_faults", &cow_fault_cnt);
+  stats_histogram ("exception", NULL, "fault_latency_log2_us",
+                   fault_latency, LATENCY_BUCKETS);
+
   /* These exceptions can be raised explicitly by a user program,
      e.g. via the INT, INT3, INTO, and BOUND instructions.  Thus,
      we set DPL==3, meaning that user programs are allowed to
@@ -45,7 +74,7 @@ exception_init (void)
   intr_register_int (0, 0, INTR_ON, kill, "#DE Divide Error");
   intr_register_int (1, 0, INTR_ON, kill, "#DB Debug Exception");
   intr_register_int (6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
-  intr_register_int (7, 0, INTR_ON, kill,
+  intr_register_int (7, 0, INTR_ON, device_not_available,
                      "#NM Device Not Available Exception");
   intr_register_int (11, 0, INTR_ON, kill, "#NP Segment Not Present");
   intr_register_int (12, 0, INTR_ON, kill, "#SS Stack Fault Exception");
@@ -64,7 +93,42 @@ exception_init (void)
 void
 exception_print_stats (void) 
 {
+  unsigned long long handled = 0;
+  int i;
+
   printf ("Exception: %lld page faults\n", page_fault_cnt);
+  for (i = 0; i < LATENCY_BUCKETS; i++)
+    handled += fault_latency[i];
+  if (handled == 0)
+    return;
+  printf ("Exception: %llu faults handled, %llu copy-on-write\n",
+          handled, cow_fault_cnt);
+  printf ("Exception: fault latency:");
+  for (i = 0; i < LATENCY_BUCKETS; i++)
+    if (fault_latency[i] != 0)
+      printf (" %s%d us %llu", i < LATENCY_BUCKETS - 1 ? "<" : ">=",
+              i < LATENCY_BUCKETS - 1 ? 1 << i : 1 << (i - 1),
+              fault_latency[i]);
+  printf ("\n");
+}
+
+/* Records that a page fault that began at timer_cycles() START
+   has been handled, by a copy-on-write copy if COW is true. */
+static void
+record_latency (uint64_t start, bool cow) 
+{
+  uint64_t us = timer_cycles_to_ns (timer_cycles () - start) / 1000;
+  enum intr_level old_level;
+  int bucket = 0;
+
+  while (bucket < LATENCY_BUCKETS - 1 && us >= (1u << bucket))
+    bucket++;
+
+  old_level = intr_disable ();
+  fault_latency[bucket]++;
+  if (cow)
+    cow_fault_cnt++;
+  intr_set_level (old_level);
 }
 
 /* Handler for an exception (probably) caused by a user process. */
@@ -89,6 +153,7 @@ kill (struct intr_frame *f)
       printf ("%s: dying due to interrupt %#04x (%s).\n",
               thread_name (), f->vec_no, intr_name (f->vec_no));
       intr_dump_frame (f);
+      process_abort ();
       thread_exit (); 
 
     case SEL_KCSEG:
@@ -108,6 +173,35 @@ kill (struct intr_frame *f)
     }
 }
 
+/* #NM handler.  A user process executed its first FPU or SSE
+   instruction since it was last switched in; give it its FPU
+   state.  Any other #NM kills the process, or panics for the
+   kernel, which does not use the FPU. */
+static void
+device_not_available (struct intr_frame *f) 
+{
+  if (f->cs != SEL_UCSEG || !fpu_trap ())
+    kill (f);
+}
+
+/* If F's faulting instruction is one that userprog/uaccess.S
+   expects may fault, arranges for F to resume at its fixup
+   address and returns true.  Otherwise returns false. */
+static bool
+uaccess_fixup (struct intr_frame *f) 
+{
+  const struct uaccess_fixup *u;
+  uintptr_t eip = (uintptr_t) f->eip;
+
+  for (u = uaccess_fixups; u->fixup != 0; u++)
+    if (eip >= u->start && eip < u->end)
+      {
+        f->eip = (void (*) (void)) u->fixup;
+        return true;
+      }
+  return false;
+}
+
 /* Page fault handler.  This is a skeleton that must be filled in
    to implement virtual memory.  Some solutions to project 2 may
    also require modifying this code.
@@ -126,6 +220,7 @@ page_fault (struct intr_frame *f)
   bool write;        /* True: access was write, false: access was read. */
   bool user;         /* True: access by user, false: access by kernel. */
   void *fault_addr;  /* Fault address. */
+  uint64_t start;    /* timer_cycles() on entry. */
 
   /* Obtain faulting address, the virtual address that was
      accessed to cause the fault.  It may point to code or to
@@ -142,12 +237,65 @@ page_fault (struct intr_frame *f)
 
   /* Count page faults. */
   page_fault_cnt++;
+  TRACE (TRACE_PAGE_FAULT, thread_current (), (uintptr_t) fault_addr,
+         f->error_code);
+  start = timer_cycles ();
 
   /* Determine cause. */
   not_present = (f->error_code & PF_P) == 0;
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+  /* A write to a page shared copy-on-write with another process
+     gets a copy of its own.  A system call writing into a user
+     buffer counts, too. */
+  if (!not_present && write && is_user_vaddr (fault_addr)
+      && thread_current ()->pagedir != NULL
+      && pagedir_cow_fault (thread_current ()->pagedir, fault_addr))
+    {
+      process_count_fault (false);
+      record_latency (start, true);
+      return;
+    }
+
+#ifdef VM
+  /* So does a write to a page of a mapped file that was read into
+     a frame shared with other processes. */
+  if (!not_present && write && page_unshare (fault_addr))
+    {
+      process_count_fault (false);
+      record_latency (start, true);
+      return;
+    }
+
+  /* Bring in a page of a program that has not been touched yet.
+     This applies to kernel accesses too, such as a system call
+     copying into a user buffer in BSS. */
+  if (not_present && page_in (fault_addr, write))
+    {
+      record_latency (start, false);
+      return;
+    }
+
+  /* Grow the stack down to a fault just below the user stack
+     pointer.  A fault in the kernel must use the one saved on
+     entry to the system call, since F's is the kernel's. */
+  if (not_present
+      && page_grow_stack (fault_addr,
+                          user ? f->esp : thread_current ()->user_esp,
+                          write))
+    {
+      record_latency (start, false);
+      return;
+    }
+#endif
+
+  /* A kernel fault on a user address inside one of the user
+     memory accessors means that a system call was passed a bad
+     pointer.  Make the accessor return failure. */
+  if (!user && is_user_vaddr (fault_addr) && uaccess_fixup (f))
+    return;
+
   /* To implement virtual memory, delete the rest of the function
      body, and replace it with code that brings in the page to
      which fault_addr refers. */
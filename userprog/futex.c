@@ -0,0 +1,170 @@
+#include "userprog/futex.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include "threads/synch.h"
+#include "userprog/pagedir.h"
+#include "userprog/uaccess.h"
+
+/* Futexes: waiting on a word of user memory.
+
+   A user-space lock takes and releases itself with atomic
+   instructions on a word of its own, and enters the kernel only
+   when it must sleep (futex_wait) or wake a sleeper
+   (futex_wake).  A futex is named by the address of its word in
+   a given page directory, so the threads of one process, which
+   share a page directory, share its futexes.  A word in a shared
+   memory segment is named instead by its kernel address, with a
+   null page directory, so that every process mapping the
+   segment shares it.  Nothing is allocated for a futex with no
+   waiters.
+
+   Waiters queue in buckets hashed on the address.  A single lock
+   covers all of them: it is held only to queue or dequeue, plus
+   the read of the word by futex_wait(), which is what makes
+   checking the word and going to sleep atomic with respect to a
+   futex_wake() on it. */
+
+/* A futex's name. */
+struct futex_key
+  {
+    uint32_t *pd;               /* Page directory, or null if shared. */
+    const void *addr;           /* User address, or kernel if shared. */
+  };
+
+/* A thread sleeping in futex_wait(). */
+struct futex_waiter
+  {
+    struct list_elem elem;      /* Element in a bucket. */
+    uint32_t *pd;               /* Waiter's page directory. */
+    struct futex_key key;       /* Futex waited on. */
+    struct semaphore sema;      /* Upped to wake the waiter. */
+  };
+
+/* Number of buckets, a power of 2. */
+#define FUTEX_BUCKET_CNT 64
+
+static struct list buckets[FUTEX_BUCKET_CNT];
+static struct lock futex_lock;
+
+/* Initializes the futex buckets. */
+void
+futex_init (void) 
+{
+  size_t i;
+
+  for (i = 0; i < FUTEX_BUCKET_CNT; i++)
+    list_init (&buckets[i]);
+  lock_init (&futex_lock);
+}
+
+/* Returns the name of the futex at UADDR in PD. */
+static struct futex_key
+make_key (uint32_t *pd, int *uaddr) 
+{
+  struct futex_key key;
+  void *kaddr = pagedir_get_shared (pd, uaddr);
+
+  key.pd = kaddr != NULL ? NULL : pd;
+  key.addr = kaddr != NULL ? kaddr : (void *) uaddr;
+  return key;
+}
+
+/* Returns the bucket for KEY. */
+static struct list *
+bucket (struct futex_key key) 
+{
+  unsigned h = (uintptr_t) key.addr ^ ((uintptr_t) key.pd >> 12);
+
+  return &buckets[hash_u32 (h) & (FUTEX_BUCKET_CNT - 1)];
+}
+
+/* If the user word at UADDR in PD, the running thread's page
+   directory, still holds VAL, sleeps until futex_wake() is
+   called on it and returns 0.  Returns 1 at once if it holds
+   another value, so that the caller retries, or -1 if UADDR
+   cannot be read. */
+int
+futex_wait (uint32_t *pd, int *uaddr, int val) 
+{
+  struct futex_waiter w;
+  int cur;
+
+  lock_acquire (&futex_lock);
+  if (!copy_from_user (&cur, uaddr, sizeof cur))
+    {
+      lock_release (&futex_lock);
+      return -1;
+    }
+  if (cur != val)
+    {
+      lock_release (&futex_lock);
+      return 1;
+    }
+  w.pd = pd;
+  w.key = make_key (pd, uaddr);
+  sema_init (&w.sema, 0);
+  list_push_back (bucket (w.key), &w.elem);
+  lock_release (&futex_lock);
+
+  sema_down (&w.sema);
+  return 0;
+}
+
+/* Wakes up to CNT threads waiting on UADDR in PD, oldest first,
+   and returns the number woken. */
+int
+futex_wake (uint32_t *pd, int *uaddr, int cnt) 
+{
+  struct futex_key key;
+  struct list *b;
+  struct list_elem *e;
+  int woken = 0;
+
+  lock_acquire (&futex_lock);
+  key = make_key (pd, uaddr);
+  b = bucket (key);
+  for (e = list_begin (b); e != list_end (b) && woken < cnt; )
+    {
+      struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+
+      if (w->key.pd == key.pd && w->key.addr == key.addr) 
+        {
+          e = list_remove (e);
+          sema_up (&w->sema);
+          woken++;
+        }
+      else
+        e = list_next (e);
+    }
+  lock_release (&futex_lock);
+  return woken;
+}
+
+/* Wakes every thread waiting on any futex in PD, so that a
+   process being torn down is not kept waiting for them. */
+void
+futex_wake_all (uint32_t *pd) 
+{
+  size_t i;
+
+  lock_acquire (&futex_lock);
+  for (i = 0; i < FUTEX_BUCKET_CNT; i++)
+    {
+      struct list_elem *e;
+
+      for (e = list_begin (&buckets[i]); e != list_end (&buckets[i]); )
+        {
+          struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+
+          if (w->pd == pd) 
+            {
+              e = list_remove (e);
+              sema_up (&w->sema);
+            }
+          else
+            e = list_next (e);
+        }
+    }
+  lock_release (&futex_lock);
+}
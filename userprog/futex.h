@@ -0,0 +1,11 @@
+#ifndef USERPROG_FUTEX_H
+#define USERPROG_FUTEX_H
+
+#include <stdint.h>
+
+void futex_init (void);
+int futex_wait (uint32_t *pd, int *uaddr, int val);
+int futex_wake (uint32_t *pd, int *uaddr, int cnt);
+void futex_wake_all (uint32_t *pd);
+
+#endif /* userprog/futex.h */
@@ -1,13 +1,183 @@
 #include "userprog/pagedir.h"
+#include <debug.h>
+#include <flatmap.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include "threads/copy.h"
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/swap.h"
+#endif
 
-static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
+static inline void invlpg (const void *);
+static bool frame_unref (void *kpage);
+static void batch_add (struct pagedir_batch *, const void *vpage);
+static void split_huge (uint32_t *pd, size_t pde_idx);
+static uint32_t get_pte (uint32_t *pd, const void *vaddr);
+
+/* Frames shared between page directories.
+
+   pagedir_fork() gives a child process its parent's frames
+   instead of copies.  Both page directories map each frame, with
+   PTE_SHARED set, and a frame that either could write is made
+   read-only in both and marked PTE_COW.  A write to it faults,
+   and pagedir_cow_fault() then gives the writer a copy of its
+   own, or, if it turns out to be the frame's only user, just
+   makes the frame writable again.
+
+   Shared memory segments (userprog/shm.c) share frames through
+   the same counts, but every process may write them.  Their
+   PTEs are the only ones with both PTE_SHARED and PTE_W set, and
+   pagedir_fork() leaves them so.
+
+   frame_refs counts, for each shared frame, the references
+   beyond the first; a frame with no entry has just one.  Only
+   PTEs with PTE_SHARED need to be looked up there.
+
+   The threads of a process share its page directory, so two of
+   them can take the same copy-on-write fault, or one can fault
+   while another forks.  cow_lock makes each of these happen as
+   a whole. */
+#define PTE_COW    0x200        /* Copy on write. */
+#define PTE_SHARED 0x400        /* Frame may be in frame_refs. */
+#define PTE_SHM (PTE_SHARED | PTE_W)  /* Both, for a shared segment. */
+
+/* A page that has been swapped out keeps a PTE that is not
+   present, has PTE_SWAP set, and holds the swap slot number where
+   a present PTE holds the frame address.  PTE_W is kept too.
+   pd_info counts such PTEs along with the present ones, so that
+   pagedir_destroy() and pagedir_fork() see them. */
+#define PTE_SWAP   0x800        /* Swapped out. */
+
+/* 4 MB pages.
+
+   With -hugepages, a 4 MB-aligned region of user memory whose
+   1,024 pages are all resident, each in a private writable frame,
+   is moved by frame_promote() into 1,024 physically contiguous
+   frames and mapped by a single PDE with PTE_PS set, which takes
+   one TLB entry instead of 1,024.
+
+   The region's page table is kept, rewritten to point at the new
+   frames, and the PDE's accessed and dirty bits stand in for the
+   PTEs' while the 4 MB page lasts.  Anything that needs a single
+   page's PTE, through lookup_page(), first splits the 4 MB page
+   back into 4 kB pages: that is, copy-on-write through fork,
+   unmapping part of the region, and eviction, which the clock
+   does only once the whole region is old.  Splitting only puts
+   the page table back in the PDE, with the 4 MB page's accessed
+   and dirty bits copied into every PTE, so it takes no memory and
+   cannot fail.  Lookups that only read a page's mapping use
+   get_pte() and leave the 4 MB page whole. */
+
+/* Most pages redirtied during promotion's copy that are copied
+   again at the switch, with interrupts off; any more, and the
+   promotion is given up. */
+#define HUGE_RECOPY_MAX 32
+
+static struct flatmap frame_refs;
+static struct lock frame_refs_lock;
+static struct lock cow_lock;
+
+#ifdef VM
+/* A frame of zeros, shared by every page that would be all zeros
+   and has only been read so far.  It is mapped like any other
+   frame shared copy-on-write, and has an entry in frame_refs for
+   as long as anything maps it, so it is never freed. */
+static void *zero_page;
+#endif
+
+/* Initializes frame sharing. */
+void
+pagedir_init (void) 
+{
+  if (!flatmap_init (&frame_refs, 64))
+    PANIC ("pagedir_init: out of memory");
+  lock_init (&frame_refs_lock);
+  lock_init (&cow_lock);
+#ifdef VM
+  zero_page = palloc_get_page (PAL_ASSERT | PAL_USER | PAL_ZERO);
+#endif
+}
+
+/* Number of page directory entries for user addresses. */
+#define USER_PDE_CNT (LOADER_PHYS_BASE >> PDSHIFT)
+
+/* Bookkeeping for a user page directory, kept in the page that
+   follows it, so that pagedir_destroy() need not scan for what
+   is mapped. */
+struct pd_info
+  {
+    uint32_t pt_map[USER_PDE_CNT / 32]; /* Bit set per page table. */
+    uint16_t pte_cnt[USER_PDE_CNT];     /* Present or swapped-out PTEs
+                                           per table. */
+    uint16_t huge_pde[PAGEDIR_HUGE_MAX];  /* PDE index of a 4 MB page. */
+    uint32_t *huge_pt[PAGEDIR_HUGE_MAX];  /* Its kept page table, or null
+                                             if the slot is free. */
+    size_t resident;                    /* Present user pages. */
+    size_t resident_max;                /* Most ever present at once. */
+  };
+
+/* Pages freed together by pagedir_destroy(). */
+#define FREE_BATCH 64
+
+/* Returns PD's bookkeeping. */
+static inline struct pd_info *
+pd_info (uint32_t *pd) 
+{
+  return (struct pd_info *) ((uint8_t *) pd + PGSIZE);
+}
+
+/* Returns the slot in INFO that holds the page table kept for the
+   4 MB page at PDE_IDX, or PAGEDIR_HUGE_MAX if there is none. */
+static size_t
+huge_slot (struct pd_info *info, size_t pde_idx) 
+{
+  size_t i;
+
+  for (i = 0; i < PAGEDIR_HUGE_MAX; i++)
+    if (info->huge_pt[i] != NULL && info->huge_pde[i] == pde_idx)
+      break;
+  return i;
+}
+
+/* Adds DELTA to the count of PD's present user pages.  Pages
+   come and go from the owner's faults and from the clock, which
+   may run in another process, so the count is updated with
+   interrupts off. */
+static void
+count_resident (uint32_t *pd, int delta) 
+{
+  struct pd_info *info = pd_info (pd);
+  enum intr_level old_level = intr_disable ();
+
+  info->resident += delta;
+  if (info->resident > info->resident_max)
+    info->resident_max = info->resident;
+  intr_set_level (old_level);
+}
+
+/* Returns the number of user pages present in PD, and stores the
+   most there have ever been at once in *MAX.  A 4 MB page counts
+   as the 1,024 pages it maps, and a frame shared with other page
+   directories counts in each of them. */
+size_t
+pagedir_resident (uint32_t *pd, size_t *max) 
+{
+  struct pd_info *info = pd_info (pd);
+  enum intr_level old_level = intr_disable ();
+  size_t resident = info->resident;
+
+  *max = info->resident_max;
+  intr_set_level (old_level);
+  return resident;
+}
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -16,35 +186,86 @@ static void invalidate_pagedir (uint32_t *);
 uint32_t *
 pagedir_create (void) 
 {
-  uint32_t *pd = palloc_get_page (0);
+  uint32_t *pd = palloc_get_multiple (0, 2);
   if (pd != NULL)
-    memcpy (pd, init_page_dir, PGSIZE);
+    {
+      block_copy (pd, init_page_dir, PGSIZE);
+      memset (pd_info (pd), 0, sizeof (struct pd_info));
+    }
   return pd;
 }
 
 /* Destroys page directory PD, freeing all the pages it
-   references. */
+   references.
+
+   Only the page tables PD actually has are visited, and each is
+   scanned only until all of its present entries have been seen.
+   The pages are freed FREE_BATCH at a time through
+   palloc_free_pages(). */
 void
 pagedir_destroy (uint32_t *pd) 
 {
-  uint32_t *pde;
+  struct pd_info *info;
+  void *pages[FREE_BATCH];
+  size_t page_cnt = 0;
+  size_t word;
 
   if (pd == NULL)
     return;
 
   ASSERT (pd != init_page_dir);
-  for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P) 
-      {
-        uint32_t *pt = pde_get_pt (*pde);
-        uint32_t *pte;
-        
-        for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
-          if (*pte & PTE_P) 
-            palloc_free_page (pte_get_page (*pte));
-        palloc_free_page (pt);
-      }
-  palloc_free_page (pd);
+  info = pd_info (pd);
+  for (word = 0; word < USER_PDE_CNT / 32; word++) 
+    {
+      uint32_t bits = info->pt_map[word];
+
+      while (bits != 0) 
+        {
+          size_t pde_idx = word * 32 + __builtin_ctz (bits);
+          size_t left = info->pte_cnt[pde_idx];
+          uint32_t *pt, *pte;
+
+          bits &= bits - 1;
+          pagedir_split (pd, (void *) (pde_idx << PDSHIFT));
+          pt = pde_get_pt (pd[pde_idx]);
+          for (pte = pt; left > 0 && pte < pt + PGSIZE / sizeof *pt; pte++)
+            if (*pte & (PTE_P | PTE_SWAP)) 
+              {
+                void *kpage;
+
+                left--;
+#ifdef VM
+                /* Once the frame table forgets the frame, the
+                   clock cannot evict it, but it may have just
+                   done so. */
+                if (*pte & PTE_P)
+                  frame_forget (pd, pte_get_page (*pte));
+                if (*pte & PTE_SWAP)
+                  swap_unref (*pte >> PTSHIFT, pd);
+                if (!(*pte & PTE_P))
+                  continue;
+#endif
+                kpage = pte_get_page (*pte);
+                if ((*pte & PTE_SHARED) && !frame_unref (kpage))
+                  continue;
+                pages[page_cnt++] = kpage;
+                if (page_cnt == FREE_BATCH)
+                  {
+                    palloc_free_pages (pages, page_cnt);
+                    page_cnt = 0;
+                  }
+              }
+
+          pages[page_cnt++] = pt;
+          if (page_cnt == FREE_BATCH)
+            {
+              palloc_free_pages (pages, page_cnt);
+              page_cnt = 0;
+            }
+        }
+    }
+  palloc_free_pages (pages, page_cnt);
+  palloc_free_multiple (pd, 2);
 }
 
 /* Returns the address of the page table entry for virtual
@@ -75,16 +296,54 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
             return NULL; 
       
           *pde = pde_create (pt);
+          pd_info (pd)->pt_map[pd_no (vaddr) / 32]
+            |= 1u << pd_no (vaddr) % 32;
         }
       else
         return NULL;
     }
+  else if (*pde & PTE_PS)
+    pagedir_split (pd, vaddr);
 
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
   return &pt[pt_no (vaddr)];
 }
 
+/* Returns the page table entry for virtual address VADDR in PD,
+   or 0 if PD has no page table for it.  A 4 MB page is left
+   whole: the entry comes from the page table kept for it, with
+   the 4 MB page's accessed and dirty bits added in. */
+static uint32_t
+get_pte (uint32_t *pd, const void *vaddr) 
+{
+  size_t pde_idx = pd_no (vaddr);
+  enum intr_level old_level;
+  uint32_t pde, pte;
+
+  ASSERT (pd != NULL);
+
+  /* Interrupts off, so that the page is not split midway. */
+  old_level = intr_disable ();
+  pde = pd[pde_idx];
+  if (pde == 0)
+    pte = 0;
+  else if (!(pde & PTE_PS))
+    pte = pde_get_pt (pde)[pt_no (vaddr)];
+  else if (pde_idx < USER_PDE_CNT)
+    {
+      struct pd_info *info = pd_info (pd);
+      size_t slot = huge_slot (info, pde_idx);
+
+      ASSERT (slot < PAGEDIR_HUGE_MAX);
+      pte = info->huge_pt[slot][pt_no (vaddr)] | (pde & (PTE_A | PTE_D));
+    }
+  else
+    pte = 0;
+  intr_set_level (old_level);
+  return pte;
+}
+
 /* Adds a mapping in page directory PD from user virtual page
    UPAGE to the physical frame identified by kernel virtual
    address KPAGE.
@@ -112,6 +371,8 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
     {
       ASSERT ((*pte & PTE_P) == 0);
       *pte = pte_create_user (kpage, writable);
+      pd_info (pd)->pte_cnt[pd_no (upage)]++;
+      count_resident (pd, 1);
       return true;
     }
   else
@@ -125,17 +386,589 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
 void *
 pagedir_get_page (uint32_t *pd, const void *uaddr) 
 {
-  uint32_t *pte;
+  uint32_t pte;
 
   ASSERT (is_user_vaddr (uaddr));
   
-  pte = lookup_page (pd, uaddr, false);
-  if (pte != NULL && (*pte & PTE_P) != 0)
-    return pte_get_page (*pte) + pg_ofs (uaddr);
+  pte = get_pte (pd, uaddr);
+  if ((pte & PTE_P) != 0)
+    return pte_get_page (pte) + pg_ofs (uaddr);
   else
     return NULL;
 }
 
+/* Returns true if user virtual address UADDR is mapped in PD
+   and writable there without a fault. */
+bool
+pagedir_is_writable (uint32_t *pd, const void *uaddr) 
+{
+  ASSERT (is_user_vaddr (uaddr));
+
+  return (get_pte (pd, uaddr) & (PTE_P | PTE_W)) == (PTE_P | PTE_W);
+}
+
+/* Makes CHILD, a new page directory, map every user page that
+   PARENT maps, except for pages CHILD already maps, sharing
+   PARENT's frames as described at the top of this file.  Frames
+   PARENT may write become copy-on-write in both.  Returns false
+   if memory is short, in which case CHILD may map some of the
+   pages and should be destroyed. */
+bool
+pagedir_fork (uint32_t *child, uint32_t *parent) 
+{
+  struct pd_info *info = pd_info (parent);
+  struct pagedir_batch batch;
+  bool success = true;
+  size_t word;
+
+  ASSERT (child != parent);
+
+  pagedir_batch_init (&batch, parent);
+  lock_acquire (&cow_lock);
+  lock_acquire (&frame_refs_lock);
+  for (word = 0; word < USER_PDE_CNT / 32 && success; word++) 
+    {
+      uint32_t bits = info->pt_map[word];
+
+      while (bits != 0 && success) 
+        {
+          size_t pde_idx = word * 32 + __builtin_ctz (bits);
+          size_t left = info->pte_cnt[pde_idx];
+          size_t pte_idx;
+          uint32_t *pt;
+
+          bits &= bits - 1;
+          pagedir_split (parent, (void *) (pde_idx << PDSHIFT));
+          pt = pde_get_pt (parent[pde_idx]);
+          /* Another thread of the parent may map pages as we go,
+             so do not trust LEFT alone to end the scan. */
+          for (pte_idx = 0; left > 0 && pte_idx < PGSIZE / sizeof *pt;
+               pte_idx++) 
+            {
+              uint32_t *pte = &pt[pte_idx];
+              void *upage;
+              uint32_t *child_pte;
+              void *kpage;
+              uintptr_t extra;
+              enum intr_level old_level;
+              bool present, shm;
+
+              if (!(*pte & (PTE_P | PTE_SWAP)))
+                continue;
+              left--;
+
+              upage = (void *) ((pde_idx << PDSHIFT) | (pte_idx << PTSHIFT));
+              child_pte = lookup_page (child, upage, true);
+              if (child_pte == NULL)
+                {
+                  success = false;
+                  break;
+                }
+              if (*child_pte & PTE_P)
+                continue;
+
+              /* Mark the frame shared before counting the child's
+                 reference, so that the clock no longer evicts it.
+                 If the clock already has, or the page was swapped
+                 out to begin with, share its swap slot instead. */
+              old_level = intr_disable ();
+              shm = (*pte & PTE_SHM) == PTE_SHM;
+              present = (*pte & PTE_P) != 0;
+              if (present)
+                *pte |= PTE_SHARED;
+#ifdef VM
+              else if (*pte & PTE_SWAP)
+                {
+                  swap_ref (*pte >> PTSHIFT);
+                  *child_pte = *pte;
+                  pd_info (child)->pte_cnt[pde_idx]++;
+                }
+#endif
+              intr_set_level (old_level);
+              if (!present)
+                continue;
+
+              /* Count the child's reference. */
+              kpage = pte_get_page (*pte);
+              extra = (uintptr_t) flatmap_find (&frame_refs, pg_no (kpage));
+              if (!flatmap_insert (&frame_refs, pg_no (kpage),
+                                   (void *) (extra + 1)))
+                {
+                  success = false;
+                  break;
+                }
+
+              if ((*pte & PTE_W) && !shm)
+                {
+                  *pte = (*pte & ~PTE_W) | PTE_COW;
+                  batch_add (&batch, upage);
+                }
+              *child_pte = *pte & ~(uint32_t) (PTE_A | PTE_D);
+              pd_info (child)->pte_cnt[pde_idx]++;
+              count_resident (child, 1);
+            }
+        }
+    }
+  lock_release (&frame_refs_lock);
+  pagedir_batch_flush (&batch);
+  lock_release (&cow_lock);
+  return success;
+}
+
+/* Resolves a write fault on UPAGE in PD, the active page
+   directory, if UPAGE is a copy-on-write page.  Returns true if
+   the write can now be retried, false if UPAGE is not
+   copy-on-write or memory is short. */
+bool
+pagedir_cow_fault (uint32_t *pd, const void *upage) 
+{
+  uint32_t *pte;
+  void *old, *new;
+
+  upage = pg_round_down (upage);
+  lock_acquire (&cow_lock);
+  pte = lookup_page (pd, upage, false);
+  if (pte == NULL || !(*pte & PTE_P))
+    {
+      lock_release (&cow_lock);
+      return false;
+    }
+  if ((*pte & (PTE_W | PTE_COW)) != PTE_COW)
+    {
+      /* Another thread of the process got here first. */
+      bool writable = (*pte & PTE_W) != 0;
+      lock_release (&cow_lock);
+      return writable;
+    }
+  old = pte_get_page (*pte);
+
+  /* If no one else maps the frame, it is ours to write. */
+  lock_acquire (&frame_refs_lock);
+  if (flatmap_find (&frame_refs, pg_no (old)) == NULL)
+    {
+      *pte = (*pte | PTE_W) & ~(uint32_t) (PTE_COW | PTE_SHARED);
+      lock_release (&frame_refs_lock);
+      invalidate_page (pd, upage);
+      lock_release (&cow_lock);
+      return true;
+    }
+  lock_release (&frame_refs_lock);
+
+  /* Otherwise make a copy.  If the other users let go of the
+     frame meanwhile, drop it rather than leak it. */
+#ifdef VM
+  /* The copy goes in the frame table, so that it can be evicted.
+     It is marked dirty, since the PTE's dirty bit, cleared in a
+     forked child, no longer tells whether it differs from where
+     the page first came from.  A copy of the zero page needs no
+     copying. */
+  new = frame_alloc (old == zero_page ? PAL_ZERO : 0, (void *) upage);
+#else
+  new = palloc_get_page (PAL_USER);
+#endif
+  if (new == NULL)
+    {
+      lock_release (&cow_lock);
+      return false;
+    }
+#ifdef VM
+  if (old != zero_page)
+    block_copy (new, old, PGSIZE);
+  *pte = pte_create_user (new, true) | PTE_D | (*pte & PTE_A);
+#else
+  block_copy (new, old, PGSIZE);
+  *pte = pte_create_user (new, true) | (*pte & (PTE_A | PTE_D));
+#endif
+  invalidate_page (pd, upage);
+  lock_release (&cow_lock);
+#ifdef VM
+  frame_forget (pd, old);
+#endif
+  if (frame_unref (old))
+    palloc_free_page (old);
+  return true;
+}
+
+/* Takes a reference to the frame that UPAGE maps in PD, as
+   pagedir_fork() does for a child, and returns its kernel
+   address.  If UPAGE is writable, it becomes copy-on-write, so
+   the frame's contents stay as they are for as long as the
+   caller holds the reference; pagedir_put_page() drops it.
+   Returns a null pointer if UPAGE is not present, is part of a
+   shared memory segment, which anyone may write, or memory is
+   short. */
+void *
+pagedir_share_page (uint32_t *pd, const void *upage) 
+{
+  enum intr_level old_level;
+  uint32_t *pte;
+  void *kpage = NULL;
+  uintptr_t extra;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  lock_acquire (&cow_lock);
+  lock_acquire (&frame_refs_lock);
+  pte = lookup_page (pd, upage, false);
+
+  /* As in pagedir_fork(), marking the frame shared stops the
+     clock from evicting it, unless it already has. */
+  old_level = intr_disable ();
+  if (pte != NULL && (*pte & PTE_P) && (*pte & PTE_SHM) != PTE_SHM)
+    {
+      *pte |= PTE_SHARED;
+      kpage = pte_get_page (*pte);
+    }
+  intr_set_level (old_level);
+
+  if (kpage != NULL)
+    {
+      extra = (uintptr_t) flatmap_find (&frame_refs, pg_no (kpage));
+      if (!flatmap_insert (&frame_refs, pg_no (kpage),
+                           (void *) (extra + 1)))
+        kpage = NULL;
+      else if (*pte & PTE_W)
+        {
+          *pte = (*pte & ~PTE_W) | PTE_COW;
+          invalidate_page (pd, upage);
+        }
+    }
+  lock_release (&frame_refs_lock);
+  lock_release (&cow_lock);
+  return kpage;
+}
+
+/* Maps UPAGE in PD, where nothing is mapped, to KPAGE, a frame of
+   a shared memory segment, writable, and counts the reference.
+   The caller keeps its own reference until it calls
+   pagedir_put_page().  Returns false if UPAGE is already mapped
+   or memory is short. */
+bool
+pagedir_map_shared (uint32_t *pd, void *upage, void *kpage) 
+{
+  uint32_t *pte;
+  uintptr_t extra;
+  bool success = false;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  lock_acquire (&cow_lock);
+  pte = lookup_page (pd, upage, true);
+  if (pte != NULL && (*pte & (PTE_P | PTE_SWAP)) == 0)
+    {
+      lock_acquire (&frame_refs_lock);
+      extra = (uintptr_t) flatmap_find (&frame_refs, pg_no (kpage));
+      success = flatmap_insert (&frame_refs, pg_no (kpage),
+                                (void *) (extra + 1));
+      lock_release (&frame_refs_lock);
+      if (success)
+        {
+          *pte = pte_create_user (kpage, true) | PTE_SHARED;
+          pd_info (pd)->pte_cnt[pd_no (upage)]++;
+          count_resident (pd, 1);
+        }
+    }
+  lock_release (&cow_lock);
+  return success;
+}
+
+/* Returns the kernel address of user address UADDR in PD if it
+   lies in a shared memory segment, or a null pointer otherwise.
+   A word in a segment has the same kernel address in every
+   process that maps it. */
+void *
+pagedir_get_shared (uint32_t *pd, const void *uaddr) 
+{
+  uint32_t pte = get_pte (pd, uaddr);
+
+  if ((pte & (PTE_P | PTE_SHM)) != (PTE_P | PTE_SHM))
+    return NULL;
+  return (uint8_t *) pte_get_page (pte) + pg_ofs (uaddr);
+}
+
+/* Drops a reference to KPAGE that pagedir_share_page() took, or
+   a shared memory segment's own reference, freeing the frame if
+   no page directory maps it any more. */
+void
+pagedir_put_page (void *kpage) 
+{
+  if (frame_unref (kpage))
+    palloc_free_page (kpage);
+}
+
+/* Drops a reference to shared frame KPAGE.  Returns true if that
+   was the last one, so that the caller should free it. */
+static bool
+frame_unref (void *kpage) 
+{
+  uintptr_t extra;
+
+  lock_acquire (&frame_refs_lock);
+  extra = (uintptr_t) flatmap_find (&frame_refs, pg_no (kpage));
+  if (extra > 1)
+    flatmap_insert (&frame_refs, pg_no (kpage), (void *) (extra - 1));
+  else if (extra == 1)
+    flatmap_remove (&frame_refs, pg_no (kpage));
+  lock_release (&frame_refs_lock);
+  return extra == 0;
+}
+
+/* Marks UPAGE not present in PD.  Returns true if it was
+   present, so that its TLB entry must be invalidated. */
+static bool
+clear_page (uint32_t *pd, void *upage) 
+{
+  uint32_t *pte;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  pte = lookup_page (pd, upage, false);
+  if (pte != NULL && (*pte & PTE_P) != 0)
+    {
+      *pte &= ~PTE_P;
+      pd_info (pd)->pte_cnt[pd_no (upage)]--;
+      count_resident (pd, -1);
+      return true;
+    }
+  return false;
+}
+
+/* Marks UPAGE not present in PD, as pagedir_clear_page() does,
+   if UPAGE is mapped to KPAGE, is clean, and its frame is not
+   shared with another page directory, so that the frame can be
+   reused and the page's contents brought back from where they
+   came from.  Returns true if successful.
+
+   The owner of PD may be running, so the dirty bit is checked
+   and the page cleared with interrupts off, lest a write slip in
+   between. */
+bool
+pagedir_clear_clean (uint32_t *pd, void *upage, void *kpage) 
+{
+  enum intr_level old_level;
+  uint32_t *pte;
+  bool success = false;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  old_level = intr_disable ();
+  pte = lookup_page (pd, upage, false);
+  if (pte != NULL && (*pte & (PTE_P | PTE_D | PTE_SHARED)) == PTE_P
+      && pte_get_page (*pte) == kpage)
+    {
+      success = clear_page (pd, upage);
+      invalidate_page (pd, upage);
+    }
+  intr_set_level (old_level);
+  return success;
+}
+
+#ifdef VM
+/* Maps UPAGE in PD, where nothing is mapped, to the shared zero
+   page, copy-on-write if WRITABLE, so that the first write gives
+   it a frame of its own.  Returns false if memory is short. */
+bool
+pagedir_map_zero (uint32_t *pd, void *upage, bool writable) 
+{
+  uint32_t *pte;
+  uintptr_t extra;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  pte = lookup_page (pd, upage, true);
+  if (pte == NULL)
+    return false;
+  ASSERT ((*pte & PTE_P) == 0);
+
+  lock_acquire (&frame_refs_lock);
+  extra = (uintptr_t) flatmap_find (&frame_refs, pg_no (zero_page));
+  if (!flatmap_insert (&frame_refs, pg_no (zero_page), (void *) (extra + 1)))
+    {
+      lock_release (&frame_refs_lock);
+      return false;
+    }
+  lock_release (&frame_refs_lock);
+
+  *pte = (pte_create_user (zero_page, false) | PTE_SHARED
+          | (writable ? PTE_COW : 0));
+  pd_info (pd)->pte_cnt[pd_no (upage)]++;
+  count_resident (pd, 1);
+  return true;
+}
+
+/* Swaps out UPAGE in PD, if it is mapped to KPAGE and its frame
+   is not shared with another page directory, by making its PTE
+   name swap SLOT instead.  The caller must write KPAGE's contents
+   to SLOT before anyone can fault the page back in.  Returns true
+   if successful. */
+bool
+pagedir_swap_out (uint32_t *pd, void *upage, void *kpage, size_t slot) 
+{
+  enum intr_level old_level;
+  uint32_t *pte;
+  bool success = false;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (slot < (1u << (32 - PTSHIFT)));
+
+  old_level = intr_disable ();
+  pte = lookup_page (pd, upage, false);
+  if (pte != NULL && (*pte & (PTE_P | PTE_SHARED)) == PTE_P
+      && pte_get_page (*pte) == kpage)
+    {
+      *pte = (slot << PTSHIFT) | PTE_SWAP | (*pte & PTE_W);
+      invalidate_page (pd, upage);
+      count_resident (pd, -1);
+      success = true;
+    }
+  intr_set_level (old_level);
+  return success;
+}
+
+/* If UPAGE is swapped out in PD, stores its swap slot in *SLOT
+   and returns true.  Otherwise, returns false. */
+bool
+pagedir_get_swap (uint32_t *pd, const void *upage, size_t *slot) 
+{
+  uint32_t e = get_pte (pd, upage);
+
+  if ((e & (PTE_P | PTE_SWAP)) != PTE_SWAP)
+    return false;
+  *slot = e >> PTSHIFT;
+  return true;
+}
+
+/* Maps UPAGE in PD to KPAGE, which holds the contents of swap
+   SLOT, if UPAGE's PTE still names SLOT.  The page is marked
+   dirty, because the caller then frees SLOT.  Returns true if
+   successful. */
+bool
+pagedir_swap_in (uint32_t *pd, void *upage, size_t slot, void *kpage) 
+{
+  enum intr_level old_level;
+  uint32_t *pte;
+  bool success = false;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  old_level = intr_disable ();
+  pte = lookup_page (pd, upage, false);
+  if (pte != NULL && (*pte & (PTE_ADDR | PTE_SWAP | PTE_P))
+                     == ((slot << PTSHIFT) | PTE_SWAP))
+    {
+      *pte = pte_create_user (kpage, (*pte & PTE_W) != 0) | PTE_D;
+      count_resident (pd, 1);
+      success = true;
+    }
+  intr_set_level (old_level);
+  return success;
+}
+
+/* Maps UPAGE in PD, which PD alone maps to KPAGE, to frame
+   TARGET instead, if the two frames hold the same contents,
+   sharing TARGET as pagedir_fork() shares a frame with a child:
+   read-only in both page directories, and copy-on-write where
+   writable.  TARGET must be mapped at TARGET_UPAGE in TARGET_PD,
+   alone or already shared, but not as part of a shared memory
+   segment.  If TARGET_PD is null, UPAGE shares the zero page
+   instead, and TARGET is ignored.  UPAGE keeps its dirty bit, so
+   that munmap() still writes a merged page of a mapped file
+   back.  Returns true if successful, in which case the caller
+   must free KPAGE.  For same-page merging, in vm/merge.c.
+
+   The contents are compared and both entries changed with
+   interrupts off, so that neither page's owner can write it
+   midway, and holding frame_refs_lock, which keeps out forks and
+   the part of a copy-on-write fault that looks at the counts. */
+bool
+pagedir_merge (uint32_t *pd, void *upage, void *kpage,
+               uint32_t *target_pd, void *target_upage, void *target) 
+{
+  enum intr_level old_level;
+  uint32_t *pte, *target_pte = NULL;
+  uintptr_t extra;
+  bool success = false;
+
+  if (target_pd == NULL)
+    target = zero_page;
+  ASSERT (kpage != target);
+
+  /* Count UPAGE's reference to TARGET first, since that may take
+     memory, and take it back if the merge falls through. */
+  lock_acquire (&frame_refs_lock);
+  extra = (uintptr_t) flatmap_find (&frame_refs, pg_no (target));
+  if (!flatmap_insert (&frame_refs, pg_no (target), (void *) (extra + 1)))
+    {
+      lock_release (&frame_refs_lock);
+      return false;
+    }
+
+  old_level = intr_disable ();
+  pte = lookup_page (pd, upage, false);
+  if (target_pd != NULL)
+    target_pte = lookup_page (target_pd, target_upage, false);
+  if (pte != NULL && (*pte & (PTE_P | PTE_SHARED)) == PTE_P
+      && pte_get_page (*pte) == kpage
+      && (target_pd == NULL
+          || (target_pte != NULL && (*target_pte & PTE_P)
+              && (*target_pte & PTE_SHM) != PTE_SHM
+              && pte_get_page (*target_pte) == target))
+      && !memcmp (kpage, target, PGSIZE))
+    {
+      if (target_pte != NULL)
+        {
+          if (*target_pte & PTE_W)
+            *target_pte = (*target_pte & ~PTE_W) | PTE_COW;
+          *target_pte |= PTE_SHARED;
+          invalidate_page (target_pd, target_upage);
+        }
+      *pte = (pte_create_user (target, false) | PTE_SHARED
+              | (*pte & (PTE_A | PTE_D))
+              | (*pte & PTE_W ? PTE_COW : 0));
+      invalidate_page (pd, upage);
+      success = true;
+    }
+  intr_set_level (old_level);
+
+  if (!success)
+    {
+      if (extra == 0)
+        flatmap_remove (&frame_refs, pg_no (target));
+      else
+        flatmap_insert (&frame_refs, pg_no (target), (void *) extra);
+    }
+  lock_release (&frame_refs_lock);
+  return success;
+}
+#endif
+
+/* Sets or clears BIT in the PTE for VPAGE in PD, according to
+   VALUE.  Clearing a bit must be followed by invalidating the
+   page's TLB entry, or the CPU may go on using the stale entry
+   and never set the bit again; returns true in that case.
+   Setting a bit needs no invalidation. */
+static bool
+set_pte_bit (uint32_t *pd, const void *vpage, uint32_t bit, bool value) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL) 
+    {
+      if (value)
+        *pte |= bit;
+      else if ((*pte & bit) != 0)
+        {
+          *pte &= ~bit;
+          return true;
+        }
+    }
+  return false;
+}
+
 /* Marks user virtual page UPAGE "not present" in page
    directory PD.  Later accesses to the page will fault.  Other
    bits in the page table entry are preserved.
@@ -143,17 +976,60 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
 void
 pagedir_clear_page (uint32_t *pd, void *upage) 
 {
-  uint32_t *pte;
+  if (clear_page (pd, upage))
+    invalidate_page (pd, upage);
+}
+
+/* Removes user page UPAGE from PD altogether, freeing its frame,
+   unless another page directory still shares it, or its swap
+   slot.  UPAGE need not be mapped.
+
+   The entry is cleared with interrupts off, so that the clock
+   either finds it gone or has already taken the page, and under
+   cow_lock, so that no copy-on-write fault or fork is midway
+   through it. */
+void
+pagedir_unmap (uint32_t *pd, void *upage) 
+{
+  enum intr_level old_level;
+  uint32_t *pte, old;
 
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (is_user_vaddr (upage));
 
+  lock_acquire (&cow_lock);
   pte = lookup_page (pd, upage, false);
-  if (pte != NULL && (*pte & PTE_P) != 0)
+  old = 0;
+  if (pte != NULL)
     {
-      *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      old_level = intr_disable ();
+      old = *pte;
+      if (old & (PTE_P | PTE_SWAP))
+        {
+          *pte = 0;
+          pd_info (pd)->pte_cnt[pd_no (upage)]--;
+          if (old & PTE_P)
+            count_resident (pd, -1);
+        }
+      intr_set_level (old_level);
+    }
+  lock_release (&cow_lock);
+
+  if (old & PTE_P)
+    {
+      void *kpage = pte_get_page (old);
+
+      invalidate_page (pd, upage);
+#ifdef VM
+      frame_forget (pd, kpage);
+#endif
+      if (!(old & PTE_SHARED) || frame_unref (kpage))
+        palloc_free_page (kpage);
     }
+#ifdef VM
+  else if (old & PTE_SWAP)
+    swap_unref (old >> PTSHIFT, pd);
+#endif
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
@@ -163,8 +1039,7 @@ pagedir_clear_page (uint32_t *pd, void *upage)
 bool
 pagedir_is_dirty (uint32_t *pd, const void *vpage) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
-  return pte != NULL && (*pte & PTE_D) != 0;
+  return (get_pte (pd, vpage) & PTE_D) != 0;
 }
 
 /* Set the dirty bit to DIRTY in the PTE for virtual page VPAGE
@@ -172,17 +1047,8 @@ pagedir_is_dirty (uint32_t *pd, const void *vpage)
 void
 pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
-  if (pte != NULL) 
-    {
-      if (dirty)
-        *pte |= PTE_D;
-      else 
-        {
-          *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
-        }
-    }
+  if (set_pte_bit (pd, vpage, PTE_D, dirty))
+    invalidate_page (pd, vpage);
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PD has been
@@ -192,8 +1058,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
 bool
 pagedir_is_accessed (uint32_t *pd, const void *vpage) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
-  return pte != NULL && (*pte & PTE_A) != 0;
+  return (get_pte (pd, vpage) & PTE_A) != 0;
 }
 
 /* Sets the accessed bit to ACCESSED in the PTE for virtual page
@@ -201,17 +1066,301 @@ pagedir_is_accessed (uint32_t *pd, const void *vpage)
 void
 pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
-  if (pte != NULL) 
+  if (set_pte_bit (pd, vpage, PTE_A, accessed))
+    invalidate_page (pd, vpage);
+}
+
+/* Returns true if user address UPAGE lies in a 4 MB page in PD. */
+bool
+pagedir_is_huge (uint32_t *pd, const void *upage) 
+{
+  return (pd_no (upage) < USER_PDE_CNT
+          && (pd[pd_no (upage)] & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS));
+}
+
+/* Clears the accessed bit of the 4 MB page that UPAGE lies in, in
+   PD, and returns its old value, for the clock.  Returns false if
+   UPAGE is not in a 4 MB page. */
+bool
+pagedir_age_huge (uint32_t *pd, const void *upage) 
+{
+  enum intr_level old_level = intr_disable ();
+  uint32_t *pde = pd + pd_no (upage);
+  bool accessed = false;
+
+  if (pagedir_is_huge (pd, upage) && (*pde & PTE_A))
+    {
+      *pde &= ~(uint32_t) PTE_A;
+      invalidate_page (pd, upage);
+      accessed = true;
+    }
+  intr_set_level (old_level);
+  return accessed;
+}
+
+/* Splits the 4 MB page that UPAGE lies in, in PD, if there is
+   one, back into 4 kB pages in the same frames. */
+void
+pagedir_split (uint32_t *pd, const void *upage) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (pagedir_is_huge (pd, upage))
+    split_huge (pd, pd_no (upage));
+  intr_set_level (old_level);
+}
+
+/* Puts the page table kept for the 4 MB page at PDE_IDX in PD
+   back in its PDE, first setting the 4 MB page's accessed and
+   dirty bits in every PTE.  Interrupts must be off, lest the CPU
+   set a bit in the PDE meanwhile.
+
+   invlpg of any address in a 4 MB page drops its TLB entry, and
+   any cached copy of the PDE, together. */
+static void
+split_huge (uint32_t *pd, size_t pde_idx) 
+{
+  struct pd_info *info = pd_info (pd);
+  size_t slot = huge_slot (info, pde_idx);
+  uint32_t bits = pd[pde_idx] & (PTE_A | PTE_D);
+  uint32_t *pt;
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (slot < PAGEDIR_HUGE_MAX);
+
+  pt = info->huge_pt[slot];
+  for (i = 0; i < PAGEDIR_HUGE_CNT; i++)
+    pt[i] |= bits;
+  pd[pde_idx] = pde_create (pt);
+  info->huge_pt[slot] = NULL;
+  invalidate_page (pd, (void *) (pde_idx << PDSHIFT));
+}
+
+/* Returns true if PTE maps frame KPAGE, or any frame if KPAGE is
+   null, in a way that a 4 MB page can take over: present and
+   writable, and neither shared nor copy-on-write. */
+static bool
+huge_ok (uint32_t pte, const void *kpage) 
+{
+  return ((pte & (PTE_P | PTE_W | PTE_U | PTE_SHARED | PTE_COW | PTE_SWAP))
+          == (PTE_P | PTE_W | PTE_U)
+          && (kpage == NULL || pte_get_page (pte) == kpage));
+}
+
+/* Returns true if every page of the 4 MB region that user address
+   UPAGE lies in is mapped in PD as pagedir_promote() requires,
+   and PD has room for another 4 MB page.  Only a hint, since the
+   mappings may change as soon as this returns. */
+bool
+pagedir_huge_candidate (uint32_t *pd, const void *upage) 
+{
+  struct pd_info *info = pd_info (pd);
+  size_t pde_idx = pd_no (upage);
+  uint32_t *pt;
+  size_t i;
+
+  if (pde_idx >= USER_PDE_CNT || info->pte_cnt[pde_idx] != PAGEDIR_HUGE_CNT
+      || (pd[pde_idx] & PTE_PS)
+      || huge_slot (info, pde_idx) != PAGEDIR_HUGE_MAX)
+    return false;
+  for (i = 0; i < PAGEDIR_HUGE_MAX; i++)
+    if (info->huge_pt[i] == NULL)
+      break;
+  if (i == PAGEDIR_HUGE_MAX)
+    return false;
+
+  pt = pde_get_pt (pd[pde_idx]);
+  for (i = 0; i < PAGEDIR_HUGE_CNT; i++)
+    if (!huge_ok (pt[i], NULL))
+      return false;
+  return true;
+}
+
+/* Maps the 4 MB region at BASE in PD, the active page directory,
+   with a single 4 MB page in HUGE, 1,024 physically contiguous
+   frames aligned to 4 MB, if every page I of the region is still
+   mapped to frame OLD[I] as huge_ok() requires.  Each page's
+   contents are copied to its frame in HUGE, which takes the old
+   frame's place in the page table kept for the 4 MB page.
+   Returns true if successful, in which case the caller must free
+   the OLD frames; otherwise nothing has changed.
+
+   The caller, frame_promote(), holds frame_lock, so that the
+   clock, same-page merging and pins leave the old frames alone,
+   and its own caller holds page_lock, so that the pages are not
+   mapped or unmapped meanwhile.  cow_lock,
+   which forks and copy-on-write faults hold, is only tried, since
+   it comes before frame_lock: this gives up rather than wait.
+
+   The process's other threads may go on writing the region, so
+   the pages' dirty bits are saved and cleared before the copy,
+   which is made with interrupts on.  At the switch, with
+   interrupts off, the pages that came out dirty again are copied
+   once more, and every page gets its saved dirty bit back. */
+bool
+pagedir_promote (uint32_t *pd, void *base, void *huge, void *old[]) 
+{
+  struct pd_info *info = pd_info (pd);
+  size_t pde_idx = pd_no (base);
+  uint32_t dirty[PAGEDIR_HUGE_CNT / 32];
+  enum intr_level old_level;
+  uint32_t *pt;
+  size_t slot, i, recopy;
+  bool success;
+
+  ASSERT (((uintptr_t) base & ~PDMASK) == 0);
+  ASSERT (pde_idx < USER_PDE_CNT);
+  ASSERT (((uintptr_t) huge & (PTSPAN - 1)) == 0);
+  ASSERT (pd == pagedir_active ());
+
+  if (!lock_try_acquire (&cow_lock))
+    return false;
+  for (slot = 0; slot < PAGEDIR_HUGE_MAX; slot++)
+    if (info->huge_pt[slot] == NULL)
+      break;
+
+  /* Save and clear the dirty bits. */
+  old_level = intr_disable ();
+  success = (slot < PAGEDIR_HUGE_MAX
+             && (pd[pde_idx] & (PTE_P | PTE_PS)) == PTE_P);
+  pt = success ? pde_get_pt (pd[pde_idx]) : NULL;
+  for (i = 0; i < PAGEDIR_HUGE_CNT && success; i++)
+    success = huge_ok (pt[i], old[i]);
+  if (success)
+    {
+      memset (dirty, 0, sizeof dirty);
+      for (i = 0; i < PAGEDIR_HUGE_CNT; i++)
+        if (pt[i] & PTE_D)
+          {
+            dirty[i / 32] |= 1u << i % 32;
+            pt[i] &= ~(uint32_t) PTE_D;
+          }
+      pagedir_activate (pd);
+    }
+  intr_set_level (old_level);
+  if (!success)
     {
-      if (accessed)
-        *pte |= PTE_A;
+      lock_release (&cow_lock);
+      return false;
+    }
+
+  for (i = 0; i < PAGEDIR_HUGE_CNT; i++)
+    block_copy ((uint8_t *) huge + i * PGSIZE, old[i], PGSIZE);
+
+  old_level = intr_disable ();
+  recopy = 0;
+  for (i = 0; i < PAGEDIR_HUGE_CNT && success; i++)
+    {
+      success = huge_ok (pt[i], old[i]);
+      if (pt[i] & PTE_D)
+        recopy++;
+    }
+  success = success && recopy <= HUGE_RECOPY_MAX;
+  for (i = 0; i < PAGEDIR_HUGE_CNT; i++)
+    {
+      uint8_t *kpage = (uint8_t *) huge + i * PGSIZE;
+      bool was_dirty = (dirty[i / 32] & (1u << i % 32)) != 0;
+
+      if (!success)
+        {
+          if (was_dirty && pte_get_page (pt[i]) == old[i])
+            pt[i] |= PTE_D;
+          continue;
+        }
+      if (pt[i] & PTE_D)
+        {
+          block_copy (kpage, old[i], PGSIZE);
+          was_dirty = true;
+        }
+      pt[i] = pte_create_user (kpage, true) | (was_dirty ? PTE_D : 0);
+    }
+  if (success)
+    {
+      info->huge_pde[slot] = pde_idx;
+      info->huge_pt[slot] = pt;
+      pd[pde_idx] = pde_create_large (huge, true) | PTE_U | PTE_A;
+      pagedir_activate (pd);
+    }
+  intr_set_level (old_level);
+  lock_release (&cow_lock);
+  return success;
+}
+
+/* Batched changes.
+
+   Code that changes many pages at once, such as unmapping a
+   range or sweeping accessed bits for eviction, can queue the
+   TLB invalidations in a struct pagedir_batch and do them all in
+   pagedir_batch_flush().  Up to PAGEDIR_BATCH_MAX pages are
+   invalidated one by one; beyond that, a single reload of CR3
+   flushes the whole TLB, which is cheaper than that many
+   invlpgs.  The page table itself changes at once, so the only
+   effect of deferring is that the CPU may use a stale entry
+   until the flush: the changes must not be relied on until then. */
+
+/* Starts batch B of changes to PD. */
+void
+pagedir_batch_init (struct pagedir_batch *b, uint32_t *pd) 
+{
+  b->pd = pd;
+  b->cnt = 0;
+}
+
+/* Queues invalidation of VPAGE in batch B. */
+static void
+batch_add (struct pagedir_batch *b, const void *vpage) 
+{
+  if (b->cnt < PAGEDIR_BATCH_MAX)
+    b->pages[b->cnt] = vpage;
+  if (b->cnt <= PAGEDIR_BATCH_MAX)
+    b->cnt++;
+}
+
+/* Like pagedir_clear_page(), as part of batch B. */
+void
+pagedir_batch_clear_page (struct pagedir_batch *b, void *upage) 
+{
+  if (clear_page (b->pd, upage))
+    batch_add (b, upage);
+}
+
+/* Like pagedir_set_dirty(), as part of batch B. */
+void
+pagedir_batch_set_dirty (struct pagedir_batch *b, const void *vpage,
+                         bool dirty) 
+{
+  if (set_pte_bit (b->pd, vpage, PTE_D, dirty))
+    batch_add (b, vpage);
+}
+
+/* Like pagedir_set_accessed(), as part of batch B. */
+void
+pagedir_batch_set_accessed (struct pagedir_batch *b, const void *vpage,
+                            bool accessed) 
+{
+  if (set_pte_bit (b->pd, vpage, PTE_A, accessed))
+    batch_add (b, vpage);
+}
+
+/* Invalidates the TLB entries for all the changes queued in B
+   and empties B, so that it can be reused. */
+void
+pagedir_batch_flush (struct pagedir_batch *b) 
+{
+  if (b->cnt > 0 && pagedir_active () == b->pd)
+    {
+      if (b->cnt > PAGEDIR_BATCH_MAX)
+        pagedir_activate (b->pd);
       else 
         {
-          *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          size_t i;
+
+          for (i = 0; i < b->cnt; i++)
+            invlpg (b->pages[i]);
         }
     }
+  b->cnt = 0;
 }
 
 /* Loads page directory PD into the CPU's page directory base
@@ -231,8 +1380,8 @@ pagedir_activate (uint32_t *pd)
 }
 
 /* Returns the currently active page directory. */
-static uint32_t *
-active_pd (void) 
+uint32_t *
+pagedir_active (void) 
 {
   /* Copy CR3, the page directory base register (PDBR), into
      `pd'.
@@ -243,21 +1392,27 @@ active_pd (void)
   return ptov (pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the stale
+   entry.
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   This function invalidates the TLB entry for VADDR if PD is the
+   active page directory.  (If PD is not active then its entries
+   are not in the TLB, so there is no need to invalidate
+   anything.)  Unlike reloading CR3, which flushes the whole TLB,
+   this leaves every other translation in place. */
 static void
-invalidate_pagedir (uint32_t *pd) 
+invalidate_page (uint32_t *pd, const void *vaddr) 
 {
-  if (active_pd () == pd) 
-    {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
-    } 
+  if (pagedir_active () == pd) 
+    invlpg (vaddr);
+}
+
+/* Invalidates the TLB entry for VADDR.  See [IA32-v2a] "INVLPG--
+   Invalidate TLB Entry". */
+static inline void
+invlpg (const void *vaddr) 
+{
+  asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
 }
@@ -2,17 +2,64 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+void pagedir_init (void);
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
 void *pagedir_get_page (uint32_t *pd, const void *upage);
+bool pagedir_is_writable (uint32_t *pd, const void *upage);
 void pagedir_clear_page (uint32_t *pd, void *upage);
+void pagedir_unmap (uint32_t *pd, void *upage);
+size_t pagedir_resident (uint32_t *pd, size_t *max);
+bool pagedir_clear_clean (uint32_t *pd, void *upage, void *kpage);
+bool pagedir_map_zero (uint32_t *pd, void *upage, bool writable);
+bool pagedir_swap_out (uint32_t *pd, void *upage, void *kpage, size_t slot);
+bool pagedir_get_swap (uint32_t *pd, const void *upage, size_t *slot);
+bool pagedir_swap_in (uint32_t *pd, void *upage, size_t slot, void *kpage);
+bool pagedir_merge (uint32_t *pd, void *upage, void *kpage,
+                    uint32_t *target_pd, void *target_upage, void *target);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
+bool pagedir_fork (uint32_t *child, uint32_t *parent);
+bool pagedir_cow_fault (uint32_t *pd, const void *upage);
+void *pagedir_share_page (uint32_t *pd, const void *upage);
+void pagedir_put_page (void *kpage);
+bool pagedir_map_shared (uint32_t *pd, void *upage, void *kpage);
+void *pagedir_get_shared (uint32_t *pd, const void *uaddr);
+bool pagedir_is_huge (uint32_t *pd, const void *upage);
+bool pagedir_age_huge (uint32_t *pd, const void *upage);
+void pagedir_split (uint32_t *pd, const void *upage);
+bool pagedir_huge_candidate (uint32_t *pd, const void *upage);
+bool pagedir_promote (uint32_t *pd, void *base, void *huge, void *old[]);
 void pagedir_activate (uint32_t *pd);
+uint32_t *pagedir_active (void);
+
+/* 4 MB user pages.  See pagedir.c. */
+#define PAGEDIR_HUGE_CNT 1024   /* 4 kB pages in a 4 MB page. */
+#define PAGEDIR_HUGE_MAX 32     /* Most 4 MB pages per page directory. */
+
+/* Page table changes whose TLB invalidations are deferred and
+   done together.  See pagedir.c. */
+#define PAGEDIR_BATCH_MAX 32
+struct pagedir_batch
+  {
+    uint32_t *pd;               /* Page directory being changed. */
+    size_t cnt;                 /* Pages queued; PAGEDIR_BATCH_MAX + 1
+                                   means flush all. */
+    const void *pages[PAGEDIR_BATCH_MAX];  /* Pages to invalidate. */
+  };
+
+void pagedir_batch_init (struct pagedir_batch *, uint32_t *pd);
+void pagedir_batch_clear_page (struct pagedir_batch *, void *upage);
+void pagedir_batch_set_dirty (struct pagedir_batch *, const void *vpage,
+                              bool dirty);
+void pagedir_batch_set_accessed (struct pagedir_batch *, const void *vpage,
+                                 bool accessed);
+void pagedir_batch_flush (struct pagedir_batch *);
 
 #endif /* userprog/pagedir.h */
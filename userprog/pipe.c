@@ -0,0 +1,346 @@
+#include "userprog/pipe.h"
+#include <debug.h>
+#include <stdint.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/poll.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/uaccess.h"
+
+/* Pipes.
+
+   A pipe buffers up to PIPE_SIZE bytes in a ring of PIPE_PAGES
+   page-sized slots.  Each byte is copied once on the way in,
+   with copy_from_user() straight into the ring, and once on the
+   way out, with copy_to_user() straight out of it.  A write of a
+   whole page-aligned user page that lands on an empty slot skips
+   the first copy: the slot takes a reference to the writer's
+   frame through pagedir_share_page(), which makes the writer's
+   page copy-on-write, so the frame keeps the data the writer
+   wrote until the reader is done with it.
+
+   Readers and writers wake each other in batches rather than
+   for each byte.  A writer wakes waiting readers once it has
+   copied all it can, and a reader wakes waiting writers only
+   once PIPE_WAKE_SPACE bytes are free.  Pollers are woken
+   whenever anything is read or written or an end is closed, and
+   each keeps the pipe alive while it watches. */
+
+#define PIPE_PAGES 4                    /* Slots in the ring. */
+#define PIPE_SIZE (PIPE_PAGES * PGSIZE) /* Bytes the ring holds. */
+#define PIPE_WAKE_SPACE PGSIZE          /* Room that wakes writers. */
+
+/* A page of the ring. */
+struct pipe_slot
+  {
+    uint8_t *buf;               /* Own page for copied data, or NULL. */
+    uint8_t *frame;             /* Writer's frame, if spliced in. */
+  };
+
+struct pipe
+  {
+    struct lock lock;           /* Protects all of the below. */
+    struct condition readable;  /* Signaled when data or EOF arrives. */
+    struct condition writable;  /* Signaled when room frees up. */
+    struct pipe_slot slots[PIPE_PAGES];
+    size_t start;               /* Ring offset of the first byte. */
+    size_t len;                 /* Bytes in the ring. */
+    int readers;                /* Open read ends. */
+    int writers;                /* Open write ends. */
+    int read_waiters;           /* Readers waiting on READABLE. */
+    int write_waiters;          /* Writers waiting on WRITABLE. */
+    int watchers;               /* Pollers that keep the pipe alive. */
+    struct poll_queue pollers;  /* Woken on any change. */
+  };
+
+/* Creates a pipe with one open end of each kind and returns it,
+   or a null pointer if memory is short. */
+struct pipe *
+pipe_create (void) 
+{
+  struct pipe *p = calloc (1, sizeof *p);
+
+  if (p != NULL)
+    {
+      lock_init (&p->lock);
+      cond_init (&p->readable);
+      cond_init (&p->writable);
+      poll_queue_init (&p->pollers);
+      p->readers = p->writers = 1;
+    }
+  return p;
+}
+
+/* Opens another of P's read ends, or write ends if WRITE_END is
+   true, as for fork(). */
+void
+pipe_dup (struct pipe *p, bool write_end) 
+{
+  lock_acquire (&p->lock);
+  if (write_end)
+    p->writers++;
+  else
+    p->readers++;
+  lock_release (&p->lock);
+}
+
+/* Frees P and whatever it still holds. */
+static void
+destroy (struct pipe *p) 
+{
+  int i;
+
+  for (i = 0; i < PIPE_PAGES; i++)
+    {
+      if (p->slots[i].frame != NULL)
+        pagedir_put_page (p->slots[i].frame);
+      palloc_free_page (p->slots[i].buf);
+    }
+  free (p);
+}
+
+/* Closes one of P's read ends, or write ends if WRITE_END is
+   true.  Closing the last end of a kind wakes everyone waiting
+   on the other, and closing the last end of all frees P. */
+void
+pipe_close (struct pipe *p, bool write_end) 
+{
+  bool dead;
+
+  if (p == NULL)
+    return;
+
+  lock_acquire (&p->lock);
+  if (write_end)
+    {
+      if (--p->writers == 0)
+        cond_broadcast (&p->readable, &p->lock);
+    }
+  else
+    {
+      if (--p->readers == 0)
+        cond_broadcast (&p->writable, &p->lock);
+    }
+  poll_wake (&p->pollers);
+  dead = p->readers == 0 && p->writers == 0 && p->watchers == 0;
+  lock_release (&p->lock);
+
+  if (dead)
+    destroy (p);
+}
+
+/* Hooks poller PL onto P and keeps P alive until a matching
+   call to pipe_unwatch(), which must come after PL is
+   destroyed. */
+void
+pipe_watch (struct pipe *p, struct poller *pl) 
+{
+  lock_acquire (&p->lock);
+  p->watchers++;
+  poller_add (pl, &p->pollers);
+  lock_release (&p->lock);
+}
+
+/* Lets go of P after pipe_watch(), freeing it if every end has
+   been closed. */
+void
+pipe_unwatch (struct pipe *p) 
+{
+  bool dead;
+
+  lock_acquire (&p->lock);
+  dead = --p->watchers == 0 && p->readers == 0 && p->writers == 0;
+  lock_release (&p->lock);
+
+  if (dead)
+    destroy (p);
+}
+
+/* Returns true if P has bytes to read, or, if WRITE_END is
+   true, if writing to P would not wait, and sets *HUNG_UP to
+   whether every end of the other kind has been closed. */
+bool
+pipe_ready (struct pipe *p, bool write_end, bool *hung_up) 
+{
+  bool ready;
+
+  lock_acquire (&p->lock);
+  if (write_end)
+    {
+      size_t end = (p->start + p->len) % PIPE_SIZE;
+
+      *hung_up = p->readers == 0;
+      ready = (*hung_up
+               || (p->len < PIPE_SIZE
+                   && p->slots[end / PGSIZE].frame == NULL));
+    }
+  else
+    {
+      *hung_up = p->writers == 0;
+      ready = p->len > 0;
+    }
+  lock_release (&p->lock);
+  return ready;
+}
+
+/* Returns the data in the slot of P at ring offset OFS. */
+static uint8_t *
+slot_data (struct pipe *p, size_t ofs) 
+{
+  struct pipe_slot *s = &p->slots[ofs / PGSIZE];
+
+  return s->frame != NULL ? s->frame : s->buf;
+}
+
+/* Reads up to SIZE bytes from P into user buffer BUFFER, waiting
+   until there is at least one unless every write end is closed.
+   Returns the number of bytes read, 0 at end of file, or -1 if
+   BUFFER is not mapped. */
+int
+pipe_read_user (struct pipe *p, void *buffer, unsigned size) 
+{
+  uint8_t *dst = buffer;
+  int done = 0;
+
+  lock_acquire (&p->lock);
+  while (p->len == 0 && p->writers > 0)
+    {
+      p->read_waiters++;
+      cond_wait (&p->readable, &p->lock);
+      p->read_waiters--;
+    }
+
+  while (size > 0 && p->len > 0)
+    {
+      size_t slot_left = PGSIZE - p->start % PGSIZE;
+      size_t n = size;
+      struct pipe_slot *s = &p->slots[p->start / PGSIZE];
+
+      if (n > p->len)
+        n = p->len;
+      if (n > slot_left)
+        n = slot_left;
+      if (!copy_to_user (dst, slot_data (p, p->start) + p->start % PGSIZE,
+                         n))
+        {
+          done = -1;
+          break;
+        }
+
+      /* A spliced frame goes back once it has been read. */
+      if (n == slot_left && s->frame != NULL)
+        {
+          pagedir_put_page (s->frame);
+          s->frame = NULL;
+        }
+      p->start = (p->start + n) % PIPE_SIZE;
+      p->len -= n;
+      dst += n;
+      size -= n;
+      done += n;
+    }
+
+  if (p->write_waiters > 0 && PIPE_SIZE - p->len >= PIPE_WAKE_SPACE)
+    cond_broadcast (&p->writable, &p->lock);
+  if (done > 0)
+    poll_wake (&p->pollers);
+  lock_release (&p->lock);
+  return done;
+}
+
+/* Tries to add the page at page-aligned user address UPAGE to P
+   without copying it, at ring offset END, which must start an
+   empty slot.  Returns true if successful. */
+static bool
+splice_page (struct pipe *p, size_t end, const uint8_t *upage) 
+{
+  struct pipe_slot *s = &p->slots[end / PGSIZE];
+
+  ASSERT (s->frame == NULL);
+  s->frame = pagedir_share_page (thread_current ()->pagedir, upage);
+  return s->frame != NULL;
+}
+
+/* Writes the SIZE bytes of user buffer BUFFER to P, waiting for
+   room as necessary.  Returns SIZE, or fewer if every read end
+   is closed partway, PIPE_BROKEN if they were all closed before
+   anything was written, or -1 if BUFFER is not mapped or memory
+   is short. */
+int
+pipe_write_user (struct pipe *p, const void *buffer, unsigned size) 
+{
+  const uint8_t *src = buffer;
+  int done = 0;
+
+  lock_acquire (&p->lock);
+  while (size > 0)
+    {
+      size_t end, slot_left, n;
+      struct pipe_slot *s;
+
+      if (p->readers == 0)
+        {
+          if (done == 0)
+            done = PIPE_BROKEN;
+          break;
+        }
+
+      /* Wait if the ring is full, or if the free space begins in
+         a slot whose spliced frame is still being read. */
+      end = (p->start + p->len) % PIPE_SIZE;
+      s = &p->slots[end / PGSIZE];
+      if (p->len == PIPE_SIZE || s->frame != NULL)
+        {
+          /* Let the readers at what we have so far. */
+          if (p->read_waiters > 0)
+            cond_broadcast (&p->readable, &p->lock);
+          if (p->len > 0)
+            poll_wake (&p->pollers);
+          p->write_waiters++;
+          cond_wait (&p->writable, &p->lock);
+          p->write_waiters--;
+          continue;
+        }
+
+      slot_left = PGSIZE - end % PGSIZE;
+      if (end % PGSIZE == 0 && size >= PGSIZE && pg_ofs (src) == 0
+          && PIPE_SIZE - p->len >= PGSIZE && splice_page (p, end, src))
+        n = PGSIZE;
+      else
+        {
+          n = size;
+          if (n > PIPE_SIZE - p->len)
+            n = PIPE_SIZE - p->len;
+          if (n > slot_left)
+            n = slot_left;
+          if (s->buf == NULL)
+            {
+              s->buf = palloc_get_page (0);
+              if (s->buf == NULL)
+                {
+                  done = -1;
+                  break;
+                }
+            }
+          if (!copy_from_user (s->buf + end % PGSIZE, src, n))
+            {
+              done = -1;
+              break;
+            }
+        }
+      p->len += n;
+      src += n;
+      size -= n;
+      done += n;
+    }
+
+  if (p->read_waiters > 0 && p->len > 0)
+    cond_broadcast (&p->readable, &p->lock);
+  if (done > 0)
+    poll_wake (&p->pollers);
+  lock_release (&p->lock);
+  return done;
+}
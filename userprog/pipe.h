@@ -0,0 +1,22 @@
+#ifndef USERPROG_PIPE_H
+#define USERPROG_PIPE_H
+
+#include <stdbool.h>
+
+struct pipe;
+struct poller;
+
+struct pipe *pipe_create (void);
+void pipe_dup (struct pipe *, bool write_end);
+void pipe_close (struct pipe *, bool write_end);
+void pipe_watch (struct pipe *, struct poller *);
+void pipe_unwatch (struct pipe *);
+bool pipe_ready (struct pipe *, bool write_end, bool *hung_up);
+int pipe_read_user (struct pipe *, void *buffer, unsigned size);
+int pipe_write_user (struct pipe *, const void *buffer, unsigned size);
+
+/* Returned by pipe_write_user() if no one can ever read what it
+   would write. */
+#define PIPE_BROKEN (-2)
+
+#endif /* userprog/pipe.h */
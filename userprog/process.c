@@ -1,68 +1,712 @@
 #include "userprog/process.h"
+#include <clock-page.h>
 #include <debug.h>
 #include <inttypes.h>
 #include <round.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/aio.h"
+#include "userprog/futex.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/shm.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
+#include "devices/timer.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "threads/workqueue.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
+
+/* A command line split into words, built by process_execute()
+   in a page of its own and handed to the new thread.
+
+   The words are packed back to back, each followed by a null
+   terminator, in exactly the form they take on the user stack,
+   so setup_stack() can place them with one memcpy(). */
+struct cmdline
+  {
+    struct child *child;        /* Exit record for the new process. */
+    struct file *file;          /* Executable, if process_execute()
+                                   could open it, or null. */
+    uint64_t spawned;           /* timer_cycles() at thread_create(). */
+    int argc;                   /* Number of words. */
+    size_t len;                 /* Bytes used in STR, counting nulls. */
+    uint16_t argv[128];         /* Offset of each word in STR. */
+    char str[];                 /* Packed words. */
+  };
+
+/* Maximum number of words on a command line. */
+#define ARGV_MAX (sizeof ((struct cmdline *) 0)->argv \
+                  / sizeof *((struct cmdline *) 0)->argv)
+
+/* Bytes available for the packed words. */
+#define CMDLINE_STR_MAX (PGSIZE - offsetof (struct cmdline, str))
+
+/* Phases of starting a process, timed for exec statistics. */
+enum exec_phase
+  {
+    EXEC_CREATE,                /* process_execute() to thread_create(). */
+    EXEC_SCHEDULE,              /* thread_create() to start_process(). */
+    EXEC_PAGEDIR,               /* pagedir_create(). */
+    EXEC_OPEN,                  /* Opening the executable. */
+    EXEC_PARSE,                 /* Reading and checking its headers. */
+    EXEC_LOAD,                  /* Loading its segments. */
+    EXEC_STACK,                 /* Setting up the stack. */
+    EXEC_PHASE_CNT
+  };
+
+static const char *exec_phase_names[EXEC_PHASE_CNT] =
+  {
+    "thread create", "first schedule", "pagedir_create", "file open",
+    "header parse", "segment load", "stack setup",
+  };
+
+/* Per-phase statistics, updated with interrupts off. */
+struct exec_stats
+  {
+    unsigned long long cnt;     /* Number of times the phase ran. */
+    uint64_t cycles;            /* Total timer_cycles() spent. */
+  };
+static struct exec_stats exec_stats[EXEC_PHASE_CNT];
+
+static uint64_t exec_phase_done (enum exec_phase, uint64_t start);
+/* What a forking process hands to its child. */
+struct fork_info
+  {
+    struct thread *parent;      /* The forking process. */
+    struct intr_frame if_;      /* Its user registers. */
+    struct child *child;        /* Exit record for the child. */
+    struct semaphore done;      /* Upped once the child is set up. */
+    bool success;               /* Did the child set up? */
+  };
+
+/* Exit records.
+
+   Each child process leaves its exit status in a record that it
+   shares with its parent.  The parent's leader keeps the records
+   of its unreaped children on its `children' list, and those of
+   them that have exited also on its `exited' list, in the order
+   they exited.  wait() for a given child looks only through the
+   parent's own children, and waiting for any child just takes
+   the front of `exited', so reaping N children costs O(N) in
+   all.
+
+   A record is freed by whichever of its parent and child is done
+   with it last.  wait_lock protects all of them. */
+struct child
+  {
+    struct list_elem elem;      /* In parent's `children'. */
+    struct list_elem exit_elem; /* In parent's `exited', once exited. */
+    struct thread *parent;      /* Parent's leader, or NULL once gone. */
+    tid_t tid;                  /* Child's thread id. */
+    int exit_status;            /* Set when the child exits. */
+    bool exited;                /* Has the child exited? */
+    bool claimed;               /* Is a thread waiting for this child? */
+    struct process_usage usage; /* Set when the child exits, counting
+                                   the children it waited for. */
+  };
+
+static struct lock wait_lock;
+
+static struct child *add_child (void);
+static void remove_child (struct child *);
+static void notify_parent (void);
+static void release_children (void);
+
+/* Threads of a process.
+
+   A process starts with one thread, its leader, which owns the
+   process's page directory, open files, and supplemental page
+   table.  process_thread_create() adds more threads that share
+   all of these: each one's `leader' points to the owner, and it
+   borrows the leader's page directory.
+
+   When the leader exits, the whole process goes: it marks the
+   group dying and waits for the other threads to notice on their
+   way back to user mode, in process_check_dying(), before it
+   frees anything they might use.  A fault in any thread kills the
+   whole process the same way.  Any other thread that exits ends
+   only itself, leaving its exit status for
+   process_thread_join(). */
+
+/* The threads of a process, created with its second thread. */
+struct thread_group
+  {
+    struct thread *leader;      /* The process's first thread. */
+    struct lock lock;           /* Protects the members below. */
+    struct list uthreads;       /* Unjoined struct uthreads. */
+    int live_cnt;               /* Threads besides the leader running. */
+    bool dying;                 /* Is the process being torn down? */
+    struct semaphore idle;      /* Upped when `live_cnt' drops to 0
+                                   once `dying' is set. */
+  };
+
+/* A thread of a process other than its leader. */
+struct uthread
+  {
+    struct list_elem elem;      /* Element in group's `uthreads'. */
+    struct thread_group *group; /* Group it belongs to. */
+    tid_t tid;                  /* Thread id. */
+    int status;                 /* Exit status, once it has exited. */
+    struct semaphore exited;    /* Upped when it exits. */
+    void (*eip) (void);         /* Where to start in user mode. */
+    void *esp;                  /* Initial user stack pointer. */
+  };
+
+/* The heap runs up from the end of the loaded segments to at
+   most STACK_MAX below the top of user memory, which is left for
+   the stack. */
+#define HEAP_LIMIT ((uint8_t *) PHYS_BASE - STACK_MAX)
+
+/* Serializes moving a break, which any of a process's threads
+   may do. */
+static struct lock brk_lock;
+
+/* Resource accounting.
+
+   A process's leader keeps the totals for all of its threads in
+   `usage', which whatever thread of the process is running
+   charges, with interrupts off, since the timer interrupt charges
+   it too.  Kernel threads, including the ones that write back
+   the buffer cache, are charged nothing.  An exiting process
+   leaves its totals, with those of the children it waited for,
+   in its exit record, and the parent that waits for it adds them
+   to its `child_usage'.  The page directory counts resident
+   pages itself; see pagedir_resident().
+
+   -rusage: print each process's totals when it exits. */
+bool process_print_usage;
+
+static struct process_usage *current_usage (void);
+static void add_usage (struct process_usage *,
+                       const struct process_usage *);
+static void print_usage (const struct thread *);
+
+/* What an exited process leaves for the reaper.
+
+   Freeing every frame, swap slot, and page table of a large
+   process takes a while, and none of it matters to the parent
+   waiting for the exit status.  So process_exit() hands the page
+   directory and, under VM, the supplemental page table to a
+   low-priority work queue job, and reports the exit right
+   away.  The job frees whatever has piled up in one batch.
+   process_execute() finishes any teardown still pending itself
+   before starting a program, so that a new process never runs
+   short of memory that a dead one still holds. */
+struct remains
+  {
+    struct list_elem elem;      /* Element in `remains_list'. */
+    uint32_t *pd;               /* Page directory. */
+#ifdef VM
+    struct flatmap pages;       /* Supplemental page table. */
+#endif
+  };
+
+/* Remains not yet freed, and the reaper's state, all protected
+   by reap_lock. */
+static struct lock reap_lock;
+static struct list remains_list;
+static bool reap_queued;        /* Is reap_work queued? */
+static int reaping;             /* Batches being freed. */
+static struct condition reaped; /* Signaled when a batch is freed. */
+static struct work reap_work;
+
+static bool map_clock_page (void);
+static void refresh_clock (struct clock_page *);
 
 static thread_func start_process NO_RETURN;
-static bool load (const char *cmdline, void (**eip) (void), void **esp);
+static thread_func start_fork NO_RETURN;
+static thread_func start_uthread NO_RETURN;
+static void exit_uthread (void);
+static void end_group (void);
+static bool parse_cmdline (struct cmdline *, const char *);
+static bool load (const struct cmdline *, void (**eip) (void), void **esp);
+static struct file *open_exec (const char *file_name);
+static void reap_wait (void);
+static work_func reap;
 
-/* Starts a new thread running a user program loaded from
-   FILENAME.  The new thread may be scheduled (and may even exit)
-   before process_execute() returns.  Returns the new process's
-   thread id, or TID_ERROR if the thread cannot be created. */
+/* Initializes process management. */
+void
+process_init (void) 
+{
+  lock_init (&brk_lock);
+  lock_init (&wait_lock);
+  lock_init (&reap_lock);
+  list_init (&remains_list);
+  cond_init (&reaped);
+  work_init (&reap_work, reap, NULL);
+}
+
+/* Starts a new thread running a user program loaded from the
+   first word of CMDLINE, passing it all the words of CMDLINE as
+   arguments.  The new thread may be scheduled (and may even
+   exit) before process_execute() returns.  Returns the new
+   process's thread id, or TID_ERROR if the thread cannot be
+   created or CMDLINE is empty or too long. */
 tid_t
-process_execute (const char *file_name) 
+process_execute (const char *cmdline) 
 {
-  char *fn_copy;
+  uint64_t start = timer_cycles ();
+  struct cmdline *cl;
   tid_t tid;
 
-  /* Make a copy of FILE_NAME.
+  /* Take back the memory of processes that have exited. */
+  reap_wait ();
+
+  /* Split CMDLINE into a page of our own.
      Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page (0);
-  if (fn_copy == NULL)
+  cl = palloc_get_page (0);
+  if (cl == NULL)
+    return TID_ERROR;
+  if (!parse_cmdline (cl, cmdline))
+    {
+      palloc_free_page (cl);
+      return TID_ERROR;
+    }
+
+  /* Create a new thread to execute the program, named after the
+     program alone.  Holding wait_lock keeps the child from
+     exiting before its record has its tid.  The executable is
+     opened here, and its first sectors start coming into the
+     buffer cache, while the child waits to be scheduled. */
+  cl->child = add_child ();
+  if (cl->child == NULL)
+    {
+      palloc_free_page (cl);
+      return TID_ERROR;
+    }
+  cl->file = open_exec (cl->str);
+  cl->spawned = timer_cycles ();
+  lock_acquire (&wait_lock);
+  tid = thread_create (cl->str, PRI_DEFAULT, start_process, cl);
+  if (tid == TID_ERROR)
+    {
+      remove_child (cl->child);
+      file_close (cl->file);
+      palloc_free_page (cl); 
+    }
+  else
+    {
+      cl->child->tid = tid;
+      exec_phase_done (EXEC_CREATE, start);
+    }
+  lock_release (&wait_lock);
+  return tid;
+}
+
+/* Creates a child of the running process that is a copy of it,
+   resuming in user mode from the registers in F as if returning
+   0 from a system call.  The child shares the parent's memory
+   copy-on-write, so this costs time in proportion to the page
+   tables, not to the memory they map.  Returns the child's
+   thread id, or TID_ERROR if it cannot be created. */
+tid_t
+process_fork (const struct intr_frame *f) 
+{
+  struct fork_info info;
+  tid_t tid;
+
+  info.parent = thread_current ()->leader;
+  info.if_ = *f;
+  sema_init (&info.done, 0);
+  info.success = false;
+  info.child = add_child ();
+  if (info.child == NULL)
+    return TID_ERROR;
+
+  lock_acquire (&wait_lock);
+  tid = thread_create (thread_name (), thread_get_priority (),
+                       start_fork, &info);
+  if (tid == TID_ERROR)
+    remove_child (info.child);
+  else
+    info.child->tid = tid;
+  lock_release (&wait_lock);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+
+  /* The child copies our state, so we must not change it (or
+     return, freeing INFO) until the child is done copying. */
+  sema_down (&info.done);
+  if (!info.success)
+    {
+      /* Reap the child, which is on its way out. */
+      process_wait (tid);
+      return TID_ERROR;
+    }
+  return tid;
+}
+
+/* A thread function that makes the running thread a copy of the
+   process that forked it and starts it running. */
+static void
+start_fork (void *info_) 
+{
+  struct fork_info *info = info_;
+  struct thread *parent = info->parent;
+  struct thread *t = thread_current ();
+  struct intr_frame if_ = info->if_;
+  bool success = false;
+
+  t->child = info->child;
+
+  t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL)
+    goto done;
+  process_activate ();
+#ifdef VM
+  if (!page_table_init ())
+    goto done;
+  t->exec_file = file_reopen (parent->exec_file);
+  if (t->exec_file == NULL)
+    goto done;
+  file_deny_write (t->exec_file);
+  if (!mmap_fork (parent) || !page_fork (parent))
+    goto done;
+#endif
+  t->heap_start = parent->heap_start;
+  t->brk = parent->brk;
+  t->heap_end = parent->heap_end;
+
+  /* Map our own clock page first, so that pagedir_fork() leaves
+     the parent's alone. */
+  success = (map_clock_page ()
+             && pagedir_fork (t->pagedir, parent->pagedir)
+             && syscall_fork (parent)
+             && shm_fork (parent)
+             && fpu_fork (parent));
+
+ done:
+  /* INFO is gone once the parent wakes up. */
+  info->success = success;
+  sema_up (&info->done);
+  if (!success)
+    thread_exit ();
+
+  /* Return 0 from fork() in the child. */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Starts a new thread in the running process, sharing its
+   memory and open files, that begins running in user mode at
+   EIP with its stack pointer at ESP.  Returns the new thread's
+   id, or TID_ERROR if it cannot be created or the process is
+   exiting. */
+tid_t
+process_thread_create (void (*eip) (void), void *esp) 
+{
+  struct thread *cur = thread_current ();
+  struct thread_group *g = cur->group;
+  struct uthread *u;
+  tid_t tid;
+
+  if (g == NULL)
+    {
+      /* Only the leader runs until the group exists. */
+      g = malloc (sizeof *g);
+      if (g == NULL)
+        return TID_ERROR;
+      g->leader = cur;
+      lock_init (&g->lock);
+      list_init (&g->uthreads);
+      g->live_cnt = 0;
+      g->dying = false;
+      sema_init (&g->idle, 0);
+      cur->group = g;
+    }
+
+  u = malloc (sizeof *u);
+  if (u == NULL)
     return TID_ERROR;
-  strlcpy (fn_copy, file_name, PGSIZE);
+  u->group = g;
+  u->status = -1;
+  sema_init (&u->exited, 0);
+  u->eip = eip;
+  u->esp = esp;
+
+  lock_acquire (&g->lock);
+  if (g->dying)
+    tid = TID_ERROR;
+  else
+    {
+      tid = thread_create (thread_name (), thread_get_priority (),
+                           start_uthread, u);
+      if (tid != TID_ERROR)
+        {
+          u->tid = tid;
+          list_push_back (&g->uthreads, &u->elem);
+          g->live_cnt++;
+        }
+    }
+  lock_release (&g->lock);
 
-  /* Create a new thread to execute FILE_NAME. */
-  tid = thread_create (file_name, PRI_DEFAULT, start_process, fn_copy);
   if (tid == TID_ERROR)
-    palloc_free_page (fn_copy); 
+    free (u);
   return tid;
 }
 
+/* A thread function that joins the running thread to the
+   process described by UTHREAD_ and starts it in user mode. */
+static void
+start_uthread (void *uthread_) 
+{
+  struct uthread *u = uthread_;
+  struct thread *t = thread_current ();
+  struct intr_frame if_;
+
+  t->leader = u->group->leader;
+  t->group = u->group;
+  t->uthread = u;
+  t->pagedir = t->leader->pagedir;
+  process_activate ();
+
+  memset (&if_, 0, sizeof if_);
+  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+  if_.cs = SEL_UCSEG;
+  if_.eflags = FLAG_IF | FLAG_MBS;
+  if_.eip = u->eip;
+  if_.esp = u->esp;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Waits for thread TID of the running process, other than its
+   leader, to exit and returns its exit status.  Returns -1 at
+   once if TID is not such a thread, is the caller, or has
+   already been joined. */
+int
+process_thread_join (tid_t tid) 
+{
+  struct thread *cur = thread_current ();
+  struct thread_group *g = cur->group;
+  struct uthread *u = NULL;
+  struct list_elem *e;
+  int status;
+
+  if (g == NULL)
+    return -1;
+
+  lock_acquire (&g->lock);
+  for (e = list_begin (&g->uthreads); e != list_end (&g->uthreads);
+       e = list_next (e))
+    if (list_entry (e, struct uthread, elem)->tid == tid)
+      {
+        u = list_entry (e, struct uthread, elem);
+        break;
+      }
+  if (u == NULL || u == cur->uthread)
+    {
+      lock_release (&g->lock);
+      return -1;
+    }
+  list_remove (&u->elem);
+  lock_release (&g->lock);
+
+  /* The thread ups U->exited holding the lock, so once we hold
+     it, the thread is done with U. */
+  sema_down (&u->exited);
+  lock_acquire (&g->lock);
+  lock_release (&g->lock);
+
+  status = u->status;
+  free (u);
+  return status;
+}
+
+/* Marks the running thread's process for teardown with exit
+   status -1, because one of its threads is being killed.  The
+   others exit on their way back to user mode. */
+void
+process_abort (void) 
+{
+  struct thread *cur = thread_current ();
+  struct thread_group *g = cur->group;
+
+  if (g == NULL)
+    return;
+  lock_acquire (&g->lock);
+  if (!g->dying)
+    {
+      g->dying = true;
+      g->leader->exit_status = -1;
+    }
+  lock_release (&g->lock);
+  futex_wake_all (cur->pagedir);
+  lock_acquire (&wait_lock);
+  cond_broadcast (&g->leader->child_exited, &wait_lock);
+  poll_wake (&g->leader->child_pollers);
+  lock_release (&wait_lock);
+}
+
+/* Called with interrupts off on each return to user mode of a
+   thread whose process has more than one thread.  Exits the
+   running thread if its process is being torn down. */
+void
+process_check_dying (void) 
+{
+  if (thread_current ()->group->dying)
+    {
+      intr_enable ();
+      thread_exit ();
+    }
+}
+
+/* Ends the running thread, which is not its process's leader,
+   recording its exit status for process_thread_join(). */
+static void
+exit_uthread (void) 
+{
+  struct thread *cur = thread_current ();
+  struct thread_group *g = cur->group;
+  struct uthread *u = cur->uthread;
+
+  /* Let go of the page directory, and everything else of the
+     leader's, before the leader can free it. */
+  cur->pagedir = NULL;
+  cur->leader = cur;
+  pagedir_activate (NULL);
+
+  lock_acquire (&g->lock);
+  u->status = cur->exit_status;
+  sema_up (&u->exited);
+  if (--g->live_cnt == 0 && g->dying)
+    sema_up (&g->idle);
+  lock_release (&g->lock);
+}
+
+/* Tears down the running thread's group, of which it is the
+   leader: stops the other threads, waits for them to exit, and
+   frees the group. */
+static void
+end_group (void) 
+{
+  struct thread *cur = thread_current ();
+  struct thread_group *g = cur->group;
+  bool wait;
+
+  lock_acquire (&g->lock);
+  g->dying = true;
+  wait = g->live_cnt > 0;
+  lock_release (&g->lock);
+
+  /* Threads asleep on a futex, waiting for a child, or polling
+     would never notice. */
+  futex_wake_all (cur->pagedir);
+  lock_acquire (&wait_lock);
+  cond_broadcast (&cur->child_exited, &wait_lock);
+  poll_wake (&cur->child_pollers);
+  lock_release (&wait_lock);
+  if (wait)
+    sema_down (&g->idle);
+  lock_acquire (&g->lock);
+  lock_release (&g->lock);
+
+  while (!list_empty (&g->uthreads))
+    free (list_entry (list_pop_front (&g->uthreads), struct uthread, elem));
+  free (g);
+  cur->group = NULL;
+}
+
+/* Adds the time since START to PHASE's statistics and returns
+   the current time, to start timing the next phase. */
+static uint64_t
+exec_phase_done (enum exec_phase phase, uint64_t start) 
+{
+  uint64_t now = timer_cycles ();
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  exec_stats[phase].cnt++;
+  exec_stats[phase].cycles += now - start;
+  intr_set_level (old_level);
+  return now;
+}
+
+/* Prints how long each phase of starting a process took. */
+void
+process_print_stats (void) 
+{
+  int i;
+
+  for (i = 0; i < EXEC_PHASE_CNT; i++)
+    if (exec_stats[i].cnt != 0)
+      printf ("Exec: %s %llu times, %llu ns total\n",
+              exec_phase_names[i], exec_stats[i].cnt,
+              timer_cycles_to_ns (exec_stats[i].cycles));
+}
+
+/* Splits SRC into words separated by spaces, packing them into
+   CL in a single pass.  Returns false if SRC has no words, more
+   than ARGV_MAX words, or too many characters. */
+static bool
+parse_cmdline (struct cmdline *cl, const char *src)
+{
+  char *dst = cl->str;
+  char *end = cl->str + CMDLINE_STR_MAX;
+
+  cl->argc = 0;
+  for (;;)
+    {
+      while (*src == ' ')
+        src++;
+      if (*src == '\0')
+        break;
+
+      if (cl->argc >= (int) ARGV_MAX)
+        return false;
+      cl->argv[cl->argc++] = dst - cl->str;
+      while (*src != ' ' && *src != '\0')
+        {
+          if (dst >= end - 1)
+            return false;
+          *dst++ = *src++;
+        }
+      *dst++ = '\0';
+    }
+  cl->len = dst - cl->str;
+  return cl->argc > 0;
+}
+
 /* A thread function that loads a user process and starts it
    running. */
 static void
-start_process (void *file_name_)
+start_process (void *cl_)
 {
-  char *file_name = file_name_;
+  struct cmdline *cl = cl_;
   struct intr_frame if_;
   bool success;
 
+  thread_current ()->child = cl->child;
+  exec_phase_done (EXEC_SCHEDULE, cl->spawned);
+
   /* Initialize interrupt frame and load executable. */
   memset (&if_, 0, sizeof if_);
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
-  success = load (file_name, &if_.eip, &if_.esp);
+  success = load (cl, &if_.eip, &if_.esp);
 
   /* If load failed, quit. */
-  palloc_free_page (file_name);
+  palloc_free_page (cl);
   if (!success) 
     thread_exit ();
 
@@ -76,19 +720,317 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
-/* Waits for thread TID to die and returns its exit status.  If
-   it was terminated by the kernel (i.e. killed due to an
-   exception), returns -1.  If TID is invalid or if it was not a
-   child of the calling process, or if process_wait() has already
-   been successfully called for the given TID, returns -1
-   immediately, without waiting.
+/* Returns a new exit record for a child of the running
+   process, or a null pointer if memory is short.  The caller
+   must fill in its tid, holding wait_lock, before the child can
+   exit. */
+static struct child *
+add_child (void) 
+{
+  struct thread *parent = thread_current ()->leader;
+  struct child *c = malloc (sizeof *c);
+
+  if (c == NULL)
+    return NULL;
+  c->parent = parent;
+  c->tid = TID_ERROR;
+  c->exit_status = -1;
+  c->exited = false;
+  c->claimed = false;
+  lock_acquire (&wait_lock);
+  list_push_back (&parent->children, &c->elem);
+  lock_release (&wait_lock);
+  return c;
+}
+
+/* Removes exit record C, whose child never ran, from its parent
+   and frees it.  The caller must hold wait_lock. */
+static void
+remove_child (struct child *c) 
+{
+  list_remove (&c->elem);
+  free (c);
+}
+
+/* Returns true if the running thread is one of several in a
+   process that is being torn down. */
+bool
+process_dying (void) 
+{
+  struct thread_group *g = thread_current ()->group;
+
+  return g != NULL && g->dying;
+}
 
-   This function will be implemented in problem 2-2.  For now, it
-   does nothing. */
+/* Waits for child process TID of the running process to die and
+   returns its exit status.  If it was terminated by the kernel
+   (i.e. killed due to an exception), returns -1.  If TID is
+   invalid or if it was not a child of the calling process, or if
+   process_wait() has already been successfully called for the
+   given TID, returns -1 immediately, without waiting. */
 int
-process_wait (tid_t child_tid UNUSED) 
+process_wait (tid_t child_tid) 
+{
+  struct thread *parent = thread_current ()->leader;
+  struct child *c = NULL;
+  struct list_elem *e;
+  int status = -1;
+
+  lock_acquire (&wait_lock);
+  for (e = list_begin (&parent->children); e != list_end (&parent->children);
+       e = list_next (e))
+    if (list_entry (e, struct child, elem)->tid == child_tid)
+      {
+        c = list_entry (e, struct child, elem);
+        break;
+      }
+  if (c == NULL)
+    {
+      lock_release (&wait_lock);
+      return -1;
+    }
+
+  /* Take the record off the lists, so that no one else waits
+     for this child. */
+  list_remove (&c->elem);
+  if (c->exited)
+    list_remove (&c->exit_elem);
+  c->claimed = true;
+
+  while (!c->exited && !process_dying ())
+    cond_wait (&parent->child_exited, &wait_lock);
+  if (c->exited)
+    {
+      status = c->exit_status;
+      add_usage (&parent->child_usage, &c->usage);
+      free (c);
+    }
+  else
+    {
+      /* Our process is exiting.  Leave the child to the leader. */
+      c->claimed = false;
+      list_push_back (&parent->children, &c->elem);
+    }
+  lock_release (&wait_lock);
+  return status;
+}
+
+/* Waits for any child process of the running process to die,
+   reaps it, stores its exit status in *STATUS, and returns its
+   tid.  Children are reaped in the order they exit.  Returns
+   TID_ERROR at once if the process has no unreaped children that
+   no other thread is waiting for. */
+tid_t
+process_wait_any (int *status) 
+{
+  struct thread *parent = thread_current ()->leader;
+  struct child *c;
+  tid_t tid;
+
+  lock_acquire (&wait_lock);
+  while (list_empty (&parent->exited))
+    if (list_empty (&parent->children) || process_dying ())
+      {
+        lock_release (&wait_lock);
+        return TID_ERROR;
+      }
+    else
+      cond_wait (&parent->child_exited, &wait_lock);
+
+  c = list_entry (list_pop_front (&parent->exited), struct child, exit_elem);
+  list_remove (&c->elem);
+  tid = c->tid;
+  *status = c->exit_status;
+  add_usage (&parent->child_usage, &c->usage);
+  free (c);
+  lock_release (&wait_lock);
+  return tid;
+}
+
+/* Returns 1 if child process TID of the running process, or any
+   of its children if TID is TID_ERROR, has exited and can be
+   reaped, 0 if not yet, or -1 if there is no such child, or no
+   children at all, for wait() to reap. */
+int
+process_child_ready (tid_t tid) 
+{
+  struct thread *parent = thread_current ()->leader;
+  struct list_elem *e;
+  int ready = -1;
+
+  lock_acquire (&wait_lock);
+  if (tid == TID_ERROR)
+    {
+      if (!list_empty (&parent->exited))
+        ready = 1;
+      else if (!list_empty (&parent->children))
+        ready = 0;
+    }
+  else
+    for (e = list_begin (&parent->children);
+         e != list_end (&parent->children); e = list_next (e))
+      {
+        struct child *c = list_entry (e, struct child, elem);
+        if (c->tid == tid)
+          {
+            ready = c->exited;
+            break;
+          }
+      }
+  lock_release (&wait_lock);
+  return ready;
+}
+
+/* Hooks poller P onto the queue of pollers woken when a child of
+   the running process exits, or when the process is torn
+   down. */
+void
+process_poll_children (struct poller *p) 
+{
+  poller_add (p, &thread_current ()->leader->child_pollers);
+}
+
+/* Leaves the running process's exit status in its exit record
+   and wakes its parent. */
+static void
+notify_parent (void) 
+{
+  struct thread *cur = thread_current ();
+  struct child *c = cur->child;
+
+  if (c == NULL)
+    return;
+  cur->child = NULL;
+
+  lock_acquire (&wait_lock);
+  c->exit_status = cur->exit_status;
+  c->usage = cur->usage;
+  add_usage (&c->usage, &cur->child_usage);
+  c->exited = true;
+  if (c->parent == NULL)
+    free (c);
+  else
+    {
+      if (!c->claimed)
+        list_push_back (&c->parent->exited, &c->exit_elem);
+      cond_broadcast (&c->parent->child_exited, &wait_lock);
+      poll_wake (&c->parent->child_pollers);
+    }
+  lock_release (&wait_lock);
+}
+
+/* Lets go of the exit records of the running process's
+   children, freeing those of children that have exited. */
+static void
+release_children (void) 
+{
+  struct thread *cur = thread_current ();
+
+  lock_acquire (&wait_lock);
+  while (!list_empty (&cur->children))
+    {
+      struct child *c = list_entry (list_pop_front (&cur->children),
+                                    struct child, elem);
+      if (c->exited)
+        free (c);
+      else
+        c->parent = NULL;
+    }
+  list_init (&cur->exited);
+  lock_release (&wait_lock);
+}
+
+/* Frees the page directory and supplemental page table in R,
+   and R itself. */
+static void
+free_remains (struct remains *r) 
+{
+#ifdef VM
+  page_table_destroy (&r->pages, r->pd);
+#endif
+  pagedir_destroy (r->pd);
+  free (r);
+}
+
+/* Frees all the remains pending, in one batch.  reap_lock must
+   be held; it is released while freeing. */
+static void
+reap_batch (void) 
+{
+  struct list batch;
+
+  ASSERT (lock_held_by_current_thread (&reap_lock));
+  list_init (&batch);
+  list_splice (list_end (&batch), list_begin (&remains_list),
+               list_end (&remains_list));
+  reaping++;
+  lock_release (&reap_lock);
+
+  while (!list_empty (&batch))
+    free_remains (list_entry (list_pop_front (&batch),
+                              struct remains, elem));
+
+  lock_acquire (&reap_lock);
+  reaping--;
+  cond_broadcast (&reaped, &reap_lock);
+}
+
+/* Work queue job that frees pending remains. */
+static void
+reap (void *aux UNUSED) 
 {
-  return -1;
+  lock_acquire (&reap_lock);
+  reap_queued = false;
+  while (!list_empty (&remains_list))
+    reap_batch ();
+  lock_release (&reap_lock);
+}
+
+/* Returns once no remains are pending or being freed, freeing
+   pending ones in this thread rather than waiting on the
+   low-priority reaper. */
+static void
+reap_wait (void) 
+{
+  lock_acquire (&reap_lock);
+  while (!list_empty (&remains_list) || reaping > 0)
+    if (!list_empty (&remains_list))
+      reap_batch ();
+    else
+      cond_wait (&reaped, &reap_lock);
+  lock_release (&reap_lock);
+}
+
+/* Hands page directory PD of the running process, which must no
+   longer be active, and its supplemental page table to the
+   reaper.  Frees them at once if memory is too short to queue
+   them. */
+static void
+defer_teardown (uint32_t *pd) 
+{
+  struct remains *r = malloc (sizeof *r);
+
+  if (r == NULL)
+    {
+#ifdef VM
+      page_table_destroy (&thread_current ()->pages, pd);
+#endif
+      pagedir_destroy (pd);
+      return;
+    }
+  r->pd = pd;
+#ifdef VM
+  r->pages = thread_current ()->pages;
+#endif
+
+  lock_acquire (&reap_lock);
+  list_push_back (&remains_list, &r->elem);
+  if (!reap_queued)
+    {
+      reap_queued = true;
+      workqueue_queue (WQ_LOW, &reap_work);
+    }
+  lock_release (&reap_lock);
 }
 
 /* Free the current process's resources. */
@@ -98,34 +1040,85 @@ process_exit (void)
   struct thread *cur = thread_current ();
   uint32_t *pd;
 
-  /* Destroy the current process's page directory and switch back
-     to the kernel-only page directory. */
+  /* A thread other than the leader owns nothing. */
+  if (cur->uthread != NULL)
+    {
+      exit_uthread ();
+      return;
+    }
+  if (cur->group != NULL)
+    end_group ();
+
+  /* Close the process's files.  A kernel thread has none. */
+  syscall_exit ();
+
+  /* Switch back to the kernel-only page directory and leave the
+     current process's page directory to the reaper. */
   pd = cur->pagedir;
   if (pd != NULL) 
     {
+      printf ("%s: exit(%d)\n", cur->name, cur->exit_status);
+
       /* Correct ordering here is crucial.  We must set
          cur->pagedir to NULL before switching page directories,
          so that a timer interrupt can't switch back to the
          process page directory.  We must activate the base page
-         directory before destroying the process's page
-         directory, or our active page directory will be one
+         directory before the process's page directory is
+         destroyed, or our active page directory will be one
          that's been freed (and cleared). */
+#ifdef VM
+      /* Write back mapped files now, so that the parent sees
+         them once it learns of the exit. */
+      mmap_exit ();
+#endif
+      pagedir_resident (pd, &cur->usage.rss_max);
+      if (process_print_usage)
+        print_usage (cur);
+
+      cur->clock = NULL;
       cur->pagedir = NULL;
       pagedir_activate (NULL);
-      pagedir_destroy (pd);
+      defer_teardown (pd);
     }
+  shm_exit ();
+  aio_exit ();
+
+#ifdef VM
+  file_close (cur->exec_file);
+  cur->exec_file = NULL;
+#endif
+
+  /* Now that everything is released, let the parent know. */
+  release_children ();
+  notify_parent ();
 }
 
 /* Sets up the CPU for running user code in the current
    thread.
-   This function is called on every context switch. */
+   This function is called on every context switch.
+
+   A kernel thread uses only kernel mappings, which every page
+   directory shares, and never enters the kernel from user mode.
+   So it just borrows whatever page directory is loaded and
+   leaves the TSS alone, and switching from a process to a kernel
+   thread and back costs neither a CR3 reload nor the TLB. */
 void
 process_activate (void)
 {
   struct thread *t = thread_current ();
 
-  /* Activate thread's page tables. */
-  pagedir_activate (t->pagedir);
+  if (t->pagedir == NULL)
+    return;
+
+  /* Activate thread's page tables, unless they are already
+     loaded. */
+  if (pagedir_active () != t->pagedir)
+    pagedir_activate (t->pagedir);
+
+  /* The clock page went stale while the process was not
+     running. */
+  if (t->leader->clock != NULL)
+    refresh_clock (t->leader->clock);
 
   /* Set thread's kernel stack for use in processing
      interrupts. */
@@ -195,24 +1188,49 @@ struct Elf32_Phdr
 #define PF_W 2          /* Writable. */
 #define PF_R 4          /* Readable. */
 
-static bool setup_stack (void **esp);
+static bool setup_stack (const struct cmdline *, void **esp);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
 
-/* Loads an ELF executable from FILE_NAME into the current thread.
+/* A loadable segment, as load_segment() takes it. */
+struct exec_segment
+  {
+    uint32_t file_page;         /* Page-aligned offset in file. */
+    uint32_t mem_page;          /* Page-aligned user address. */
+    uint32_t read_bytes;        /* Bytes to read from the file. */
+    uint32_t zero_bytes;        /* Bytes to zero after them. */
+    bool writable;              /* Writable by the process? */
+  };
+
+/* An executable's parsed and validated headers.  Parsing is done
+   once per executable and the result cached on its inode, so
+   that later execs of the same file skip the header reads and
+   checks. */
+struct exec_info
+  {
+    Elf32_Addr entry;           /* Entry point. */
+    int seg_cnt;                /* Number of segments. */
+    struct exec_segment segs[]; /* Segments to load. */
+  };
+
+static struct exec_info *get_exec_info (struct file *);
+
+/* Loads an ELF executable named by the first word of CL into
+   the current thread, with CL's words as its arguments.
    Stores the executable's entry point into *EIP
    and its initial stack pointer into *ESP.
    Returns true if successful, false otherwise. */
 bool
-load (const char *file_name, void (**eip) (void), void **esp) 
+load (const struct cmdline *cl, void (**eip) (void), void **esp) 
 {
+  const char *file_name = cl->str;
   struct thread *t = thread_current ();
-  struct Elf32_Ehdr ehdr;
-  struct file *file = NULL;
-  off_t file_ofs;
+  const struct exec_info *info;
+  struct file *file = cl->file;
   bool success = false;
+  uint64_t stamp = timer_cycles ();
   int i;
 
   /* Allocate and activate page directory. */
@@ -220,42 +1238,156 @@ load (const char *file_name, void (**eip) (void), void **esp)
   if (t->pagedir == NULL) 
     goto done;
   process_activate ();
+#ifdef VM
+  if (!page_table_init ())
+    goto done;
+#endif
+  stamp = exec_phase_done (EXEC_PAGEDIR, stamp);
 
-  /* Open executable file. */
-  file = filesys_open (file_name);
+  /* Open executable file, unless process_execute() already has.
+     Denying writes keeps the cached headers valid while we use
+     them. */
+  if (file == NULL)
+    file = filesys_open (file_name);
   if (file == NULL) 
     {
       printf ("load: %s: open failed\n", file_name);
       goto done; 
     }
+  file_deny_write (file);
+  stamp = exec_phase_done (EXEC_OPEN, stamp);
+
+  /* Get the executable's headers. */
+  info = get_exec_info (file);
+  if (info == NULL)
+    {
+      printf ("load: %s: error loading executable\n", file_name);
+      goto done; 
+    }
+  stamp = exec_phase_done (EXEC_PARSE, stamp);
+
+  /* Load segments.  The heap starts after the last one. */
+  for (i = 0; i < info->seg_cnt; i++) 
+    {
+      const struct exec_segment *seg = &info->segs[i];
+      uint8_t *end;
+
+      if (!load_segment (file, seg->file_page, (void *) seg->mem_page,
+                         seg->read_bytes, seg->zero_bytes, seg->writable))
+        goto done;
+      end = (uint8_t *) seg->mem_page + seg->read_bytes + seg->zero_bytes;
+      if (end > t->brk)
+        t->heap_start = t->brk = t->heap_end = end;
+    }
+  stamp = exec_phase_done (EXEC_LOAD, stamp);
+
+  /* Set up stack. */
+  if (!setup_stack (cl, esp) || !map_clock_page ())
+    goto done;
+  exec_phase_done (EXEC_STACK, stamp);
+
+  /* Start address. */
+  *eip = (void (*) (void)) info->entry;
+
+  success = true;
+
+ done:
+  /* We arrive here whether the load is successful or not. */
+#ifdef VM
+  /* Segments are read on demand, so keep the executable open
+     until the process exits. */
+  if (success)
+    t->exec_file = file;
+  else
+#endif
+    file_close (file);
+  return success;
+}
+
+/* Bytes at the start of an executable that open_exec() reads
+   ahead: the ELF headers and the code that the linker puts right
+   after them.  As much as cache_prefetch()'s queue holds. */
+#define EXEC_PREFETCH_BYTES (16 * 1024)
+
+/* Opens the executable named FILE_NAME for a new process, denying
+   writes to it, and asks for its first EXEC_PREFETCH_BYTES, and
+   the page holding its entry point if its headers were parsed by
+   an earlier exec, to be read into the buffer cache in the
+   background, so that load() in the new thread finds them there.
+   Returns the file, or a null pointer if it cannot be opened, in
+   which case load() tries again and reports the failure. */
+static struct file *
+open_exec (const char *file_name) 
+{
+  struct file *file = filesys_open (file_name);
+  const struct exec_info *info;
+  struct inode *inode;
+  int i;
+
+  if (file == NULL)
+    return NULL;
+  file_deny_write (file);
+  inode = file_get_inode (file);
+  info = inode_get_exec_data (inode);
+  for (i = 0; info != NULL && i < info->seg_cnt; i++)
+    {
+      const struct exec_segment *seg = &info->segs[i];
+      uint32_t ofs = info->entry - seg->mem_page;
+
+      if (info->entry >= seg->mem_page && ofs < seg->read_bytes)
+        inode_prefetch (inode, seg->file_page + (ofs & ~PGMASK), PGSIZE);
+    }
+  inode_prefetch (inode, 0, EXEC_PREFETCH_BYTES);
+  return file;
+}
+
+/* Returns FILE's parsed headers, from the cache on its inode if
+   possible, otherwise by reading and validating them and caching
+   the result.  FILE must have writes denied.  Returns a null
+   pointer if FILE is not a valid executable. */
+static struct exec_info *
+get_exec_info (struct file *file) 
+{
+  struct inode *inode = file_get_inode (file);
+  struct Elf32_Ehdr ehdr;
+  struct Elf32_Phdr *phdrs = NULL;
+  struct exec_info *info = NULL;
+  size_t phdrs_size;
+  int i;
+
+  info = inode_get_exec_data (inode);
+  if (info != NULL)
+    return info;
 
   /* Read and verify executable header. */
-  if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
+  if (file_read_at (file, &ehdr, sizeof ehdr, 0) != sizeof ehdr
       || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
       || ehdr.e_type != 2
       || ehdr.e_machine != 3
       || ehdr.e_version != 1
       || ehdr.e_phentsize != sizeof (struct Elf32_Phdr)
+      || ehdr.e_phnum == 0
       || ehdr.e_phnum > 1024) 
-    {
-      printf ("load: %s: error loading executable\n", file_name);
-      goto done; 
-    }
+    return NULL;
+
+  /* Read all the program headers at once. */
+  phdrs_size = ehdr.e_phnum * sizeof *phdrs;
+  if (ehdr.e_phoff > (Elf32_Off) file_length (file))
+    return NULL;
+  phdrs = malloc (phdrs_size);
+  info = malloc (sizeof *info + ehdr.e_phnum * sizeof *info->segs);
+  if (phdrs == NULL || info == NULL
+      || file_read_at (file, phdrs, phdrs_size, ehdr.e_phoff)
+         != (off_t) phdrs_size)
+    goto error;
 
-  /* Read program headers. */
-  file_ofs = ehdr.e_phoff;
+  info->entry = ehdr.e_entry;
+  info->seg_cnt = 0;
   for (i = 0; i < ehdr.e_phnum; i++) 
     {
-      struct Elf32_Phdr phdr;
-
-      if (file_ofs < 0 || file_ofs > file_length (file))
-        goto done;
-      file_seek (file, file_ofs);
+      struct Elf32_Phdr *phdr = &phdrs[i];
 
-      if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-        goto done;
-      file_ofs += sizeof phdr;
-      switch (phdr.p_type) 
+      switch (phdr->p_type) 
         {
         case PT_NULL:
         case PT_NOTE:
@@ -267,53 +1399,47 @@ load (const char *file_name, void (**eip) (void), void **esp)
         case PT_DYNAMIC:
         case PT_INTERP:
         case PT_SHLIB:
-          goto done;
+          goto error;
         case PT_LOAD:
-          if (validate_segment (&phdr, file)) 
+          if (validate_segment (phdr, file)) 
             {
-              bool writable = (phdr.p_flags & PF_W) != 0;
-              uint32_t file_page = phdr.p_offset & ~PGMASK;
-              uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
-              uint32_t page_offset = phdr.p_vaddr & PGMASK;
-              uint32_t read_bytes, zero_bytes;
-              if (phdr.p_filesz > 0)
+              struct exec_segment *seg = &info->segs[info->seg_cnt++];
+              uint32_t page_offset = phdr->p_vaddr & PGMASK;
+
+              seg->writable = (phdr->p_flags & PF_W) != 0;
+              seg->file_page = phdr->p_offset & ~PGMASK;
+              seg->mem_page = phdr->p_vaddr & ~PGMASK;
+              if (phdr->p_filesz > 0)
                 {
                   /* Normal segment.
                      Read initial part from disk and zero the rest. */
-                  read_bytes = page_offset + phdr.p_filesz;
-                  zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
-                                - read_bytes);
+                  seg->read_bytes = page_offset + phdr->p_filesz;
+                  seg->zero_bytes = (ROUND_UP (page_offset + phdr->p_memsz,
+                                               PGSIZE)
+                                     - seg->read_bytes);
                 }
               else 
                 {
                   /* Entirely zero.
                      Don't read anything from disk. */
-                  read_bytes = 0;
-                  zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
+                  seg->read_bytes = 0;
+                  seg->zero_bytes = ROUND_UP (page_offset + phdr->p_memsz,
+                                              PGSIZE);
                 }
-              if (!load_segment (file, file_page, (void *) mem_page,
-                                 read_bytes, zero_bytes, writable))
-                goto done;
             }
           else
-            goto done;
+            goto error;
           break;
         }
     }
+  free (phdrs);
 
-  /* Set up stack. */
-  if (!setup_stack (esp))
-    goto done;
-
-  /* Start address. */
-  *eip = (void (*) (void)) ehdr.e_entry;
-
-  success = true;
+  return inode_set_exec_data (inode, info);
 
- done:
-  /* We arrive here whether the load is successful or not. */
-  file_close (file);
-  return success;
+ error:
+  free (phdrs);
+  free (info);
+  return NULL;
 }
 
 /* load() helpers. */
@@ -377,6 +1503,9 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With VM, the pages are only recorded in the supplemental page
+   table and are read or zeroed when first touched.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -387,6 +1516,24 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifdef VM
+  /* Just record where each page comes from.  page_in() reads it
+     on first access. */
+  while (read_bytes > 0 || zero_bytes > 0) 
+    {
+      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+      size_t page_zero_bytes = PGSIZE - page_read_bytes;
+
+      if (!page_add_file (upage, file, ofs, page_read_bytes, writable))
+        return false;
+
+      /* Advance. */
+      read_bytes -= page_read_bytes;
+      zero_bytes -= page_zero_bytes;
+      ofs += page_read_bytes;
+      upage += PGSIZE;
+    }
+#else
   file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
@@ -421,27 +1568,58 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       zero_bytes -= page_zero_bytes;
       upage += PGSIZE;
     }
+#endif
   return true;
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
+   user virtual memory, and lay out CL's words on it as the
+   arguments to main(): the packed strings at the very top, then
+   the argv[] array, argv, argc, and a null return address. */
 static bool
-setup_stack (void **esp) 
+setup_stack (const struct cmdline *cl, void **esp) 
 {
   uint8_t *kpage;
-  bool success = false;
+  uint8_t *str, *top;
+  uint32_t *sp, *argv;
+  size_t ptr_cnt;
+  int i;
+
+  /* The pointers below the strings: argv[0..argc], argv, argc,
+     and the return address. */
+  ptr_cnt = cl->argc + 4;
+  if (ROUND_UP (cl->len, sizeof (uint32_t)) + ptr_cnt * sizeof (uint32_t)
+      > PGSIZE)
+    return false;
 
   kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-  if (kpage != NULL) 
+  if (kpage == NULL)
+    return false;
+  if (!install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true))
     {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success)
-        *esp = PHYS_BASE;
-      else
-        palloc_free_page (kpage);
+      palloc_free_page (kpage);
+      return false;
     }
-  return success;
+
+  /* The strings are already packed the way they go on the stack.
+     TOP is the user address corresponding to STR. */
+  top = kpage + PGSIZE;
+  str = top - cl->len;
+  memcpy (str, cl->str, cl->len);
+
+  /* Word-align and fill in the pointers in one pass, directly in
+     the kernel mapping of the page. */
+  sp = (uint32_t *) ((uintptr_t) str & ~(sizeof (uint32_t) - 1)) - ptr_cnt;
+  argv = sp + 3;
+  for (i = 0; i < cl->argc; i++)
+    argv[i] = (uintptr_t) PHYS_BASE - cl->len + cl->argv[i];
+  argv[cl->argc] = 0;
+  sp[2] = (uintptr_t) PHYS_BASE - (top - (uint8_t *) argv);
+  sp[1] = cl->argc;
+  sp[0] = 0;
+
+  *esp = (uint8_t *) PHYS_BASE - (top - (uint8_t *) sp);
+  return true;
 }
 
 /* Adds a mapping from user virtual address UPAGE to kernel
@@ -463,3 +1641,266 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+
+/* Maps a fresh clock page into the running process at
+   CLOCK_PAGE.  Returns false if memory is short. */
+static bool
+map_clock_page (void) 
+{
+  struct thread *t = thread_current ();
+  struct clock_page *c = palloc_get_page (PAL_USER | PAL_ZERO);
+
+  if (c == NULL)
+    return false;
+  if (!install_page ((void *) CLOCK_PAGE, c, false))
+    {
+      palloc_free_page (c);
+      return false;
+    }
+  c->freq = TIMER_FREQ;
+  refresh_clock (c);
+  t->clock = c;
+  return true;
+}
+
+/* Brings the system-wide members of clock page C up to date. */
+static void
+refresh_clock (struct clock_page *c) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  c->seq++;
+  barrier ();
+  c->ticks = timer_ticks ();
+  c->load_avg = thread_get_load_avg ();
+  barrier ();
+  c->seq++;
+  intr_set_level (old_level);
+}
+
+/* Called by the timer interrupt handler at each timer tick,
+   which interrupted user code if USER is true.  Brings the
+   running process's clock page up to date and charges it for the
+   tick. */
+void
+process_tick (bool user) 
+{
+  struct thread *t = thread_current ();
+  struct clock_page *c = t->leader->clock;
+
+  if (t->pagedir != NULL)
+    {
+      if (user)
+        t->leader->usage.user_ticks++;
+      else
+        t->leader->usage.kernel_ticks++;
+    }
+  if (c != NULL)
+    {
+      c->seq++;
+      barrier ();
+      c->ticks = timer_ticks ();
+      c->run_ticks++;
+      c->load_avg = thread_get_load_avg ();
+      barrier ();
+      c->seq++;
+    }
+}
+
+/* Returns the totals that the running thread charges, or a null
+   pointer if it is a kernel thread. */
+static struct process_usage *
+current_usage (void) 
+{
+  struct thread *t = thread_current ();
+
+  return t->pagedir != NULL ? &t->leader->usage : NULL;
+}
+
+/* Charges the running process for a page fault, a major one,
+   which read a file or swap, if MAJOR is true. */
+void
+process_count_fault (bool major) 
+{
+  struct process_usage *u = current_usage ();
+  enum intr_level old_level;
+
+  if (u == NULL)
+    return;
+  old_level = intr_disable ();
+  if (major)
+    u->major_faults++;
+  else
+    u->minor_faults++;
+  intr_set_level (old_level);
+}
+
+/* Charges the running process for BYTES bytes written, if WRITE
+   is true, or read, through system calls. */
+void
+process_count_io (bool write, unsigned long long bytes) 
+{
+  struct process_usage *u = current_usage ();
+  enum intr_level old_level;
+
+  if (u == NULL)
+    return;
+  old_level = intr_disable ();
+  if (write)
+    u->write_bytes += bytes;
+  else
+    u->read_bytes += bytes;
+  intr_set_level (old_level);
+}
+
+/* Charges the running process for SECTOR_CNT sectors written to
+   disk, if WRITE is true, or read. */
+void
+process_count_sectors (bool write, size_t sector_cnt) 
+{
+  struct process_usage *u = current_usage ();
+  enum intr_level old_level;
+
+  if (u == NULL)
+    return;
+  old_level = intr_disable ();
+  if (write)
+    u->write_sectors += sector_cnt;
+  else
+    u->read_sectors += sector_cnt;
+  intr_set_level (old_level);
+}
+
+/* Adds the totals in SRC to DST.  DST's peak resident pages
+   become the larger of the two. */
+static void
+add_usage (struct process_usage *dst, const struct process_usage *src) 
+{
+  dst->minor_faults += src->minor_faults;
+  dst->major_faults += src->major_faults;
+  dst->read_bytes += src->read_bytes;
+  dst->write_bytes += src->write_bytes;
+  dst->read_sectors += src->read_sectors;
+  dst->write_sectors += src->write_sectors;
+  dst->user_ticks += src->user_ticks;
+  dst->kernel_ticks += src->kernel_ticks;
+  if (src->rss_max > dst->rss_max)
+    dst->rss_max = src->rss_max;
+}
+
+/* Stores in *U the running process's totals, with its peak
+   resident pages so far, and returns the number of its pages
+   resident now.  If CHILDREN is true, stores instead the totals
+   of the children it has waited for, and their descendants that
+   were waited for in turn, and returns 0. */
+size_t
+process_get_usage (bool children, struct process_usage *u) 
+{
+  struct thread *t = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (t->pagedir != NULL);
+  if (children)
+    {
+      lock_acquire (&wait_lock);
+      *u = t->leader->child_usage;
+      lock_release (&wait_lock);
+      return 0;
+    }
+  old_level = intr_disable ();
+  *u = t->leader->usage;
+  intr_set_level (old_level);
+  return pagedir_resident (t->pagedir, &u->rss_max);
+}
+
+/* Prints the totals of process T, which is exiting. */
+static void
+print_usage (const struct thread *t) 
+{
+  const struct process_usage *u = &t->usage;
+
+  printf ("%s: usage: %zu kB peak resident, %llu minor faults, "
+          "%llu major, %llu bytes read, %llu written, "
+          "%llu sectors read, %llu written, "
+          "%lld user ticks, %lld kernel\n",
+          t->name, u->rss_max * (PGSIZE / 1024), u->minor_faults,
+          u->major_faults, u->read_bytes, u->write_bytes,
+          u->read_sectors, u->write_sectors,
+          u->user_ticks, u->kernel_ticks);
+}
+
+/* Frees LEADER's heap pages from END, which is page-aligned, up
+   to the end of its heap.  The caller must hold brk_lock. */
+static void
+shrink_heap (struct thread *leader, uint8_t *end) 
+{
+  if (end >= leader->heap_end)
+    return;
+#ifdef VM
+  page_remove_range (end, (leader->heap_end - end) / PGSIZE);
+#else
+  {
+    uint8_t *upage;
+
+    for (upage = end; upage < leader->heap_end; upage += PGSIZE)
+      pagedir_unmap (thread_current ()->pagedir, upage);
+  }
+#endif
+  leader->heap_end = end;
+}
+
+/* Moves the running process's break, the end of its heap, by
+   INCREMENT bytes, and returns the old break.  New heap pages
+   read as zeros.  Shrinking the heap frees the pages wholly above
+   the new break.  Returns a null pointer if INCREMENT would move
+   the break below the start of the heap or run the heap into the
+   stack, or if memory is short.  Under VM, the new pages are only
+   recorded, to be paged in when first touched. */
+void *
+process_sbrk (intptr_t increment) 
+{
+  struct thread *leader = thread_current ()->leader;
+  uint8_t *old, *new;
+
+  lock_acquire (&brk_lock);
+  old = leader->brk;
+  new = old + increment;
+  if (increment < 0)
+    {
+      if (new < leader->heap_start || new > old)
+        goto fail;
+      shrink_heap (leader, pg_round_up (new));
+      leader->brk = new;
+      lock_release (&brk_lock);
+      return old;
+    }
+  if (new > HEAP_LIMIT || new < old)
+    goto fail;
+
+  /* Pages added before a failure stay for the next call to use. */
+  while (leader->heap_end < new)
+    {
+#ifdef VM
+      if (!page_add_zero (leader->heap_end, true))
+        goto fail;
+#else
+      uint8_t *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+
+      if (kpage == NULL)
+        goto fail;
+      if (!install_page (leader->heap_end, kpage, true))
+        {
+          palloc_free_page (kpage);
+          goto fail;
+        }
+#endif
+      leader->heap_end += PGSIZE;
+    }
+  leader->brk = new;
+  lock_release (&brk_lock);
+  return old;
+
+ fail:
+  lock_release (&brk_lock);
+  return NULL;
+}
@@ -3,9 +3,37 @@
 
 #include "threads/thread.h"
 
+struct intr_frame;
+struct poller;
+
+/* Most bytes of user stack a process may have.  The stack grows
+   on demand under VM.  Can be overridden in DEFINES. */
+#ifndef STACK_MAX
+#define STACK_MAX (8 * 1024 * 1024)
+#endif
+
+extern bool process_print_usage;
+
+void process_init (void);
 tid_t process_execute (const char *file_name);
+tid_t process_fork (const struct intr_frame *);
 int process_wait (tid_t);
+tid_t process_wait_any (int *status);
+int process_child_ready (tid_t);
+void process_poll_children (struct poller *);
+bool process_dying (void);
+tid_t process_thread_create (void (*eip) (void), void *esp);
+int process_thread_join (tid_t);
+void process_abort (void);
+void process_check_dying (void);
 void process_exit (void);
 void process_activate (void);
+void process_tick (bool user);
+void process_count_fault (bool major);
+void process_count_io (bool write, unsigned long long bytes);
+void process_count_sectors (bool write, size_t sector_cnt);
+size_t process_get_usage (bool children, struct process_usage *);
+void *process_sbrk (intptr_t increment);
+void process_print_stats (void);
 
 #endif /* userprog/process.h */
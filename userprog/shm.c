@@ -0,0 +1,275 @@
+#include "userprog/shm.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/uaccess.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
+
+/* Shared memory segments.
+
+   shm_create() allocates a segment of zeroed frames and gives it
+   an id, and shm_map() maps all of a segment's frames, writable,
+   at an address of the caller's choosing, in as many processes
+   as map it.  What one process writes there, the others see at
+   once, and their futexes on it are shared too (see futex.c).
+
+   Each frame counts its references in the page directory's
+   table of shared frames: one for the segment itself, and one
+   for each page that maps it, which pagedir_destroy() or
+   pagedir_unmap() drops.  The segment in turn is referenced by
+   each process that created or mapped it, through a struct
+   shm_ref on the process's list, until the process exits.  The
+   last reference to a segment takes its id away and drops its
+   frames, which are freed once nothing maps them.
+
+   Under VM the pages go in the supplemental page table as well,
+   as zero pages, so that nothing else is mapped over them.
+   They are never evicted: the clock leaves shared frames
+   alone. */
+
+/* Largest segment, in pages. */
+#define SHM_PAGES_MAX 1024
+
+struct shm_segment
+  {
+    struct list_elem elem;      /* Element in `segments'. */
+    int id;                     /* Identifier. */
+    int ref_cnt;                /* Processes that hold it. */
+    size_t page_cnt;            /* Number of frames. */
+    void **frames;              /* The frames, PAGE_CNT of them. */
+  };
+
+/* A process's hold on a segment. */
+struct shm_ref
+  {
+    struct list_elem elem;      /* Element in thread's `shm_refs'. */
+    struct shm_segment *seg;    /* Segment held. */
+  };
+
+/* All segments, the next id, and the lock for both and for every
+   segment's and process's references. */
+static struct list segments;
+static int next_id;
+static struct lock shm_lock;
+
+/* Initializes shared memory. */
+void
+shm_init (void) 
+{
+  list_init (&segments);
+  lock_init (&shm_lock);
+}
+
+/* Returns the segment with the given ID, or a null pointer.  The
+   caller must hold shm_lock. */
+static struct shm_segment *
+find_segment (int id) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&segments); e != list_end (&segments);
+       e = list_next (e))
+    {
+      struct shm_segment *seg = list_entry (e, struct shm_segment, elem);
+      if (seg->id == id)
+        return seg;
+    }
+  return NULL;
+}
+
+/* Drops the segment's frames and frees SEG, whose first
+   PAGE_CNT frames have been allocated. */
+static void
+free_segment (struct shm_segment *seg, size_t page_cnt) 
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    pagedir_put_page (seg->frames[i]);
+  free (seg->frames);
+  free (seg);
+}
+
+/* Gives the running process a reference to SEG.  Returns false
+   if memory is short.  The caller must hold shm_lock. */
+static bool
+add_ref (struct thread *t, struct shm_segment *seg) 
+{
+  struct shm_ref *r = malloc (sizeof *r);
+
+  if (r == NULL)
+    return false;
+  r->seg = seg;
+  seg->ref_cnt++;
+  list_push_back (&t->leader->shm_refs, &r->elem);
+  return true;
+}
+
+/* Drops reference R and frees it, and its segment if that was
+   the last reference.  The caller must hold shm_lock. */
+static void
+put_ref (struct shm_ref *r) 
+{
+  struct shm_segment *seg = r->seg;
+
+  list_remove (&r->elem);
+  free (r);
+  if (--seg->ref_cnt == 0)
+    {
+      list_remove (&seg->elem);
+      free_segment (seg, seg->page_cnt);
+    }
+}
+
+/* Creates a segment of SIZE bytes, rounded up to whole pages, of
+   zeros, and returns its id, or -1 if SIZE is 0 or too large or
+   memory is short.  The running process holds the segment until
+   it exits. */
+int
+shm_create (size_t size) 
+{
+  size_t page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  struct shm_segment *seg;
+  size_t i;
+  int id;
+
+  if (page_cnt == 0 || page_cnt > SHM_PAGES_MAX)
+    return -1;
+
+  seg = malloc (sizeof *seg);
+  if (seg == NULL)
+    return -1;
+  seg->frames = malloc (page_cnt * sizeof *seg->frames);
+  if (seg->frames == NULL)
+    {
+      free (seg);
+      return -1;
+    }
+  for (i = 0; i < page_cnt; i++)
+    {
+      seg->frames[i] = palloc_get_page (PAL_USER | PAL_ZERO);
+      if (seg->frames[i] == NULL)
+        {
+          free_segment (seg, i);
+          return -1;
+        }
+    }
+  seg->page_cnt = page_cnt;
+  seg->ref_cnt = 0;
+
+  lock_acquire (&shm_lock);
+  if (!add_ref (thread_current (), seg))
+    {
+      lock_release (&shm_lock);
+      free_segment (seg, page_cnt);
+      return -1;
+    }
+  id = seg->id = next_id++;
+  list_push_back (&segments, &seg->elem);
+  lock_release (&shm_lock);
+  return id;
+}
+
+/* Unmaps the first PAGE_CNT pages at ADDR in the running
+   process, which shm_map() mapped. */
+static void
+unmap_pages (uint8_t *addr, size_t page_cnt) 
+{
+#ifdef VM
+  page_remove_range (addr, page_cnt);
+#else
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    pagedir_unmap (thread_current ()->pagedir, addr + i * PGSIZE);
+#endif
+}
+
+/* Maps the whole of segment ID at page-aligned user address ADDR
+   in the running process.  Returns false if there is no such
+   segment, any of the pages is already in use, or memory is
+   short. */
+bool
+shm_map (int id, void *addr_) 
+{
+  struct thread *t = thread_current ();
+  uint8_t *addr = addr_;
+  struct shm_segment *seg;
+  size_t i;
+
+  lock_acquire (&shm_lock);
+  seg = find_segment (id);
+  if (seg == NULL || addr == NULL || pg_ofs (addr) != 0
+      || !user_range_ok (addr, seg->page_cnt * PGSIZE))
+    goto fail;
+
+  for (i = 0; i < seg->page_cnt; i++)
+    {
+      uint8_t *upage = addr + i * PGSIZE;
+#ifdef VM
+      if (!page_add_zero (upage, true))
+        break;
+      if (!pagedir_map_shared (t->pagedir, upage, seg->frames[i]))
+        {
+          page_remove_range (upage, 1);
+          break;
+        }
+#else
+      if (!pagedir_map_shared (t->pagedir, upage, seg->frames[i]))
+        break;
+#endif
+    }
+  if (i < seg->page_cnt || !add_ref (t, seg))
+    {
+      unmap_pages (addr, i);
+      goto fail;
+    }
+  lock_release (&shm_lock);
+  return true;
+
+ fail:
+  lock_release (&shm_lock);
+  return false;
+}
+
+/* Gives the running process, a new child of PARENT, a reference
+   to each segment that PARENT holds.  The child already maps
+   them, through pagedir_fork().  Returns false if memory is
+   short; the references taken so far are dropped by
+   shm_exit(). */
+bool
+shm_fork (struct thread *parent) 
+{
+  struct thread *t = thread_current ();
+  struct list *refs = &parent->leader->shm_refs;
+  struct list_elem *e;
+  bool success = true;
+
+  lock_acquire (&shm_lock);
+  for (e = list_begin (refs); e != list_end (refs) && success;
+       e = list_next (e))
+    success = add_ref (t, list_entry (e, struct shm_ref, elem)->seg);
+  lock_release (&shm_lock);
+  return success;
+}
+
+/* Drops the running process's references to segments.  Called
+   by its leader as it exits. */
+void
+shm_exit (void) 
+{
+  struct thread *t = thread_current ();
+
+  lock_acquire (&shm_lock);
+  while (!list_empty (&t->shm_refs))
+    put_ref (list_entry (list_front (&t->shm_refs), struct shm_ref, elem));
+  lock_release (&shm_lock);
+}
@@ -0,0 +1,15 @@
+#ifndef USERPROG_SHM_H
+#define USERPROG_SHM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct thread;
+
+void shm_init (void);
+int shm_create (size_t size);
+bool shm_map (int id, void *addr);
+bool shm_fork (struct thread *parent);
+void shm_exit (void);
+
+#endif /* userprog/shm.h */
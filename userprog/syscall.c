@@ -1,20 +1,1561 @@
 #include "userprog/syscall.h"
+#include <bitmap.h>
+#include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include "devices/input.h"
+#include "devices/shutdown.h"
+#include "devices/timer.h"
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/poll.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/aio.h"
+#include "userprog/futex.h"
+#include "userprog/pagedir.h"
+#include "userprog/pipe.h"
+#include "userprog/process.h"
+#include "userprog/shm.h"
+#include "userprog/uaccess.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
+
+/* A system call handler.  ARGS points to the call's arguments,
+   which the dispatcher has copied from the user stack.  The
+   return value is passed back to the user program in eax; calls
+   that return nothing return 0. */
+typedef uint32_t syscall_func (const uint32_t *args);
+
+static syscall_func sys_halt, sys_exit, sys_exec, sys_wait;
+static syscall_func sys_create, sys_remove, sys_open, sys_filesize;
+static syscall_func sys_read, sys_write, sys_seek, sys_tell, sys_close;
+static syscall_func sys_chdir;
+static syscall_func sys_readv, sys_writev, sys_pread, sys_pwrite;
+static syscall_func sys_submit, sys_fork;
+static syscall_func sys_thread_create, sys_thread_join;
+static syscall_func sys_futex_wait, sys_futex_wake, sys_sbrk;
+static syscall_func sys_wait_any;
+static syscall_func sys_group_create, sys_group_join, sys_group_set_weight;
+static syscall_func sys_pipe, sys_shm_create, sys_shm_map, sys_poll;
+static syscall_func sys_aio_submit, sys_aio_wait, sys_getdents;
+static syscall_func sys_fallocate, sys_open_flags, sys_fadvise;
+static syscall_func sys_getrusage;
+#ifdef VM
+static syscall_func sys_mmap, sys_munmap, sys_madvise;
+#endif
+
+/* A system call. */
+struct syscall
+  {
+    syscall_func *func;         /* Handler, or NULL if unsupported. */
+    int arg_cnt;                /* Number of 32-bit arguments, at most
+                                   SYSCALL_ARGS_MAX. */
+    const char *name;           /* Name, for statistics. */
+  };
+
+/* System calls, indexed by SYS_* number.  Dispatching is a
+   bounds check and an indirect call. */
+static const struct syscall syscalls[] =
+  {
+    [SYS_HALT] = {sys_halt, 0, "halt"},
+    [SYS_EXIT] = {sys_exit, 1, "exit"},
+    [SYS_EXEC] = {sys_exec, 1, "exec"},
+    [SYS_WAIT] = {sys_wait, 1, "wait"},
+    [SYS_CREATE] = {sys_create, 2, "create"},
+    [SYS_REMOVE] = {sys_remove, 1, "remove"},
+    [SYS_OPEN] = {sys_open, 1, "open"},
+    [SYS_FILESIZE] = {sys_filesize, 1, "filesize"},
+    [SYS_READ] = {sys_read, 3, "read"},
+    [SYS_WRITE] = {sys_write, 3, "write"},
+    [SYS_SEEK] = {sys_seek, 2, "seek"},
+    [SYS_TELL] = {sys_tell, 1, "tell"},
+    [SYS_CLOSE] = {sys_close, 1, "close"},
+#ifdef VM
+    [SYS_MMAP] = {sys_mmap, 2, "mmap"},
+    [SYS_MUNMAP] = {sys_munmap, 1, "munmap"},
+#else
+    [SYS_MMAP] = {NULL, 2, "mmap"},
+    [SYS_MUNMAP] = {NULL, 1, "munmap"},
+#endif
+    [SYS_CHDIR] = {sys_chdir, 1, "chdir"},
+    [SYS_MKDIR] = {NULL, 1, "mkdir"},
+    [SYS_READDIR] = {NULL, 2, "readdir"},
+    [SYS_ISDIR] = {NULL, 1, "isdir"},
+    [SYS_INUMBER] = {NULL, 1, "inumber"},
+    [SYS_READV] = {sys_readv, 3, "readv"},
+    [SYS_WRITEV] = {sys_writev, 3, "writev"},
+    [SYS_PREAD] = {sys_pread, 4, "pread"},
+    [SYS_PWRITE] = {sys_pwrite, 4, "pwrite"},
+    [SYS_SUBMIT] = {sys_submit, 2, "submit"},
+    [SYS_FORK] = {sys_fork, 0, "fork"},
+    [SYS_THREAD_CREATE] = {sys_thread_create, 2, "thread_create"},
+    [SYS_THREAD_JOIN] = {sys_thread_join, 1, "thread_join"},
+    [SYS_FUTEX_WAIT] = {sys_futex_wait, 2, "futex_wait"},
+    [SYS_FUTEX_WAKE] = {sys_futex_wake, 2, "futex_wake"},
+    [SYS_SBRK] = {sys_sbrk, 1, "sbrk"},
+    [SYS_WAIT_ANY] = {sys_wait_any, 1, "wait_any"},
+    [SYS_GROUP_CREATE] = {sys_group_create, 1, "group_create"},
+    [SYS_GROUP_JOIN] = {sys_group_join, 1, "group_join"},
+    [SYS_GROUP_SET_WEIGHT] = {sys_group_set_weight, 2, "group_set_weight"},
+    [SYS_PIPE] = {sys_pipe, 1, "pipe"},
+    [SYS_SHM_CREATE] = {sys_shm_create, 1, "shm_create"},
+    [SYS_SHM_MAP] = {sys_shm_map, 2, "shm_map"},
+    [SYS_POLL] = {sys_poll, 3, "poll"},
+    [SYS_AIO_SUBMIT] = {sys_aio_submit, 2, "aio_submit"},
+    [SYS_AIO_WAIT] = {sys_aio_wait, 3, "aio_wait"},
+    [SYS_GETDENTS] = {sys_getdents, 3, "getdents"},
+    [SYS_FALLOCATE] = {sys_fallocate, 3, "fallocate"},
+    [SYS_OPEN_FLAGS] = {sys_open_flags, 2, "open_flags"},
+    [SYS_FADVISE] = {sys_fadvise, 4, "fadvise"},
+#ifdef VM
+    [SYS_MADVISE] = {sys_madvise, 3, "madvise"},
+#else
+    [SYS_MADVISE] = {NULL, 3, "madvise"},
+#endif
+    [SYS_GETRUSAGE] = {sys_getrusage, 2, "getrusage"},
+  };
+#define SYSCALL_CNT (sizeof syscalls / sizeof *syscalls)
+#define SYSCALL_ARGS_MAX 4
+
+/* Per-call statistics, updated with interrupts off. */
+struct syscall_stats
+  {
+    unsigned long long calls;   /* Number of calls. */
+    uint64_t cycles;            /* Total timer_cycles() spent. */
+  };
+static struct syscall_stats stats[SYSCALL_CNT];
+
+/* File descriptor table.
+
+   Each process has an array of fd entries indexed by fd and a
+   bitmap of the fds in use, both in its struct thread.  An entry
+   is an open file or one end of a pipe.  Looking
+   up an fd is a bounds check and an index.  A new fd is the
+   lowest free one, found with bitmap_scan(), which skips whole
+   words of used fds at once.  fds 0 and 1 are the console and
+   are always marked used.  The table starts out empty and
+   doubles when it fills up.
+
+   The table belongs to the process's leader thread and is shared
+   by all of its threads, so it is only touched under fd_lock. */
+
+/* Size of a process's fd table when it first opens a file. */
+#define FD_TABLE_MIN 16
+
+/* What an fd refers to.  An unused entry is all zeros. */
+struct fd_entry
+  {
+    struct file *file;          /* Open file, or NULL. */
+    struct pipe *pipe;          /* Pipe, if not a file. */
+    bool write_end;             /* PIPE's write end, not its read end? */
+  };
+
+/* Protects every process's fd table. */
+static struct lock fd_lock;
 
 static void syscall_handler (struct intr_frame *);
+static uint32_t dispatch (uint32_t nr, const uint32_t *args);
+static void kill_process (void) NO_RETURN;
 
 void
-syscall_init (void) 
+syscall_init (void)
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
+  lock_init (&fd_lock);
+}
+
+/* Prints system call statistics, for the calls that have been
+   made at least once. */
+void
+syscall_print_stats (void)
+{
+  size_t nr;
+
+  for (nr = 0; nr < SYSCALL_CNT; nr++)
+    if (stats[nr].calls != 0)
+      printf ("Syscall: %s %llu calls, %llu ns total\n",
+              syscalls[nr].name, stats[nr].calls,
+              timer_cycles_to_ns (stats[nr].cycles));
+}
+
+/* Closes all of the running process's open files. */
+void
+syscall_exit (void)
+{
+  struct thread *cur = thread_current ();
+  size_t fd;
+
+  /* Only the leader gets here, after its other threads are gone. */
+  for (fd = 0; fd < cur->fd_cnt; fd++)
+    {
+      file_close (cur->fds[fd].file);
+      pipe_close (cur->fds[fd].pipe, cur->fds[fd].write_end);
+    }
+  free (cur->fds);
+  bitmap_destroy (cur->fd_map);
+  cur->fds = NULL;
+  cur->fd_map = NULL;
+  cur->fd_cnt = 0;
+}
+
+/* Returns true if the null-terminated string at user address
+   STR is entirely readable by the running process. */
+static bool
+user_string_ok (const char *str)
+{
+  const uint8_t *p = (const uint8_t *) str;
+  int c;
+
+  do
+    {
+      if (!is_user_vaddr (p))
+        return false;
+      c = get_user (p++);
+      if (c < 0)
+        return false;
+    }
+  while (c != '\0');
+  return true;
+}
+
+/* Returns the argument to a system call that is a string, or
+   terminates the process if it is not a valid one. */
+static const char *
+string_arg (uint32_t arg)
+{
+  const char *str = (const char *) arg;
+
+  if (!user_string_ok (str))
+    kill_process ();
+  return str;
+}
+
+/* Returns the argument to a system call that is a buffer of SIZE
+   bytes, or terminates the process if it does not lie in user
+   memory.  Whether it is mapped shows only when the buffer is
+   accessed through userprog/uaccess.h. */
+static void *
+buffer_arg (uint32_t arg, size_t size)
+{
+  void *buffer = (void *) arg;
+
+  if (!user_range_ok (buffer, size))
+    kill_process ();
+  return buffer;
+}
+
+/* Returns the running process's entry for FD, which is all
+   zeros if FD is not open. */
+static struct fd_entry
+lookup_fd (int fd)
+{
+  struct thread *leader = thread_current ()->leader;
+  struct fd_entry e = {NULL, NULL, false};
+
+  lock_acquire (&fd_lock);
+  if (fd >= 0 && (size_t) fd < leader->fd_cnt)
+    e = leader->fds[fd];
+  lock_release (&fd_lock);
+  return e;
+}
+
+/* Returns the running process's file with the given FD, or a
+   null pointer if it has none. */
+static struct file *
+lookup_file (int fd)
+{
+  return lookup_fd (fd).file;
+}
+
+/* Doubles the running process's fd table, or creates it if it
+   does not exist yet.  Returns false if memory is short.  The
+   caller must hold fd_lock. */
+static bool
+grow_fd_table (void)
+{
+  struct thread *cur = thread_current ()->leader;
+  size_t new_cnt = cur->fd_cnt > 0 ? cur->fd_cnt * 2 : FD_TABLE_MIN;
+  struct fd_entry *fds;
+  struct bitmap *map;
+
+  fds = calloc (new_cnt, sizeof *fds);
+  map = bitmap_create (new_cnt);
+  if (fds == NULL || map == NULL)
+    {
+      free (fds);
+      bitmap_destroy (map);
+      return false;
+    }
+
+  if (cur->fd_cnt > 0)
+    {
+      /* Every fd is in use, or we would not be growing. */
+      memcpy (fds, cur->fds, cur->fd_cnt * sizeof *fds);
+      bitmap_set_multiple (map, 0, cur->fd_cnt, true);
+    }
+  else
+    bitmap_set_multiple (map, 0, 2, true);
+
+  free (cur->fds);
+  bitmap_destroy (cur->fd_map);
+  cur->fds = fds;
+  cur->fd_map = map;
+  cur->fd_cnt = new_cnt;
+  return true;
+}
+
+/* Gives E the lowest free fd in the running process's table and
+   returns it, or returns -1 if memory is short. */
+static int
+install_fd (struct fd_entry e)
+{
+  struct thread *cur = thread_current ()->leader;
+  size_t fd = BITMAP_ERROR;
+
+  lock_acquire (&fd_lock);
+  if (cur->fd_map != NULL)
+    fd = bitmap_scan_and_flip (cur->fd_map, 2, 1, false);
+  if (fd == BITMAP_ERROR)
+    {
+      if (!grow_fd_table ())
+        {
+          lock_release (&fd_lock);
+          return -1;
+        }
+      fd = bitmap_scan_and_flip (cur->fd_map, 2, 1, false);
+      ASSERT (fd != BITMAP_ERROR);
+    }
+  cur->fds[fd] = e;
+  lock_release (&fd_lock);
+  return fd;
 }
 
 static void
-syscall_handler (struct intr_frame *f UNUSED) 
+syscall_handler (struct intr_frame *f)
 {
-  printf ("system call!\n");
+  const uint32_t *esp = f->esp;
+  uint32_t args[SYSCALL_ARGS_MAX];
+  uint32_t nr;
+
+  /* Faults taken on the user stack from here on need esp to tell
+     whether the stack should grow. */
+  thread_current ()->user_esp = f->esp;
+  if (!copy_from_user (&nr, esp, sizeof nr) || nr >= SYSCALL_CNT)
+    kill_process ();
+  if (!copy_from_user (args, esp + 1,
+                       syscalls[nr].arg_cnt * sizeof *args))
+    kill_process ();
+  f->eax = dispatch (nr, args);
+}
+
+/* Makes system call NR, which must be less than SYSCALL_CNT,
+   with arguments ARGS, and returns its result. */
+static uint32_t
+dispatch (uint32_t nr, const uint32_t *args)
+{
+  const struct syscall *sc = &syscalls[nr];
+  enum intr_level old_level;
+  uint64_t start;
+  uint32_t result;
+
+  /* Count the call before making it, because exit and halt do
+     not return. */
+  old_level = intr_disable ();
+  stats[nr].calls++;
+  intr_set_level (old_level);
+
+  if (sc->func == NULL)
+    return -1;
+  start = timer_cycles ();
+  result = sc->func (args);
+
+  old_level = intr_disable ();
+  stats[nr].cycles += timer_cycles () - start;
+  intr_set_level (old_level);
+  return result;
+}
+
+/* Terminates the running process, with all of its threads,
+   because it passed a bad argument to a system call. */
+static void
+kill_process (void)
+{
+  thread_current ()->exit_status = -1;
+  process_abort ();
+  thread_exit ();
+}
+
+static uint32_t
+sys_halt (const uint32_t *args UNUSED)
+{
+  shutdown_power_off ();
+}
+
+/* Ends the running thread with exit status ARGS[0].  In a
+   process's leader, this ends the whole process. */
+static uint32_t
+sys_exit (const uint32_t *args)
+{
+  thread_current ()->exit_status = args[0];
   thread_exit ();
 }
+
+static uint32_t
+sys_exec (const uint32_t *args)
+{
+  return process_execute (string_arg (args[0]));
+}
+
+static uint32_t
+sys_wait (const uint32_t *args)
+{
+  return process_wait (args[0]);
+}
+
+/* Reaps whichever child exits first and returns its pid, storing
+   its exit status at user address ARGS[0] unless that is null.
+   Returns -1 if there are no children to wait for. */
+static uint32_t
+sys_wait_any (const uint32_t *args)
+{
+  int *ustatus = (int *) args[0];
+  int status;
+  tid_t tid;
+
+  if (ustatus != NULL)
+    buffer_arg (args[0], sizeof *ustatus);
+  tid = process_wait_any (&status);
+  if (tid != TID_ERROR && ustatus != NULL
+      && !copy_to_user (ustatus, &status, sizeof status))
+    kill_process ();
+  return tid;
+}
+
+static uint32_t
+sys_create (const uint32_t *args)
+{
+  return filesys_create (string_arg (args[0]), args[1]);
+}
+
+static uint32_t
+sys_remove (const uint32_t *args)
+{
+  return filesys_remove (string_arg (args[0]));
+}
+
+/* Flags for open_flags(), as in lib/user/syscall.h. */
+#define O_DIRECT 0x01
+
+/* Opens file NAME in the running process with the O_* FLAGS, and
+   returns its fd, or -1 on failure. */
+static int
+open_file (const char *name, int flags)
+{
+  struct fd_entry e = {NULL, NULL, false};
+  int fd;
+
+  if (flags & ~O_DIRECT)
+    return -1;
+  e.file = filesys_open (name);
+  if (e.file == NULL)
+    return -1;
+  file_set_direct (e.file, (flags & O_DIRECT) != 0);
+
+  fd = install_fd (e);
+  if (fd < 0)
+    file_close (e.file);
+  return fd;
+}
+
+static uint32_t
+sys_open (const uint32_t *args)
+{
+  return open_file (string_arg (args[0]), 0);
+}
+
+static uint32_t
+sys_filesize (const uint32_t *args)
+{
+  struct file *file = lookup_file (args[0]);
+
+  return file != NULL ? file_length (file) : -1;
+}
+
+/* Reads SIZE bytes from FILE into user buffer BUFFER, if READ is
+   true, or writes them from BUFFER into FILE, at FILE_OFS, or at
+   FILE's current position if FILE_OFS is negative.  Returns the
+   number of bytes transferred, or -1 if BUFFER is not mapped. */
+static off_t
+file_transfer_user (struct file *file, void *buffer, unsigned size,
+                    off_t file_ofs, bool read)
+{
+  if (file_ofs < 0)
+    return (read
+            ? file_read_user (file, buffer, size)
+            : file_write_user (file, buffer, size));
+  else
+    return (read
+            ? file_read_at_user (file, buffer, size, file_ofs)
+            : file_write_at_user (file, buffer, size, file_ofs));
+}
+
+/* Most sectors transfer_direct() hands to the file system at
+   once. */
+#define DIRECT_BATCH 32
+
+/* Returns the kernel address of byte U of user buffer BUFFER,
+   from KPAGES, the frames of the pages that BUFFER spans, if they
+   are pinned, or else from the page directory.  Returns a null
+   pointer if U's page is not mapped, or if it is not writable and
+   WRITE is true. */
+static void *
+user_kaddr (const uint8_t *buffer, const uint8_t *u, void *const kpages[],
+            bool write)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+
+  if (kpages != NULL)
+    return (uint8_t *) kpages[pg_no (u) - pg_no (buffer)] + pg_ofs (u);
+  if (write && !pagedir_is_writable (pd, u))
+    return NULL;
+  return pagedir_get_page (pd, u);
+}
+
+/* Moves the whole sectors at the start of the SIZE bytes of user
+   buffer BUFFER between FILE and the disk, as
+   file_transfer_user(), but through the frames that hold BUFFER
+   instead of the buffer cache, if FILE was opened with O_DIRECT
+   and both BUFFER and the file offset are sector-aligned.  KPAGES
+   is as for user_kaddr().  Returns the number of bytes moved,
+   possibly 0, and leaves the rest to the caller. */
+static off_t
+transfer_direct (struct file *file, uint8_t *buffer, unsigned size,
+                 off_t file_ofs, bool read, void *const kpages[])
+{
+  off_t ofs = file_ofs >= 0 ? file_ofs : file_tell (file);
+  off_t total = 0;
+
+  if (!file_is_direct (file) || ofs % BLOCK_SECTOR_SIZE != 0
+      || (uintptr_t) buffer % BLOCK_SECTOR_SIZE != 0)
+    return 0;
+  while (size - total >= BLOCK_SECTOR_SIZE)
+    {
+      void *sectors[DIRECT_BATCH];
+      size_t cnt = (size - total) / BLOCK_SECTOR_SIZE;
+      size_t i;
+      off_t n;
+
+      if (cnt > DIRECT_BATCH)
+        cnt = DIRECT_BATCH;
+      for (i = 0; i < cnt; i++)
+        {
+          sectors[i] = user_kaddr (buffer,
+                                   buffer + total + i * BLOCK_SECTOR_SIZE,
+                                   kpages, read);
+          if (sectors[i] == NULL)
+            break;
+        }
+      cnt = i;
+      if (cnt == 0)
+        break;
+
+      n = (read
+           ? file_read_direct (file, sectors, cnt, ofs + total)
+           : file_write_direct (file, (const void *const *) sectors, cnt,
+                                ofs + total));
+      total += n;
+      if ((size_t) n < cnt * BLOCK_SECTOR_SIZE)
+        break;
+    }
+  if (file_ofs < 0)
+    file_seek (file, ofs + total);
+  return total;
+}
+
+/* Transfers SIZE bytes between FILE and user buffer BUFFER as
+   file_transfer_user(), bypassing the buffer cache for what
+   transfer_direct() can do.  KPAGES is as for user_kaddr().
+   Returns the number of bytes transferred, or -1 if BUFFER is not
+   mapped. */
+static off_t
+transfer_chunk (struct file *file, uint8_t *buffer, unsigned size,
+                off_t file_ofs, bool read, void *const kpages[])
+{
+  off_t direct = transfer_direct (file, buffer, size, file_ofs, read,
+                                  kpages);
+  off_t n;
+
+  if ((unsigned) direct == size)
+    return direct;
+  n = file_transfer_user (file, buffer + direct, size - direct,
+                          file_ofs >= 0 ? file_ofs + direct : -1, read);
+  return n < 0 ? n : direct + n;
+}
+
+/* Transfers SIZE bytes between FILE and user buffer BUFFER, as
+   file_transfer_user(), terminating the process if BUFFER is not
+   mapped.  BUFFER must already have passed buffer_arg().
+
+   The file system copies to and from user memory while holding
+   its locks, so a fault that had to read a page from a file then
+   could deadlock.  With virtual memory, the buffer is therefore
+   brought in and pinned beforehand, PAGE_PIN_MAX pages at a
+   time. */
+static off_t
+transfer_file (struct file *file, void *buffer, unsigned size,
+               off_t file_ofs, bool read)
+{
+#ifdef VM
+  uint8_t *p = buffer;
+  off_t total = 0;
+
+  while (size > 0) 
+    {
+      void *kpages[PAGE_PIN_MAX];
+      unsigned chunk = PAGE_PIN_MAX * PGSIZE - pg_ofs (p);
+      size_t pin_cnt;
+      off_t n;
+
+      if (chunk > size)
+        chunk = size;
+      pin_cnt = page_pin (p, chunk, read, kpages);
+      if (pin_cnt == 0)
+        kill_process ();
+      n = transfer_chunk (file, p, chunk, file_ofs, read, kpages);
+      page_unpin (kpages, pin_cnt);
+      if (n < 0)
+        kill_process ();
+
+      total += n;
+      if ((unsigned) n < chunk)
+        break;
+      p += n;
+      size -= n;
+      if (file_ofs >= 0)
+        file_ofs += n;
+    }
+  return total;
+#else
+  off_t n = transfer_chunk (file, buffer, size, file_ofs, read, NULL);
+
+  if (n < 0)
+    kill_process ();
+  return n;
+#endif
+}
+
+/* Reads SIZE bytes into user buffer BUFFER from FD at its
+   current position, as the read system call.  BUFFER must
+   already have passed buffer_arg().  The console reads at most
+   one line. */
+static int
+read_fd (int fd, uint8_t *buffer, unsigned size)
+{
+  struct fd_entry e;
+  int n;
+
+  if (fd == STDIN_FILENO)
+    {
+      uint8_t line[INPUT_LINE_MAX];
+
+      if (size == 0)
+        return 0;
+      n = input_read_line (line, size < sizeof line ? size : sizeof line);
+      if (!copy_to_user (buffer, line, n))
+        kill_process ();
+      return n;
+    }
+
+  e = lookup_fd (fd);
+  if (e.pipe != NULL && !e.write_end)
+    {
+      n = pipe_read_user (e.pipe, buffer, size);
+      if (n < 0)
+        kill_process ();
+      return n;
+    }
+  if (e.file == NULL)
+    return -1;
+  return transfer_file (e.file, buffer, size, -1, true);
+}
+
+/* Writes the SIZE bytes of user buffer BUFFER to the console,
+   copying them through a small kernel buffer because putbuf()
+   holds the console lock while it reads its argument. */
+static unsigned
+write_console (const uint8_t *buffer, unsigned size)
+{
+  char chunk[256];
+  unsigned done;
+
+  for (done = 0; done < size; done += sizeof chunk)
+    {
+      unsigned n = size - done < sizeof chunk ? size - done : sizeof chunk;
+
+      if (!copy_from_user (chunk, buffer + done, n))
+        kill_process ();
+      putbuf (chunk, n);
+    }
+  return size;
+}
+
+/* Writes SIZE bytes from user buffer BUFFER to FD at its current
+   position, as the write system call.  BUFFER must already have
+   passed buffer_arg(). */
+static int
+write_fd (int fd, const uint8_t *buffer, unsigned size)
+{
+  struct fd_entry e;
+  int n;
+
+  if (fd == STDOUT_FILENO)
+    return write_console (buffer, size);
+
+  e = lookup_fd (fd);
+  if (e.pipe != NULL && e.write_end)
+    {
+      n = pipe_write_user (e.pipe, buffer, size);
+      if (n == -1)
+        kill_process ();
+      return n == PIPE_BROKEN ? -1 : n;
+    }
+  if (e.file == NULL)
+    return -1;
+  return transfer_file (e.file, (void *) buffer, size, -1, false);
+}
+
+/* Charges the running process for the N bytes that a read or,
+   if WRITE is true, a write system call transferred, if N is not
+   an error.  Returns N. */
+static int
+count_io (int n, bool write)
+{
+  if (n > 0)
+    process_count_io (write, n);
+  return n;
+}
+
+static uint32_t
+sys_read (const uint32_t *args)
+{
+  unsigned size = args[2];
+
+  return count_io (read_fd (args[0], buffer_arg (args[1], size), size),
+                   false);
+}
+
+static uint32_t
+sys_write (const uint32_t *args)
+{
+  unsigned size = args[2];
+
+  return count_io (write_fd (args[0], buffer_arg (args[1], size), size),
+                   true);
+}
+
+/* Layout of struct iovec in lib/user/syscall.h. */
+struct user_iovec
+  {
+    uint32_t base;              /* Start of buffer. */
+    uint32_t len;               /* Length of buffer in bytes. */
+  };
+
+/* Reads or writes, according to WRITE, each of the IOV_CNT
+   buffers in the user array of struct iovec at IOV in turn, at
+   FD's current position.  Stops early at a buffer that is not
+   transferred in full.  Returns the number of bytes transferred,
+   or -1 if FD is not open. */
+static int
+transfer_iov (int fd, const struct user_iovec *iov, int iov_cnt, bool write)
+{
+  int total = 0;
+  int i;
+
+  for (i = 0; i < iov_cnt; i++)
+    {
+      struct user_iovec v;
+      int n;
+
+      if (!copy_from_user (&v, iov + i, sizeof v))
+        kill_process ();
+      n = (write
+           ? write_fd (fd, buffer_arg (v.base, v.len), v.len)
+           : read_fd (fd, buffer_arg (v.base, v.len), v.len));
+      if (n < 0)
+        return i == 0 ? -1 : total;
+      total += n;
+      if ((unsigned) n < v.len)
+        break;
+    }
+  return total;
+}
+
+static uint32_t
+sys_readv (const uint32_t *args)
+{
+  return count_io (transfer_iov (args[0],
+                                 (const struct user_iovec *) args[1],
+                                 args[2], false), false);
+}
+
+static uint32_t
+sys_writev (const uint32_t *args)
+{
+  return count_io (transfer_iov (args[0],
+                                 (const struct user_iovec *) args[1],
+                                 args[2], true), true);
+}
+
+static uint32_t
+sys_pread (const uint32_t *args)
+{
+  struct file *file = lookup_file (args[0]);
+  unsigned size = args[2];
+  void *buffer = buffer_arg (args[1], size);
+
+  if (file == NULL || (off_t) args[3] < 0)
+    return -1;
+  return count_io (transfer_file (file, buffer, size, args[3], true), false);
+}
+
+static uint32_t
+sys_pwrite (const uint32_t *args)
+{
+  struct file *file = lookup_file (args[0]);
+  unsigned size = args[2];
+  void *buffer = buffer_arg (args[1], size);
+
+  if (file == NULL || (off_t) args[3] < 0)
+    return -1;
+  return count_io (transfer_file (file, buffer, size, args[3], false), true);
+}
+
+static uint32_t
+sys_seek (const uint32_t *args)
+{
+  struct file *file = lookup_file (args[0]);
+
+  if (file != NULL)
+    file_seek (file, args[1]);
+  return 0;
+}
+
+static uint32_t
+sys_tell (const uint32_t *args)
+{
+  struct file *file = lookup_file (args[0]);
+
+  return file != NULL ? file_tell (file) : -1;
+}
+
+/* Closes FD in the running process, if it is open. */
+static void
+close_fd (int fd)
+{
+  struct thread *cur = thread_current ()->leader;
+  struct fd_entry e = {NULL, NULL, false};
+
+  lock_acquire (&fd_lock);
+  if (fd >= 0 && (size_t) fd < cur->fd_cnt
+      && (cur->fds[fd].file != NULL || cur->fds[fd].pipe != NULL))
+    {
+      e = cur->fds[fd];
+      memset (&cur->fds[fd], 0, sizeof cur->fds[fd]);
+      bitmap_reset (cur->fd_map, fd);
+    }
+  lock_release (&fd_lock);
+  file_close (e.file);
+  pipe_close (e.pipe, e.write_end);
+}
+
+static uint32_t
+sys_close (const uint32_t *args)
+{
+  close_fd (args[0]);
+  return 0;
+}
+
+#ifdef VM
+static uint32_t
+sys_mmap (const uint32_t *args)
+{
+  struct file *file = lookup_file (args[0]);
+
+  return file != NULL ? mmap_map (file, (void *) args[1]) : -1;
+}
+
+static uint32_t
+sys_munmap (const uint32_t *args)
+{
+  mmap_unmap (args[0]);
+  return 0;
+}
+
+/* Advice for madvise(), as in lib/user/syscall.h. */
+#define MADV_NORMAL 0
+#define MADV_WILLNEED 3
+#define MADV_DONTNEED 4
+
+/* Applies MADV_* advice ARGS[2] to the ARGS[1] bytes of user
+   memory at ARGS[0], which must be page-aligned.  Returns true
+   if successful, false if the range or the advice is invalid. */
+static uint32_t
+sys_madvise (const uint32_t *args)
+{
+  uint8_t *addr = (uint8_t *) args[0];
+  size_t length = args[1];
+  size_t page_cnt = DIV_ROUND_UP (length, PGSIZE);
+
+  if (pg_ofs (addr) != 0 || !is_user_vaddr (addr)
+      || length > (size_t) ((uint8_t *) PHYS_BASE - addr))
+    return false;
+  switch (args[2]) 
+    {
+    case MADV_NORMAL:
+      return true;
+    case MADV_WILLNEED:
+      page_willneed (addr, page_cnt);
+      return true;
+    case MADV_DONTNEED:
+      page_dontneed (addr, page_cnt);
+      return true;
+    default:
+      return false;
+    }
+}
+#endif
+
+static uint32_t
+sys_chdir (const uint32_t *args)
+{
+  return filesys_chdir (string_arg (args[0]));
+}
+
+/* Layout of struct syscall_req in lib/user/syscall.h. */
+struct user_syscall_req
+  {
+    uint32_t nr;                        /* SYS_* number. */
+    uint32_t args[SYSCALL_ARGS_MAX];    /* Arguments. */
+    uint32_t result;                    /* Return value, set by kernel. */
+  };
+
+/* Makes each of the CNT system calls described by the user array
+   of struct syscall_req at REQS, in order, storing each one's
+   return value in its `result'.  Paying for one trap instead of
+   CNT is worthwhile for runs of small calls.  A request with an
+   invalid number, including a nested submit or a fork, gets -1
+   as its result.  Returns CNT. */
+static uint32_t
+sys_submit (const uint32_t *args)
+{
+  struct user_syscall_req *reqs = (struct user_syscall_req *) args[0];
+  int cnt = args[1];
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct user_syscall_req req;
+
+      if (!copy_from_user (&req, reqs + i, sizeof req))
+        kill_process ();
+      if (req.nr < SYSCALL_CNT
+          && req.nr != SYS_SUBMIT && req.nr != SYS_FORK)
+        req.result = dispatch (req.nr, req.args);
+      else
+        req.result = -1;
+      if (!copy_to_user (&reqs[i].result, &req.result, sizeof req.result))
+        kill_process ();
+    }
+  return cnt;
+}
+
+/* Creates a copy of the running process, which returns 0 from
+   this call, and returns its pid, or -1 on failure. */
+static uint32_t
+sys_fork (const uint32_t *args UNUSED)
+{
+  /* A system call from user mode saves the user's registers at
+     the very top of the thread's kernel stack. */
+  struct intr_frame *f
+    = (struct intr_frame *) ((uint8_t *) thread_current () + PGSIZE) - 1;
+
+  return process_fork (f);
+}
+
+/* Gives the running process, a new child of PARENT, its own
+   copy of each of PARENT's open files, at the same fd and
+   position.  Returns false if memory is short; the files copied
+   so far are closed by syscall_exit(). */
+bool
+syscall_fork (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+  bool success = false;
+  size_t fd;
+
+  lock_acquire (&fd_lock);
+  if (parent->fd_cnt == 0)
+    {
+      lock_release (&fd_lock);
+      return true;
+    }
+
+  cur->fds = calloc (parent->fd_cnt, sizeof *cur->fds);
+  cur->fd_map = bitmap_create (parent->fd_cnt);
+  if (cur->fds == NULL || cur->fd_map == NULL)
+    {
+      free (cur->fds);
+      bitmap_destroy (cur->fd_map);
+      cur->fds = NULL;
+      cur->fd_map = NULL;
+      goto done;
+    }
+  cur->fd_cnt = parent->fd_cnt;
+  bitmap_set_multiple (cur->fd_map, 0, 2, true);
+
+  for (fd = 2; fd < parent->fd_cnt; fd++)
+    {
+      struct fd_entry *e = &parent->fds[fd];
+
+      if (e->file != NULL)
+        {
+          struct file *file = file_reopen (e->file);
+          if (file == NULL)
+            goto done;
+          file_seek (file, file_tell (e->file));
+          file_set_direct (file, file_is_direct (e->file));
+          file_advise (file, file_pattern (e->file), 0, 0);
+          cur->fds[fd].file = file;
+          bitmap_mark (cur->fd_map, fd);
+        }
+      else if (e->pipe != NULL)
+        {
+          pipe_dup (e->pipe, e->write_end);
+          cur->fds[fd] = *e;
+          bitmap_mark (cur->fd_map, fd);
+        }
+    }
+  success = true;
+
+ done:
+  lock_release (&fd_lock);
+  return success;
+}
+
+/* Starts a new thread in the running process at user address
+   ARGS[0] with stack pointer ARGS[1], and returns its tid, or -1
+   on failure.  The new thread shares the process's memory and
+   open files. */
+static uint32_t
+sys_thread_create (const uint32_t *args)
+{
+  void *esp = (void *) args[1];
+
+  if (!is_user_vaddr (esp))
+    return -1;
+  return process_thread_create ((void (*) (void)) args[0], esp);
+}
+
+static uint32_t
+sys_thread_join (const uint32_t *args)
+{
+  return process_thread_join (args[0]);
+}
+
+/* Returns the argument to a futex call that is the address of a
+   futex word, or terminates the process if it is not one. */
+static int *
+futex_arg (uint32_t arg)
+{
+  if (arg % sizeof (int) != 0)
+    kill_process ();
+  return buffer_arg (arg, sizeof (int));
+}
+
+/* If the user word at ARGS[0] holds ARGS[1], sleeps until a
+   futex_wake on it, and returns 0; otherwise returns 1 at once. */
+static uint32_t
+sys_futex_wait (const uint32_t *args)
+{
+  int result = futex_wait (thread_current ()->pagedir,
+                           futex_arg (args[0]), args[1]);
+
+  if (result < 0)
+    kill_process ();
+  return result;
+}
+
+/* Wakes up to ARGS[1] threads sleeping on the user word at
+   ARGS[0] and returns the number woken. */
+static uint32_t
+sys_futex_wake (const uint32_t *args)
+{
+  return futex_wake (thread_current ()->pagedir, futex_arg (args[0]),
+                     args[1]);
+}
+
+/* Grows the heap by ARGS[0] bytes, or shrinks it if ARGS[0] is
+   negative, and returns the old end of the heap, or -1 on
+   failure. */
+static uint32_t
+sys_sbrk (const uint32_t *args)
+{
+  void *old = process_sbrk ((int32_t) args[0]);
+
+  return old != NULL ? (uint32_t) old : (uint32_t) -1;
+}
+
+/* Moves the calling thread into a new process group of weight
+   ARGS[0] and returns the group's number, or -1. */
+static uint32_t
+sys_group_create (const uint32_t *args)
+{
+  return sched_group_create (args[0]);
+}
+
+/* Moves the calling thread into process group ARGS[0]. */
+static uint32_t
+sys_group_join (const uint32_t *args)
+{
+  return sched_group_join (args[0]);
+}
+
+/* Sets the weight of process group ARGS[0] to ARGS[1]. */
+static uint32_t
+sys_group_set_weight (const uint32_t *args)
+{
+  return sched_group_set_weight (args[0], args[1]);
+}
+
+/* Creates a pipe and stores the fds of its read and write ends
+   in the user array of two ints at ARGS[0].  Returns true if
+   successful, false if memory is short. */
+static uint32_t
+sys_pipe (const uint32_t *args)
+{
+  int *ufds = buffer_arg (args[0], 2 * sizeof (int));
+  struct fd_entry read_end = {NULL, NULL, false};
+  struct fd_entry write_end = {NULL, NULL, true};
+  int fds[2];
+
+  read_end.pipe = write_end.pipe = pipe_create ();
+  if (read_end.pipe == NULL)
+    return false;
+
+  fds[0] = install_fd (read_end);
+  if (fds[0] < 0)
+    {
+      pipe_close (read_end.pipe, false);
+      pipe_close (write_end.pipe, true);
+      return false;
+    }
+  fds[1] = install_fd (write_end);
+  if (fds[1] < 0)
+    {
+      close_fd (fds[0]);
+      pipe_close (write_end.pipe, true);
+      return false;
+    }
+
+  /* If this faults, exiting closes both ends. */
+  if (!copy_to_user (ufds, fds, sizeof fds))
+    kill_process ();
+  return true;
+}
+
+/* Creates a shared memory segment of ARGS[0] bytes and returns
+   its id, or -1 on failure. */
+static uint32_t
+sys_shm_create (const uint32_t *args)
+{
+  return shm_create (args[0]);
+}
+
+/* Maps shared memory segment ARGS[0] at user address ARGS[1] and
+   returns true, or returns false on failure. */
+static uint32_t
+sys_shm_map (const uint32_t *args)
+{
+  return shm_map (args[0], (void *) args[1]);
+}
+
+/* Layout of struct pollfd in lib/user/syscall.h, and its
+   events. */
+struct user_pollfd
+  {
+    int32_t fd;                 /* Fd, or pid with POLLCHILD. */
+    int16_t events;             /* Events to watch for. */
+    int16_t revents;            /* Those that happened. */
+  };
+#define POLLIN 0x01
+#define POLLOUT 0x04
+#define POLLERR 0x08
+#define POLLHUP 0x10
+#define POLLNVAL 0x20
+#define POLLCHILD 0x40
+
+/* Most entries one poll() may watch. */
+#define POLL_FDS_MAX 256
+
+/* One entry that sys_poll() watches. */
+struct poll_fd
+  {
+    struct user_pollfd u;       /* Copy of the user's entry. */
+    struct fd_entry e;          /* What U.fd was when poll() began. */
+  };
+
+/* Hooks P onto whatever wakes it when PF might be ready, and
+   looks up the fd that PF watches. */
+static void
+watch_fd (struct poll_fd *pf, struct poller *p)
+{
+  memset (&pf->e, 0, sizeof pf->e);
+  if (pf->u.events & POLLCHILD)
+    process_poll_children (p);
+  else if (pf->u.fd == STDIN_FILENO)
+    input_poll (p);
+  else if (pf->u.fd > STDOUT_FILENO)
+    {
+      pf->e = lookup_fd (pf->u.fd);
+      if (pf->e.pipe != NULL)
+        pipe_watch (pf->e.pipe, p);
+    }
+}
+
+/* Returns the events of PF that have happened. */
+static int
+fd_revents (const struct poll_fd *pf)
+{
+  int events = pf->u.events | POLLERR | POLLHUP | POLLNVAL;
+  int revents = 0;
+
+  if (pf->u.events & POLLCHILD)
+    {
+      int ready = process_child_ready (pf->u.fd < 0 ? TID_ERROR
+                                       : pf->u.fd);
+      revents = ready < 0 ? POLLNVAL : ready ? POLLCHILD : 0;
+    }
+  else if (pf->u.fd < 0)
+    revents = 0;
+  else if (pf->u.fd == STDIN_FILENO)
+    revents = input_line_ready () ? POLLIN : 0;
+  else if (pf->u.fd == STDOUT_FILENO)
+    revents = POLLOUT;
+  else if (pf->e.pipe != NULL)
+    {
+      bool write_end = pf->e.write_end;
+      bool hung_up;
+
+      if (pipe_ready (pf->e.pipe, write_end, &hung_up))
+        revents = write_end ? POLLOUT : POLLIN;
+      if (hung_up)
+        revents |= write_end ? POLLERR : POLLHUP;
+    }
+  else if (pf->e.file != NULL)
+    revents = POLLIN | POLLOUT;
+  else
+    revents = POLLNVAL;
+  return revents & events;
+}
+
+/* Waits for any of the ARGS[1] entries in the user array of
+   struct pollfd at ARGS[0] to have one of its events, for up to
+   ARGS[2] timer ticks, or forever if that is negative.  Returns
+   the number of entries whose revents it set, 0 on timeout, or
+   -1 if there are too many entries or memory is short.
+
+   All of the entries share one poller, which everything that
+   they watch wakes directly, so there is no thread per entry
+   and no polling loop: each wakeup costs one check of every
+   entry. */
+static uint32_t
+sys_poll (const uint32_t *args)
+{
+  unsigned cnt = args[1];
+  int timeout = args[2];
+  struct user_pollfd *ufds;
+  struct poll_fd *fds;
+  struct poll_hook *hooks;
+  struct poller poller;
+  int64_t deadline;
+  int ready_cnt;
+  unsigned i;
+  bool ok;
+
+  if (cnt > POLL_FDS_MAX)
+    return -1;
+  ufds = buffer_arg (args[0], cnt * sizeof *ufds);
+  fds = malloc (cnt * sizeof *fds + 1);
+  hooks = malloc (cnt * sizeof *hooks + 1);
+  if (fds == NULL || hooks == NULL)
+    {
+      free (fds);
+      free (hooks);
+      return -1;
+    }
+  for (i = 0, ok = true; i < cnt && ok; i++)
+    ok = copy_from_user (&fds[i].u, &ufds[i], sizeof fds[i].u);
+  if (!ok)
+    {
+      free (fds);
+      free (hooks);
+      kill_process ();
+    }
+
+  /* Hook on before the first check, so that nothing that becomes
+     ready after it goes unnoticed. */
+  deadline = timeout < 0 ? -1 : timer_ticks () + timeout;
+  poller_init (&poller, hooks, cnt);
+  for (i = 0; i < cnt; i++)
+    watch_fd (&fds[i], &poller);
+  for (;;)
+    {
+      ready_cnt = 0;
+      for (i = 0; i < cnt; i++)
+        {
+          fds[i].u.revents = fd_revents (&fds[i]);
+          if (fds[i].u.revents != 0)
+            ready_cnt++;
+        }
+      if (ready_cnt > 0 || process_dying ()
+          || (deadline >= 0 && timer_ticks () >= deadline))
+        break;
+      poller_wait (&poller, deadline);
+    }
+  poller_destroy (&poller);
+  for (i = 0; i < cnt; i++)
+    if (fds[i].e.pipe != NULL)
+      pipe_unwatch (fds[i].e.pipe);
+
+  for (i = 0, ok = true; i < cnt && ok; i++)
+    ok = copy_to_user (&ufds[i].revents, &fds[i].u.revents,
+                       sizeof fds[i].u.revents);
+  free (fds);
+  free (hooks);
+  if (!ok)
+    kill_process ();
+  return ready_cnt;
+}
+
+/* Layout of struct aiocb in lib/user/syscall.h. */
+struct user_aiocb
+  {
+    int32_t fd;                 /* File to read or write. */
+    uint32_t buf;               /* Buffer. */
+    uint32_t size;              /* Bytes. */
+    uint32_t offset;            /* Offset in the file. */
+    bool write;                 /* Write rather than read? */
+    int32_t result;             /* Set by aio_wait(). */
+  };
+
+/* Queues the ARGS[1] requests that the user array of pointers to
+   struct aiocb at ARGS[0] points to, stopping at the first that
+   cannot be queued, and returns the number queued.  Each
+   request's user address is its tag, for sys_aio_wait(). */
+static uint32_t
+sys_aio_submit (const uint32_t *args)
+{
+  const uint32_t *ucbs = (const uint32_t *) args[0];
+  int cnt = args[1];
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct user_aiocb cb;
+      struct file *file;
+      uint32_t ucb;
+      int status;
+
+      if (!copy_from_user (&ucb, ucbs + i, sizeof ucb)
+          || !copy_from_user (&cb, (void *) ucb, sizeof cb))
+        kill_process ();
+      file = lookup_file (cb.fd);
+      if (file == NULL || cb.size == 0 || cb.size > AIO_SIZE_MAX
+          || (int32_t) cb.offset < 0)
+        break;
+      status = aio_submit (file, buffer_arg (cb.buf, cb.size), cb.size,
+                           cb.offset, cb.write, ucb);
+      if (status < 0)
+        kill_process ();
+      if (status == 0)
+        break;
+    }
+  return i;
+}
+
+/* Reaps up to ARGS[1] finished requests, waiting up to ARGS[2]
+   timer ticks for one, or forever if that is negative.  Sets
+   each one's result and stores pointers to them in the user
+   array at ARGS[0].  Returns the number reaped, or -1 if there
+   are no requests. */
+static uint32_t
+sys_aio_wait (const uint32_t *args)
+{
+  uint32_t *udone = (uint32_t *) args[0];
+  int max = args[1];
+  int timeout = args[2];
+  struct aio_result results[AIO_MAX];
+  int cnt, i;
+
+  if (max > AIO_MAX)
+    max = AIO_MAX;
+  if (max > 0)
+    buffer_arg (args[0], max * sizeof *udone);
+  cnt = aio_wait (results, max,
+                  timeout < 0 ? -1 : timer_ticks () + timeout);
+  for (i = 0; i < cnt; i++)
+    {
+      struct user_aiocb *ucb = (struct user_aiocb *) results[i].tag;
+
+      if (!copy_to_user (&ucb->result, &results[i].result,
+                         sizeof ucb->result)
+          || !copy_to_user (udone + i, &results[i].tag,
+                            sizeof results[i].tag))
+        kill_process ();
+    }
+  return cnt;
+}
+
+/* Layout of struct dirent in lib/user/syscall.h. */
+struct user_dirent
+  {
+    int32_t inumber;            /* Inode number. */
+    char name[NAME_MAX + 1];    /* Null-terminated name. */
+  };
+
+/* Entries sys_getdents() reads from the directory at a time. */
+#define GETDENTS_BATCH 16
+
+/* Reads as many entries of directory ARGS[0] as fit in the
+   ARGS[2] bytes of user buffer ARGS[1], from the fd's current
+   position, which it advances.  Returns the number read, or -1
+   if the fd is not open. */
+static uint32_t
+sys_getdents (const uint32_t *args)
+{
+  struct file *file = lookup_file (args[0]);
+  unsigned size = args[2];
+  struct user_dirent *udents = buffer_arg (args[1], size);
+  size_t max = size / sizeof *udents;
+  size_t total = 0;
+
+  if (file == NULL)
+    return -1;
+  while (total < max)
+    {
+      struct dir_record records[GETDENTS_BATCH];
+      struct user_dirent dents[GETDENTS_BATCH];
+      off_t pos = file_tell (file);
+      size_t n, i;
+
+      n = dir_read_batch (file_get_inode (file), &pos, records,
+                          max - total < GETDENTS_BATCH
+                          ? max - total : GETDENTS_BATCH);
+      file_seek (file, pos);
+      if (n == 0)
+        break;
+      for (i = 0; i < n; i++)
+        {
+          dents[i].inumber = records[i].inumber;
+          memcpy (dents[i].name, records[i].name, sizeof dents[i].name);
+        }
+      if (!copy_to_user (udents + total, dents, n * sizeof *dents))
+        kill_process ();
+      total += n;
+    }
+  return total;
+}
+
+/* Sets aside disk space for the ARGS[2] bytes of file ARGS[0]
+   starting at offset ARGS[1], extending the file to cover them.
+   Returns true if successful, false if the fd is not an open
+   file or the space could not be found. */
+static uint32_t
+sys_fallocate (const uint32_t *args)
+{
+  struct file *file = lookup_file (args[0]);
+  off_t offset = args[1];
+  off_t length = args[2];
+
+  return file != NULL && file_allocate (file, offset, length);
+}
+
+/* Opens file ARGS[0] with the O_* flags in ARGS[1], as open()
+   does with none. */
+static uint32_t
+sys_open_flags (const uint32_t *args)
+{
+  return open_file (string_arg (args[0]), args[1]);
+}
+
+/* Applies advice ARGS[3] to file ARGS[0] and, for FADV_WILLNEED
+   and FADV_DONTNEED, the ARGS[2] bytes starting at ARGS[1].  The
+   FADV_* values in lib/user/syscall.h are those of enum
+   file_advice.  Returns true if successful, false if the fd or
+   the advice is invalid. */
+static uint32_t
+sys_fadvise (const uint32_t *args)
+{
+  struct file *file = lookup_file (args[0]);
+  off_t offset = args[1];
+  off_t length = args[2];
+
+  if (file == NULL || offset < 0 || length < 0
+      || args[3] > FILE_ADV_DONTNEED)
+    return false;
+  file_advise (file, args[3], offset, length);
+  return true;
+}
+
+/* Layout of struct rusage in lib/user/syscall.h, and its
+   RUSAGE_* values. */
+struct user_rusage
+  {
+    uint32_t rss;               /* Pages resident now. */
+    uint32_t rss_max;           /* Most pages resident at once. */
+    uint32_t minor_faults;      /* Faults served from memory. */
+    uint32_t major_faults;      /* Faults that read a file or swap. */
+    uint64_t read_bytes;        /* Read through system calls. */
+    uint64_t write_bytes;       /* Written through system calls. */
+    uint64_t read_sectors;      /* Read from disk while running. */
+    uint64_t write_sectors;     /* Written to disk while running. */
+    int64_t user_ticks;         /* Timer ticks in user mode. */
+    int64_t kernel_ticks;       /* Timer ticks in the kernel. */
+  };
+#define RUSAGE_SELF 0
+#define RUSAGE_CHILDREN 1
+
+/* Stores the resource use of the running process, if ARGS[0] is
+   RUSAGE_SELF, or of the children it has waited for, if it is
+   RUSAGE_CHILDREN, in the struct rusage at user address ARGS[1].
+   Returns false if ARGS[0] is neither. */
+static uint32_t
+sys_getrusage (const uint32_t *args)
+{
+  struct process_usage u;
+  struct user_rusage r;
+
+  if (args[0] != RUSAGE_SELF && args[0] != RUSAGE_CHILDREN)
+    return false;
+  r.rss = process_get_usage (args[0] == RUSAGE_CHILDREN, &u);
+  r.rss_max = u.rss_max;
+  r.minor_faults = u.minor_faults;
+  r.major_faults = u.major_faults;
+  r.read_bytes = u.read_bytes;
+  r.write_bytes = u.write_bytes;
+  r.read_sectors = u.read_sectors;
+  r.write_sectors = u.write_sectors;
+  r.user_ticks = u.user_ticks;
+  r.kernel_ticks = u.kernel_ticks;
+  if (!copy_to_user ((void *) args[1], &r, sizeof r))
+    kill_process ();
+  return true;
+}
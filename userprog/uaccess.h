@@ -0,0 +1,82 @@
+#ifndef USERPROG_UACCESS_H
+#define USERPROG_UACCESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/copy.h"
+#include "threads/vaddr.h"
+
+/* Access to user memory from the kernel.
+
+   Rather than checking that every page of a user buffer is
+   mapped before touching it, the kernel checks only that the
+   buffer lies below PHYS_BASE and then accesses it directly
+   through the routines here.  If the access faults, page_fault()
+   makes the routine return failure instead of killing the
+   kernel, and the system call can fail or terminate the process
+   as it sees fit. */
+
+/* Range of instructions in userprog/uaccess.S that may fault on
+   user memory, and where to resume if one does. */
+struct uaccess_fixup
+  {
+    uintptr_t start;            /* First instruction that may fault. */
+    uintptr_t end;              /* End of the faulting instructions. */
+    uintptr_t fixup;            /* Where to resume after a fault. */
+  };
+
+/* Table of fixups, terminated by an all-zero entry. */
+extern const struct uaccess_fixup uaccess_fixups[];
+
+/* Raw accessors in userprog/uaccess.S.  The caller must have
+   checked that the user addresses are below PHYS_BASE. */
+bool copy_user (void *dst, const void *src, size_t size);
+int get_user (const uint8_t *uaddr);
+bool put_user (uint8_t *udst, uint8_t byte);
+
+/* Returns true if the SIZE bytes starting at UADDR lie entirely
+   in user virtual memory.  They need not be mapped. */
+static inline bool
+user_range_ok (const void *uaddr, size_t size) 
+{
+  uintptr_t start = (uintptr_t) uaddr;
+
+  return start + size >= start && start + size <= (uintptr_t) PHYS_BASE;
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address
+   DST.  Returns true if successful, false if USRC is not a
+   valid user buffer. */
+static inline bool
+copy_from_user (void *dst, const void *usrc, size_t size) 
+{
+  return user_range_ok (usrc, size) && copy_user (dst, usrc, size);
+}
+
+/* Copies SIZE bytes from kernel address SRC to user address
+   UDST.  Returns true if successful, false if UDST is not a
+   valid, writable user buffer. */
+static inline bool
+copy_to_user (void *udst, const void *src, size_t size) 
+{
+  return user_range_ok (udst, size) && copy_user (udst, src, size);
+}
+
+/* Copies SIZE bytes from SRC to DST.  If USER is true, one of
+   them may be a user buffer that the caller has checked with
+   user_range_ok(), and the copy returns false if it faults.
+   Otherwise this is block_copy() and always succeeds.  This lets
+   code shared between the kernel and system calls copy straight
+   to or from user memory. */
+static inline bool
+copy_maybe_user (void *dst, const void *src, size_t size, bool user) 
+{
+  if (user)
+    return copy_user (dst, src, size);
+  block_copy (dst, src, size);
+  return true;
+}
+
+#endif /* userprog/uaccess.h */
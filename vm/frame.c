@@ -0,0 +1,572 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/swap.h"
+
+/* Frame table.
+
+   Every frame in the user pool has a descriptor here, in an
+   array indexed by the frame's position in the pool, which is
+   allocated once at boot so that evicting a page under memory
+   pressure never needs memory itself.  A frame that page_in() or
+   a copy-on-write fault filled records the page directory and
+   user page that map it; other frames, such as those shared
+   between processes, have a null `pd' and are never chosen.
+
+   Pages are chosen for eviction by WSClock.  A hand sweeps
+   around the array.  A page whose accessed bit is set has been
+   used since the hand last passed: the bit is cleared and the
+   time noted.  A page that has gone unused for WS_WINDOW ticks
+   has left its process's working set and may go; younger ones
+   are passed over, unless a whole sweep finds nothing, in which
+   case the next degrades to a plain clock.  Only pages mapped by
+   one page directory alone can go.  A clean one is simply
+   unmapped, to be brought back by page_in() from where it came
+   from; see pagedir_clear_clean().  Dirty ones are written to
+   swap, SWAP_CLUSTER at a time.
+
+   Writing is left to the pager thread as far as possible.  It
+   wakes when the number of free frames falls below `free_low'
+   and evicts until there are `free_high', in batches, gathering
+   dirty pages for one write and freeing old clean ones as it
+   goes.  A thread that finds no free frame itself sweeps for a
+   clean page first and writes dirty pages only if there is
+   nothing else, so with the reserve the pager keeps, a fault
+   seldom waits for the disk.
+
+   A descriptor says where its page is mapped, but the mapping
+   can change underneath it: page_in() registers a frame before
+   mapping it, and a copy-on-write fault moves a page to another
+   frame.  The clock therefore only trusts a descriptor whose
+   page directory still maps the page to that frame.  All it
+   relies on is that the page directory still exists, which
+   pagedir_destroy() ensures by calling frame_forget() for every
+   frame it maps.
+
+   A system call that copies to or from a user buffer while
+   holding file system locks must not fault the buffer in from a
+   file midway, so it first pins the buffer's frames with
+   page_pin(), and the clock passes pinned frames over.  Pins are
+   counted per frame, not per mapping, so that a pin can be
+   dropped by frame even if a copy-on-write fault has moved the
+   page meanwhile.
+
+   With -hugepages, frame_promote() moves a region of 1,024 pages
+   into a 4 MB page, as described in userprog/pagedir.c.  Its
+   frames keep their descriptors, but the clock ages the 4 MB
+   page as a whole, on the descriptor of its first frame, and
+   splits it into 4 kB pages, to be evicted one by one, only once
+   the whole of it is old. */
+
+/* A page unused for this many ticks is outside its process's
+   working set. */
+#define WS_WINDOW (TIMER_FREQ / 2)
+
+/* A user frame. */
+struct frame
+  {
+    uint32_t *pd;               /* Page directory, or null if unused. */
+    void *upage;                /* User page mapped in PD. */
+    uint32_t last_use;          /* timer_ticks() when last seen used. */
+    unsigned pin_cnt;           /* Pins held by system calls. */
+  };
+
+static struct frame *frames;    /* One per frame in the user pool. */
+static uint8_t *frame_base;     /* First frame in the user pool. */
+static size_t frame_cnt;        /* Number of frames. */
+static size_t hand;             /* Clock hand, an index into FRAMES. */
+static struct lock frame_lock;  /* Protects all of the above. */
+
+/* The pager keeps between FREE_LOW and FREE_HIGH frames free. */
+static size_t free_low, free_high;
+static struct semaphore pager_sema;     /* Upped to wake the pager. */
+static bool pager_awake;                /* Pager busy or about to be? */
+
+/* Statistics, updated with interrupts off. */
+static unsigned long long clean_total;  /* Clean pages dropped. */
+static unsigned long long dirty_total;  /* Dirty pages written to swap. */
+static unsigned long long pager_total;  /* Pages evicted by the pager. */
+static unsigned long long wake_total;   /* Times the pager was woken. */
+static unsigned long long huge_total;   /* 4 MB pages made. */
+static unsigned long long split_total;  /* 4 MB pages split to evict. */
+
+bool frame_huge_pages;
+
+static void add_frame (void *kpage, void *upage);
+static struct frame *frame_of (void *kpage);
+static bool evict (bool background);
+static void wake_pager (void);
+static thread_func pager;
+
+/* Allocates the frame table. */
+void
+frame_init (void) 
+{
+  size_t size;
+
+  frame_base = palloc_user_pool (&frame_cnt);
+  size = frame_cnt * sizeof *frames;
+  frames = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                                DIV_ROUND_UP (size, PGSIZE));
+  lock_init (&frame_lock);
+
+  free_low = frame_cnt / 64 > SWAP_CLUSTER ? frame_cnt / 64 : SWAP_CLUSTER;
+  free_high = 2 * free_low;
+  sema_init (&pager_sema, 0);
+}
+
+/* Prints frame table statistics. */
+void
+frame_print_stats (void) 
+{
+  printf ("Frame: %llu pages evicted, %llu clean and %llu written to swap; "
+          "%llu by the pager, woken %llu times\n",
+          clean_total + dirty_total, clean_total, dirty_total,
+          pager_total, wake_total);
+  if (frame_huge_pages)
+    printf ("Frame: %llu 4 MB pages made, %llu split for eviction\n",
+            huge_total, split_total);
+}
+
+/* Starts the pager thread.  Must be called after swap_init(). */
+void
+frame_start_pager (void) 
+{
+  pager_awake = true;
+  if (thread_create ("pager", PRI_DEFAULT, pager, NULL) == TID_ERROR)
+    PANIC ("frame_start_pager: cannot start pager");
+}
+
+/* Obtains a frame from the user pool, as palloc_get_page() with
+   FLAGS | PAL_USER would, for user page UPAGE of the running
+   process, evicting another page if there is no free frame.  The
+   caller must map the frame at UPAGE or free it with
+   frame_free().  Returns a null pointer if no page can be
+   evicted. */
+void *
+frame_alloc (enum palloc_flags flags, void *upage) 
+{
+  void *kpage;
+
+  while ((kpage = palloc_get_page (flags | PAL_USER)) == NULL)
+    if (!evict (false))
+      return NULL;
+  add_frame (kpage, upage);
+  if (palloc_user_free () < free_low)
+    wake_pager ();
+  return kpage;
+}
+
+/* Like frame_alloc() with no FLAGS, but only takes a frame that
+   is free, without evicting anything.  For reading ahead. */
+void *
+frame_try_alloc (void *upage) 
+{
+  void *kpage = palloc_get_page (PAL_USER);
+
+  if (kpage != NULL)
+    add_frame (kpage, upage);
+  return kpage;
+}
+
+/* Frees KPAGE, which came from frame_alloc(). */
+void
+frame_free (void *kpage) 
+{
+  lock_acquire (&frame_lock);
+  frame_of (kpage)->pd = NULL;
+  lock_release (&frame_lock);
+  palloc_free_page (kpage);
+}
+
+/* Tells the frame table that PD no longer maps user frame KPAGE. */
+void
+frame_forget (uint32_t *pd, void *kpage) 
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = frame_of (kpage);
+  if (f->pd == pd)
+    f->pd = NULL;
+  lock_release (&frame_lock);
+}
+
+/* Pins the frame that maps UPAGE in PD, if it is mapped, and
+   writable as well if WRITE is true, and returns the frame.
+   Otherwise returns a null pointer. */
+void *
+frame_pin (uint32_t *pd, const void *upage, bool write) 
+{
+  void *kpage;
+
+  lock_acquire (&frame_lock);
+  kpage = pagedir_get_page (pd, upage);
+  if (kpage != NULL && (!write || pagedir_is_writable (pd, upage)))
+    frame_of (kpage)->pin_cnt++;
+  else
+    kpage = NULL;
+  lock_release (&frame_lock);
+  return kpage;
+}
+
+/* Drops a pin taken on KPAGE by frame_pin(). */
+void
+frame_unpin (void *kpage) 
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = frame_of (kpage);
+  ASSERT (f->pin_cnt > 0);
+  f->pin_cnt--;
+  lock_release (&frame_lock);
+}
+
+/* Drops UPAGE's frame from PD if UPAGE is mapped there, clean,
+   unpinned and not shared, so that the page will be brought back
+   from where it came from, as the clock does for a clean page,
+   and frees the frame.  A dirty page is not written out but
+   marked as unused for WS_WINDOW, so that the clock takes it
+   first. */
+void
+frame_drop (uint32_t *pd, void *upage) 
+{
+  uint8_t *kpage;
+  struct frame *f;
+  bool dropped = false;
+
+  lock_acquire (&frame_lock);
+  kpage = pagedir_get_page (pd, upage);
+  if (kpage >= frame_base && kpage < frame_base + frame_cnt * PGSIZE)
+    {
+      f = frame_of (kpage);
+      if (f->pd == pd && f->upage == upage && f->pin_cnt == 0)
+        {
+          if (!pagedir_is_dirty (pd, upage))
+            dropped = pagedir_clear_clean (pd, upage, kpage);
+          else 
+            {
+              pagedir_set_accessed (pd, upage, false);
+              f->last_use = timer_ticks () - WS_WINDOW;
+            }
+          if (dropped)
+            f->pd = NULL;
+        }
+    }
+  lock_release (&frame_lock);
+  if (dropped)
+    palloc_free_page (kpage);
+}
+
+/* Maps the 4 MB-aligned region of the running process's address
+   space that UPAGE lies in with a single 4 MB page, if huge pages
+   are enabled, every page of the region is resident in a private
+   writable frame that is not pinned, and palloc has an aligned
+   block of 1,024 free frames to move them into.  Returns true if
+   successful.  Otherwise a later fault in the region may try
+   again.  The caller must hold the lock on the supplemental page
+   tables; see pagedir_promote(). */
+bool
+frame_promote (const void *upage) 
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  uint8_t *base = (uint8_t *) ((uintptr_t) upage & PDMASK);
+  uint8_t *huge;
+  void **old;
+  bool success = false;
+  size_t i;
+
+  if (!frame_huge_pages || !pagedir_huge_candidate (pd, base))
+    return false;
+  huge = palloc_get_aligned (PAL_USER, PAGEDIR_HUGE_CNT, PAGEDIR_HUGE_CNT);
+  if (huge == NULL)
+    return false;
+  old = palloc_get_page (0);
+  if (old == NULL)
+    {
+      palloc_free_multiple (huge, PAGEDIR_HUGE_CNT);
+      return false;
+    }
+  ASSERT (PAGEDIR_HUGE_CNT * sizeof *old <= PGSIZE);
+
+  lock_acquire (&frame_lock);
+  for (i = 0; i < PAGEDIR_HUGE_CNT; i++)
+    {
+      uint8_t *kpage = pagedir_get_page (pd, base + i * PGSIZE);
+
+      if (kpage < frame_base || kpage >= frame_base + frame_cnt * PGSIZE
+          || frame_of (kpage)->pin_cnt > 0)
+        break;
+      old[i] = kpage;
+    }
+  if (i == PAGEDIR_HUGE_CNT && pagedir_promote (pd, base, huge, old))
+    {
+      uint32_t now = timer_ticks ();
+
+      for (i = 0; i < PAGEDIR_HUGE_CNT; i++)
+        {
+          struct frame *f = frame_of (huge + i * PGSIZE);
+
+          frame_of (old[i])->pd = NULL;
+          f->pd = pd;
+          f->upage = base + i * PGSIZE;
+          f->last_use = now;
+        }
+      success = true;
+    }
+  lock_release (&frame_lock);
+
+  if (success)
+    {
+      enum intr_level old_level;
+
+      palloc_free_pages (old, PAGEDIR_HUGE_CNT);
+      old_level = intr_disable ();
+      huge_total++;
+      intr_set_level (old_level);
+    }
+  else
+    palloc_free_multiple (huge, PAGEDIR_HUGE_CNT);
+  palloc_free_page (old);
+  return success;
+}
+
+/* Returns the number of frames in the user pool. */
+size_t
+frame_table_size (void) 
+{
+  return frame_cnt;
+}
+
+/* Returns the IDX'th frame of the user pool if its descriptor's
+   page directory maps it, dirty, not as part of a 4 MB page, and
+   it is not pinned, otherwise a null pointer.  The answer may be
+   stale by the time the caller looks at the frame. */
+void *
+frame_get_dirty (size_t idx) 
+{
+  void *kpage = frame_base + idx * PGSIZE;
+  struct frame *f;
+
+  ASSERT (idx < frame_cnt);
+  lock_acquire (&frame_lock);
+  f = &frames[idx];
+  if (f->pd == NULL || f->pin_cnt > 0
+      || pagedir_get_page (f->pd, f->upage) != kpage
+      || !pagedir_is_dirty (f->pd, f->upage)
+      || pagedir_is_huge (f->pd, f->upage))
+    kpage = NULL;
+  lock_release (&frame_lock);
+  return kpage;
+}
+
+/* Makes the page in user frame KPAGE share frame TARGET instead,
+   copy-on-write, if the two frames hold the same contents, and
+   frees KPAGE.  If TARGET is null, the page shares the zero page
+   instead, if it is all zeros.  Neither frame may be pinned, and
+   each must still be mapped by the page directory its descriptor
+   names; see pagedir_merge() for the rest.  Returns true if
+   successful.
+
+   Holding frame_lock keeps the descriptors, and so the page
+   directories, from going away, and keeps anyone from pinning
+   either frame meanwhile. */
+bool
+frame_merge (void *kpage, void *target) 
+{
+  struct frame *f, *t;
+  bool merged = false;
+
+  lock_acquire (&frame_lock);
+  f = frame_of (kpage);
+  t = target != NULL ? frame_of (target) : NULL;
+  if (f->pd != NULL && f->pin_cnt == 0
+      && (t == NULL || (t->pd != NULL && t->pin_cnt == 0)))
+    merged = pagedir_merge (f->pd, f->upage, kpage,
+                            t != NULL ? t->pd : NULL,
+                            t != NULL ? t->upage : NULL, target);
+  if (merged)
+    f->pd = NULL;
+  lock_release (&frame_lock);
+
+  if (merged)
+    palloc_free_page (kpage);
+  return merged;
+}
+
+/* Records that the running process is to map KPAGE at UPAGE. */
+static void
+add_frame (void *kpage, void *upage) 
+{
+  struct frame *f;
+
+  ASSERT (pg_ofs (upage) == 0);
+  lock_acquire (&frame_lock);
+  f = frame_of (kpage);
+  f->pd = thread_current ()->pagedir;
+  f->upage = upage;
+  f->last_use = timer_ticks ();
+  lock_release (&frame_lock);
+}
+
+/* Returns the descriptor for user frame KPAGE. */
+static struct frame *
+frame_of (void *kpage) 
+{
+  size_t idx = pg_no (kpage) - pg_no (frame_base);
+
+  ASSERT (pg_ofs (kpage) == 0);
+  ASSERT (idx < frame_cnt);
+  return &frames[idx];
+}
+
+/* Runs the clock and frees the frames of the pages it evicts.
+   Returns true if it freed any.
+
+   In the foreground, for a thread that found no free frame, the
+   clock stops at the first old clean page.  Failing that, after
+   two sweeps, the second ignoring the working-set window, it
+   writes out up to SWAP_CLUSTER of the dirty pages it passed.  If
+   it found a clean page, the dirty ones are left for the pager.
+
+   In the BACKGROUND, for the pager, the clock makes at most one
+   sweep, frees old clean pages as it goes, and stops once it has
+   SWAP_CLUSTER of them, or SWAP_CLUSTER dirty pages to write. */
+static bool
+evict (bool background) 
+{
+  struct swap_victim dirty[SWAP_CLUSTER];
+  void *clean[SWAP_CLUSTER];
+  size_t dirty_cnt = 0, clean_cnt = 0, split_cnt = 0, first_slot;
+  size_t clean_max = background ? SWAP_CLUSTER : 1;
+  size_t limit = background ? frame_cnt : 2 * frame_cnt;
+  bool swap = swap_available ();
+  uint32_t now = timer_ticks ();
+  enum intr_level old_level;
+  size_t i;
+
+  lock_acquire (&frame_lock);
+  for (i = 0; i < limit && clean_cnt < clean_max
+         && (!background || dirty_cnt < SWAP_CLUSTER); i++) 
+    {
+      struct frame *f = &frames[hand];
+      void *kpage = frame_base + hand * PGSIZE;
+
+      hand = hand + 1 < frame_cnt ? hand + 1 : 0;
+      if (f->pd == NULL || f->pin_cnt > 0)
+        continue;
+      if (pagedir_is_huge (f->pd, f->upage)
+          && pagedir_get_page (f->pd, f->upage) == kpage)
+        {
+          struct frame *head = f - pt_no (f->upage);
+
+          if (pagedir_age_huge (f->pd, f->upage))
+            {
+              head->last_use = now;
+              continue;
+            }
+          if (now - head->last_use < WS_WINDOW && i < frame_cnt)
+            continue;
+          pagedir_split (f->pd, f->upage);
+          split_cnt++;
+        }
+      if (pagedir_is_accessed (f->pd, f->upage))
+        {
+          pagedir_set_accessed (f->pd, f->upage, false);
+          f->last_use = now;
+          continue;
+        }
+      if (now - f->last_use < WS_WINDOW && i < frame_cnt)
+        continue;
+
+      if (!pagedir_is_dirty (f->pd, f->upage))
+        {
+          if (pagedir_clear_clean (f->pd, f->upage, kpage))
+            {
+              f->pd = NULL;
+              clean[clean_cnt++] = kpage;
+            }
+        }
+      else if (swap && dirty_cnt < SWAP_CLUSTER)
+        {
+          struct swap_victim *v = &dirty[dirty_cnt++];
+          v->pd = f->pd;
+          v->upage = f->upage;
+          v->kpage = kpage;
+        }
+    }
+  if (!background && clean_cnt > 0 && dirty_cnt > 0)
+    {
+      dirty_cnt = 0;
+      wake_pager ();
+    }
+
+  /* Unmap the dirty pages while their descriptors can still be
+     trusted, then write them without holding up everyone else's
+     allocations. */
+  dirty_cnt = swap_out_start (dirty, dirty_cnt, &first_slot);
+  for (i = 0; i < dirty_cnt; i++)
+    frame_of (dirty[i].kpage)->pd = NULL;
+  lock_release (&frame_lock);
+
+  for (i = 0; i < clean_cnt; i++)
+    palloc_free_page (clean[i]);
+  if (dirty_cnt > 0)
+    {
+      swap_out_finish (dirty, dirty_cnt, first_slot);
+      for (i = 0; i < dirty_cnt; i++)
+        palloc_free_page (dirty[i].kpage);
+    }
+
+  old_level = intr_disable ();
+  clean_total += clean_cnt;
+  dirty_total += dirty_cnt;
+  split_total += split_cnt;
+  if (background)
+    pager_total += clean_cnt + dirty_cnt;
+  intr_set_level (old_level);
+  return clean_cnt > 0 || dirty_cnt > 0;
+}
+
+/* Wakes the pager, unless it is awake already. */
+static void
+wake_pager (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  bool wake = !pager_awake;
+
+  pager_awake = true;
+  if (wake)
+    wake_total++;
+  intr_set_level (old_level);
+  if (wake)
+    sema_up (&pager_sema);
+}
+
+/* Pager thread.  Keeps free frames in reserve, so that faults
+   find them without waiting for pages to be written out. */
+static void
+pager (void *aux UNUSED) 
+{
+  for (;;) 
+    {
+      enum intr_level old_level;
+
+      while (palloc_user_free () < free_high && evict (true))
+        continue;
+
+      old_level = intr_disable ();
+      pager_awake = false;
+      intr_set_level (old_level);
+      sema_down (&pager_sema);
+    }
+}
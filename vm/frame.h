@@ -0,0 +1,29 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/palloc.h"
+
+/* -hugepages: Back fully resident 4 MB regions with 4 MB pages? */
+extern bool frame_huge_pages;
+
+void frame_init (void);
+void frame_start_pager (void);
+void frame_print_stats (void);
+void *frame_alloc (enum palloc_flags, void *upage);
+void *frame_try_alloc (void *upage);
+void frame_free (void *kpage);
+void frame_forget (uint32_t *pd, void *kpage);
+void frame_drop (uint32_t *pd, void *upage);
+void *frame_pin (uint32_t *pd, const void *upage, bool write);
+void frame_unpin (void *kpage);
+bool frame_promote (const void *upage);
+
+/* For vm/merge.c. */
+size_t frame_table_size (void);
+void *frame_get_dirty (size_t idx);
+bool frame_merge (void *kpage, void *target);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,181 @@
+#include "vm/merge.h"
+#include <debug.h>
+#include <flatmap.h>
+#include <hash.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/frame.h"
+
+/* Same-page merging.
+
+   Processes running the same program, or simply touching memory
+   they only ever fill with zeros, end up with many frames that
+   hold the same bytes.  With -ksm, a kernel thread at PRI_MIN
+   sweeps the frame table, MERGE_BATCH frames every MERGE_SLEEP
+   ticks, and maps identical pages to a single frame, shared
+   copy-on-write through the same machinery as fork(), so that
+   the next write to one of them gives it a copy again.
+
+   Only dirty pages are looked at.  A clean page can be dropped
+   and read back from its file whenever memory is short, so
+   sharing it gains little, whereas a dirty one would otherwise
+   have to go to swap.  Each frame's contents are hashed with
+   hash_bytes_fast(), and a page is merged only if its hash is the
+   same as on the last sweep, so that pages that are still being
+   written, which would soon be copied again, are left alone.
+   Within a sweep, `seen' maps each stable hash to the first
+   frame found with it, and a later frame with the same hash is
+   merged into that one if their contents turn out to match.  An
+   all-zero page shares the zero page that pagedir.c keeps.
+
+   A shared frame is never evicted, so merged pages stay in
+   memory until their processes write them or exit. */
+
+/* Frames scanned between sleeps. */
+#define MERGE_BATCH 64
+
+/* Ticks to sleep between batches. */
+#define MERGE_SLEEP (TIMER_FREQ / 10)
+
+static size_t frame_cnt;        /* Frames in the user pool. */
+static unsigned *sums;          /* Per frame: hash on the last sweep. */
+static struct flatmap seen;     /* This sweep: hash -> frame index + 1. */
+static unsigned zero_sum;       /* Hash of a page of zeros. */
+static bool running;            /* Thread started? */
+
+/* Statistics, updated with interrupts off. */
+static unsigned long long scan_cnt;     /* Frames hashed. */
+static unsigned long long pass_cnt;     /* Sweeps completed. */
+static unsigned long long merge_cnt;    /* Frames freed by merging. */
+static unsigned long long zero_cnt;     /* Of those, into the zero page. */
+
+static thread_func scanner;
+
+/* Starts merging identical user pages in the background. */
+void
+merge_start (void) 
+{
+  static const uint8_t zeros[PGSIZE];
+  size_t i;
+
+  frame_cnt = frame_table_size ();
+  sums = malloc (frame_cnt * sizeof *sums);
+  if (sums == NULL || !flatmap_init (&seen, 0))
+    PANIC ("merge_start: out of memory");
+  for (i = 0; i < frame_cnt; i++)
+    sums[i] = 0;
+  zero_sum = hash_bytes_fast (zeros, PGSIZE);
+
+  running = true;
+  if (thread_create ("merge", PRI_MIN, scanner, NULL) == TID_ERROR)
+    PANIC ("merge_start: cannot start thread");
+}
+
+/* Adds 1 to statistic *CNT. */
+static void
+count (unsigned long long *cnt) 
+{
+  enum intr_level old_level = intr_disable ();
+  (*cnt)++;
+  intr_set_level (old_level);
+}
+
+/* Looks at frame IDX, merging its page with an identical one if
+   it has stayed the same since the last sweep. */
+static void
+scan_frame (size_t idx) 
+{
+  void *kpage = frame_get_dirty (idx);
+  void *other;
+  size_t other_idx;
+  unsigned sum;
+
+  if (kpage == NULL)
+    {
+      sums[idx] = 0;
+      return;
+    }
+  sum = hash_bytes_fast (kpage, PGSIZE);
+  count (&scan_cnt);
+  if (sum != sums[idx])
+    {
+      sums[idx] = sum;
+      return;
+    }
+
+  if (sum == zero_sum && frame_merge (kpage, NULL))
+    {
+      sums[idx] = 0;
+      count (&merge_cnt);
+      count (&zero_cnt);
+      return;
+    }
+
+  other_idx = (uintptr_t) flatmap_find (&seen, sum);
+  if (other_idx-- == 0 || other_idx == idx)
+    {
+      flatmap_insert (&seen, sum, (void *) (idx + 1));
+      return;
+    }
+
+  /* Merge this frame into the earlier one.  If this one is a
+     frame merged on an earlier sweep, merge the other way. */
+  other = frame_get_dirty (other_idx);
+  if (other == NULL)
+    {
+      flatmap_insert (&seen, sum, (void *) (idx + 1));
+      return;
+    }
+  if (frame_merge (kpage, other))
+    sums[idx] = 0;
+  else if (frame_merge (other, kpage))
+    {
+      sums[other_idx] = 0;
+      flatmap_insert (&seen, sum, (void *) (idx + 1));
+    }
+  else
+    return;
+  count (&merge_cnt);
+}
+
+/* Sweeps the frame table forever. */
+static void
+scanner (void *aux UNUSED) 
+{
+  size_t idx = 0;
+
+  for (;;) 
+    {
+      size_t i;
+
+      for (i = 0; i < MERGE_BATCH; i++)
+        {
+          scan_frame (idx);
+          if (++idx == frame_cnt)
+            {
+              idx = 0;
+              flatmap_destroy (&seen);
+              while (!flatmap_init (&seen, 0))
+                timer_sleep (MERGE_SLEEP);
+              count (&pass_cnt);
+            }
+        }
+      timer_sleep (MERGE_SLEEP);
+    }
+}
+
+/* Prints same-page merging statistics. */
+void
+merge_print_stats (void) 
+{
+  if (!running)
+    return;
+  printf ("Merge: %llu pages hashed in %llu sweeps, "
+          "%llu frames freed, %llu into the zero page\n",
+          scan_cnt, pass_cnt, merge_cnt, zero_cnt);
+}
@@ -0,0 +1,248 @@
+#include "vm/mmap.h"
+#include <list.h>
+#include <round.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/uaccess.h"
+#include "vm/page.h"
+
+/* Memory-mapped files.
+
+   mmap() reads nothing.  It records each page of the mapping in
+   the supplemental page table, as load() does for a program's
+   segments, and page_in() reads a page through the buffer cache
+   the first time it is touched.  Under memory pressure a clean
+   page is dropped and read again later, and a dirty one goes to
+   swap like any other.  A page that is only read is mapped from
+   a frame shared with every other process that has read the same
+   page of the same file, until it writes the page; see
+   vm/page.c.
+
+   munmap(), and exit, write back only the pages the process has
+   written: those whose page table entries are dirty, or that
+   were swapped out, which they only are if dirty.  A run of
+   adjacent dirty pages is written with one call, so the file
+   system sees one request for as many sectors as it can take at
+   once.  The pages are written from where the process maps them,
+   pinned first so that the copy cannot fault.
+
+   Each process has a list of its mappings in its leader's struct
+   thread.  A forked child inherits copies of them, backed by its
+   own handles on the files. */
+
+/* A memory-mapped file. */
+struct mapping
+  {
+    struct list_elem elem;      /* In the process's `mappings'. */
+    int id;                     /* Mapping id returned by mmap(). */
+    struct file *file;          /* Own handle on the file. */
+    uint8_t *addr;              /* First page mapped. */
+    off_t length;               /* Bytes mapped. */
+  };
+
+/* Protects every process's list of mappings. */
+static struct lock mmap_lock;
+
+static struct mapping *new_mapping (struct file *, void *addr,
+                                    off_t length);
+static void unmap (struct mapping *);
+static void write_back (struct mapping *);
+static bool is_dirty (uint32_t *pd, const void *upage);
+
+/* Initializes memory-mapped files. */
+void
+mmap_init (void) 
+{
+  lock_init (&mmap_lock);
+}
+
+/* Maps FILE into the running process starting at ADDR, and
+   returns the mapping's id, or -1 if ADDR is not a page boundary
+   in user memory, if FILE is empty, if some page of the mapping
+   is in use already, or if memory is short. */
+int
+mmap_map (struct file *file, void *addr) 
+{
+  struct thread *t = thread_current ()->leader;
+  off_t length = file_length (file);
+  struct mapping *m;
+
+  if (addr == NULL || pg_ofs (addr) != 0 || length == 0
+      || !user_range_ok (addr, length))
+    return -1;
+
+  m = new_mapping (file, addr, length);
+  if (m == NULL)
+    return -1;
+  if (!page_add_range (addr, m->file, length)) 
+    {
+      file_close (m->file);
+      free (m);
+      return -1;
+    }
+
+  lock_acquire (&mmap_lock);
+  m->id = t->next_mapid++;
+  list_push_back (&t->mappings, &m->elem);
+  lock_release (&mmap_lock);
+  return m->id;
+}
+
+/* Unmaps the running process's mapping with the given MAPID, if
+   it has one, writing back the pages it has written. */
+void
+mmap_unmap (int mapid) 
+{
+  struct thread *t = thread_current ()->leader;
+  struct mapping *m = NULL;
+  struct list_elem *e;
+
+  lock_acquire (&mmap_lock);
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    if (list_entry (e, struct mapping, elem)->id == mapid)
+      {
+        m = list_entry (e, struct mapping, elem);
+        list_remove (&m->elem);
+        break;
+      }
+  lock_release (&mmap_lock);
+
+  if (m != NULL)
+    unmap (m);
+}
+
+/* Gives the running process, a new child of PARENT, a copy of
+   each of PARENT's mappings, for fork().  The child then shares
+   PARENT's pages copy-on-write through pagedir_fork(), like the
+   rest of its memory.  Returns false if memory is short; the
+   mappings copied so far are undone by mmap_exit(). */
+bool
+mmap_fork (struct thread *parent) 
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+  bool success = true;
+
+  lock_acquire (&mmap_lock);
+  for (e = list_begin (&parent->mappings);
+       e != list_end (&parent->mappings) && success; e = list_next (e))
+    {
+      struct mapping *pm = list_entry (e, struct mapping, elem);
+      struct mapping *m = new_mapping (pm->file, pm->addr, pm->length);
+
+      if (m != NULL && page_add_range (m->addr, m->file, m->length))
+        {
+          m->id = pm->id;
+          list_push_back (&t->mappings, &m->elem);
+        }
+      else
+        {
+          if (m != NULL)
+            {
+              file_close (m->file);
+              free (m);
+            }
+          success = false;
+        }
+    }
+  t->next_mapid = parent->next_mapid;
+  lock_release (&mmap_lock);
+  return success;
+}
+
+/* Unmaps every mapping of the running process, which is exiting
+   and has no other threads left.  Must be called while its page
+   directory and supplemental page table still exist. */
+void
+mmap_exit (void) 
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mappings))
+    unmap (list_entry (list_pop_front (&t->mappings),
+                       struct mapping, elem));
+}
+
+/* Returns a new mapping of LENGTH bytes of FILE at ADDR, with its
+   own handle on FILE, or a null pointer if memory is short. */
+static struct mapping *
+new_mapping (struct file *file, void *addr, off_t length) 
+{
+  struct mapping *m = malloc (sizeof *m);
+
+  if (m == NULL)
+    return NULL;
+  m->file = file_reopen (file);
+  if (m->file == NULL)
+    {
+      free (m);
+      return NULL;
+    }
+  m->addr = addr;
+  m->length = length;
+  return m;
+}
+
+/* Writes back and unmaps M, which is no longer on its process's
+   list, and frees it. */
+static void
+unmap (struct mapping *m) 
+{
+  write_back (m);
+  page_remove_range (m->addr, DIV_ROUND_UP (m->length, PGSIZE));
+  file_close (m->file);
+  free (m);
+}
+
+/* Writes each page of M that the process has written back to
+   M's file, a run of up to PAGE_PIN_MAX adjacent pages at a
+   time.  A run that cannot be brought in, because memory is
+   short, is lost. */
+static void
+write_back (struct mapping *m) 
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  size_t page_cnt = DIV_ROUND_UP (m->length, PGSIZE);
+  size_t i = 0;
+
+  while (i < page_cnt) 
+    {
+      void *kpages[PAGE_PIN_MAX];
+      size_t start = i, pin_cnt;
+      off_t ofs, end;
+
+      while (i < page_cnt && i - start < PAGE_PIN_MAX
+             && is_dirty (pd, m->addr + i * PGSIZE))
+        i++;
+      if (i == start)
+        {
+          i++;
+          continue;
+        }
+
+      ofs = start * PGSIZE;
+      end = i * PGSIZE;
+      if (end > m->length)
+        end = m->length;
+      pin_cnt = page_pin (m->addr + ofs, end - ofs, false, kpages);
+      if (pin_cnt == 0)
+        continue;
+      file_write_at_user (m->file, m->addr + ofs, end - ofs, ofs);
+      page_unpin (kpages, pin_cnt);
+    }
+}
+
+/* Returns true if UPAGE in PD differs from what the file holds,
+   as far as we know. */
+static bool
+is_dirty (uint32_t *pd, const void *upage) 
+{
+  size_t slot;
+
+  return pagedir_is_dirty (pd, upage) || pagedir_get_swap (pd, upage, &slot);
+}
@@ -0,0 +1,15 @@
+#ifndef VM_MMAP_H
+#define VM_MMAP_H
+
+#include <stdbool.h>
+
+struct file;
+struct thread;
+
+void mmap_init (void);
+int mmap_map (struct file *, void *addr);
+void mmap_unmap (int mapid);
+bool mmap_fork (struct thread *parent);
+void mmap_exit (void);
+
+#endif /* vm/mmap.h */
@@ -0,0 +1,1002 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/copy.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/* Supplemental page table.
+
+   load() does not read a program's segments into memory.  It
+   only records here, for each page, where the page's contents
+   come from.  The first access to the page faults, and
+   page_in() then allocates a frame, fills it from the
+   executable (or with zeros, for BSS), and maps it.  Pages that
+   are never touched are never read.  A process that faults its
+   way through a file in order has the following pages brought in
+   along with each fault; see fault_around().
+
+   Each process has its own table, a flat map from user page
+   number to entry in its leader's struct thread, so that a fault
+   finds its page's entry in one probe or a few, and tearing the
+   table down is one sweep over the map's array.  The process's threads can
+   grow the heap, and fault on the same page, at the same time,
+   so page_lock protects the tables and serializes mapping the
+   frames brought in.
+
+   Memory-mapped files are recorded here too, page by page, by
+   vm/mmap.c, which also takes them out again.
+
+   Read-only pages backed by a file are also shared between
+   processes: every process running the same executable maps the
+   same frame for a given text page.  Those frames are tracked,
+   with a reference count, in a global table keyed by inode and
+   file offset.  Pages of memory-mapped files are shared the same
+   way when they are first read, so that processes mapping the
+   same file keep one copy of it, and mapped read-only; the first
+   write gives the writer a frame of its own, in page_unshare().
+   Executables cannot be written while they run, but mapped files
+   can, so each shared frame records the version of the inode it
+   was read at.  Once the inode changes, the frame is stale: the
+   processes mapping it keep it, as they would a frame of their
+   own, but it is moved out of the table and later faults read
+   the file afresh.
+
+   The other frames page_in() brings in come from the frame
+   table, which may take them back under memory pressure.  The
+   page's entry here stays, so the next access faults the page in
+   again: from swap, if the page was dirty and its page table
+   entry names a swap slot, or else from where it first came
+   from. */
+
+/* Most pages fault_around() brings in after a fault. */
+#define FAULT_AROUND_MAX 16
+
+/* Where a user page's contents come from.  A process has one of
+   these for every page of its image and heap, so it is kept to
+   16 bytes.  Whether the page is resident, or swapped out, is
+   up to its page table entry. */
+struct page
+  {
+    void *upage;                /* User virtual address. */
+    struct file *file;          /* File to read, or null to zero. */
+    off_t ofs;                  /* Offset in FILE. */
+    uint16_t read_bytes;        /* Bytes to read; the rest is zeroed. */
+    bool writable;              /* Map the page writable? */
+    bool shared;                /* Mapped to a shared frame? */
+  };
+
+/* A frame holding a read-only file page for all the processes
+   that map it. */
+struct shared_frame
+  {
+    struct hash_elem elem;      /* Element in `shared_frames'. */
+    struct list_elem stale_elem; /* Element in `stale_frames'. */
+    block_sector_t inumber;     /* Inode of the file. */
+    off_t ofs;                  /* Offset in the file. */
+    uint32_t read_bytes;        /* Bytes read; the rest is zeros. */
+    unsigned version;           /* inode_get_version() when read. */
+    bool stale;                 /* In `stale_frames'? */
+    void *kpage;                /* The frame. */
+    int ref_cnt;                /* Number of pages mapping it. */
+  };
+
+/* Shared frames, those that have gone stale but are still
+   mapped, and the lock that protects them. */
+static struct hash shared_frames;
+static struct list stale_frames;
+static struct lock shared_lock;
+
+/* Protects supplemental page tables and mapping pages in. */
+static struct lock page_lock;
+
+/* Supplemental page table entries. */
+static struct kmem_cache *page_cache;
+
+/* Statistics, updated with interrupts off.  Pages brought in
+   around a fault count only in `around_cnt'. */
+static unsigned long long file_cnt;     /* Faults that read a file. */
+static unsigned long long around_cnt;   /* Pages brought in around faults. */
+static unsigned long long reuse_cnt;    /* Shared frames found in memory. */
+static unsigned long long zero_cnt;     /* Zero pages mapped or filled. */
+static unsigned long long swap_cnt;     /* Faults served from swap. */
+static unsigned long long stack_cnt;    /* Stack pages added. */
+
+static hash_hash_func shared_frame_hash;
+static hash_less_func shared_frame_less;
+static void *get_shared_frame (struct page *, bool *reused);
+static void ref_shared_frame (struct page *, void *kpage);
+static void put_shared_frame (struct page *, void *kpage);
+static struct shared_frame *find_shared_frame (struct page *, void *kpage);
+static void retire_shared_frame (struct shared_frame *);
+static bool fork_shared (struct thread *parent, struct page *pp);
+static bool read_page (struct page *, uint8_t *kpage);
+static void count (unsigned long long *);
+static bool fetch_page (struct page *, bool write, bool around);
+static void fault_around (struct page *);
+static size_t release_held (struct pagedir_batch *, struct page *held[],
+                            void *kpages[], size_t cnt);
+static bool add_page (void *upage, struct file *, off_t ofs,
+                      uint32_t read_bytes, bool writable);
+static void promote (const void *upage);
+
+/* Prints paging statistics.  Major faults are those that read
+   a page from a file or from swap; minor ones found it in memory
+   or filled it with zeros.  Pages brought in for a system call's
+   buffer count as faults too. */
+void
+page_print_stats (void) 
+{
+  printf ("Page: %llu major faults, %llu minor, "
+          "%llu pages brought in around them\n",
+          file_cnt + swap_cnt, reuse_cnt + zero_cnt, around_cnt);
+  printf ("Page: %llu from files, %llu from swap, "
+          "%llu shared frames reused, %llu zero, %llu stack pages added\n",
+          file_cnt, swap_cnt, reuse_cnt, zero_cnt, stack_cnt);
+}
+
+/* Adds 1 to statistic *CNT. */
+static void
+count (unsigned long long *cnt) 
+{
+  enum intr_level old_level = intr_disable ();
+  (*cnt)++;
+  intr_set_level (old_level);
+}
+
+/* Initializes the table of shared frames. */
+void
+page_init (void) 
+{
+  if (!hash_init (&shared_frames, shared_frame_hash, shared_frame_less, NULL))
+    PANIC ("page_init: out of memory");
+  list_init (&stale_frames);
+  lock_init (&shared_lock);
+  lock_init (&page_lock);
+  page_cache = kmem_cache_create ("page", sizeof (struct page), 0, NULL);
+}
+
+/* Initializes the current process's supplemental page table.
+   Returns false if memory is short. */
+bool
+page_table_init (void) 
+{
+  return flatmap_init (&thread_current ()->pages, 16);
+}
+
+/* Frees PAGES, the supplemental page table of an exited process
+   whose page directory was PD.  Shared frames are unmapped and
+   released here; other frames belong to the page directory,
+   which frees them when it is destroyed, so this must be called
+   before pagedir_destroy(). */
+void
+page_table_destroy (struct flatmap *pages, uint32_t *pd) 
+{
+  struct pagedir_batch batch;
+  struct page *held[PAGEDIR_BATCH_MAX];
+  void *kpages[PAGEDIR_BATCH_MAX];
+  size_t held_cnt = 0;
+  struct flatmap_slot *s;
+
+  /* Unmap the shared frames, holding on to each until no stale
+     TLB entry can reach it. */
+  pagedir_batch_init (&batch, pd);
+  for (s = flatmap_first (pages); s != NULL; s = flatmap_next (pages, s))
+    {
+      struct page *p = s->value;
+
+      if (!p->shared)
+        {
+          kmem_cache_free (page_cache, p);
+          continue;
+        }
+      kpages[held_cnt] = pagedir_get_page (pd, p->upage);
+      held[held_cnt++] = p;
+      pagedir_batch_clear_page (&batch, p->upage);
+      if (held_cnt == PAGEDIR_BATCH_MAX)
+        held_cnt = release_held (&batch, held, kpages, held_cnt);
+    }
+  release_held (&batch, held, kpages, held_cnt);
+  flatmap_destroy (pages);
+}
+
+/* Flushes BATCH, then releases the CNT shared frames in KPAGES[]
+   and frees the entries in HELD[] that mapped them.  Returns 0,
+   the new number of held entries. */
+static size_t
+release_held (struct pagedir_batch *batch, struct page *held[],
+              void *kpages[], size_t cnt) 
+{
+  size_t i;
+
+  pagedir_batch_flush (batch);
+  for (i = 0; i < cnt; i++)
+    {
+      put_shared_frame (held[i], kpages[i]);
+      kmem_cache_free (page_cache, held[i]);
+    }
+  return 0;
+}
+
+/* Copies PARENT's supplemental page table into the running
+   process, a new child of PARENT whose `exec_file' is already
+   open, for fork().  Pages PARENT has mapped from shared frames
+   are mapped into the child from the same frames; the rest are
+   left for pagedir_fork(), or to be paged in on demand.  Entries
+   for pages of memory-mapped files are left to mmap_fork(),
+   which must have added them already.  Returns false if memory
+   is short. */
+bool
+page_fork (struct thread *parent) 
+{
+  struct thread *t = thread_current ();
+  struct flatmap_slot *s;
+  bool success = true;
+
+  lock_acquire (&page_lock);
+  for (s = flatmap_first (&parent->pages); s != NULL && success;
+       s = flatmap_next (&parent->pages, s))
+    {
+      struct page *pp = s->value;
+
+      if (pp->file != NULL && pp->file != parent->exec_file)
+        {
+          if (pp->shared)
+            success = fork_shared (parent, pp);
+          continue;
+        }
+      if (!add_page (pp->upage, t->exec_file, pp->ofs, pp->read_bytes,
+                     pp->writable))
+        success = false;
+      else if (pp->shared)
+        success = fork_shared (parent, pp);
+    }
+  lock_release (&page_lock);
+  return success;
+}
+
+/* Maps the shared frame that PARENT maps for its page PP into
+   the running process, a new child of PARENT, at the child's
+   entry for the same page.  Returns false if memory is short.
+   The caller must hold page_lock. */
+static bool
+fork_shared (struct thread *parent, struct page *pp) 
+{
+  struct thread *t = thread_current ();
+  void *kpage = pagedir_get_page (parent->pagedir, pp->upage);
+  struct page *p = flatmap_find (&t->pages, pg_no (pp->upage));
+
+  ASSERT (p != NULL);
+  ref_shared_frame (p, kpage);
+  if (!pagedir_set_page (t->pagedir, p->upage, kpage, false))
+    {
+      put_shared_frame (p, kpage);
+      return false;
+    }
+  p->shared = true;
+  return true;
+}
+
+/* Records that user page UPAGE is to hold READ_BYTES bytes of
+   FILE starting at offset OFS, followed by zeros.  FILE must
+   stay open until the table is destroyed.  Returns false if
+   UPAGE already has an entry or if memory is short. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs,
+               uint32_t read_bytes, bool writable) 
+{
+  bool success;
+
+  lock_acquire (&page_lock);
+  success = add_page (upage, file, ofs, read_bytes, writable);
+  lock_release (&page_lock);
+  return success;
+}
+
+/* Records that the pages starting at UPAGE are to hold the
+   first LENGTH bytes of FILE, followed by zeros to the end of the
+   last page, and be writable, for mmap().  FILE must stay open
+   until the pages are removed with page_remove_range().  Returns
+   false, recording nothing, if any of the pages is in use
+   already or if memory is short. */
+bool
+page_add_range (void *upage, struct file *file, off_t length) 
+{
+  struct thread *t = thread_current ();
+  size_t page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  uint8_t *first = upage;
+  size_t i;
+
+  lock_acquire (&page_lock);
+  for (i = 0; i < page_cnt; i++)
+    if (flatmap_find (&t->leader->pages, pg_no (first) + i) != NULL
+        || pagedir_get_page (t->pagedir, first + i * PGSIZE) != NULL)
+      {
+        lock_release (&page_lock);
+        return false;
+      }
+  for (i = 0; i < page_cnt; i++) 
+    {
+      off_t ofs = i * PGSIZE;
+      uint32_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+      if (!add_page (first + ofs, file, ofs, read_bytes, true))
+        {
+          lock_release (&page_lock);
+          page_remove_range (upage, i);
+          return false;
+        }
+    }
+  lock_release (&page_lock);
+  return true;
+}
+
+/* Removes the PAGE_CNT pages starting at UPAGE from the running
+   process, releasing their frames and swap slots, and forgets
+   where their contents came from.  Pages without entries are
+   left alone. */
+void
+page_remove_range (void *upage, size_t page_cnt) 
+{
+  struct thread *t = thread_current ();
+  uint8_t *first = upage;
+  size_t i;
+
+  lock_acquire (&page_lock);
+  for (i = 0; i < page_cnt; i++) 
+    {
+      struct page *p = flatmap_remove (&t->leader->pages,
+                                       pg_no (first) + i);
+
+      if (p == NULL)
+        continue;
+      if (p->shared)
+        {
+          void *kpage = pagedir_get_page (t->pagedir, p->upage);
+
+          pagedir_clear_page (t->pagedir, p->upage);
+          put_shared_frame (p, kpage);
+        }
+      else
+        pagedir_unmap (t->pagedir, p->upage);
+      kmem_cache_free (page_cache, p);
+    }
+  lock_release (&page_lock);
+}
+
+/* Does the work of page_add_file().  The caller must hold
+   page_lock. */
+static bool
+add_page (void *upage, struct file *file, off_t ofs,
+          uint32_t read_bytes, bool writable) 
+{
+  struct thread *t = thread_current ()->leader;
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (read_bytes <= PGSIZE);
+
+  if (flatmap_find (&t->pages, pg_no (upage)) != NULL)
+    return false;
+  p = kmem_cache_alloc (page_cache);
+  if (p == NULL)
+    return false;
+  if (!flatmap_insert (&t->pages, pg_no (upage), p))
+    {
+      kmem_cache_free (page_cache, p);
+      return false;
+    }
+  p->upage = upage;
+  p->file = read_bytes > 0 ? file : NULL;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  p->writable = writable;
+  p->shared = false;
+  return true;
+}
+
+/* Records that user page UPAGE is to be zero-filled. */
+bool
+page_add_zero (void *upage, bool writable) 
+{
+  return page_add_file (upage, NULL, 0, 0, writable);
+}
+
+/* Grows the running process's stack to cover FAULT_ADDR, which
+   was not present and has no entry in the table, if FAULT_ADDR
+   looks like a stack access given ESP, the user stack pointer:
+   no more than 32 bytes below it, as far as PUSHA reaches before
+   moving it, and within STACK_MAX of the top of user memory.
+   ESP may be null if it is not known.  WRITE is as for
+   page_in().  Returns true if the page is now mapped. */
+bool
+page_grow_stack (const void *fault_addr, const void *esp, bool write) 
+{
+  if (thread_current ()->pagedir == NULL || esp == NULL
+      || (const uint8_t *) fault_addr + 32 < (const uint8_t *) esp
+      || !is_user_vaddr (fault_addr)
+      || (const uint8_t *) fault_addr < (uint8_t *) PHYS_BASE - STACK_MAX)
+    return false;
+
+  /* Another thread of the process may have just added the page,
+     so add_page() failing is fine as long as page_in() succeeds. */
+  if (page_add_zero (pg_round_down (fault_addr), true))
+    count (&stack_cnt);
+  return page_in (fault_addr, write);
+}
+
+/* Brings in the page containing FAULT_ADDR, which was not
+   present, for a read or, if WRITE is true, a write, if the
+   current process's table has an entry for it.
+   Returns true if the page is now mapped, false if the access
+   was invalid or memory is short. */
+bool
+page_in (const void *fault_addr, bool write) 
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+  size_t slot;
+  bool mapped;
+
+  if (t->pagedir == NULL || !is_user_vaddr (fault_addr))
+    return false;
+  if (pagedir_get_swap (t->pagedir, fault_addr, &slot))
+    {
+      if (!swap_in (pg_round_down (fault_addr), slot))
+        return false;
+      count (&swap_cnt);
+      process_count_fault (true);
+      promote (fault_addr);
+      return true;
+    }
+  lock_acquire (&page_lock);
+  p = flatmap_find (&t->leader->pages, pg_no (fault_addr));
+  mapped = p != NULL && pagedir_get_page (t->pagedir, p->upage) != NULL;
+
+  /* Reading a page that starts out as zeros maps the shared zero
+     page, until a write gives the process a frame of its own. */
+  if (p != NULL && !mapped && p->file == NULL && !write
+      && pagedir_map_zero (t->pagedir, p->upage, p->writable))
+    {
+      mapped = true;
+      count (&zero_cnt);
+      process_count_fault (false);
+    }
+  lock_release (&page_lock);
+  if (p == NULL || mapped)
+    return mapped;
+
+  if (!fetch_page (p, write, false))
+    return false;
+  if (p->file != NULL)
+    fault_around (p);
+  promote (fault_addr);
+  return true;
+}
+
+/* Gives the running process a frame of its own for the page
+   containing FAULT_ADDR, on a write fault, if the page belongs
+   to a mapped file and is mapped read-only from a shared frame.
+   Returns true if the write can now be retried, false if the
+   page is not such a page or memory is short. */
+bool
+page_unshare (const void *fault_addr) 
+{
+  struct thread *t = thread_current ();
+  void *upage = pg_round_down (fault_addr);
+  struct page *p;
+  void *kpage, *old;
+  bool success;
+
+  if (t->pagedir == NULL || !is_user_vaddr (fault_addr))
+    return false;
+  lock_acquire (&page_lock);
+  p = flatmap_find (&t->leader->pages, pg_no (upage));
+  success = p != NULL && p->shared && p->writable;
+  lock_release (&page_lock);
+  if (!success)
+    return false;
+
+  /* Allocate the frame first, since that may have to evict. */
+  kpage = frame_alloc (0, upage);
+  if (kpage == NULL)
+    return false;
+
+  /* Another thread of the process may have unshared or unmapped
+     the page meanwhile. */
+  lock_acquire (&page_lock);
+  p = flatmap_find (&t->leader->pages, pg_no (upage));
+  if (p != NULL && p->shared)
+    {
+      old = pagedir_get_page (t->pagedir, upage);
+      block_copy (kpage, old, PGSIZE);
+      pagedir_clear_page (t->pagedir, upage);
+      success = pagedir_set_page (t->pagedir, upage, kpage, true);
+      if (success)
+        {
+          p->shared = false;
+          put_shared_frame (p, old);
+          kpage = NULL;
+        }
+      else if (!pagedir_set_page (t->pagedir, upage, old, false))
+        PANIC ("page_unshare: cannot map page back");
+    }
+  else
+    success = p != NULL && pagedir_is_writable (t->pagedir, upage);
+  lock_release (&page_lock);
+
+  if (kpage != NULL)
+    frame_free (kpage);
+  return success;
+}
+
+/* With -hugepages, maps the 4 MB region around UPAGE, where
+   page_in() has just brought in a page, with a 4 MB page if it
+   is now resident in full.  See frame_promote(). */
+static void
+promote (const void *upage) 
+{
+  if (!frame_huge_pages
+      || !pagedir_huge_candidate (thread_current ()->pagedir, upage))
+    return;
+  lock_acquire (&page_lock);
+  frame_promote (upage);
+  lock_release (&page_lock);
+}
+
+/* Fills a frame for page P of the running process and maps it,
+   for a write if WRITE is true.  If AROUND is true, P is being
+   brought in ahead of a fault, and only a frame that is already
+   free will do.  Returns true if P is mapped, or swapped out,
+   afterward, false if memory is short. */
+static bool
+fetch_page (struct page *p, bool write, bool around) 
+{
+  struct thread *t = thread_current ();
+  uint8_t *kpage;
+  size_t slot;
+  bool shared, reused, mapped, success;
+
+  /* Fill a frame without holding page_lock, so that reading the
+     file does not hold up the process's other threads.  A page
+     of a mapped file is shared if it is only being read, but can
+     do without if there is no free frame to share. */
+  shared = (p->file != NULL
+            && (!p->writable
+                || (!write && p->file != t->leader->exec_file)));
+  reused = false;
+  if (shared)
+    {
+      kpage = get_shared_frame (p, &reused);
+      if (kpage == NULL && p->writable)
+        shared = false;
+    }
+  if (!shared)
+    {
+      if (around)
+        kpage = frame_try_alloc (p->upage);
+      else
+        kpage = frame_alloc (p->file == NULL ? PAL_ZERO : 0, p->upage);
+      if (kpage != NULL && p->file != NULL && !read_page (p, kpage))
+        {
+          frame_free (kpage);
+          kpage = NULL;
+        }
+    }
+  if (kpage == NULL)
+    return false;
+  if (!around)
+    {
+      count (p->file == NULL ? &zero_cnt : reused ? &reuse_cnt : &file_cnt);
+      process_count_fault (p->file != NULL && !reused);
+    }
+
+  /* Another thread of the process may have faulted on the same
+     page and mapped it meanwhile, and it may even have been
+     swapped out again since. */
+  lock_acquire (&page_lock);
+  mapped = false;
+  if (pagedir_get_page (t->pagedir, p->upage) != NULL
+      || pagedir_get_swap (t->pagedir, p->upage, &slot))
+    success = true;
+  else if (pagedir_set_page (t->pagedir, p->upage, kpage,
+                             !shared && p->writable))
+    {
+      p->shared = shared;
+      mapped = success = true;
+    }
+  else
+    success = false;
+  lock_release (&page_lock);
+
+  if (!mapped)
+    {
+      if (shared)
+        put_shared_frame (p, kpage);
+      else
+        frame_free (kpage);
+    }
+  return success;
+}
+
+/* Having just brought in file page P of the running process on
+   a fault, brings in some of the pages that follow it from the
+   same file, as long as they are not in memory already and there
+   are free frames for them.
+
+   How many depends on how the process has been faulting.  A
+   fault on the page right after the last batch brought in
+   doubles the window, up to FAULT_AROUND_MAX pages; any other
+   fault halves it.  A sequential scan thus soon takes one fault
+   per FAULT_AROUND_MAX + 1 pages, while random access reads
+   little it does not ask for.  The window belongs to the whole
+   process and is only a hint, so its threads update it without
+   locking. */
+static void
+fault_around (struct page *p) 
+{
+  struct thread *t = thread_current ()->leader;
+  uint8_t *upage = (uint8_t *) p->upage + PGSIZE;
+  unsigned window = t->fault_window;
+  unsigned i;
+
+  if (p->upage == t->fault_next)
+    window = window == 0 ? 1 : window * 2;
+  else
+    window /= 2;
+  if (window > FAULT_AROUND_MAX)
+    window = FAULT_AROUND_MAX;
+  t->fault_window = window;
+
+  for (i = 0; i < window && is_user_vaddr (upage); i++, upage += PGSIZE) 
+    {
+      struct page *q;
+      size_t slot;
+      bool ok;
+
+      lock_acquire (&page_lock);
+      q = flatmap_find (&t->pages, pg_no (upage));
+      ok = (q != NULL && q->file == p->file
+            && pagedir_get_page (t->pagedir, upage) == NULL
+            && !pagedir_get_swap (t->pagedir, upage, &slot));
+      lock_release (&page_lock);
+      if (!ok || !fetch_page (q, false, true))
+        break;
+      count (&around_cnt);
+    }
+  t->fault_next = upage;
+}
+
+/* Makes the SIZE bytes of user memory at UADDR resident, and
+   writable if WRITE is true, and pins their frames so that they
+   cannot be evicted until page_unpin() is called.  The range
+   must be nonempty and span no more than PAGE_PIN_MAX pages.
+   Stores the frames into KPAGES and returns how many there are,
+   or returns 0, with nothing pinned, if some page of the range
+   is not valid user memory. */
+size_t
+page_pin (const void *uaddr, size_t size, bool write, void *kpages[]) 
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  const uint8_t *addr = uaddr;
+  const uint8_t *end = addr + size;
+  size_t cnt = 0;
+
+  ASSERT (size > 0);
+  ASSERT (pg_no (end - 1) - pg_no (addr) < PAGE_PIN_MAX);
+  if (pd == NULL)
+    return 0;
+
+  /* Fault each page in, the way an access would, until it can be
+     pinned.  It may be evicted again before then, so retry. */
+  for (; addr < end; addr = pg_round_down (addr) + PGSIZE) 
+    {
+      void *upage = pg_round_down (addr);
+      void *kpage;
+
+      while ((kpage = frame_pin (pd, upage, write)) == NULL)
+        {
+          bool ok;
+
+          if (pagedir_get_page (pd, upage) != NULL)
+            ok = write && (pagedir_cow_fault (pd, upage)
+                           || page_unshare (upage));
+          else
+            ok = (page_in (addr, write)
+                  || page_grow_stack (addr, thread_current ()->user_esp,
+                                      write));
+          if (!ok)
+            {
+              page_unpin (kpages, cnt);
+              return 0;
+            }
+        }
+      kpages[cnt++] = kpage;
+    }
+  return cnt;
+}
+
+/* Unpins the CNT frames in KPAGES, as returned by page_pin(). */
+void
+page_unpin (void *kpages[], size_t cnt) 
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    frame_unpin (kpages[i]);
+}
+
+/* Gets the PAGE_CNT pages starting at UPAGE on their way into
+   memory, because the running process is about to use them.
+   The data of a page that comes from a file is queued to be read
+   into the buffer cache in the background, so that the fault
+   that maps it need not wait for the disk; a page in swap, which
+   has no such queue, is brought in now.  Resident pages, pages
+   that start out as zeros and pages without entries are left
+   alone. */
+void
+page_willneed (void *upage, size_t page_cnt) 
+{
+  struct thread *t = thread_current ();
+  uint8_t *first = upage;
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++) 
+    {
+      uint8_t *addr = first + i * PGSIZE;
+      struct inode *inode = NULL;
+      struct page *p;
+      off_t ofs = 0;
+      uint32_t read_bytes = 0;
+      size_t slot;
+
+      if (pagedir_get_swap (t->pagedir, addr, &slot))
+        {
+          page_in (addr, false);
+          continue;
+        }
+
+      /* Take a reference to the inode, since the file could be
+         unmapped as soon as page_lock is released. */
+      lock_acquire (&page_lock);
+      p = flatmap_find (&t->leader->pages, pg_no (addr));
+      if (p != NULL && p->file != NULL
+          && pagedir_get_page (t->pagedir, addr) == NULL)
+        {
+          inode = inode_reopen (file_get_inode (p->file));
+          ofs = p->ofs;
+          read_bytes = p->read_bytes;
+        }
+      lock_release (&page_lock);
+      if (inode != NULL)
+        {
+          inode_prefetch (inode, ofs, read_bytes);
+          inode_close (inode);
+        }
+    }
+}
+
+/* Drops the frames of those of the PAGE_CNT pages starting at
+   UPAGE that are resident and clean, without writing anything
+   to swap, because the running process will not use them soon.
+   Their entries stay, so the next access brings each back from
+   where it came from.  Dirty pages stay too, but become the
+   clock's first candidates for eviction; see frame_drop(). */
+void
+page_dontneed (void *upage, size_t page_cnt) 
+{
+  struct thread *t = thread_current ();
+  uint8_t *first = upage;
+  size_t i;
+
+  lock_acquire (&page_lock);
+  for (i = 0; i < page_cnt; i++) 
+    {
+      struct page *p = flatmap_find (&t->leader->pages,
+                                     pg_no (first) + i);
+
+      if (p != NULL && !p->shared)
+        frame_drop (t->pagedir, p->upage);
+    }
+  lock_release (&page_lock);
+}
+
+/* Reads P's contents from its file into KPAGE. */
+static bool
+read_page (struct page *p, uint8_t *kpage) 
+{
+  if (file_read_at (p->file, kpage, p->read_bytes, p->ofs)
+      != (off_t) p->read_bytes)
+    return false;
+  memset (kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+  return true;
+}
+
+/* Returns a frame holding P's contents, shared with every other
+   process mapping the same page of the same file, and takes a
+   reference to it.  Sets *REUSED to true if the frame was in
+   memory already.  Returns a null pointer if memory is short or
+   the read fails. */
+static void *
+get_shared_frame (struct page *p, bool *reused) 
+{
+  struct inode *inode = file_get_inode (p->file);
+  struct shared_frame key, *sf;
+  struct hash_elem *e;
+  void *kpage;
+
+  key.inumber = inode_get_inumber (inode);
+  key.ofs = p->ofs;
+  key.read_bytes = p->read_bytes;
+  key.version = inode_get_version (inode);
+  key.stale = false;
+
+  lock_acquire (&shared_lock);
+  e = hash_find (&shared_frames, &key.elem);
+  if (e != NULL)
+    {
+      sf = hash_entry (e, struct shared_frame, elem);
+      if (sf->version == key.version)
+        {
+          sf->ref_cnt++;
+          lock_release (&shared_lock);
+          *reused = true;
+          return sf->kpage;
+        }
+      retire_shared_frame (sf);
+    }
+  lock_release (&shared_lock);
+
+  /* Read the page without holding the lock, so that one process
+     waiting on the disk does not hold up others' faults. */
+  sf = malloc (sizeof *sf);
+  kpage = palloc_get_page (PAL_USER);
+  if (sf == NULL || kpage == NULL || !read_page (p, kpage))
+    {
+      free (sf);
+      palloc_free_page (kpage);
+      return NULL;
+    }
+  *sf = key;
+  sf->kpage = kpage;
+  sf->ref_cnt = 1;
+
+  /* Someone else may have read the same page meanwhile.  If so,
+     use theirs, unless it is from another version of the file, in
+     which case whichever is older goes stale at the next fault. */
+  lock_acquire (&shared_lock);
+  e = hash_insert (&shared_frames, &sf->elem);
+  if (e != NULL)
+    {
+      struct shared_frame *other = hash_entry (e, struct shared_frame, elem);
+
+      if (other->version == sf->version)
+        {
+          free (sf);
+          palloc_free_page (kpage);
+          sf = other;
+          sf->ref_cnt++;
+        }
+      else
+        {
+          retire_shared_frame (other);
+          hash_insert (&shared_frames, &sf->elem);
+        }
+    }
+  lock_release (&shared_lock);
+  return sf->kpage;
+}
+
+/* Returns the shared frame KPAGE, which holds P's contents and
+   may have gone stale.  The caller must hold shared_lock. */
+static struct shared_frame *
+find_shared_frame (struct page *p, void *kpage) 
+{
+  struct shared_frame key, *sf;
+  struct hash_elem *e;
+  struct list_elem *le;
+
+  key.inumber = inode_get_inumber (file_get_inode (p->file));
+  key.ofs = p->ofs;
+  key.read_bytes = p->read_bytes;
+
+  e = hash_find (&shared_frames, &key.elem);
+  if (e != NULL && hash_entry (e, struct shared_frame, elem)->kpage == kpage)
+    return hash_entry (e, struct shared_frame, elem);
+  for (le = list_begin (&stale_frames); le != list_end (&stale_frames);
+       le = list_next (le))
+    {
+      sf = list_entry (le, struct shared_frame, stale_elem);
+      if (sf->kpage == kpage)
+        return sf;
+    }
+  NOT_REACHED ();
+}
+
+/* Moves shared frame SF, whose file has been written since SF
+   was read, out of the table and onto the list of stale frames,
+   where it stays until no process maps it any longer.  The
+   caller must hold shared_lock. */
+static void
+retire_shared_frame (struct shared_frame *sf) 
+{
+  ASSERT (!sf->stale);
+  hash_delete (&shared_frames, &sf->elem);
+  list_push_back (&stale_frames, &sf->stale_elem);
+  sf->stale = true;
+}
+
+/* Takes another reference to shared frame KPAGE, which holds
+   P's contents. */
+static void
+ref_shared_frame (struct page *p, void *kpage) 
+{
+  lock_acquire (&shared_lock);
+  find_shared_frame (p, kpage)->ref_cnt++;
+  lock_release (&shared_lock);
+}
+
+/* Drops P's reference to shared frame KPAGE, freeing the frame
+   when no process maps it any longer. */
+static void
+put_shared_frame (struct page *p, void *kpage) 
+{
+  struct shared_frame *sf;
+
+  lock_acquire (&shared_lock);
+  sf = find_shared_frame (p, kpage);
+  if (--sf->ref_cnt == 0)
+    {
+      if (sf->stale)
+        list_remove (&sf->stale_elem);
+      else
+        hash_delete (&shared_frames, &sf->elem);
+    }
+  else
+    sf = NULL;
+  lock_release (&shared_lock);
+
+  if (sf != NULL)
+    {
+      palloc_free_page (sf->kpage);
+      free (sf);
+    }
+}
+
+/* Returns a hash of shared frame E's inode and offset. */
+static unsigned
+shared_frame_hash (const struct hash_elem *e, void *aux UNUSED) 
+{
+  const struct shared_frame *sf = hash_entry (e, struct shared_frame, elem);
+  return hash_u32 (sf->inumber * 1048583u + sf->ofs);
+}
+
+/* Orders shared frames A and B by inode, offset and length. */
+static bool
+shared_frame_less (const struct hash_elem *a_, const struct hash_elem *b_,
+                   void *aux UNUSED) 
+{
+  const struct shared_frame *a = hash_entry (a_, struct shared_frame, elem);
+  const struct shared_frame *b = hash_entry (b_, struct shared_frame, elem);
+
+  if (a->inumber != b->inumber)
+    return a->inumber < b->inumber;
+  if (a->ofs != b->ofs)
+    return a->ofs < b->ofs;
+  return a->read_bytes < b->read_bytes;
+}
@@ -0,0 +1,38 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct flatmap;
+struct thread;
+
+void page_init (void);
+void page_print_stats (void);
+
+bool page_table_init (void);
+bool page_fork (struct thread *parent);
+void page_table_destroy (struct flatmap *, uint32_t *pd);
+
+bool page_add_file (void *upage, struct file *, off_t ofs,
+                    uint32_t read_bytes, bool writable);
+bool page_add_zero (void *upage, bool writable);
+bool page_add_range (void *upage, struct file *, off_t length);
+void page_remove_range (void *upage, size_t page_cnt);
+void page_willneed (void *upage, size_t page_cnt);
+void page_dontneed (void *upage, size_t page_cnt);
+bool page_in (const void *fault_addr, bool write);
+bool page_unshare (const void *fault_addr);
+bool page_grow_stack (const void *fault_addr, const void *esp, bool write);
+
+/* Most pages page_pin() pins at once. */
+#define PAGE_PIN_MAX 16
+
+size_t page_pin (const void *uaddr, size_t size, bool write,
+                 void *kpages[]);
+void page_unpin (void *kpages[], size_t cnt);
+
+#endif /* vm/page.h */
@@ -0,0 +1,634 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <list.h>
+#include <lzf.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+
+/* Swap space.
+
+   The BLOCK_SWAP device is divided into page-size slots, whose
+   use is tracked in a bitmap.  A page swapped out leaves its
+   slot number behind in its page table entry, which is marked
+   not present, so that the page fault handler can find it
+   without consulting anything else; see pagedir_swap_out().  A
+   forked child shares its parent's swapped-out pages by sharing
+   their slots, so each slot has a reference count.
+
+   The frame table hands over dirty pages SWAP_CLUSTER at a time.
+   They go to a run of adjacent free slots, taken next-fit so
+   that the runs stay long, in a single write request.  Pages
+   evicted together tend to be used together, so on the way back
+   in, swap_in() also reads the neighbouring slots in the same
+   aligned group of SWAP_CLUSTER that hold other pages of the
+   same process, all in one request, and maps them ahead of
+   their faults.
+
+   Slot bookkeeping is short, and fork() must take a reference
+   to a slot at the same moment it copies the page table entry
+   that names it, so it is done with interrupts off.  A write is
+   split in two, so that the frame table need not wait for the
+   disk: swap_out_start() assigns slots and unmaps the pages, and
+   swap_out_finish() writes them, holding swap_lock.  A slot
+   counts the writes pending on it, and a fault on a page that is
+   still being written waits on `write_done' until there are
+   none.  A slot whose last reference goes while it is being
+   written is only freed once the write is done, so that a later
+   write to it cannot overtake the earlier one.
+
+   With -zswap, a cache of compressed pages sits in front of the
+   device, so that a brief overcommit need not touch the disk at
+   all.  swap_out_finish() compresses each page and, if it
+   shrinks to at most half a page and the cache has room, keeps
+   it there instead of writing it.  The page keeps its slot, so
+   its page table entry names it as usual, and swap_in()
+   decompresses it instead of reading the slot.  Compressed pages
+   live in objects from a few slab caches of graded sizes.  When
+   the cache is full, its oldest pages are written out to their
+   slots to make room, leaving it with the pages evicted most
+   recently, which are the likeliest to fault back in.
+
+   The cache changes only under swap_lock, except that
+   free_slot(), which runs with interrupts off and so cannot free
+   memory, moves the page of a slot it frees to `zdead', for the
+   next holder of swap_lock to free.  Pages are attached to and
+   detached from slots with interrupts off as well. */
+
+/* Sectors per page. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A swap slot. */
+struct slot
+  {
+    uint32_t *pd;               /* Page directory it was written from. */
+    void *upage;                /* User page it holds. */
+    unsigned ref_cnt;           /* Page table entries naming it. */
+    unsigned write_cnt;         /* Writes pending, under swap_lock. */
+    struct zpage *zpage;        /* Compressed copy, or null if on disk. */
+  };
+
+/* A compressed page held in memory in place of its slot. */
+struct zpage
+  {
+    struct list_elem elem;      /* Element in `zlru' or `zdead'. */
+    size_t slot;                /* Slot it stands for. */
+    unsigned short size;        /* Bytes of compressed data. */
+    unsigned char class;        /* Index into zclasses[]. */
+    uint8_t data[];             /* Compressed data. */
+  };
+
+/* Compressed pages are kept in objects of graded sizes, each
+   class fitting this many objects into a slab.  Pages that do
+   not compress into the largest class are written to disk. */
+static const unsigned zclass_per_slab[] = {32, 16, 8, 6, 5, 4, 3, 2};
+#define ZCLASS_CNT (sizeof zclass_per_slab / sizeof *zclass_per_slab)
+
+/* Object size for a class holding N objects per slab, leaving
+   room for the slab header. */
+#define ZCLASS_SIZE(N) ((PGSIZE - 64) / (N) & ~7u)
+
+static struct block *swap_block;        /* Swap device. */
+static struct bitmap *used_map;         /* Slots in use. */
+static struct slot *slots;              /* One per slot. */
+static size_t slot_cnt;                 /* Number of slots. */
+static struct lock swap_lock;           /* Held while writing. */
+static struct condition write_done;     /* Signaled after each write. */
+
+/* Most pages of memory for the compressed cache to take up, or 0
+   if there is no cache.  Set by -zswap. */
+size_t swap_cache_pages;
+
+/* Compressed cache. */
+static struct kmem_cache *zclasses[ZCLASS_CNT]; /* One per class. */
+static size_t zclass_size[ZCLASS_CNT];  /* Object size of each class. */
+static char zclass_name[ZCLASS_CNT][16];        /* Cache names. */
+static struct list zlru;                /* Cached pages, oldest first. */
+static struct list zdead;               /* Pages of freed slots. */
+static size_t zbytes, zbytes_max;       /* Bytes in use, and the limit. */
+static uint8_t *zbuf;                   /* Compressor output. */
+static void *zwork;                     /* Compressor scratch. */
+static uint8_t *zbounce;                /* Page being written back. */
+
+/* Statistics. */
+static size_t used_cnt, used_max;       /* Slots in use, and most ever. */
+static unsigned long long out_cnt, write_cnt;   /* Pages, requests out. */
+static unsigned long long in_cnt, read_cnt;     /* Pages, requests in. */
+static unsigned long long around_cnt;   /* Pages read ahead of a fault. */
+static unsigned long long zstore_cnt;   /* Pages kept compressed. */
+static unsigned long long zreject_cnt;  /* Pages that did not compress. */
+static unsigned long long zload_cnt;    /* Faults served compressed. */
+static unsigned long long zback_cnt;    /* Pages written back to disk. */
+
+static size_t alloc_slots (size_t cnt);
+static void free_slot (size_t slot);
+static bool can_read_around (size_t slot, uint32_t *pd);
+static bool get_around_frame (size_t slot, size_t group, void *upages[],
+                              void *kpages[]);
+static void zswap_init (void);
+static bool zswap_store (size_t slot, const void *page);
+static bool zswap_load (size_t slot, void *page);
+
+/* Sets up swap space on the BLOCK_SWAP device, if there is one. */
+void
+swap_init (void) 
+{
+  lock_init (&swap_lock);
+  cond_init (&write_done);
+  swap_block = block_get_role (BLOCK_SWAP);
+  if (swap_block == NULL)
+    return;
+
+  slot_cnt = block_size (swap_block) / SECTORS_PER_SLOT;
+  used_map = bitmap_create (slot_cnt);
+  slots = calloc (slot_cnt, sizeof *slots);
+  if (used_map == NULL || slots == NULL)
+    PANIC ("swap_init: out of memory");
+  if (swap_cache_pages > 0)
+    zswap_init ();
+}
+
+/* Returns true if there is swap space to write pages to. */
+bool
+swap_available (void) 
+{
+  return swap_block != NULL;
+}
+
+/* Starts writing the CNT pages in V, which must all be dirty
+   and have frames in the frame table, to swap, by giving them
+   slots and unmapping them.  Moves the pages unmapped to the
+   front of V and returns how many there are, storing the slot of
+   the first into *FIRST; the caller must pass them to
+   swap_out_finish().  Pages that are no longer
+   mapped where V says, or that do not fit in the longest run of
+   free slots, are left alone.  Does not sleep. */
+size_t
+swap_out_start (struct swap_victim v[], size_t cnt, size_t *first) 
+{
+  enum intr_level old_level;
+  size_t slot, done, i;
+
+  ASSERT (cnt <= SWAP_CLUSTER);
+  if (swap_block == NULL)
+    return 0;
+
+  slot = BITMAP_ERROR;
+  for (; cnt > 0; cnt--)
+    if ((slot = alloc_slots (cnt)) != BITMAP_ERROR)
+      break;
+
+  done = 0;
+  for (i = 0; i < cnt; i++)
+    if (pagedir_swap_out (v[i].pd, v[i].upage, v[i].kpage, slot + done)) 
+      {
+        old_level = intr_disable ();
+        slots[slot + done].pd = v[i].pd;
+        slots[slot + done].upage = v[i].upage;
+        slots[slot + done].write_cnt++;
+        intr_set_level (old_level);
+        v[done++] = v[i];
+      }
+  for (i = done; i < cnt; i++)
+    swap_unref (slot + i, NULL);
+  *first = slot;
+  return done;
+}
+
+/* Writes the CNT pages in V, as returned by swap_out_start(),
+   to the slots starting at FIRST, or to the compressed cache.
+   Their frames are then free for reuse. */
+void
+swap_out_finish (const struct swap_victim v[], size_t cnt, size_t first) 
+{
+  const void *sectors[SWAP_CLUSTER * SECTORS_PER_SLOT];
+  bool cached[SWAP_CLUSTER];
+  enum intr_level old_level;
+  size_t writes = 0;
+  size_t i, j, k;
+
+  ASSERT (cnt > 0 && cnt <= SWAP_CLUSTER);
+
+  lock_acquire (&swap_lock);
+  for (i = 0; i < cnt; i++)
+    cached[i] = zswap_store (first + i, v[i].kpage);
+
+  /* Write the rest, one request per run of adjacent slots. */
+  for (i = 0; i < cnt; i = j) 
+    {
+      for (j = i; j < cnt && !cached[j]; j++)
+        for (k = 0; k < SECTORS_PER_SLOT; k++)
+          sectors[(j - i) * SECTORS_PER_SLOT + k]
+            = (uint8_t *) v[j].kpage + k * BLOCK_SECTOR_SIZE;
+      if (j > i)
+        {
+          block_writev (swap_block, (first + i) * SECTORS_PER_SLOT,
+                        sectors, (j - i) * SECTORS_PER_SLOT);
+          writes++;
+        }
+      else
+        j++;
+    }
+
+  old_level = intr_disable ();
+  for (i = first; i < first + cnt; i++)
+    if (--slots[i].write_cnt == 0 && slots[i].ref_cnt == 0)
+      free_slot (i);
+  out_cnt += cnt;
+  write_cnt += writes;
+  intr_set_level (old_level);
+  cond_broadcast (&write_done, &swap_lock);
+  lock_release (&swap_lock);
+}
+
+/* Brings user page UPAGE of the running process back in from
+   swap SLOT, which its page table entry names, along with any of
+   its neighbours that can come too.  Returns false if memory is
+   short. */
+bool
+swap_in (void *upage, size_t slot) 
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  void *sectors[SWAP_CLUSTER * SECTORS_PER_SLOT];
+  void *kpages[SWAP_CLUSTER];
+  void *upages[SWAP_CLUSTER];
+  size_t group, first, last, i, j;
+  enum intr_level old_level;
+  bool cached, read;
+
+  ASSERT (swap_block != NULL);
+  ASSERT (slot < slot_cnt);
+
+  /* Wait for SLOT to be written, if it is still in progress. */
+  lock_acquire (&swap_lock);
+  while (slots[slot].write_cnt > 0)
+    cond_wait (&write_done, &swap_lock);
+  cached = slots[slot].zpage != NULL;
+  lock_release (&swap_lock);
+
+  /* Find the run of slots around SLOT, within its group, that
+     can be read along with it.  A compressed page comes in
+     alone. */
+  group = slot - slot % SWAP_CLUSTER;
+  first = last = slot;
+  while (!cached && first > group && can_read_around (first - 1, pd))
+    first--;
+  while (!cached && last + 1 < group + SWAP_CLUSTER && last + 1 < slot_cnt
+         && can_read_around (last + 1, pd))
+    last++;
+
+  /* Get frames.  The faulting page may evict others, but the
+     pages read ahead only take frames that are already free.
+     The arrays are indexed relative to GROUP. */
+  upages[slot - group] = upage;
+  kpages[slot - group] = frame_alloc (0, upage);
+  if (kpages[slot - group] == NULL)
+    return false;
+  for (i = slot + 1; i <= last; i++)
+    if (!get_around_frame (i, group, upages, kpages))
+      {
+        last = i - 1;
+        break;
+      }
+  for (i = slot; i-- > first; )
+    if (!get_around_frame (i, group, upages, kpages))
+      {
+        first = i + 1;
+        break;
+      }
+
+  /* The page may have been written back from the cache while we
+     waited for a frame. */
+  read = !cached || !zswap_load (slot, kpages[slot - group]);
+  if (read)
+    {
+      for (i = first; i <= last; i++)
+        for (j = 0; j < SECTORS_PER_SLOT; j++)
+          sectors[(i - first) * SECTORS_PER_SLOT + j]
+            = (uint8_t *) kpages[i - group] + j * BLOCK_SECTOR_SIZE;
+      block_readv (swap_block, first * SECTORS_PER_SLOT, sectors,
+                   (last - first + 1) * SECTORS_PER_SLOT);
+    }
+
+  /* Map the pages whose entries still name their slots.  Another
+     thread of the process may have brought some in meanwhile. */
+  for (i = first; i <= last; i++)
+    if (pagedir_swap_in (pd, upages[i - group], i, kpages[i - group]))
+      swap_unref (i, pd);
+    else
+      frame_free (kpages[i - group]);
+
+  old_level = intr_disable ();
+  in_cnt += last - first + 1;
+  around_cnt += last - first;
+  if (read)
+    read_cnt++;
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Gets a frame for reading SLOT ahead of a fault, into UPAGES[]
+   and KPAGES[] at SLOT's index relative to GROUP.  Returns false
+   if no frame is free. */
+static bool
+get_around_frame (size_t slot, size_t group, void *upages[],
+                  void *kpages[]) 
+{
+  upages[slot - group] = slots[slot].upage;
+  kpages[slot - group] = frame_try_alloc (upages[slot - group]);
+  return kpages[slot - group] != NULL;
+}
+
+/* Adds a reference to SLOT, for fork(). */
+void
+swap_ref (size_t slot) 
+{
+  enum intr_level old_level;
+
+  ASSERT (slot < slot_cnt);
+  old_level = intr_disable ();
+  ASSERT (slots[slot].ref_cnt > 0);
+  slots[slot].ref_cnt++;
+  intr_set_level (old_level);
+}
+
+/* Drops a reference to SLOT from page directory PD, freeing the
+   slot once nothing names it. */
+void
+swap_unref (size_t slot, uint32_t *pd) 
+{
+  enum intr_level old_level;
+  struct slot *s;
+
+  ASSERT (slot < slot_cnt);
+  old_level = intr_disable ();
+  s = &slots[slot];
+  ASSERT (s->ref_cnt > 0);
+  if (s->pd == pd)
+    s->pd = NULL;
+  if (--s->ref_cnt == 0 && s->write_cnt == 0)
+    free_slot (slot);
+  intr_set_level (old_level);
+}
+
+/* Frees SLOT.  Interrupts must be off. */
+static void
+free_slot (size_t slot) 
+{
+  struct zpage *z = slots[slot].zpage;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (z != NULL)
+    {
+      list_remove (&z->elem);
+      list_push_back (&zdead, &z->elem);
+      slots[slot].zpage = NULL;
+    }
+  bitmap_reset (used_map, slot);
+  used_cnt--;
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void) 
+{
+  if (swap_block == NULL)
+    return;
+  printf ("Swap: %zu of %zu slots in use, %zu max\n",
+          used_cnt, slot_cnt, used_max);
+  printf ("Swap: %llu pages out in %llu writes, "
+          "%llu pages in in %llu reads (%llu read around)\n",
+          out_cnt, write_cnt, in_cnt, read_cnt, around_cnt);
+  if (zbytes_max > 0)
+    printf ("Swap: %zu of %zu kB compressed cache in use, "
+            "%llu pages kept, %llu not compressible, "
+            "%llu faults served, %llu written back\n",
+            zbytes / 1024, zbytes_max / 1024, zstore_cnt, zreject_cnt,
+            zload_cnt, zback_cnt);
+}
+
+/* Allocates CNT adjacent free slots, each with one reference,
+   and returns the first, or BITMAP_ERROR if there is no such
+   run. */
+static size_t
+alloc_slots (size_t cnt) 
+{
+  enum intr_level old_level;
+  size_t slot, i;
+
+  old_level = intr_disable ();
+  slot = bitmap_scan_and_flip_next (used_map, cnt, false);
+  if (slot != BITMAP_ERROR)
+    {
+      for (i = 0; i < cnt; i++)
+        {
+          slots[slot + i].pd = NULL;
+          slots[slot + i].ref_cnt = 1;
+        }
+      used_cnt += cnt;
+      if (used_cnt > used_max)
+        used_max = used_cnt;
+    }
+  intr_set_level (old_level);
+  return slot;
+}
+
+/* Returns true if SLOT holds a page that PD alone still has
+   swapped out there, so that it can be read in along with a
+   neighbour. */
+static bool
+can_read_around (size_t slot, uint32_t *pd) 
+{
+  enum intr_level old_level;
+  size_t pte_slot;
+  bool ok;
+
+  old_level = intr_disable ();
+  ok = (bitmap_test (used_map, slot)
+        && slots[slot].pd == pd && slots[slot].ref_cnt == 1
+        && slots[slot].write_cnt == 0 && slots[slot].zpage == NULL
+        && pagedir_get_swap (pd, slots[slot].upage, &pte_slot)
+        && pte_slot == slot);
+  intr_set_level (old_level);
+  return ok;
+}
+
+/* Sets up the compressed cache, with room for swap_cache_pages
+   pages of compressed data. */
+static void
+zswap_init (void) 
+{
+  size_t i;
+
+  list_init (&zlru);
+  list_init (&zdead);
+  for (i = 0; i < ZCLASS_CNT; i++)
+    {
+      zclass_size[i] = ZCLASS_SIZE (zclass_per_slab[i]);
+      snprintf (zclass_name[i], sizeof zclass_name[i], "zswap-%zu",
+                zclass_size[i]);
+      zclasses[i] = kmem_cache_create (zclass_name[i], zclass_size[i], 0,
+                                       NULL);
+      if (zclasses[i] == NULL)
+        PANIC ("swap_init: out of memory");
+    }
+  zbuf = palloc_get_page (PAL_ASSERT);
+  zwork = palloc_get_page (PAL_ASSERT);
+  zbounce = palloc_get_page (PAL_ASSERT);
+  zbytes_max = swap_cache_pages * PGSIZE;
+}
+
+/* Frees compressed page Z.  swap_lock must be held. */
+static void
+zpage_free (struct zpage *z) 
+{
+  zbytes -= zclass_size[z->class];
+  kmem_cache_free (zclasses[z->class], z);
+}
+
+/* Frees the compressed pages of slots freed since the last call.
+   swap_lock must be held. */
+static void
+zswap_reap (void) 
+{
+  for (;;) 
+    {
+      enum intr_level old_level = intr_disable ();
+      struct zpage *z = (list_empty (&zdead) ? NULL
+                         : list_entry (list_pop_front (&zdead),
+                                       struct zpage, elem));
+      intr_set_level (old_level);
+
+      if (z == NULL)
+        break;
+      zpage_free (z);
+    }
+}
+
+/* Decompresses Z into PAGE, which must be PGSIZE bytes. */
+static void
+zpage_decompress (const struct zpage *z, void *page) 
+{
+  if (!lzf_decompress (z->data, z->size, page, PGSIZE))
+    PANIC ("swap: compressed page for slot %zu is corrupt", z->slot);
+}
+
+/* Writes the oldest page in the compressed cache to its slot and
+   frees its memory.  Returns false if the cache is empty.
+   swap_lock must be held. */
+static bool
+zswap_write_back (void) 
+{
+  const void *sectors[SECTORS_PER_SLOT];
+  enum intr_level old_level;
+  struct zpage *z;
+  size_t i;
+
+  old_level = intr_disable ();
+  if (list_empty (&zlru))
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  z = list_entry (list_pop_front (&zlru), struct zpage, elem);
+  slots[z->slot].zpage = NULL;
+  slots[z->slot].write_cnt++;
+  intr_set_level (old_level);
+
+  zpage_decompress (z, zbounce);
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    sectors[i] = zbounce + i * BLOCK_SECTOR_SIZE;
+  block_writev (swap_block, z->slot * SECTORS_PER_SLOT, sectors,
+                SECTORS_PER_SLOT);
+
+  old_level = intr_disable ();
+  if (--slots[z->slot].write_cnt == 0 && slots[z->slot].ref_cnt == 0)
+    free_slot (z->slot);
+  write_cnt++;
+  zback_cnt++;
+  intr_set_level (old_level);
+  zpage_free (z);
+  return true;
+}
+
+/* Keeps PAGE, which is to go to SLOT, compressed in the cache
+   instead, writing back the oldest pages in the cache to make
+   room if necessary.  Returns true if successful, false if there
+   is no cache, PAGE does not compress to half a page, or memory
+   is short, in which case the caller must write PAGE to SLOT.
+   swap_lock must be held. */
+static bool
+zswap_store (size_t slot, const void *page) 
+{
+  const size_t data_ofs = offsetof (struct zpage, data);
+  enum intr_level old_level;
+  struct zpage *z;
+  size_t size, class;
+
+  if (zbytes_max == 0)
+    return false;
+  zswap_reap ();
+
+  size = lzf_compress (page, PGSIZE, zbuf,
+                       zclass_size[ZCLASS_CNT - 1] - data_ofs, zwork);
+  if (size == 0)
+    {
+      zreject_cnt++;
+      return false;
+    }
+  for (class = 0; data_ofs + size > zclass_size[class]; class++)
+    continue;
+
+  while (zbytes + zclass_size[class] > zbytes_max && zswap_write_back ())
+    continue;
+  if (zbytes + zclass_size[class] > zbytes_max)
+    return false;
+  z = kmem_cache_alloc (zclasses[class]);
+  if (z == NULL)
+    return false;
+  z->slot = slot;
+  z->size = size;
+  z->class = class;
+  memcpy (z->data, zbuf, size);
+  zbytes += zclass_size[class];
+  zstore_cnt++;
+
+  old_level = intr_disable ();
+  slots[slot].zpage = z;
+  list_push_back (&zlru, &z->elem);
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Decompresses the page in SLOT into PAGE and returns true, if
+   it is in the compressed cache, otherwise returns false.  The
+   compressed copy stays until the slot is freed, since a forked
+   process may share it. */
+static bool
+zswap_load (size_t slot, void *page) 
+{
+  bool found;
+
+  lock_acquire (&swap_lock);
+  while (slots[slot].write_cnt > 0)
+    cond_wait (&write_done, &swap_lock);
+  zswap_reap ();
+  found = slots[slot].zpage != NULL;
+  if (found)
+    {
+      zpage_decompress (slots[slot].zpage, page);
+      zload_cnt++;
+    }
+  lock_release (&swap_lock);
+  return found;
+}
@@ -0,0 +1,30 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Most pages written out, or read back in, by one request. */
+#define SWAP_CLUSTER 8
+
+/* A page to be swapped out. */
+struct swap_victim
+  {
+    uint32_t *pd;               /* Page directory mapping it. */
+    void *upage;                /* User page. */
+    void *kpage;                /* Frame it occupies. */
+  };
+
+extern size_t swap_cache_pages;
+
+void swap_init (void);
+bool swap_available (void);
+size_t swap_out_start (struct swap_victim[], size_t cnt, size_t *first);
+void swap_out_finish (const struct swap_victim[], size_t cnt, size_t first);
+bool swap_in (void *upage, size_t slot);
+void swap_ref (size_t slot);
+void swap_unref (size_t slot, uint32_t *pd);
+void swap_print_stats (void);
+
+#endif /* vm/swap.h */